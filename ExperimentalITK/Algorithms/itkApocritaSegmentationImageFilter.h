@@ -94,6 +94,8 @@ public:
   typedef Array<double>                               ParametersType;
   typedef FixedArray<unsigned,
     itkGetStaticConstMacro( ImageDimension )>         ArrayType;
+  typedef typename ClassifiedImageType::IndexType     IndexType;
+  typedef typename ClassifiedImageType::OffsetType    OffsetType;
 
   /** B-spline fitting typedefs */
   typedef Vector<RealType, 1>                         ScalarType;
@@ -152,6 +154,12 @@ public:
   itkSetMacro( NumberOfControlPoints, ArrayType );
   itkGetConstMacro( NumberOfControlPoints, ArrayType );
 
+  /**
+   * The posteriors and priors are always stored for the masked voxels only.
+   * Minimizing the memory usage additionally drops the cached MRF
+   * neighborhood class weights, which are then recomputed at every
+   * iteration.
+   */
   itkSetMacro( MinimizeMemoryUsage, bool );
   itkGetConstMacro( MinimizeMemoryUsage, bool );
   itkBooleanMacro( MinimizeMemoryUsage );
@@ -229,6 +237,33 @@ private:
 
   RealType UpdateClassParametersAndLabeling();
 
+  enum EMStageType { MRFInitializationStage, ExpectationStage };
+
+  struct EMThreadStruct
+    {
+    ApocritaSegmentationImageFilter *Filter;
+    EMStageType                      Stage;
+    };
+
+  static ITK_THREAD_RETURN_TYPE EMThreaderCallback( void *arg );
+
+  /** Runs one pass over the masked voxels on the threads. */
+  void ExecuteEMStage( EMStageType stage );
+
+  void ThreadedInitializeMRFWeights( ThreadIdType threadId,
+    ThreadIdType numberOfThreads );
+  void ThreadedExpectation( ThreadIdType threadId,
+    ThreadIdType numberOfThreads );
+
+  void InitializeMaskedVoxels();
+  void ComputeDistancePriorProbabilities();
+  void ComputeMRFWeights( SizeValueType voxel, RealType *classWeights,
+    RealType &totalWeight );
+  void UpdateMRFWeights( SizeValueType voxel, LabelType oldLabel,
+    LabelType newLabel );
+  typename RealImageType::Pointer ExpandMaskedValues(
+    const std::vector<RealType> &values, unsigned int whichClass );
+
   unsigned int                                  m_NumberOfClasses;
   unsigned int                                  m_ElapsedIterations;
   unsigned int                                  m_MaximumNumberOfIterations;
@@ -254,14 +289,33 @@ private:
   std::vector<typename
     ControlPointLatticeType::Pointer>           m_ControlPointLattices;
 
-  typename RealImageType::Pointer               m_SumDistancePriorProbabilityImage;
-  typename RealImageType::Pointer               m_SumPosteriorProbabilityImage;
   bool                                          m_MinimizeMemoryUsage;
-
-  std::vector<typename RealImageType::Pointer>  m_PosteriorProbabilityImages;
-  std::vector<typename RealImageType::Pointer>  m_DistancePriorProbabilityImages;
   bool                                          m_UseEuclideanDistanceForPriorLabels;
 
+  /**
+   * Compact storage of the masked voxels.  The per-class arrays are laid out
+   * class by class, i.e. the value of class c at masked voxel i is found at
+   * c * numberOfMaskedVoxels + i.
+   */
+  std::vector<OffsetValueType>                  m_MaskedVoxelOffsets;
+  std::vector<RealType>                         m_MaskedIntensities;
+  std::vector<LabelType>                        m_UpdatedLabels;
+  std::vector<RealType>                         m_PosteriorProbabilities;
+  std::vector<RealType>                         m_DistancePriorProbabilities;
+  std::vector<const RealType *>                 m_PriorProbabilityBuffers;
+
+  std::vector<OffsetType>                       m_MRFNeighborhoodOffsets;
+  std::vector<OffsetValueType>                  m_MRFNeighborhoodBufferOffsets;
+  std::vector<RealType>                         m_MRFNeighborhoodWeights;
+  std::vector<RealType>                         m_MRFClassWeights;
+  std::vector<RealType>                         m_MRFTotalWeights;
+
+  std::vector<std::vector<double> >             m_ThreadSumPosteriors;
+  std::vector<std::vector<double> >             m_ThreadProportionDenominators;
+  std::vector<std::vector<double> >             m_ThreadClassWeights;
+  std::vector<std::vector<double> >             m_ThreadClassMeans;
+  std::vector<std::vector<double> >             m_ThreadClassSquaredDeviations;
+
 };
 
 } // namespace itk
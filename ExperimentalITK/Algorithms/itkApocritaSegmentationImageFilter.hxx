@@ -24,7 +24,6 @@
 #include "itkBinaryContourImageFilter.h"
 #include "itkBinaryThresholdImageFilter.h"
 #include "itkBSplineControlPointImageFilter.h"
-#include "itkConstNeighborhoodIterator.h"
 #include "itkEuclideanDistance.h"
 #include "itkFastMarchingImageFilter.h"
 #include "itkGaussianMixtureModelComponent.h"
@@ -81,8 +80,8 @@ ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
   this->m_NumberOfControlPoints.Fill( this->m_SplineOrder + 1 );
 
   this->m_MinimizeMemoryUsage = false;
-  this->m_PosteriorProbabilityImages.clear();
-  this->m_DistancePriorProbabilityImages.clear();
+  this->m_PosteriorProbabilities.clear();
+  this->m_DistancePriorProbabilities.clear();
   this->m_UseEuclideanDistanceForPriorLabels = false;
 }
 
@@ -176,6 +175,11 @@ ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
 ::GenerateData()
 {
   this->GenerateInitialClassLabeling();
+  this->InitializeMaskedVoxels();
+  if( this->m_InitializationStrategy == PriorLabelImage )
+    {
+    this->ComputeDistancePriorProbabilities();
+    }
 
   /**
    * Iterate until convergence or iterative exhaustion.
@@ -189,12 +193,6 @@ ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
   unsigned int iteration = 0;
   while( !isConverged && iteration++ < this->m_MaximumNumberOfIterations )
     {
-    /**
-     * Clear the current posterior probability images to force
-     * recalculation of the posterior probability images.
-     */
-    this->m_PosteriorProbabilityImages.clear();
-
     TimeProbe timer;
     timer.Start();
     probabilityNew = this->UpdateClassParametersAndLabeling();
@@ -653,962 +651,838 @@ ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
 }
 
 template <class TInputImage, class TMaskImage, class TClassifiedImage>
-typename ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
-::RealType
+void
 ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
-::UpdateClassParametersAndLabeling()
+::InitializeMaskedVoxels()
 {
-  typename RealImageType::Pointer maxProbabilityImage =
-    RealImageType::New();
-  maxProbabilityImage->SetRegions( this->GetOutput()->GetRequestedRegion() );
-  maxProbabilityImage->SetOrigin( this->GetOutput()->GetOrigin() );
-  maxProbabilityImage->SetSpacing( this->GetOutput()->GetSpacing() );
-  maxProbabilityImage->SetDirection( this->GetOutput()->GetDirection() );
-  maxProbabilityImage->Allocate();
-  maxProbabilityImage->FillBuffer( NumericTraits<RealType>::Zero );
-
-  typename ClassifiedImageType::Pointer maxLabels =
-    ClassifiedImageType::New();
-  maxLabels->SetRegions( this->GetOutput()->GetRequestedRegion() );
-  maxLabels->SetOrigin( this->GetOutput()->GetOrigin() );
-  maxLabels->SetSpacing( this->GetOutput()->GetSpacing() );
-  maxLabels->SetDirection( this->GetOutput()->GetDirection() );
-  maxLabels->Allocate();
-  maxLabels->FillBuffer( NumericTraits<LabelType>::Zero );
-
-  typename RealImageType::Pointer weightedPriorProbabilityImage =
-    RealImageType::New();
-  weightedPriorProbabilityImage->SetRegions(
-    this->GetOutput()->GetRequestedRegion() );
-  weightedPriorProbabilityImage->SetOrigin( this->GetOutput()->GetOrigin() );
-  weightedPriorProbabilityImage->SetSpacing( this->GetOutput()->GetSpacing() );
-  weightedPriorProbabilityImage->SetDirection(
-    this->GetOutput()->GetDirection() );
-  weightedPriorProbabilityImage->Allocate();
-  weightedPriorProbabilityImage->FillBuffer( NumericTraits<RealType>::Zero );
+  const ClassifiedImageType *output = this->GetOutput();
 
-  ParametersType sumPosteriors( this->m_NumberOfClasses );
-  sumPosteriors.Fill( 0.0 );
-
-  for( unsigned int n = 0; n < this->m_NumberOfClasses; n++ )
+  /**
+   * Only the voxels inside the mask take part in the EM iterations, so they
+   * are indexed once by their buffer offset in the output image.  All the
+   * per-voxel quantities (intensities, posteriors, priors and MRF weights)
+   * are then stored in compact arrays parallel to this list.
+   */
+  SizeValueType numberOfMaskedVoxels = 0;
+  ImageRegionConstIteratorWithIndex<ClassifiedImageType> ItO( output,
+    output->GetRequestedRegion() );
+  for( ItO.GoToBegin(); !ItO.IsAtEnd(); ++ItO )
     {
-    typename RealImageType::Pointer posteriorProbabilityImage
-      = this->GetPosteriorProbabilityImage( n + 1 );
-
-    ImageRegionIteratorWithIndex<ClassifiedImageType> ItO( maxLabels,
-      maxLabels->GetRequestedRegion() );
-    ImageRegionConstIterator<RealImageType> ItP( posteriorProbabilityImage,
-      posteriorProbabilityImage->GetRequestedRegion() );
-    ImageRegionIterator<RealImageType> ItM( maxProbabilityImage,
-      maxProbabilityImage->GetRequestedRegion() );
-
-    ItP.GoToBegin();
-    ItM.GoToBegin();
-    ItO.GoToBegin();
-    while( !ItP.IsAtEnd() )
+    if( !this->GetMaskImage() || this->GetMaskImage()->GetPixel(
+      ItO.GetIndex() ) == this->m_MaskLabel )
       {
-      if( !this->GetMaskImage() || this->GetMaskImage()->GetPixel(
-        ItO.GetIndex() ) == this->m_MaskLabel )
-        {
-        if( ItP.Get() >= ItM.Get() )
-          {
-          ItM.Set( ItP.Get() );
-          ItO.Set( static_cast<LabelType>( n + 1 ) );
-          }
-        sumPosteriors[n] += ItP.Get();
-        }
-      ++ItP;
-      ++ItM;
-      ++ItO;
+      numberOfMaskedVoxels++;
       }
+    }
 
-    // Perform the following calculation to update the class proportions
-    typename RealImageType::Pointer distancePriorProbabilityImage = NULL;
-    typename RealImageType::ConstPointer priorProbabilityImage = NULL;
+  this->m_MaskedVoxelOffsets.clear();
+  this->m_MaskedVoxelOffsets.reserve( numberOfMaskedVoxels );
+  this->m_MaskedIntensities.clear();
+  this->m_MaskedIntensities.reserve( numberOfMaskedVoxels );
 
-    if( this->m_InitializationStrategy == PriorProbabilityImages )
+  /**
+   * Only the masked voxels are relabeled during the iterations, so the
+   * initial labels outside the mask are cleared here, before they can enter
+   * the MRF weights or the final segmentation.
+   */
+  LabelType *labels = this->GetOutput()->GetBufferPointer();
+
+  for( ItO.GoToBegin(); !ItO.IsAtEnd(); ++ItO )
+    {
+    if( !this->GetMaskImage() || this->GetMaskImage()->GetPixel(
+      ItO.GetIndex() ) == this->m_MaskLabel )
       {
-      priorProbabilityImage = const_cast<RealImageType *>(
-        this->GetPriorProbabilityImage( n + 1 ) );
+      this->m_MaskedVoxelOffsets.push_back(
+        output->ComputeOffset( ItO.GetIndex() ) );
+      this->m_MaskedIntensities.push_back( static_cast<RealType>(
+        this->GetInput()->GetPixel( ItO.GetIndex() ) ) );
       }
-    else if( this->m_InitializationStrategy == PriorLabelImage )
+    else
       {
-      distancePriorProbabilityImage
-        = this->GetDistancePriorProbabilityImageFromPriorLabelImage( n + 1 );
+      labels[output->ComputeOffset( ItO.GetIndex() )] =
+        NumericTraits<LabelType>::Zero;
       }
+    }
 
-    ImageRegionIteratorWithIndex<RealImageType> ItW(
-      weightedPriorProbabilityImage,
-      weightedPriorProbabilityImage->GetRequestedRegion() );
-    for( ItW.GoToBegin(); !ItW.IsAtEnd(); ++ItW )
+  this->m_PosteriorProbabilities.clear();
+  this->m_DistancePriorProbabilities.clear();
+  this->m_UpdatedLabels.assign( numberOfMaskedVoxels,
+    NumericTraits<LabelType>::Zero );
+
+  /**
+   * The prior probability images are read directly from their buffers so
+   * they have to share the buffered region of the output.
+   */
+  this->m_PriorProbabilityBuffers.clear();
+  if( this->m_InitializationStrategy == PriorProbabilityImages )
+    {
+    for( unsigned int n = 0; n < this->m_NumberOfClasses; n++ )
       {
-      if( !this->GetMaskImage() || this->GetMaskImage()->GetPixel(
-        ItW.GetIndex() ) == this->m_MaskLabel )
+      const RealImageType *priorProbabilityImage =
+        this->GetPriorProbabilityImage( n + 1 );
+      if( !priorProbabilityImage )
         {
-        RealType priorProbability = 1.0;
-        if( priorProbabilityImage )
-          {
-          priorProbability = priorProbabilityImage->GetPixel( ItW.GetIndex() );
-          }
-        else if( distancePriorProbabilityImage )
-          {
-          priorProbability =
-            distancePriorProbabilityImage->GetPixel( ItW.GetIndex() );
-          }
-        ItW.Set( ItW.Get() + this->m_CurrentClassParameters[n][2] *
-          priorProbability );
+        this->m_PriorProbabilityBuffers.clear();
+        break;
         }
+      if( priorProbabilityImage->GetBufferedRegion() !=
+        output->GetBufferedRegion() )
+        {
+        itkExceptionMacro( "The buffered region of prior probability image "
+          << n + 1 << " does not match that of the output." );
+        }
+      this->m_PriorProbabilityBuffers.push_back(
+        priorProbabilityImage->GetBufferPointer() );
       }
     }
 
-  // Update the class proportions
-  for( unsigned int n = 0; n < this->m_NumberOfClasses; n++ )
-    {
-    RealType denominator = 0.0;
-
-    typename RealImageType::Pointer distancePriorProbabilityImage = NULL;
-    typename RealImageType::ConstPointer priorProbabilityImage = NULL;
+  /**
+   * Neighborhood of the MRF prior (the center voxel excluded) with each
+   * neighbor weighted by its inverse physical distance.
+   */
+  this->m_MRFNeighborhoodOffsets.clear();
+  this->m_MRFNeighborhoodBufferOffsets.clear();
+  this->m_MRFNeighborhoodWeights.clear();
 
-    if( this->m_InitializationStrategy == PriorProbabilityImages )
+  unsigned int neighborhoodSize = 1;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    neighborhoodSize *= ( 2 * this->m_MRFRadius[d] + 1 );
+    }
+  for( unsigned int n = 0; n < neighborhoodSize; n++ )
+    {
+    if( n == static_cast<unsigned int>( 0.5 * neighborhoodSize ) )
       {
-      priorProbabilityImage = const_cast<RealImageType *>(
-        this->GetPriorProbabilityImage( n + 1 ) );
+      continue;
       }
-    else if( this->m_InitializationStrategy == PriorLabelImage )
+    OffsetType offset;
+    OffsetValueType bufferOffset = 0;
+    double distance = 0.0;
+    unsigned int stride = 1;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
       {
-      distancePriorProbabilityImage
-        = this->GetDistancePriorProbabilityImageFromPriorLabelImage( n + 1 );
-      }
+      unsigned int width = 2 * this->m_MRFRadius[d] + 1;
+      offset[d] = static_cast<OffsetValueType>( ( n / stride ) % width )
+        - static_cast<OffsetValueType>( this->m_MRFRadius[d] );
+      stride *= width;
 
-    ImageRegionIteratorWithIndex<RealImageType> ItW(
-      weightedPriorProbabilityImage,
-      weightedPriorProbabilityImage->GetRequestedRegion() );
-    for( ItW.GoToBegin(); !ItW.IsAtEnd(); ++ItW )
-      {
-      if( !this->GetMaskImage() || this->GetMaskImage()->GetPixel(
-        ItW.GetIndex() ) == this->m_MaskLabel )
-        {
-        RealType priorProbability = 1.0;
-        if( priorProbabilityImage )
-          {
-          priorProbability = priorProbabilityImage->GetPixel( ItW.GetIndex() );
-          }
-        else if( distancePriorProbabilityImage )
-          {
-          priorProbability =
-            distancePriorProbabilityImage->GetPixel( ItW.GetIndex() );
-          }
-        denominator += ( priorProbability / ItW.Get() );
-        }
-      }
-    if( denominator > 0.0 )
-      {
-      this->m_CurrentClassParameters[n][2] = sumPosteriors[n] / denominator;
-      }
-    else
-      {
-      this->m_CurrentClassParameters[n][2] = 0.0;
+      bufferOffset += offset[d] * output->GetOffsetTable()[d];
+      distance += vnl_math_sqr( offset[d] * output->GetSpacing()[d] );
       }
+    this->m_MRFNeighborhoodOffsets.push_back( offset );
+    this->m_MRFNeighborhoodBufferOffsets.push_back( bufferOffset );
+    this->m_MRFNeighborhoodWeights.push_back(
+      static_cast<RealType>( 1.0 / vcl_sqrt( distance ) ) );
     }
 
-  // now update the class means and variances
+  /**
+   * Unless memory usage is to be minimized, the weighted class counts of
+   * each neighborhood are cached and only updated around the voxels whose
+   * labels change.
+   */
+  this->m_MRFClassWeights.clear();
+  this->m_MRFTotalWeights.clear();
+  if( this->m_MRFSmoothingFactor > 0.0 && !this->m_MinimizeMemoryUsage )
+    {
+    this->m_MRFClassWeights.assign(
+      this->m_NumberOfClasses * numberOfMaskedVoxels, 0.0 );
+    this->m_MRFTotalWeights.assign( numberOfMaskedVoxels, 0.0 );
+    this->ExecuteEMStage( MRFInitializationStage );
+    }
+}
 
-  vnl_vector<RealType> N( this->m_NumberOfClasses );
-  N.fill( 0.0 );
+template <class TInputImage, class TMaskImage, class TClassifiedImage>
+void
+ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
+::ExecuteEMStage( EMStageType stage )
+{
+  EMThreadStruct str;
+  str.Filter = this;
+  str.Stage = stage;
 
-  ImageRegionIteratorWithIndex<ClassifiedImageType> ItO( maxLabels,
-    maxLabels->GetRequestedRegion() );
-  ImageRegionIterator<RealImageType> ItM( maxProbabilityImage,
-    maxProbabilityImage->GetRequestedRegion() );
-  ImageRegionConstIterator<ImageType> ItI( this->GetInput(),
-    this->GetInput()->GetRequestedRegion() );
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->GetMultiThreader()->SetSingleMethod( this->EMThreaderCallback, &str );
 
-  ItI.GoToBegin();
-  ItM.GoToBegin();
-  ItO.GoToBegin();
+  // One set of accumulators per thread, reduced once the threads are done.
+  const unsigned int numberOfThreads =
+    this->GetMultiThreader()->GetNumberOfThreads();
+  if( stage == ExpectationStage )
+    {
+    std::vector<double> zeros( this->m_NumberOfClasses, 0.0 );
+    this->m_ThreadSumPosteriors.assign( numberOfThreads, zeros );
+    this->m_ThreadProportionDenominators.assign( numberOfThreads, zeros );
+    this->m_ThreadClassWeights.assign( numberOfThreads, zeros );
+    this->m_ThreadClassMeans.assign( numberOfThreads, zeros );
+    this->m_ThreadClassSquaredDeviations.assign( numberOfThreads, zeros );
+    }
 
-  unsigned long voxelCount = 0;
+  this->GetMultiThreader()->SingleMethodExecute();
+}
 
-  while( !ItO.IsAtEnd() )
+template <class TInputImage, class TMaskImage, class TClassifiedImage>
+ITK_THREAD_RETURN_TYPE
+ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
+::EMThreaderCallback( void *arg )
+{
+  MultiThreader::ThreadInfoStruct *info =
+    static_cast<MultiThreader::ThreadInfoStruct *>( arg );
+  EMThreadStruct *str = static_cast<EMThreadStruct *>( info->UserData );
+
+  if( str->Stage == MRFInitializationStage )
     {
-    if( !this->GetMaskImage() || this->GetMaskImage()->GetPixel(
-      ItO.GetIndex() ) == this->m_MaskLabel )
-      {
-      RealType intensity = static_cast<RealType>( ItI.Get() );
-      RealType weight = ItM.Get();
+    str->Filter->ThreadedInitializeMRFWeights( info->ThreadID,
+      info->NumberOfThreads );
+    }
+  else
+    {
+    str->Filter->ThreadedExpectation( info->ThreadID, info->NumberOfThreads );
+    }
 
-      voxelCount++;
+  return ITK_THREAD_RETURN_VALUE;
+}
 
-      // running weighted mean and variance formulation
+template <class TInputImage, class TMaskImage, class TClassifiedImage>
+void
+ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
+::ComputeMRFWeights( SizeValueType voxel, RealType *classWeights,
+  RealType &totalWeight )
+{
+  const ClassifiedImageType *output = this->GetOutput();
+  const LabelType *labels = output->GetBufferPointer();
+  const typename ClassifiedImageType::RegionType &region =
+    output->GetBufferedRegion();
 
-      unsigned int n = ItO.Get() - 1;
+  const OffsetValueType offset = this->m_MaskedVoxelOffsets[voxel];
+  const IndexType index = output->ComputeIndex( offset );
 
-      N[n] += weight;
-      this->m_CurrentClassParameters[n][0] = ( ( N[n] - weight ) *
-        this->m_CurrentClassParameters[n][0] + weight * intensity ) / N[n];
+  std::fill( classWeights, classWeights + this->m_NumberOfClasses, 0.0 );
+  totalWeight = 0.0;
 
-      if( N[n] > weight )
+  for( unsigned int k = 0; k < this->m_MRFNeighborhoodOffsets.size(); k++ )
+    {
+    bool isInBounds = true;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      OffsetValueType position =
+        index[d] + this->m_MRFNeighborhoodOffsets[k][d];
+      if( position < region.GetIndex()[d] || position >=
+        region.GetIndex()[d] + static_cast<OffsetValueType>(
+        region.GetSize()[d] ) )
         {
-        this->m_CurrentClassParameters[n][1]
-          = this->m_CurrentClassParameters[n][1] * ( N[n] - weight )
-          / N[n] + vnl_math_sqr( intensity -
-          this->m_CurrentClassParameters[n][0] ) * weight / ( N[n] - weight );
+        isInBounds = false;
+        break;
         }
       }
-    ++ItI;
-    ++ItM;
-    ++ItO;
+    if( isInBounds )
+      {
+      unsigned int label = static_cast<unsigned int>(
+        labels[offset + this->m_MRFNeighborhoodBufferOffsets[k]] );
+      if( label >= 1 && label <= this->m_NumberOfClasses )
+        {
+        classWeights[label-1] += this->m_MRFNeighborhoodWeights[k];
+        }
+      totalWeight += this->m_MRFNeighborhoodWeights[k];
+      }
     }
-  this->SetNthOutput( 0, maxLabels );
-
-  return N.sum() / static_cast<RealType>( voxelCount );
 }
 
 template <class TInputImage, class TMaskImage, class TClassifiedImage>
-typename ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
-::RealImageType::Pointer
+void
 ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
-::GetPosteriorProbabilityImage( unsigned int whichClass )
+::ThreadedInitializeMRFWeights( ThreadIdType threadId,
+  ThreadIdType numberOfThreads )
 {
-  if( whichClass > this->m_NumberOfClasses )
-    {
-    itkExceptionMacro(
-      "Requested class is greater than the number of classes." );
-    }
+  const SizeValueType numberOfVoxels = this->m_MaskedVoxelOffsets.size();
+  const SizeValueType begin = numberOfVoxels * threadId / numberOfThreads;
+  const SizeValueType end = numberOfVoxels * ( threadId + 1 ) / numberOfThreads;
 
-  /**
-   * If memory minimization is turned off and if the posterior probability
-   * images have already been calculated, simply return the probability
-   * image for the requested class.  Otherwise, calculate the probability
-   * image.
-   */
-  if( whichClass <= this->m_PosteriorProbabilityImages.size() )
+  std::vector<RealType> classWeights( this->m_NumberOfClasses );
+  for( SizeValueType i = begin; i < end; i++ )
     {
-    return this->m_PosteriorProbabilityImages[whichClass-1];
+    this->ComputeMRFWeights( i, &classWeights[0],
+      this->m_MRFTotalWeights[i] );
+    for( unsigned int c = 0; c < this->m_NumberOfClasses; c++ )
+      {
+      this->m_MRFClassWeights[c * numberOfVoxels + i] = classWeights[c];
+      }
     }
-  else
-    {
-    /**
-     * Here we assume that the encompassing function is called in order such
-     * that GetPosteriorProbabilityImage( 1 ) is called before
-     * GetPosteriorProbabilityImage( 2 ), etc.  As such, when this part of
-     * the code is reached and the class requested is '1', we assume that
-     * the sum of the posterior probability images needs to be calculated
-     * for normalization purposes.  This sum is then saved for subsequent calls.
-     */
-
-    typename RealImageType::Pointer posteriorProbabilityImage =
-      RealImageType::New();
-    posteriorProbabilityImage->SetRegions(
-      this->GetOutput()->GetRequestedRegion() );
-    posteriorProbabilityImage->SetOrigin( this->GetOutput()->GetOrigin() );
-    posteriorProbabilityImage->SetSpacing( this->GetOutput()->GetSpacing() );
-    posteriorProbabilityImage->SetDirection( this->GetOutput()->GetDirection() );
-    posteriorProbabilityImage->Allocate();
-    posteriorProbabilityImage->FillBuffer( 0 );
+}
 
-    /**
-     * Calculate the sum of the probability images.  Also, store the
-     * posterior probability images if m_MinimizeMemoryUsage == false.
-     */
-    if( whichClass == 1 )
+template <class TInputImage, class TMaskImage, class TClassifiedImage>
+void
+ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
+::ThreadedExpectation( ThreadIdType threadId, ThreadIdType numberOfThreads )
+{
+  const SizeValueType numberOfVoxels = this->m_MaskedVoxelOffsets.size();
+  const SizeValueType begin = numberOfVoxels * threadId / numberOfThreads;
+  const SizeValueType end = numberOfVoxels * ( threadId + 1 ) / numberOfThreads;
+  const unsigned int numberOfClasses = this->m_NumberOfClasses;
+
+  std::vector<double> &sumPosteriors = this->m_ThreadSumPosteriors[threadId];
+  std::vector<double> &denominators =
+    this->m_ThreadProportionDenominators[threadId];
+  std::vector<double> &weights = this->m_ThreadClassWeights[threadId];
+  std::vector<double> &means = this->m_ThreadClassMeans[threadId];
+  std::vector<double> &squaredDeviations =
+    this->m_ThreadClassSquaredDeviations[threadId];
+
+  std::vector<RealType> classWeights( numberOfClasses, 0.0 );
+  std::vector<RealType> priors( numberOfClasses, 1.0 );
+
+  for( SizeValueType i = begin; i < end; i++ )
+    {
+    RealType totalWeight = 0.0;
+    if( this->m_MRFSmoothingFactor > 0.0 )
       {
-      this->m_SumPosteriorProbabilityImage = RealImageType::New();
-      this->m_SumPosteriorProbabilityImage->SetRegions(
-        this->GetOutput()->GetRequestedRegion() );
-      this->m_SumPosteriorProbabilityImage->SetOrigin(
-        this->GetOutput()->GetOrigin() );
-      this->m_SumPosteriorProbabilityImage->SetSpacing(
-        this->GetOutput()->GetSpacing() );
-      this->m_SumPosteriorProbabilityImage->SetDirection(
-        this->GetOutput()->GetDirection() );
-      this->m_SumPosteriorProbabilityImage->Allocate();
-      this->m_SumPosteriorProbabilityImage->FillBuffer( 0 );
-
-      for( unsigned int c = 0; c < this->m_NumberOfClasses; c++ )
+      if( this->m_MRFClassWeights.empty() )
         {
-        typename RealImageType::Pointer smoothImage = NULL;
-        typename RealImageType::Pointer distancePriorProbabilityImage = NULL;
-        typename RealImageType::ConstPointer priorProbabilityImage = NULL;
-
-        if( this->m_PriorProbabilityWeighting > 0.0 )
-          {
-          smoothImage =
-            this->CalculateSmoothIntensityImageFromPriorProbabilityImage(
-            c + 1 );
-          }
-
-        if( this->m_InitializationStrategy == PriorProbabilityImages )
-          {
-          priorProbabilityImage = const_cast<RealImageType *>(
-            this->GetPriorProbabilityImage( c + 1 ) );
-          }
-        else if( this->m_InitializationStrategy == PriorLabelImage )
-          {
-          distancePriorProbabilityImage
-            = this->GetDistancePriorProbabilityImageFromPriorLabelImage( c + 1 );
-          }
-
-        typename NeighborhoodIterator<ClassifiedImageType>::RadiusType radius;
-        unsigned int neighborhoodSize = 1;
-        for( unsigned int d = 0; d < ImageDimension; d++ )
-          {
-          neighborhoodSize *= ( 2 * this->m_MRFRadius[d] + 1 );
-          radius[d] = this->m_MRFRadius[d];
-          }
-
-        ImageRegionConstIterator<ImageType> ItI( this->GetInput(),
-          this->GetInput()->GetRequestedRegion() );
-        ConstNeighborhoodIterator<ClassifiedImageType> ItO( radius,
-          this->GetOutput(), this->GetOutput()->GetRequestedRegion() );
-        ImageRegionIterator<RealImageType> ItS(
-          this->m_SumPosteriorProbabilityImage,
-          this->m_SumPosteriorProbabilityImage->GetRequestedRegion() );
-
-        for( ItI.GoToBegin(), ItO.GoToBegin(), ItS.GoToBegin(); !ItI.IsAtEnd();
-          ++ItI, ++ItO, ++ItS )
-          {
-          if( !this->GetMaskImage() || this->GetMaskImage()->GetPixel(
-            ItO.GetIndex() ) == this->m_MaskLabel )
-            {
-            RealType weightedNumberOfClassNeighbors = 0.0;
-            RealType weightedTotalNumberOfNeighbors = 0.0;
-            for( unsigned int n = 0; n < neighborhoodSize; n++ )
-              {
-              if( n == static_cast<unsigned int>( 0.5*neighborhoodSize ) )
-                {
-                continue;
-                }
-              typename ClassifiedImageType::OffsetType offset
-                = ItO.GetOffset( n );
-
-              double distance = 0.0;
-              for( unsigned int d = 0; d < ImageDimension; d++ )
-                {
-                distance += vnl_math_sqr( offset[d]
-                  * this->GetOutput()->GetSpacing()[d] );
-                }
-              distance = vcl_sqrt( distance );
-
-              bool isInBounds = false;
-              LabelType label = ItO.GetPixel( n, isInBounds );
-              if( isInBounds )
-                {
-                if( static_cast<unsigned int>( label ) == c + 1 )
-                  {
-                  weightedNumberOfClassNeighbors += ( 1.0 / distance );
-                  }
-                weightedTotalNumberOfNeighbors += ( 1.0 / distance );
-                }
-              }
-            RealType ratio = weightedNumberOfClassNeighbors
-              / weightedTotalNumberOfNeighbors;
-
-            RealType mrfPrior = 1.0;
-            if( this->m_MRFSmoothingFactor > 0.0 )
-              {
-              mrfPrior = vcl_exp( -( 1.0 - ratio ) /
-                this->m_MRFSmoothingFactor );
-              }
-
-            RealType prior = 1.0;
-            if( priorProbabilityImage )
-              {
-              prior = priorProbabilityImage->GetPixel( ItO.GetIndex() );
-              }
-            else if( distancePriorProbabilityImage )
-              {
-              prior = distancePriorProbabilityImage->GetPixel( ItO.GetIndex() );
-              }
-
-            RealType mu = this->m_CurrentClassParameters[c][0];
-            if( smoothImage )
-              {
-              mu = ( 1.0 - this->m_PriorProbabilityWeighting ) * mu
-                + this->m_PriorProbabilityWeighting
-                * smoothImage->GetPixel( ItO.GetIndex() );
-              }
-            RealType likelihood = 1.0 / vcl_sqrt( 2.0 * vnl_math::pi
-              * this->m_CurrentClassParameters[c][1] ) *
-              vcl_exp( -0.5 * vnl_math_sqr( ItI.Get() - mu ) /
-              this->m_CurrentClassParameters[c][1] );
-
-            RealType posteriorProbability = likelihood * mrfPrior * prior *
-              this->m_CurrentClassParameters[c][2];
-
-            if( this->m_MRFSigmoidAlpha > 0.0 )
-              {
-              posteriorProbability = 1.0 / ( 1.0 + vcl_exp(
-                -( posteriorProbability - this->m_MRFSigmoidBeta ) /
-                this->m_MRFSigmoidAlpha ) );
-              }
-
-            if( vnl_math_isnan( posteriorProbability ) ||
-              vnl_math_isinf( posteriorProbability ) )
-              {
-              posteriorProbability = 0.0;
-              }
-
-            ItS.Set( ItS.Get() + posteriorProbability  );
-            if( ( c == 0 ) || !this->m_MinimizeMemoryUsage )
-              {
-              posteriorProbabilityImage->SetPixel( ItO.GetIndex(),
-                posteriorProbability );
-              }
-            }
-          }
-        if( !this->m_MinimizeMemoryUsage )
+        this->ComputeMRFWeights( i, &classWeights[0], totalWeight );
+        }
+      else
+        {
+        for( unsigned int c = 0; c < numberOfClasses; c++ )
           {
-          typedef ImageDuplicator<RealImageType> DuplicatorType;
-          typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
-          duplicator->SetInputImage( posteriorProbabilityImage );
-          duplicator->Update();
-
-          this->m_PosteriorProbabilityImages.push_back(
-            duplicator->GetOutput() );
+          classWeights[c] = this->m_MRFClassWeights[c * numberOfVoxels + i];
           }
+        totalWeight = this->m_MRFTotalWeights[i];
         }
+      }
 
-      /**
-       * Normalize the posterior probability image(s).
-       */
-      ImageRegionIterator<RealImageType> ItS(
-        this->m_SumPosteriorProbabilityImage,
-        this->m_SumPosteriorProbabilityImage->GetRequestedRegion() );
-      if( this->m_MinimizeMemoryUsage )
+    for( unsigned int c = 0; c < numberOfClasses; c++ )
+      {
+      if( !this->m_PriorProbabilityBuffers.empty() )
         {
-        ImageRegionIterator<RealImageType> ItP( posteriorProbabilityImage,
-          posteriorProbabilityImage->GetRequestedRegion() );
-        for( ItP.GoToBegin(), ItS.GoToBegin(); !ItS.IsAtEnd(); ++ItP, ++ItS )
-          {
-          if( ItS.Get() > 0 )
-            {
-            ItP.Set( ItP.Get() / ItS.Get() );
-            }
-          }
-        return posteriorProbabilityImage;
+        priors[c] = this->m_PriorProbabilityBuffers[c][
+          this->m_MaskedVoxelOffsets[i]];
         }
-      else
+      else if( !this->m_DistancePriorProbabilities.empty() )
         {
-        for( unsigned int n = 0; n < this->m_NumberOfClasses; n++ )
-          {
-          ImageRegionIterator<RealImageType> ItP(
-            this->m_PosteriorProbabilityImages[n],
-            this->m_PosteriorProbabilityImages[n]->GetRequestedRegion() );
-          for( ItP.GoToBegin(), ItS.GoToBegin(); !ItS.IsAtEnd(); ++ItP, ++ItS )
-            {
-            if( ItS.Get() > 0 )
-              {
-              ItP.Set( ItP.Get() / ItS.Get() );
-              }
-            }
-          }
-        return this->m_PosteriorProbabilityImages[0];
+        priors[c] =
+          this->m_DistancePriorProbabilities[c * numberOfVoxels + i];
         }
       }
-    else // whichClass > 1
+
+    const RealType intensity = this->m_MaskedIntensities[i];
+
+    RealType sumPosteriorProbability = 0.0;
+    for( unsigned int c = 0; c < numberOfClasses; c++ )
       {
-      typename RealImageType::Pointer smoothImage = NULL;
-      typename RealImageType::Pointer distancePriorProbabilityImage = NULL;
-      typename RealImageType::ConstPointer priorProbabilityImage = NULL;
+      RealType mrfPrior = 1.0;
+      if( this->m_MRFSmoothingFactor > 0.0 )
+        {
+        RealType ratio = classWeights[c] / totalWeight;
+        mrfPrior = vcl_exp( -( 1.0 - ratio ) / this->m_MRFSmoothingFactor );
+        }
 
+      /**
+       * When the prior probability weighting is on, the posterior slot of
+       * this voxel holds the smoothed class intensity on entry.
+       */
+      RealType &posteriorProbability =
+        this->m_PosteriorProbabilities[c * numberOfVoxels + i];
+
+      RealType mu = this->m_CurrentClassParameters[c][0];
       if( this->m_PriorProbabilityWeighting > 0.0 )
         {
-        smoothImage =
-          this->CalculateSmoothIntensityImageFromPriorProbabilityImage(
-          whichClass );
+        mu = ( 1.0 - this->m_PriorProbabilityWeighting ) * mu
+          + this->m_PriorProbabilityWeighting * posteriorProbability;
         }
+      RealType likelihood = 1.0 / vcl_sqrt( 2.0 * vnl_math::pi
+        * this->m_CurrentClassParameters[c][1] ) *
+        vcl_exp( -0.5 * vnl_math_sqr( intensity - mu ) /
+        this->m_CurrentClassParameters[c][1] );
+
+      posteriorProbability = likelihood * mrfPrior * priors[c] *
+        this->m_CurrentClassParameters[c][2];
 
-      if( this->m_InitializationStrategy == PriorProbabilityImages )
+      if( this->m_MRFSigmoidAlpha > 0.0 )
         {
-        priorProbabilityImage = const_cast<RealImageType *>(
-          this->GetPriorProbabilityImage( whichClass ) );
+        posteriorProbability = 1.0 / ( 1.0 + vcl_exp(
+          -( posteriorProbability - this->m_MRFSigmoidBeta ) /
+          this->m_MRFSigmoidAlpha ) );
         }
-      else if( this->m_InitializationStrategy == PriorLabelImage )
+
+      if( vnl_math_isnan( posteriorProbability ) ||
+        vnl_math_isinf( posteriorProbability ) )
         {
-        distancePriorProbabilityImage =
-          this->GetDistancePriorProbabilityImageFromPriorLabelImage( whichClass );
+        posteriorProbability = 0.0;
         }
+      sumPosteriorProbability += posteriorProbability;
+      }
 
-      typename NeighborhoodIterator<ClassifiedImageType>::RadiusType radius;
-      unsigned int neighborhoodSize = 1;
-      for( unsigned int d = 0; d < ImageDimension; d++ )
+    /**
+     * Normalize the posteriors and label the voxel with the most probable
+     * class (ties go to the higher class).
+     */
+    RealType maxPosteriorProbability = 0.0;
+    LabelType label = NumericTraits<LabelType>::Zero;
+    RealType weightedPriorProbability = 0.0;
+    for( unsigned int c = 0; c < numberOfClasses; c++ )
+      {
+      RealType &posteriorProbability =
+        this->m_PosteriorProbabilities[c * numberOfVoxels + i];
+      if( sumPosteriorProbability > 0.0 )
         {
-        neighborhoodSize *= ( 2 * this->m_MRFRadius[d] + 1 );
-        radius[d] = this->m_MRFRadius[d];
+        posteriorProbability /= sumPosteriorProbability;
         }
-
-      ImageRegionConstIterator<ImageType> ItI( this->GetInput(),
-        this->GetInput()->GetRequestedRegion() );
-      ConstNeighborhoodIterator<ClassifiedImageType> ItO( radius,
-        this->GetOutput(), this->GetOutput()->GetRequestedRegion() );
-
-      for( ItI.GoToBegin(), ItO.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++ItO )
+      if( posteriorProbability >= maxPosteriorProbability )
         {
-        if( !this->GetMaskImage() || this->GetMaskImage()->GetPixel(
-          ItO.GetIndex() ) == this->m_MaskLabel )
-          {
-          RealType weightedNumberOfClassNeighbors = 0.0;
-          RealType weightedTotalNumberOfNeighbors = 0.0;
-          for( unsigned int n = 0; n < neighborhoodSize; n++ )
-            {
-            if( n == static_cast<unsigned int>( 0.5*neighborhoodSize ) )
-              {
-              continue;
-              }
-            typename ClassifiedImageType::OffsetType offset
-              = ItO.GetOffset( n );
-
-            double distance = 0.0;
-            for( unsigned int d = 0; d < ImageDimension; d++ )
-              {
-              distance += vnl_math_sqr( offset[d]
-                * this->GetOutput()->GetSpacing()[d] );
-              }
-            distance = vcl_sqrt( distance );
-
-            bool isInBounds = false;
-            LabelType label = ItO.GetPixel( n, isInBounds );
-            if( isInBounds )
-              {
-              if( static_cast<unsigned int>( label ) == whichClass )
-                {
-                weightedNumberOfClassNeighbors += ( 1.0 / distance );
-                }
-              weightedTotalNumberOfNeighbors += ( 1.0 / distance );
-              }
-            }
-          RealType ratio = weightedNumberOfClassNeighbors
-            / weightedTotalNumberOfNeighbors;
-
-          RealType mrfPrior = 1.0;
-          if( this->m_MRFSmoothingFactor > 0.0 )
-            {
-            mrfPrior = vcl_exp( -( 1.0 - ratio ) /
-              this->m_MRFSmoothingFactor );
-            }
+        maxPosteriorProbability = posteriorProbability;
+        label = static_cast<LabelType>( c + 1 );
+        }
+      sumPosteriors[c] += posteriorProbability;
+      weightedPriorProbability +=
+        this->m_CurrentClassParameters[c][2] * priors[c];
+      }
+    this->m_UpdatedLabels[i] = label;
 
-          RealType prior = 1.0;
-          if( priorProbabilityImage )
-            {
-            prior = priorProbabilityImage->GetPixel( ItO.GetIndex() );
-            }
-          else if( distancePriorProbabilityImage )
-            {
-            prior = distancePriorProbabilityImage->GetPixel( ItO.GetIndex() );
-            }
+    // Denominators of the class proportions (with the current proportions)
+    if( weightedPriorProbability > 0.0 )
+      {
+      for( unsigned int c = 0; c < numberOfClasses; c++ )
+        {
+        denominators[c] += priors[c] / weightedPriorProbability;
+        }
+      }
 
-          RealType mu = this->m_CurrentClassParameters[whichClass-1][0];
-          if( smoothImage )
-            {
-            mu = ( 1.0 - this->m_PriorProbabilityWeighting ) * mu
-              + this->m_PriorProbabilityWeighting
-              * smoothImage->GetPixel( ItO.GetIndex() );
-            }
-          RealType likelihood = 1.0 / vcl_sqrt( 2.0 * vnl_math::pi
-            * this->m_CurrentClassParameters[whichClass-1][1] ) *
-            vcl_exp( -0.5 * vnl_math_sqr( ItI.Get() - mu ) /
-            this->m_CurrentClassParameters[whichClass-1][1] );
+    // Running weighted mean and variance of the winning class
+    unsigned int n = label - 1;
+    weights[n] += maxPosteriorProbability;
+    if( weights[n] > 0.0 )
+      {
+      double delta = intensity - means[n];
+      means[n] += delta * maxPosteriorProbability / weights[n];
+      squaredDeviations[n] +=
+        maxPosteriorProbability * delta * ( intensity - means[n] );
+      }
+    }
+}
 
-          RealType posteriorProbability = likelihood * mrfPrior * prior *
-            this->m_CurrentClassParameters[whichClass-1][2];
+template <class TInputImage, class TMaskImage, class TClassifiedImage>
+void
+ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
+::UpdateMRFWeights( SizeValueType voxel, LabelType oldLabel,
+  LabelType newLabel )
+{
+  const ClassifiedImageType *output = this->GetOutput();
+  const typename ClassifiedImageType::RegionType &region =
+    output->GetBufferedRegion();
 
-          if( this->m_MRFSigmoidAlpha > 0.0 )
-            {
-            posteriorProbability = 1.0 / ( 1.0 + vcl_exp(
-              -( posteriorProbability - this->m_MRFSigmoidBeta ) /
-              this->m_MRFSigmoidAlpha ) );
-            }
+  const SizeValueType numberOfVoxels = this->m_MaskedVoxelOffsets.size();
+  const OffsetValueType offset = this->m_MaskedVoxelOffsets[voxel];
+  const IndexType index = output->ComputeIndex( offset );
 
-          if( vnl_math_isnan( posteriorProbability ) ||
-            vnl_math_isinf( posteriorProbability ) )
-            {
-            posteriorProbability = 0.0;
-            }
-          posteriorProbabilityImage->SetPixel( ItO.GetIndex(),
-            posteriorProbability );
-          }
-        }
+  const unsigned int oldClass = static_cast<unsigned int>( oldLabel );
+  const unsigned int newClass = static_cast<unsigned int>( newLabel );
 
-      /**
-       * Normalize the posterior probability image(s).
-       */
-      ImageRegionIterator<RealImageType> ItS(
-        this->m_SumPosteriorProbabilityImage,
-        this->m_SumPosteriorProbabilityImage->GetRequestedRegion() );
-      ImageRegionIterator<RealImageType> ItP( posteriorProbabilityImage,
-        posteriorProbabilityImage->GetRequestedRegion() );
-      for( ItP.GoToBegin(), ItS.GoToBegin(); !ItS.IsAtEnd(); ++ItP, ++ItS )
+  /**
+   * The neighborhood is symmetric so the voxel contributes to each of its
+   * masked neighbors with the weight of the corresponding offset.
+   */
+  for( unsigned int k = 0; k < this->m_MRFNeighborhoodOffsets.size(); k++ )
+    {
+    bool isInBounds = true;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      OffsetValueType position =
+        index[d] + this->m_MRFNeighborhoodOffsets[k][d];
+      if( position < region.GetIndex()[d] || position >=
+        region.GetIndex()[d] + static_cast<OffsetValueType>(
+        region.GetSize()[d] ) )
         {
-        if( ItS.Get() > 0 )
-          {
-          ItP.Set( ItP.Get() / ItS.Get() );
-          }
+        isInBounds = false;
+        break;
         }
+      }
+    if( !isInBounds )
+      {
+      continue;
+      }
+
+    const OffsetValueType neighborOffset =
+      offset + this->m_MRFNeighborhoodBufferOffsets[k];
+    typename std::vector<OffsetValueType>::const_iterator it =
+      std::lower_bound( this->m_MaskedVoxelOffsets.begin(),
+      this->m_MaskedVoxelOffsets.end(), neighborOffset );
+    if( it == this->m_MaskedVoxelOffsets.end() || *it != neighborOffset )
+      {
+      continue;
+      }
+    const SizeValueType neighbor = it - this->m_MaskedVoxelOffsets.begin();
 
-      return posteriorProbabilityImage;
+    if( oldClass >= 1 && oldClass <= this->m_NumberOfClasses )
+      {
+      RealType &weight = this->m_MRFClassWeights[
+        ( oldClass - 1 ) * numberOfVoxels + neighbor];
+      weight = vnl_math_max( 0.0f,
+        weight - this->m_MRFNeighborhoodWeights[k] );
+      }
+    if( newClass >= 1 && newClass <= this->m_NumberOfClasses )
+      {
+      this->m_MRFClassWeights[( newClass - 1 ) * numberOfVoxels + neighbor]
+        += this->m_MRFNeighborhoodWeights[k];
       }
     }
 }
 
 template <class TInputImage, class TMaskImage, class TClassifiedImage>
 typename ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
-::RealImageType::Pointer
+::RealType
 ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
-::GetDistancePriorProbabilityImageFromPriorLabelImage( unsigned int whichClass )
+::UpdateClassParametersAndLabeling()
 {
-  if( whichClass > this->m_NumberOfClasses )
+  const SizeValueType numberOfVoxels = this->m_MaskedVoxelOffsets.size();
+  if( numberOfVoxels == 0 )
     {
-    itkExceptionMacro(
-      "Requested class is greater than the number of classes." );
+    return 0.0;
     }
 
+  this->m_PosteriorProbabilities.resize(
+    this->m_NumberOfClasses * numberOfVoxels );
+
   /**
-   * If memory minimization is turned off and if the distance prior probability
-   * images have already been calculated, simply return the probability
-   * image for the requested class.  Otherwise, calculate the probability
-   * image.
+   * The smoothed class intensities are sampled into the posterior buffer
+   * which the expectation step overwrites voxel by voxel.
    */
-  if( whichClass <= this->m_DistancePriorProbabilityImages.size() )
+  if( this->m_PriorProbabilityWeighting > 0.0 )
     {
-    return this->m_DistancePriorProbabilityImages[whichClass-1];
+    const ClassifiedImageType *output = this->GetOutput();
+    for( unsigned int n = 0; n < this->m_NumberOfClasses; n++ )
+      {
+      typename RealImageType::Pointer smoothImage =
+        this->CalculateSmoothIntensityImageFromPriorProbabilityImage( n + 1 );
+      for( SizeValueType i = 0; i < numberOfVoxels; i++ )
+        {
+        this->m_PosteriorProbabilities[n * numberOfVoxels + i] =
+          smoothImage->GetPixel( output->ComputeIndex(
+          this->m_MaskedVoxelOffsets[i] ) );
+        }
+      }
     }
-  else
+
+  /**
+   * E-step together with the sums needed by the M-step.
+   */
+  this->ExecuteEMStage( ExpectationStage );
+
+  ParametersType sumPosteriors( this->m_NumberOfClasses );
+  ParametersType denominators( this->m_NumberOfClasses );
+  ParametersType N( this->m_NumberOfClasses );
+  ParametersType means( this->m_NumberOfClasses );
+  ParametersType squaredDeviations( this->m_NumberOfClasses );
+  sumPosteriors.Fill( 0.0 );
+  denominators.Fill( 0.0 );
+  N.Fill( 0.0 );
+  means.Fill( 0.0 );
+  squaredDeviations.Fill( 0.0 );
+
+  for( unsigned int t = 0; t < this->m_ThreadSumPosteriors.size(); t++ )
     {
-    /**
-     * Here we assume that the encompassing function is called in order such
-     * that GetDistancePriorImage( 1 ) is called before
-     * GetDistancePriorImage( 2 ), etc.  As such, when this part of
-     * the code is reached and the class requested is '1', we assume that
-     * the sum of the distance prior probability images needs to be calculated
-     * for normalization purposes.  This sum is then saved for subsequent calls.
-     */
-    typename RealImageType::Pointer distancePriorProbabilityImage = NULL;
+    for( unsigned int n = 0; n < this->m_NumberOfClasses; n++ )
+      {
+      sumPosteriors[n] += this->m_ThreadSumPosteriors[t][n];
+      denominators[n] += this->m_ThreadProportionDenominators[t][n];
 
-    /**
-     * Calculate the sum of the distance probability images.  Also, store the
-     * distance probability images if m_MinimizeMemoryUsage == false.
-     */
-    if( whichClass == 1 )
+      // Pairwise combination of the weighted means and variances
+      double weight = this->m_ThreadClassWeights[t][n];
+      if( weight <= 0.0 )
+        {
+        continue;
+        }
+      double combinedWeight = N[n] + weight;
+      double delta = this->m_ThreadClassMeans[t][n] - means[n];
+      means[n] += delta * weight / combinedWeight;
+      squaredDeviations[n] += this->m_ThreadClassSquaredDeviations[t][n]
+        + vnl_math_sqr( delta ) * N[n] * weight / combinedWeight;
+      N[n] = combinedWeight;
+      }
+    }
+
+  // Update the class proportions
+  for( unsigned int n = 0; n < this->m_NumberOfClasses; n++ )
+    {
+    if( denominators[n] > 0.0 )
       {
-      this->m_SumDistancePriorProbabilityImage = RealImageType::New();
-      this->m_SumDistancePriorProbabilityImage->SetRegions(
-        this->GetOutput()->GetRequestedRegion() );
-      this->m_SumDistancePriorProbabilityImage->SetOrigin(
-        this->GetOutput()->GetOrigin() );
-      this->m_SumDistancePriorProbabilityImage->SetSpacing(
-        this->GetOutput()->GetSpacing() );
-      this->m_SumDistancePriorProbabilityImage->SetDirection(
-        this->GetOutput()->GetDirection() );
-      this->m_SumDistancePriorProbabilityImage->Allocate();
-      this->m_SumDistancePriorProbabilityImage->FillBuffer( 0 );
-
-      for( unsigned int c = 0; c < this->m_NumberOfClasses; c++ )
+      this->m_CurrentClassParameters[n][2] = sumPosteriors[n] / denominators[n];
+      }
+    else
+      {
+      this->m_CurrentClassParameters[n][2] = 0.0;
+      }
+    }
+
+  // now update the class means and variances
+  RealType sumMaxPosteriors = 0.0;
+  for( unsigned int n = 0; n < this->m_NumberOfClasses; n++ )
+    {
+    if( N[n] > 0.0 )
+      {
+      this->m_CurrentClassParameters[n][0] = means[n];
+      if( squaredDeviations[n] > 0.0 )
         {
-        typedef BinaryThresholdImageFilter<ClassifiedImageType, RealImageType>
-          ThresholderType;
-        typename ThresholderType::Pointer thresholder = ThresholderType::New();
-        thresholder->SetInput( const_cast<ClassifiedImageType *>(
-          this->GetPriorLabelImage() ) );
-        thresholder->SetInsideValue( 1 );
-        thresholder->SetOutsideValue( 0 );
-        thresholder->SetLowerThreshold( static_cast<LabelType>( c + 1 ) );
-        thresholder->SetUpperThreshold( static_cast<LabelType>( c + 1 ) );
-        thresholder->Update();
-
-        typename RealImageType::Pointer distanceImage = RealImageType::New();
-
-        if( this->m_UseEuclideanDistanceForPriorLabels )
-          {
-          typedef SignedMaurerDistanceMapImageFilter
-            <RealImageType, RealImageType> DistancerType;
-          typename DistancerType::Pointer distancer = DistancerType::New();
-          distancer->SetInput( thresholder->GetOutput() );
-          distancer->SetSquaredDistance( true );
-          distancer->SetUseImageSpacing( true );
-          distancer->SetInsideIsPositive( false );
-          distancer->Update();
-
-          distanceImage = distancer->GetOutput();
-          }
-        else
-          {
-          typedef BinaryContourImageFilter<RealImageType, RealImageType>
-            ContourFilterType;
-          typename ContourFilterType::Pointer contour = ContourFilterType::New();
-          contour->SetInput( thresholder->GetOutput() );
-          contour->FullyConnectedOff();
-          contour->SetBackgroundValue( 0 );
-          contour->SetForegroundValue( 1 );
-          contour->Update();
-
-          typedef FastMarchingImageFilter<RealImageType, RealImageType>
-            FastMarchingFilterType;
-          typename FastMarchingFilterType::Pointer fastMarching
-            = FastMarchingFilterType::New();
-          fastMarching->SetInput( contour->GetOutput() );
-          fastMarching->SetStoppingValue( NumericTraits<RealType>::max() );
-          fastMarching->SetTopologyCheck( FastMarchingFilterType::None );
-          fastMarching->Update();
-
-          ImageRegionIterator<RealImageType> ItT( thresholder->GetOutput(),
-            thresholder->GetOutput()->GetRequestedRegion() );
-          ImageRegionIterator<RealImageType> ItF( fastMarching->GetOutput(),
-            fastMarching->GetOutput()->GetRequestedRegion() );
-          for( ItT.GoToBegin(), ItF.GoToBegin(); !ItT.IsAtEnd(); ++ItT, ++ItF )
-            {
-            if( ItT.Get() == 1 )
-              {
-              ItF.Set( -ItF.Get() );
-              }
-            }
+        this->m_CurrentClassParameters[n][1] = squaredDeviations[n] / N[n];
+        }
+      }
+    sumMaxPosteriors += N[n];
+    }
 
-          distanceImage = fastMarching->GetOutput();
-          }
+  /**
+   * Write the new labeling and refresh the cached MRF neighborhoods around
+   * the voxels that changed class.
+   */
+  LabelType *labels = this->GetOutput()->GetBufferPointer();
+  for( SizeValueType i = 0; i < numberOfVoxels; i++ )
+    {
+    LabelType &label = labels[this->m_MaskedVoxelOffsets[i]];
+    if( label != this->m_UpdatedLabels[i] )
+      {
+      if( !this->m_MRFClassWeights.empty() )
+        {
+        this->UpdateMRFWeights( i, label, this->m_UpdatedLabels[i] );
+        }
+      label = this->m_UpdatedLabels[i];
+      }
+    }
 
-        RealType maximumInteriorDistance = 0.0;
+  return sumMaxPosteriors / static_cast<RealType>( numberOfVoxels );
+}
 
-        ImageRegionIterator<RealImageType> ItD( distanceImage,
-          distanceImage->GetRequestedRegion() );
-        for( ItD.GoToBegin(); !ItD.IsAtEnd(); ++ItD )
-          {
-          if( ItD.Get() < 0 &&
-            maximumInteriorDistance < vnl_math_abs( ItD.Get() ) )
-            {
-            maximumInteriorDistance = vnl_math_abs( ItD.Get() );
-            }
-          }
+template <class TInputImage, class TMaskImage, class TClassifiedImage>
+typename ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
+::RealImageType::Pointer
+ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
+::ExpandMaskedValues( const std::vector<RealType> &values,
+  unsigned int whichClass )
+{
+  const ClassifiedImageType *output = this->GetOutput();
+
+  typename RealImageType::Pointer image = RealImageType::New();
+  image->SetRegions( output->GetBufferedRegion() );
+  image->SetOrigin( output->GetOrigin() );
+  image->SetSpacing( output->GetSpacing() );
+  image->SetDirection( output->GetDirection() );
+  image->Allocate();
+  image->FillBuffer( 0 );
+
+  const SizeValueType numberOfVoxels = this->m_MaskedVoxelOffsets.size();
+  RealType *buffer = image->GetBufferPointer();
+  for( SizeValueType i = 0; i < numberOfVoxels; i++ )
+    {
+    buffer[this->m_MaskedVoxelOffsets[i]] =
+      values[( whichClass - 1 ) * numberOfVoxels + i];
+    }
 
-        RealType labelSigma = 0.1;
-        RealType labelBoundaryProbability = 0.75;
+  return image;
+}
 
-        typename LabelParameterMapType::iterator it =
-          this->m_PriorLabelParameterMap.find( c + 1 );
-        if( it == this->m_PriorLabelParameterMap.end() )
-          {
-          itkWarningMacro( "The parameters for label \'" << c + 1 <<
-            "\' are not specified.  Using the default values of " <<
-            "sigma = " << labelSigma << ", boundary probability = " <<
-            labelBoundaryProbability );
-          }
-        else
-          {
-          labelSigma = ( it->second ).first;
-          labelBoundaryProbability = ( it->second ).second;
-          }
+template <class TInputImage, class TMaskImage, class TClassifiedImage>
+typename ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
+::RealImageType::Pointer
+ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
+::GetPosteriorProbabilityImage( unsigned int whichClass )
+{
+  if( whichClass > this->m_NumberOfClasses )
+    {
+    itkExceptionMacro(
+      "Requested class is greater than the number of classes." );
+    }
+  if( this->m_PosteriorProbabilities.empty() )
+    {
+    itkExceptionMacro( "The posterior probabilities are only available "
+      << "once the filter has been updated." );
+    }
 
-        for( ItD.GoToBegin(); !ItD.IsAtEnd(); ++ItD )
-          {
-          if( labelSigma == 0 )
-            {
-            ItD.Set( 0.0 );
-            }
-          else if( ItD.Get() >= 0 )
-            {
-            ItD.Set( labelBoundaryProbability
-              * vcl_exp( -ItD.Get() / vnl_math_sqr( labelSigma ) ) );
-            }
-          else if( ItD.Get() < 0 )
-            {
-            ItD.Set( 1.0 - ( 1.0 - labelBoundaryProbability )
-              * ( maximumInteriorDistance - vnl_math_abs( ItD.Get() ) )
-              / ( maximumInteriorDistance ) );
-            }
-          }
+  /**
+   * The posteriors of the last iteration are kept for the masked voxels
+   * only.  The image is zero outside the mask.
+   */
+  return this->ExpandMaskedValues( this->m_PosteriorProbabilities,
+    whichClass );
+}
 
-        typedef AddImageFilter<RealImageType, RealImageType, RealImageType>
-          AdderType;
-        typename AdderType::Pointer adder = AdderType::New();
-        adder->SetInput1( this->m_SumDistancePriorProbabilityImage );
-        adder->SetInput2( distanceImage );
-        adder->Update();
+template <class TInputImage, class TMaskImage, class TClassifiedImage>
+void
+ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
+::ComputeDistancePriorProbabilities()
+{
+  const ClassifiedImageType *output = this->GetOutput();
+  const SizeValueType numberOfVoxels = this->m_MaskedVoxelOffsets.size();
 
-        this->m_SumDistancePriorProbabilityImage = adder->GetOutput();
+  /**
+   * The prior label image does not change during the iterations so the
+   * distance priors are computed only once.  One distance map is alive at a
+   * time and only its values inside the mask are kept.
+   */
+  this->m_DistancePriorProbabilities.assign(
+    this->m_NumberOfClasses * numberOfVoxels, 0.0 );
+  std::vector<RealType> sumDistancePriorProbabilities( numberOfVoxels, 0.0 );
 
-        if( ( c == 0 ) && this->m_MinimizeMemoryUsage )
-          {
-          distancePriorProbabilityImage = distanceImage;
-          }
-        if( !this->m_MinimizeMemoryUsage )
-          {
-          this->m_DistancePriorProbabilityImages.push_back(
-            distanceImage );
-          }
-        }
+  for( unsigned int c = 0; c < this->m_NumberOfClasses; c++ )
+    {
+    typedef BinaryThresholdImageFilter<ClassifiedImageType, RealImageType>
+      ThresholderType;
+    typename ThresholderType::Pointer thresholder = ThresholderType::New();
+    thresholder->SetInput( const_cast<ClassifiedImageType *>(
+      this->GetPriorLabelImage() ) );
+    thresholder->SetInsideValue( 1 );
+    thresholder->SetOutsideValue( 0 );
+    thresholder->SetLowerThreshold( static_cast<LabelType>( c + 1 ) );
+    thresholder->SetUpperThreshold( static_cast<LabelType>( c + 1 ) );
+    thresholder->Update();
 
-      /**
-       * Normalize the distance prior probability image(s).
-       */
-      ImageRegionIterator<RealImageType> ItS(
-        this->m_SumDistancePriorProbabilityImage,
-        this->m_SumDistancePriorProbabilityImage->GetRequestedRegion() );
-      if( this->m_MinimizeMemoryUsage )
-        {
-        ImageRegionIterator<RealImageType> ItD( distancePriorProbabilityImage,
-          distancePriorProbabilityImage->GetRequestedRegion() );
-        for( ItD.GoToBegin(), ItS.GoToBegin(); !ItS.IsAtEnd(); ++ItD, ++ItS )
-          {
-          ItD.Set( ItD.Get() - ( ItS.Get() - ItD.Get() ) );
-          if( ItD.Get() < 0 )
-            {
-            ItD.Set( 0 );
-            }
-          }
-        return distancePriorProbabilityImage;
-        }
-      else
+    typename RealImageType::Pointer distanceImage = RealImageType::New();
+
+    if( this->m_UseEuclideanDistanceForPriorLabels )
+      {
+      typedef SignedMaurerDistanceMapImageFilter
+        <RealImageType, RealImageType> DistancerType;
+      typename DistancerType::Pointer distancer = DistancerType::New();
+      distancer->SetInput( thresholder->GetOutput() );
+      distancer->SetSquaredDistance( true );
+      distancer->SetUseImageSpacing( true );
+      distancer->SetInsideIsPositive( false );
+      distancer->Update();
+
+      distanceImage = distancer->GetOutput();
+      }
+    else
+      {
+      typedef BinaryContourImageFilter<RealImageType, RealImageType>
+        ContourFilterType;
+      typename ContourFilterType::Pointer contour = ContourFilterType::New();
+      contour->SetInput( thresholder->GetOutput() );
+      contour->FullyConnectedOff();
+      contour->SetBackgroundValue( 0 );
+      contour->SetForegroundValue( 1 );
+      contour->Update();
+
+      typedef FastMarchingImageFilter<RealImageType, RealImageType>
+        FastMarchingFilterType;
+      typename FastMarchingFilterType::Pointer fastMarching
+        = FastMarchingFilterType::New();
+      fastMarching->SetInput( contour->GetOutput() );
+      fastMarching->SetStoppingValue( NumericTraits<RealType>::max() );
+      fastMarching->SetTopologyCheck( FastMarchingFilterType::None );
+      fastMarching->Update();
+
+      ImageRegionIterator<RealImageType> ItT( thresholder->GetOutput(),
+        thresholder->GetOutput()->GetRequestedRegion() );
+      ImageRegionIterator<RealImageType> ItF( fastMarching->GetOutput(),
+        fastMarching->GetOutput()->GetRequestedRegion() );
+      for( ItT.GoToBegin(), ItF.GoToBegin(); !ItT.IsAtEnd(); ++ItT, ++ItF )
         {
-        for( unsigned int n = 0; n < this->m_NumberOfClasses; n++ )
+        if( ItT.Get() == 1 )
           {
-          ImageRegionIterator<RealImageType> ItD(
-            this->m_DistancePriorProbabilityImages[n],
-            this->m_DistancePriorProbabilityImages[n]->GetRequestedRegion() );
-          for( ItD.GoToBegin(), ItS.GoToBegin(); !ItS.IsAtEnd(); ++ItD, ++ItS )
-            {
-            ItD.Set( ItD.Get() - ( ItS.Get() - ItD.Get() ) );
-            if( ItD.Get() < 0 )
-              {
-              ItD.Set( 0 );
-              }
-            }
+          ItF.Set( -ItF.Get() );
           }
-        return this->m_DistancePriorProbabilityImages[0];
         }
+
+      distanceImage = fastMarching->GetOutput();
       }
-    else // whichClass > 1
-      {
-      typedef BinaryThresholdImageFilter<ClassifiedImageType, RealImageType>
-        ThresholderType;
-      typename ThresholderType::Pointer thresholder = ThresholderType::New();
-      thresholder->SetInput( const_cast<ClassifiedImageType *>(
-        this->GetPriorLabelImage() ) );
-      thresholder->SetInsideValue( 1 );
-      thresholder->SetOutsideValue( 0 );
-      thresholder->SetLowerThreshold( static_cast<LabelType>( whichClass ) );
-      thresholder->SetUpperThreshold( static_cast<LabelType>( whichClass ) );
-      thresholder->Update();
 
-      typename RealImageType::Pointer distanceImage = RealImageType::New();
+    RealType maximumInteriorDistance = 0.0;
 
-      if( this->m_UseEuclideanDistanceForPriorLabels )
+    ImageRegionConstIterator<RealImageType> ItD( distanceImage,
+      distanceImage->GetRequestedRegion() );
+    for( ItD.GoToBegin(); !ItD.IsAtEnd(); ++ItD )
+      {
+      if( ItD.Get() < 0 &&
+        maximumInteriorDistance < vnl_math_abs( ItD.Get() ) )
         {
-        typedef SignedMaurerDistanceMapImageFilter
-          <RealImageType, RealImageType> DistancerType;
-        typename DistancerType::Pointer distancer = DistancerType::New();
-        distancer->SetInput( thresholder->GetOutput() );
-        distancer->SetSquaredDistance( true );
-        distancer->SetUseImageSpacing( true );
-        distancer->SetInsideIsPositive( false );
-        distancer->Update();
-
-        distanceImage = distancer->GetOutput();
+        maximumInteriorDistance = vnl_math_abs( ItD.Get() );
         }
-      else
-        {
-        typedef BinaryContourImageFilter<RealImageType, RealImageType>
-          ContourFilterType;
-        typename ContourFilterType::Pointer contour = ContourFilterType::New();
-        contour->SetInput( thresholder->GetOutput() );
-        contour->FullyConnectedOff();
-        contour->SetBackgroundValue( 0 );
-        contour->SetForegroundValue( 1 );
-        contour->Update();
-
-        typedef FastMarchingImageFilter<RealImageType, RealImageType>
-          FastMarchingFilterType;
-        typename FastMarchingFilterType::Pointer fastMarching
-          = FastMarchingFilterType::New();
-        fastMarching->SetInput( contour->GetOutput() );
-        fastMarching->SetStoppingValue( NumericTraits<RealType>::max() );
-        fastMarching->SetTopologyCheck( FastMarchingFilterType::None );
-        fastMarching->Update();
-
-        ImageRegionIterator<RealImageType> ItT( thresholder->GetOutput(),
-          thresholder->GetOutput()->GetRequestedRegion() );
-        ImageRegionIterator<RealImageType> ItF( fastMarching->GetOutput(),
-          fastMarching->GetOutput()->GetRequestedRegion() );
-        for( ItT.GoToBegin(), ItF.GoToBegin(); !ItT.IsAtEnd(); ++ItT, ++ItF )
-          {
-          if( ItT.Get() == 1 )
-            {
-            ItF.Set( -ItF.Get() );
-            }
-          }
+      }
 
-        distanceImage = fastMarching->GetOutput();
-        }
+    RealType labelSigma = 0.1;
+    RealType labelBoundaryProbability = 0.75;
 
-      distancePriorProbabilityImage = distanceImage;
+    typename LabelParameterMapType::iterator it =
+      this->m_PriorLabelParameterMap.find( c + 1 );
+    if( it == this->m_PriorLabelParameterMap.end() )
+      {
+      itkWarningMacro( "The parameters for label \'" << c + 1 <<
+        "\' are not specified.  Using the default values of " <<
+        "sigma = " << labelSigma << ", boundary probability = " <<
+        labelBoundaryProbability );
+      }
+    else
+      {
+      labelSigma = ( it->second ).first;
+      labelBoundaryProbability = ( it->second ).second;
+      }
 
-      RealType maximumInteriorDistance = 0.0;
+    for( SizeValueType i = 0; i < numberOfVoxels; i++ )
+      {
+      RealType distance = distanceImage->GetPixel(
+        output->ComputeIndex( this->m_MaskedVoxelOffsets[i] ) );
 
-      ImageRegionIterator<RealImageType> ItD( distancePriorProbabilityImage,
-        distancePriorProbabilityImage->GetRequestedRegion() );
-      for( ItD.GoToBegin(); !ItD.IsAtEnd(); ++ItD )
+      RealType probability = 0.0;
+      if( labelSigma == 0 )
         {
-        if( ItD.Get() < 0 &&
-          maximumInteriorDistance < vnl_math_abs( ItD.Get() ) )
-          {
-          maximumInteriorDistance = vnl_math_abs( ItD.Get() );
-          }
+        probability = 0.0;
         }
-
-      RealType labelSigma = 0.1;
-      RealType labelBoundaryProbability = 0.75;
-
-      typename LabelParameterMapType::iterator it =
-        this->m_PriorLabelParameterMap.find( whichClass );
-      if( it == this->m_PriorLabelParameterMap.end() )
+      else if( distance >= 0 )
         {
-        itkWarningMacro( "The parameters for label \'" << whichClass <<
-          "\' are not specified.  Using the default values of " <<
-          "sigma = " << labelSigma << ", boundary probability = " <<
-          labelBoundaryProbability );
+        probability = labelBoundaryProbability
+          * vcl_exp( -distance / vnl_math_sqr( labelSigma ) );
         }
       else
         {
-        labelSigma = ( it->second ).first;
-        labelBoundaryProbability = ( it->second ).second;
+        probability = 1.0 - ( 1.0 - labelBoundaryProbability )
+          * ( maximumInteriorDistance - vnl_math_abs( distance ) )
+          / ( maximumInteriorDistance );
         }
+      this->m_DistancePriorProbabilities[c * numberOfVoxels + i] =
+        probability;
+      sumDistancePriorProbabilities[i] += probability;
+      }
+    }
 
-      for( ItD.GoToBegin(); !ItD.IsAtEnd(); ++ItD )
+  /**
+   * Normalize the distance prior probabilities.
+   */
+  for( unsigned int c = 0; c < this->m_NumberOfClasses; c++ )
+    {
+    for( SizeValueType i = 0; i < numberOfVoxels; i++ )
+      {
+      RealType &probability =
+        this->m_DistancePriorProbabilities[c * numberOfVoxels + i];
+      probability -= ( sumDistancePriorProbabilities[i] - probability );
+      if( probability < 0 )
         {
-        if( labelSigma == 0 )
-          {
-          ItD.Set( 0.0 );
-          }
-        else if( ItD.Get() >= 0 )
-          {
-          ItD.Set( labelBoundaryProbability
-            * vcl_exp( -ItD.Get() / vnl_math_sqr( labelSigma ) ) );
-          }
-        else if( ItD.Get() < 0 )
-          {
-          ItD.Set( 1.0 - ( 1.0 - labelBoundaryProbability )
-            * ( maximumInteriorDistance - vnl_math_abs( ItD.Get() ) )
-            / ( maximumInteriorDistance ) );
-          }
+        probability = 0;
         }
+      }
+    }
+}
 
-      /**
-       * Normalize the distance prior probability image(s).
-       */
-      ImageRegionIterator<RealImageType> ItS(
-        this->m_SumDistancePriorProbabilityImage,
-        this->m_SumDistancePriorProbabilityImage->GetRequestedRegion() );
-      for( ItD.GoToBegin(), ItS.GoToBegin(); !ItS.IsAtEnd(); ++ItD, ++ItS )
-        {
-        ItD.Set( ItD.Get() - ( ItS.Get() - ItD.Get() ) );
-        if( ItD.Get() < 0 )
-          {
-          ItD.Set( 0 );
-          }
-        }
-      return distancePriorProbabilityImage;
+template <class TInputImage, class TMaskImage, class TClassifiedImage>
+typename ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
+::RealImageType::Pointer
+ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
+::GetDistancePriorProbabilityImageFromPriorLabelImage( unsigned int whichClass )
+{
+  if( whichClass > this->m_NumberOfClasses )
+    {
+    itkExceptionMacro(
+      "Requested class is greater than the number of classes." );
+    }
+  if( this->m_DistancePriorProbabilities.empty() )
+    {
+    if( this->m_MaskedVoxelOffsets.empty() || !this->GetPriorLabelImage() )
+      {
+      itkExceptionMacro( "The distance prior probabilities are only "
+        << "available once the filter has been updated with a prior label "
+        << "image." );
       }
+    this->ComputeDistancePriorProbabilities();
     }
+
+  return this->ExpandMaskedValues( this->m_DistancePriorProbabilities,
+    whichClass );
 }
 
+
 template <class TInputImage, class TMaskImage, class TClassifiedImage>
 typename ApocritaSegmentationImageFilter<TInputImage, TMaskImage, TClassifiedImage>
 ::RealImageType::Pointer
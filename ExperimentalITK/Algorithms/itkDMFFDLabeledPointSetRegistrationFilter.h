@@ -22,10 +22,12 @@
 #include "itkBSplineControlPointImageFilter.h"
 #include "itkBSplineScatteredDataPointSetToImageFilter.h"
 #include "itkImage.h"
+#include "itkJensenHavrdaCharvatTsallisLabeledPointSetMetric.h"
 #include "itkPointSet.h"
 #include "itkVector.h"
 
 #include <map>
+#include <vector>
 
 namespace itk {
 /** \class DMFFDLabeledPointSetRegistrationFilter
@@ -36,6 +38,13 @@ namespace itk {
     point-set.  The total deformation field, described by control points,
     can subsequently be used to generate the resulting sampled deformation
     field.
+    \par The moving points are fixed in the (similarity transformed) source
+    space, so the B-spline basis weights of every moving point are computed
+    once per level and stored as a sparse matrix.  Warping the moving points
+    is then a sparse matrix-vector product with the control point lattice and
+    fitting the gradient to the lattice uses the transpose.  The point-set
+    metric is kept between evaluations so that the fixed densities are only
+    rebuilt when the annealed point-set sigma changes.
 */
 template<class TFixedPointSet, class TMovingPointSet = TFixedPointSet,
   class TWarpedPointSet = TFixedPointSet>
@@ -108,6 +117,9 @@ public:
   typedef typename
     ControlPointFilterType::DirectionType           DirectionType;
 
+  typedef JensenHavrdaCharvatTsallisLabeledPointSetMetric
+    <FixedPointSetType>                             PointSetMetricType;
+
   /** Main functions */
   void RunRegistration()
     { this->Update(); }
@@ -313,6 +325,17 @@ private :
   RealType EvaluateMetricAndGradient();
   RealType EvaluateMetric( RealType );
 
+  /**
+   * Sparse B-spline basis of the moving points and the point-set metric
+   */
+  void UpdateBasisMatrix();
+  RealType EvaluateBSplineBasis( RealType ) const;
+  VectorType EvaluateBasisRow( unsigned long, const VectorType *,
+    const VectorType *, RealType ) const;
+  void WarpMovingPoints( const ControlPointLatticeType *,
+    const ControlPointLatticeType *, RealType, MovingPointSetType * ) const;
+  void UpdatePointSetMetric( MovingPointSetType * );
+
   /**
    * Conjugate gradient descent and ancillary functions
    */
@@ -379,6 +402,22 @@ private :
   ControlPointLatticePointer            m_CurrentDeformationFieldControlPoints;
   ControlPointLatticePointer            m_GradientFieldControlPoints;
 
+  /**
+   * Basis weights of the moving points inside the transformation domain in
+   * compressed row format.  Row r corresponds to the moving point with
+   * identifier m_BasisPointIdentifiers[r], and its nonzero weights are
+   * m_BasisValues[m_BasisRowOffsets[r]] to
+   * m_BasisValues[m_BasisRowOffsets[r+1]-1] at the lattice offsets in
+   * m_BasisColumns.
+   */
+  std::vector<unsigned long>            m_BasisPointIdentifiers;
+  std::vector<bool>                     m_BasisRowIsInterior;
+  std::vector<unsigned long>            m_BasisRowOffsets;
+  std::vector<unsigned long>            m_BasisColumns;
+  std::vector<RealType>                 m_BasisValues;
+
+  typename PointSetMetricType::Pointer  m_PointSetMetric;
+
   /**
    * Other variables.
    */
@@ -24,7 +24,6 @@ PURPOSE.  See the above copyright notices for more information.
 #include "itkAddImageFilter.h"
 #include "itkImageDuplicator.h"
 #include "itkImageRegionIteratorWithIndex.h"
-#include "itkJensenHavrdaCharvatTsallisLabeledPointSetMetric.h"
 #include "itkMultiplyImageFilter.h"
 
 #include "vnl/vnl_math.h"
@@ -85,6 +84,7 @@ DMFFDLabeledPointSetRegistrationFilter
 ::GenerateData()
 {
   this->m_CurrentAnnealing = 1.0;
+  this->m_PointSetMetric = NULL;
 
   for( this->m_CurrentLevel = 0; this->m_CurrentLevel
     < this->m_MaximumNumberOfIterations.Size(); this->m_CurrentLevel++ )
@@ -114,21 +114,17 @@ DMFFDLabeledPointSetRegistrationFilter
       }
     }
 
-  // Warp the input points
+  // Warp the input points.  Points outside the transformation domain are
+  // not displaced.
 
   typename WarpedPointSetType::Pointer warpedPoints
     = WarpedPointSetType::New();
   warpedPoints->Initialize();
 
-  typename ControlPointFilterType::Pointer bspliner
-    = ControlPointFilterType::New();
-  bspliner->SetSplineOrder( this->m_SplineOrder );
-  bspliner->SetInput( this->m_TotalDeformationFieldControlPoints );
-  bspliner->SetOrigin( this->m_Origin );
-  bspliner->SetSize( this->m_Size );
-  bspliner->SetSpacing( this->m_Spacing );
-  bspliner->SetDirection( this->m_Direction );
+  const VectorType *lattice =
+    this->m_TotalDeformationFieldControlPoints->GetBufferPointer();
 
+  unsigned long row = 0;
   typename MovingPointSetType::PointsContainerConstIterator ItM =
     this->m_SimilarityTransformMovingPointSet->GetPoints()->Begin();
   typename MovingPointSetType::PointDataContainer::ConstIterator ItD =
@@ -137,26 +133,21 @@ DMFFDLabeledPointSetRegistrationFilter
     {
     MovingPointType inputPoint = ItM.Value();
 
-    typename ControlPointFilterType::PointType point;
-    point.CastFrom( inputPoint );
-
     VectorType vector;
     vector.Fill( 0 );
-    try
-      {
-      bspliner->EvaluateAtPoint( point, vector );
-      }
-    catch(...)
+    if( row < this->m_BasisPointIdentifiers.size() &&
+      this->m_BasisPointIdentifiers[row] == ItM.Index() )
       {
-      vector.Fill( 0 );
+      vector = this->EvaluateBasisRow( row++, lattice, NULL, 0.0 );
       }
-    point += vector;
+
+    WarpedPointType point;
     for( unsigned int d = 0; d < Dimension; d++ )
       {
-      inputPoint[d] = point[d];
+      point[d] = inputPoint[d] + vector[d];
       }
 
-    warpedPoints->SetPoint( ItM.Index(), inputPoint );
+    warpedPoints->SetPoint( ItM.Index(), point );
     warpedPoints->SetPointData( ItM.Index(), ItD.Value() );
     ++ItM;
     ++ItD;
@@ -284,6 +275,8 @@ DMFFDLabeledPointSetRegistrationFilter
     this->m_GradientFieldControlPoints->Allocate();
     this->m_GradientFieldControlPoints->FillBuffer( V );
     }
+
+  this->UpdateBasisMatrix();
 }
 
 template<class TFixedPointSet, class TMovingPointSet, class TWarpedPointSet>
@@ -590,117 +583,22 @@ DMFFDLabeledPointSetRegistrationFilter
 ::EvaluateMetric( RealType t = 0 )
 {
   /**
-   * Warp the moving points
+   * Warp the moving points with the total field plus t times the gradient
    */
   typename MovingPointSetType::Pointer warpedPoints
     = MovingPointSetType::New();
   warpedPoints->Initialize();
 
-  typename RealImageType::Pointer lambda = RealImageType::New();
-  lambda->SetRegions( this->m_TotalDeformationFieldControlPoints
-    ->GetLargestPossibleRegion().GetSize() );
-  lambda->Allocate();
-  lambda->FillBuffer( t );
-
-  typedef MultiplyImageFilter<ControlPointLatticeType, RealImageType,
-    ControlPointLatticeType> MultiplierType;
-  typename MultiplierType::Pointer multiplier = MultiplierType::New();
-  multiplier->SetInput1( this->m_GradientFieldControlPoints );
-  multiplier->SetInput2( lambda );
-  multiplier->Update();
-
-  typedef AddImageFilter<ControlPointLatticeType, ControlPointLatticeType,
-    ControlPointLatticeType> AdderType;
-  typename AdderType::Pointer adder = AdderType::New();
-  adder->SetInput1( multiplier->GetOutput() );
-  adder->SetInput2( this->m_TotalDeformationFieldControlPoints );
-  adder->Update();
-
-  typename ControlPointFilterType::Pointer bspliner
-    = ControlPointFilterType::New();
-  bspliner->SetSplineOrder( this->m_SplineOrder );
-  bspliner->SetInput( adder->GetOutput() );
-  bspliner->SetOrigin( this->m_Origin );
-  bspliner->SetSize( this->m_Size );
-  bspliner->SetSpacing( this->m_Spacing );
-  bspliner->SetDirection( this->m_Direction );
-
-  unsigned long count = 0;
-  typename MovingPointSetType::PointsContainerConstIterator ItM =
-    this->m_SimilarityTransformMovingPointSet->GetPoints()->Begin();
-  typename MovingPointSetType::PointDataContainer::ConstIterator ItD =
-    this->m_SimilarityTransformMovingPointSet->GetPointData()->Begin();
-  while( ItM != this->m_SimilarityTransformMovingPointSet->GetPoints()->End() )
-    {
-    MovingPointType inputPoint = ItM.Value();
-
-    typename ControlPointFilterType::PointType point;
-    point.CastFrom( inputPoint );
-
-    VectorType vector;
-    try
-      {
-      bspliner->EvaluateAtPoint( point, vector );
-      }
-    catch(...)
-      {
-      ++ItM;
-      ++ItD;
-      continue;
-      }
-    inputPoint += vector;
+  this->WarpMovingPoints( this->m_TotalDeformationFieldControlPoints,
+    this->m_GradientFieldControlPoints, t, warpedPoints );
 
-    warpedPoints->SetPoint( count, inputPoint );
-    warpedPoints->SetPointData( count, ItD.Value() );
-    count++;
-    ++ItM;
-    ++ItD;
-    }
+  this->UpdatePointSetMetric( warpedPoints );
 
-  /**
-   * Set up the point-set function
-   */
-  typedef itk::JensenHavrdaCharvatTsallisLabeledPointSetMetric
-    <FixedPointSetType> PointSetFunctionType;
-  typename PointSetFunctionType::Pointer pointSetFunction
-    = PointSetFunctionType::New();
-
-  pointSetFunction->SetUseWithRespectToTheMovingPointSet( true );
-  pointSetFunction->SetUseAnisotropicCovariances(
-    this->m_UseAnisotropicCovariances );
-  pointSetFunction->SetUseInputAsSamples(
-    this->m_UseInputAsSamples );
-  pointSetFunction->SetUseRegularizationTerm( this->m_UseRegularizationTerm );
-  pointSetFunction->SetAlpha( this->m_Alpha );
-
-  pointSetFunction->SetFixedPointSet( this->GetInput( 0 ) );
-  pointSetFunction->SetFixedPointSetSigma( this->m_CurrentPointSetSigma
-    * vcl_sqrt( this->m_CurrentAnnealing ) );
-  pointSetFunction->SetFixedKernelSigma( this->m_KernelSigma );
-  pointSetFunction->SetFixedCovarianceKNeighborhood(
-    this->m_CovarianceKNeighborhood );
-  pointSetFunction->SetFixedEvaluationKNeighborhood(
-    this->m_EvaluationKNeighborhood );
-  pointSetFunction->SetNumberOfFixedSamples( this->m_NumberOfFixedSamples );
-
-  pointSetFunction->SetMovingPointSet( warpedPoints );
-  pointSetFunction->SetMovingPointSetSigma( this->m_CurrentPointSetSigma
-    * vcl_sqrt( this->m_CurrentAnnealing ) );
-  pointSetFunction->SetMovingKernelSigma( this->m_KernelSigma );
-  pointSetFunction->SetMovingCovarianceKNeighborhood(
-    this->m_CovarianceKNeighborhood );
-  pointSetFunction->SetMovingEvaluationKNeighborhood(
-    this->m_EvaluationKNeighborhood );
-  pointSetFunction->SetNumberOfFixedSamples( this->m_NumberOfMovingSamples );
-
-  pointSetFunction->Initialize();
-
-  typename PointSetFunctionType
-    ::DefaultTransformType::ParametersType parameters;
+  typename PointSetMetricType::DefaultTransformType::ParametersType parameters;
   parameters.Fill( 0 );
 
-  typename PointSetFunctionType::MeasureType value
-    = pointSetFunction->GetValue( parameters );
+  typename PointSetMetricType::MeasureType value
+    = this->m_PointSetMetric->GetValue( parameters );
 
   RealType sumValue = 0.0;
   for( unsigned int n = 0; n < value.Size(); n++ )
@@ -725,92 +623,17 @@ DMFFDLabeledPointSetRegistrationFilter
     = MovingPointSetType::New();
   warpedPoints->Initialize();
 
-  typename ControlPointFilterType::Pointer bspliner
-    = ControlPointFilterType::New();
-
-  bspliner->SetSplineOrder( this->m_SplineOrder );
-  bspliner->SetInput( this->m_TotalDeformationFieldControlPoints );
-  bspliner->SetOrigin( this->m_Origin );
-  bspliner->SetSize( this->m_Size );
-  bspliner->SetSpacing( this->m_Spacing );
-  bspliner->SetDirection( this->m_Direction );
-
-  unsigned long count = 0;
-  typename MovingPointSetType::PointsContainerConstIterator ItM =
-    this->m_SimilarityTransformMovingPointSet->GetPoints()->Begin();
-  typename MovingPointSetType::PointDataContainer::ConstIterator ItD =
-    this->m_SimilarityTransformMovingPointSet->GetPointData()->Begin();
-  while( ItM != this->m_SimilarityTransformMovingPointSet->GetPoints()->End() )
-    {
-    MovingPointType inputPoint = ItM.Value();
+  this->WarpMovingPoints( this->m_TotalDeformationFieldControlPoints,
+    NULL, 0.0, warpedPoints );
 
-    typename ControlPointFilterType::PointType point;
-    point.CastFrom( inputPoint );
+  this->UpdatePointSetMetric( warpedPoints );
 
-    VectorType vector;
-    try
-      {
-      bspliner->EvaluateAtPoint( point, vector );
-      }
-    catch(...)
-      {
-      ++ItM;
-      ++ItD;
-      continue;
-      }
-    inputPoint += vector;
-
-    warpedPoints->SetPoint( count, inputPoint );
-    warpedPoints->SetPointData( count, ItD.Value() );
-    count++;
-    ++ItM;
-    ++ItD;
-    }
-
-  /**
-   * Set up the point-set function
-   */
-  typedef itk::JensenHavrdaCharvatTsallisLabeledPointSetMetric
-    <FixedPointSetType> PointSetFunctionType;
-  typename PointSetFunctionType::Pointer pointSetFunction
-    = PointSetFunctionType::New();
-
-  pointSetFunction->SetUseWithRespectToTheMovingPointSet( true );
-  pointSetFunction->SetUseAnisotropicCovariances(
-    this->m_UseAnisotropicCovariances );
-  pointSetFunction->SetUseInputAsSamples( this->m_UseInputAsSamples );
-  pointSetFunction->SetUseRegularizationTerm( this->m_UseRegularizationTerm );
-  pointSetFunction->SetAlpha( this->m_Alpha );
-
-  pointSetFunction->SetFixedPointSet( this->GetInput( 0 ) );
-  pointSetFunction->SetFixedPointSetSigma( this->m_CurrentPointSetSigma
-      * vcl_sqrt( this->m_CurrentAnnealing ) );
-  pointSetFunction->SetFixedKernelSigma( this->m_KernelSigma );
-  pointSetFunction->SetFixedCovarianceKNeighborhood(
-    this->m_CovarianceKNeighborhood );
-  pointSetFunction->SetFixedEvaluationKNeighborhood(
-    this->m_EvaluationKNeighborhood );
-  pointSetFunction->SetNumberOfFixedSamples( this->m_NumberOfFixedSamples );
-
-  pointSetFunction->SetMovingPointSet( warpedPoints );
-  pointSetFunction->SetMovingPointSetSigma( this->m_CurrentPointSetSigma
-      * vcl_sqrt( this->m_CurrentAnnealing ) );
-  pointSetFunction->SetMovingKernelSigma( this->m_KernelSigma );
-  pointSetFunction->SetMovingCovarianceKNeighborhood(
-    this->m_CovarianceKNeighborhood );
-  pointSetFunction->SetMovingEvaluationKNeighborhood(
-    this->m_EvaluationKNeighborhood );
-  pointSetFunction->SetNumberOfMovingSamples( this->m_NumberOfMovingSamples );
-
-  pointSetFunction->Initialize();
-
-  typename PointSetFunctionType::DefaultTransformType
-    ::ParametersType parameters;
+  typename PointSetMetricType::DefaultTransformType::ParametersType parameters;
   parameters.Fill( 0 );
 
-  typename PointSetFunctionType::DerivativeType pointSetGradient;
-  typename PointSetFunctionType::MeasureType value;
-  pointSetFunction->GetValueAndDerivative(
+  typename PointSetMetricType::DerivativeType pointSetGradient;
+  typename PointSetMetricType::MeasureType value;
+  this->m_PointSetMetric->GetValueAndDerivative(
     parameters, value, pointSetGradient );
 
   RealType sumValue = 0.0;
@@ -819,55 +642,48 @@ DMFFDLabeledPointSetRegistrationFilter
     sumValue += value[n];
     }
 
-  typename BSplinePointSetType::Pointer fieldPoints
-    = BSplinePointSetType::New();
-  fieldPoints->Initialize();
-  typename BSplineFilterType::WeightsContainerType::Pointer weights
-    = WeightsContainerType::New();
-  weights->Initialize();
+  /**
+   * Collect the gradients of the moving points in the interior of the
+   * transformation domain.  The displacement of a moving point is
+   * linear in the control points with the basis weights of its source
+   * location, so those are the weights used to fit the gradient.
+   */
+  unsigned long numberOfRows = this->m_BasisPointIdentifiers.size();
 
-  count = 0;
-  for( unsigned int n = 0; n < pointSetFunction->GetNumberOfValues(); n++ )
-    {
-    typename BSplinePointSetType::PointType fieldPoint;
-    VectorType gradient;
+  std::vector<VectorType> gradients( numberOfRows );
+  std::vector<RealType> weights( numberOfRows, 0.0 );
 
-    MovingPointType warpedPoint;
-    warpedPoints->GetPoint( n, &warpedPoint );
+  unsigned long count = 0;
+  RealType sumSquaredNorm = 0.0;
+  for( unsigned long r = 0; r < numberOfRows; r++ )
+    {
+    if( !this->m_BasisRowIsInterior[r] )
+      {
+      continue;
+      }
 
     WarpedPixelType label = 1;
-    warpedPoints->GetPointData( n, &label );
+    warpedPoints->GetPointData( r, &label );
 
-    bool isInside = true;
     for( unsigned d = 0; d < Dimension; d++ )
       {
-      gradient[d] = pointSetGradient(n, d);
+      gradients[r][d] = pointSetGradient(r, d);
       if( !this->m_Directionality[d] )
         {
-        gradient[d] = 0.0;
-        }
-      fieldPoint[d] = warpedPoint[d];
-      if( fieldPoint[d] <= this->m_Origin[d] ||
-          fieldPoint[d] >= this->m_Origin[d] + this->m_Spacing[d]
-        * static_cast<RealType>( this->m_Size[d] - 1 ) )
-        {
-        isInside = false;
+        gradients[r][d] = 0.0;
         }
       }
-    if( isInside )
+    sumSquaredNorm += gradients[r].GetSquaredNorm();
+
+    if( this->m_LabelWeights.size() == 0 )
       {
-      fieldPoints->SetPoint( count, fieldPoint );
-      fieldPoints->SetPointData( count, gradient );
-      if( this->m_LabelWeights.size() == 0 )
-        {
-        weights->InsertElement( count, 1.0 );
-        }
-      else
-        {
-        weights->InsertElement( count, this->m_LabelWeights[label] );
-        }
-      count++;
+      weights[r] = 1.0;
       }
+    else
+      {
+      weights[r] = this->m_LabelWeights[label];
+      }
+    count++;
     }
 
   /**
@@ -882,13 +698,6 @@ DMFFDLabeledPointSetRegistrationFilter
     */
   itkDebugMacro( "Normalizing gradient values." );
 
-  RealType sumSquaredNorm = 0.0;
-  for( unsigned int i = 0; i < fieldPoints->GetNumberOfPoints(); i++ )
-    {
-    VectorType gradient;
-    fieldPoints->GetPointData( i, &gradient );
-    sumSquaredNorm += gradient.GetSquaredNorm();
-    }
   VectorType V;
   RealType sigma;
   for( unsigned int i = 0; i < Dimension; i++ )
@@ -904,45 +713,346 @@ DMFFDLabeledPointSetRegistrationFilter
     sigma = V.GetNorm()/vcl_sqrt( 2.0 );
     }
   RealType gradientNormalizationFactor = sigma*vcl_sqrt
-    ( static_cast<RealType>( Dimension *
-    fieldPoints->GetNumberOfPoints() ) / sumSquaredNorm );
+    ( static_cast<RealType>( Dimension * count ) / sumSquaredNorm )
+    * this->m_GradientScalingFactor[this->m_CurrentLevel];
+
+  /**
+   * Fit the gradient to the control point lattice by applying the
+   * transpose of the basis matrix with the normalization of the
+   * single level B-spline approximation.
+   */
+  ControlPointLatticePointer gradientLattice = ControlPointLatticeType::New();
+  gradientLattice->SetOrigin(
+    this->m_TotalDeformationFieldControlPoints->GetOrigin() );
+  gradientLattice->SetSpacing(
+    this->m_TotalDeformationFieldControlPoints->GetSpacing() );
+  gradientLattice->SetDirection(
+    this->m_TotalDeformationFieldControlPoints->GetDirection() );
+  gradientLattice->SetRegions(
+    this->m_TotalDeformationFieldControlPoints->GetLargestPossibleRegion() );
+  gradientLattice->Allocate();
+
+  unsigned long numberOfControlPoints = gradientLattice
+    ->GetLargestPossibleRegion().GetNumberOfPixels();
+
+  std::vector<VectorType> delta( numberOfControlPoints );
+  std::vector<RealType> omega( numberOfControlPoints, 0.0 );
+  for( unsigned long k = 0; k < numberOfControlPoints; k++ )
+    {
+    delta[k].Fill( 0.0 );
+    }
 
-  for( unsigned int i = 0; i < fieldPoints->GetNumberOfPoints(); i++ )
+  for( unsigned long r = 0; r < numberOfRows; r++ )
     {
-    VectorType gradient;
-    fieldPoints->GetPointData( i, &gradient );
-    fieldPoints->SetPointData( i,
-      gradient*gradientNormalizationFactor
-      *this->m_GradientScalingFactor[this->m_CurrentLevel] );
+    if( !this->m_BasisRowIsInterior[r] )
+      {
+      continue;
+      }
+    VectorType gradient = gradients[r] * gradientNormalizationFactor;
+
+    RealType w2Sum = 0.0;
+    for( unsigned long j = this->m_BasisRowOffsets[r];
+      j < this->m_BasisRowOffsets[r+1]; j++ )
+      {
+      w2Sum += this->m_BasisValues[j] * this->m_BasisValues[j];
+      }
+    if( w2Sum <= 0.0 )
+      {
+      continue;
+      }
+    for( unsigned long j = this->m_BasisRowOffsets[r];
+      j < this->m_BasisRowOffsets[r+1]; j++ )
+      {
+      RealType B = this->m_BasisValues[j];
+      RealType wt2 = weights[r] * B * B;
+      delta[this->m_BasisColumns[j]] += gradient * ( wt2 * B / w2Sum );
+      omega[this->m_BasisColumns[j]] += wt2;
+      }
     }
 
-  typename BSplineFilterType::ArrayType nlevels;
-  typename BSplineFilterType::ArrayType ncps;
+  VectorType *phi = gradientLattice->GetBufferPointer();
+  for( unsigned long k = 0; k < numberOfControlPoints; k++ )
+    {
+    if( omega[k] != 0.0 )
+      {
+      phi[k] = delta[k] / omega[k];
+      }
+    else
+      {
+      phi[k].Fill( 0.0 );
+      }
+    }
+
+  this->m_GradientFieldControlPoints = gradientLattice;
+
+  return sumValue;
+}
+
+template<class TFixedPointSet, class TMovingPointSet, class TWarpedPointSet>
+void
+DMFFDLabeledPointSetRegistrationFilter
+  <TFixedPointSet, TMovingPointSet, TWarpedPointSet>
+::UpdateBasisMatrix()
+{
+  /**
+   * Compute, for every moving point in the transformation domain, the
+   * B-spline basis weights of the control points in its support in the
+   * same way as BSplineControlPointImageFilter::EvaluateAtPoint().
+   */
+  typename ControlPointLatticeType::SizeType latticeSize =
+    this->m_TotalDeformationFieldControlPoints
+      ->GetLargestPossibleRegion().GetSize();
 
-  nlevels.Fill( 1 );
+  unsigned long strides[Dimension];
+  unsigned int numberOfSpans[Dimension];
+  unsigned long numberOfSupportPoints = 1;
   for( unsigned int d = 0; d < Dimension; d++ )
     {
-    ncps[d] = this->m_TotalDeformationFieldControlPoints
-      ->GetLargestPossibleRegion().GetSize()[d];
+    strides[d] = ( d == 0 ) ? 1 : strides[d-1] * latticeSize[d-1];
+    numberOfSpans[d] = latticeSize[d] - this->m_SplineOrder;
+    numberOfSupportPoints *= ( this->m_SplineOrder + 1 );
     }
 
-  typename BSplineFilterType::Pointer bsplineFilter = BSplineFilterType::New();
+  this->m_BasisPointIdentifiers.clear();
+  this->m_BasisRowIsInterior.clear();
+  this->m_BasisColumns.clear();
+  this->m_BasisValues.clear();
+  this->m_BasisRowOffsets.clear();
+  this->m_BasisRowOffsets.push_back( 0 );
 
-  bsplineFilter->SetInput( fieldPoints );
-  bsplineFilter->SetOrigin( this->m_Origin );
-  bsplineFilter->SetSpacing( this->m_Spacing );
-  bsplineFilter->SetSize( this->m_Size );
-  bsplineFilter->SetDirection( this->m_Direction );
-  bsplineFilter->SetNumberOfLevels( nlevels );
-  bsplineFilter->SetSplineOrder( this->m_SplineOrder );
-  bsplineFilter->SetNumberOfControlPoints( ncps );
-  bsplineFilter->SetGenerateOutputImage( false );
-  bsplineFilter->SetPointWeights( weights.GetPointer() );
-  bsplineFilter->Update();
+  std::vector<RealType> weights1D( Dimension * ( this->m_SplineOrder + 1 ) );
+  unsigned int startIndex[Dimension];
 
-  this->m_GradientFieldControlPoints = bsplineFilter->GetPhiLattice();
+  typename MovingPointSetType::PointsContainerConstIterator ItM =
+    this->m_SimilarityTransformMovingPointSet->GetPoints()->Begin();
+  while( ItM != this->m_SimilarityTransformMovingPointSet->GetPoints()->End() )
+    {
+    MovingPointType point = ItM.Value();
 
-  return sumValue;
+    bool isInside = true;
+    bool isInterior = true;
+    for( unsigned int d = 0; d < Dimension; d++ )
+      {
+      RealType p = 0.0;
+      for( unsigned int e = 0; e < Dimension; e++ )
+        {
+        p += this->m_Direction[e][d] * ( point[e] - this->m_Origin[e] );
+        }
+      p /= ( this->m_Spacing[d] * static_cast<RealType>( this->m_Size[d] - 1 ) );
+      if( p < 0.0 || p > 1.0 )
+        {
+        isInside = false;
+        break;
+        }
+      if( p <= 0.0 || p >= 1.0 )
+        {
+        isInterior = false;
+        }
+
+      RealType U = p * static_cast<RealType>( numberOfSpans[d] );
+      startIndex[d] = vnl_math_min( static_cast<unsigned int>( U ),
+        numberOfSpans[d] - 1 );
+      for( unsigned int k = 0; k <= this->m_SplineOrder; k++ )
+        {
+        RealType u = U - static_cast<RealType>( startIndex[d] + k )
+          + 0.5 * static_cast<RealType>( this->m_SplineOrder - 1 );
+        weights1D[d * ( this->m_SplineOrder + 1 ) + k] =
+          this->EvaluateBSplineBasis( u );
+        }
+      }
+    if( !isInside )
+      {
+      ++ItM;
+      continue;
+      }
+
+    for( unsigned long n = 0; n < numberOfSupportPoints; n++ )
+      {
+      RealType B = 1.0;
+      unsigned long column = 0;
+      unsigned long m = n;
+      for( unsigned int d = 0; d < Dimension; d++ )
+        {
+        unsigned int k = m % ( this->m_SplineOrder + 1 );
+        m /= ( this->m_SplineOrder + 1 );
+        B *= weights1D[d * ( this->m_SplineOrder + 1 ) + k];
+        column += ( startIndex[d] + k ) * strides[d];
+        }
+      if( B != 0.0 )
+        {
+        this->m_BasisColumns.push_back( column );
+        this->m_BasisValues.push_back( B );
+        }
+      }
+    this->m_BasisRowOffsets.push_back( this->m_BasisColumns.size() );
+    this->m_BasisPointIdentifiers.push_back( ItM.Index() );
+    this->m_BasisRowIsInterior.push_back( isInterior );
+    ++ItM;
+    }
+}
+
+template<class TFixedPointSet, class TMovingPointSet, class TWarpedPointSet>
+typename DMFFDLabeledPointSetRegistrationFilter
+  <TFixedPointSet, TMovingPointSet, TWarpedPointSet>::RealType
+DMFFDLabeledPointSetRegistrationFilter
+  <TFixedPointSet, TMovingPointSet, TWarpedPointSet>
+::EvaluateBSplineBasis( RealType u ) const
+{
+  /**
+   * Centered uniform B-spline of degree m_SplineOrder from the truncated
+   * power expansion.
+   */
+  const unsigned int order = this->m_SplineOrder;
+  RealType x = u + 0.5 * static_cast<RealType>( order + 1 );
+  if( x <= 0.0 || x >= static_cast<RealType>( order + 1 ) )
+    {
+    return 0.0;
+    }
+
+  RealType value = 0.0;
+  RealType binomial = 1.0;
+  RealType sign = 1.0;
+  for( unsigned int k = 0; k <= order + 1; k++ )
+    {
+    RealType y = x - static_cast<RealType>( k );
+    if( y <= 0.0 )
+      {
+      break;
+      }
+    RealType power = 1.0;
+    for( unsigned int i = 0; i < order; i++ )
+      {
+      power *= y;
+      }
+    value += sign * binomial * power;
+    binomial *= static_cast<RealType>( order + 1 - k )
+      / static_cast<RealType>( k + 1 );
+    sign = -sign;
+    }
+
+  RealType factorial = 1.0;
+  for( unsigned int i = 2; i <= order; i++ )
+    {
+    factorial *= static_cast<RealType>( i );
+    }
+  return value / factorial;
+}
+
+template<class TFixedPointSet, class TMovingPointSet, class TWarpedPointSet>
+typename DMFFDLabeledPointSetRegistrationFilter
+  <TFixedPointSet, TMovingPointSet, TWarpedPointSet>::VectorType
+DMFFDLabeledPointSetRegistrationFilter
+  <TFixedPointSet, TMovingPointSet, TWarpedPointSet>
+::EvaluateBasisRow( unsigned long row, const VectorType *lattice,
+  const VectorType *direction, RealType t ) const
+{
+  VectorType vector;
+  vector.Fill( 0.0 );
+  for( unsigned long j = this->m_BasisRowOffsets[row];
+    j < this->m_BasisRowOffsets[row+1]; j++ )
+    {
+    unsigned long column = this->m_BasisColumns[j];
+    if( direction )
+      {
+      vector += ( lattice[column] + direction[column] * t )
+        * this->m_BasisValues[j];
+      }
+    else
+      {
+      vector += lattice[column] * this->m_BasisValues[j];
+      }
+    }
+  return vector;
+}
+
+template<class TFixedPointSet, class TMovingPointSet, class TWarpedPointSet>
+void
+DMFFDLabeledPointSetRegistrationFilter
+  <TFixedPointSet, TMovingPointSet, TWarpedPointSet>
+::WarpMovingPoints( const ControlPointLatticeType *lattice,
+  const ControlPointLatticeType *direction, RealType t,
+  MovingPointSetType *warpedPoints ) const
+{
+  /**
+   * Only the moving points inside the transformation domain are warped.
+   * Warped point r is the moving point of basis row r.
+   */
+  const VectorType *latticeBuffer = lattice->GetBufferPointer();
+  const VectorType *directionBuffer = NULL;
+  if( direction )
+    {
+    directionBuffer = direction->GetBufferPointer();
+    }
+
+  for( unsigned long r = 0; r < this->m_BasisPointIdentifiers.size(); r++ )
+    {
+    MovingPointType point;
+    this->m_SimilarityTransformMovingPointSet->GetPoint(
+      this->m_BasisPointIdentifiers[r], &point );
+    MovingPixelType label = 1;
+    this->m_SimilarityTransformMovingPointSet->GetPointData(
+      this->m_BasisPointIdentifiers[r], &label );
+
+    VectorType vector = this->EvaluateBasisRow( r, latticeBuffer,
+      directionBuffer, t );
+    for( unsigned int d = 0; d < Dimension; d++ )
+      {
+      point[d] += vector[d];
+      }
+
+    warpedPoints->SetPoint( r, point );
+    warpedPoints->SetPointData( r, label );
+    }
+}
+
+template<class TFixedPointSet, class TMovingPointSet, class TWarpedPointSet>
+void
+DMFFDLabeledPointSetRegistrationFilter
+  <TFixedPointSet, TMovingPointSet, TWarpedPointSet>
+::UpdatePointSetMetric( MovingPointSetType *warpedPoints )
+{
+  /**
+   * Set up the point-set function.  The same metric is reused for every
+   * evaluation so that the fixed point-set densities persist as long as
+   * the annealed sigma does not change (e.g. during a line search).
+   */
+  if( !this->m_PointSetMetric )
+    {
+    this->m_PointSetMetric = PointSetMetricType::New();
+
+    this->m_PointSetMetric->SetUseWithRespectToTheMovingPointSet( true );
+    this->m_PointSetMetric->SetUseAnisotropicCovariances(
+      this->m_UseAnisotropicCovariances );
+    this->m_PointSetMetric->SetUseInputAsSamples( this->m_UseInputAsSamples );
+    this->m_PointSetMetric->SetUseRegularizationTerm(
+      this->m_UseRegularizationTerm );
+    this->m_PointSetMetric->SetAlpha( this->m_Alpha );
+
+    this->m_PointSetMetric->SetFixedPointSet( this->GetInput( 0 ) );
+    this->m_PointSetMetric->SetFixedKernelSigma( this->m_KernelSigma );
+    this->m_PointSetMetric->SetFixedCovarianceKNeighborhood(
+      this->m_CovarianceKNeighborhood );
+    this->m_PointSetMetric->SetFixedEvaluationKNeighborhood(
+      this->m_EvaluationKNeighborhood );
+    this->m_PointSetMetric->SetNumberOfFixedSamples(
+      this->m_NumberOfFixedSamples );
+
+    this->m_PointSetMetric->SetMovingKernelSigma( this->m_KernelSigma );
+    this->m_PointSetMetric->SetMovingCovarianceKNeighborhood(
+      this->m_CovarianceKNeighborhood );
+    this->m_PointSetMetric->SetMovingEvaluationKNeighborhood(
+      this->m_EvaluationKNeighborhood );
+    this->m_PointSetMetric->SetNumberOfMovingSamples(
+      this->m_NumberOfMovingSamples );
+    }
+
+  RealType sigma = this->m_CurrentPointSetSigma
+    * vcl_sqrt( this->m_CurrentAnnealing );
+  this->m_PointSetMetric->SetFixedPointSetSigma( sigma );
+  this->m_PointSetMetric->SetMovingPointSetSigma( sigma );
+  this->m_PointSetMetric->SetMovingPointSet( warpedPoints );
+
+  this->m_PointSetMetric->Initialize();
 }
 
 template<class TFixedPointSet, class TMovingPointSet, class TWarpedPointSet>
@@ -20,8 +20,11 @@
 
 #include "itkImageToImageFilter.h"
 
+#include "itkGaussianOperator.h"
 #include "itkVector.h"
 
+#include <vector>
+
 namespace itk
 {
 /** \class DiReCTImageFilter
@@ -82,6 +85,9 @@ public:
   typedef typename VectorImageType::Pointer     VectorImagePointer;
   typedef typename VectorType::ValueType        VectorValueType;
   typedef typename VectorImageType::PointType   PointType;
+  typedef typename InputImageType::IndexType    IndexType;
+  typedef GaussianOperator<VectorValueType,
+    itkGetStaticConstMacro( ImageDimension )>   GaussianOperatorType;
 
   /**
    * Set the segmentation image.  The segmentation image is a labeled image
@@ -270,12 +276,8 @@ private:
   InputImagePointer ExtractRegionalContours( const InputImageType *, unsigned int );
 
   /**
-   * Private function for warping an image.
-   */
-  RealImagePointer WarpImage( const RealImageType *, const VectorImageType * );
-
-  /**
-   * Private function for inverting the deformation field.
+   * Private function for inverting the deformation field.  The inverse field
+   * passed in is used as the starting estimate.
    */
   void InvertDeformationField( const VectorImageType *, VectorImageType * );
 
@@ -285,6 +287,34 @@ private:
   VectorImagePointer SmoothDeformationField( const VectorImageType *,
     const RealType );
 
+  /**
+   * Private function computing the linear interpolation weights at a
+   * displaced voxel.  Returns the number of neighbors, zero outside the
+   * buffer.
+   */
+  unsigned int ComputeLinearInterpolationWeights(
+    const ImageBase<ImageDimension> *, const IndexType &, const VectorType &,
+    OffsetValueType *, RealType * ) const;
+
+  enum ThreadedStageType
+    { WarpStage, GradientStage, ThicknessStage, InversionStage };
+
+  struct DiReCTThreadStruct
+    {
+    DiReCTImageFilter *Filter;
+    ThreadedStageType  Stage;
+    };
+
+  static ITK_THREAD_RETURN_TYPE ThreaderCallback( void *arg );
+
+  /** Runs one pass of the registration on the threads. */
+  void ExecuteThreadedStage( ThreadedStageType stage );
+
+  void ThreadedWarp( ThreadIdType, ThreadIdType );
+  void ThreadedGradient( ThreadIdType, ThreadIdType );
+  void ThreadedThickness( ThreadIdType, ThreadIdType );
+  void ThreadedInversion( ThreadIdType, ThreadIdType );
+
   RealType                                       m_ThicknessPriorEstimate;
   RealType                                       m_SmoothingSigma;
   RealType                                       m_GradientStep;
@@ -299,6 +329,37 @@ private:
   RealType                                       m_CurrentConvergenceMeasurement;
   RealType                                       m_ConvergenceThreshold;
   unsigned int                                   m_ConvergenceWindowSize;
+
+  // Work images and buffers shared with the threaded passes.
+  InputImagePointer                              m_MaskImage;
+  RealImagePointer                               m_WhiteMatterContours;
+  RealImagePointer                               m_HitImage;
+  RealImagePointer                               m_TotalImage;
+  RealImagePointer                               m_ThicknessImage;
+  RealImagePointer                               m_CorticalThicknessImage;
+  RealImagePointer                               m_WarpedWhiteMatterProbabilityMap;
+  VectorImagePointer                             m_GradientImage;
+  VectorImagePointer                             m_InverseField;
+  VectorImagePointer                             m_IntegratedField;
+  VectorImagePointer                             m_VelocityField;
+  unsigned int                                   m_IntegrationPoint;
+
+  std::vector<SizeValueType>                     m_GrayMatterOffsets;
+  std::vector<VectorType>                        m_ForwardIncrements;
+  std::vector<RealType>                          m_ThreadEnergies;
+
+  VectorImagePointer                             m_ComposedField;
+  const VectorImageType                         *m_InversionDeformationField;
+  VectorImageType                               *m_InversionInverseField;
+  RealType                                       m_InversionEpsilon;
+  RealType                                       m_InversionMaximumNorm;
+  RealType                                       m_InversionNormFactor;
+  bool                                           m_ApplyInversionUpdate;
+  bool                                           m_ComposeInversion;
+  std::vector<RealType>                          m_ThreadNormSums;
+  std::vector<RealType>                          m_ThreadNormMaxima;
+
+  std::vector<GaussianOperatorType>              m_SmoothingOperators;
 };
 
 } // end namespace itk
@@ -33,20 +33,15 @@
 #include "itkDiscreteGaussianImageFilter.h"
 #include "itkGaussianOperator.h"
 #include "itkGradientRecursiveGaussianImageFilter.h"
-#include "itkImageDuplicator.h"
 #include "itkImageRegionIterator.h"
 #include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
 #include "itkIterationReporter.h"
 #include "itkMaximumImageFilter.h"
-#include "itkMultiplyByConstantImageFilter.h"
-#include "itkMultiplyByConstantVectorImageFilter.h"
 #include "itkOrImageFilter.h"
 #include "itkPointSet.h"
-#include "itkStatisticsImageFilter.h"
 #include "itkVectorLinearInterpolateImageFunction.h"
 #include "itkVectorNeighborhoodOperatorImageFilter.h"
-#include "itkVectorNormImageFilter.h"
-#include "itkWarpImageFilter.h"
 
 namespace itk
 {
@@ -63,7 +58,15 @@ DiReCTImageFilter<TInputImage, TOutputImage>
   m_MaximumNumberOfIterations( 50 ),
   m_CurrentEnergy( NumericTraits<RealType>::max() ),
   m_ConvergenceThreshold( 0.001 ),
-  m_ConvergenceWindowSize( 10 )
+  m_ConvergenceWindowSize( 10 ),
+  m_IntegrationPoint( 0 ),
+  m_InversionDeformationField( NULL ),
+  m_InversionInverseField( NULL ),
+  m_InversionEpsilon( 0.75 ),
+  m_InversionMaximumNorm( 0.0 ),
+  m_InversionNormFactor( 1.0 ),
+  m_ApplyInversionUpdate( false ),
+  m_ComposeInversion( true )
 {
   this->SetNumberOfRequiredInputs( 3 );
 }
@@ -177,100 +180,93 @@ DiReCTImageFilter<TInputImage, TOutputImage>
 
   VectorType zeroVector( 0.0 );
 
+  const typename InputImageType::RegionType region =
+    this->GetInput()->GetRequestedRegion();
+
+  // The inner loops address every image through its buffer, so all the
+  // inputs have to share the same buffered region.
+
+  for( unsigned int d = 0; d < 3; d++ )
+    {
+    const ImageBase<ImageDimension> *input =
+      dynamic_cast<const ImageBase<ImageDimension> *>(
+      this->ProcessObject::GetInput( d ) );
+    if( input->GetBufferedRegion() != region )
+      {
+      itkExceptionMacro( "The buffered region of input " << d
+        << " does not match the requested region of the segmentation image." );
+      }
+    }
+
   RealImagePointer corticalThicknessImage = RealImageType::New();
   corticalThicknessImage->CopyInformation( this->GetInput() );
-  corticalThicknessImage->SetRegions( this->GetInput()->GetRequestedRegion() );
+  corticalThicknessImage->SetRegions( region );
   corticalThicknessImage->Allocate();
   corticalThicknessImage->FillBuffer( 0.0 );
 
-  VectorImagePointer forwardIncrementalField = VectorImageType::New();
-  forwardIncrementalField->CopyInformation( this->GetInput() );
-  forwardIncrementalField->SetRegions( this->GetInput()->GetRequestedRegion() );
-  forwardIncrementalField->Allocate();
-
   RealImagePointer hitImage = RealImageType::New();
   hitImage->CopyInformation( this->GetInput() );
-  hitImage->SetRegions( this->GetInput()->GetRequestedRegion() );
+  hitImage->SetRegions( region );
   hitImage->Allocate();
 
   VectorImagePointer integratedField = VectorImageType::New();
   integratedField->CopyInformation( this->GetInput() );
-  integratedField->SetRegions( this->GetInput()->GetRequestedRegion() );
+  integratedField->SetRegions( region );
   integratedField->Allocate();
   integratedField->FillBuffer( zeroVector );
 
   VectorImagePointer inverseField = VectorImageType::New();
   inverseField->CopyInformation( this->GetInput() );
-  inverseField->SetRegions( this->GetInput()->GetRequestedRegion() );
+  inverseField->SetRegions( region );
   inverseField->Allocate();
 
-  VectorImagePointer inverseIncrementalField = VectorImageType::New();
-  inverseIncrementalField->CopyInformation( this->GetInput() );
-  inverseIncrementalField->SetRegions( this->GetInput()->GetRequestedRegion() );
-  inverseIncrementalField->Allocate();
-
-  RealImagePointer speedImage = RealImageType::New();
-  speedImage->CopyInformation( this->GetInput() );
-  speedImage->SetRegions( this->GetInput()->GetRequestedRegion() );
-  speedImage->Allocate();
-
   RealImagePointer thicknessImage = RealImageType::New();
   thicknessImage->CopyInformation( this->GetInput() );
-  thicknessImage->SetRegions( this->GetInput()->GetRequestedRegion() );
+  thicknessImage->SetRegions( region );
   thicknessImage->Allocate();
 
   RealImagePointer totalImage = RealImageType::New();
   totalImage->CopyInformation( this->GetInput() );
-  totalImage->SetRegions( this->GetInput()->GetRequestedRegion() );
+  totalImage->SetRegions( region );
   totalImage->Allocate();
 
+  RealImagePointer warpedWhiteMatterProbabilityMap = RealImageType::New();
+  warpedWhiteMatterProbabilityMap->CopyInformation( this->GetInput() );
+  warpedWhiteMatterProbabilityMap->SetRegions( region );
+  warpedWhiteMatterProbabilityMap->Allocate();
+
   VectorImagePointer velocityField = VectorImageType::New();
   velocityField->CopyInformation( this->GetInput() );
-  velocityField->SetRegions( this->GetInput()->GetRequestedRegion() );
+  velocityField->SetRegions( region );
   velocityField->Allocate();
   velocityField->FillBuffer( zeroVector );
 
-  // Instantiate most of the iterators all in one place
-
-  ImageRegionIterator<RealImageType> ItCorticalThicknessImage(
-    corticalThicknessImage,
-    corticalThicknessImage->GetRequestedRegion() );
-  ImageRegionConstIterator<RealImageType> ItGrayMatterProbabilityMap(
-    this->GetGrayMatterProbabilityImage(),
-    this->GetGrayMatterProbabilityImage()->GetRequestedRegion() );
-  ImageRegionIterator<RealImageType> ItHitImage(
-    hitImage,
-    hitImage->GetRequestedRegion() );
-  ImageRegionIterator<VectorImageType> ItForwardIncrementalField(
-    forwardIncrementalField,
-    forwardIncrementalField->GetRequestedRegion() );
-  ImageRegionConstIterator<InputImageType> ItDilatedMatterContours(
-    dilatedMatterContours,
-    dilatedMatterContours->GetRequestedRegion() );
-  ImageRegionIterator<VectorImageType> ItIntegratedField(
-    integratedField,
-    integratedField->GetRequestedRegion() );
-  ImageRegionIterator<VectorImageType> ItInverseIncrementalField(
-    inverseIncrementalField,
-    inverseIncrementalField->GetRequestedRegion() );
-  ImageRegionConstIterator<InputImageType> ItMaskImage(
-    maskImage,
-    maskImage->GetRequestedRegion() );
-  ImageRegionConstIteratorWithIndex<InputImageType> ItSegmentationImage(
-    this->GetSegmentationImage(),
-    this->GetSegmentationImage()->GetRequestedRegion() );
-  ImageRegionIterator<RealImageType> ItSpeedImage(
-    speedImage,
-    speedImage->GetRequestedRegion() );
-  ImageRegionIterator<RealImageType> ItThicknessImage(
-    thicknessImage,
-    thicknessImage->GetRequestedRegion() );
-  ImageRegionIterator<RealImageType> ItTotalImage(
-    totalImage,
-    totalImage->GetRequestedRegion() );
-  ImageRegionConstIterator<RealImageType> ItWhiteMatterContours(
-    whiteMatterContours,
-    whiteMatterContours->GetRequestedRegion() );
+  // The gray matter voxels are the only ones driving the registration and
+  // carrying a thickness estimate so they are listed once.  The forward
+  // increments of the velocity field live on this list only.
+
+  this->m_GrayMatterOffsets.clear();
+  const InputPixelType *segmentation =
+    this->GetSegmentationImage()->GetBufferPointer();
+  for( SizeValueType i = 0; i < region.GetNumberOfPixels(); i++ )
+    {
+    if( segmentation[i] == this->m_GrayMatterLabel )
+      {
+      this->m_GrayMatterOffsets.push_back( i );
+      }
+    }
+
+  this->m_MaskImage = maskImage;
+  this->m_WhiteMatterContours = whiteMatterContours;
+  this->m_HitImage = hitImage;
+  this->m_TotalImage = totalImage;
+  this->m_ThicknessImage = thicknessImage;
+  this->m_CorticalThicknessImage = corticalThicknessImage;
+  this->m_WarpedWhiteMatterProbabilityMap = warpedWhiteMatterProbabilityMap;
+  this->m_IntegratedField = integratedField;
+  this->m_VelocityField = velocityField;
+  this->m_ComposedField = NULL;
+  this->m_SmoothingOperators.clear();
 
   // Instantiate objects for profiling energy convergence
 
@@ -296,36 +292,37 @@ DiReCTImageFilter<TInputImage, TOutputImage>
     currentEnergy[0] = 0.0;
     RealType numberOfGrayMatterVoxels = 0.0;
 
-    forwardIncrementalField->FillBuffer( zeroVector );
+    this->m_ForwardIncrements.assign( this->m_GrayMatterOffsets.size(),
+      zeroVector );
     inverseField->FillBuffer( zeroVector );
-    inverseIncrementalField->FillBuffer( zeroVector );
 
     hitImage->FillBuffer( 0.0 );
     totalImage->FillBuffer( 0.0 );
     thicknessImage->FillBuffer( 0.0 );
 
-    ImageRegionIterator<VectorImageType> ItVelocityField(
-      velocityField,
-      velocityField->GetRequestedRegion() );
-
-    unsigned int integrationPoint = 0;
-    while( integrationPoint++ < this->m_NumberOfIntegrationPoints )
+    this->m_IntegrationPoint = 0;
+    while( this->m_IntegrationPoint++ < this->m_NumberOfIntegrationPoints )
       {
-      typedef ComposeDiffeomorphismsImageFilter<VectorImageType> ComposerType;
-      typename ComposerType::Pointer composer = ComposerType::New();
-      composer->SetDeformationField( inverseIncrementalField );
-      composer->SetWarpingField( inverseField );
-      composer->Update();
+      // The velocity field is masked during the first integration point and
+      // the inverse field is still the identity then, so composition is only
+      // needed afterwards.
+      if( this->m_IntegrationPoint > 1 )
+        {
+        typedef ComposeDiffeomorphismsImageFilter<VectorImageType> ComposerType;
+        typename ComposerType::Pointer composer = ComposerType::New();
+        composer->SetDeformationField( velocityField );
+        composer->SetWarpingField( inverseField );
+        composer->Update();
+
+        inverseField = composer->GetOutput();
+        inverseField->DisconnectPipeline();
+        }
+      this->m_InverseField = inverseField;
 
-      inverseField = composer->GetOutput();
-      inverseField->DisconnectPipeline();
+      // Warp the white matter probability map, the white matter contours and
+      // the thickness in a single pass and accumulate the hits and totals.
 
-   	  RealImagePointer warpedWhiteMatterProbabilityMap = this->WarpImage(
-   	    this->GetWhiteMatterProbabilityImage(), inverseField );
-   	  RealImagePointer warpedWhiteMatterContours = this->WarpImage(
-   	    whiteMatterContours, inverseField );
-   	  RealImagePointer warpedThicknessImage = this->WarpImage(
-   	    thicknessImage, inverseField );
+      this->ExecuteThreadedStage( WarpStage );
 
       typedef GradientRecursiveGaussianImageFilter<RealImageType, VectorImageType>
         GradientImageFilterType;
@@ -335,136 +332,20 @@ DiReCTImageFilter<TInputImage, TOutputImage>
       gradientFilter->SetSigma( this->m_SmoothingSigma );
       gradientFilter->Update();
 
-      VectorImagePointer gradientImage = gradientFilter->GetOutput();
-
-      // Instantiate the iterators all in one place
-
-      ImageRegionIterator<VectorImageType> ItGradientImage(
-        gradientImage,
-        gradientImage->GetRequestedRegion() );
-      ImageRegionIterator<VectorImageType> ItInverseField(
-        inverseField,
-        inverseField->GetRequestedRegion() );
-      ImageRegionIterator<RealImageType> ItWarpedThicknessImage(
-        warpedThicknessImage,
-        warpedThicknessImage->GetRequestedRegion() );
-      ImageRegionIterator<RealImageType> ItWarpedWhiteMatterProbabilityMap(
-        warpedWhiteMatterProbabilityMap,
-        warpedWhiteMatterProbabilityMap->GetRequestedRegion() );
-      ImageRegionIterator<RealImageType> ItWarpedWhiteMatterContours(
-        warpedWhiteMatterContours,
-        warpedWhiteMatterContours->GetRequestedRegion() );
-
-      // Generate speed image
-
-      speedImage->FillBuffer( 0.0 );
-
-      ItGradientImage.GoToBegin();
-      ItGrayMatterProbabilityMap.GoToBegin();
-      ItSegmentationImage.GoToBegin();
-      ItSpeedImage.GoToBegin();
-      ItWarpedWhiteMatterProbabilityMap.GoToBegin();
-
-      while( !ItSegmentationImage.IsAtEnd() )
-        {
-        if( ItSegmentationImage.Get() == this->m_GrayMatterLabel )
-          {
-          RealType norm = ( ItGradientImage.Get() ).GetNorm();
-          if( norm > 1e-3 && !vnl_math_isnan( norm ) && !vnl_math_isinf( norm ) )
-            {
-            ItGradientImage.Set( ItGradientImage.Get() / norm );
-            }
-          else
-            {
-            ItGradientImage.Set( zeroVector );
-            }
-          RealType delta = ( ItWarpedWhiteMatterProbabilityMap.Get() -
-            ItGrayMatterProbabilityMap.Get() );
-
-          currentEnergy[0] += vnl_math_abs( delta );
-          numberOfGrayMatterVoxels++;
-
-          RealType speedValue = -1.0 * delta * ItGrayMatterProbabilityMap.Get() *
-            this->m_GradientStep;
-          if( vnl_math_isnan( speedValue ) || vnl_math_isinf( speedValue ) )
-            {
-            speedValue = 0.0;
-            }
-          ItSpeedImage.Set( speedValue );
-          }
-        ++ItGradientImage;
-        ++ItGrayMatterProbabilityMap;
-        ++ItSegmentationImage;
-        ++ItSpeedImage;
-        ++ItWarpedWhiteMatterProbabilityMap;
-        }
+      this->m_GradientImage = gradientFilter->GetOutput();
 
-      // Calculate objective function value
+      // Accumulate the energy and the forward increments over the gray matter
 
-      ItForwardIncrementalField.GoToBegin();
-      ItGradientImage.GoToBegin();
-      ItIntegratedField.GoToBegin();
-      ItInverseField.GoToBegin();
-      ItInverseIncrementalField.GoToBegin();
-      ItMaskImage.GoToBegin();
-      ItSegmentationImage.GoToBegin();
-      ItSpeedImage.GoToBegin();
-      ItVelocityField.GoToBegin();
-      ItWhiteMatterContours.GoToBegin();
+      this->ExecuteThreadedStage( GradientStage );
+      this->m_GradientImage = NULL;
 
-      while( !ItSegmentationImage.IsAtEnd() )
+      for( unsigned int n = 0; n < this->m_ThreadEnergies.size(); n++ )
         {
-        typename InputImageType::IndexType index =
-          ItSegmentationImage.GetIndex();
-        typename InputImageType::PixelType segmentationValue =
-          ItSegmentationImage.Get();
-
-        if( !ItMaskImage.Get() )
-          {
-          ItIntegratedField.Set( zeroVector );
-          ItInverseField.Set( zeroVector );
-          ItVelocityField.Set( zeroVector );
-          }
-        ItInverseIncrementalField.Set( ItVelocityField.Get() );
-        ItForwardIncrementalField.Set( ItForwardIncrementalField.Get() +
-          ItGradientImage.Get() * ItSpeedImage.Get() );
-
-        if( segmentationValue == this->m_GrayMatterLabel ||
-          segmentationValue == this->m_WhiteMatterLabel )
-          {
-          if( integrationPoint == 1 )
-            {
-            typename InputImageType::PixelType whiteMatterContoursValue =
-              ItWhiteMatterContours.Get();
-            hitImage->SetPixel( index, whiteMatterContoursValue );
-
-            VectorType vector = integratedField->GetPixel( index );
-            RealType weightedNorm = vector.GetNorm() * whiteMatterContoursValue;
-
-            thicknessImage->SetPixel( index, weightedNorm );
-            totalImage->SetPixel( index, weightedNorm );
-            }
-          else if( segmentationValue == this->m_GrayMatterLabel )
-            {
-            hitImage->SetPixel( index, hitImage->GetPixel( index ) +
-              warpedWhiteMatterContours->GetPixel( index ) );
-            totalImage->SetPixel( index, totalImage->GetPixel( index ) +
-              warpedThicknessImage->GetPixel( index ) );
-            }
-          }
-
-        ++ItForwardIncrementalField;
-        ++ItGradientImage;
-        ++ItIntegratedField;
-        ++ItInverseField;
-        ++ItInverseIncrementalField;
-        ++ItMaskImage;
-        ++ItSegmentationImage;
-        ++ItSpeedImage;
-        ++ItVelocityField;
-        ++ItWhiteMatterContours;
+        currentEnergy[0] += this->m_ThreadEnergies[n];
         }
-      if( integrationPoint == 1 )
+      numberOfGrayMatterVoxels += this->m_GrayMatterOffsets.size();
+
+      if( this->m_IntegrationPoint == 1 )
         {
         integratedField->FillBuffer( zeroVector );
         }
@@ -472,45 +353,13 @@ DiReCTImageFilter<TInputImage, TOutputImage>
       this->InvertDeformationField( integratedField, inverseField );
       }
 
-    ItCorticalThicknessImage.GoToBegin();
-    ItForwardIncrementalField.GoToBegin();
-    ItHitImage.GoToBegin();
-    ItSegmentationImage.GoToBegin();
-    ItTotalImage.GoToBegin();
-    ItVelocityField.GoToBegin();
+    // Update the velocity field and the thickness over the gray matter
 
-    while( !ItSegmentationImage.IsAtEnd() )
-      {
-      ItVelocityField.Set( ItVelocityField.Get() +
-        ItForwardIncrementalField.Get() );
-      if( ItSegmentationImage.Get() == this->m_GrayMatterLabel )
-        {
-        RealType thicknessValue = 0.0;
-        if( ItHitImage.Get() > 0.001 )
-          {
-          thicknessValue = ItTotalImage.Get() / ItHitImage.Get();
-          if( thicknessValue < 0.0 )
-            {
-            thicknessValue = 0.0;
-            }
-          if( thicknessValue > this->m_ThicknessPriorEstimate )
-            {
-            thicknessValue = this->m_ThicknessPriorEstimate;
-            }
-          }
+    this->ExecuteThreadedStage( ThicknessStage );
 
-        ItCorticalThicknessImage.Set( thicknessValue );
-        }
-
-      ++ItCorticalThicknessImage;
-      ++ItForwardIncrementalField;
-      ++ItHitImage;
-      ++ItSegmentationImage;
-      ++ItTotalImage;
-      ++ItVelocityField;
-      }
     velocityField = this->SmoothDeformationField( velocityField,
       this->m_SmoothingSigma );
+    this->m_VelocityField = velocityField;
 
     // Calculate current energy and current convergence measurement
 
@@ -608,6 +457,21 @@ DiReCTImageFilter<TInputImage, TOutputImage>
 
   this->SetNthOutput( 0, corticalThicknessImage );
 
+  // Release the work images held for the threaded passes.
+  this->m_MaskImage = NULL;
+  this->m_WhiteMatterContours = NULL;
+  this->m_HitImage = NULL;
+  this->m_TotalImage = NULL;
+  this->m_ThicknessImage = NULL;
+  this->m_CorticalThicknessImage = NULL;
+  this->m_WarpedWhiteMatterProbabilityMap = NULL;
+  this->m_InverseField = NULL;
+  this->m_IntegratedField = NULL;
+  this->m_VelocityField = NULL;
+  this->m_ComposedField = NULL;
+  this->m_GrayMatterOffsets.clear();
+  this->m_ForwardIncrements.clear();
+
   // Replace direction matrices to the inputs.
   for( unsigned int d = 0; d < this->GetNumberOfInputs(); d++ )
     {
@@ -666,101 +530,514 @@ DiReCTImageFilter<TInputImage, TOutputImage>
 }
 
 template<class TInputImage, class TOutputImage>
-typename DiReCTImageFilter<TInputImage, TOutputImage>::RealImagePointer
+void
 DiReCTImageFilter<TInputImage, TOutputImage>
-::WarpImage( const RealImageType *inputImage,
-  const VectorImageType *deformationField )
+::ExecuteThreadedStage( ThreadedStageType stage )
 {
-  typedef WarpImageFilter<RealImageType, RealImageType, VectorImageType>
-    WarperType;
-  typename WarperType::Pointer warper = WarperType::New();
-  warper->SetInput( inputImage );
-  warper->SetDeformationField( deformationField );
-  warper->SetEdgePaddingValue( 0 );
-  warper->SetOutputSpacing( inputImage->GetSpacing() );
-  warper->SetOutputOrigin( inputImage->GetOrigin() );
-  warper->SetOutputDirection( inputImage->GetDirection() );
-
-  RealImagePointer warpedImage = warper->GetOutput();
-  warpedImage->Update();
-  warpedImage->DisconnectPipeline();
-
-  return warpedImage;
+  DiReCTThreadStruct str;
+  str.Filter = this;
+  str.Stage = stage;
+
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->GetMultiThreader()->SetSingleMethod( this->ThreaderCallback, &str );
+
+  // One accumulator per thread, so the threads never share one.
+  const unsigned int numberOfThreads =
+    this->GetMultiThreader()->GetNumberOfThreads();
+  if( stage == GradientStage )
+    {
+    this->m_ThreadEnergies.assign( numberOfThreads, 0.0 );
+    }
+  else if( stage == InversionStage )
+    {
+    this->m_ThreadNormSums.assign( numberOfThreads, 0.0 );
+    this->m_ThreadNormMaxima.assign( numberOfThreads, 0.0 );
+    }
+
+  this->GetMultiThreader()->SingleMethodExecute();
 }
 
 template<class TInputImage, class TOutputImage>
-void
+ITK_THREAD_RETURN_TYPE
 DiReCTImageFilter<TInputImage, TOutputImage>
-::InvertDeformationField( const VectorImageType *deformationField,
-  VectorImageType *inverseField )
+::ThreaderCallback( void *arg )
 {
-  typename VectorImageType::SpacingType spacing =
-    deformationField->GetSpacing();
-  VectorType spacingFactor;
+  MultiThreader::ThreadInfoStruct *info =
+    static_cast<MultiThreader::ThreadInfoStruct *>( arg );
+  DiReCTThreadStruct *str = static_cast<DiReCTThreadStruct *>( info->UserData );
+
+  switch( str->Stage )
+    {
+    case WarpStage:
+      {
+      str->Filter->ThreadedWarp( info->ThreadID, info->NumberOfThreads );
+      break;
+      }
+    case GradientStage:
+      {
+      str->Filter->ThreadedGradient( info->ThreadID, info->NumberOfThreads );
+      break;
+      }
+    case ThicknessStage:
+      {
+      str->Filter->ThreadedThickness( info->ThreadID, info->NumberOfThreads );
+      break;
+      }
+    case InversionStage:
+      {
+      str->Filter->ThreadedInversion( info->ThreadID, info->NumberOfThreads );
+      break;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TInputImage, class TOutputImage>
+unsigned int
+DiReCTImageFilter<TInputImage, TOutputImage>
+::ComputeLinearInterpolationWeights( const ImageBase<ImageDimension> *image,
+  const IndexType &index, const VectorType &displacement,
+  OffsetValueType *neighborOffsets, RealType *neighborWeights ) const
+{
+  // Same conventions as the linear interpolators used by the warp and
+  // composition filters: points beyond half a voxel outside the buffer are
+  // outside, and neighbors past the border are clamped to it.
+
+  const typename InputImageType::RegionType &region =
+    image->GetBufferedRegion();
+  const OffsetValueType *offsetTable = image->GetOffsetTable();
+
+  IndexType baseIndex;
+  RealType distance[ImageDimension];
   for( unsigned int d = 0; d < ImageDimension; d++ )
     {
-    spacingFactor[d] = 1.0 / spacing[d];
+    RealType continuousIndex = index[d] + displacement[d] /
+      image->GetSpacing()[d];
+    RealType start = static_cast<RealType>( region.GetIndex()[d] ) - 0.5;
+    RealType end = start + static_cast<RealType>( region.GetSize()[d] );
+    if( continuousIndex < start || continuousIndex >= end )
+      {
+      return 0;
+      }
+    baseIndex[d] = static_cast<IndexValueType>(
+      vcl_floor( continuousIndex ) );
+    distance[d] = continuousIndex - static_cast<RealType>( baseIndex[d] );
     }
 
-  RealType maxNorm = 1.0;
-  RealType meanNorm = 1.0;
-  unsigned int iteration = 0;
-  while( iteration++ < 20 && maxNorm > 0.1 && meanNorm > 0.001 )
+  unsigned int numberOfNeighbors = 0;
+  for( unsigned int counter = 0; counter < ( 1u << ImageDimension ); counter++ )
     {
-    meanNorm = 0.0;
-    maxNorm = 0.0;
-
-    typedef ComposeDiffeomorphismsImageFilter<VectorImageType> ComposerType;
-    typename ComposerType::Pointer composer = ComposerType::New();
-    composer->SetDeformationField( deformationField );
-    composer->SetWarpingField( inverseField );
-
-    typedef MultiplyByConstantVectorImageFilter<VectorImageType, VectorType,
-      VectorImageType> ConstantMultiplierType;
-    typename ConstantMultiplierType::Pointer constantMultiplier =
-      ConstantMultiplierType::New();
-    constantMultiplier->SetConstantVector( spacingFactor );
-    constantMultiplier->SetInput( composer->GetOutput() );
-
-    typedef VectorNormImageFilter<VectorImageType, RealImageType> NormFilterType;
-    typename NormFilterType::Pointer normFilter = NormFilterType::New();
-    normFilter->SetInput( constantMultiplier->GetOutput() );
-
-    typedef StatisticsImageFilter<RealImageType> StatisticsType;
-    typename StatisticsType::Pointer statistics = StatisticsType::New();
-    statistics->SetInput( normFilter->GetOutput() );
-    statistics->Update();
-
-    meanNorm = statistics->GetMean();
-    maxNorm = statistics->GetMaximum();
-
-    RealType epsilon = 0.5;
-    if( iteration == 1 )
+    RealType overlap = 1.0;
+    OffsetValueType offset = 0;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      IndexValueType neighborIndex = baseIndex[d];
+      if( counter & ( 1u << d ) )
+        {
+        neighborIndex++;
+        if( neighborIndex > region.GetIndex()[d] +
+          static_cast<IndexValueType>( region.GetSize()[d] ) - 1 )
+          {
+          neighborIndex = region.GetIndex()[d] +
+            static_cast<IndexValueType>( region.GetSize()[d] ) - 1;
+          }
+        overlap *= distance[d];
+        }
+      else
+        {
+        if( neighborIndex < region.GetIndex()[d] )
+          {
+          neighborIndex = region.GetIndex()[d];
+          }
+        overlap *= ( 1.0 - distance[d] );
+        }
+      offset += ( neighborIndex - region.GetIndex()[d] ) * offsetTable[d];
+      }
+    if( overlap > 0.0 )
+      {
+      neighborOffsets[numberOfNeighbors] = offset;
+      neighborWeights[numberOfNeighbors] = overlap;
+      numberOfNeighbors++;
+      }
+    }
+  return numberOfNeighbors;
+}
+
+template<class TInputImage, class TOutputImage>
+void
+DiReCTImageFilter<TInputImage, TOutputImage>
+::ThreadedWarp( ThreadIdType threadId, ThreadIdType numberOfThreads )
+{
+  const typename InputImageType::RegionType &region =
+    this->m_HitImage->GetBufferedRegion();
+  const SizeValueType numberOfPixels = region.GetNumberOfPixels();
+  const SizeValueType begin = numberOfPixels * threadId / numberOfThreads;
+  const SizeValueType end = numberOfPixels * ( threadId + 1 ) / numberOfThreads;
+  if( begin >= end )
+    {
+    return;
+    }
+
+  const InputPixelType *segmentation =
+    this->GetSegmentationImage()->GetBufferPointer();
+  const InputPixelType *mask = this->m_MaskImage->GetBufferPointer();
+  const RealType *whiteMatterProbabilities =
+    this->GetWhiteMatterProbabilityImage()->GetBufferPointer();
+  const RealType *whiteMatterContours =
+    this->m_WhiteMatterContours->GetBufferPointer();
+
+  RealType *warpedWhiteMatterProbabilities =
+    this->m_WarpedWhiteMatterProbabilityMap->GetBufferPointer();
+  RealType *hits = this->m_HitImage->GetBufferPointer();
+  RealType *totals = this->m_TotalImage->GetBufferPointer();
+  RealType *thicknesses = this->m_ThicknessImage->GetBufferPointer();
+  VectorType *inverseField = this->m_InverseField->GetBufferPointer();
+  VectorType *integratedField = this->m_IntegratedField->GetBufferPointer();
+  VectorType *velocityField = this->m_VelocityField->GetBufferPointer();
+
+  VectorType zeroVector( 0.0 );
+
+  OffsetValueType neighborOffsets[1u << ImageDimension];
+  RealType neighborWeights[1u << ImageDimension];
+
+  IndexType index = this->m_HitImage->ComputeIndex(
+    static_cast<OffsetValueType>( begin ) );
+  for( SizeValueType i = begin; i < end; i++ )
+    {
+    const unsigned int segmentationValue =
+      static_cast<unsigned int>( segmentation[i] );
+
+    // The three warps share the interpolation weights.  The contours and
+    // the thickness are only needed in the gray matter.
+
+    unsigned int numberOfNeighbors = this->ComputeLinearInterpolationWeights(
+      this->m_HitImage, index, inverseField[i], neighborOffsets,
+      neighborWeights );
+
+    RealType warpedWhiteMatterProbability = 0.0;
+    for( unsigned int n = 0; n < numberOfNeighbors; n++ )
       {
-      epsilon = 0.75;
+      warpedWhiteMatterProbability += neighborWeights[n] *
+        whiteMatterProbabilities[neighborOffsets[n]];
       }
-    RealType normFactor = 1.0;
+    warpedWhiteMatterProbabilities[i] = warpedWhiteMatterProbability;
+
+    if( this->m_IntegrationPoint > 1 &&
+      segmentationValue == this->m_GrayMatterLabel )
+      {
+      RealType warpedWhiteMatterContour = 0.0;
+      RealType warpedThickness = 0.0;
+      for( unsigned int n = 0; n < numberOfNeighbors; n++ )
+        {
+        warpedWhiteMatterContour += neighborWeights[n] *
+          whiteMatterContours[neighborOffsets[n]];
+        warpedThickness += neighborWeights[n] *
+          thicknesses[neighborOffsets[n]];
+        }
+      hits[i] += warpedWhiteMatterContour;
+      totals[i] += warpedThickness;
+      }
+
+    if( !mask[i] )
+      {
+      integratedField[i] = zeroVector;
+      inverseField[i] = zeroVector;
+      if( this->m_IntegrationPoint == 1 )
+        {
+        velocityField[i] = zeroVector;
+        }
+      }
+
+    if( this->m_IntegrationPoint == 1 &&
+      ( segmentationValue == this->m_GrayMatterLabel ||
+      segmentationValue == this->m_WhiteMatterLabel ) )
+      {
+      RealType whiteMatterContoursValue = whiteMatterContours[i];
+      hits[i] = whiteMatterContoursValue;
+
+      RealType weightedNorm = integratedField[i].GetNorm() *
+        whiteMatterContoursValue;
+      thicknesses[i] = weightedNorm;
+      totals[i] = weightedNorm;
+      }
+
     for( unsigned int d = 0; d < ImageDimension; d++ )
       {
-      normFactor /= spacing[d];
+      if( ++index[d] < region.GetIndex()[d] +
+        static_cast<IndexValueType>( region.GetSize()[d] ) )
+        {
+        break;
+        }
+      index[d] = region.GetIndex()[d];
+      }
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+DiReCTImageFilter<TInputImage, TOutputImage>
+::ThreadedGradient( ThreadIdType threadId, ThreadIdType numberOfThreads )
+{
+  const SizeValueType numberOfVoxels = this->m_GrayMatterOffsets.size();
+  const SizeValueType begin = numberOfVoxels * threadId / numberOfThreads;
+  const SizeValueType end = numberOfVoxels * ( threadId + 1 ) / numberOfThreads;
+
+  const RealType *grayMatterProbabilities =
+    this->GetGrayMatterProbabilityImage()->GetBufferPointer();
+  const RealType *warpedWhiteMatterProbabilities =
+    this->m_WarpedWhiteMatterProbabilityMap->GetBufferPointer();
+  const VectorType *gradients = this->m_GradientImage->GetBufferPointer();
+
+  VectorType zeroVector( 0.0 );
+
+  RealType energy = 0.0;
+  for( SizeValueType i = begin; i < end; i++ )
+    {
+    const SizeValueType offset = this->m_GrayMatterOffsets[i];
+
+    VectorType gradient = gradients[offset];
+    RealType norm = gradient.GetNorm();
+    if( norm > 1e-3 && !vnl_math_isnan( norm ) && !vnl_math_isinf( norm ) )
+      {
+      gradient /= norm;
       }
+    else
+      {
+      gradient = zeroVector;
+      }
+    RealType delta = ( warpedWhiteMatterProbabilities[offset] -
+      grayMatterProbabilities[offset] );
+
+    energy += vnl_math_abs( delta );
+
+    RealType speedValue = -1.0 * delta * grayMatterProbabilities[offset] *
+      this->m_GradientStep;
+    if( vnl_math_isnan( speedValue ) || vnl_math_isinf( speedValue ) )
+      {
+      speedValue = 0.0;
+      }
+    this->m_ForwardIncrements[i] += gradient * speedValue;
+    }
+  this->m_ThreadEnergies[threadId] = energy;
+}
+
+template<class TInputImage, class TOutputImage>
+void
+DiReCTImageFilter<TInputImage, TOutputImage>
+::ThreadedThickness( ThreadIdType threadId, ThreadIdType numberOfThreads )
+{
+  const SizeValueType numberOfVoxels = this->m_GrayMatterOffsets.size();
+  const SizeValueType begin = numberOfVoxels * threadId / numberOfThreads;
+  const SizeValueType end = numberOfVoxels * ( threadId + 1 ) / numberOfThreads;
+
+  const RealType *hits = this->m_HitImage->GetBufferPointer();
+  const RealType *totals = this->m_TotalImage->GetBufferPointer();
+  RealType *corticalThicknesses =
+    this->m_CorticalThicknessImage->GetBufferPointer();
+  VectorType *velocityField = this->m_VelocityField->GetBufferPointer();
+
+  for( SizeValueType i = begin; i < end; i++ )
+    {
+    const SizeValueType offset = this->m_GrayMatterOffsets[i];
+
+    velocityField[offset] += this->m_ForwardIncrements[i];
 
-    ImageRegionIterator<VectorImageType> ItE( composer->GetOutput(),
-      composer->GetOutput()->GetRequestedRegion() );
-    ImageRegionIterator<VectorImageType> ItI( inverseField,
-      inverseField->GetRequestedRegion() );
-    for( ItI.GoToBegin(), ItE.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++ItE )
+    RealType thicknessValue = 0.0;
+    if( hits[offset] > 0.001 )
       {
-      VectorType update = -ItE.Get();
+      thicknessValue = totals[offset] / hits[offset];
+      if( thicknessValue < 0.0 )
+        {
+        thicknessValue = 0.0;
+        }
+      if( thicknessValue > this->m_ThicknessPriorEstimate )
+        {
+        thicknessValue = this->m_ThicknessPriorEstimate;
+        }
+      }
+    corticalThicknesses[offset] = thicknessValue;
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+DiReCTImageFilter<TInputImage, TOutputImage>
+::ThreadedInversion( ThreadIdType threadId, ThreadIdType numberOfThreads )
+{
+  const typename InputImageType::RegionType &region =
+    this->m_ComposedField->GetBufferedRegion();
+  const SizeValueType numberOfPixels = region.GetNumberOfPixels();
+  const SizeValueType begin = numberOfPixels * threadId / numberOfThreads;
+  const SizeValueType end = numberOfPixels * ( threadId + 1 ) / numberOfThreads;
+  if( begin >= end )
+    {
+    return;
+    }
+
+  const VectorType *deformationField =
+    this->m_InversionDeformationField->GetBufferPointer();
+  VectorType *inverseField = this->m_InversionInverseField->GetBufferPointer();
+  VectorType *composedField = this->m_ComposedField->GetBufferPointer();
+
+  const typename VectorImageType::SpacingType &spacing =
+    this->m_ComposedField->GetSpacing();
+
+  VectorType zeroVector( 0.0 );
+
+  OffsetValueType neighborOffsets[1u << ImageDimension];
+  RealType neighborWeights[1u << ImageDimension];
+
+  RealType normSum = 0.0;
+  RealType normMaximum = 0.0;
+
+  IndexType index = this->m_ComposedField->ComputeIndex(
+    static_cast<OffsetValueType>( begin ) );
+  for( SizeValueType i = begin; i < end; i++ )
+    {
+    // Apply the update of the previous composition ...
+
+    if( this->m_ApplyInversionUpdate )
+      {
+      VectorType update = -composedField[i];
       RealType updateNorm = update.GetNorm();
 
-      if( updateNorm > epsilon * maxNorm / normFactor )
+      RealType maximumUpdateNorm = this->m_InversionEpsilon *
+        this->m_InversionMaximumNorm / this->m_InversionNormFactor;
+      if( updateNorm > maximumUpdateNorm )
+        {
+        update *= ( maximumUpdateNorm / updateNorm );
+        }
+      inverseField[i] += update * this->m_InversionEpsilon;
+      }
+
+    // ... and compose the updated inverse with the field.  Both only involve
+    // the inverse at this voxel so they are done in the same pass.
+
+    if( this->m_ComposeInversion )
+      {
+      VectorType composedVector = zeroVector;
+
+      unsigned int numberOfNeighbors = this->ComputeLinearInterpolationWeights(
+        this->m_ComposedField, index, inverseField[i], neighborOffsets,
+        neighborWeights );
+      if( numberOfNeighbors > 0 )
+        {
+        composedVector = inverseField[i];
+        for( unsigned int n = 0; n < numberOfNeighbors; n++ )
+          {
+          composedVector += deformationField[neighborOffsets[n]] *
+            neighborWeights[n];
+          }
+        }
+      composedField[i] = composedVector;
+
+      RealType norm = 0.0;
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        norm += vnl_math_sqr( composedVector[d] / spacing[d] );
+        }
+      norm = vcl_sqrt( norm );
+
+      normSum += norm;
+      if( norm > normMaximum )
+        {
+        normMaximum = norm;
+        }
+      }
+
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      if( ++index[d] < region.GetIndex()[d] +
+        static_cast<IndexValueType>( region.GetSize()[d] ) )
         {
-        update *= ( epsilon * maxNorm / ( updateNorm * normFactor ) );
+        break;
         }
-      ItI.Set( ItI.Get() + update * epsilon );
+      index[d] = region.GetIndex()[d];
       }
     }
+  this->m_ThreadNormSums[threadId] = normSum;
+  this->m_ThreadNormMaxima[threadId] = normMaximum;
+}
+
+template<class TInputImage, class TOutputImage>
+void
+DiReCTImageFilter<TInputImage, TOutputImage>
+::InvertDeformationField( const VectorImageType *deformationField,
+  VectorImageType *inverseField )
+{
+  // The inverse field passed in is the starting estimate, i.e. the inverse
+  // of the previous integration point or the field being re-inverted, and
+  // the composition buffer is kept from one call to the next.
+
+  if( this->m_ComposedField.IsNull() ||
+    this->m_ComposedField->GetBufferedRegion() !=
+    deformationField->GetBufferedRegion() )
+    {
+    this->m_ComposedField = VectorImageType::New();
+    this->m_ComposedField->CopyInformation( deformationField );
+    this->m_ComposedField->SetRegions( deformationField->GetBufferedRegion() );
+    this->m_ComposedField->Allocate();
+    }
+
+  this->m_InversionDeformationField = deformationField;
+  this->m_InversionInverseField = inverseField;
+
+  typename VectorImageType::SpacingType spacing =
+    deformationField->GetSpacing();
+
+  this->m_InversionNormFactor = 1.0;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    this->m_InversionNormFactor /= spacing[d];
+    }
+
+  const RealType numberOfPixels = static_cast<RealType>(
+    deformationField->GetBufferedRegion().GetNumberOfPixels() );
+
+  // The first pass only composes.  Every following pass applies the update
+  // of the last composition and, unless the iterations stop there, composes
+  // again with the updated inverse.
+
+  this->m_ApplyInversionUpdate = false;
+  this->m_ComposeInversion = true;
+  this->ExecuteThreadedStage( InversionStage );
+
+  unsigned int iteration = 1;
+  while( true )
+    {
+    RealType meanNorm = 0.0;
+    RealType maxNorm = 0.0;
+    for( unsigned int n = 0; n < this->m_ThreadNormSums.size(); n++ )
+      {
+      meanNorm += this->m_ThreadNormSums[n];
+      maxNorm = vnl_math_max( maxNorm, this->m_ThreadNormMaxima[n] );
+      }
+    meanNorm /= numberOfPixels;
+
+    this->m_InversionEpsilon = 0.5;
+    if( iteration == 1 )
+      {
+      this->m_InversionEpsilon = 0.75;
+      }
+    this->m_InversionMaximumNorm = maxNorm;
+
+    bool isNextIteration = ( iteration < 20 && maxNorm > 0.1 &&
+      meanNorm > 0.001 );
+
+    this->m_ApplyInversionUpdate = true;
+    this->m_ComposeInversion = isNextIteration;
+    this->ExecuteThreadedStage( InversionStage );
+
+    if( !isNextIteration )
+      {
+      break;
+      }
+    iteration++;
+    }
+
+  this->m_InversionDeformationField = NULL;
+  this->m_InversionInverseField = NULL;
 }
 
 template<class TInputImage, class TOutputImage>
@@ -769,37 +1046,50 @@ DiReCTImageFilter<TInputImage, TOutputImage>
 ::SmoothDeformationField( const VectorImageType *inputField,
   const RealType variance )
 {
-  typedef ImageDuplicator<VectorImageType> DuplicatorType;
-  typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
-  duplicator->SetInputImage( inputField );
-  duplicator->Update();
-  VectorImagePointer outputField = duplicator->GetOutput();
+  // The directional kernels only depend on the variance and the field size,
+  // both fixed during a run, so they are built on the first call.
+
+  if( this->m_SmoothingOperators.size() != ImageDimension )
+    {
+    this->m_SmoothingOperators.clear();
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      GaussianOperatorType gaussian;
+      gaussian.SetVariance( variance );
+      gaussian.SetMaximumError( 0.001 );
+      gaussian.SetDirection( d );
+      gaussian.SetMaximumKernelWidth(
+        inputField->GetRequestedRegion().GetSize()[d] );
+      gaussian.CreateDirectional();
+
+      this->m_SmoothingOperators.push_back( gaussian );
+      }
+    }
 
   typedef VectorNeighborhoodOperatorImageFilter<VectorImageType,
     VectorImageType> SmootherType;
-  typename SmootherType::Pointer smoother = SmootherType::New();
-
-  typedef GaussianOperator<VectorValueType, ImageDimension> GaussianType;
-  GaussianType gaussian;
-  gaussian.SetVariance( variance );
-  gaussian.SetMaximumError( 0.001 );
 
+  VectorImagePointer outputField = NULL;
   for( unsigned int d = 0; d < ImageDimension; d++ )
     {
-    gaussian.SetDirection( d );
-    gaussian.SetMaximumKernelWidth(
-      outputField->GetRequestedRegion().GetSize()[d] );
-    gaussian.CreateDirectional();
-
-    smoother->SetOperator( gaussian );
-    smoother->SetInput( outputField );
+    typename SmootherType::Pointer smoother = SmootherType::New();
+    smoother->SetOperator( this->m_SmoothingOperators[d] );
+    if( d == 0 )
+      {
+      smoother->SetInput( inputField );
+      }
+    else
+      {
+      smoother->SetInput( outputField );
+      }
 
     outputField = smoother->GetOutput();
     outputField->Update();
     outputField->DisconnectPipeline();
     }
 
-  // Ensure zero motion on the boundary
+  // Blend with the input and ensure zero motion on the boundary in a single
+  // pass over the smoothed field.
 
   RealType weight1 = 1.0;
   if( variance < 0.5 )
@@ -808,44 +1098,35 @@ DiReCTImageFilter<TInputImage, TOutputImage>
     }
   RealType weight2 = 1.0 - weight1;
 
-  typedef MultiplyByConstantImageFilter<VectorImageType, RealType,
-    VectorImageType> MultiplierType;
-
-  typename MultiplierType::Pointer multiplier1 = MultiplierType::New();
-  multiplier1->SetConstant( weight1 );
-  multiplier1->SetInput( outputField );
-
-  typename MultiplierType::Pointer multiplier2 = MultiplierType::New();
-  multiplier2->SetConstant( weight2 );
-  multiplier2->SetInput( inputField );
-
-  typedef AddImageFilter<VectorImageType, VectorImageType, VectorImageType>
-    AdderType;
-  typename AdderType::Pointer adder = AdderType::New();
-  adder->SetInput1( multiplier1->GetOutput() );
-  adder->SetInput2( multiplier2->GetOutput() );
-
-  outputField = adder->GetOutput();
-  outputField->Update();
-  outputField->DisconnectPipeline();
-
   VectorType zeroVector( 0.0 );
 
-  ImageLinearIteratorWithIndex<VectorImageType> It( outputField,
-    outputField->GetRequestedRegion() );
-  for( unsigned int d = 0; d < ImageDimension; d++ )
+  const typename VectorImageType::RegionType &region =
+    outputField->GetRequestedRegion();
+
+  ImageRegionIteratorWithIndex<VectorImageType> ItO( outputField, region );
+  ImageRegionConstIterator<VectorImageType> ItI( inputField, region );
+  for( ItO.GoToBegin(), ItI.GoToBegin(); !ItO.IsAtEnd(); ++ItO, ++ItI )
     {
-    It.SetDirection( d );
-    It.GoToBegin();
-    while( !It.IsAtEnd() )
-      {
-      It.GoToBeginOfLine();
-      It.Set( zeroVector );
-      It.GoToEndOfLine();
-      --It;
-      It.Set( zeroVector );
+    const IndexType index = ItO.GetIndex();
 
-      It.NextLine();
+    bool isOnBoundary = false;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      if( index[d] == region.GetIndex()[d] || index[d] ==
+        region.GetIndex()[d] + static_cast<IndexValueType>(
+        region.GetSize()[d] ) - 1 )
+        {
+        isOnBoundary = true;
+        break;
+        }
+      }
+    if( isOnBoundary )
+      {
+      ItO.Set( zeroVector );
+      }
+    else
+      {
+      ItO.Set( ItO.Get() * weight1 + ItI.Get() * weight2 );
       }
     }
 
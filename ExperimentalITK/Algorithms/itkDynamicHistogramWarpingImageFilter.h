@@ -22,6 +22,7 @@
 #include "itkHistogram.h"
 
 #include <deque>
+#include <vector>
 
 namespace itk
 {
@@ -42,6 +43,14 @@ namespace itk
  * pairs for constant image brightness," Proceedings:  International Conference
  * on Image Processing, vol.2, pp.366-369, 1995, doi: 10.1109/ICIP.1995.537491
  *
+ * The min/max/mean scans and the histograms are computed by threads, each
+ * with its own bins, and merged once.  The cost table of the dynamic
+ * program is evaluated on plain arrays and can be restricted to a band of
+ * cells around its diagonal.  The statistics and histogram of the
+ * reference image are cached and reused as long as the same, unmodified
+ * reference image is set with the same histogram parameters, so one filter
+ * can normalize many source images against a template.
+ *
  * \ingroup IntensityImageFilters Multithreaded
  *
  */
@@ -118,6 +127,13 @@ public:
   itkSetMacro( MaximumSourceBinCompressionSize, SizeValueType );
   itkGetConstMacro( MaximumSourceBinCompressionSize, SizeValueType );
 
+  /** Set/Get the half width of the band of the cost table that is
+   * evaluated: only the cells with | m - n | <= BandRadius, for reference
+   * bin m and source bin n, are reachable.  Zero, the default, evaluates
+   * the whole table. */
+  itkSetMacro( BandRadius, SizeValueType );
+  itkGetConstMacro( BandRadius, SizeValueType );
+
   /** Set/Get the threshold at mean intensity flag.
    * If true, only source (reference) pixels which are greater
    * than the mean source (reference) intensity is used in
@@ -186,9 +202,6 @@ protected:
     HistogramType *histogram, const THistogramMeasurement minValue,
     const THistogramMeasurement maxValue );
 
-  void ConstructCumulativeHistogram( const HistogramType *histogram,
-    HistogramType *cumulativeHistogram );
-
   void CalculateOptimalHistogramMapping( const HistogramType *referenceHistogram,
     const HistogramType *sourceHistogram );
 
@@ -196,6 +209,25 @@ private:
   DynamicHistogramWarpingImageFilter( const Self & ); //purposely not implemented
   void operator=( const Self & );               //purposely not implemented
 
+  enum ScanStageType { MinMaxMeanStage, HistogramStage };
+
+  struct ScanThreadStruct
+    {
+    DynamicHistogramWarpingImageFilter *Filter;
+    ScanStageType                       Stage;
+    const InputImageType               *Image;
+    };
+
+  static ITK_THREAD_RETURN_TYPE ScanThreaderCallback( void *arg );
+
+  /** Runs one scan of the buffer of an image over the threads. */
+  void ExecuteScan( ScanStageType stage, const InputImageType *image );
+
+  void ThreadedComputeMinMaxMean( const InputImageType *image,
+    ThreadIdType threadId, ThreadIdType numberOfThreads );
+  void ThreadedConstructHistogram( const InputImageType *image,
+    ThreadIdType threadId, ThreadIdType numberOfThreads );
+
   SizeValueType m_NumberOfHistogramLevels;
   SizeValueType m_MaximumSourceBinCompressionSize;
   SizeValueType m_MaximumReferenceBinCompressionSize;
@@ -221,8 +253,27 @@ private:
   HistogramPointer m_ReferenceHistogram;
   HistogramPointer m_OutputHistogram;
 
+  SizeValueType m_BandRadius;
+
   std::deque<RealType> m_WarpedSourceHistogramProfile;
   std::deque<RealType> m_WarpedReferenceHistogramProfile;
+
+  /** Per thread results of the scans.  The bins of a histogram scan are
+   * located by their lower bounds, as Histogram::GetIndex() does. */
+  std::vector<RealType>                m_ThreadMinimums;
+  std::vector<RealType>                m_ThreadMaximums;
+  std::vector<RealType>                m_ThreadSums;
+  std::vector<SizeValueType>           m_ThreadCounts;
+  std::vector<std::vector<RealType> >  m_ThreadFrequencies;
+  std::vector<RealType>                m_BinMinimums;
+  RealType                             m_ScanMinimum;
+  RealType                             m_ScanMaximum;
+
+  /** What the cached reference statistics and histogram were built from. */
+  const InputImageType                *m_CachedReferenceImage;
+  unsigned long                        m_CachedReferenceTime;
+  SizeValueType                        m_CachedNumberOfHistogramLevels;
+  bool                                 m_CachedThresholdAtMeanIntensity;
 };
 } // end namespace itk
 
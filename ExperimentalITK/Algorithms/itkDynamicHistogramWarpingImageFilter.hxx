@@ -22,7 +22,8 @@
 
 #include "itkImageRegionIterator.h"
 #include "itkNumericTraits.h"
-#include "itkVariableSizeMatrix.h"
+
+#include <algorithm>
 
 namespace itk
 {
@@ -47,7 +48,14 @@ DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurem
   m_ReferenceMeanValue( 0 ),
   m_OutputMinValue( 0 ),
   m_OutputMaxValue( 0 ),
-  m_OutputMeanValue( 0 )
+  m_OutputMeanValue( 0 ),
+  m_BandRadius( 0 ),
+  m_ScanMinimum( 0 ),
+  m_ScanMaximum( 0 ),
+  m_CachedReferenceImage( NULL ),
+  m_CachedReferenceTime( 0 ),
+  m_CachedNumberOfHistogramLevels( 0 ),
+  m_CachedThresholdAtMeanIntensity( false )
 {
   this->SetNumberOfRequiredInputs( 2 );
 
@@ -72,6 +80,8 @@ DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurem
   os << this->m_MaximumReferenceBinCompressionSize << std::endl;
   os << indent << "Maximum source bin compression size: ";
   os << this->m_MaximumSourceBinCompressionSize << std::endl;
+  os << indent << "Band radius: ";
+  os << this->m_BandRadius << std::endl;
   os << indent << "Source histogram: ";
   os << this->m_SourceHistogram.GetPointer() << std::endl;
   os << indent << "Reference histogram: ";
@@ -174,30 +184,50 @@ DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurem
 
   this->ComputeMinMaxMean( source, this->m_SourceMinValue,
     this->m_SourceMaxValue, this->m_SourceMeanValue );
-  this->ComputeMinMaxMean( reference, this->m_ReferenceMinValue,
-    this->m_ReferenceMaxValue, this->m_ReferenceMeanValue );
-
 
   if( this->m_ThresholdAtMeanIntensity )
     {
     this->m_SourceIntensityThreshold =
       static_cast<InputPixelType>( this->m_SourceMeanValue );
-    this->m_ReferenceIntensityThreshold =
-      static_cast<InputPixelType>( this->m_ReferenceMeanValue );
     }
   else
     {
     this->m_SourceIntensityThreshold =
       static_cast<InputPixelType>( this->m_SourceMinValue );
-    this->m_ReferenceIntensityThreshold =
-      static_cast<InputPixelType>( this->m_ReferenceMinValue );
     }
 
   this->ConstructHistogram( source, this->m_SourceHistogram,
     this->m_SourceIntensityThreshold, this->m_SourceMaxValue );
 
-  this->ConstructHistogram( reference, this->m_ReferenceHistogram,
-    this->m_ReferenceIntensityThreshold, this->m_ReferenceMaxValue );
+  // The reference statistics and histogram only depend on the reference
+  // image and the histogram parameters.
+  if( reference.GetPointer() != this->m_CachedReferenceImage ||
+    reference->GetMTime() != this->m_CachedReferenceTime ||
+    this->m_NumberOfHistogramLevels != this->m_CachedNumberOfHistogramLevels ||
+    this->m_ThresholdAtMeanIntensity != this->m_CachedThresholdAtMeanIntensity )
+    {
+    this->ComputeMinMaxMean( reference, this->m_ReferenceMinValue,
+      this->m_ReferenceMaxValue, this->m_ReferenceMeanValue );
+
+    if( this->m_ThresholdAtMeanIntensity )
+      {
+      this->m_ReferenceIntensityThreshold =
+        static_cast<InputPixelType>( this->m_ReferenceMeanValue );
+      }
+    else
+      {
+      this->m_ReferenceIntensityThreshold =
+        static_cast<InputPixelType>( this->m_ReferenceMinValue );
+      }
+
+    this->ConstructHistogram( reference, this->m_ReferenceHistogram,
+      this->m_ReferenceIntensityThreshold, this->m_ReferenceMaxValue );
+
+    this->m_CachedReferenceImage = reference.GetPointer();
+    this->m_CachedReferenceTime = reference->GetMTime();
+    this->m_CachedNumberOfHistogramLevels = this->m_NumberOfHistogramLevels;
+    this->m_CachedThresholdAtMeanIntensity = this->m_ThresholdAtMeanIntensity;
+    }
 
   this->CalculateOptimalHistogramMapping( this->m_ReferenceHistogram,
     this->m_SourceHistogram );
@@ -254,6 +284,11 @@ DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurem
       }
     }
 
+  const std::deque<RealType> & sourceProfile =
+    this->m_WarpedSourceHistogramProfile;
+  const std::deque<RealType> & referenceProfile =
+    this->m_WarpedReferenceHistogramProfile;
+
   RealType srcValue = 0.0;
   RealType mappedValue = 0.0;
 
@@ -267,42 +302,29 @@ DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurem
 
     srcValue = static_cast<RealType>( inIter.Get() );
 
-    if( srcValue <= this->m_WarpedSourceHistogramProfile[0] )
+    if( srcValue <= sourceProfile.front() )
       {
-      mappedValue = this->m_WarpedReferenceHistogramProfile[0];
+      mappedValue = referenceProfile.front();
       }
-    else if( srcValue >= this->m_WarpedSourceHistogramProfile[
-      this->m_WarpedSourceHistogramProfile.size()-1] )
+    else if( srcValue >= sourceProfile.back() )
       {
-      mappedValue = this->m_WarpedSourceHistogramProfile[
-        this->m_WarpedSourceHistogramProfile.size()-1];
+      mappedValue = referenceProfile.back();
       }
     else
       {
-      typename std::deque<RealType>::const_iterator it;
-      for( it = this->m_WarpedSourceHistogramProfile.begin() + 1; it !=
-        this->m_WarpedSourceHistogramProfile.end(); ++it )
+      // The source profile is sorted, so the segment holding the value is
+      // found by bisection.
+      const SizeValueType index = std::upper_bound( sourceProfile.begin(),
+        sourceProfile.end(), srcValue ) - sourceProfile.begin();
+
+      RealType proportion = 1.0;
+      if( sourceProfile[index - 1] != sourceProfile[index] )
         {
-        if( *it > srcValue )
-          {
-          SizeValueType index = it -
-            this->m_WarpedSourceHistogramProfile.begin();
-
-          RealType proportion = 1.0;
-          if( this->m_WarpedSourceHistogramProfile[index] !=
-            this->m_WarpedSourceHistogramProfile[index+1] )
-            {
-            proportion = ( srcValue -
-              this->m_WarpedSourceHistogramProfile[index] ) /
-              ( this->m_WarpedSourceHistogramProfile[index+1] -
-              this->m_WarpedSourceHistogramProfile[index] );
-            }
-          mappedValue = this->m_WarpedReferenceHistogramProfile[index] +
-            proportion * ( this->m_WarpedReferenceHistogramProfile[index+1] -
-            this->m_WarpedReferenceHistogramProfile[index] );
-          break;
-          }
+        proportion = ( srcValue - sourceProfile[index - 1] ) /
+          ( sourceProfile[index] - sourceProfile[index - 1] );
         }
+      mappedValue = referenceProfile[index - 1] +
+        proportion * ( referenceProfile[index] - referenceProfile[index - 1] );
       }
 
     outIter.Set( static_cast< OutputPixelType >( mappedValue ) );
@@ -319,34 +341,26 @@ DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurem
   THistogramMeasurement & minValue, THistogramMeasurement & maxValue,
   THistogramMeasurement & meanValue )
 {
-  typedef ImageRegionConstIterator< InputImageType > ConstIterator;
-  ConstIterator iter( image, image->GetBufferedRegion() );
+  this->ExecuteScan( MinMaxMeanStage, image );
 
+  RealType minimum = NumericTraits<RealType>::max();
+  RealType maximum = NumericTraits<RealType>::NonpositiveMin();
   RealType sum = 0.0;
-
   SizeValueType count = 0;
-
-  minValue = static_cast< THistogramMeasurement >( iter.Get() );
-  maxValue = minValue;
-
-  while( !iter.IsAtEnd() )
+  for( unsigned int t = 0; t < this->m_ThreadCounts.size(); t++ )
     {
-    const THistogramMeasurement value =
-      static_cast< THistogramMeasurement >( iter.Get() );
-    sum += static_cast< double >( value );
-
-    if( value < minValue )
-      {
-      minValue = value;
-      }
-    if( value > maxValue )
+    if( this->m_ThreadCounts[t] == 0 )
       {
-      maxValue = value;
+      continue;
       }
-    ++iter;
-    ++count;
+    minimum = vnl_math_min( minimum, this->m_ThreadMinimums[t] );
+    maximum = vnl_math_max( maximum, this->m_ThreadMaximums[t] );
+    sum += this->m_ThreadSums[t];
+    count += this->m_ThreadCounts[t];
     }
 
+  minValue = static_cast<THistogramMeasurement>( minimum );
+  maxValue = static_cast<THistogramMeasurement>( maximum );
   meanValue = static_cast<THistogramMeasurement>( sum
     / static_cast<RealType>( count ) );
 }
@@ -378,66 +392,152 @@ DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurem
   histogram->Initialize( size, lowerBound, upperBound );
   histogram->SetToZero();
 
-  typename HistogramType::MeasurementVectorType measurement;
-  measurement.SetSize( 1 );
-
-  typedef typename HistogramType::MeasurementType MeasurementType;
-  measurement[0] = NumericTraits< MeasurementType >::Zero;
+  this->m_BinMinimums.resize( this->m_NumberOfHistogramLevels );
+  for( SizeValueType i = 0; i < this->m_NumberOfHistogramLevels; i++ )
+    {
+    this->m_BinMinimums[i] = histogram->GetBinMin( 0, i );
+    }
+  this->m_ScanMinimum = static_cast<RealType>( minValue );
+  this->m_ScanMaximum = static_cast<RealType>( maxValue );
 
-  // put each image pixel into the histogram
-  ImageRegionConstIterator<InputImageType>
-    iter( image, image->GetBufferedRegion() );
+  // Each thread fills its own bins, which are summed afterwards.
+  this->ExecuteScan( HistogramStage, image );
 
-  iter.GoToBegin();
-  while( !iter.IsAtEnd() )
+  for( SizeValueType i = 0; i < this->m_NumberOfHistogramLevels; i++ )
     {
-    InputPixelType value = iter.Get();
-
-    if( static_cast<RealType>( value ) >= minValue &&
-      static_cast<RealType>( value ) <= maxValue )
+    RealType frequency = 0.0;
+    for( unsigned int t = 0; t < this->m_ThreadFrequencies.size(); t++ )
       {
-      // add sample to histogram
-      measurement[0] = value;
-      histogram->IncreaseFrequencyOfMeasurement( measurement, 1 );
+      frequency += this->m_ThreadFrequencies[t][i];
       }
-    ++iter;
+    histogram->SetFrequency( i, frequency );
     }
+  this->m_ThreadFrequencies.clear();
 }
 
-/**
- * Construct cumulative histogram.
- */
 template<class TInputImage, class TOutputImage, class THistogramMeasurement>
 void
 DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurement>
-::ConstructCumulativeHistogram( const HistogramType *histogram,
-  HistogramType *cumulativeHistogram )
+::ExecuteScan( ScanStageType stage, const InputImageType *image )
 {
-  typename HistogramType::SizeType size = histogram->GetSize();
+  ScanThreadStruct str;
+  str.Filter = this;
+  str.Stage = stage;
+  str.Image = image;
+
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->GetMultiThreader()->SetSingleMethod( this->ScanThreaderCallback, &str );
+
+  // One slot per thread, so the threads never share an accumulator.
+  const unsigned int numberOfThreads =
+    this->GetMultiThreader()->GetNumberOfThreads();
+  if( stage == MinMaxMeanStage )
+    {
+    this->m_ThreadMinimums.assign( numberOfThreads, 0.0 );
+    this->m_ThreadMaximums.assign( numberOfThreads, 0.0 );
+    this->m_ThreadSums.assign( numberOfThreads, 0.0 );
+    this->m_ThreadCounts.assign( numberOfThreads, 0 );
+    }
+  else
+    {
+    this->m_ThreadFrequencies.assign( numberOfThreads,
+      std::vector<RealType>( this->m_NumberOfHistogramLevels, 0.0 ) );
+    }
 
-  typename HistogramType::MeasurementVectorType lowerBound;
-  typename HistogramType::MeasurementVectorType upperBound;
+  this->GetMultiThreader()->SingleMethodExecute();
+}
 
-  lowerBound.SetSize( 1 );
-  upperBound.SetSize( 1 );
+template<class TInputImage, class TOutputImage, class THistogramMeasurement>
+ITK_THREAD_RETURN_TYPE
+DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurement>
+::ScanThreaderCallback( void *arg )
+{
+  MultiThreader::ThreadInfoStruct *info =
+    static_cast<MultiThreader::ThreadInfoStruct *>( arg );
+  ScanThreadStruct *str = static_cast<ScanThreadStruct *>( info->UserData );
+
+  if( str->Stage == MinMaxMeanStage )
+    {
+    str->Filter->ThreadedComputeMinMaxMean( str->Image, info->ThreadID,
+      info->NumberOfThreads );
+    }
+  else
+    {
+    str->Filter->ThreadedConstructHistogram( str->Image, info->ThreadID,
+      info->NumberOfThreads );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TInputImage, class TOutputImage, class THistogramMeasurement>
+void
+DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurement>
+::ThreadedComputeMinMaxMean( const InputImageType *image,
+  ThreadIdType threadId, ThreadIdType numberOfThreads )
+{
+  const InputPixelType *buffer = image->GetBufferPointer();
+  const SizeValueType numberOfPixels =
+    image->GetBufferedRegion().GetNumberOfPixels();
+  const SizeValueType begin = numberOfPixels * threadId / numberOfThreads;
+  const SizeValueType end = numberOfPixels * ( threadId + 1 ) / numberOfThreads;
+  if( begin == end )
+    {
+    return;
+    }
 
-  lowerBound.Fill( histogram->GetBinMin( 0, 0 ) );
-  upperBound.Fill( histogram->GetBinMax( 0, size[0]-1 ) );
+  RealType minimum = static_cast<RealType>(
+    static_cast<THistogramMeasurement>( buffer[begin] ) );
+  RealType maximum = minimum;
+  RealType sum = 0.0;
+  for( SizeValueType n = begin; n < end; n++ )
+    {
+    const RealType value = static_cast<RealType>(
+      static_cast<THistogramMeasurement>( buffer[n] ) );
+    sum += value;
+    if( value < minimum )
+      {
+      minimum = value;
+      }
+    if( value > maximum )
+      {
+      maximum = value;
+      }
+    }
 
-  cumulativeHistogram->SetMeasurementVectorSize( 1 );
-  cumulativeHistogram->Initialize( size, lowerBound, upperBound );
-  cumulativeHistogram->SetToZero();
+  this->m_ThreadMinimums[threadId] = minimum;
+  this->m_ThreadMaximums[threadId] = maximum;
+  this->m_ThreadSums[threadId] = sum;
+  this->m_ThreadCounts[threadId] = end - begin;
+}
+
+template<class TInputImage, class TOutputImage, class THistogramMeasurement>
+void
+DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurement>
+::ThreadedConstructHistogram( const InputImageType *image,
+  ThreadIdType threadId, ThreadIdType numberOfThreads )
+{
+  const InputPixelType *buffer = image->GetBufferPointer();
+  const SizeValueType numberOfPixels =
+    image->GetBufferedRegion().GetNumberOfPixels();
+  const SizeValueType begin = numberOfPixels * threadId / numberOfThreads;
+  const SizeValueType end = numberOfPixels * ( threadId + 1 ) / numberOfThreads;
 
-  typename HistogramType::ConstIterator It = histogram->Begin();
-  typename HistogramType::Iterator ItC = cumulativeHistogram->Begin();
+  std::vector<RealType> & frequencies = this->m_ThreadFrequencies[threadId];
+  const std::vector<RealType> & binMinimums = this->m_BinMinimums;
 
-  typename HistogramType::AbsoluteFrequencyType sum = 0.0;
-  while( It != histogram->End() )
+  for( SizeValueType n = begin; n < end; n++ )
     {
-    sum += It.GetFrequency();
-    ItC.SetFrequency( sum );
-    ++ItC;
-    ++It;
+    const RealType value = static_cast<RealType>( buffer[n] );
+    if( value >= this->m_ScanMinimum && value <= this->m_ScanMaximum )
+      {
+      const RealType measurement = static_cast<RealType>(
+        static_cast<THistogramMeasurement>( buffer[n] ) );
+      SizeValueType bin = std::upper_bound( binMinimums.begin(),
+        binMinimums.end(), measurement ) - binMinimums.begin();
+      bin = ( bin > 0 ) ? bin - 1 : 0;
+      frequencies[bin] += 1.0;
+      }
     }
 }
 
@@ -450,94 +550,124 @@ DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurem
 ::CalculateOptimalHistogramMapping( const HistogramType *referenceHistogram,
   const HistogramType *sourceHistogram )
 {
-  // Create cumulative histograms
+  this->m_WarpedReferenceHistogramProfile.clear();
+  this->m_WarpedSourceHistogramProfile.clear();
+
+  // Frequencies and cumulative frequencies as plain arrays.
+  const SizeValueType rows = referenceHistogram->GetSize( 0 );
+  const SizeValueType cols = sourceHistogram->GetSize( 0 );
+
+  std::vector<RealType> referenceFrequencies( rows );
+  std::vector<RealType> referenceCumulative( rows );
+  RealType sum = 0.0;
+  for( SizeValueType m = 0; m < rows; m++ )
+    {
+    referenceFrequencies[m] = referenceHistogram->GetFrequency( m );
+    sum += referenceFrequencies[m];
+    referenceCumulative[m] = sum;
+    }
+  std::vector<RealType> sourceFrequencies( cols );
+  std::vector<RealType> sourceCumulative( cols );
+  sum = 0.0;
+  for( SizeValueType n = 0; n < cols; n++ )
+    {
+    sourceFrequencies[n] = sourceHistogram->GetFrequency( n );
+    sum += sourceFrequencies[n];
+    sourceCumulative[n] = sum;
+    }
+
+  /**
+   * With a band radius r, only the cells of the band | m - n | <= r are
+   * stored, row by row; without one the whole table is.  Cells outside the
+   * table or the band cost the maximum.
+   */
+  struct CostTableType
+    {
+    std::vector<RealType> Cells;
+    SizeValueType         Columns;
+    SizeValueType         Radius;
+    bool                  Banded;
+    RealType              MaximumCost;
 
-  typename HistogramType::Pointer referenceCumulativeHistogram =
-    HistogramType::New();
-  this->ConstructCumulativeHistogram( referenceHistogram,
-    referenceCumulativeHistogram );
+    SizeValueType GetOffset( SizeValueType m, SizeValueType n ) const
+      {
+      return ( this->Banded )
+        ? m * ( 2 * this->Radius + 1 ) + n + this->Radius - m
+        : m * this->Columns + n;
+      }
+    RealType & operator()( SizeValueType m, SizeValueType n )
+      {
+      return this->Cells[this->GetOffset( m, n )];
+      }
+    RealType Get( SizeValueType m, SizeValueType n ) const
+      {
+      if( n >= this->Columns || ( this->Banded &&
+        ( n + this->Radius < m || m + this->Radius < n ) ) )
+        {
+        return this->MaximumCost;
+        }
+      return this->Cells[this->GetOffset( m, n )];
+      }
+    };
 
-  typename HistogramType::Pointer sourceCumulativeHistogram =
-    HistogramType::New();
-  this->ConstructCumulativeHistogram( sourceHistogram,
-    sourceCumulativeHistogram );
+  const RealType maximumCost = NumericTraits<RealType>::max();
+  const bool banded = ( this->m_BandRadius > 0 );
+  const SizeValueType radius = ( banded ) ?
+    this->m_BandRadius : vnl_math_max( rows, cols );
 
-  VariableSizeMatrix<RealType> D;
-  D.SetSize( referenceCumulativeHistogram->GetSize( 0 ),
-    sourceCumulativeHistogram->GetSize( 0 ) );
+  CostTableType D;
+  D.Columns = cols;
+  D.Radius = radius;
+  D.Banded = banded;
+  D.MaximumCost = maximumCost;
+  D.Cells.assign( ( banded ) ? rows * ( 2 * radius + 1 ) : rows * cols,
+    maximumCost );
 
   // Formulate the cost table
-  for( unsigned int m = 0; m < D.Rows(); m++ )
+  for( SizeValueType m = 0; m < rows; m++ )
     {
-    for( unsigned int n = 0; n < D.Cols(); n++ )
+    const SizeValueType nBegin = ( m > radius ) ? m - radius : 0;
+    const SizeValueType nEnd = vnl_math_min( cols, m + radius + 1 );
+    for( SizeValueType n = nBegin; n < nEnd; n++ )
       {
+      RealType & cost = D( m, n );
       if( m == 0 && n == 0 )
         {
-        D(m, n) = 0.0;
+        cost = 0.0;
         }
       else if( m == 0 || n == 0 )
         {
-        D(m, n) = NumericTraits<RealType>::max();
+        cost = maximumCost;
         }
       else
         {
-        typename HistogramType::IndexType referenceIndex;
-        referenceIndex.SetSize( 1 );
-        referenceIndex[0] = m;
-        typename HistogramType::IndexType sourceIndex;
-        sourceIndex.SetSize( 1 );
-        sourceIndex[0] = n;
-
-        RealType case1 = D(m - 1, n - 1) +
-          vnl_math_abs( referenceHistogram->GetFrequency( referenceIndex ) -
-          sourceHistogram->GetFrequency( sourceIndex ) );
-        RealType case2 = NumericTraits<RealType>::max();
-        for( unsigned int k = 2;
-          k <= this->m_MaximumReferenceBinCompressionSize; k++ )
+        RealType case1 = D.Get( m - 1, n - 1 ) +
+          vnl_math_abs( referenceFrequencies[m] - sourceFrequencies[n] );
+        RealType case2 = maximumCost;
+        for( SizeValueType k = 2;
+          k <= this->m_MaximumReferenceBinCompressionSize && k <= m; k++ )
           {
-          typename HistogramType::IndexType kIndex;
-          kIndex.SetSize( 1 );
-          kIndex[0] = referenceIndex[0] - k;
-          if( kIndex[0] < 0 )
-            {
-            break;
-            }
-          case2 = vnl_math_min( case2, D(m - k, n - 1) +
-            vnl_math_abs(
-              ( referenceCumulativeHistogram->GetFrequency( referenceIndex ) -
-              referenceCumulativeHistogram->GetFrequency( kIndex ) ) -
-              sourceHistogram->GetFrequency( sourceIndex )
-              )
-            );
+          case2 = vnl_math_min( case2, D.Get( m - k, n - 1 ) +
+            vnl_math_abs( ( referenceCumulative[m] -
+            referenceCumulative[m - k] ) - sourceFrequencies[n] ) );
           }
-        RealType case3 = NumericTraits<RealType>::max();
-        for( unsigned int l = 2;
-          l <= this->m_MaximumSourceBinCompressionSize; l++ )
+        RealType case3 = maximumCost;
+        for( SizeValueType l = 2;
+          l <= this->m_MaximumSourceBinCompressionSize && l <= n; l++ )
           {
-          typename HistogramType::IndexType lIndex;
-          lIndex.SetSize( 1 );
-          lIndex[0] = sourceIndex[0] - l;
-          if( lIndex[0] < 0 )
-            {
-            break;
-            }
-          case3 = vnl_math_min( case3, D(m - 1, n - l) +
-            vnl_math_abs(
-              referenceHistogram->GetFrequency( referenceIndex ) -
-              ( sourceCumulativeHistogram->GetFrequency( sourceIndex ) -
-              sourceCumulativeHistogram->GetFrequency( lIndex ) )
-              )
-            );
+          case3 = vnl_math_min( case3, D.Get( m - 1, n - l ) +
+            vnl_math_abs( referenceFrequencies[m] -
+            ( sourceCumulative[n] - sourceCumulative[n - l] ) ) );
           }
-        D(m, n) = vnl_math_min( case1, vnl_math_min( case2, case3 ) );
+        cost = vnl_math_min( case1, vnl_math_min( case2, case3 ) );
         }
       }
     }
 
   // Find the optimal histogram mapping by tracing back through the
   // cost table.
-  unsigned int m = D.Rows() - 1;
-  unsigned int n = D.Cols() - 1;
+  SizeValueType m = rows - 1;
+  SizeValueType n = cols - 1;
   while( m > 0 && n > 0 )
     {
     RealType referenceBinCenter = 0.5 * ( referenceHistogram->GetBinMin( 0, m ) +
@@ -548,14 +678,14 @@ DynamicHistogramWarpingImageFilter<TInputImage, TOutputImage, THistogramMeasurem
       sourceHistogram->GetBinMax( 0, n ) );
     this->m_WarpedSourceHistogramProfile.push_front( sourceBinCenter );
 
-    unsigned int minM = m;
-    unsigned int minN = n - 1;
-    if( D(m - 1, n - 1) < D(minM, minN) )
+    SizeValueType minM = m;
+    SizeValueType minN = n - 1;
+    if( D.Get( m - 1, n - 1 ) < D.Get( minM, minN ) )
       {
       minM = m - 1;
       minN = n - 1;
       }
-    else if( D(m - 1, n) < D(minM, minN) )
+    else if( D.Get( m - 1, n ) < D.Get( minM, minN ) )
       {
       minM = m - 1;
       minN = n;
@@ -20,6 +20,10 @@
 #include "itkPointSetToPointSetMetric.h"
 
 #include "itkIdentityTransform.h"
+#include "itkJensenHavrdaCharvatTsallisPointSetMetric.h"
+#include "itkTimeStamp.h"
+
+#include <vector>
 
 namespace itk {
 
@@ -29,6 +33,12 @@ namespace itk {
  * This class is templated over the fixed point-set type, moving
  * point-set type.
  *
+ * Initialize() splits both point sets by label and sets up one
+ * JensenHavrdaCharvatTsallisPointSetMetric per label.  The per-label fixed
+ * point sets and metrics are kept between calls to Initialize(), so when
+ * only the moving point set changes (e.g. during a registration) the fixed
+ * densities are not rebuilt.
+ *
  */
 template<class TPointSet>
 class ITK_EXPORT JensenHavrdaCharvatTsallisLabeledPointSetMetric :
@@ -72,6 +82,9 @@ public:
 
   typedef std::vector<PixelType>                        LabelSetType;
 
+  typedef JensenHavrdaCharvatTsallisPointSetMetric<PointSetType>
+                                                        LabelMetricType;
+
   /**
    * Public function definitions
    */
@@ -209,6 +222,21 @@ private:
   JensenHavrdaCharvatTsallisLabeledPointSetMetric(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
 
+  /**
+   * The points of one label and the metric between them
+   */
+  struct LabelTermType
+    {
+    PixelType                              Label;
+    typename PointSetType::Pointer         FixedPoints;
+    std::vector<long>                      FixedIndices;
+    std::vector<long>                      MovingIndices;
+    typename LabelMetricType::Pointer      Metric;
+    };
+
+  void ScatterLabelDerivative( const LabelTermType &, DerivativeType &,
+    DerivativeType & ) const;
+
   bool                                     m_UseRegularizationTerm;
   bool                                     m_UseInputAsSamples;
   bool                                     m_UseAnisotropicCovariances;
@@ -233,6 +261,10 @@ private:
   LabelSetType                             m_FixedLabelSet;
   LabelSetType                             m_MovingLabelSet;
 
+  std::vector<LabelTermType>               m_LabelTerms;
+  const PointSetType                      *m_LabelTermsFixedPointSet;
+  TimeStamp                                m_LabelTermsTime;
+
 };
 
 
@@ -50,6 +50,8 @@ JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
   transform->SetIdentity();
 
   Superclass::SetTransform( transform );
+
+  this->m_LabelTermsFixedPointSet = NULL;
 }
 
 /** Initialize the metric */
@@ -90,67 +92,48 @@ JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
       ++It;
       }
     }
-}
 
-/** Return the number of values, i.e the number of points in the moving set */
-template <class TPointSet>
-unsigned int
-JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
-::GetNumberOfValues() const
-{
-  if ( this->m_UseWithRespectToTheMovingPointSet )
+  /**
+   * The labels common to both point sets
+   */
+  LabelSetType labels;
+  typename LabelSetType::const_iterator iter;
+  for ( iter = this->m_FixedLabelSet.begin();
+        iter != this->m_FixedLabelSet.end(); ++iter )
     {
-    if ( this->m_MovingPointSet )
+    if ( find( this->m_MovingLabelSet.begin(), this->m_MovingLabelSet.end(),
+           *iter ) != this->m_MovingLabelSet.end() )
       {
-      return  this->m_MovingPointSet->GetPoints()->Size();
+      labels.push_back( *iter );
       }
     }
-  else
+
+  /**
+   * Split the fixed point set by label.  The per-label fixed point sets and
+   * metrics are kept between calls so that the fixed densities are only
+   * rebuilt when the fixed point set or the fixed parameters change.
+   */
+  bool splitFixedPointSet = ( this->m_LabelTerms.size() != labels.size()
+    || this->m_LabelTermsFixedPointSet != this->m_FixedPointSet.GetPointer()
+    || this->m_FixedPointSet->GetMTime() > this->m_LabelTermsTime.GetMTime() );
+  for ( unsigned int n = 0; !splitFixedPointSet && n < labels.size(); n++ )
     {
-    if ( this->m_FixedPointSet )
-      {
-      return  this->m_FixedPointSet->GetPoints()->Size();
-      }
+    splitFixedPointSet = ( this->m_LabelTerms[n].Label != labels[n] );
     }
 
-  return 0;
-}
-
-
-/** Get the match Measure */
-template <class TPointSet>
-typename JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>::MeasureType
-JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
-::GetValue( const TransformParametersType & parameters ) const
-{
-  MeasureType measure;
-  measure.SetSize( 1 );
-  measure.Fill( 0 );
-
-  typename LabelSetType::const_iterator iter;
-
-  for ( iter = this->m_FixedLabelSet.begin();
-        iter != this->m_FixedLabelSet.end(); ++iter )
+  if ( splitFixedPointSet )
     {
-    PixelType currentLabel = *iter;
-
-    /**
-     * check to see if the moving label set contains the same label
-     */
-    if ( find( this->m_MovingLabelSet.begin(), this->m_MovingLabelSet.end(),
-           currentLabel ) == this->m_MovingLabelSet.end() )
+    this->m_LabelTerms.clear();
+    this->m_LabelTerms.resize( labels.size() );
+    for ( unsigned int n = 0; n < labels.size(); n++ )
       {
-      continue;
+      LabelTermType & term = this->m_LabelTerms[n];
+      term.Label = labels[n];
+      term.FixedPoints = PointSetType::New();
+      term.FixedPoints->Initialize();
+      term.Metric = LabelMetricType::New();
       }
 
-    /**
-     * Collect all the fixed and moving points with the currentLabel
-     */
-    typename PointSetType::Pointer fixedLabelPoints
-      = PointSetType::New();
-    fixedLabelPoints->Initialize();
-    unsigned long fixedCount = 0;
-
     typename PointSetType::PointsContainerConstIterator ItF =
       this->m_FixedPointSet->GetPoints()->Begin();
     typename PointSetType::PointDataContainerIterator ItFD =
@@ -158,67 +141,129 @@ JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
 
     while ( ItF != this->m_FixedPointSet->GetPoints()->End() )
       {
-      if ( ItFD.Value() == currentLabel )
+      for ( unsigned int n = 0; n < labels.size(); n++ )
         {
-        fixedLabelPoints->SetPoint( fixedCount++, ItF.Value() );
+        if ( ItFD.Value() == labels[n] )
+          {
+          LabelTermType & term = this->m_LabelTerms[n];
+          term.FixedPoints->SetPoint( term.FixedIndices.size(), ItF.Value() );
+          term.FixedIndices.push_back( ItF.Index() );
+          break;
+          }
         }
       ++ItF;
       ++ItFD;
       }
+    this->m_LabelTermsFixedPointSet = this->m_FixedPointSet.GetPointer();
+    this->m_LabelTermsTime.Modified();
+    }
 
-    typename PointSetType::Pointer movingLabelPoints
-      = PointSetType::New();
-    movingLabelPoints->Initialize();
-    unsigned long movingCount = 0;
+  /**
+   * The moving point set changes between calls so it is always split.
+   */
+  std::vector<typename PointSetType::Pointer> movingLabelPoints( labels.size() );
+  for ( unsigned int n = 0; n < labels.size(); n++ )
+    {
+    movingLabelPoints[n] = PointSetType::New();
+    movingLabelPoints[n]->Initialize();
+    this->m_LabelTerms[n].MovingIndices.clear();
+    }
 
-    typename PointSetType::PointsContainerConstIterator ItM =
-      this->m_MovingPointSet->GetPoints()->Begin();
-    typename PointSetType::PointDataContainerIterator ItMD =
-      this->m_MovingPointSet->GetPointData()->Begin();
+  typename PointSetType::PointsContainerConstIterator ItM =
+    this->m_MovingPointSet->GetPoints()->Begin();
+  typename PointSetType::PointDataContainerIterator ItMD =
+    this->m_MovingPointSet->GetPointData()->Begin();
 
-    while ( ItM != this->m_MovingPointSet->GetPoints()->End() )
+  while ( ItM != this->m_MovingPointSet->GetPoints()->End() )
+    {
+    for ( unsigned int n = 0; n < labels.size(); n++ )
       {
-      if ( ItMD.Value() == currentLabel )
+      if ( ItMD.Value() == labels[n] )
         {
-        movingLabelPoints->SetPoint( movingCount++, ItM.Value() );
+        LabelTermType & term = this->m_LabelTerms[n];
+        movingLabelPoints[n]->SetPoint( term.MovingIndices.size(), ItM.Value() );
+        term.MovingIndices.push_back( ItM.Index() );
+        break;
         }
-      ++ItM;
-      ++ItMD;
       }
+    ++ItM;
+    ++ItMD;
+    }
 
-    /**
-     * Invoke the single label JensenTsallis measure
-     */
-    typedef JensenHavrdaCharvatTsallisPointSetMetric
-      <PointSetType> MetricType;
-    typename MetricType::Pointer metric = MetricType::New();
+  /**
+   * Set up the single label JensenTsallis measures
+   */
+  for ( unsigned int n = 0; n < labels.size(); n++ )
+    {
+    typename LabelMetricType::Pointer metric = this->m_LabelTerms[n].Metric;
 
-    metric->SetFixedPointSet( fixedLabelPoints );
+    metric->SetFixedPointSet( this->m_LabelTerms[n].FixedPoints );
     metric->SetNumberOfFixedSamples( this->m_NumberOfFixedSamples );
     metric->SetFixedPointSetSigma( this->m_FixedPointSetSigma );
     metric->SetFixedKernelSigma( this->m_FixedKernelSigma );
-    metric->SetFixedCovarianceKNeighborhood( 
+    metric->SetFixedCovarianceKNeighborhood(
       this->m_FixedCovarianceKNeighborhood );
-    metric->SetFixedEvaluationKNeighborhood( 
+    metric->SetFixedEvaluationKNeighborhood(
       this->m_FixedEvaluationKNeighborhood );
 
-    metric->SetMovingPointSet( movingLabelPoints );
+    metric->SetMovingPointSet( movingLabelPoints[n] );
     metric->SetNumberOfMovingSamples( this->m_NumberOfMovingSamples );
     metric->SetMovingPointSetSigma( this->m_MovingPointSetSigma );
     metric->SetMovingKernelSigma( this->m_MovingKernelSigma );
-    metric->SetMovingCovarianceKNeighborhood( 
+    metric->SetMovingCovarianceKNeighborhood(
       this->m_MovingCovarianceKNeighborhood );
-    metric->SetMovingEvaluationKNeighborhood( 
+    metric->SetMovingEvaluationKNeighborhood(
       this->m_MovingEvaluationKNeighborhood );
 
     metric->SetUseRegularizationTerm( this->m_UseRegularizationTerm );
     metric->SetUseInputAsSamples( this->m_UseInputAsSamples );
     metric->SetUseAnisotropicCovariances( this->m_UseAnisotropicCovariances );
-    metric->SetUseWithRespectToTheMovingPointSet(
-      this->m_UseWithRespectToTheMovingPointSet );
     metric->SetAlpha( this->m_Alpha );
 
     metric->Initialize();
+    }
+}
+
+/** Return the number of values, i.e the number of points in the moving set */
+template <class TPointSet>
+unsigned int
+JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
+::GetNumberOfValues() const
+{
+  if ( this->m_UseWithRespectToTheMovingPointSet )
+    {
+    if ( this->m_MovingPointSet )
+      {
+      return  this->m_MovingPointSet->GetPoints()->Size();
+      }
+    }
+  else
+    {
+    if ( this->m_FixedPointSet )
+      {
+      return  this->m_FixedPointSet->GetPoints()->Size();
+      }
+    }
+
+  return 0;
+}
+
+
+/** Get the match Measure */
+template <class TPointSet>
+typename JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>::MeasureType
+JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
+::GetValue( const TransformParametersType & parameters ) const
+{
+  MeasureType measure;
+  measure.SetSize( 1 );
+  measure.Fill( 0 );
+
+  for ( unsigned int n = 0; n < this->m_LabelTerms.size(); n++ )
+    {
+    typename LabelMetricType::Pointer metric = this->m_LabelTerms[n].Metric;
+    metric->SetUseWithRespectToTheMovingPointSet(
+      this->m_UseWithRespectToTheMovingPointSet );
 
     MeasureType value = metric->GetValue( parameters );
     measure[0] += value[0];
@@ -242,148 +287,17 @@ JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
   derivative.SetSize( numberOfDerivatives, PointDimension );
   derivative.Fill( 0 );
 
-  typename LabelSetType::const_iterator iter;
-
-  for ( iter = this->m_FixedLabelSet.begin();
-        iter != this->m_FixedLabelSet.end(); ++iter )
+  for ( unsigned int n = 0; n < this->m_LabelTerms.size(); n++ )
     {
-    PixelType currentLabel = *iter;
-  
-    /**
-     * check to see if the moving label set contains the same label
-     */
-    if ( find( this->m_MovingLabelSet.begin(), this->m_MovingLabelSet.end(),
-           currentLabel ) == this->m_MovingLabelSet.end() )
-      {
-      continue;
-      }
-
-    /**
-     * Collect all the fixed and moving points with the currentLabel
-     */
-    typename PointSetType::Pointer fixedLabelPoints
-      = PointSetType::New();
-    fixedLabelPoints->Initialize();
-    unsigned long fixedCount = 0;
-
-    std::vector<long> fixedIndices;
-    fixedIndices.clear();
-
-    typename PointSetType::PointsContainerConstIterator ItF =
-      this->m_FixedPointSet->GetPoints()->Begin();
-    typename PointSetType::PointDataContainerIterator ItFD =
-      this->m_FixedPointSet->GetPointData()->Begin();
-
-    while ( ItF != this->m_FixedPointSet->GetPoints()->End() )
-      {
-      if ( ItFD.Value() == currentLabel )
-        {
-        fixedLabelPoints->SetPoint( fixedCount++, ItF.Value() );
-        fixedIndices.push_back( ItF.Index() );
-        }
-      ++ItF;
-      ++ItFD;
-      }
-
-    typename PointSetType::Pointer movingLabelPoints
-      = PointSetType::New();
-    movingLabelPoints->Initialize();
-    unsigned long movingCount = 0;
-
-    std::vector<long> movingIndices;
-    movingIndices.clear();
-
-    typename PointSetType::PointsContainerConstIterator ItM =
-      this->m_MovingPointSet->GetPoints()->Begin();
-    typename PointSetType::PointDataContainerIterator ItMD =
-      this->m_MovingPointSet->GetPointData()->Begin();
-
-    while ( ItM != this->m_MovingPointSet->GetPoints()->End() )
-      {
-      if ( ItMD.Value() == currentLabel )
-        {
-        movingLabelPoints->SetPoint( movingCount++, ItM.Value() );
-        movingIndices.push_back( ItM.Index() );
-        }
-      ++ItM;
-      ++ItMD;
-      }
-
-    /**
-     * Invoke the single label JensenTsallis measure
-     */
-    typedef JensenHavrdaCharvatTsallisPointSetMetric<PointSetType> MetricType;
-    typename MetricType::Pointer metric = MetricType::New();
-
-    metric->SetFixedPointSet( fixedLabelPoints );
-    metric->SetNumberOfFixedSamples( this->m_NumberOfFixedSamples );
-    metric->SetFixedPointSetSigma( this->m_FixedPointSetSigma );
-    metric->SetFixedKernelSigma( this->m_FixedKernelSigma );
-    metric->SetFixedCovarianceKNeighborhood( 
-      this->m_FixedCovarianceKNeighborhood );
-    metric->SetFixedEvaluationKNeighborhood( 
-      this->m_FixedEvaluationKNeighborhood );
-
-    metric->SetMovingPointSet( movingLabelPoints );
-    metric->SetNumberOfMovingSamples( this->m_NumberOfMovingSamples );
-    metric->SetMovingPointSetSigma( this->m_MovingPointSetSigma );
-    metric->SetMovingKernelSigma( this->m_MovingKernelSigma );
-    metric->SetMovingCovarianceKNeighborhood( 
-      this->m_MovingCovarianceKNeighborhood );
-    metric->SetMovingEvaluationKNeighborhood( 
-      this->m_MovingEvaluationKNeighborhood );
-
-    metric->SetUseRegularizationTerm( this->m_UseRegularizationTerm );
-    metric->SetUseInputAsSamples( this->m_UseInputAsSamples );
-    metric->SetUseAnisotropicCovariances( this->m_UseAnisotropicCovariances );
+    typename LabelMetricType::Pointer metric = this->m_LabelTerms[n].Metric;
     metric->SetUseWithRespectToTheMovingPointSet(
       this->m_UseWithRespectToTheMovingPointSet );
-    metric->SetAlpha( this->m_Alpha );
-
-    metric->Initialize();
 
     DerivativeType labelDerivative;
     metric->GetDerivative( parameters, labelDerivative );
 
-    RealType avgNorm = 0.0;
-    for ( unsigned int i = 0; i < metric->GetNumberOfValues(); i++ )
-      {
-      RealType norm = 0.0; 
-      for ( unsigned int j = 0; j < PointDimension; j++ )
-        {
-        norm += ( labelDerivative(i, j) * labelDerivative(i, j) ); 
-        } 
-      avgNorm += vcl_sqrt( norm );  
-      }
-    avgNorm /= static_cast<RealType>( metric->GetNumberOfValues() );   
-    labelDerivative /= avgNorm;
-
-    if ( this->m_UseWithRespectToTheMovingPointSet )
-      {
-      std::vector<long>::const_iterator it;
-      unsigned long index = 0;
-      for ( it = movingIndices.begin(); it != movingIndices.end(); ++it )
-        {
-        for ( unsigned int d = 0; d < PointDimension; d++ )
-          {
-          derivative( *it, d ) = labelDerivative( index, d );
-          }
-        index++;
-        }
-      }
-    else
-      {
-      std::vector<long>::const_iterator it;
-      unsigned long index = 0;
-      for ( it = fixedIndices.begin(); it != fixedIndices.end(); ++it )
-        {
-        for ( unsigned int d = 0; d < PointDimension; d++ )
-          {
-          derivative( *it, d ) = labelDerivative( index, d );
-          }
-        index++;
-        }
-      }
+    this->ScatterLabelDerivative( this->m_LabelTerms[n], labelDerivative,
+      derivative );
     }
 }
 
@@ -405,152 +319,62 @@ JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
   value.SetSize( 1 );
   value.Fill( 0 );
 
-  typename LabelSetType::const_iterator iter;
-
-  for ( iter = this->m_FixedLabelSet.begin();
-        iter != this->m_FixedLabelSet.end(); ++iter )
+  for ( unsigned int n = 0; n < this->m_LabelTerms.size(); n++ )
     {
-    PixelType currentLabel = *iter;
-  
-    /**
-     * check to see if the moving label set contains the same label
-     */
-    if ( find( this->m_MovingLabelSet.begin(), this->m_MovingLabelSet.end(),
-           currentLabel ) == this->m_MovingLabelSet.end() )
-      {
-      continue;
-      }
-
-    /**
-     * Collect all the fixed and moving points with the currentLabel
-     */
-    typename PointSetType::Pointer fixedLabelPoints
-      = PointSetType::New();
-    fixedLabelPoints->Initialize();
-    unsigned long fixedCount = 0;
-
-    std::vector<long> fixedIndices;
-    fixedIndices.clear();
-
-    typename PointSetType::PointsContainerConstIterator ItF =
-      this->m_FixedPointSet->GetPoints()->Begin();
-    typename PointSetType::PointDataContainerIterator ItFD =
-      this->m_FixedPointSet->GetPointData()->Begin();
-
-    while ( ItF != this->m_FixedPointSet->GetPoints()->End() )
-      {
-      if ( ItFD.Value() == currentLabel )
-        {
-        fixedLabelPoints->SetPoint( fixedCount++, ItF.Value() );
-        fixedIndices.push_back( ItF.Index() );
-        }
-      ++ItF;
-      ++ItFD;
-      }
-
-    typename PointSetType::Pointer movingLabelPoints
-      = PointSetType::New();
-    movingLabelPoints->Initialize();
-    unsigned long movingCount = 0;
-
-    std::vector<long> movingIndices;
-    movingIndices.clear();
-
-    typename PointSetType::PointsContainerConstIterator ItM =
-      this->m_MovingPointSet->GetPoints()->Begin();
-    typename PointSetType::PointDataContainerIterator ItMD =
-      this->m_MovingPointSet->GetPointData()->Begin();
-
-    while ( ItM != this->m_MovingPointSet->GetPoints()->End() )
-      {
-      if ( ItMD.Value() == currentLabel )
-        {
-        movingLabelPoints->SetPoint( movingCount++, ItM.Value() );
-        movingIndices.push_back( ItM.Index() );
-        }
-      ++ItM;
-      ++ItMD;
-      }
-
-    /**
-     * Invoke the single label JensenTsallis measure
-     */
-    typedef JensenHavrdaCharvatTsallisPointSetMetric<PointSetType> MetricType;
-    typename MetricType::Pointer metric = MetricType::New();
-
-    metric->SetFixedPointSet( fixedLabelPoints );
-    metric->SetNumberOfFixedSamples( this->m_NumberOfFixedSamples );
-    metric->SetFixedPointSetSigma( this->m_FixedPointSetSigma );
-    metric->SetFixedKernelSigma( this->m_FixedKernelSigma );
-    metric->SetFixedCovarianceKNeighborhood( 
-      this->m_FixedCovarianceKNeighborhood );
-    metric->SetFixedEvaluationKNeighborhood( 
-      this->m_FixedEvaluationKNeighborhood );
-
-    metric->SetMovingPointSet( movingLabelPoints );
-    metric->SetNumberOfMovingSamples( this->m_NumberOfMovingSamples );
-    metric->SetMovingPointSetSigma( this->m_MovingPointSetSigma );
-    metric->SetMovingKernelSigma( this->m_MovingKernelSigma );
-    metric->SetMovingCovarianceKNeighborhood( 
-      this->m_MovingCovarianceKNeighborhood );
-    metric->SetMovingEvaluationKNeighborhood( 
-      this->m_MovingEvaluationKNeighborhood );
-
-    metric->SetUseRegularizationTerm( this->m_UseRegularizationTerm );
-    metric->SetUseInputAsSamples( this->m_UseInputAsSamples );
-    metric->SetUseAnisotropicCovariances( this->m_UseAnisotropicCovariances );
+    typename LabelMetricType::Pointer metric = this->m_LabelTerms[n].Metric;
     metric->SetUseWithRespectToTheMovingPointSet(
       this->m_UseWithRespectToTheMovingPointSet );
-    metric->SetAlpha( this->m_Alpha );
-
-    metric->Initialize();
 
     DerivativeType labelDerivative;
     MeasureType labelValue;
-    
+
     metric->GetValueAndDerivative( parameters, labelValue, labelDerivative );
 
     value[0] += labelValue[0];
 
-    RealType avgNorm = 0.0;
-    for ( unsigned int i = 0; i < metric->GetNumberOfValues(); i++ )
-      {
-      RealType norm = 0.0; 
-      for ( unsigned int j = 0; j < PointDimension; j++ )
-        {
-        norm += ( labelDerivative(i, j) * labelDerivative(i, j) ); 
-        } 
-      avgNorm += vcl_sqrt( norm );  
-      }
-    avgNorm /= static_cast<RealType>( metric->GetNumberOfValues() );   
-    labelDerivative /= avgNorm;
+    this->ScatterLabelDerivative( this->m_LabelTerms[n], labelDerivative,
+      derivative );
+    }
+}
 
-    if ( this->m_UseWithRespectToTheMovingPointSet )
+/** Normalize a single label derivative and copy it to the full derivative */
+template <class TPointSet>
+void
+JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
+::ScatterLabelDerivative( const LabelTermType & term,
+  DerivativeType & labelDerivative, DerivativeType & derivative ) const
+{
+  const std::vector<long> & indices =
+    ( this->m_UseWithRespectToTheMovingPointSet )
+    ? term.MovingIndices : term.FixedIndices;
+
+  if ( indices.size() == 0 )
+    {
+    return;
+    }
+
+  RealType avgNorm = 0.0;
+  for ( unsigned int i = 0; i < indices.size(); i++ )
+    {
+    RealType norm = 0.0;
+    for ( unsigned int j = 0; j < PointDimension; j++ )
       {
-      std::vector<long>::const_iterator it;
-      unsigned long index = 0;
-      for ( it = movingIndices.begin(); it != movingIndices.end(); ++it )
-        {
-        for ( unsigned int d = 0; d < PointDimension; d++ )
-          {
-          derivative( *it, d ) = labelDerivative( index, d );
-          }
-        index++;
-        }
+      norm += ( labelDerivative(i, j) * labelDerivative(i, j) );
       }
-    else
+    avgNorm += vcl_sqrt( norm );
+    }
+  avgNorm /= static_cast<RealType>( indices.size() );
+  labelDerivative /= avgNorm;
+
+  std::vector<long>::const_iterator it;
+  unsigned long index = 0;
+  for ( it = indices.begin(); it != indices.end(); ++it )
+    {
+    for ( unsigned int d = 0; d < PointDimension; d++ )
       {
-      std::vector<long>::const_iterator it;
-      unsigned long index = 0;
-      for ( it = fixedIndices.begin(); it != fixedIndices.end(); ++it )
-        {
-        for ( unsigned int d = 0; d < PointDimension; d++ )
-          {
-          derivative( *it, d ) = labelDerivative( index, d );
-          }
-        index++;
-        }
+      derivative( *it, d ) = labelDerivative( index, d );
       }
+    index++;
     }
 }
 
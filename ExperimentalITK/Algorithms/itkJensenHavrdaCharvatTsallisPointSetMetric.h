@@ -21,13 +21,14 @@
 
 #include "itkIdentityTransform.h"
 #include "itkManifoldParzenWindowsPointSetFunction.h"
+#include "itkTimeStamp.h"
 
 namespace itk {
 
 /** \class JensenHavrdaCharvatTsallisPointSetMetric
  *
- *
- *
+ * The fixed density function is only rebuilt by Initialize() when the fixed
+ * point set or one of the fixed parameters has changed since the last call.
  *
  */
 template<class TPointSet>
@@ -207,6 +208,7 @@ private:
   unsigned int                             m_FixedCovarianceKNeighborhood;
   unsigned int                             m_FixedEvaluationKNeighborhood;
   unsigned long                            m_NumberOfFixedSamples;
+  TimeStamp                                m_FixedDensityFunctionBuildTime;
 
   RealType                                 m_Alpha;
 
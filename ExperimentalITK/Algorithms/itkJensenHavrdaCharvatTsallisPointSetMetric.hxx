@@ -60,32 +60,56 @@ JensenHavrdaCharvatTsallisPointSetMetric<TPointSet>
   Superclass::Initialize();
 
   /**
-   * Initialize the fixed points
+   * Initialize the fixed points.  The fixed density is reused if neither the
+   * fixed point set nor the parameters it depends on have changed.
    */
-  this->m_FixedDensityFunction = DensityFunctionType::New();
-  this->m_FixedDensityFunction->SetBucketSize( 4 );
-  this->m_FixedDensityFunction->SetKernelSigma( this->m_FixedKernelSigma );
-  this->m_FixedDensityFunction->SetRegularizationSigma(
-    this->m_FixedPointSetSigma );
-  this->m_FixedDensityFunction->SetNormalize( true );
-  this->m_FixedDensityFunction->SetUseAnisotropicCovariances(
-    this->m_UseAnisotropicCovariances );
-  this->m_FixedDensityFunction->SetCovarianceKNeighborhood(
-      this->m_FixedCovarianceKNeighborhood );
-  this->m_FixedDensityFunction->SetEvaluationKNeighborhood(
-      this->m_FixedEvaluationKNeighborhood );
-  this->m_FixedDensityFunction->SetInputPointSet( this->m_FixedPointSet );
-
-  if( !this->m_UseInputAsSamples )
+  bool rebuildFixedDensity = ( !this->m_FixedDensityFunction
+    || this->m_FixedDensityFunction->GetInputPointSet()
+      != this->m_FixedPointSet.GetPointer()
+    || this->m_FixedPointSet->GetMTime()
+      > this->m_FixedDensityFunctionBuildTime.GetMTime()
+    || this->m_FixedDensityFunction->GetKernelSigma()
+      != this->m_FixedKernelSigma
+    || this->m_FixedDensityFunction->GetRegularizationSigma()
+      != this->m_FixedPointSetSigma
+    || this->m_FixedDensityFunction->GetUseAnisotropicCovariances()
+      != this->m_UseAnisotropicCovariances
+    || this->m_FixedDensityFunction->GetCovarianceKNeighborhood()
+      != this->m_FixedCovarianceKNeighborhood
+    || this->m_FixedDensityFunction->GetEvaluationKNeighborhood()
+      != this->m_FixedEvaluationKNeighborhood
+    || ( !this->m_UseInputAsSamples && ( !this->m_FixedSamplePoints
+      || this->m_FixedSamplePoints->GetNumberOfPoints()
+        != this->m_NumberOfFixedSamples ) ) );
+
+  if( rebuildFixedDensity )
     {
-    this->m_FixedSamplePoints = PointSetType::New();
-    this->m_FixedSamplePoints->Initialize();
-
-    for( unsigned long i = 0; i < this->m_NumberOfFixedSamples; i++ )
-      {
-      this->m_FixedSamplePoints->SetPoint( i,
-        this->m_FixedDensityFunction->GenerateRandomSample() );
+    this->m_FixedDensityFunction = DensityFunctionType::New();
+    this->m_FixedDensityFunction->SetBucketSize( 4 );
+    this->m_FixedDensityFunction->SetKernelSigma( this->m_FixedKernelSigma );
+    this->m_FixedDensityFunction->SetRegularizationSigma(
+      this->m_FixedPointSetSigma );
+    this->m_FixedDensityFunction->SetNormalize( true );
+    this->m_FixedDensityFunction->SetUseAnisotropicCovariances(
+      this->m_UseAnisotropicCovariances );
+    this->m_FixedDensityFunction->SetCovarianceKNeighborhood(
+        this->m_FixedCovarianceKNeighborhood );
+    this->m_FixedDensityFunction->SetEvaluationKNeighborhood(
+        this->m_FixedEvaluationKNeighborhood );
+    this->m_FixedDensityFunction->SetInputPointSet( this->m_FixedPointSet );
+
+    if( !this->m_UseInputAsSamples )
+      {
+      this->m_FixedSamplePoints = PointSetType::New();
+      this->m_FixedSamplePoints->Initialize();
+
+      for( unsigned long i = 0; i < this->m_NumberOfFixedSamples; i++ )
+        {
+        this->m_FixedSamplePoints->SetPoint( i,
+          this->m_FixedDensityFunction->GenerateRandomSample() );
+        }
       }
+    this->m_FixedDensityFunctionBuildTime.Modified();
     }
 
   /**
@@ -0,0 +1,195 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkBSplineGridBatchFitter_h
+#define __itkBSplineGridBatchFitter_h
+
+#include "itkFixedArray.h"
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+
+#include <vector>
+
+namespace itk
+{
+/** \class BSplineGridBatchFitter
+ * \brief Fits one cubic B-spline object over space and time to a series of
+ * vector images that share the same grid.
+ *
+ * The images are stacked along an extra (time) axis and approximated with
+ * the multilevel B-spline approximation of
+ * BSplineScatteredDataPointSetToImageFilter, with the data points at the
+ * voxel centers of the stack.  Since the points form a regular grid, the
+ * weights of a point are the product of per-axis basis values, and both
+ * the numerator and the denominator of the control point update are
+ * separable.  The fit is computed with per-axis contractions of the data
+ * against the basis, which is evaluated once per grid line, and all time
+ * points and vector components are carried through each contraction
+ * together.  No point set is built.
+ *
+ * The parametric domain of each axis spans the grid from the first to the
+ * last voxel, as for a scattered data fit with the same origin, spacing
+ * and size.  Closed (periodic) axes have NumberOfSpans control points.
+ * The number of spans doubles at every level.  The outputs have the
+ * information of the corresponding inputs.
+ */
+template<class TImage>
+class ITK_EXPORT BSplineGridBatchFitter : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef BSplineGridBatchFitter                         Self;
+  typedef Object                                         Superclass;
+  typedef SmartPointer<Self>                             Pointer;
+  typedef SmartPointer<const Self>                       ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( BSplineGridBatchFitter, Object );
+
+  itkStaticConstMacro( ImageDimension, unsigned int, TImage::ImageDimension );
+
+  typedef TImage                                         ImageType;
+  typedef typename ImageType::Pointer                    ImagePointer;
+  typedef typename ImageType::ConstPointer               ImageConstPointer;
+  typedef typename ImageType::PixelType                  PixelType;
+  typedef typename PixelType::ValueType                  ComponentType;
+
+  itkStaticConstMacro( NumberOfComponents, unsigned int, PixelType::Dimension );
+
+  /** Spatial axes followed by the time axis. */
+  typedef FixedArray<unsigned int, ImageDimension + 1>   ArrayType;
+  typedef FixedArray<bool, ImageDimension + 1>           BooleanArrayType;
+
+  typedef double                                         RealType;
+
+  /** Triggers the fit. */
+  void Compute();
+
+  /** Set the image of time point n. */
+  void SetInput( unsigned int n, const ImageType *image );
+  const ImageType * GetInput( unsigned int n ) const;
+
+  unsigned int GetNumberOfInputs() const
+    {
+    return this->m_Inputs.size();
+    }
+
+  /** The fitted image of time point n. */
+  ImageType * GetOutput( unsigned int n );
+
+  /** Number of spans (mesh elements) of every axis at the first level.
+   * Default is 1. */
+  itkSetMacro( NumberOfSpans, ArrayType );
+  itkGetConstMacro( NumberOfSpans, ArrayType );
+
+  itkSetMacro( CloseDimension, BooleanArrayType );
+  itkGetConstMacro( CloseDimension, BooleanArrayType );
+
+  itkSetClampMacro( NumberOfLevels, unsigned int, 1,
+    NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( NumberOfLevels, unsigned int );
+
+  itkSetClampMacro( NumberOfThreads, unsigned int, 1,
+    NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( NumberOfThreads, unsigned int );
+
+protected:
+  BSplineGridBatchFitter();
+  ~BSplineGridBatchFitter() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  BSplineGridBatchFitter( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  itkStaticConstMacro( SplineOrder, unsigned int, 3 );
+
+  /** Basis of one axis at one level: the first control point and the
+   * order + 1 weights of every grid coordinate. */
+  struct AxisBasisType
+    {
+    unsigned long              NumberOfControlPoints;
+    std::vector<unsigned long> FirstControlPoint;
+    std::vector<RealType>      Weights;
+    bool                       Closed;
+    };
+
+  /** A contraction of one axis of a row-major array with Outer x
+   * ( length along the axis ) x Inner layout.  The input of a fit is
+   * either Input or the residual Data - Fitted of one time point, and the
+   * output of an evaluation is either Output or added to Fitted. */
+  struct ContractionType
+    {
+    const RealType            *Input;
+    const ComponentType       *Data;
+    ComponentType             *Fitted;
+    RealType                  *Output;
+    const AxisBasisType       *Basis;
+    const RealType            *Factors;
+    unsigned long              Outer;
+    unsigned long              Inner;
+    bool                       Evaluate;
+    };
+
+  struct ContractionThreadStruct
+    {
+    BSplineGridBatchFitter    *Fitter;
+    ContractionType            Contraction;
+    };
+
+  static ITK_THREAD_RETURN_TYPE ContractionThreaderCallback( void *arg );
+
+  /** Fit: Output( k ) += Factor( i, j ) * Input( i ) for the control
+   * points k of every grid coordinate i.  Evaluate: Output( i ) +=
+   * Weight( i, j ) * Input( k ). */
+  void ThreadedContraction( const ContractionType &, unsigned int threadId,
+    unsigned int numberOfThreads );
+
+  void Contract( const ContractionType & );
+
+  void ComputeAxisBasis( unsigned int axis, unsigned long numberOfSpans,
+    AxisBasisType & ) const;
+
+  inline unsigned long GetControlPoint( const AxisBasisType & basis,
+    unsigned long i, unsigned int j ) const
+    {
+    const unsigned long k = basis.FirstControlPoint[i] + j;
+    return ( basis.Closed ) ? k % basis.NumberOfControlPoints : k;
+    }
+
+  std::vector<ImageConstPointer>                   m_Inputs;
+  std::vector<ImagePointer>                        m_Outputs;
+
+  ArrayType                                        m_NumberOfSpans;
+  BooleanArrayType                                 m_CloseDimension;
+  unsigned int                                     m_NumberOfLevels;
+  unsigned int                                     m_NumberOfThreads;
+
+  /** Grid size of every axis, including the time axis. */
+  unsigned long                                    m_GridSize[ImageDimension + 1];
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkBSplineGridBatchFitter.hxx"
+#endif
+
+#endif
@@ -0,0 +1,489 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkBSplineGridBatchFitter_hxx
+#define __itkBSplineGridBatchFitter_hxx
+
+#include "itkBSplineGridBatchFitter.h"
+
+#include "vnl/vnl_math.h"
+
+namespace itk
+{
+
+template<class TImage>
+BSplineGridBatchFitter<TImage>
+::BSplineGridBatchFitter()
+{
+  this->m_NumberOfSpans.Fill( 1 );
+  this->m_CloseDimension.Fill( false );
+  this->m_NumberOfLevels = 1;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+}
+
+template<class TImage>
+void
+BSplineGridBatchFitter<TImage>
+::SetInput( unsigned int n, const ImageType *image )
+{
+  if( n >= this->m_Inputs.size() )
+    {
+    this->m_Inputs.resize( n + 1 );
+    }
+  this->m_Inputs[n] = image;
+  this->Modified();
+}
+
+template<class TImage>
+const typename BSplineGridBatchFitter<TImage>::ImageType *
+BSplineGridBatchFitter<TImage>
+::GetInput( unsigned int n ) const
+{
+  if( n >= this->m_Inputs.size() )
+    {
+    return NULL;
+    }
+  return this->m_Inputs[n].GetPointer();
+}
+
+template<class TImage>
+typename BSplineGridBatchFitter<TImage>::ImageType *
+BSplineGridBatchFitter<TImage>
+::GetOutput( unsigned int n )
+{
+  if( n >= this->m_Outputs.size() )
+    {
+    itkExceptionMacro( "Output " << n << " has not been computed." );
+    }
+  return this->m_Outputs[n].GetPointer();
+}
+
+template<class TImage>
+void
+BSplineGridBatchFitter<TImage>
+::Compute()
+{
+  const unsigned int numberOfTimePoints = this->m_Inputs.size();
+  if( numberOfTimePoints == 0 )
+    {
+    itkExceptionMacro( "No inputs are set." );
+    }
+
+  const typename ImageType::RegionType region =
+    this->m_Inputs[0]->GetBufferedRegion();
+  for( unsigned int n = 0; n < numberOfTimePoints; n++ )
+    {
+    if( !this->m_Inputs[n] ||
+      this->m_Inputs[n]->GetBufferedRegion().GetSize() != region.GetSize() )
+      {
+      itkExceptionMacro( "Input " << n << " is missing or does not have "
+        << "the grid of the first input." );
+      }
+    }
+
+  for( unsigned int d = 0; d <= ImageDimension; d++ )
+    {
+    if( this->m_NumberOfSpans[d] == 0 )
+      {
+      itkExceptionMacro( "The number of spans must be positive." );
+      }
+    }
+
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    this->m_GridSize[d] = region.GetSize()[d];
+    }
+  this->m_GridSize[ImageDimension] = numberOfTimePoints;
+
+  const unsigned long pointsPerTimePoint = region.GetNumberOfPixels();
+
+  // The outputs hold the fit so far; the data of every level is the
+  // residual of the inputs.
+  this->m_Outputs.resize( numberOfTimePoints );
+  for( unsigned int n = 0; n < numberOfTimePoints; n++ )
+    {
+    PixelType zero;
+    zero.Fill( NumericTraits<ComponentType>::Zero );
+
+    this->m_Outputs[n] = ImageType::New();
+    this->m_Outputs[n]->CopyInformation( this->m_Inputs[n] );
+    this->m_Outputs[n]->SetRegions( this->m_Inputs[n]->GetBufferedRegion() );
+    this->m_Outputs[n]->Allocate();
+    this->m_Outputs[n]->FillBuffer( zero );
+    }
+
+  const unsigned int numberOfWeights = SplineOrder + 1;
+
+  std::vector<AxisBasisType> bases( ImageDimension + 1 );
+  std::vector<std::vector<RealType> > factors( ImageDimension + 1 );
+  std::vector<std::vector<RealType> > denominators( ImageDimension + 1 );
+
+  for( unsigned int level = 0; level < this->m_NumberOfLevels; level++ )
+    {
+    // Per-axis bases.  The fit of a control point is
+    //   sum_p w_pc^3 z_p / sum_c' w_pc'^2 / sum_p w_pc^2,
+    // where every sum over a tensor product factors into sums along the
+    // axes.
+    for( unsigned int d = 0; d <= ImageDimension; d++ )
+      {
+      this->ComputeAxisBasis( d,
+        this->m_NumberOfSpans[d] * ( 1ul << level ), bases[d] );
+
+      const unsigned long gridSize = this->m_GridSize[d];
+      factors[d].resize( gridSize * numberOfWeights );
+      denominators[d].assign( bases[d].NumberOfControlPoints, 0.0 );
+      for( unsigned long i = 0; i < gridSize; i++ )
+        {
+        const RealType *w = &bases[d].Weights[i * numberOfWeights];
+        RealType sumOfSquares = 0.0;
+        for( unsigned int j = 0; j < numberOfWeights; j++ )
+          {
+          sumOfSquares += w[j] * w[j];
+          }
+        for( unsigned int j = 0; j < numberOfWeights; j++ )
+          {
+          factors[d][i * numberOfWeights + j] =
+            w[j] * w[j] * w[j] / sumOfSquares;
+          denominators[d][this->GetControlPoint( bases[d], i, j )] +=
+            w[j] * w[j];
+          }
+        }
+      }
+
+    // Numerator: contract the residual along x for every time point, then
+    // the remaining axes, with all time points and components carried
+    // along.
+    unsigned long dimensions[ImageDimension + 1];
+    for( unsigned int d = 0; d <= ImageDimension; d++ )
+      {
+      dimensions[d] = this->m_GridSize[d];
+      }
+
+    std::vector<RealType> current;
+    std::vector<RealType> next;
+    {
+    dimensions[0] = bases[0].NumberOfControlPoints;
+    const unsigned long blockSize = pointsPerTimePoint / this->m_GridSize[0] *
+      dimensions[0] * NumberOfComponents;
+    current.assign( blockSize * numberOfTimePoints, 0.0 );
+
+    for( unsigned int n = 0; n < numberOfTimePoints; n++ )
+      {
+      ContractionType contraction;
+      contraction.Input = NULL;
+      contraction.Data = reinterpret_cast<const ComponentType *>(
+        this->m_Inputs[n]->GetBufferPointer() );
+      contraction.Fitted = reinterpret_cast<ComponentType *>(
+        this->m_Outputs[n]->GetBufferPointer() );
+      contraction.Output = &current[n * blockSize];
+      contraction.Basis = &bases[0];
+      contraction.Factors = &factors[0][0];
+      contraction.Outer = pointsPerTimePoint / this->m_GridSize[0];
+      contraction.Inner = NumberOfComponents;
+      contraction.Evaluate = false;
+      this->Contract( contraction );
+      }
+    }
+
+    for( unsigned int d = 1; d <= ImageDimension; d++ )
+      {
+      unsigned long inner = NumberOfComponents;
+      unsigned long outer = 1;
+      for( unsigned int e = 0; e < d; e++ )
+        {
+        inner *= dimensions[e];
+        }
+      for( unsigned int e = d + 1; e <= ImageDimension; e++ )
+        {
+        outer *= dimensions[e];
+        }
+      next.assign( outer * bases[d].NumberOfControlPoints * inner, 0.0 );
+
+      ContractionType contraction;
+      contraction.Input = &current[0];
+      contraction.Data = NULL;
+      contraction.Fitted = NULL;
+      contraction.Output = &next[0];
+      contraction.Basis = &bases[d];
+      contraction.Factors = &factors[d][0];
+      contraction.Outer = outer;
+      contraction.Inner = inner;
+      contraction.Evaluate = false;
+      this->Contract( contraction );
+
+      dimensions[d] = bases[d].NumberOfControlPoints;
+      current.swap( next );
+      }
+
+    // Divide by the separable denominator.
+    unsigned long lattice[ImageDimension + 1];
+    for( unsigned int d = 0; d <= ImageDimension; d++ )
+      {
+      lattice[d] = 0;
+      }
+    for( unsigned long c = 0; c < current.size(); c += NumberOfComponents )
+      {
+      RealType omega = 1.0;
+      for( unsigned int d = 0; d <= ImageDimension; d++ )
+        {
+        omega *= denominators[d][lattice[d]];
+        }
+      for( unsigned int k = 0; k < NumberOfComponents; k++ )
+        {
+        current[c + k] = ( omega != 0.0 ) ? current[c + k] / omega : 0.0;
+        }
+      for( unsigned int d = 0; d <= ImageDimension; d++ )
+        {
+        if( ++lattice[d] < dimensions[d] )
+          {
+          break;
+          }
+        lattice[d] = 0;
+        }
+      }
+
+    // Evaluate the control point update on the grid, from the time axis
+    // down to x, and add it to the outputs.
+    for( unsigned int d = ImageDimension; d > 0; d-- )
+      {
+      unsigned long inner = NumberOfComponents;
+      unsigned long outer = 1;
+      for( unsigned int e = 0; e < d; e++ )
+        {
+        inner *= dimensions[e];
+        }
+      for( unsigned int e = d + 1; e <= ImageDimension; e++ )
+        {
+        outer *= dimensions[e];
+        }
+      next.assign( outer * this->m_GridSize[d] * inner, 0.0 );
+
+      ContractionType contraction;
+      contraction.Input = &current[0];
+      contraction.Data = NULL;
+      contraction.Fitted = NULL;
+      contraction.Output = &next[0];
+      contraction.Basis = &bases[d];
+      contraction.Factors = &bases[d].Weights[0];
+      contraction.Outer = outer;
+      contraction.Inner = inner;
+      contraction.Evaluate = true;
+      this->Contract( contraction );
+
+      dimensions[d] = this->m_GridSize[d];
+      current.swap( next );
+      }
+
+    const unsigned long blockSize = pointsPerTimePoint / this->m_GridSize[0] *
+      dimensions[0] * NumberOfComponents;
+    for( unsigned int n = 0; n < numberOfTimePoints; n++ )
+      {
+      ContractionType contraction;
+      contraction.Input = &current[n * blockSize];
+      contraction.Data = NULL;
+      contraction.Fitted = reinterpret_cast<ComponentType *>(
+        this->m_Outputs[n]->GetBufferPointer() );
+      contraction.Output = NULL;
+      contraction.Basis = &bases[0];
+      contraction.Factors = &bases[0].Weights[0];
+      contraction.Outer = pointsPerTimePoint / this->m_GridSize[0];
+      contraction.Inner = NumberOfComponents;
+      contraction.Evaluate = true;
+      this->Contract( contraction );
+      }
+    }
+}
+
+template<class TImage>
+void
+BSplineGridBatchFitter<TImage>
+::ComputeAxisBasis( unsigned int axis, unsigned long numberOfSpans,
+  AxisBasisType & basis ) const
+{
+  const unsigned long gridSize = this->m_GridSize[axis];
+
+  basis.Closed = this->m_CloseDimension[axis];
+  basis.NumberOfControlPoints = ( basis.Closed )
+    ? numberOfSpans : numberOfSpans + SplineOrder;
+  basis.FirstControlPoint.resize( gridSize );
+  basis.Weights.resize( gridSize * ( SplineOrder + 1 ) );
+
+  for( unsigned long i = 0; i < gridSize; i++ )
+    {
+    RealType u = 0.0;
+    if( gridSize > 1 )
+      {
+      u = static_cast<RealType>( i ) * numberOfSpans / ( gridSize - 1 );
+      }
+    // The last grid point falls in the last span.
+    unsigned long span = static_cast<unsigned long>( vcl_floor( u ) );
+    if( span > numberOfSpans - 1 )
+      {
+      span = numberOfSpans - 1;
+      }
+    const RealType t = u - span;
+    const RealType s = 1.0 - t;
+
+    basis.FirstControlPoint[i] = span;
+    RealType *w = &basis.Weights[i * ( SplineOrder + 1 )];
+    w[0] = s * s * s / 6.0;
+    w[1] = ( 3.0 * t * t * t - 6.0 * t * t + 4.0 ) / 6.0;
+    w[2] = ( -3.0 * t * t * t + 3.0 * t * t + 3.0 * t + 1.0 ) / 6.0;
+    w[3] = t * t * t / 6.0;
+    }
+}
+
+template<class TImage>
+void
+BSplineGridBatchFitter<TImage>
+::Contract( const ContractionType & contraction )
+{
+  ContractionThreadStruct str;
+  str.Fitter = this;
+  str.Contraction = contraction;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( this->m_NumberOfThreads );
+  threader->SetSingleMethod( this->ContractionThreaderCallback, &str );
+  threader->SingleMethodExecute();
+}
+
+template<class TImage>
+ITK_THREAD_RETURN_TYPE
+BSplineGridBatchFitter<TImage>
+::ContractionThreaderCallback( void *arg )
+{
+  unsigned int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  unsigned int threadCount =
+    ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ContractionThreadStruct *str = (ContractionThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  str->Fitter->ThreadedContraction( str->Contraction, threadId, threadCount );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TImage>
+void
+BSplineGridBatchFitter<TImage>
+::ThreadedContraction( const ContractionType & contraction,
+  unsigned int threadId, unsigned int numberOfThreads )
+{
+  const AxisBasisType & basis = *contraction.Basis;
+  const unsigned long gridSize = basis.FirstControlPoint.size();
+  const unsigned long numberOfControlPoints = basis.NumberOfControlPoints;
+  const unsigned int numberOfWeights = SplineOrder + 1;
+
+  // Split the outer lines over the threads if there are enough of them,
+  // otherwise the contiguous inner blocks.  Either way the threads write
+  // to disjoint parts of the output.
+  unsigned long firstOuter = 0;
+  unsigned long lastOuter = contraction.Outer;
+  unsigned long firstInner = 0;
+  unsigned long lastInner = contraction.Inner;
+  if( contraction.Outer >= numberOfThreads )
+    {
+    firstOuter = contraction.Outer * threadId / numberOfThreads;
+    lastOuter = contraction.Outer * ( threadId + 1 ) / numberOfThreads;
+    }
+  else
+    {
+    firstInner = contraction.Inner * threadId / numberOfThreads;
+    lastInner = contraction.Inner * ( threadId + 1 ) / numberOfThreads;
+    }
+  const unsigned long inner = contraction.Inner;
+
+  for( unsigned long o = firstOuter; o < lastOuter; o++ )
+    {
+    for( unsigned long i = 0; i < gridSize; i++ )
+      {
+      const unsigned long gridOffset = ( o * gridSize + i ) * inner;
+      const RealType *factors = contraction.Factors + i * numberOfWeights;
+
+      for( unsigned int j = 0; j < numberOfWeights; j++ )
+        {
+        const RealType f = factors[j];
+        const unsigned long latticeOffset = ( o * numberOfControlPoints +
+          this->GetControlPoint( basis, i, j ) ) * inner;
+
+        if( !contraction.Evaluate )
+          {
+          RealType *output = contraction.Output + latticeOffset;
+          if( contraction.Data )
+            {
+            const ComponentType *data = contraction.Data + gridOffset;
+            const ComponentType *fitted = contraction.Fitted + gridOffset;
+            for( unsigned long q = firstInner; q < lastInner; q++ )
+              {
+              output[q] += f * ( static_cast<RealType>( data[q] ) -
+                static_cast<RealType>( fitted[q] ) );
+              }
+            }
+          else
+            {
+            const RealType *input = contraction.Input + gridOffset;
+            for( unsigned long q = firstInner; q < lastInner; q++ )
+              {
+              output[q] += f * input[q];
+              }
+            }
+          }
+        else
+          {
+          const RealType *input = contraction.Input + latticeOffset;
+          if( contraction.Output )
+            {
+            RealType *output = contraction.Output + gridOffset;
+            for( unsigned long q = firstInner; q < lastInner; q++ )
+              {
+              output[q] += f * input[q];
+              }
+            }
+          else
+            {
+            ComponentType *fitted = contraction.Fitted + gridOffset;
+            for( unsigned long q = firstInner; q < lastInner; q++ )
+              {
+              fitted[q] += static_cast<ComponentType>( f * input[q] );
+              }
+            }
+          }
+        }
+      }
+    }
+}
+
+template<class TImage>
+void
+BSplineGridBatchFitter<TImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Number of inputs: " << this->m_Inputs.size() << std::endl;
+  os << indent << "Number of spans: " << this->m_NumberOfSpans << std::endl;
+  os << indent << "Close dimension: " << this->m_CloseDimension << std::endl;
+  os << indent << "Number of levels: " << this->m_NumberOfLevels << std::endl;
+  os << indent << "Number of threads: " << this->m_NumberOfThreads
+    << std::endl;
+}
+
+} // end namespace itk
+
+#endif
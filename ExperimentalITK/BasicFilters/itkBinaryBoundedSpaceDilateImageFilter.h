@@ -19,6 +19,8 @@
 
 #include "itkBinaryDilateImageFilter.h"
 
+#include <vector>
+
 namespace itk
 {
 /**
@@ -28,6 +30,13 @@ namespace itk
  * BinaryBoundedSpaceDilateImageFilter is a binary dilation
  * morphologic operation over a bounded space. 
  *
+ * The foreground is grown geodesically: at each step, the pixels of the
+ * bounded space covered by the structuring element centered at a pixel
+ * added in the previous step (or at an input foreground pixel in the first
+ * step) are added.  Only the advancing front is visited, and the filter
+ * stops when the front is empty or after Scaling steps.  Foreground pixels
+ * of the input outside the bounded space are set to the background value.
+ *
  * \sa ImageToImageFilter BinaryDilateImageFilter BinaryMorphologyImageFilter
  */
 template <class TInputImage, class TOutputImage, 
@@ -75,6 +84,7 @@ public:
   itkSetMacro( BoundedSpaceValue, BoundedSpaceValueType );
   itkGetConstMacro( BoundedSpaceValue, BoundedSpaceValueType ); 
 
+  /** Maximum number of dilation steps. */
   itkSetMacro( Scaling, unsigned int );
   itkGetConstMacro( Scaling, unsigned int );
 
@@ -88,6 +98,11 @@ protected:
   // type inherited from the superclass
   typedef typename Superclass::NeighborIndexContainer NeighborIndexContainer;
 
+  typedef typename OutputImageType::RegionType        RegionType;
+  typedef typename OutputImageType::IndexType         IndexType;
+  typedef typename OutputImageType::OffsetType        OffsetType;
+  typedef std::vector<IndexType>                      IndexContainerType;
+
 private:
   BinaryBoundedSpaceDilateImageFilter(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
@@ -19,10 +19,8 @@
 
 #include "itkBinaryBoundedSpaceDilateImageFilter.h"
 
-#include "itkCastImageFilter.h"
-#include "itkImageDuplicator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkImageRegionIterator.h"
-#include "itkImageRegionConstIterator.h"
 
 namespace itk
 {
@@ -40,63 +38,95 @@ void
 BinaryBoundedSpaceDilateImageFilter< TInputImage, TOutputImage, TKernel, TBoundedSpaceImage>
 ::GenerateData()
 {
-  typedef ImageDuplicator<InputImageType> DuplicatorType;
-  typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
-  duplicator->SetInputImage( this->GetInput() );
-  duplicator->Update();
+  this->AllocateOutputs();
+
+  typename OutputImageType::Pointer output = this->GetOutput();
+  const RegionType region = output->GetRequestedRegion();
+
+  typedef typename OutputImageType::PixelType OutputPixelType;
+  const OutputPixelType foregroundValue =
+    static_cast<OutputPixelType>( this->GetForegroundValue() );
+  const OutputPixelType backgroundValue =
+    static_cast<OutputPixelType>( this->GetBackgroundValue() );
+
+  /**
+   * Copy the input to the output and collect the foreground pixels of the
+   * input, which form the first front.
+   */
+  IndexContainerType seeds;
+
+  ImageRegionConstIteratorWithIndex<InputImageType> ItI( this->GetInput(),
+    region );
+  ImageRegionIterator<OutputImageType> ItO( output, region );
+  for ( ItI.GoToBegin(), ItO.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++ItO )
+    {
+    OutputPixelType pixel = static_cast<OutputPixelType>( ItI.Get() );
+    ItO.Set( pixel );
+    if ( pixel == foregroundValue )
+      {
+      seeds.push_back( ItI.GetIndex() );
+      }
+    }
 
-  typename InputImageType::ConstPointer input = duplicator->GetOutput();
-  typename OutputImageType::Pointer output;
+  /**
+   * The active offsets of the structuring element
+   */
+  std::vector<OffsetType> offsets;
+  const KernelType & kernel = this->GetKernel();
+  for ( unsigned int i = 0; i < kernel.Size(); i++ )
+    {
+    if ( kernel[i] > NumericTraits<typename KernelType::PixelType>::Zero )
+      {
+      offsets.push_back( kernel.GetOffset( i ) );
+      }
+    }
 
-  for ( unsigned int i = 0; i < this->GetScaling(); i++ )
+  /**
+   * Each step dilates only the pixels added by the previous step, since
+   * the neighborhoods of the older foreground pixels have already been
+   * filled.  A pixel joins the foreground if it lies in the bounded space.
+   * The first step reads the seeds in place.
+   */
+  const IndexContainerType *current = &seeds;
+  IndexContainerType front;
+  IndexContainerType nextFront;
+  for ( unsigned int i = 0; i < this->m_Scaling && !current->empty(); i++ )
     {
-    typename Superclass::Pointer dilater = Superclass::New();
-    dilater->SetInput( input );
-    dilater->SetKernel( this->GetKernel() );
-    dilater->SetForegroundValue( this->GetForegroundValue() );
-    dilater->SetBackgroundValue( this->GetBackgroundValue() );
-    dilater->Update();
-
-    bool isFilled = true;
-
-    ImageRegionIterator<OutputImageType> ItD( dilater->GetOutput(),
-      dilater->GetOutput()->GetRequestedRegion() );
-    ImageRegionIterator<BoundedSpaceImageType> ItB( this->m_BoundedSpaceImage,
-      this->m_BoundedSpaceImage->GetRequestedRegion() );
-    ItD.GoToBegin();
-    ItB.GoToBegin();
-    while ( !ItD.IsAtEnd() )
+    nextFront.clear();
+    for ( unsigned long n = 0; n < current->size(); n++ )
       {
-      if ( ItD.Get() == this->GetForegroundValue()
-           && ItB.Get() != this->GetBoundedSpaceValue() )
-        {
-        ItD.Set( static_cast<typename OutputImageType::PixelType>( this->GetBackgroundValue() ) );
-        }
-      if ( ItB.Get() == this->m_BoundedSpaceValue &&
-           ItD.Get() != this->GetForegroundValue() )
+      for ( unsigned int k = 0; k < offsets.size(); k++ )
         {
-        isFilled = false;
+        IndexType index = ( *current )[n] + offsets[k];
+        if ( !region.IsInside( index )
+          || this->m_BoundedSpaceImage->GetPixel( index )
+            != this->m_BoundedSpaceValue
+          || output->GetPixel( index ) == foregroundValue )
+          {
+          continue;
+          }
+        output->SetPixel( index, foregroundValue );
+        nextFront.push_back( index );
         }
-      ++ItD;
-      ++ItB;
       }
+    front.swap( nextFront );
+    current = &front;
+    }
 
-    output = dilater->GetOutput();
-
-    if ( isFilled )
+  /**
+   * Foreground pixels of the input outside the bounded space are removed.
+   */
+  if ( this->m_Scaling > 0 )
+    {
+    for ( unsigned long n = 0; n < seeds.size(); n++ )
       {
-      break;
+      if ( this->m_BoundedSpaceImage->GetPixel( seeds[n] )
+        != this->m_BoundedSpaceValue )
+        {
+        output->SetPixel( seeds[n], backgroundValue );
+        }
       }
-
-    typedef CastImageFilter<OutputImageType, InputImageType> CasterType;
-    typename CasterType::Pointer caster = CasterType::New();
-    caster->SetInput( dilater->GetOutput() );
-    caster->Update();
-
-    input = caster->GetOutput();
     }
-
-  this->GraftOutput( output );
 }
 
 
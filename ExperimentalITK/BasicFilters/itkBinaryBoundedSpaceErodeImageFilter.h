@@ -25,9 +25,12 @@ namespace itk
  * \class BinaryBoundedSpaceErodeImageFilter
  * \brief Fast binary erosion
  *
- * BinaryBoundedSpaceErodeImageFilter is a binary dilation
+ * BinaryBoundedSpaceErodeImageFilter is a binary erosion
  * morphologic operation over a bounded space. 
  *
+ * The background of the bounded space is grown into the foreground with
+ * BinaryBoundedSpaceDilateImageFilter for at most Scaling steps.
+ *
  * \sa ImageToImageFilter BinaryErodeImageFilter BinaryMorphologyImageFilter
  */
 template <class TInputImage, class TOutputImage, 
@@ -75,6 +78,7 @@ public:
   itkSetMacro( BoundedSpaceValue, BoundedSpaceValueType );
   itkGetConstMacro( BoundedSpaceValue, BoundedSpaceValueType ); 
 
+  /** Maximum number of erosion steps. */
   itkSetMacro( Scaling, unsigned int );
   itkGetConstMacro( Scaling, unsigned int );
 
@@ -20,6 +20,8 @@
 #include "itkBinaryBoundedSpaceErodeImageFilter.h"
 
 #include "itkBinaryBoundedSpaceDilateImageFilter.h"
+#include "itkImageDuplicator.h"
+#include "itkImageRegionIterator.h"
 
 namespace itk
 {
@@ -42,14 +44,15 @@ BinaryBoundedSpaceErodeImageFilter< TInputImage, TOutputImage, TKernel, TBounded
   duplicator->SetInputImage( this->GetInput() );
   duplicator->Update();
 
-  typename InputImageType::ConstPointer input = duplicator->GetOutput();
+  typename InputImageType::Pointer input = duplicator->GetOutput();
 
   ImageRegionIterator<InputImageType> ItI( input,
     input->GetRequestedRegion() );   
   ImageRegionIterator<BoundedSpaceImageType> ItB( this->m_BoundedSpaceImage,
     this->m_BoundedSpaceImage->GetRequestedRegion() );   
 
-  // Now perform bounded space erosion
+  // Erosion of the foreground is the bounded space dilation of the
+  // background within the bounded space, which only visits the front.
   for ( ItI.GoToBegin(), ItB.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++ItB )
     {
     typename InputImageType::PixelType pixel = ItI.Get();
@@ -65,12 +68,13 @@ BinaryBoundedSpaceErodeImageFilter< TInputImage, TOutputImage, TKernel, TBounded
     } 
 
   typedef BinaryBoundedSpaceDilateImageFilter<InputImageType, 
-    OutputImageType, KernelType> DilaterType;
+    OutputImageType, KernelType, BoundedSpaceImageType> DilaterType;
   typename DilaterType::Pointer dilater = DilaterType::New();
   dilater->SetInput( input );
   dilater->SetKernel( this->GetKernel() );
-  dilater->SetSpacing( this->GetSpacing() );
   dilater->SetForegroundValue( this->GetForegroundValue() );
+  dilater->SetBackgroundValue( this->GetBackgroundValue() );
+  dilater->SetScaling( this->m_Scaling );
   dilater->SetBoundedSpaceImage( this->GetBoundedSpaceImage() );
   dilater->SetBoundedSpaceValue( this->GetBoundedSpaceValue() );
   dilater->Update();
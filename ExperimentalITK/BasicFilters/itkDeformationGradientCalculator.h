@@ -0,0 +1,231 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkDeformationGradientCalculator_h
+#define __itkDeformationGradientCalculator_h
+
+#include "itkImage.h"
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+#include "itkVector.h"
+
+#include <vector>
+
+namespace itk
+{
+/** \class DeformationGradientCalculator
+ * \brief Computes the Jacobian determinant, the principal strains and the
+ * directional strains of a displacement field in one threaded pass.
+ *
+ * The deformation gradient of every voxel is computed from the field
+ * buffer with a grid-aligned stencil: the five point difference of
+ * VectorFieldGradientImageFunction::EvaluateDeformationGradientTensorAtIndex
+ * or a central difference.  Neighbors outside the buffered region are
+ * clamped to the border, as with a zero flux Neumann boundary condition.
+ * With UseImageDirection on, the index-space derivatives are rotated into
+ * physical space with the direction cosines of the field.
+ *
+ * As in VectorFieldGradientImageFunction, row i of the deformation
+ * gradient F holds the derivatives along axis i, plus the identity.  The
+ * Lagrangian strain is ( F^T F - I ) / 2 and the Eulerian strain is
+ * ( I - ( F F^T )^-1 ) / 2.  The principal strains are the eigenvalues of
+ * the Lagrangian strain, sorted from largest to smallest.  Each one is
+ * stored as its eigenvector scaled by the eigenvalue.  The directional
+ * strains are v^T E v along the vectors of a direction field, or a single
+ * component E( i, j ) of both strain tensors.
+ *
+ * All 2x2 and 3x3 matrix work (determinant, inverse and symmetric eigen
+ * decomposition) is done in closed form on fixed-size arrays, so only two
+ * and three dimensional fields are supported.  Voxels outside the mask
+ * are set to zero in all outputs.  The mask and direction field must have
+ * the buffered region of the displacement field.
+ */
+template<class TDisplacementField, class TMaskImage =
+  Image<int, TDisplacementField::ImageDimension> >
+class ITK_EXPORT DeformationGradientCalculator : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef DeformationGradientCalculator                  Self;
+  typedef Object                                         Superclass;
+  typedef SmartPointer<Self>                             Pointer;
+  typedef SmartPointer<const Self>                       ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( DeformationGradientCalculator, Object );
+
+  itkStaticConstMacro( ImageDimension, unsigned int,
+                       TDisplacementField::ImageDimension );
+
+  typedef TDisplacementField                             DisplacementFieldType;
+  typedef typename DisplacementFieldType::PixelType      VectorType;
+  typedef typename DisplacementFieldType::RegionType     RegionType;
+  typedef typename DisplacementFieldType::IndexType      IndexType;
+  typedef TMaskImage                                     MaskImageType;
+
+  typedef float                                          RealType;
+  typedef Image<RealType, ImageDimension>                RealImageType;
+  typedef Vector<RealType, ImageDimension>               StrainVectorType;
+  typedef Image<StrainVectorType, ImageDimension>        StrainVectorImageType;
+
+  enum DifferenceSchemeType { CentralDifference, FivePointDifference };
+
+  itkSetConstObjectMacro( DisplacementField, DisplacementFieldType );
+  itkGetConstObjectMacro( DisplacementField, DisplacementFieldType );
+
+  /** Optional mask; voxels where it is zero are skipped. */
+  itkSetConstObjectMacro( MaskImage, MaskImageType );
+  itkGetConstObjectMacro( MaskImage, MaskImageType );
+
+  /** Default is FivePointDifference. */
+  itkSetMacro( DifferenceScheme, DifferenceSchemeType );
+  itkGetConstMacro( DifferenceScheme, DifferenceSchemeType );
+
+  /** Default is on. */
+  itkSetMacro( UseImageDirection, bool );
+  itkGetConstMacro( UseImageDirection, bool );
+  itkBooleanMacro( UseImageDirection );
+
+  itkSetMacro( ComputeJacobianDeterminant, bool );
+  itkGetConstMacro( ComputeJacobianDeterminant, bool );
+  itkBooleanMacro( ComputeJacobianDeterminant );
+
+  /** Store the log of the Jacobian determinant.  Voxels with a
+   * nonpositive determinant are set to the largest RealType value. */
+  itkSetMacro( UseLogJacobianDeterminant, bool );
+  itkGetConstMacro( UseLogJacobianDeterminant, bool );
+  itkBooleanMacro( UseLogJacobianDeterminant );
+
+  itkSetMacro( ComputePrincipalStrains, bool );
+  itkGetConstMacro( ComputePrincipalStrains, bool );
+  itkBooleanMacro( ComputePrincipalStrains );
+
+  /** The directional strains are computed along the vectors of the
+   * direction field, which should have unit length, if one is set, and
+   * otherwise for the strain components set with SetStrainComponents(). */
+  itkSetMacro( ComputeDirectionalStrains, bool );
+  itkGetConstMacro( ComputeDirectionalStrains, bool );
+  itkBooleanMacro( ComputeDirectionalStrains );
+
+  itkSetConstObjectMacro( DirectionField, DisplacementFieldType );
+  itkGetConstObjectMacro( DirectionField, DisplacementFieldType );
+
+  void SetStrainComponents( unsigned int i, unsigned int j )
+    {
+    this->m_StrainComponents[0] = i;
+    this->m_StrainComponents[1] = j;
+    this->Modified();
+    }
+
+  itkSetClampMacro( NumberOfThreads, unsigned int, 1,
+    NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( NumberOfThreads, unsigned int );
+
+  /** Triggers the computation. */
+  void Compute();
+
+  RealImageType * GetJacobianDeterminantImage()
+    {
+    return this->m_JacobianDeterminantImage.GetPointer();
+    }
+
+  /** Principal strain n, with n = 0 the largest. */
+  StrainVectorImageType * GetPrincipalStrainImage( unsigned int n )
+    {
+    return this->m_PrincipalStrainImages[n].GetPointer();
+    }
+
+  RealImageType * GetLagrangianDirectionalStrainImage()
+    {
+    return this->m_LagrangianDirectionalStrainImage.GetPointer();
+    }
+  RealImageType * GetEulerianDirectionalStrainImage()
+    {
+    return this->m_EulerianDirectionalStrainImage.GetPointer();
+    }
+
+  /** Eigenvalues ( ascending ) and eigenvectors ( columns ) of a
+   * symmetric matrix of the given dimension ( 2 or 3 ), in closed form. */
+  static void ComputeSymmetricEigenSystem( const double A[3][3],
+    unsigned int dimension, double eigenvalues[3], double eigenvectors[3][3] );
+
+  /** Determinant and inverse of a matrix of the given dimension ( 2 or 3 ).
+   * The inverse is not computed if the determinant is zero. */
+  static double ComputeDeterminant( const double A[3][3],
+    unsigned int dimension );
+  static bool ComputeInverse( const double A[3][3], unsigned int dimension,
+    double inverse[3][3] );
+
+protected:
+  DeformationGradientCalculator();
+  ~DeformationGradientCalculator() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  DeformationGradientCalculator( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  struct GradientThreadStruct
+    {
+    DeformationGradientCalculator *Calculator;
+    };
+
+  static ITK_THREAD_RETURN_TYPE GradientThreaderCallback( void *arg );
+
+  void ThreadedCompute( unsigned int threadId, unsigned int numberOfThreads );
+
+  /** The deformation gradient of the voxel at the given index and buffer
+   * offset. */
+  void ComputeDeformationGradient( const IndexType & index,
+    OffsetValueType offset, double F[3][3] ) const;
+
+  typename DisplacementFieldType::ConstPointer     m_DisplacementField;
+  typename MaskImageType::ConstPointer             m_MaskImage;
+  typename DisplacementFieldType::ConstPointer     m_DirectionField;
+
+  DifferenceSchemeType                             m_DifferenceScheme;
+  bool                                             m_UseImageDirection;
+  bool                                             m_ComputeJacobianDeterminant;
+  bool                                             m_UseLogJacobianDeterminant;
+  bool                                             m_ComputePrincipalStrains;
+  bool                                             m_ComputeDirectionalStrains;
+  unsigned int                                     m_StrainComponents[2];
+  unsigned int                                     m_NumberOfThreads;
+
+  typename RealImageType::Pointer                  m_JacobianDeterminantImage;
+  std::vector<typename StrainVectorImageType::Pointer>
+                                                   m_PrincipalStrainImages;
+  typename RealImageType::Pointer                  m_LagrangianDirectionalStrainImage;
+  typename RealImageType::Pointer                  m_EulerianDirectionalStrainImage;
+
+  /** Stencil set up by Compute(): the buffer stride and the difference
+   * weight of every axis, and the direction cosines. */
+  OffsetValueType                                  m_Strides[ImageDimension];
+  double                                           m_Weights[ImageDimension];
+  double                                           m_Direction[ImageDimension][ImageDimension];
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkDeformationGradientCalculator.hxx"
+#endif
+
+#endif
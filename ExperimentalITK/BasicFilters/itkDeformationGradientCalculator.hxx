@@ -0,0 +1,642 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkDeformationGradientCalculator_hxx
+#define __itkDeformationGradientCalculator_hxx
+
+#include "itkDeformationGradientCalculator.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+template<class TDisplacementField, class TMaskImage>
+DeformationGradientCalculator<TDisplacementField, TMaskImage>
+::DeformationGradientCalculator()
+{
+  this->m_DisplacementField = NULL;
+  this->m_MaskImage = NULL;
+  this->m_DirectionField = NULL;
+
+  this->m_DifferenceScheme = FivePointDifference;
+  this->m_UseImageDirection = true;
+  this->m_ComputeJacobianDeterminant = true;
+  this->m_UseLogJacobianDeterminant = false;
+  this->m_ComputePrincipalStrains = false;
+  this->m_ComputeDirectionalStrains = false;
+  this->m_StrainComponents[0] = 0;
+  this->m_StrainComponents[1] = 0;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+}
+
+template<class TDisplacementField, class TMaskImage>
+double
+DeformationGradientCalculator<TDisplacementField, TMaskImage>
+::ComputeDeterminant( const double A[3][3], unsigned int dimension )
+{
+  if( dimension == 2 )
+    {
+    return A[0][0] * A[1][1] - A[0][1] * A[1][0];
+    }
+  return A[0][0] * ( A[1][1] * A[2][2] - A[1][2] * A[2][1] )
+    - A[0][1] * ( A[1][0] * A[2][2] - A[1][2] * A[2][0] )
+    + A[0][2] * ( A[1][0] * A[2][1] - A[1][1] * A[2][0] );
+}
+
+template<class TDisplacementField, class TMaskImage>
+bool
+DeformationGradientCalculator<TDisplacementField, TMaskImage>
+::ComputeInverse( const double A[3][3], unsigned int dimension,
+  double inverse[3][3] )
+{
+  const double determinant = ComputeDeterminant( A, dimension );
+  if( determinant == 0.0 )
+    {
+    return false;
+    }
+  if( dimension == 2 )
+    {
+    inverse[0][0] = A[1][1] / determinant;
+    inverse[0][1] = -A[0][1] / determinant;
+    inverse[1][0] = -A[1][0] / determinant;
+    inverse[1][1] = A[0][0] / determinant;
+    return true;
+    }
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    const unsigned int i1 = ( i + 1 ) % 3;
+    const unsigned int i2 = ( i + 2 ) % 3;
+    for( unsigned int j = 0; j < 3; j++ )
+      {
+      const unsigned int j1 = ( j + 1 ) % 3;
+      const unsigned int j2 = ( j + 2 ) % 3;
+      // Cyclic cofactor of A[j][i], which already carries its sign.
+      inverse[i][j] = ( A[j1][i1] * A[j2][i2] - A[j1][i2] * A[j2][i1] )
+        / determinant;
+      }
+    }
+  return true;
+}
+
+template<class TDisplacementField, class TMaskImage>
+void
+DeformationGradientCalculator<TDisplacementField, TMaskImage>
+::ComputeSymmetricEigenSystem( const double A[3][3], unsigned int dimension,
+  double eigenvalues[3], double eigenvectors[3][3] )
+{
+  if( dimension == 2 )
+    {
+    const double mean = 0.5 * ( A[0][0] + A[1][1] );
+    const double difference = 0.5 * ( A[0][0] - A[1][1] );
+    const double radius = vcl_sqrt( difference * difference + A[0][1] * A[0][1] );
+    const double angle = 0.5 * vcl_atan2( 2.0 * A[0][1], A[0][0] - A[1][1] );
+
+    eigenvalues[0] = mean - radius;
+    eigenvalues[1] = mean + radius;
+    eigenvectors[0][1] = vcl_cos( angle );
+    eigenvectors[1][1] = vcl_sin( angle );
+    eigenvectors[0][0] = -eigenvectors[1][1];
+    eigenvectors[1][0] = eigenvectors[0][1];
+    return;
+    }
+
+  // Scale to avoid over- and underflow in the cubic.
+  double scale = 0.0;
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    for( unsigned int j = i; j < 3; j++ )
+      {
+      scale = std::max( scale, vnl_math_abs( A[i][j] ) );
+      }
+    }
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    for( unsigned int j = 0; j < 3; j++ )
+      {
+      eigenvectors[i][j] = ( i == j ) ? 1.0 : 0.0;
+      }
+    }
+
+  double B[3][3];
+  const double offDiagonal = A[0][1] * A[0][1] + A[0][2] * A[0][2]
+    + A[1][2] * A[1][2];
+  if( scale == 0.0 || offDiagonal == 0.0 )
+    {
+    unsigned int order[3] = { 0, 1, 2 };
+    for( unsigned int i = 0; i < 3; i++ )
+      {
+      for( unsigned int j = i + 1; j < 3; j++ )
+        {
+        if( A[order[j]][order[j]] < A[order[i]][order[i]] )
+          {
+          std::swap( order[i], order[j] );
+          }
+        }
+      }
+    for( unsigned int i = 0; i < 3; i++ )
+      {
+      eigenvalues[i] = A[order[i]][order[i]];
+      for( unsigned int j = 0; j < 3; j++ )
+        {
+        eigenvectors[j][i] = ( j == order[i] ) ? 1.0 : 0.0;
+        }
+      }
+    return;
+    }
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    for( unsigned int j = 0; j < 3; j++ )
+      {
+      B[i][j] = A[i][j] / scale;
+      }
+    }
+
+  // Trigonometric solution of the characteristic cubic.
+  const double q = ( B[0][0] + B[1][1] + B[2][2] ) / 3.0;
+  const double p = vcl_sqrt( ( vnl_math_sqr( B[0][0] - q )
+    + vnl_math_sqr( B[1][1] - q ) + vnl_math_sqr( B[2][2] - q )
+    + 2.0 * offDiagonal / ( scale * scale ) ) / 6.0 );
+  double C[3][3];
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    for( unsigned int j = 0; j < 3; j++ )
+      {
+      C[i][j] = ( B[i][j] - ( ( i == j ) ? q : 0.0 ) ) / p;
+      }
+    }
+  const double r = std::max( -1.0, std::min( 1.0,
+    0.5 * ComputeDeterminant( C, 3 ) ) );
+  const double phi = vcl_acos( r ) / 3.0;
+  const double largest = q + 2.0 * p * vcl_cos( phi );
+  const double smallest = q + 2.0 * p * vcl_cos( phi + 2.0 * vnl_math::pi / 3.0 );
+  const double middle = 3.0 * q - largest - smallest;
+
+  // The eigenvector of the eigenvalue farthest from the middle one is the
+  // cross product of two rows of B - lambda I.  The other two follow from
+  // the 2x2 problem in the plane orthogonal to it.
+  const bool firstIsLargest = ( largest - middle >= middle - smallest );
+  const double lambda = firstIsLargest ? largest : smallest;
+
+  double v[3] = { 1.0, 0.0, 0.0 };
+  double bestNorm = 0.0;
+  for( unsigned int a = 0; a < 3; a++ )
+    {
+    for( unsigned int b = a + 1; b < 3; b++ )
+      {
+      double ra[3], rb[3];
+      for( unsigned int j = 0; j < 3; j++ )
+        {
+        ra[j] = B[a][j] - ( ( a == j ) ? lambda : 0.0 );
+        rb[j] = B[b][j] - ( ( b == j ) ? lambda : 0.0 );
+        }
+      const double c[3] = { ra[1] * rb[2] - ra[2] * rb[1],
+        ra[2] * rb[0] - ra[0] * rb[2], ra[0] * rb[1] - ra[1] * rb[0] };
+      const double norm = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+      if( norm > bestNorm )
+        {
+        bestNorm = norm;
+        std::copy( c, c + 3, v );
+        }
+      }
+    }
+  bestNorm = vcl_sqrt( bestNorm );
+  if( bestNorm > 0.0 )
+    {
+    for( unsigned int j = 0; j < 3; j++ )
+      {
+      v[j] /= bestNorm;
+      }
+    }
+
+  double u[3];
+  if( vnl_math_abs( v[0] ) > vnl_math_abs( v[1] ) )
+    {
+    const double norm = vcl_sqrt( v[0] * v[0] + v[2] * v[2] );
+    u[0] = -v[2] / norm;
+    u[1] = 0.0;
+    u[2] = v[0] / norm;
+    }
+  else
+    {
+    const double norm = vcl_sqrt( v[1] * v[1] + v[2] * v[2] );
+    u[0] = 0.0;
+    u[1] = v[2] / norm;
+    u[2] = -v[1] / norm;
+    }
+  const double w[3] = { v[1] * u[2] - v[2] * u[1],
+    v[2] * u[0] - v[0] * u[2], v[0] * u[1] - v[1] * u[0] };
+
+  double Bu[3], Bw[3];
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    Bu[i] = B[i][0] * u[0] + B[i][1] * u[1] + B[i][2] * u[2];
+    Bw[i] = B[i][0] * w[0] + B[i][1] * w[1] + B[i][2] * w[2];
+    }
+  double M[3][3];
+  M[0][0] = u[0] * Bu[0] + u[1] * Bu[1] + u[2] * Bu[2];
+  M[0][1] = M[1][0] = u[0] * Bw[0] + u[1] * Bw[1] + u[2] * Bw[2];
+  M[1][1] = w[0] * Bw[0] + w[1] * Bw[1] + w[2] * Bw[2];
+
+  double mu[3];
+  double Z[3][3];
+  ComputeSymmetricEigenSystem( M, 2, mu, Z );
+
+  const unsigned int first = firstIsLargest ? 2 : 0;
+  const unsigned int other = firstIsLargest ? 0 : 1;
+  eigenvalues[first] = lambda * scale;
+  for( unsigned int k = 0; k < 2; k++ )
+    {
+    eigenvalues[other + k] = mu[k] * scale;
+    for( unsigned int j = 0; j < 3; j++ )
+      {
+      eigenvectors[j][other + k] = Z[0][k] * u[j] + Z[1][k] * w[j];
+      }
+    }
+  for( unsigned int j = 0; j < 3; j++ )
+    {
+    eigenvectors[j][first] = v[j];
+    }
+}
+
+template<class TDisplacementField, class TMaskImage>
+void
+DeformationGradientCalculator<TDisplacementField, TMaskImage>
+::Compute()
+{
+  if( ImageDimension != 2 && ImageDimension != 3 )
+    {
+    itkExceptionMacro( "Only two and three dimensional fields are supported." );
+    }
+  if( !this->m_DisplacementField )
+    {
+    itkExceptionMacro( "The displacement field is not set." );
+    }
+  if( this->m_ComputeDirectionalStrains && !this->m_DirectionField &&
+    ( this->m_StrainComponents[0] >= ImageDimension ||
+    this->m_StrainComponents[1] >= ImageDimension ) )
+    {
+    itkExceptionMacro( "The strain components are out of range." );
+    }
+
+  const DisplacementFieldType *field = this->m_DisplacementField;
+  const RegionType region = field->GetBufferedRegion();
+
+  const OffsetValueType *offsetTable = field->GetOffsetTable();
+  for( unsigned int k = 0; k < ImageDimension; k++ )
+    {
+    this->m_Strides[k] = offsetTable[k];
+    this->m_Weights[k] = 1.0 / ( ( this->m_DifferenceScheme == FivePointDifference )
+      ? 12.0 * field->GetSpacing()[k] : 2.0 * field->GetSpacing()[k] );
+    }
+
+  // The derivative along physical axis m is sum_k D^-T[m][k] times the
+  // derivative along index axis k.
+  for( unsigned int m = 0; m < ImageDimension; m++ )
+    {
+    for( unsigned int k = 0; k < ImageDimension; k++ )
+      {
+      this->m_Direction[m][k] = ( this->m_UseImageDirection )
+        ? field->GetInverseDirection()[k][m] : ( ( m == k ) ? 1.0 : 0.0 );
+      }
+    }
+
+  this->m_JacobianDeterminantImage = NULL;
+  this->m_PrincipalStrainImages.clear();
+  this->m_LagrangianDirectionalStrainImage = NULL;
+  this->m_EulerianDirectionalStrainImage = NULL;
+
+  if( this->m_ComputeJacobianDeterminant )
+    {
+    this->m_JacobianDeterminantImage = RealImageType::New();
+    this->m_JacobianDeterminantImage->CopyInformation( field );
+    this->m_JacobianDeterminantImage->SetRegions( region );
+    this->m_JacobianDeterminantImage->Allocate();
+    }
+  if( this->m_ComputePrincipalStrains )
+    {
+    this->m_PrincipalStrainImages.resize( ImageDimension );
+    for( unsigned int n = 0; n < ImageDimension; n++ )
+      {
+      this->m_PrincipalStrainImages[n] = StrainVectorImageType::New();
+      this->m_PrincipalStrainImages[n]->CopyInformation( field );
+      this->m_PrincipalStrainImages[n]->SetRegions( region );
+      this->m_PrincipalStrainImages[n]->Allocate();
+      }
+    }
+  if( this->m_ComputeDirectionalStrains )
+    {
+    this->m_LagrangianDirectionalStrainImage = RealImageType::New();
+    this->m_LagrangianDirectionalStrainImage->CopyInformation( field );
+    this->m_LagrangianDirectionalStrainImage->SetRegions( region );
+    this->m_LagrangianDirectionalStrainImage->Allocate();
+
+    this->m_EulerianDirectionalStrainImage = RealImageType::New();
+    this->m_EulerianDirectionalStrainImage->CopyInformation( field );
+    this->m_EulerianDirectionalStrainImage->SetRegions( region );
+    this->m_EulerianDirectionalStrainImage->Allocate();
+    }
+
+  GradientThreadStruct str;
+  str.Calculator = this;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( std::min( this->m_NumberOfThreads,
+    static_cast<unsigned int>( region.GetSize()[ImageDimension - 1] ) ) );
+  threader->SetSingleMethod( this->GradientThreaderCallback, &str );
+  threader->SingleMethodExecute();
+}
+
+template<class TDisplacementField, class TMaskImage>
+ITK_THREAD_RETURN_TYPE
+DeformationGradientCalculator<TDisplacementField, TMaskImage>
+::GradientThreaderCallback( void *arg )
+{
+  MultiThreader::ThreadInfoStruct *info =
+    static_cast<MultiThreader::ThreadInfoStruct *>( arg );
+  GradientThreadStruct *str =
+    static_cast<GradientThreadStruct *>( info->UserData );
+
+  str->Calculator->ThreadedCompute( info->ThreadID, info->NumberOfThreads );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TDisplacementField, class TMaskImage>
+void
+DeformationGradientCalculator<TDisplacementField, TMaskImage>
+::ComputeDeformationGradient( const IndexType & index,
+  OffsetValueType offset, double F[3][3] ) const
+{
+  const DisplacementFieldType *field = this->m_DisplacementField;
+  const VectorType *buffer = field->GetBufferPointer();
+  const RegionType & region = field->GetBufferedRegion();
+
+  double G[ImageDimension][ImageDimension];
+  for( unsigned int k = 0; k < ImageDimension; k++ )
+    {
+    const OffsetValueType i = index[k] - region.GetIndex()[k];
+    const OffsetValueType last =
+      static_cast<OffsetValueType>( region.GetSize()[k] ) - 1;
+    const OffsetValueType stride = this->m_Strides[k];
+
+    const VectorType & xp1 =
+      buffer[offset + ( std::min( i + 1, last ) - i ) * stride];
+    const VectorType & xm1 =
+      buffer[offset + ( std::max( i - 1, OffsetValueType( 0 ) ) - i ) * stride];
+
+    if( this->m_DifferenceScheme == FivePointDifference )
+      {
+      const VectorType & xp2 =
+        buffer[offset + ( std::min( i + 2, last ) - i ) * stride];
+      const VectorType & xm2 =
+        buffer[offset + ( std::max( i - 2, OffsetValueType( 0 ) ) - i ) * stride];
+      for( unsigned int j = 0; j < ImageDimension; j++ )
+        {
+        G[k][j] = this->m_Weights[k] * ( -xp2[j] + 8.0 * xp1[j]
+          - 8.0 * xm1[j] + xm2[j] );
+        }
+      }
+    else
+      {
+      for( unsigned int j = 0; j < ImageDimension; j++ )
+        {
+        G[k][j] = this->m_Weights[k] * ( xp1[j] - xm1[j] );
+        }
+      }
+    }
+
+  for( unsigned int m = 0; m < ImageDimension; m++ )
+    {
+    for( unsigned int j = 0; j < ImageDimension; j++ )
+      {
+      double derivative = 0.0;
+      for( unsigned int k = 0; k < ImageDimension; k++ )
+        {
+        derivative += this->m_Direction[m][k] * G[k][j];
+        }
+      F[m][j] = derivative + ( ( m == j ) ? 1.0 : 0.0 );
+      }
+    }
+}
+
+template<class TDisplacementField, class TMaskImage>
+void
+DeformationGradientCalculator<TDisplacementField, TMaskImage>
+::ThreadedCompute( unsigned int threadId, unsigned int numberOfThreads )
+{
+  const DisplacementFieldType *field = this->m_DisplacementField;
+  const RegionType & region = field->GetBufferedRegion();
+
+  const unsigned long numberOfSlices = region.GetSize()[ImageDimension - 1];
+  const unsigned long begin = numberOfSlices * threadId / numberOfThreads;
+  const unsigned long end = numberOfSlices * ( threadId + 1 ) / numberOfThreads;
+  if( begin == end )
+    {
+    return;
+    }
+
+  RegionType threadRegion = region;
+  threadRegion.SetIndex( ImageDimension - 1,
+    region.GetIndex()[ImageDimension - 1] + begin );
+  threadRegion.SetSize( ImageDimension - 1, end - begin );
+
+  RealType *jacobian = ( this->m_JacobianDeterminantImage )
+    ? this->m_JacobianDeterminantImage->GetBufferPointer() : NULL;
+  RealType *lagrangian = ( this->m_LagrangianDirectionalStrainImage )
+    ? this->m_LagrangianDirectionalStrainImage->GetBufferPointer() : NULL;
+  RealType *eulerian = ( this->m_EulerianDirectionalStrainImage )
+    ? this->m_EulerianDirectionalStrainImage->GetBufferPointer() : NULL;
+  std::vector<StrainVectorType *> principal;
+  for( unsigned int n = 0; n < this->m_PrincipalStrainImages.size(); n++ )
+    {
+    principal.push_back( this->m_PrincipalStrainImages[n]->GetBufferPointer() );
+    }
+
+  const MaskImageType *mask = this->m_MaskImage;
+  const DisplacementFieldType *directions = this->m_DirectionField;
+
+  StrainVectorType zero;
+  zero.Fill( 0.0 );
+
+  ImageRegionConstIteratorWithIndex<DisplacementFieldType> It( field,
+    threadRegion );
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    const IndexType index = It.GetIndex();
+    const OffsetValueType offset = field->ComputeOffset( index );
+
+    if( mask &&
+      mask->GetBufferPointer()[mask->ComputeOffset( index )] == 0 )
+      {
+      if( jacobian )
+        {
+        jacobian[offset] = 0.0;
+        }
+      for( unsigned int n = 0; n < principal.size(); n++ )
+        {
+        principal[n][offset] = zero;
+        }
+      if( lagrangian )
+        {
+        lagrangian[offset] = 0.0;
+        eulerian[offset] = 0.0;
+        }
+      continue;
+      }
+
+    double F[3][3];
+    this->ComputeDeformationGradient( index, offset, F );
+
+    if( jacobian )
+      {
+      const double determinant = ComputeDeterminant( F, ImageDimension );
+      if( !this->m_UseLogJacobianDeterminant )
+        {
+        jacobian[offset] = static_cast<RealType>( determinant );
+        }
+      else
+        {
+        jacobian[offset] = ( determinant > 0.0 )
+          ? static_cast<RealType>( vcl_log( determinant ) )
+          : NumericTraits<RealType>::max();
+        }
+      }
+
+    if( principal.empty() && !lagrangian )
+      {
+      continue;
+      }
+
+    double E[3][3];
+    for( unsigned int a = 0; a < ImageDimension; a++ )
+      {
+      for( unsigned int b = 0; b < ImageDimension; b++ )
+        {
+        double sum = 0.0;
+        for( unsigned int i = 0; i < ImageDimension; i++ )
+          {
+          sum += F[i][a] * F[i][b];
+          }
+        E[a][b] = 0.5 * ( sum - ( ( a == b ) ? 1.0 : 0.0 ) );
+        }
+      }
+
+    if( !principal.empty() )
+      {
+      double eigenvalues[3];
+      double eigenvectors[3][3];
+      ComputeSymmetricEigenSystem( E, ImageDimension, eigenvalues,
+        eigenvectors );
+      for( unsigned int n = 0; n < ImageDimension; n++ )
+        {
+        const unsigned int e = ImageDimension - 1 - n;
+        StrainVectorType & strain = principal[n][offset];
+        for( unsigned int i = 0; i < ImageDimension; i++ )
+          {
+          strain[i] = static_cast<RealType>(
+            eigenvalues[e] * eigenvectors[i][e] );
+          }
+        }
+      }
+
+    if( lagrangian )
+      {
+      double C[3][3];
+      for( unsigned int a = 0; a < ImageDimension; a++ )
+        {
+        for( unsigned int b = 0; b < ImageDimension; b++ )
+          {
+          double sum = 0.0;
+          for( unsigned int j = 0; j < ImageDimension; j++ )
+            {
+            sum += F[a][j] * F[b][j];
+            }
+          C[a][b] = sum;
+          }
+        }
+      double Cinverse[3][3];
+      const bool isInvertible = ComputeInverse( C, ImageDimension, Cinverse );
+
+      double Ee[3][3];
+      for( unsigned int a = 0; a < ImageDimension; a++ )
+        {
+        for( unsigned int b = 0; b < ImageDimension; b++ )
+          {
+          Ee[a][b] = ( isInvertible ) ? 0.5 * ( ( ( a == b ) ? 1.0 : 0.0 )
+            - Cinverse[a][b] ) : 0.0;
+          }
+        }
+
+      double l = 0.0;
+      double e = 0.0;
+      if( directions )
+        {
+        const VectorType & v =
+          directions->GetBufferPointer()[directions->ComputeOffset( index )];
+        for( unsigned int a = 0; a < ImageDimension; a++ )
+          {
+          for( unsigned int b = 0; b < ImageDimension; b++ )
+            {
+            l += v[a] * E[a][b] * v[b];
+            e += v[a] * Ee[a][b] * v[b];
+            }
+          }
+        }
+      else
+        {
+        l = E[this->m_StrainComponents[0]][this->m_StrainComponents[1]];
+        e = Ee[this->m_StrainComponents[0]][this->m_StrainComponents[1]];
+        }
+      lagrangian[offset] = static_cast<RealType>( l );
+      eulerian[offset] = static_cast<RealType>( e );
+      }
+    }
+}
+
+template<class TDisplacementField, class TMaskImage>
+void
+DeformationGradientCalculator<TDisplacementField, TMaskImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Difference scheme: "
+     << ( ( this->m_DifferenceScheme == FivePointDifference )
+     ? "five point" : "central" ) << std::endl;
+  os << indent << "Use image direction: " << this->m_UseImageDirection
+     << std::endl;
+  os << indent << "Compute Jacobian determinant: "
+     << this->m_ComputeJacobianDeterminant << std::endl;
+  os << indent << "Use log Jacobian determinant: "
+     << this->m_UseLogJacobianDeterminant << std::endl;
+  os << indent << "Compute principal strains: "
+     << this->m_ComputePrincipalStrains << std::endl;
+  os << indent << "Compute directional strains: "
+     << this->m_ComputeDirectionalStrains << std::endl;
+  os << indent << "Strain components: " << this->m_StrainComponents[0]
+     << ", " << this->m_StrainComponents[1] << std::endl;
+  os << indent << "Number of threads: " << this->m_NumberOfThreads << std::endl;
+}
+
+} // end namespace itk
+
+#endif
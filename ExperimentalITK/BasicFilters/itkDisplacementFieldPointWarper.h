@@ -0,0 +1,162 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkDisplacementFieldPointWarper_h
+#define __itkDisplacementFieldPointWarper_h
+
+#include "itkMatrixOffsetTransformBase.h"
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+#include "itkPoint.h"
+
+#include <vector>
+
+namespace itk
+{
+/** \class DisplacementFieldPointWarper
+ * \brief Warps a large number of points through a chain of displacement
+ * fields and affine transforms.
+ *
+ * The stages are applied in the order in which they are added.  An affine
+ * stage maps x to A x + t.  A displacement field stage maps x to
+ * x + u( x ), with u linearly interpolated as by
+ * VectorLinearInterpolateImageFunction.  A point is inside a field if
+ * VectorLinearInterpolateImageFunction::IsInsideBuffer would accept it, i.e.
+ * if its continuous index is within half a voxel of the buffered region.
+ * Points that leave any field are flagged and not warped further.
+ *
+ * The physical-to-index matrix, the buffer strides and the bounds of every
+ * field are computed once per Warp() call.  The points are split among
+ * threads and each thread processes its points in batches of BatchSize:
+ * stage by stage, all continuous indices of the batch are computed with
+ * one matrix product per point, then the field is sampled for the whole
+ * batch.  The fields must stay unchanged while Warp() runs.
+ */
+template<class TDisplacementField>
+class ITK_EXPORT DisplacementFieldPointWarper : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef DisplacementFieldPointWarper                   Self;
+  typedef Object                                         Superclass;
+  typedef SmartPointer<Self>                             Pointer;
+  typedef SmartPointer<const Self>                       ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( DisplacementFieldPointWarper, Object );
+
+  itkStaticConstMacro( Dimension, unsigned int,
+                       TDisplacementField::ImageDimension );
+
+  typedef TDisplacementField                             DisplacementFieldType;
+  typedef typename DisplacementFieldType::PixelType      VectorType;
+
+  typedef MatrixOffsetTransformBase<double, Dimension, Dimension>
+                                                         AffineTransformType;
+
+  typedef Point<double, Dimension>                       PointType;
+  typedef std::vector<PointType>                         PointContainerType;
+  typedef std::vector<char>                              InsideContainerType;
+
+  /** Appends a displacement field to the chain. */
+  void AddDisplacementField( const DisplacementFieldType *field );
+
+  /** Appends an affine transform to the chain. */
+  void AddAffineTransform( const AffineTransformType *transform );
+
+  void ClearStages()
+    {
+    this->m_Stages.clear();
+    this->m_Fields.clear();
+    this->Modified();
+    }
+
+  unsigned int GetNumberOfStages() const
+    {
+    return this->m_Stages.size();
+    }
+
+  itkSetClampMacro( NumberOfThreads, unsigned int, 1,
+    NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( NumberOfThreads, unsigned int );
+
+  /** Default is 4096. */
+  itkSetClampMacro( BatchSize, unsigned int, 1,
+    NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( BatchSize, unsigned int );
+
+  /** Warps the points.  isInside[n] is zero if point n left a field, in
+   * which case output[n] is where it left. */
+  void Warp( const PointContainerType & input, PointContainerType & output,
+    InsideContainerType & isInside );
+
+protected:
+  DisplacementFieldPointWarper();
+  ~DisplacementFieldPointWarper() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  DisplacementFieldPointWarper( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  /** One stage of the chain.  For an affine stage, Matrix and Offset map a
+   * point to its image; for a field stage, they map a point to its
+   * continuous index relative to the start of the buffer. */
+  struct StageType
+    {
+    bool                       IsField;
+    double                     Matrix[Dimension][Dimension];
+    double                     Offset[Dimension];
+    const VectorType          *Buffer;
+    OffsetValueType            Strides[Dimension];
+    double                     Upper[Dimension];
+    long                       Last[Dimension];
+    };
+
+  struct WarpThreadStruct
+    {
+    DisplacementFieldPointWarper *Warper;
+    const PointContainerType     *Input;
+    PointContainerType           *Output;
+    InsideContainerType          *IsInside;
+    };
+
+  static ITK_THREAD_RETURN_TYPE WarpThreaderCallback( void *arg );
+
+  void ThreadedWarp( const WarpThreadStruct &, unsigned int threadId,
+    unsigned int numberOfThreads );
+
+  void InitializeFieldStage( const DisplacementFieldType *, StageType & ) const;
+
+  std::vector<StageType>                               m_Stages;
+  std::vector<typename DisplacementFieldType::ConstPointer>
+                                                       m_Fields;
+
+  unsigned int                                         m_NumberOfThreads;
+  unsigned int                                         m_BatchSize;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkDisplacementFieldPointWarper.hxx"
+#endif
+
+#endif
@@ -0,0 +1,315 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkDisplacementFieldPointWarper_hxx
+#define __itkDisplacementFieldPointWarper_hxx
+
+#include "itkDisplacementFieldPointWarper.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+
+template<class TDisplacementField>
+DisplacementFieldPointWarper<TDisplacementField>
+::DisplacementFieldPointWarper()
+{
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->m_BatchSize = 4096;
+}
+
+template<class TDisplacementField>
+void
+DisplacementFieldPointWarper<TDisplacementField>
+::AddDisplacementField( const DisplacementFieldType *field )
+{
+  if( !field )
+    {
+    itkExceptionMacro( "The displacement field is NULL." );
+    }
+  StageType stage;
+  stage.IsField = true;
+  this->m_Stages.push_back( stage );
+  this->m_Fields.push_back( field );
+  this->Modified();
+}
+
+template<class TDisplacementField>
+void
+DisplacementFieldPointWarper<TDisplacementField>
+::AddAffineTransform( const AffineTransformType *transform )
+{
+  if( !transform )
+    {
+    itkExceptionMacro( "The transform is NULL." );
+    }
+  StageType stage;
+  stage.IsField = false;
+  stage.Buffer = NULL;
+  for( unsigned int i = 0; i < Dimension; i++ )
+    {
+    for( unsigned int j = 0; j < Dimension; j++ )
+      {
+      stage.Matrix[i][j] = transform->GetMatrix()[i][j];
+      }
+    stage.Offset[i] = transform->GetOffset()[i];
+    }
+  this->m_Stages.push_back( stage );
+  this->m_Fields.push_back( NULL );
+  this->Modified();
+}
+
+template<class TDisplacementField>
+void
+DisplacementFieldPointWarper<TDisplacementField>
+::InitializeFieldStage( const DisplacementFieldType *field,
+  StageType & stage ) const
+{
+  const typename DisplacementFieldType::RegionType & region =
+    field->GetBufferedRegion();
+
+  // c = S^-1 D^-1 ( x - origin ) - start, as a matrix and an offset.
+  for( unsigned int i = 0; i < Dimension; i++ )
+    {
+    stage.Offset[i] = -static_cast<double>( region.GetIndex()[i] );
+    for( unsigned int j = 0; j < Dimension; j++ )
+      {
+      stage.Matrix[i][j] = field->GetInverseDirection()[i][j]
+        / field->GetSpacing()[i];
+      stage.Offset[i] -= stage.Matrix[i][j] * field->GetOrigin()[j];
+      }
+    stage.Strides[i] = field->GetOffsetTable()[i];
+    stage.Last[i] = static_cast<long>( region.GetSize()[i] ) - 1;
+    stage.Upper[i] = static_cast<double>( region.GetSize()[i] ) - 0.5;
+    }
+  stage.Buffer = field->GetBufferPointer();
+}
+
+template<class TDisplacementField>
+void
+DisplacementFieldPointWarper<TDisplacementField>
+::Warp( const PointContainerType & input, PointContainerType & output,
+  InsideContainerType & isInside )
+{
+  for( unsigned int s = 0; s < this->m_Stages.size(); s++ )
+    {
+    if( this->m_Stages[s].IsField )
+      {
+      this->InitializeFieldStage( this->m_Fields[s], this->m_Stages[s] );
+      }
+    }
+
+  output.resize( input.size() );
+  isInside.assign( input.size(), 1 );
+  if( input.empty() )
+    {
+    return;
+    }
+
+  WarpThreadStruct str;
+  str.Warper = this;
+  str.Input = &input;
+  str.Output = &output;
+  str.IsInside = &isInside;
+
+  const unsigned long numberOfBatches =
+    ( input.size() + this->m_BatchSize - 1 ) / this->m_BatchSize;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( static_cast<unsigned int>( std::min(
+    static_cast<unsigned long>( this->m_NumberOfThreads ), numberOfBatches ) ) );
+  threader->SetSingleMethod( this->WarpThreaderCallback, &str );
+  threader->SingleMethodExecute();
+}
+
+template<class TDisplacementField>
+ITK_THREAD_RETURN_TYPE
+DisplacementFieldPointWarper<TDisplacementField>
+::WarpThreaderCallback( void *arg )
+{
+  MultiThreader::ThreadInfoStruct *info =
+    static_cast<MultiThreader::ThreadInfoStruct *>( arg );
+  WarpThreadStruct *str = static_cast<WarpThreadStruct *>( info->UserData );
+
+  str->Warper->ThreadedWarp( *str, info->ThreadID, info->NumberOfThreads );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TDisplacementField>
+void
+DisplacementFieldPointWarper<TDisplacementField>
+::ThreadedWarp( const WarpThreadStruct & str, unsigned int threadId,
+  unsigned int numberOfThreads )
+{
+  const PointContainerType & input = *str.Input;
+  PointContainerType & output = *str.Output;
+  InsideContainerType & isInside = *str.IsInside;
+
+  const unsigned long numberOfPoints = input.size();
+  const unsigned long begin = numberOfPoints * threadId / numberOfThreads;
+  const unsigned long end = numberOfPoints * ( threadId + 1 ) / numberOfThreads;
+
+  const unsigned int numberOfCorners = 1u << Dimension;
+
+  // Points and continuous indices of one batch, point-major.
+  std::vector<double> x( this->m_BatchSize * Dimension );
+  std::vector<double> c( this->m_BatchSize * Dimension );
+
+  for( unsigned long batchBegin = begin; batchBegin < end;
+    batchBegin += this->m_BatchSize )
+    {
+    const unsigned long batchSize = std::min(
+      static_cast<unsigned long>( this->m_BatchSize ), end - batchBegin );
+    char *inside = &isInside[batchBegin];
+
+    for( unsigned long n = 0; n < batchSize; n++ )
+      {
+      for( unsigned int d = 0; d < Dimension; d++ )
+        {
+        x[n * Dimension + d] = input[batchBegin + n][d];
+        }
+      }
+
+    for( unsigned int s = 0; s < this->m_Stages.size(); s++ )
+      {
+      const StageType & stage = this->m_Stages[s];
+
+      // One matrix product per point: the image of the point for an
+      // affine stage, its continuous index for a field stage.
+      for( unsigned long n = 0; n < batchSize; n++ )
+        {
+        const double *p = &x[n * Dimension];
+        double *q = &c[n * Dimension];
+        for( unsigned int i = 0; i < Dimension; i++ )
+          {
+          double value = stage.Offset[i];
+          for( unsigned int j = 0; j < Dimension; j++ )
+            {
+            value += stage.Matrix[i][j] * p[j];
+            }
+          q[i] = value;
+          }
+        }
+
+      if( !stage.IsField )
+        {
+        for( unsigned long n = 0; n < batchSize; n++ )
+          {
+          if( inside[n] )
+            {
+            std::copy( &c[n * Dimension], &c[n * Dimension] + Dimension,
+              &x[n * Dimension] );
+            }
+          }
+        continue;
+        }
+
+      for( unsigned long n = 0; n < batchSize; n++ )
+        {
+        if( !inside[n] )
+          {
+          continue;
+          }
+        const double *q = &c[n * Dimension];
+
+        OffsetValueType lower[Dimension];
+        OffsetValueType upper[Dimension];
+        double fraction[Dimension];
+        bool isInBuffer = true;
+        for( unsigned int d = 0; d < Dimension; d++ )
+          {
+          if( q[d] < -0.5 || q[d] >= stage.Upper[d] )
+            {
+            isInBuffer = false;
+            break;
+            }
+          const double base = std::floor( q[d] );
+          fraction[d] = q[d] - base;
+          const long b = static_cast<long>( base );
+          lower[d] = std::max( b, 0L ) * stage.Strides[d];
+          upper[d] = std::min( b + 1, stage.Last[d] ) * stage.Strides[d];
+          }
+        if( !isInBuffer )
+          {
+          inside[n] = 0;
+          continue;
+          }
+
+        double displacement[Dimension];
+        std::fill( displacement, displacement + Dimension, 0.0 );
+        for( unsigned int corner = 0; corner < numberOfCorners; corner++ )
+          {
+          OffsetValueType offset = 0;
+          double weight = 1.0;
+          for( unsigned int d = 0; d < Dimension; d++ )
+            {
+            if( corner & ( 1u << d ) )
+              {
+              offset += upper[d];
+              weight *= fraction[d];
+              }
+            else
+              {
+              offset += lower[d];
+              weight *= 1.0 - fraction[d];
+              }
+            }
+          if( weight == 0.0 )
+            {
+            continue;
+            }
+          const VectorType & value = stage.Buffer[offset];
+          for( unsigned int d = 0; d < Dimension; d++ )
+            {
+            displacement[d] += weight * value[d];
+            }
+          }
+        for( unsigned int d = 0; d < Dimension; d++ )
+          {
+          x[n * Dimension + d] += displacement[d];
+          }
+        }
+      }
+
+    for( unsigned long n = 0; n < batchSize; n++ )
+      {
+      for( unsigned int d = 0; d < Dimension; d++ )
+        {
+        output[batchBegin + n][d] = x[n * Dimension + d];
+        }
+      }
+    }
+}
+
+template<class TDisplacementField>
+void
+DisplacementFieldPointWarper<TDisplacementField>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Number of stages: " << this->m_Stages.size() << std::endl;
+  os << indent << "Number of threads: " << this->m_NumberOfThreads << std::endl;
+  os << indent << "Batch size: " << this->m_BatchSize << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -21,6 +21,12 @@
 
 #include "itkFixedArray.h"
 #include "itkGaussianImageSource.h"
+#include "itkMatrix.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+
+#include <complex>
+#include <vector>
 
 
 namespace itk
@@ -28,6 +34,18 @@ namespace itk
 
 /** \class GaborFilterBankImageFilter.h
  * \brief Image filter.
+ *
+ * The spectrum of the input image is computed once.  The frequency response
+ * of each Gabor filter in the bank (a pair of Gaussians at +/- the
+ * fundamental frequency, rotated by the Euler angles) is evaluated
+ * analytically at every frequency sample so that no kernel image has to be
+ * generated, resampled, or transformed.  Since each response is real and
+ * even, the product with the half (Hermitian) spectrum of the input is
+ * inverted directly with a complex-to-real transform.  The inverse
+ * transforms are executed in batches of NumberOfFiltersPerBatch filters
+ * with a single reusable FFTW plan, the batches being distributed over the
+ * threads.  Only the maximum response (the output) and the index of the
+ * filter attaining it (GetMaximumResponseLabelImage()) are retained.
  */
 
 template <class TInputImage, class TOutputImage>
@@ -63,6 +81,12 @@ public:
   typedef FixedArray<unsigned int, 
     itkGetStaticConstMacro( ImageDimension )>     UnsignedIntArrayType; 
 
+  /** Parameters of a single filter of the bank stored as
+   * ( gabor spacing, theta, psi, phi ). */
+  typedef FixedArray<RealType, 4>                 GaborParametersType;
+  typedef std::vector<GaborParametersType>        GaborParametersContainerType;
+  typedef std::complex<RealType>                  ComplexType;
+
   /** Helper functions */
 
   itkSetMacro( NumberOfGaborSpacingSteps, unsigned int );
@@ -83,6 +107,30 @@ public:
   itkSetMacro( NumberOfRotationAngleSteps, UnsignedIntArrayType );
   itkGetConstMacro( NumberOfRotationAngleSteps, UnsignedIntArrayType );
 
+  /**
+   * Number of inverse transforms executed together by a single thread.
+   * Each filter in a batch requires a spectrum and a real buffer the size of
+   * the input so memory grows linearly with this value.  Default = 2.
+   */
+  itkSetClampMacro( NumberOfFiltersPerBatch, unsigned int, 1,
+    NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( NumberOfFiltersPerBatch, unsigned int );
+
+  /**
+   * Image containing, at each voxel, the index (into
+   * GetGaborParameters()) of the filter with the maximal response.
+   */
+  itkGetObjectMacro( MaximumResponseLabelImage, LabelImageType );
+
+  /**
+   * The parameters of each filter of the bank in the order in which they
+   * are labeled.  Available after the filter is updated.
+   */
+  const GaborParametersContainerType & GetGaborParameters() const
+    {
+    return this->m_GaborParameters;
+    }
+
 protected:
   GaborFilterBankImageFilter();
   virtual ~GaborFilterBankImageFilter();
@@ -94,6 +142,52 @@ private:
   GaborFilterBankImageFilter(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
 
+  typedef Matrix<RealType, itkGetStaticConstMacro( ImageDimension ),
+    itkGetStaticConstMacro( ImageDimension )>     RotationMatrixType;
+
+  struct GaborBankThreadStruct
+    {
+    GaborFilterBankImageFilter *Filter;
+    };
+
+  /** Enumerate the filter parameters of the bank. */
+  void GenerateGaborParameters();
+
+  /** Sample values as traversed by the original nested parameter loops. */
+  std::vector<RealType> GenerateParameterSamples( RealType, RealType,
+    RealType, unsigned int ) const;
+
+  /** Multiply the input spectrum by the analytic frequency response of
+   * the specified filter and store the result in the given buffer. */
+  void SynthesizeFilteredSpectrum( unsigned int, ComplexType * ) const;
+
+  /** Keep the maximum (and its filter index) of a single filtered image in
+   * the given per-thread buffers. */
+  void AccumulateMaximumResponse( const RealType *, unsigned int,
+    RealType *, typename LabelImageType::PixelType * ) const;
+
+  /** Merge the per-thread maxima of one thread into the outputs.  Called
+   * once per thread, after all of its batches. */
+  void MergeMaximumResponses( const RealType *,
+    const typename LabelImageType::PixelType * );
+
+  void ThreadedFilterBatches( int threadId, int numberOfThreads );
+
+  static ITK_THREAD_RETURN_TYPE FilterBatchesThreaderCallback( void *arg );
+
+  unsigned int                                     m_NumberOfFiltersPerBatch;
+  GaborParametersContainerType                     m_GaborParameters;
+  typename LabelImageType::Pointer                 m_MaximumResponseLabelImage;
+
+  /** Half (Hermitian) spectrum of the input, frequency coordinates of the
+   * samples along each axis, and the transform plan shared by the threads. */
+  ComplexType                                     *m_InputSpectrum;
+  std::vector<RealType>                            m_FrequencyCoordinates[ImageDimension];
+  unsigned long                                    m_NumberOfSpectrumSamples;
+  unsigned long                                    m_NumberOfPixels;
+  void                                            *m_InversePlan;
+  SimpleFastMutexLock                              m_AccumulatorMutex;
+
   unsigned int                                     m_NumberOfGaborSpacingSteps;
   RealType                                         m_GaborSpacingMinimum;
   RealType                                         m_GaborSpacingMaximum;
@@ -3,24 +3,14 @@
 
 #include "itkGaborFilterBankImageFilter.h"
 
-#include "itkBinaryThresholdImageFilter.h"
 #include "itkEuler3DTransform.h"
-#include "itkExtractImageFilter.h"
-#include "itkFFTShiftImageFilter.h"
-#include "itkFFTWComplexConjugateToRealImageFilter.h"
-#include "itkFFTWRealToComplexConjugateImageFilter.h"
-#include "itkResampleImageFilter.h"
-#include "itkVnlFFTComplexConjugateToRealImageFilter.h"
-#include "itkVnlFFTRealToComplexConjugateImageFilter.h"
-
-#include "itkBinaryMagnitudeImageFilter.h"
-#include "itkComplexToImaginaryImageFilter.h"
-#include "itkComplexToRealImageFilter.h"
-#include "itkImageFileWriter.h"
+#include "itkImageRegionConstIterator.h"
 
 #include "vnl/vnl_math.h"
 
-#define USE_FFTW
+#include <algorithm>
+
+#include "fftw3.h"
 
 namespace itk
 {
@@ -29,23 +19,103 @@ template <class TInputImage, class TOutputImage>
 GaborFilterBankImageFilter<TInputImage, TOutputImage>
 ::GaborFilterBankImageFilter()
 {
+  this->m_NumberOfFiltersPerBatch = 2;
+  this->m_MaximumResponseLabelImage = NULL;
+  this->m_InputSpectrum = NULL;
+  this->m_InversePlan = NULL;
+  this->m_NumberOfSpectrumSamples = 0;
+  this->m_NumberOfPixels = 0;
 }
 
 template <class TInputImage, class TOutputImage>
 GaborFilterBankImageFilter<TInputImage, TOutputImage>
 ::~GaborFilterBankImageFilter()
-{  
+{
+}
+
+template <class TInputImage, class TOutputImage>
+std::vector<typename GaborFilterBankImageFilter<TInputImage, TOutputImage>::RealType>
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::GenerateParameterSamples( RealType minimum, RealType maximum,
+  RealType delta, unsigned int numberOfSteps ) const
+{
+  /**
+   * Reproduce the sampling of the original nested loops exactly (including
+   * the case of a single step in which the increment is infinite).
+   */
+  std::vector<RealType> samples;
+  for ( RealType value = minimum; value <= maximum;
+    value += delta / static_cast<RealType>( numberOfSteps - 1 ) )
+    {
+    samples.push_back( value );
+    }
+  return samples;
 }
 
 template <class TInputImage, class TOutputImage>
 void
 GaborFilterBankImageFilter<TInputImage, TOutputImage>
-::GenerateData()
+::GenerateGaborParameters()
 {
+  RealType deltaGaborSpacing = vnl_math_max( static_cast<RealType>( 1.0 ),
+    this->m_GaborSpacingMaximum - this->m_GaborSpacingMinimum );
+  RealType deltaPhiSpacing = vnl_math_max( static_cast<RealType>( 1.0 ),
+    this->m_RotationAngleMaximum[2] - this->m_RotationAngleMinimum[2] );
+  RealType deltaPsiSpacing = vnl_math_max( static_cast<RealType>( 1.0 ),
+    this->m_RotationAngleMaximum[1] - this->m_RotationAngleMinimum[1] );
+  RealType deltaThetaSpacing = vnl_math_max( static_cast<RealType>( 1.0 ),
+    this->m_RotationAngleMaximum[0] - this->m_RotationAngleMinimum[0] );
+
+  std::vector<RealType> gaborSpacings = this->GenerateParameterSamples(
+    this->m_GaborSpacingMinimum, this->m_GaborSpacingMaximum,
+    deltaGaborSpacing, this->m_NumberOfGaborSpacingSteps );
+  std::vector<RealType> phis = this->GenerateParameterSamples(
+    this->m_RotationAngleMinimum[2], this->m_RotationAngleMaximum[2],
+    deltaPhiSpacing, this->m_NumberOfRotationAngleSteps[2] );
+  std::vector<RealType> psis = this->GenerateParameterSamples(
+    this->m_RotationAngleMinimum[1], this->m_RotationAngleMaximum[1],
+    deltaPsiSpacing, this->m_NumberOfRotationAngleSteps[1] );
+  std::vector<RealType> thetas = this->GenerateParameterSamples(
+    this->m_RotationAngleMinimum[0], this->m_RotationAngleMaximum[0],
+    deltaThetaSpacing, this->m_NumberOfRotationAngleSteps[0] );
+
+  this->m_GaborParameters.clear();
+  for ( unsigned int g = 0; g < gaborSpacings.size(); g++ )
+    {
+    for ( unsigned int k = 0; k < phis.size(); k++ )
+      {
+      for ( unsigned int j = 0; j < psis.size(); j++ )
+        {
+        for ( unsigned int i = 0; i < thetas.size(); i++ )
+          {
+          GaborParametersType parameters;
+          parameters[0] = gaborSpacings[g];
+          parameters[1] = thetas[i];
+          parameters[2] = psis[j];
+          parameters[3] = phis[k];
+          this->m_GaborParameters.push_back( parameters );
+          }
+        }
+      }
+    }
+}
 
+template <class TInputImage, class TOutputImage>
+void
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::GenerateData()
+{
   this->AllocateOutputs();
+  this->GetOutput()->FillBuffer(
+    static_cast<typename OutputImageType::PixelType>(
+    NumericTraits<RealType>::NonpositiveMin() ) );
 
-  this->GetOutput( NumericTraits<RealType>::NonpositiveMin() );
+  this->m_MaximumResponseLabelImage = LabelImageType::New();
+  this->m_MaximumResponseLabelImage->CopyInformation( this->GetOutput() );
+  this->m_MaximumResponseLabelImage->SetRegions(
+    this->GetOutput()->GetBufferedRegion() );
+  this->m_MaximumResponseLabelImage->Allocate();
+  this->m_MaximumResponseLabelImage->FillBuffer( 0 );
 
   /**
    * Note regarding tagging geometry:  Assume that the tagging planes are perpendicular
@@ -53,320 +123,326 @@ GaborFilterBankImageFilter<TInputImage, TOutputImage>
    * is parallel to the imaging planes.  (theta, psi, phi) are the Euler angles around
    * the x, y, and z axes, respectively.
    */
+  this->GenerateGaborParameters();
+  if ( this->m_GaborParameters.empty() )
+    {
+    return;
+    }
+
+  /**
+   * Frequency coordinates of the spectrum samples.  As before, the spacing
+   * of the frequency domain is the reciprocal of the image spacing.  The
+   * first dimension only holds the non-negative half of the spectrum.
+   */
+  typename InputImageType::RegionType region
+    = this->GetOutput()->GetBufferedRegion();
+  typename InputImageType::SizeType size = region.GetSize();
 
-  typename InputImageType::SpacingType spacing;
+  int fftwSize[ImageDimension];
+  this->m_NumberOfPixels = 1;
+  this->m_NumberOfSpectrumSamples = 1;
   for ( unsigned int i = 0; i < ImageDimension; i++ )
-    { 
-    spacing[i] = 1.0 / this->GetInput()->GetSpacing()[i];
+    {
+    RealType frequencySpacing = 1.0 / this->GetInput()->GetSpacing()[i];
+    unsigned int numberOfSamples = ( i == 0 ) ? size[0] / 2 + 1 : size[i];
+
+    this->m_FrequencyCoordinates[i].resize( numberOfSamples );
+    for ( unsigned int n = 0; n < numberOfSamples; n++ )
+      {
+      long m = ( n <= size[i] / 2 ) ? static_cast<long>( n )
+        : static_cast<long>( n ) - static_cast<long>( size[i] );
+      this->m_FrequencyCoordinates[i][n] =
+        static_cast<RealType>( m ) * frequencySpacing;
+      }
+    fftwSize[ImageDimension - i - 1] = size[i];
+    this->m_NumberOfPixels *= size[i];
+    this->m_NumberOfSpectrumSamples *= numberOfSamples;
     }
 
   /**
-   * Generate the fourier transform of the input image
+   * Generate the half spectrum of the input image once.
    */
-#ifdef USE_FFTW   
-  typedef FFTWRealToComplexConjugateImageFilter
-    <RealType, ImageDimension> FFTFilterType;
-#else
-  typedef VnlFFTRealToComplexConjugateImageFilter
-    <RealType, ImageDimension> FFTFilterType;
-#endif
-  typename FFTFilterType::Pointer fftFilter = FFTFilterType::New();
-  fftFilter->SetInput( this->GetInput() );
-  fftFilter->Update(); 
-  fftFilter->GetOutput()->SetSpacing( spacing );
+  float *inputBuffer = static_cast<float *>(
+    fftwf_malloc( sizeof( float ) * this->m_NumberOfPixels ) );
+  this->m_InputSpectrum = reinterpret_cast<ComplexType *>(
+    fftwf_malloc( sizeof( fftwf_complex ) * this->m_NumberOfSpectrumSamples ) );
+
+  fftwf_plan forwardPlan = fftwf_plan_dft_r2c( ImageDimension, fftwSize,
+    inputBuffer, reinterpret_cast<fftwf_complex *>( this->m_InputSpectrum ),
+    FFTW_ESTIMATE );
+
+  ImageRegionConstIterator<InputImageType> ItI( this->GetInput(), region );
+  unsigned long count = 0;
+  for ( ItI.GoToBegin(); !ItI.IsAtEnd(); ++ItI )
+    {
+    inputBuffer[count++] = static_cast<float>( ItI.Get() );
+    }
+  fftwf_execute( forwardPlan );
+  fftwf_destroy_plan( forwardPlan );
+  fftwf_free( inputBuffer );
+
+  /**
+   * Create the batched complex-to-real plan once.  The threads execute it
+   * on their own (identically aligned) buffers which is thread-safe in FFTW.
+   */
+  unsigned int batchSize = vnl_math_min( this->m_NumberOfFiltersPerBatch,
+    static_cast<unsigned int>( this->m_GaborParameters.size() ) );
+  fftwf_complex *planSpectrum = static_cast<fftwf_complex *>( fftwf_malloc(
+    sizeof( fftwf_complex ) * this->m_NumberOfSpectrumSamples * batchSize ) );
+  float *planResponse = static_cast<float *>( fftwf_malloc(
+    sizeof( float ) * this->m_NumberOfPixels * batchSize ) );
+  fftwf_plan inversePlan = fftwf_plan_many_dft_c2r( ImageDimension, fftwSize,
+    batchSize, planSpectrum, NULL, 1, this->m_NumberOfSpectrumSamples,
+    planResponse, NULL, 1, this->m_NumberOfPixels, FFTW_ESTIMATE );
+  fftwf_free( planSpectrum );
+  fftwf_free( planResponse );
+  this->m_InversePlan = static_cast<void *>( inversePlan );
+
+  /**
+   * Distribute the batches of the bank over the threads.
+   */
+  unsigned int numberOfBatches = static_cast<unsigned int>( vcl_ceil(
+    static_cast<RealType>( this->m_GaborParameters.size() ) /
+    static_cast<RealType>( batchSize ) ) );
+
+  GaborBankThreadStruct str;
+  str.Filter = this;
+  this->GetMultiThreader()->SetNumberOfThreads( vnl_math_min(
+    static_cast<unsigned int>( this->GetNumberOfThreads() ), numberOfBatches ) );
+  this->GetMultiThreader()->SetSingleMethod(
+    this->FilterBatchesThreaderCallback, &str );
+  this->GetMultiThreader()->SingleMethodExecute();
+
+  fftwf_destroy_plan( inversePlan );
+  this->m_InversePlan = NULL;
+  fftwf_free( this->m_InputSpectrum );
+  this->m_InputSpectrum = NULL;
+}
+
+template <class TInputImage, class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::FilterBatchesThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  GaborBankThreadStruct *str = (GaborBankThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
 
-  typedef typename FFTFilterType::OutputImageType ComplexImageType;
-  typename ComplexImageType::Pointer fft = ComplexImageType::New();
+  str->Filter->ThreadedFilterBatches( threadId, threadCount );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
 
-#ifdef USE_FFTW   
-  fft->SetSpacing( spacing );
-  fft->SetOrigin( fftFilter->GetOutput()->GetOrigin() );
-  fft->SetRegions( this->GetInput()->GetRequestedRegion() ); 
-  fft->SetDirection( this->GetInput()->GetDirection() ); 
-  fft->Allocate();
+template <class TInputImage, class TOutputImage>
+void
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::ThreadedFilterBatches( int threadId, int numberOfThreads )
+{
+  fftwf_plan inversePlan = static_cast<fftwf_plan>( this->m_InversePlan );
 
-  ImageRegionIteratorWithIndex<ComplexImageType> ItF( fft,
-    fft->GetRequestedRegion() ); 
+  unsigned int numberOfFilters = this->m_GaborParameters.size();
+  unsigned int batchSize = vnl_math_min( this->m_NumberOfFiltersPerBatch,
+    numberOfFilters );
 
-  for ( ItF.GoToBegin(); !ItF.IsAtEnd(); ++ItF )
+  fftwf_complex *spectra = static_cast<fftwf_complex *>( fftwf_malloc(
+    sizeof( fftwf_complex ) * this->m_NumberOfSpectrumSamples * batchSize ) );
+  float *responses = static_cast<float *>( fftwf_malloc(
+    sizeof( float ) * this->m_NumberOfPixels * batchSize ) );
+
+  /**
+   * Each thread reduces its own filters into private buffers so that the
+   * threads only synchronize once, when the buffers are merged.
+   */
+  std::vector<RealType> maximum( this->m_NumberOfPixels,
+    NumericTraits<RealType>::NonpositiveMin() );
+  std::vector<typename LabelImageType::PixelType> label(
+    this->m_NumberOfPixels, 0 );
+
+  for ( unsigned int first = threadId * batchSize; first < numberOfFilters;
+    first += numberOfThreads * batchSize )
     {
-    if ( ItF.GetIndex()[0] <= 0.5 * fft->GetRequestedRegion().GetSize()[0] )
+    unsigned int last = vnl_math_min( first + batchSize, numberOfFilters );
+    for ( unsigned int b = 0; b < batchSize; b++ )
       {
-      ItF.Set( fftFilter->GetOutput()->GetPixel( ItF.GetIndex() ) );  
-      } 
-    else
-      {
-      typename ComplexImageType::IndexType index;
-      for ( unsigned int i = 0; i < ImageDimension; i++ )
+      ComplexType *spectrum = reinterpret_cast<ComplexType *>( spectra )
+        + b * this->m_NumberOfSpectrumSamples;
+      if ( first + b < last )
+        {
+        this->SynthesizeFilteredSpectrum( first + b, spectrum );
+        }
+      else
         {
-        index[i] = fft->GetRequestedRegion().GetSize()[i] - ItF.GetIndex()[i];
-        } 
-      typename ComplexImageType::PixelType pixel
-        = fftFilter->GetOutput()->GetPixel( index );
-      ItF.Set( std::complex<RealType>( pixel.real(), -pixel.imag() ) ); 
+        std::fill( spectrum, spectrum + this->m_NumberOfSpectrumSamples,
+          ComplexType( 0.0, 0.0 ) );
+        }
+      }
+
+    fftwf_execute_dft_c2r( inversePlan, spectra, responses );
+
+    for ( unsigned int n = first; n < last; n++ )
+      {
+      itkDebugMacro( "Filter " << n << ": " << this->m_GaborParameters[n] );
+      this->AccumulateMaximumResponse(
+        responses + ( n - first ) * this->m_NumberOfPixels, n,
+        &maximum[0], &label[0] );
       }
     }
 
-#else
-  fft = fftFilter->GetOutput();
-#endif 
-
-  typedef FFTShiftImageFilter<ComplexImageType, ComplexImageType> ShifterType;
-  typename ShifterType::Pointer shifter = ShifterType::New();
-  shifter->SetInput( fft );
-  shifter->SetInverse( 1 );
-  shifter->Update();
-
-  
-  /** 
-   * Debug: Write magnitude image of imaginary and real parts.
-   */ 
-  /*
-  typedef ComplexToImaginaryImageFilter<ComplexImageType, RealImageType> ImaginerType;
-  typename ImaginerType::Pointer imaginer = ImaginerType::New();
-  imaginer->SetInput( shifter->GetOutput() );
-  imaginer->Update();
-
-  typedef ComplexToImaginaryImageFilter<ComplexImageType, RealImageType> RealerType;
-  typename RealerType::Pointer realer = RealerType::New();
-  realer->SetInput( shifter->GetOutput() );
-  realer->Update();
-
-  typedef BinaryMagnitudeImageFilter<RealImageType, RealImageType, RealImageType> BinarierType;
-  typename BinarierType::Pointer binarier = BinarierType::New();
-  binarier->SetInput1( imaginer->GetOutput() );
-  binarier->SetInput2( realer->GetOutput() );
-  binarier->Update();
-
-  typedef ImageFileWriter<RealImageType> WriterType;
-  typename WriterType::Pointer writer = WriterType::New();
-  writer->SetInput( binarier->GetOutput() );
-  writer->SetFileName( "FFTimage.hdr" );
-  writer->Update();
-  */  
-
-  unsigned int iteration = 0;
-
-  RealType deltaGaborSpacing = vnl_math_max( static_cast<RealType>( 1.0 ), 
-    this->m_GaborSpacingMaximum - this->m_GaborSpacingMinimum );
-  RealType deltaPhiSpacing = vnl_math_max( static_cast<RealType>( 1.0 ), 
-    this->m_RotationAngleMaximum[2] - this->m_RotationAngleMinimum[2] );
-  RealType deltaPsiSpacing = vnl_math_max( static_cast<RealType>( 1.0 ), 
-    this->m_RotationAngleMaximum[1] - this->m_RotationAngleMinimum[1] );
-  RealType deltaThetaSpacing = vnl_math_max( static_cast<RealType>( 1.0 ), 
-    this->m_RotationAngleMaximum[0] - this->m_RotationAngleMinimum[0] );
+  fftwf_free( spectra );
+  fftwf_free( responses );
+
+  this->MergeMaximumResponses( &maximum[0], &label[0] );
+}
+
+template <class TInputImage, class TOutputImage>
+void
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::SynthesizeFilteredSpectrum( unsigned int whichFilter,
+  ComplexType *spectrum ) const
+{
+  const GaborParametersType & parameters
+    = this->m_GaborParameters[whichFilter];
+  RealType gaborSpacing = parameters[0];
+
+  /**
+   * Calculate the initial parameters
+   */
+  ArrayType fundamentalFrequency;
+  ArrayType sigma;
+  fundamentalFrequency.Fill( 0.0 );
+  fundamentalFrequency[0] = gaborSpacing;
+  sigma.Fill( 2.0 / gaborSpacing );
+  sigma[0] = 1.0 / gaborSpacing;
+
+  ArrayType inverseGaussianSigma;
+  for ( unsigned int i = 0; i < ImageDimension; i++ )
+    {
+    inverseGaussianSigma[i] = 2.0 * sigma[i] * vnl_math::pi;
+    }
 
-  for ( RealType gaborSpacing = this->m_GaborSpacingMinimum; 
-        gaborSpacing <= this->m_GaborSpacingMaximum; 
-        gaborSpacing += deltaGaborSpacing 
-          / static_cast<RealType>( this->m_NumberOfGaborSpacingSteps - 1 ) 
-      )
+  /**
+   * The rotated response at frequency k is the unrotated response at R*k,
+   * i.e. what resampling the Fourier gabor image about the center of the
+   * spectrum with the Euler transform used to produce.
+   */
+  typedef Euler3DTransform<RealType> TransformType;
+  typename TransformType::Pointer transform = TransformType::New();
+  transform->SetRotation( parameters[1], parameters[2], parameters[3] );
+
+  RotationMatrixType R;
+  R.SetIdentity();
+  for ( unsigned int i = 0; i < vnl_math_min( 3u,
+    static_cast<unsigned int>( ImageDimension ) ); i++ )
     {
-    for ( RealType phi = this->m_RotationAngleMinimum[2]; 
-          phi <= this->m_RotationAngleMaximum[2]; 
-          phi += deltaPhiSpacing 
-            / static_cast<RealType>( this->m_NumberOfRotationAngleSteps[2] - 1 )  
-        )
+    for ( unsigned int j = 0; j < vnl_math_min( 3u,
+      static_cast<unsigned int>( ImageDimension ) ); j++ )
+      {
+      R[i][j] = transform->GetMatrix()[i][j];
+      }
+    }
+
+  /**
+   * Sum of the two Gaussians at +/- the fundamental frequency, i.e.
+   *   G(u) = sum_d exp( -0.5 * sum_i ( ( u_i - d * f_i ) / s_i )^2 ).
+   * The response is even so the filtered half spectrum stays Hermitian.
+   * The sign is negated as in the original frequency-space product.
+   */
+  const unsigned int n0 = this->m_FrequencyCoordinates[0].size();
+  unsigned long numberOfRows = this->m_NumberOfSpectrumSamples / n0;
+
+  RealType u[ImageDimension];
+  for ( unsigned long row = 0; row < numberOfRows; row++ )
+    {
+    RealType rowOffset[ImageDimension];
+    for ( unsigned int i = 0; i < ImageDimension; i++ )
+      {
+      rowOffset[i] = 0.0;
+      }
+    unsigned long rowIndex = row;
+    for ( unsigned int j = 1; j < ImageDimension; j++ )
       {
-      for ( RealType psi = this->m_RotationAngleMinimum[1]; 
-            psi <= this->m_RotationAngleMaximum[1]; 
-            psi += deltaPsiSpacing 
-              / static_cast<RealType>( this->m_NumberOfRotationAngleSteps[1] - 1 )  
-          )
+      unsigned int nj = this->m_FrequencyCoordinates[j].size();
+      RealType kj = this->m_FrequencyCoordinates[j][rowIndex % nj];
+      rowIndex /= nj;
+      for ( unsigned int i = 0; i < ImageDimension; i++ )
         {
-        for ( RealType theta = this->m_RotationAngleMinimum[0]; 
-              theta <= this->m_RotationAngleMaximum[0]; 
-              theta += deltaThetaSpacing 
-                / static_cast<RealType>( this->m_NumberOfRotationAngleSteps[0] - 1 )  
-            )
-          {
-          std::cout << "Iteration " << iteration << ": " << gaborSpacing << ", " << phi << ", " << psi << ", " << theta << std::endl; 
-  
-          /**
-           * Calculate the initial parameters
-           */
-  
-          ArrayType fundamentalFrequency;
-          fundamentalFrequency[0] = gaborSpacing; 
-          fundamentalFrequency[1] = 0; 
-          fundamentalFrequency[2] = 0; 
-
-          ArrayType sigma;
-          sigma[0] = 1.0 / gaborSpacing;
-          sigma[1] = sigma[2] = 2.0 * sigma[0]; 
-        
-          /**
-           * Generate the fourier transform of the gabor filter
-           */
-          typename RealImageType::Pointer fourierGaborImage 
-            = RealImageType::New();
-          fourierGaborImage->SetOrigin( this->GetInput()->GetOrigin() );
-          fourierGaborImage->SetSpacing( spacing );
-          fourierGaborImage->SetRegions( this->GetInput()->GetRequestedRegion().GetSize() );
-          fourierGaborImage->Allocate();
-          fourierGaborImage->FillBuffer( 0.0 );
-             
-          for ( RealType d = -1.0; d <= 1.01; d+=2.0 )
-            {  
-            typename FourierTransformGaborImageSourceType::Pointer 
-              fourierGabor = FourierTransformGaborImageSourceType::New();
-            fourierGabor->SetOrigin( this->GetInput()->GetOrigin() );
-            fourierGabor->SetSpacing( spacing );
-            fourierGabor->SetSize( this->GetInput()->GetRequestedRegion().GetSize() );
-          
-            typename FourierTransformGaborImageSourceType::ArrayType gaussianSigma;
-            typename FourierTransformGaborImageSourceType::ArrayType mean;
-          
-            for ( unsigned int i = 0; i < ImageDimension; i++ )
-              {
-              gaussianSigma[i] = 1.0 / ( 2.0 * sigma[i] * vnl_math::pi );
-              mean[i] = this->GetInput()->GetOrigin()[i] 
-                + 0.5 * ( this->GetInput()->GetRequestedRegion().GetSize()[i] - 1 ) 
-                      * ( spacing[i] ) + d * fundamentalFrequency[i];
-              } 
-    
-            fourierGabor->SetSigma( gaussianSigma );
-            fourierGabor->SetMean( mean );
-            fourierGabor->SetScale( 1.0 );
-            fourierGabor->SetNormalized( false );
-            fourierGabor->Update();
-            
-            ImageRegionIterator<RealImageType> It( fourierGabor->GetOutput(),
-              fourierGabor->GetOutput()->GetRequestedRegion() );
-            ImageRegionIterator<RealImageType> ItF( fourierGaborImage,
-              fourierGaborImage->GetRequestedRegion() );
-            for ( It.GoToBegin(), ItF.GoToBegin(); !It.IsAtEnd(); ++It, ++ItF )  
-              {
-              ItF.Set( ItF.Get() + It.Get() );
-              }  
-            }       
-       
-          /**
-           * Rotate the fourier transformed gabor filter
-           */
-          typedef Euler3DTransform<RealType> TransformType;
-          typename TransformType::Pointer transform = TransformType::New();
-        
-          transform->SetRotation( theta, psi, phi );
-          typename TransformType::OutputVectorType translation;
-          translation.Fill( 0 );
-          transform->SetTranslation( translation );
-          typename TransformType::InputPointType center;
-          for ( unsigned int i = 0; i < ImageDimension; i++ )
-            {
-            center[i] = this->GetInput()->GetOrigin()[i] + 0.5
-              * ( this->GetInput()->GetRequestedRegion().GetSize()[i] - 1 ) 
-              * ( spacing[i] );
-            }
-          transform->SetCenter( center );
-          
-          typedef LinearInterpolateImageFunction
-            <RealImageType, RealType> LinearInterpolatorType;
-          typename LinearInterpolatorType::Pointer interpolator 
-            = LinearInterpolatorType::New();
-          interpolator->SetInputImage( fourierGaborImage );
-        
-          typedef ResampleImageFilter
-            <RealImageType, RealImageType, RealType> ResamplerType;
-          typename ResamplerType::Pointer resampler = ResamplerType::New();
-          resampler->SetDefaultPixelValue( NumericTraits<RealType>::Zero );
-          resampler->SetTransform( transform );
-          resampler->SetInterpolator( interpolator );
-          resampler->SetInput( fourierGaborImage );
-          resampler->SetOutputSpacing( fourierGaborImage->GetSpacing() );
-          resampler->SetOutputOrigin( fourierGaborImage->GetOrigin() );
-          resampler->SetSize( 
-            fourierGaborImage->GetRequestedRegion().GetSize() );
-          resampler->Update();
-  
-          /**
-           * Multiply in frequency space
-           */
-          typename ComplexImageType::Pointer filteredImage 
-            = ComplexImageType::New();
-          filteredImage->SetRegions( 
-            resampler->GetOutput()->GetRequestedRegion() );
-          filteredImage->SetOrigin( resampler->GetOutput()->GetOrigin() );
-          filteredImage->SetSpacing( resampler->GetOutput()->GetSpacing() );
-          filteredImage->Allocate();
-        
-          ImageRegionIterator<ComplexImageType> ItS( shifter->GetOutput(), 
-            shifter->GetOutput()->GetRequestedRegion() );
-          ImageRegionIterator<RealImageType> ItG( resampler->GetOutput(), 
-            resampler->GetOutput()->GetRequestedRegion() );
-          ImageRegionIterator<ComplexImageType> It( filteredImage, 
-            filteredImage->GetRequestedRegion() );
-        
-          ItS.GoToBegin();
-          ItG.GoToBegin();
-          It.GoToBegin();
-          while ( !It.IsAtEnd()  )
-            {
-            It.Set( ItS.Get() * std::complex<RealType>( 
-              -ItG.Get(), NumericTraits<RealType>::Zero ) );     
-        
-            ++ItS;
-            ++ItG;  
-            ++It;
-            }  
-        
-          /**
-           * Generate the fourier transform of the filtered image
-           */
-        
-          typename ShifterType::Pointer inverseShifter = ShifterType::New();
-          inverseShifter->SetInput( filteredImage );
-          inverseShifter->SetInverse( 1 );
-          inverseShifter->Update();
-
-          typename ComplexImageType::Pointer ifft = ComplexImageType::New();
-
-#ifdef USE_FFTW   
-          typedef FFTWComplexConjugateToRealImageFilter
-            <RealType, ImageDimension> InverseFFTFilterType;
-
-          typedef ExtractImageFilter
-            <ComplexImageType, ComplexImageType> ExtracterType;
-          typename ExtracterType::Pointer extracter = ExtracterType::New();
-          typename ComplexImageType::RegionType region;
-          typename ComplexImageType::RegionType::SizeType size;
-          size = inverseShifter->GetOutput()->GetRequestedRegion().GetSize();
-          size[0] = static_cast<unsigned int>( 0.5 * size[0] ) + 1;
-          region.SetIndex( 
-            inverseShifter->GetOutput()->GetRequestedRegion().GetIndex() );
-          region.SetSize( size );
-          extracter->SetInput( inverseShifter->GetOutput() );
-          extracter->SetExtractionRegion( region );  
-          extracter->Update();
-
-          ifft = extracter->GetOutput();
-#else
-          typedef VnlFFTComplexConjugateToRealImageFilter
-            <RealType, ImageDimension> InverseFFTFilterType;
-          ifft = inverseShifter->GetOutput();
-#endif
-          typename InverseFFTFilterType::Pointer ifftFilter 
-            = InverseFFTFilterType::New();
-          ifftFilter->SetInput( ifft );
-          ifftFilter->Update(); 
-          ifftFilter->GetOutput()->SetSpacing( this->GetInput()->GetSpacing() );
-
-          ImageRegionIterator<RealImageType> ItI( ifftFilter->GetOutput(), 
-            ifftFilter->GetOutput()->GetRequestedRegion() );
-          ImageRegionIterator<RealImageType> ItR( this->GetOutput(), 
-            this->GetOutput()->GetRequestedRegion() );
-     
-          for ( ItI.GoToBegin(), ItR.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++ItR )
-            {
-            ItR.Set( vnl_math_max( ItI.Get(), ItR.Get() ) );
-            }  
-  
-          iteration++;
-          } 
+        rowOffset[i] += R[i][j] * kj;
+        }
+      }
+
+    const ComplexType *input = this->m_InputSpectrum + row * n0;
+    ComplexType *output = spectrum + row * n0;
+    for ( unsigned int n = 0; n < n0; n++ )
+      {
+      RealType k0 = this->m_FrequencyCoordinates[0][n];
+
+      RealType common = 0.0;
+      for ( unsigned int i = 1; i < ImageDimension; i++ )
+        {
+        u[i] = ( rowOffset[i] + R[i][0] * k0 ) * inverseGaussianSigma[i];
+        common += u[i] * u[i];
         }
+      u[0] = rowOffset[0] + R[0][0] * k0;
+
+      RealType plus = ( u[0] - fundamentalFrequency[0] ) * inverseGaussianSigma[0];
+      RealType minus = ( u[0] + fundamentalFrequency[0] ) * inverseGaussianSigma[0];
+
+      RealType response = vcl_exp( -0.5 * ( common + plus * plus ) )
+        + vcl_exp( -0.5 * ( common + minus * minus ) );
+
+      output[n] = input[n] * -response;
+      }
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::AccumulateMaximumResponse( const RealType *response,
+  unsigned int whichFilter, RealType *maximum,
+  typename LabelImageType::PixelType *label ) const
+{
+  // FFTW's inverse transform is unnormalized.
+  RealType scale = 1.0 / static_cast<RealType>( this->m_NumberOfPixels );
+
+  for ( unsigned long n = 0; n < this->m_NumberOfPixels; n++ )
+    {
+    RealType value = scale * response[n];
+    if ( value > maximum[n] ||
+      ( value == maximum[n] && whichFilter < label[n] ) )
+      {
+      maximum[n] = value;
+      label[n] = whichFilter;
       }
-    }      
+    }
+}
 
+template <class TInputImage, class TOutputImage>
+void
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::MergeMaximumResponses( const RealType *threadMaximum,
+  const typename LabelImageType::PixelType *threadLabel )
+{
+  typename OutputImageType::PixelType *maximum
+    = this->GetOutput()->GetBufferPointer();
+  typename LabelImageType::PixelType *label
+    = this->m_MaximumResponseLabelImage->GetBufferPointer();
+
+  // Ties go to the lowest filter index, whatever the order of the merges.
+  this->m_AccumulatorMutex.Lock();
+  for ( unsigned long n = 0; n < this->m_NumberOfPixels; n++ )
+    {
+    if ( threadMaximum[n] > maximum[n] ||
+      ( threadMaximum[n] == maximum[n] && threadLabel[n] < label[n] ) )
+      {
+      maximum[n] = static_cast<typename OutputImageType::PixelType>(
+        threadMaximum[n] );
+      label[n] = threadLabel[n];
+      }
+    }
+  this->m_AccumulatorMutex.Unlock();
 }
 
 /**
@@ -376,9 +452,15 @@ template <class TInputImage, class TOutputImage>
 void
 GaborFilterBankImageFilter<TInputImage, TOutputImage>
 ::PrintSelf(
-  std::ostream& os, 
+  std::ostream& os,
   Indent indent) const
 {
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Number of filters per batch: "
+     << this->m_NumberOfFiltersPerBatch << std::endl;
+  os << indent << "Number of filters: "
+     << this->m_GaborParameters.size() << std::endl;
 }
 
 
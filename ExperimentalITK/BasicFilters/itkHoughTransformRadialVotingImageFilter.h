@@ -50,11 +50,13 @@
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkDiscreteGaussianImageFilter.h"
 #include "itkGaussianDerivativeImageFunction.h"
-#include "itkMinimumMaximumImageCalculator.h"
 #include "itkCastImageFilter.h"
-#include <itkGaussianDistribution.h>
 #include "itkAddImageFilter.h"
 #include "itkImageRegionIterator.h"
+#include "itkMultiThreader.h"
+
+#include <algorithm>
+#include <vector>
 
 namespace itk
 {
@@ -75,6 +77,11 @@ namespace itk
  * point and votes on a small region defined using the minimum and maximum
  * radius given by the user, and fill in the array of radii.
  *
+ * The votes are cast in two passes over slabs of the image that are wider
+ * than the reach of a vote, so the slabs processed concurrently never touch
+ * the same accumulator voxel and no per-thread copy of the accumulator is
+ * needed.
+ *
  * \ingroup ImageFeatureExtraction
  * \todo Update the doxygen documentation!!!
  * */
@@ -125,6 +132,7 @@ public:
   typedef typename InternalImageType::SizeType        InternalSizeType;
   typedef typename InternalSizeType::SizeValueType    InternalSizeValueType;
   typedef typename InternalImageType::SpacingType     InternalSpacingType;
+  typedef typename InternalImageType::OffsetValueType InternalOffsetValueType;
 
   /** Sphere typedef */
   typedef EllipseSpatialObject< ImageDimension > SphereType;
@@ -140,9 +148,6 @@ public:
   typedef typename GaussianFilterType::Pointer
     GaussianFilterPointer;
 
-  typedef itk::Statistics::GaussianDistribution  GaussianFunctionType;
-  typedef typename GaussianFunctionType::Pointer GaussianFunctionPointer;
-
   typedef GaussianDerivativeImageFunction< InputImageType, InputCoordType >
     DoGFunctionType;
   typedef typename DoGFunctionType::Pointer
@@ -150,9 +155,6 @@ public:
   typedef typename DoGFunctionType::VectorType
     DoGVectorType;
 
-  typedef MinimumMaximumImageCalculator< InternalImageType >  MinMaxCalculatorType;
-  typedef typename MinMaxCalculatorType::Pointer              MinMaxCalculatorPointer;
-
   typedef CastImageFilter< InternalImageType, OutputImageType > CastFilterType;
   typedef typename CastFilterType::Pointer                      CastFilterPointer;
 
@@ -270,9 +272,24 @@ protected:
   bool                  m_AllSeedsProcessed;
 
 
-  /** Method for evaluating the implicit function over the image. */
+  /** Precomputed voting kernel, as buffer offsets from the voted center,
+   *  physical displacements from the center and Gaussian weights. */
+  std::vector<InternalOffsetValueType>  m_VotingOffsets;
+  std::vector<SphereVectorType>         m_VotingDisplacements;
+  std::vector<InternalPixelType>        m_VotingWeights;
+  InternalIndexType                     m_VotingRadius;
+
+  /** Width of the slabs, along the last dimension, the votes are cast in. */
+  InternalSizeValueType                 m_VotingSlabWidth;
+  InternalSizeValueType                 m_NumberOfVotingSlabs;
+
+  /** Number of voxels passing both thresholds in the slabs before each
+   *  slab, in raster order.  Only counted when SamplingRatio is below one. */
+  std::vector<SizeValueType>            m_VotingSlabCounts;
+
+  /** Casts all the votes, then the threads turn the vote sums into the
+   *  accumulator output and the mean radius image. */
   virtual void BeforeThreadedGenerateData();
-  virtual void AfterThreadedGenerateData();
   virtual void ThreadedGenerateData(const OutputImageRegionType& windowRegion,
                        ThreadIdType threadId);
 
@@ -289,11 +306,31 @@ protected:
    * \sa ProcessObject::EnlargeOutputRequestedRegion() */
   void EnlargeOutputRequestedRegion(DataObject *itkNotUsed(output));
 
-  void ComputeMeanRadiusImage( );
+private:
+  struct VotingThreadStruct
+    {
+    HoughTransformRadialVotingImageFilter *Filter;
+    unsigned int                           Phase;
+    bool                                   Count;
+    };
 
+  static ITK_THREAD_RETURN_TYPE VotingThreaderCallback( void *arg );
 
+  /** The region of the input covered by a voting slab. */
+  InputRegionType GetVotingSlab( InternalSizeValueType slab ) const;
+
+  /** Counts the voxels passing both thresholds in the slabs of a thread. */
+  void ThreadedCounting( ThreadIdType threadId, ThreadIdType numberOfThreads );
+
+  /** Casts the votes of every other slab, starting at slab \a phase. */
+  void ThreadedVoting( unsigned int phase, ThreadIdType threadId,
+    ThreadIdType numberOfThreads );
+
+  /** Maximum of a tile of the blurred accumulator and the buffer offset of
+   *  its first occurrence. */
+  void ComputeTileMaximum( const InternalImageType *, const InternalRegionType &,
+    InternalPixelType &, InternalOffsetValueType & ) const;
 
-private:
   HoughTransformRadialVotingImageFilter(const Self&) {}
   void operator=(const Self&) {}
 };
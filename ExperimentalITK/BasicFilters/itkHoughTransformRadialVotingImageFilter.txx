@@ -63,6 +63,8 @@ HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage>
   m_NumberOfSpheres = 1;
   m_OutputThreshold = 0.;
   m_SamplingRatio = 1.;
+  m_VotingSlabWidth = 1;
+  m_NumberOfVotingSlabs = 0;
 
   m_NbOfThreads        = 1;
   m_AllSeedsProcessed  = false;
@@ -130,174 +132,337 @@ HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage>
   m_RadiusImage->SetDirection( inputImage->GetDirection() );
   m_RadiusImage->Allocate();
   m_RadiusImage->FillBuffer( 0 );
+
+  // The weight of a vote only depends on its offset from the voted center,
+  // so the Gaussian kernel is evaluated once here rather than for each vote.
+
+  InputCoordType averageRadius = 0.5 * ( m_MinimumRadius + m_MaximumRadius );
+  double variance = averageRadius * averageRadius;
+  double normalization = 1.0 / vcl_sqrt( 2.0 * vnl_math::pi * variance );
+
+  unsigned int i;
+  SizeValueType numberOfVotes = 1;
+  InternalIndexType kernelIndex;
+  for ( i = 0; i < ImageDimension; i++ )
+    {
+    m_VotingRadius[i] = static_cast<InternalIndexValueType>(
+      m_VotingRadiusRatio * m_MinimumRadius/spacing[i] );
+    kernelIndex[i] = -m_VotingRadius[i];
+    numberOfVotes *= 1 + 2 * m_VotingRadius[i];
+    }
+
+  const InternalOffsetValueType *offsetTable =
+    m_AccumulatorImage->GetOffsetTable();
+
+  m_VotingOffsets.resize( numberOfVotes );
+  m_VotingDisplacements.resize( numberOfVotes );
+  m_VotingWeights.resize( numberOfVotes );
+  for ( SizeValueType n = 0; n < numberOfVotes; n++ )
+    {
+    InternalOffsetValueType offset = 0;
+    double d = 0;
+    for ( i = 0; i < ImageDimension; i++ )
+      {
+      offset += kernelIndex[i] * offsetTable[i];
+      m_VotingDisplacements[n][i] =
+        static_cast<double>( kernelIndex[i] ) * spacing[i];
+      d += vnl_math_sqr( m_VotingDisplacements[n][i] );
+      }
+    m_VotingOffsets[n] = offset;
+    m_VotingWeights[n] = normalization * vcl_exp( -0.5 * d / variance );
+
+    for ( i = 0; i < ImageDimension; i++ )
+      {
+      if ( ++kernelIndex[i] <= m_VotingRadius[i] )
+        {
+        break;
+        }
+      kernelIndex[i] = -m_VotingRadius[i];
+      }
+    }
+
+  // A voxel only votes within reach of itself along the last dimension.
+  // Slabs wider than twice that reach, cast every other one at a time, never
+  // write to the same voxel concurrently, so the votes go straight into the
+  // accumulator without locks or per-thread copies of the image.
+
+  const unsigned int splitAxis = ImageDimension - 1;
+  const InternalSizeValueType length =
+    inputImage->GetRequestedRegion().GetSize()[splitAxis];
+  const InternalSizeValueType numberOfThreads = this->GetNumberOfThreads();
+  const InternalSizeValueType reach = static_cast<InternalSizeValueType>(
+    vcl_ceil( averageRadius / spacing[splitAxis] ) + m_VotingRadius[splitAxis] );
+
+  m_VotingSlabWidth = std::max( 2 * reach + 1,
+    ( length + 2 * numberOfThreads - 1 ) / ( 2 * numberOfThreads ) );
+  m_NumberOfVotingSlabs = ( length + m_VotingSlabWidth - 1 ) / m_VotingSlabWidth;
+
+  VotingThreadStruct str;
+  str.Filter = this;
+  str.Phase = 0;
+
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->GetMultiThreader()->SetSingleMethod( this->VotingThreaderCallback, &str );
+
+  // With a SamplingRatio below one, every sampling-th voxel passing both
+  // thresholds votes, counted in raster order over the whole region.  The
+  // voxels of each slab are counted first, so that each slab starts from
+  // the count of the slabs before it and the sampled voxels do not depend
+  // on the slab layout.
+  m_VotingSlabCounts.assign( m_NumberOfVotingSlabs, 0 );
+  if ( static_cast< unsigned int >( 1. / m_SamplingRatio ) > 1 )
+    {
+    str.Count = true;
+    this->GetMultiThreader()->SingleMethodExecute();
+
+    SizeValueType total = 0;
+    for ( InternalSizeValueType slab = 0; slab < m_NumberOfVotingSlabs; slab++ )
+      {
+      const SizeValueType count = m_VotingSlabCounts[slab];
+      m_VotingSlabCounts[slab] = total;
+      total += count;
+      }
+    }
+
+  str.Count = false;
+  for ( str.Phase = 0; str.Phase < 2; str.Phase++ )
+    {
+    this->GetMultiThreader()->SingleMethodExecute();
+    }
 }
 
 template<class TInputImage, class TOutputImage>
-void
+typename HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage>::InputRegionType
 HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage>
-::AfterThreadedGenerateData()
+::GetVotingSlab( InternalSizeValueType slab ) const
 {
-  ComputeMeanRadiusImage();
+  const InputRegionType requestedRegion = this->GetInput()->GetRequestedRegion();
+  const unsigned int splitAxis = ImageDimension - 1;
 
-  // Copy the typecast m_AccumulatorImage to Output image
-  InternalIteratorType iIt( m_AccumulatorImage, this->GetOutput()->GetRequestedRegion() );
-  OutputIteratorType oIt( this->GetOutput(), this->GetOutput()->GetRequestedRegion() );
+  InputIndexType slabStart = requestedRegion.GetIndex();
+  InputSizeType slabSize = requestedRegion.GetSize();
+  slabStart[splitAxis] += slab * m_VotingSlabWidth;
+  slabSize[splitAxis] = std::min( m_VotingSlabWidth,
+    slabSize[splitAxis] - slab * m_VotingSlabWidth );
 
-  iIt.GoToBegin();
-  oIt.GoToBegin();
-  while( !iIt.IsAtEnd() )
+  return InputRegionType( slabStart, slabSize );
+}
+
+template<class TInputImage, class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage>
+::VotingThreaderCallback( void *arg )
+{
+  MultiThreader::ThreadInfoStruct *info =
+    static_cast<MultiThreader::ThreadInfoStruct *>( arg );
+  VotingThreadStruct *str = static_cast<VotingThreadStruct *>( info->UserData );
+
+  if ( str->Count )
     {
-    oIt.Set( static_cast< OutputPixelType >( iIt.Get() ) );
-    ++iIt;
-    ++oIt;
+    str->Filter->ThreadedCounting( info->ThreadID, info->NumberOfThreads );
+    }
+  else
+    {
+    str->Filter->ThreadedVoting( str->Phase, info->ThreadID,
+      info->NumberOfThreads );
     }
+
+  return ITK_THREAD_RETURN_VALUE;
 }
 
 template<class TInputImage, class TOutputImage>
 void
 HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage>::
-ThreadedGenerateData(const OutputImageRegionType& windowRegion,
-                       ThreadIdType threadId)
+ThreadedCounting( ThreadIdType threadId, ThreadIdType numberOfThreads )
+{
+  InputImageConstPointer  inputImage = this->GetInput();
 
+  DoGFunctionPointer DoGFunction = DoGFunctionType::New();
+  DoGFunction->SetInputImage( inputImage );
+  DoGFunction->SetSigma( m_SigmaGradient );
+
+  for ( InternalSizeValueType slab = threadId; slab < m_NumberOfVotingSlabs;
+    slab += numberOfThreads )
+    {
+    ImageRegionConstIteratorWithIndex< InputImageType >
+      image_it( inputImage, this->GetVotingSlab( slab ) );
+
+    SizeValueType count = 0;
+    for ( image_it.GoToBegin(); !image_it.IsAtEnd(); ++image_it )
+      {
+      if ( image_it.Get() > m_Threshold &&
+        DoGFunction->EvaluateAtIndex( image_it.GetIndex() ).GetSquaredNorm() >
+        m_GradientThreshold )
+        {
+        count++;
+        }
+      }
+    m_VotingSlabCounts[slab] = count;
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage>::
+ThreadedVoting( unsigned int phase, ThreadIdType threadId,
+  ThreadIdType numberOfThreads )
 {
   // Get the input and output pointers
   InputImageConstPointer  inputImage = this->GetInput();
   InputSpacingType spacing = inputImage->GetSpacing();
+  InputRegionType requestedRegion = inputImage->GetRequestedRegion();
 
   DoGFunctionPointer DoGFunction = DoGFunctionType::New();
   DoGFunction->SetInputImage( inputImage );
   DoGFunction->SetSigma( m_SigmaGradient );
 
-  GaussianFunctionPointer GaussianFunction = GaussianFunctionType::New();
+  InternalPixelType *accumulator = m_AccumulatorImage->GetBufferPointer();
+  InternalPixelType *radius = m_RadiusImage->GetBufferPointer();
 
   unsigned int i;
 
-  InternalRegionType region;
-  InternalIndexType start;
-  InternalSizeType size;
-
   DoGVectorType grad;
   typename DoGVectorType::ValueType norm2, inv_norm;
 
-  Index< ImageDimension > index, indexAtVote, center;
+  InputIndexType index;
+  InternalIndexType center;
+  SphereVectorType centerDisplacement;
   InputCoordType distance;
 
-  double d;
   InputCoordType averageRadius = 0.5 * ( m_MinimumRadius + m_MaximumRadius );
-  InputCoordType averageRadius2 = averageRadius * averageRadius;
 
-  InputCoordType rad;
-  double weight;
-
-  ImageRegionConstIteratorWithIndex< InputImageType >
-    image_it( inputImage, windowRegion );
-  image_it.GoToBegin();
+  const SizeValueType numberOfVotes = m_VotingWeights.size();
 
   unsigned int sampling = static_cast< unsigned int >( 1. / m_SamplingRatio );
-  unsigned int counter = 1;
 
-  while( !image_it.IsAtEnd() )
+  for ( InternalSizeValueType slab = phase + 2 * threadId;
+    slab < m_NumberOfVotingSlabs; slab += 2 * numberOfThreads )
     {
-    if( image_it.Get() > m_Threshold )
-      {
-      index = image_it.GetIndex();
-      grad = DoGFunction->EvaluateAtIndex( index );
+    ImageRegionConstIteratorWithIndex< InputImageType >
+      image_it( inputImage, this->GetVotingSlab( slab ) );
+    image_it.GoToBegin();
 
-      // if the gradient is not flat
-      norm2 = grad.GetSquaredNorm();
+    SizeValueType counter = 1 + m_VotingSlabCounts[slab];
 
-      if( norm2 > m_GradientThreshold )
+    while( !image_it.IsAtEnd() )
+      {
+      if( image_it.Get() > m_Threshold )
         {
-        if( counter % sampling == 0 )
+        index = image_it.GetIndex();
+        grad = DoGFunction->EvaluateAtIndex( index );
+
+        // if the gradient is not flat
+        norm2 = grad.GetSquaredNorm();
+
+        if( norm2 > m_GradientThreshold )
           {
-          // Normalization
-          if( norm2 != 0 )
+          if( counter % sampling == 0 )
             {
-            inv_norm = 1. / vcl_sqrt( norm2 );
-            for ( i = 0; i < ImageDimension; i++ )
+            // Normalization
+            if( norm2 != 0 )
               {
-              grad[i] *= inv_norm;
+              inv_norm = 1. / vcl_sqrt( norm2 );
+              for ( i = 0; i < ImageDimension; i++ )
+                {
+                grad[i] *= inv_norm;
+                }
               }
-            }
-
-          for ( i = 0; i < ImageDimension; i++ )
-            {
-            center[i] = index[i] - static_cast< InternalIndexValueType >(
-              averageRadius * grad[i]/spacing[i] );
-
-            rad = m_VotingRadiusRatio * m_MinimumRadius/spacing[i];
-            start[i] = center[i] - static_cast<InternalIndexValueType>( rad );
-            size[i] = 1 + 2 * static_cast<InternalSizeValueType>( rad );
-            }
 
-          region.SetSize( size );
-          region.SetIndex( start );
-
-          if ( inputImage->GetRequestedRegion().IsInside( region ) )
-            {
-            ImageRegionIteratorWithIndex< InternalImageType >
-              It1( m_AccumulatorImage, region );
-            ImageRegionIterator< InternalImageType > It2( m_RadiusImage, region );
-            It1.GoToBegin();
-            It2.GoToBegin();
+            bool isInside = true;
+            for ( i = 0; i < ImageDimension; i++ )
+              {
+              center[i] = index[i] - static_cast< InternalIndexValueType >(
+                averageRadius * grad[i]/spacing[i] );
+              centerDisplacement[i] =
+                static_cast<double>( center[i] - index[i] ) * spacing[i];
+
+              if ( center[i] - m_VotingRadius[i] < requestedRegion.GetIndex()[i] ||
+                center[i] + m_VotingRadius[i] >= requestedRegion.GetIndex()[i] +
+                static_cast<InternalIndexValueType>( requestedRegion.GetSize()[i] ) )
+                {
+                isInside = false;
+                }
+              }
 
-            while ( !It1.IsAtEnd() )
+            if ( isInside )
               {
-              indexAtVote = It1.GetIndex();
-              distance = 0;
-              d = 0;
-              for ( i = 0; i < ImageDimension; i++ )
+              const InternalOffsetValueType centerOffset =
+                m_AccumulatorImage->ComputeOffset( center );
+
+              for ( SizeValueType n = 0; n < numberOfVotes; n++ )
                 {
-                d += vnl_math_sqr(
-                  static_cast<double>( indexAtVote[i] - center[i] ) * spacing[i] );
-                distance += vnl_math_sqr(
-                  static_cast<InputCoordType>( indexAtVote[i] - index[i] ) * spacing[i] );
+                distance = 0;
+                for ( i = 0; i < ImageDimension; i++ )
+                  {
+                  distance += vnl_math_sqr(
+                    centerDisplacement[i] + m_VotingDisplacements[n][i] );
+                  }
+
+                const InternalOffsetValueType offset =
+                  centerOffset + m_VotingOffsets[n];
+                accumulator[offset] += m_VotingWeights[n];
+                radius[offset] += vcl_sqrt( distance ) * m_VotingWeights[n];
                 }
-              d = vcl_sqrt( d );
-              distance = vcl_sqrt( distance );
-
-              // Apply a normal distribution weight;
-              weight = GaussianFunction->EvaluatePDF( d, 0, averageRadius2 );
-              It1.Set( It1.Get() + weight );
-              It2.Set( It2.Get() + distance*weight );
-              ++It1;
-              ++It2;
               }
-            }
-          } // end counter
-        counter++;
-        }  // end gradient threshold
-      } // end intensity threshold
-    ++image_it;
+            } // end counter
+          counter++;
+          }  // end gradient threshold
+        } // end intensity threshold
+      ++image_it;
+      }
     }
 }
 
 template<class TInputImage, class TOutputImage>
 void
-HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage >::
-ComputeMeanRadiusImage( )
+HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage>::
+ThreadedGenerateData(const OutputImageRegionType& windowRegion,
+                       ThreadIdType itkNotUsed( threadId ) )
 {
-  InputImageConstPointer  inputImage = this->GetInput(0);
-  InputRegionType windowRegion = inputImage->GetRequestedRegion();
-
-  ImageRegionConstIterator< InternalImageType >  acc_it( m_AccumulatorImage, windowRegion );
-  ImageRegionIterator< InternalImageType >  radius_it( m_RadiusImage, windowRegion );
+  // Turn the vote sums into the mean radius and copy the typecast
+  // accumulator to the output in the same pass.
+  InternalIteratorType acc_it( m_AccumulatorImage, windowRegion );
+  InternalIteratorType radius_it( m_RadiusImage, windowRegion );
+  OutputIteratorType oIt( this->GetOutput(), windowRegion );
 
   acc_it.GoToBegin();
   radius_it.GoToBegin();
+  oIt.GoToBegin();
 
   while( !acc_it.IsAtEnd() )
     {
-    if( acc_it.Get() > 0 )
+    const InternalPixelType votes = acc_it.Get();
+    if( votes > 0 )
       {
-      radius_it.Set( radius_it.Get() / acc_it.Get() );
+      radius_it.Set( radius_it.Get() / votes );
       }
+    oIt.Set( static_cast< OutputPixelType >( votes ) );
     ++acc_it;
     ++radius_it;
+    ++oIt;
     }
 }
 
+template<class TInputImage, class TOutputImage>
+void
+HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage >::
+ComputeTileMaximum( const InternalImageType *image,
+  const InternalRegionType &tileRegion, InternalPixelType &maximum,
+  InternalOffsetValueType &offset ) const
+{
+  ImageRegionConstIterator< InternalImageType > It( image, tileRegion );
 
+  maximum = NumericTraits<InternalPixelType>::NonpositiveMin();
+  offset = image->ComputeOffset( tileRegion.GetIndex() );
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    if( It.Get() > maximum )
+      {
+      maximum = It.Get();
+      offset = image->ComputeOffset( It.GetIndex() );
+      }
+    }
+}
 
 /** Get the list of circles. This recomputes the circles */
 template<class TInputImage, class TOutputImage>
@@ -323,13 +488,12 @@ HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage>
   InternalSpacingType spacing = postProcessImage->GetSpacing();
   InternalSizeType size = postProcessImage->GetRequestedRegion().GetSize();
 
-  MinMaxCalculatorPointer minMaxCalculator = MinMaxCalculatorType::New();
-  minMaxCalculator->SetImage( postProcessImage );
-  minMaxCalculator->ComputeMaximum();
+  InternalIndexType imageStart = postProcessImage->GetBufferedRegion().GetIndex();
 
-  InternalPixelType  pmax = minMaxCalculator->GetMaximum();
+  InternalPixelType  pmax = 0;
   InternalIndexType idx;
   InternalPixelType max;
+  InternalOffsetValueType offset;
   InternalRegionType region;
   InternalIndexType start, end;
   InternalSizeType sizeOfROI;
@@ -338,12 +502,76 @@ HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage>
   unsigned int circles=0;
   unsigned int i;
 
+  // The accumulator is searched by tiles that keep their own maximum, so
+  // finding a peak only scans the tile maxima and removing a sphere only
+  // rescans the tiles it overlaps.
+  const InternalSizeValueType tileWidth = 8;
+  InternalSizeType numberOfTiles;
+  InternalIndexType firstTile, lastTile, tile;
+  SizeValueType totalNumberOfTiles = 1;
+  for ( i = 0; i < ImageDimension; i++ )
+    {
+    numberOfTiles[i] = ( size[i] + tileWidth - 1 ) / tileWidth;
+    totalNumberOfTiles *= numberOfTiles[i];
+    firstTile[i] = 0;
+    lastTile[i] = numberOfTiles[i] - 1;
+    }
+  std::vector<InternalPixelType> tileMaxima( totalNumberOfTiles );
+  std::vector<InternalOffsetValueType> tileOffsets( totalNumberOfTiles );
+
   // Find maxima
   do
     {
-    minMaxCalculator->ComputeMaximum();
-    max = minMaxCalculator->GetMaximum();
-    idx = minMaxCalculator->GetIndexOfMaximum();
+    tile = firstTile;
+    bool isTileUpdated = false;
+    while( !isTileUpdated )
+      {
+      SizeValueType tileId = 0;
+      InternalIndexType tileStart;
+      InternalSizeType tileSize;
+      for ( i = ImageDimension; i > 0; i-- )
+        {
+        tileId = tileId * numberOfTiles[i-1] + tile[i-1];
+        }
+      for ( i = 0; i < ImageDimension; i++ )
+        {
+        tileStart[i] = imageStart[i] + tile[i] * tileWidth;
+        tileSize[i] = std::min( tileWidth, size[i] - tile[i] * tileWidth );
+        }
+      this->ComputeTileMaximum( postProcessImage,
+        InternalRegionType( tileStart, tileSize ),
+        tileMaxima[tileId], tileOffsets[tileId] );
+
+      isTileUpdated = true;
+      for ( i = 0; i < ImageDimension; i++ )
+        {
+        if ( ++tile[i] <= lastTile[i] )
+          {
+          isTileUpdated = false;
+          break;
+          }
+        tile[i] = firstTile[i];
+        }
+      }
+
+    // Ties go to the first maximum in raster order.
+    max = tileMaxima[0];
+    offset = tileOffsets[0];
+    for ( SizeValueType t = 1; t < totalNumberOfTiles; t++ )
+      {
+      if ( tileMaxima[t] > max ||
+        ( tileMaxima[t] == max && tileOffsets[t] < offset ) )
+        {
+        max = tileMaxima[t];
+        offset = tileOffsets[t];
+        }
+      }
+    idx = postProcessImage->ComputeIndex( offset );
+
+    if ( circles == 0 )
+      {
+      pmax = max;
+      }
 
     if ( max < m_OutputThreshold * pmax )
       {
@@ -403,6 +631,15 @@ HoughTransformRadialVotingImageFilter< TInputImage, TOutputImage>
       ++It;
       }
 
+    for( i = 0; i < ImageDimension; i++ )
+      {
+      firstTile[i] = std::max( start[i] - imageStart[i],
+        NumericTraits<InternalIndexValueType>::Zero ) / tileWidth;
+      lastTile[i] = std::min( static_cast<InternalIndexValueType>(
+        ( end[i] - imageStart[i] ) / tileWidth ),
+        static_cast<InternalIndexValueType>( numberOfTiles[i] - 1 ) );
+      }
+
     ++circles;
     } while(circles < m_NumberOfSpheres);
 
@@ -0,0 +1,219 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkLabelSurfaceDistanceCalculator_h
+#define __itkLabelSurfaceDistanceCalculator_h
+
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+#include "itkPoint.h"
+#include "itkTimeStamp.h"
+
+#include <vector>
+
+namespace itk
+{
+/** \class LabelSurfaceDistanceCalculator
+ * \brief Computes distances between the surfaces of two label objects.
+ *
+ * The surface of an object is the set of its voxels with at least one face
+ * neighbor outside the object (or outside the image).  The physical
+ * locations of the surface voxels of each object are stored in an implicit
+ * kd-tree (the points are reordered in place so that the median of every
+ * subrange is its splitting node), and the distance from every surface
+ * voxel of one object to the closest surface voxel of the other object is
+ * found by tree traversal, multithreaded over the query points.  No
+ * distance map is computed.
+ *
+ * After Compute(), the directed and symmetric Hausdorff distances,
+ * percentile Hausdorff distances, mean surface distances and the closest
+ * pair of surface voxels are available.  HausdorffDistanceExceeds() answers
+ * a threshold query directly from the trees and stops as soon as a
+ * surface voxel farther than the threshold is found, so it does not need
+ * Compute() to have been called.
+ *
+ * Distances are measured between physical points, so the two inputs may
+ * have different geometries (or be the same image).
+ */
+template< class TInputImage >
+class ITK_EXPORT LabelSurfaceDistanceCalculator:
+  public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef LabelSurfaceDistanceCalculator Self;
+  typedef Object                         Superclass;
+  typedef SmartPointer< Self >           Pointer;
+  typedef SmartPointer< const Self >     ConstPointer;
+
+  /** Some convenient typedefs. */
+  typedef TInputImage                           InputImageType;
+  typedef typename InputImageType::ConstPointer InputImageConstPointer;
+  typedef typename InputImageType::PixelType    LabelType;
+  typedef typename InputImageType::RegionType   RegionType;
+  typedef typename InputImageType::IndexType    IndexType;
+
+  /** ImageDimension constants */
+  itkStaticConstMacro( ImageDimension, unsigned int, TInputImage::ImageDimension );
+
+  typedef double                                RealType;
+  typedef Point<RealType, ImageDimension>       PointType;
+
+  /** A surface voxel. */
+  struct SurfacePointType
+    {
+    PointType Point;
+    IndexType Index;
+    };
+  typedef std::vector<SurfacePointType>         SurfacePointContainerType;
+
+  /** Standard New method. */
+  itkNewMacro( Self );
+
+  /** Runtime information support. */
+  itkTypeMacro( LabelSurfaceDistanceCalculator, Object );
+
+  /** Set/Get the two label images. */
+  itkSetConstObjectMacro( Input1, InputImageType );
+  itkGetConstObjectMacro( Input1, InputImageType );
+  itkSetConstObjectMacro( Input2, InputImageType );
+  itkGetConstObjectMacro( Input2, InputImageType );
+
+  /** Set/Get the labels of the objects in the first and second image. */
+  itkSetMacro( Label1, LabelType );
+  itkGetConstMacro( Label1, LabelType );
+  itkSetMacro( Label2, LabelType );
+  itkGetConstMacro( Label2, LabelType );
+
+  itkSetClampMacro( NumberOfThreads, unsigned int, 1,
+    NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( NumberOfThreads, unsigned int );
+
+  /** Extracts the surfaces, builds the trees and computes the distance of
+   * every surface voxel to the other surface. */
+  void Compute();
+
+  /** True if the directed Hausdorff distance from the surface of object
+   * 'from' (0 or 1) to the other surface is greater than the threshold, or,
+   * with from = 2, if the symmetric Hausdorff distance is. */
+  bool HausdorffDistanceExceeds( RealType threshold, unsigned int from = 2 );
+
+  /** The surface voxels of object 0 or 1 (in tree order). */
+  const SurfacePointContainerType & GetSurfacePoints( unsigned int which ) const
+  {
+    return this->m_SurfacePoints[which];
+  }
+
+  /** The distance from every surface voxel of object 'from' to the other
+   * surface, in the order of GetSurfacePoints( from ). */
+  const std::vector<RealType> & GetDistances( unsigned int from ) const
+  {
+    return this->m_Distances[from];
+  }
+
+  /** The index, into GetSurfacePoints() of the other object, of the closest
+   * surface voxel of every surface voxel of object 'from'. */
+  const std::vector<unsigned long> & GetClosestPointIndices( unsigned int from ) const
+  {
+    return this->m_ClosestPointIndices[from];
+  }
+
+  RealType GetDirectedHausdorffDistance( unsigned int from ) const;
+  RealType GetHausdorffDistance() const;
+
+  /** The given percentile (in [0, 1]) of the distances from the surface
+   * of object 'from', and the larger of the two directed percentiles. */
+  RealType GetDirectedPercentileHausdorffDistance( unsigned int from,
+    RealType percentile ) const;
+  RealType GetPercentileHausdorffDistance( RealType percentile ) const;
+
+  /** The mean distance from the surface of object 'from' to the other
+   * surface, and the mean over the surface voxels of both objects. */
+  RealType GetDirectedMeanSurfaceDistance( unsigned int from ) const;
+  RealType GetMeanSurfaceDistance() const;
+
+  /** The minimum distance between the two surfaces and the indices (into
+   * GetSurfacePoints( 0 ) and GetSurfacePoints( 1 )) of the closest pair. */
+  RealType GetMinimumDistance() const;
+  void GetClosestPair( unsigned long & index1, unsigned long & index2 ) const;
+
+protected:
+  LabelSurfaceDistanceCalculator();
+  ~LabelSurfaceDistanceCalculator() {}
+  void PrintSelf( std::ostream & os, Indent indent ) const;
+
+private:
+  LabelSurfaceDistanceCalculator( const Self & ); //purposely not implemented
+  void operator=( const Self & );                 //purposely not implemented
+
+  struct SurfaceDistanceThreadStruct
+    {
+    LabelSurfaceDistanceCalculator *Calculator;
+    };
+
+  /** Orders surface points along one coordinate. */
+  struct CoordinateCompare
+    {
+    unsigned int m_Dimension;
+    bool operator()( const SurfacePointType & a, const SurfacePointType & b ) const
+      {
+      return ( a.Point[m_Dimension] < b.Point[m_Dimension] );
+      }
+    };
+
+  /** Extracts the surfaces and builds their trees if the inputs or labels
+   * changed since the last time. */
+  void UpdateTrees();
+
+  void ExtractSurface( unsigned int which );
+
+  void BuildTree( unsigned int which, unsigned long begin, unsigned long end );
+
+  /** Closest point of tree 'which' in [begin, end) to the query point,
+   * closer than sqrt( closestSquaredDistance ). */
+  void SearchClosestPoint( unsigned int which, const PointType & point,
+    unsigned long begin, unsigned long end,
+    RealType & closestSquaredDistance, unsigned long & closestIndex ) const;
+
+  /** True if a point of tree 'which' in [begin, end) lies within
+   * sqrt( squaredRadius ) of the query point. */
+  bool HasPointWithin( unsigned int which, const PointType & point,
+    unsigned long begin, unsigned long end, RealType squaredRadius ) const;
+
+  static ITK_THREAD_RETURN_TYPE ComputeDistancesThreaderCallback( void *arg );
+
+  void ThreadedComputeDistances( unsigned int, unsigned int );
+
+  InputImageConstPointer                    m_Input1;
+  InputImageConstPointer                    m_Input2;
+  LabelType                                 m_Label1;
+  LabelType                                 m_Label2;
+  unsigned int                              m_NumberOfThreads;
+
+  SurfacePointContainerType                 m_SurfacePoints[2];
+  std::vector<unsigned char>                m_SplitDimensions[2];
+  std::vector<RealType>                     m_Distances[2];
+  std::vector<unsigned long>                m_ClosestPointIndices[2];
+  TimeStamp                                 m_TreeBuildTime;
+}; // end of class
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkLabelSurfaceDistanceCalculator.hxx"
+#endif
+
+#endif
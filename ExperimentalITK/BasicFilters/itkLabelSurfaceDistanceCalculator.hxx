@@ -0,0 +1,477 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkLabelSurfaceDistanceCalculator_hxx
+#define __itkLabelSurfaceDistanceCalculator_hxx
+
+#include "itkLabelSurfaceDistanceCalculator.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+
+namespace itk
+{
+template< class TInputImage >
+LabelSurfaceDistanceCalculator< TInputImage >
+::LabelSurfaceDistanceCalculator()
+{
+  this->m_Input1 = NULL;
+  this->m_Input2 = NULL;
+  this->m_Label1 = NumericTraits<LabelType>::One;
+  this->m_Label2 = NumericTraits<LabelType>::One;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+}
+
+template< class TInputImage >
+void
+LabelSurfaceDistanceCalculator< TInputImage >
+::Compute()
+{
+  this->UpdateTrees();
+
+  for( unsigned int from = 0; from < 2; from++ )
+    {
+    this->m_Distances[from].resize( this->m_SurfacePoints[from].size() );
+    this->m_ClosestPointIndices[from].resize( this->m_SurfacePoints[from].size() );
+    }
+
+  SurfaceDistanceThreadStruct str;
+  str.Calculator = this;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( this->m_NumberOfThreads );
+  threader->SetSingleMethod( this->ComputeDistancesThreaderCallback, &str );
+  threader->SingleMethodExecute();
+}
+
+template< class TInputImage >
+void
+LabelSurfaceDistanceCalculator< TInputImage >
+::UpdateTrees()
+{
+  if( !this->m_Input1 || !this->m_Input2 )
+    {
+    itkExceptionMacro( "The two input images must be set." );
+    }
+  if( this->m_TreeBuildTime > this->GetMTime() &&
+    this->m_TreeBuildTime > this->m_Input1->GetMTime() &&
+    this->m_TreeBuildTime > this->m_Input2->GetMTime() )
+    {
+    return;
+    }
+
+  for( unsigned int which = 0; which < 2; which++ )
+    {
+    this->ExtractSurface( which );
+    if( this->m_SurfacePoints[which].empty() )
+      {
+      itkExceptionMacro( "Object " << which + 1 << " is empty." );
+      }
+    this->m_SplitDimensions[which].resize( this->m_SurfacePoints[which].size() );
+    this->BuildTree( which, 0, this->m_SurfacePoints[which].size() );
+    }
+
+  this->m_TreeBuildTime.Modified();
+}
+
+template< class TInputImage >
+void
+LabelSurfaceDistanceCalculator< TInputImage >
+::ExtractSurface( unsigned int which )
+{
+  const InputImageType *image = ( which == 0 ) ? this->m_Input1.GetPointer()
+    : this->m_Input2.GetPointer();
+  const LabelType label = ( which == 0 ) ? this->m_Label1 : this->m_Label2;
+
+  const RegionType region = image->GetBufferedRegion();
+  const typename RegionType::SizeType size = region.GetSize();
+  const typename RegionType::IndexType start = region.GetIndex();
+  const LabelType *buffer = image->GetBufferPointer();
+
+  long strides[ImageDimension];
+  long stride = 1;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    strides[d] = stride;
+    stride *= size[d];
+    }
+
+  SurfacePointContainerType & points = this->m_SurfacePoints[which];
+  points.clear();
+
+  SurfacePointType surfacePoint;
+
+  ImageRegionConstIteratorWithIndex<InputImageType> It( image, region );
+  long n = 0;
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It, ++n )
+    {
+    if( buffer[n] != label )
+      {
+      continue;
+      }
+    const IndexType index = It.GetIndex();
+
+    bool isOnSurface = false;
+    for( unsigned int d = 0; d < ImageDimension && !isOnSurface; d++ )
+      {
+      const long c = index[d] - start[d];
+      if( c == 0 || c == static_cast<long>( size[d] ) - 1 ||
+        buffer[n - strides[d]] != label || buffer[n + strides[d]] != label )
+        {
+        isOnSurface = true;
+        }
+      }
+    if( isOnSurface )
+      {
+      surfacePoint.Index = index;
+      image->TransformIndexToPhysicalPoint( index, surfacePoint.Point );
+      points.push_back( surfacePoint );
+      }
+    }
+}
+
+template< class TInputImage >
+void
+LabelSurfaceDistanceCalculator< TInputImage >
+::BuildTree( unsigned int which, unsigned long begin, unsigned long end )
+{
+  if( end <= begin + 1 )
+    {
+    if( end == begin + 1 )
+      {
+      this->m_SplitDimensions[which][begin] = 0;
+      }
+    return;
+    }
+
+  SurfacePointContainerType & points = this->m_SurfacePoints[which];
+
+  // Split along the dimension of largest extent.
+  PointType minimum = points[begin].Point;
+  PointType maximum = points[begin].Point;
+  for( unsigned long n = begin + 1; n < end; n++ )
+    {
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      minimum[d] = vnl_math_min( minimum[d], points[n].Point[d] );
+      maximum[d] = vnl_math_max( maximum[d], points[n].Point[d] );
+      }
+    }
+  CoordinateCompare compare;
+  compare.m_Dimension = 0;
+  for( unsigned int d = 1; d < ImageDimension; d++ )
+    {
+    if( maximum[d] - minimum[d] >
+      maximum[compare.m_Dimension] - minimum[compare.m_Dimension] )
+      {
+      compare.m_Dimension = d;
+      }
+    }
+
+  const unsigned long middle = begin + ( end - begin ) / 2;
+  std::nth_element( points.begin() + begin, points.begin() + middle,
+    points.begin() + end, compare );
+  this->m_SplitDimensions[which][middle] =
+    static_cast<unsigned char>( compare.m_Dimension );
+
+  this->BuildTree( which, begin, middle );
+  this->BuildTree( which, middle + 1, end );
+}
+
+template< class TInputImage >
+void
+LabelSurfaceDistanceCalculator< TInputImage >
+::SearchClosestPoint( unsigned int which, const PointType & point,
+  unsigned long begin, unsigned long end,
+  RealType & closestSquaredDistance, unsigned long & closestIndex ) const
+{
+  if( begin >= end )
+    {
+    return;
+    }
+
+  const unsigned long middle = begin + ( end - begin ) / 2;
+  const PointType & node = this->m_SurfacePoints[which][middle].Point;
+
+  const RealType squaredDistance = point.SquaredEuclideanDistanceTo( node );
+  if( squaredDistance < closestSquaredDistance )
+    {
+    closestSquaredDistance = squaredDistance;
+    closestIndex = middle;
+    }
+
+  const unsigned int d = this->m_SplitDimensions[which][middle];
+  const RealType difference = point[d] - node[d];
+  if( difference < 0.0 )
+    {
+    this->SearchClosestPoint( which, point, begin, middle,
+      closestSquaredDistance, closestIndex );
+    if( difference * difference < closestSquaredDistance )
+      {
+      this->SearchClosestPoint( which, point, middle + 1, end,
+        closestSquaredDistance, closestIndex );
+      }
+    }
+  else
+    {
+    this->SearchClosestPoint( which, point, middle + 1, end,
+      closestSquaredDistance, closestIndex );
+    if( difference * difference < closestSquaredDistance )
+      {
+      this->SearchClosestPoint( which, point, begin, middle,
+        closestSquaredDistance, closestIndex );
+      }
+    }
+}
+
+template< class TInputImage >
+bool
+LabelSurfaceDistanceCalculator< TInputImage >
+::HasPointWithin( unsigned int which, const PointType & point,
+  unsigned long begin, unsigned long end, RealType squaredRadius ) const
+{
+  if( begin >= end )
+    {
+    return false;
+    }
+
+  const unsigned long middle = begin + ( end - begin ) / 2;
+  const PointType & node = this->m_SurfacePoints[which][middle].Point;
+
+  if( point.SquaredEuclideanDistanceTo( node ) <= squaredRadius )
+    {
+    return true;
+    }
+
+  const unsigned int d = this->m_SplitDimensions[which][middle];
+  const RealType difference = point[d] - node[d];
+  const bool nearIsLeft = ( difference < 0.0 );
+  if( this->HasPointWithin( which, point, nearIsLeft ? begin : middle + 1,
+    nearIsLeft ? middle : end, squaredRadius ) )
+    {
+    return true;
+    }
+  if( difference * difference <= squaredRadius )
+    {
+    return this->HasPointWithin( which, point, nearIsLeft ? middle + 1 : begin,
+      nearIsLeft ? end : middle, squaredRadius );
+    }
+  return false;
+}
+
+template< class TInputImage >
+bool
+LabelSurfaceDistanceCalculator< TInputImage >
+::HausdorffDistanceExceeds( RealType threshold, unsigned int from )
+{
+  this->UpdateTrees();
+
+  const RealType squaredThreshold = threshold * threshold;
+  for( unsigned int f = 0; f < 2; f++ )
+    {
+    if( from != 2 && f != from )
+      {
+      continue;
+      }
+    const unsigned int to = 1 - f;
+    const SurfacePointContainerType & points = this->m_SurfacePoints[f];
+    for( unsigned long n = 0; n < points.size(); n++ )
+      {
+      if( !this->HasPointWithin( to, points[n].Point, 0,
+        this->m_SurfacePoints[to].size(), squaredThreshold ) )
+        {
+        return true;
+        }
+      }
+    }
+  return false;
+}
+
+template< class TInputImage >
+ITK_THREAD_RETURN_TYPE
+LabelSurfaceDistanceCalculator< TInputImage >
+::ComputeDistancesThreaderCallback( void *arg )
+{
+  unsigned int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  unsigned int threadCount =
+    ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  SurfaceDistanceThreadStruct *str = (SurfaceDistanceThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  str->Calculator->ThreadedComputeDistances( threadId, threadCount );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template< class TInputImage >
+void
+LabelSurfaceDistanceCalculator< TInputImage >
+::ThreadedComputeDistances( unsigned int threadId, unsigned int numberOfThreads )
+{
+  for( unsigned int from = 0; from < 2; from++ )
+    {
+    const unsigned int to = 1 - from;
+    const SurfacePointContainerType & points = this->m_SurfacePoints[from];
+    const unsigned long numberOfPoints = points.size();
+    const unsigned long begin = threadId * numberOfPoints / numberOfThreads;
+    const unsigned long end = ( threadId + 1 ) * numberOfPoints / numberOfThreads;
+
+    // Consecutive points (in tree order) are close to each other, so the
+    // distance of the previous point bounds the search of the next one.
+    unsigned long closestIndex = 0;
+    for( unsigned long n = begin; n < end; n++ )
+      {
+      RealType closestSquaredDistance = NumericTraits<RealType>::max();
+      if( n > begin )
+        {
+        closestSquaredDistance = points[n].Point.SquaredEuclideanDistanceTo(
+          this->m_SurfacePoints[to][closestIndex].Point );
+        }
+      this->SearchClosestPoint( to, points[n].Point, 0,
+        this->m_SurfacePoints[to].size(), closestSquaredDistance, closestIndex );
+
+      this->m_Distances[from][n] = vcl_sqrt( closestSquaredDistance );
+      this->m_ClosestPointIndices[from][n] = closestIndex;
+      }
+    }
+}
+
+template< class TInputImage >
+typename LabelSurfaceDistanceCalculator< TInputImage >::RealType
+LabelSurfaceDistanceCalculator< TInputImage >
+::GetDirectedHausdorffDistance( unsigned int from ) const
+{
+  const std::vector<RealType> & distances = this->m_Distances[from];
+  if( distances.empty() )
+    {
+    return NumericTraits<RealType>::Zero;
+    }
+  return *std::max_element( distances.begin(), distances.end() );
+}
+
+template< class TInputImage >
+typename LabelSurfaceDistanceCalculator< TInputImage >::RealType
+LabelSurfaceDistanceCalculator< TInputImage >
+::GetHausdorffDistance() const
+{
+  return vnl_math_max( this->GetDirectedHausdorffDistance( 0 ),
+    this->GetDirectedHausdorffDistance( 1 ) );
+}
+
+template< class TInputImage >
+typename LabelSurfaceDistanceCalculator< TInputImage >::RealType
+LabelSurfaceDistanceCalculator< TInputImage >
+::GetDirectedPercentileHausdorffDistance( unsigned int from, RealType percentile ) const
+{
+  std::vector<RealType> distances = this->m_Distances[from];
+  if( distances.empty() )
+    {
+    return NumericTraits<RealType>::Zero;
+    }
+  percentile = vnl_math_max( 0.0, vnl_math_min( 1.0, percentile ) );
+  const unsigned long k = static_cast<unsigned long>(
+    percentile * static_cast<RealType>( distances.size() - 1 ) + 0.5 );
+  std::nth_element( distances.begin(), distances.begin() + k, distances.end() );
+  return distances[k];
+}
+
+template< class TInputImage >
+typename LabelSurfaceDistanceCalculator< TInputImage >::RealType
+LabelSurfaceDistanceCalculator< TInputImage >
+::GetPercentileHausdorffDistance( RealType percentile ) const
+{
+  return vnl_math_max(
+    this->GetDirectedPercentileHausdorffDistance( 0, percentile ),
+    this->GetDirectedPercentileHausdorffDistance( 1, percentile ) );
+}
+
+template< class TInputImage >
+typename LabelSurfaceDistanceCalculator< TInputImage >::RealType
+LabelSurfaceDistanceCalculator< TInputImage >
+::GetDirectedMeanSurfaceDistance( unsigned int from ) const
+{
+  const std::vector<RealType> & distances = this->m_Distances[from];
+  if( distances.empty() )
+    {
+    return NumericTraits<RealType>::Zero;
+    }
+  RealType sum = 0.0;
+  for( unsigned long n = 0; n < distances.size(); n++ )
+    {
+    sum += distances[n];
+    }
+  return sum / static_cast<RealType>( distances.size() );
+}
+
+template< class TInputImage >
+typename LabelSurfaceDistanceCalculator< TInputImage >::RealType
+LabelSurfaceDistanceCalculator< TInputImage >
+::GetMeanSurfaceDistance() const
+{
+  const RealType n0 = this->m_Distances[0].size();
+  const RealType n1 = this->m_Distances[1].size();
+  if( n0 + n1 == 0.0 )
+    {
+    return NumericTraits<RealType>::Zero;
+    }
+  return ( n0 * this->GetDirectedMeanSurfaceDistance( 0 ) +
+    n1 * this->GetDirectedMeanSurfaceDistance( 1 ) ) / ( n0 + n1 );
+}
+
+template< class TInputImage >
+typename LabelSurfaceDistanceCalculator< TInputImage >::RealType
+LabelSurfaceDistanceCalculator< TInputImage >
+::GetMinimumDistance() const
+{
+  const std::vector<RealType> & distances = this->m_Distances[0];
+  if( distances.empty() )
+    {
+    return NumericTraits<RealType>::Zero;
+    }
+  return *std::min_element( distances.begin(), distances.end() );
+}
+
+template< class TInputImage >
+void
+LabelSurfaceDistanceCalculator< TInputImage >
+::GetClosestPair( unsigned long & index1, unsigned long & index2 ) const
+{
+  const std::vector<RealType> & distances = this->m_Distances[0];
+  index1 = std::min_element( distances.begin(), distances.end() ) -
+    distances.begin();
+  index2 = this->m_ClosestPointIndices[0][index1];
+}
+
+template< class TInputImage >
+void
+LabelSurfaceDistanceCalculator< TInputImage >
+::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Label1: " << this->m_Label1 << std::endl;
+  os << indent << "Label2: " << this->m_Label2 << std::endl;
+  os << indent << "Number of surface points: " << this->m_SurfacePoints[0].size()
+     << ", " << this->m_SurfacePoints[1].size() << std::endl;
+  os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+}
+} // end namespace itk
+
+#endif
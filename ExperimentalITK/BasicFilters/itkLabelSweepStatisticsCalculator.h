@@ -0,0 +1,269 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkLabelSweepStatisticsCalculator_h
+#define __itkLabelSweepStatisticsCalculator_h
+
+#include "itkContinuousIndex.h"
+#include "itkImage.h"
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+
+#include "vnl/vnl_matrix.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace itk
+{
+/** \class LabelSweepStatisticsCalculator
+ * \brief Computes the intensity, geometry and perimeter statistics of all
+ * labels of a label image in a single threaded sweep.
+ *
+ * For every label other than the background value the calculator
+ * accumulates the voxel count, the sum and the second, third and fourth
+ * power sums of the intensities, the intensity extrema, the bounding box,
+ * the centroid and the second order central moments (both in index
+ * space, as in LabelGeometryImageFilter) and the perimeter estimate of
+ * LabelPerimeterEstimationCalculator.  If UseHistograms is on, each label
+ * also gets a histogram of NumberOfHistogramBins bins over the intensity
+ * range of the foreground, from which quantiles and the entropy are read.
+ *
+ * The labels are found by a first, label-only pass and mapped to
+ * consecutive indices.  The image is then split into slabs along its last
+ * axis, and every thread accumulates into its own flat arrays indexed by
+ * label index.  The arrays are merged once at the end.  The intensity
+ * image is optional; without it only the geometric statistics are
+ * computed.
+ *
+ * The label pixel type must be integral.  Both images must have the same
+ * buffered region, which is the region that is swept.
+ */
+template<class TLabelImage, class TIntensityImage =
+  Image<float, TLabelImage::ImageDimension> >
+class ITK_EXPORT LabelSweepStatisticsCalculator : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef LabelSweepStatisticsCalculator                 Self;
+  typedef Object                                         Superclass;
+  typedef SmartPointer<Self>                             Pointer;
+  typedef SmartPointer<const Self>                       ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( LabelSweepStatisticsCalculator, Object );
+
+  itkStaticConstMacro( ImageDimension, unsigned int,
+                       TLabelImage::ImageDimension );
+
+  typedef TLabelImage                                    LabelImageType;
+  typedef typename LabelImageType::PixelType             LabelType;
+  typedef typename LabelImageType::RegionType            RegionType;
+  typedef typename LabelImageType::IndexType             IndexType;
+  typedef typename LabelImageType::SizeType              SizeType;
+  typedef std::vector<LabelType>                         LabelContainerType;
+
+  typedef TIntensityImage                                IntensityImageType;
+  typedef typename IntensityImageType::PixelType         IntensityPixelType;
+
+  typedef double                                         RealType;
+  typedef ContinuousIndex<RealType, ImageDimension>      ContinuousIndexType;
+  typedef vnl_matrix<RealType>                           MatrixType;
+  typedef std::vector<unsigned long>                     HistogramType;
+
+  /** Triggers the computation. */
+  void Compute();
+
+  itkSetConstObjectMacro( LabelImage, LabelImageType );
+  itkGetConstObjectMacro( LabelImage, LabelImageType );
+
+  /** The intensity image is optional. */
+  itkSetConstObjectMacro( IntensityImage, IntensityImageType );
+  itkGetConstObjectMacro( IntensityImage, IntensityImageType );
+
+  /** Voxels with this label are not accumulated.  Default is 0. */
+  itkSetMacro( BackgroundValue, LabelType );
+  itkGetConstMacro( BackgroundValue, LabelType );
+
+  /** Compute the perimeter estimate.  Default is on. */
+  itkSetMacro( ComputePerimeter, bool );
+  itkGetConstMacro( ComputePerimeter, bool );
+  itkBooleanMacro( ComputePerimeter );
+
+  /** Accumulate the per-label histograms.  Default is off. */
+  itkSetMacro( UseHistograms, bool );
+  itkGetConstMacro( UseHistograms, bool );
+  itkBooleanMacro( UseHistograms );
+
+  itkSetClampMacro( NumberOfHistogramBins, unsigned int, 1,
+    NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( NumberOfHistogramBins, unsigned int );
+
+  itkSetClampMacro( NumberOfThreads, unsigned int, 1,
+    NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( NumberOfThreads, unsigned int );
+
+  /** The labels found in the label image, in increasing order. */
+  const LabelContainerType & GetLabels() const
+    {
+    return this->m_Labels;
+    }
+
+  unsigned long GetNumberOfLabels() const
+    {
+    return this->m_Labels.size();
+    }
+
+  bool HasLabel( LabelType label ) const;
+
+  /** Intensity range of all non-background voxels. */
+  itkGetConstMacro( Minimum, RealType );
+  itkGetConstMacro( Maximum, RealType );
+
+  unsigned long GetCount( LabelType label ) const;
+  RealType GetSum( LabelType label ) const;
+  RealType GetMean( LabelType label ) const;
+  /** Sample variance and standard deviation, as in
+   * LabelStatisticsImageFilter. */
+  RealType GetVariance( LabelType label ) const;
+  RealType GetSigma( LabelType label ) const;
+  /** Sample skewness and kurtosis from the k-statistics. */
+  RealType GetSkewness( LabelType label ) const;
+  RealType GetKurtosis( LabelType label ) const;
+  RealType GetMinimum( LabelType label ) const;
+  RealType GetMaximum( LabelType label ) const;
+
+  RegionType GetBoundingBox( LabelType label ) const;
+  ContinuousIndexType GetCentroid( LabelType label ) const;
+  MatrixType GetSecondOrderCentralMoments( LabelType label ) const;
+  /** Eccentricity and elongation as in LabelGeometryImageFilter; 0 if
+   * the moments are degenerate. */
+  RealType GetEccentricity( LabelType label ) const;
+  RealType GetElongation( LabelType label ) const;
+
+  /** Perimeter in physical units, as in
+   * LabelPerimeterEstimationCalculator. */
+  RealType GetPerimeter( LabelType label ) const;
+
+  const HistogramType & GetHistogram( LabelType label ) const;
+  /** Quantile interpolated within the histogram bins, as
+   * Statistics::Histogram::Quantile. */
+  RealType GetQuantile( LabelType label, RealType p ) const;
+  /** Entropy (in bits) of the histogram. */
+  RealType GetEntropy( LabelType label ) const;
+
+protected:
+  LabelSweepStatisticsCalculator();
+  ~LabelSweepStatisticsCalculator() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  LabelSweepStatisticsCalculator( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  typedef typename IndexType::IndexValueType             IndexValueType;
+
+  /** Per-label accumulator.  The power sums are taken about m_Shift to
+   * limit cancellation when the central moments are formed. */
+  struct AccumulatorType
+    {
+    unsigned long  Count;
+    RealType       Sum;
+    RealType       SumOfSquares;
+    RealType       SumOfCubes;
+    RealType       SumOfFourthPowers;
+    RealType       Minimum;
+    RealType       Maximum;
+    IndexValueType LowerBound[ImageDimension];
+    IndexValueType UpperBound[ImageDimension];
+    RealType       IndexSum[ImageDimension];
+    RealType       IndexProductSum[ImageDimension][ImageDimension];
+    RealType       Perimeter;
+    };
+
+  struct SweepThreadStruct
+    {
+    LabelSweepStatisticsCalculator *Calculator;
+    };
+
+  static ITK_THREAD_RETURN_TYPE SweepThreaderCallback( void *arg );
+
+  void ThreadedSweep( unsigned int threadId, unsigned int numberOfThreads );
+
+  /** Finds the labels and the foreground intensity range. */
+  void FindLabels();
+
+  /** Contribution of every 2^ImageDimension block configuration to the
+   * perimeter, with corner i at offset bit d of i along axis d. */
+  void ComputePerimeterContributions();
+
+  void InitializeAccumulator( AccumulatorType & ) const;
+
+  /** Maps a label to its index, or NumericTraits<unsigned long>::max(). */
+  inline unsigned long GetLabelIndex( LabelType label ) const
+    {
+    if( label == this->m_BackgroundValue )
+      {
+      return NumericTraits<unsigned long>::max();
+      }
+    if( !this->m_LabelLookup.empty() )
+      {
+      return this->m_LabelLookup[static_cast<unsigned long>(
+        label - this->m_Labels[0] )];
+      }
+    return static_cast<unsigned long>( std::lower_bound(
+      this->m_Labels.begin(), this->m_Labels.end(), label )
+      - this->m_Labels.begin() );
+    }
+
+  const AccumulatorType & GetAccumulator( LabelType label ) const;
+
+  typename LabelImageType::ConstPointer            m_LabelImage;
+  typename IntensityImageType::ConstPointer        m_IntensityImage;
+  LabelType                                        m_BackgroundValue;
+  bool                                             m_ComputePerimeter;
+  bool                                             m_UseHistograms;
+  unsigned int                                     m_NumberOfHistogramBins;
+  unsigned int                                     m_NumberOfThreads;
+
+  LabelContainerType                               m_Labels;
+  std::vector<unsigned long>                       m_LabelLookup;
+  RealType                                         m_Minimum;
+  RealType                                         m_Maximum;
+  RealType                                         m_Shift;
+
+  unsigned long                                    m_Strides[ImageDimension];
+  std::vector<long>                                m_BlockOffsets;
+  std::vector<RealType>                            m_PerimeterContributions;
+
+  std::vector<std::vector<AccumulatorType> >       m_ThreadAccumulators;
+  std::vector<HistogramType>                       m_ThreadHistograms;
+
+  std::vector<AccumulatorType>                     m_Accumulators;
+  std::vector<HistogramType>                       m_Histograms;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkLabelSweepStatisticsCalculator.hxx"
+#endif
+
+#endif
@@ -0,0 +1,811 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkLabelSweepStatisticsCalculator_hxx
+#define __itkLabelSweepStatisticsCalculator_hxx
+
+#include "itkLabelSweepStatisticsCalculator.h"
+
+#include "vnl/vnl_math.h"
+#include "vnl/algo/vnl_symmetric_eigensystem.h"
+
+#include <set>
+
+namespace itk
+{
+
+template<class TLabelImage, class TIntensityImage>
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::LabelSweepStatisticsCalculator()
+{
+  this->m_LabelImage = NULL;
+  this->m_IntensityImage = NULL;
+  this->m_BackgroundValue = NumericTraits<LabelType>::Zero;
+  this->m_ComputePerimeter = true;
+  this->m_UseHistograms = false;
+  this->m_NumberOfHistogramBins = 200;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+
+  this->m_Minimum = NumericTraits<RealType>::Zero;
+  this->m_Maximum = NumericTraits<RealType>::Zero;
+  this->m_Shift = NumericTraits<RealType>::Zero;
+}
+
+template<class TLabelImage, class TIntensityImage>
+void
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::Compute()
+{
+  if( !this->m_LabelImage )
+    {
+    itkExceptionMacro( "Label image is not set." );
+    }
+  const RegionType region = this->m_LabelImage->GetBufferedRegion();
+  if( this->m_IntensityImage &&
+    this->m_IntensityImage->GetBufferedRegion() != region )
+    {
+    itkExceptionMacro( "The label and intensity images do not have the "
+      << "same buffered region." );
+    }
+
+  unsigned long stride = 1;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    this->m_Strides[d] = stride;
+    stride *= region.GetSize()[d];
+    }
+
+  this->FindLabels();
+  if( this->m_ComputePerimeter )
+    {
+    this->ComputePerimeterContributions();
+    }
+
+  const unsigned long numberOfLabels = this->m_Labels.size();
+  const bool useHistograms = this->m_UseHistograms && this->m_IntensityImage;
+
+  AccumulatorType initial;
+  this->InitializeAccumulator( initial );
+
+  this->m_ThreadAccumulators.resize( this->m_NumberOfThreads );
+  this->m_ThreadHistograms.resize( this->m_NumberOfThreads );
+  for( unsigned int n = 0; n < this->m_NumberOfThreads; n++ )
+    {
+    this->m_ThreadAccumulators[n].assign( numberOfLabels, initial );
+    if( useHistograms )
+      {
+      this->m_ThreadHistograms[n].assign(
+        numberOfLabels * this->m_NumberOfHistogramBins, 0 );
+      }
+    }
+
+  SweepThreadStruct str;
+  str.Calculator = this;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( this->m_NumberOfThreads );
+  threader->SetSingleMethod( this->SweepThreaderCallback, &str );
+  threader->SingleMethodExecute();
+
+  // Merge the per-thread accumulators.
+  this->m_Accumulators.assign( numberOfLabels, initial );
+  this->m_Histograms.clear();
+  if( useHistograms )
+    {
+    this->m_Histograms.assign( numberOfLabels,
+      HistogramType( this->m_NumberOfHistogramBins, 0 ) );
+    }
+  for( unsigned int n = 0; n < this->m_NumberOfThreads; n++ )
+    {
+    for( unsigned long l = 0; l < numberOfLabels; l++ )
+      {
+      AccumulatorType & total = this->m_Accumulators[l];
+      const AccumulatorType & partial = this->m_ThreadAccumulators[n][l];
+      if( partial.Count == 0 )
+        {
+        total.Perimeter += partial.Perimeter;
+        continue;
+        }
+      total.Count += partial.Count;
+      total.Sum += partial.Sum;
+      total.SumOfSquares += partial.SumOfSquares;
+      total.SumOfCubes += partial.SumOfCubes;
+      total.SumOfFourthPowers += partial.SumOfFourthPowers;
+      total.Minimum = vnl_math_min( total.Minimum, partial.Minimum );
+      total.Maximum = vnl_math_max( total.Maximum, partial.Maximum );
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        total.LowerBound[d] = vnl_math_min( total.LowerBound[d],
+          partial.LowerBound[d] );
+        total.UpperBound[d] = vnl_math_max( total.UpperBound[d],
+          partial.UpperBound[d] );
+        total.IndexSum[d] += partial.IndexSum[d];
+        for( unsigned int e = 0; e <= d; e++ )
+          {
+          total.IndexProductSum[d][e] += partial.IndexProductSum[d][e];
+          }
+        }
+      total.Perimeter += partial.Perimeter;
+
+      if( useHistograms )
+        {
+        const unsigned long *counts = &this->m_ThreadHistograms[n][
+          l * this->m_NumberOfHistogramBins];
+        for( unsigned int b = 0; b < this->m_NumberOfHistogramBins; b++ )
+          {
+          this->m_Histograms[l][b] += counts[b];
+          }
+        }
+      }
+    }
+
+  this->m_ThreadAccumulators.clear();
+  this->m_ThreadHistograms.clear();
+}
+
+template<class TLabelImage, class TIntensityImage>
+void
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::FindLabels()
+{
+  const LabelType *labels = this->m_LabelImage->GetBufferPointer();
+  const IntensityPixelType *intensities = ( this->m_IntensityImage )
+    ? this->m_IntensityImage->GetBufferPointer() : NULL;
+  const unsigned long numberOfPixels =
+    this->m_LabelImage->GetBufferedRegion().GetNumberOfPixels();
+
+  // Labels are only inserted at the start of a run, which keeps the set
+  // operations off the per-voxel path for segmentations.
+  std::set<LabelType> labelSet;
+  LabelType lastLabel = this->m_BackgroundValue;
+
+  RealType minimum = NumericTraits<RealType>::max();
+  RealType maximum = NumericTraits<RealType>::NonpositiveMin();
+
+  for( unsigned long i = 0; i < numberOfPixels; i++ )
+    {
+    const LabelType label = labels[i];
+    if( label == this->m_BackgroundValue )
+      {
+      lastLabel = label;
+      continue;
+      }
+    if( label != lastLabel )
+      {
+      labelSet.insert( label );
+      lastLabel = label;
+      }
+    if( intensities )
+      {
+      const RealType value = static_cast<RealType>( intensities[i] );
+      minimum = vnl_math_min( minimum, value );
+      maximum = vnl_math_max( maximum, value );
+      }
+    }
+
+  this->m_Labels.assign( labelSet.begin(), labelSet.end() );
+
+  if( minimum > maximum )
+    {
+    minimum = maximum = NumericTraits<RealType>::Zero;
+    }
+  this->m_Minimum = minimum;
+  this->m_Maximum = maximum;
+  this->m_Shift = 0.5 * ( minimum + maximum );
+
+  // Direct lookup if the label range is not larger than the image,
+  // otherwise binary search in the sorted labels.
+  this->m_LabelLookup.clear();
+  if( !this->m_Labels.empty() )
+    {
+    const unsigned long range = static_cast<unsigned long>(
+      this->m_Labels.back() - this->m_Labels.front() ) + 1;
+    if( range <= numberOfPixels )
+      {
+      this->m_LabelLookup.assign( range, NumericTraits<unsigned long>::max() );
+      for( unsigned long l = 0; l < this->m_Labels.size(); l++ )
+        {
+        this->m_LabelLookup[static_cast<unsigned long>(
+          this->m_Labels[l] - this->m_Labels.front() )] = l;
+        }
+      }
+    }
+}
+
+template<class TLabelImage, class TIntensityImage>
+void
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::ComputePerimeterContributions()
+{
+  const unsigned int numberOfCorners = 1 << ImageDimension;
+
+  this->m_BlockOffsets.resize( numberOfCorners );
+  for( unsigned int i = 0; i < numberOfCorners; i++ )
+    {
+    this->m_BlockOffsets[i] = 0;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      if( i & ( 1 << d ) )
+        {
+        this->m_BlockOffsets[i] += this->m_Strides[d];
+        }
+      }
+    }
+
+  const typename LabelImageType::SpacingType spacing =
+    this->m_LabelImage->GetSpacing();
+  RealType physicalSize = 1.0;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    physicalSize *= spacing[d];
+    }
+
+  // Every face of a corner voxel that is not shared with another corner
+  // of the same label contributes half of its area.
+  const unsigned long numberOfConfigurations = 1ul << numberOfCorners;
+  this->m_PerimeterContributions.assign( numberOfConfigurations, 0.0 );
+  for( unsigned long c = 0; c < numberOfConfigurations; c++ )
+    {
+    for( unsigned int i = 0; i < numberOfCorners; i++ )
+      {
+      if( !( c & ( 1ul << i ) ) )
+        {
+        continue;
+        }
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        if( !( c & ( 1ul << ( i ^ ( 1 << d ) ) ) ) )
+          {
+          this->m_PerimeterContributions[c] +=
+            physicalSize / spacing[d] / 2.0;
+          }
+        }
+      }
+    this->m_PerimeterContributions[c] /= ImageDimension;
+    }
+}
+
+template<class TLabelImage, class TIntensityImage>
+void
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::InitializeAccumulator( AccumulatorType & accumulator ) const
+{
+  accumulator.Count = 0;
+  accumulator.Sum = 0.0;
+  accumulator.SumOfSquares = 0.0;
+  accumulator.SumOfCubes = 0.0;
+  accumulator.SumOfFourthPowers = 0.0;
+  accumulator.Minimum = NumericTraits<RealType>::max();
+  accumulator.Maximum = NumericTraits<RealType>::NonpositiveMin();
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    accumulator.LowerBound[d] = NumericTraits<IndexValueType>::max();
+    accumulator.UpperBound[d] = NumericTraits<IndexValueType>::NonpositiveMin();
+    accumulator.IndexSum[d] = 0.0;
+    for( unsigned int e = 0; e < ImageDimension; e++ )
+      {
+      accumulator.IndexProductSum[d][e] = 0.0;
+      }
+    }
+  accumulator.Perimeter = 0.0;
+}
+
+template<class TLabelImage, class TIntensityImage>
+ITK_THREAD_RETURN_TYPE
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::SweepThreaderCallback( void *arg )
+{
+  unsigned int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  unsigned int threadCount =
+    ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  SweepThreadStruct *str = (SweepThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  str->Calculator->ThreadedSweep( threadId, threadCount );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TLabelImage, class TIntensityImage>
+void
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::ThreadedSweep( unsigned int threadId, unsigned int numberOfThreads )
+{
+  const RegionType region = this->m_LabelImage->GetBufferedRegion();
+  const SizeType size = region.GetSize();
+  const IndexType start = region.GetIndex();
+
+  // Slabs along the last axis.
+  const unsigned long numberOfSlices = size[ImageDimension - 1];
+  const unsigned long firstSlice = numberOfSlices * threadId / numberOfThreads;
+  const unsigned long lastSlice =
+    numberOfSlices * ( threadId + 1 ) / numberOfThreads;
+  if( firstSlice >= lastSlice )
+    {
+    return;
+    }
+
+  const LabelType *labels = this->m_LabelImage->GetBufferPointer();
+  const IntensityPixelType *intensities = ( this->m_IntensityImage )
+    ? this->m_IntensityImage->GetBufferPointer() : NULL;
+
+  AccumulatorType *accumulators = &this->m_ThreadAccumulators[threadId][0];
+
+  const unsigned int numberOfBins = this->m_NumberOfHistogramBins;
+  unsigned long *histograms = ( this->m_ThreadHistograms[threadId].empty() )
+    ? NULL : &this->m_ThreadHistograms[threadId][0];
+  const RealType binScale = ( this->m_Maximum > this->m_Minimum )
+    ? numberOfBins / ( this->m_Maximum - this->m_Minimum ) : 0.0;
+
+  const unsigned int numberOfCorners = this->m_BlockOffsets.size();
+  const bool computePerimeter = this->m_ComputePerimeter;
+  const unsigned long notALabel = NumericTraits<unsigned long>::max();
+
+  IndexValueType index[ImageDimension];
+  for( unsigned int d = 0; d < ImageDimension - 1; d++ )
+    {
+    index[d] = 0;
+    }
+  index[ImageDimension - 1] = firstSlice;
+
+  const unsigned long end = lastSlice * this->m_Strides[ImageDimension - 1];
+  for( unsigned long offset = firstSlice * this->m_Strides[ImageDimension - 1];
+    offset < end; offset++ )
+    {
+    const LabelType label = labels[offset];
+    const unsigned long l = this->GetLabelIndex( label );
+    if( l != notALabel )
+      {
+      AccumulatorType & accumulator = accumulators[l];
+      accumulator.Count++;
+
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        const IndexValueType position = start[d] + index[d];
+        accumulator.LowerBound[d] = vnl_math_min( accumulator.LowerBound[d],
+          position );
+        accumulator.UpperBound[d] = vnl_math_max( accumulator.UpperBound[d],
+          position );
+        accumulator.IndexSum[d] += position;
+        for( unsigned int e = 0; e <= d; e++ )
+          {
+          accumulator.IndexProductSum[d][e] += static_cast<RealType>(
+            position ) * static_cast<RealType>( start[e] + index[e] );
+          }
+        }
+
+      if( intensities )
+        {
+        const RealType value = static_cast<RealType>( intensities[offset] );
+        const RealType x = value - this->m_Shift;
+        const RealType x2 = x * x;
+        accumulator.Sum += x;
+        accumulator.SumOfSquares += x2;
+        accumulator.SumOfCubes += x2 * x;
+        accumulator.SumOfFourthPowers += x2 * x2;
+        accumulator.Minimum = vnl_math_min( accumulator.Minimum, value );
+        accumulator.Maximum = vnl_math_max( accumulator.Maximum, value );
+
+        if( histograms )
+          {
+          unsigned int bin = static_cast<unsigned int>(
+            ( value - this->m_Minimum ) * binScale );
+          if( bin >= numberOfBins )
+            {
+            bin = numberOfBins - 1;
+            }
+          histograms[l * numberOfBins + bin]++;
+          }
+        }
+      }
+
+    // The perimeter is accumulated over the 2x...x2 blocks anchored at
+    // every voxel that is not on the upper border, as in
+    // LabelPerimeterEstimationCalculator.
+    bool anchor = computePerimeter;
+    for( unsigned int d = 0; d < ImageDimension && anchor; d++ )
+      {
+      anchor = ( index[d] + 1 < static_cast<IndexValueType>( size[d] ) );
+      }
+    if( anchor )
+      {
+      LabelType corners[1 << ImageDimension];
+      for( unsigned int i = 0; i < numberOfCorners; i++ )
+        {
+        corners[i] = labels[offset + this->m_BlockOffsets[i]];
+        }
+      for( unsigned int i = 0; i < numberOfCorners; i++ )
+        {
+        if( corners[i] == this->m_BackgroundValue )
+          {
+          continue;
+          }
+        bool seen = false;
+        for( unsigned int j = 0; j < i && !seen; j++ )
+          {
+          seen = ( corners[j] == corners[i] );
+          }
+        if( seen )
+          {
+          continue;
+          }
+        unsigned long configuration = 0;
+        for( unsigned int j = i; j < numberOfCorners; j++ )
+          {
+          if( corners[j] == corners[i] )
+            {
+            configuration |= ( 1ul << j );
+            }
+          }
+        accumulators[this->GetLabelIndex( corners[i] )].Perimeter +=
+          this->m_PerimeterContributions[configuration];
+        }
+      }
+
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      if( ++index[d] < static_cast<IndexValueType>( size[d] ) ||
+        d == ImageDimension - 1 )
+        {
+        break;
+        }
+      index[d] = 0;
+      }
+    }
+}
+
+template<class TLabelImage, class TIntensityImage>
+bool
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::HasLabel( LabelType label ) const
+{
+  return std::binary_search( this->m_Labels.begin(), this->m_Labels.end(),
+    label );
+}
+
+template<class TLabelImage, class TIntensityImage>
+const typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::AccumulatorType &
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetAccumulator( LabelType label ) const
+{
+  if( !this->HasLabel( label ) || this->m_Accumulators.empty() )
+    {
+    itkExceptionMacro( << "Unknown label: "
+      << static_cast<typename NumericTraits<LabelType>::PrintType>( label ) );
+    }
+  return this->m_Accumulators[this->GetLabelIndex( label )];
+}
+
+template<class TLabelImage, class TIntensityImage>
+unsigned long
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetCount( LabelType label ) const
+{
+  return this->GetAccumulator( label ).Count;
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetSum( LabelType label ) const
+{
+  const AccumulatorType & accumulator = this->GetAccumulator( label );
+  return accumulator.Sum + accumulator.Count * this->m_Shift;
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetMean( LabelType label ) const
+{
+  const AccumulatorType & accumulator = this->GetAccumulator( label );
+  return accumulator.Sum / accumulator.Count + this->m_Shift;
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetVariance( LabelType label ) const
+{
+  const AccumulatorType & accumulator = this->GetAccumulator( label );
+  const RealType N = accumulator.Count;
+  if( N < 2 )
+    {
+    return 0.0;
+    }
+  return vnl_math_max( 0.0, ( accumulator.SumOfSquares -
+    vnl_math_sqr( accumulator.Sum ) / N ) / ( N - 1.0 ) );
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetSigma( LabelType label ) const
+{
+  return vcl_sqrt( this->GetVariance( label ) );
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetSkewness( LabelType label ) const
+{
+  const AccumulatorType & accumulator = this->GetAccumulator( label );
+  const RealType N = accumulator.Count;
+  if( N < 3 )
+    {
+    return 0.0;
+    }
+
+  const RealType mu = accumulator.Sum / N;
+  const RealType m2 = accumulator.SumOfSquares / N - mu * mu;
+  const RealType m3 = accumulator.SumOfCubes / N
+    - 3.0 * mu * accumulator.SumOfSquares / N + 2.0 * mu * mu * mu;
+
+  const RealType k2 = N / ( N - 1.0 ) * m2;
+  const RealType k3 = vnl_math_sqr( N ) / ( ( N - 1.0 ) * ( N - 2.0 ) ) * m3;
+  if( k2 <= 0.0 )
+    {
+    return 0.0;
+    }
+  return k3 / vcl_sqrt( k2 * k2 * k2 );
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetKurtosis( LabelType label ) const
+{
+  const AccumulatorType & accumulator = this->GetAccumulator( label );
+  const RealType N = accumulator.Count;
+  if( N < 4 )
+    {
+    return 0.0;
+    }
+
+  const RealType mu = accumulator.Sum / N;
+  const RealType mu2 = mu * mu;
+  const RealType m2 = accumulator.SumOfSquares / N - mu2;
+  const RealType m4 = accumulator.SumOfFourthPowers / N
+    - 4.0 * mu * accumulator.SumOfCubes / N
+    + 6.0 * mu2 * accumulator.SumOfSquares / N - 3.0 * mu2 * mu2;
+
+  const RealType k2 = N / ( N - 1.0 ) * m2;
+  const RealType k4 = vnl_math_sqr( N ) /
+    ( ( N - 1.0 ) * ( N - 2.0 ) * ( N - 3.0 ) ) *
+    ( ( N + 1.0 ) * m4 - 3.0 * ( N - 1.0 ) * vnl_math_sqr( m2 ) );
+  if( k2 <= 0.0 )
+    {
+    return 0.0;
+    }
+  return k4 / vnl_math_sqr( k2 );
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetMinimum( LabelType label ) const
+{
+  return this->GetAccumulator( label ).Minimum;
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetMaximum( LabelType label ) const
+{
+  return this->GetAccumulator( label ).Maximum;
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RegionType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetBoundingBox( LabelType label ) const
+{
+  const AccumulatorType & accumulator = this->GetAccumulator( label );
+
+  IndexType index;
+  SizeType size;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    index[d] = accumulator.LowerBound[d];
+    size[d] = accumulator.UpperBound[d] - accumulator.LowerBound[d] + 1;
+    }
+  RegionType boundingBox( index, size );
+  return boundingBox;
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::ContinuousIndexType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetCentroid( LabelType label ) const
+{
+  const AccumulatorType & accumulator = this->GetAccumulator( label );
+
+  ContinuousIndexType centroid;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    centroid[d] = accumulator.IndexSum[d] / accumulator.Count;
+    }
+  return centroid;
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::MatrixType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetSecondOrderCentralMoments( LabelType label ) const
+{
+  const AccumulatorType & accumulator = this->GetAccumulator( label );
+  const ContinuousIndexType centroid = this->GetCentroid( label );
+
+  MatrixType moments( ImageDimension, ImageDimension );
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    for( unsigned int e = 0; e <= d; e++ )
+      {
+      moments( d, e ) = accumulator.IndexProductSum[d][e] / accumulator.Count
+        - centroid[d] * centroid[e];
+      moments( e, d ) = moments( d, e );
+      }
+    }
+  return moments;
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetEccentricity( LabelType label ) const
+{
+  vnl_symmetric_eigensystem<RealType> eigensystem(
+    this->GetSecondOrderCentralMoments( label ) );
+
+  const RealType largest = eigensystem.get_eigenvalue( ImageDimension - 1 );
+  if( largest <= 0.0 )
+    {
+    return 0.0;
+    }
+  return vcl_sqrt( vnl_math_max( 0.0,
+    ( largest - eigensystem.get_eigenvalue( 0 ) ) / largest ) );
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetElongation( LabelType label ) const
+{
+  vnl_symmetric_eigensystem<RealType> eigensystem(
+    this->GetSecondOrderCentralMoments( label ) );
+
+  const RealType second = eigensystem.get_eigenvalue( ImageDimension - 2 );
+  if( second <= 0.0 )
+    {
+    return 0.0;
+    }
+  return vcl_sqrt( eigensystem.get_eigenvalue( ImageDimension - 1 ) / second );
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetPerimeter( LabelType label ) const
+{
+  return this->GetAccumulator( label ).Perimeter;
+}
+
+template<class TLabelImage, class TIntensityImage>
+const typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::HistogramType &
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetHistogram( LabelType label ) const
+{
+  this->GetAccumulator( label );
+  if( this->m_Histograms.empty() )
+    {
+    itkExceptionMacro( "Histograms were not computed." );
+    }
+  return this->m_Histograms[this->GetLabelIndex( label )];
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetQuantile( LabelType label, RealType p ) const
+{
+  const HistogramType & histogram = this->GetHistogram( label );
+  const RealType binWidth = ( this->m_Maximum - this->m_Minimum ) /
+    static_cast<RealType>( histogram.size() );
+
+  RealType total = 0.0;
+  for( unsigned int b = 0; b < histogram.size(); b++ )
+    {
+    total += histogram[b];
+    }
+  if( total == 0.0 )
+    {
+    return this->m_Minimum;
+    }
+
+  const RealType target = p * total;
+  RealType cumulative = 0.0;
+  for( unsigned int b = 0; b < histogram.size(); b++ )
+    {
+    if( histogram[b] == 0 )
+      {
+      continue;
+      }
+    const RealType previous = cumulative;
+    cumulative += histogram[b];
+    if( cumulative >= target )
+      {
+      return this->m_Minimum + binWidth * ( b +
+        ( target - previous ) / static_cast<RealType>( histogram[b] ) );
+      }
+    }
+  return this->m_Maximum;
+}
+
+template<class TLabelImage, class TIntensityImage>
+typename LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>::RealType
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::GetEntropy( LabelType label ) const
+{
+  const HistogramType & histogram = this->GetHistogram( label );
+
+  RealType total = 0.0;
+  for( unsigned int b = 0; b < histogram.size(); b++ )
+    {
+    total += histogram[b];
+    }
+
+  RealType entropy = 0.0;
+  for( unsigned int b = 0; b < histogram.size(); b++ )
+    {
+    if( histogram[b] > 0 )
+      {
+      const RealType p = histogram[b] / total;
+      entropy -= p * vcl_log( p ) / vcl_log( 2.0 );
+      }
+    }
+  return entropy;
+}
+
+template<class TLabelImage, class TIntensityImage>
+void
+LabelSweepStatisticsCalculator<TLabelImage, TIntensityImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Background value: "
+    << static_cast<typename NumericTraits<LabelType>::PrintType>(
+    this->m_BackgroundValue ) << std::endl;
+  os << indent << "Compute perimeter: " << this->m_ComputePerimeter
+    << std::endl;
+  os << indent << "Use histograms: " << this->m_UseHistograms << std::endl;
+  os << indent << "Number of histogram bins: "
+    << this->m_NumberOfHistogramBins << std::endl;
+  os << indent << "Number of threads: " << this->m_NumberOfThreads
+    << std::endl;
+  os << indent << "Number of labels: " << this->m_Labels.size() << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -39,6 +39,15 @@ namespace itk
  * \reference
  * W. A. Barrett and E. N. Mortenson, "Interactive live-wire boundary 
  * extraction", Medical Image Analysis, 1(4):331-341, 1996/7.
+ *
+ * By default the shortest paths from the anchor seed are expanded on the
+ * fly: evaluating the function at a free point runs Dijkstra's algorithm
+ * only until that point is settled, and the frontier is kept so that later
+ * evaluations from the same anchor resume where the last one stopped.  The
+ * cost terms that depend on a single voxel (gradient magnitude and zero
+ * crossings) are computed once per input image and weights.  With
+ * UseOnTheFlyExpansion off, the paths to all voxels are computed when the
+ * anchor seed is set.
  * \ingroup ImageFunctions
  */
 template <class TInputImage>
@@ -75,6 +84,7 @@ public:
   typedef typename InputImageType::ConstPointer             InputImageConstPointer;
   typedef typename InputImageType::RegionType               InputImageRegionType; 
   typedef typename InputImageType::PixelType                InputImagePixelType; 
+  typedef typename InputImageType::OffsetType               OffsetType;
 
   typedef typename Superclass::IndexType                    IndexType;
   typedef typename Superclass::PointType                    PointType;
@@ -105,7 +115,7 @@ public:
       } 
     };
 
-  typedef std::priority_queue<RealType, 
+  typedef std::priority_queue<NodeType, 
     std::vector<NodeType>, std::greater<NodeType> >         PriorityQueueType;
 
   /** Set the input image.
@@ -187,6 +197,13 @@ public:
   itkGetConstMacro( FindStepEdges, bool );
   itkBooleanMacro( FindStepEdges );
 
+  /** Expand the paths from the anchor seed only as far as the evaluated
+   * points (default) instead of to the whole image when the anchor seed is
+   * set.  Only the voxels reached so far have a path direction cost. */
+  itkSetMacro( UseOnTheFlyExpansion, bool );
+  itkGetConstMacro( UseOnTheFlyExpansion, bool );
+  itkBooleanMacro( UseOnTheFlyExpansion );
+
 protected:
 
   LiveWireImageFunction(); 
@@ -199,6 +216,22 @@ private:
 
   void GeneratePathDirectionImage();
 
+  /** Computes the weighted gradient magnitude and zero-crossing terms of
+   * every voxel if the image, the weights or the zero-crossing image
+   * changed. */
+  void UpdateLocalCosts();
+
+  /** Cost of the step from a settled voxel to its n-th neighbor. */
+  RealType ComputeEdgeCost( const IndexType & centerIndex, unsigned int n,
+    const IndexType & neighborIndex, unsigned long neighborOffset ) const;
+
+  /** Runs Dijkstra's algorithm from the saved frontier until the voxel at
+   * the target offset is settled, or until the frontier is empty if target
+   * is NULL.  Returns false if the target cannot be reached. */
+  bool ExpandFrontier( const unsigned long *target ) const;
+
+  enum { UnvisitedNode = 0, FrontierNode = 1, SettledNode = 2 };
+
   RealType                                   m_GradientMagnitudeWeight;
   RealType                                   m_ZeroCrossingWeight;
   RealType                                   m_GradientDirectionWeight;
@@ -219,6 +252,27 @@ private:
   bool                                       m_UseFaceConnectedness;
   bool                                       m_UseImageSpacing;
   bool                                       m_FindStepEdges;
+  bool                                       m_UseOnTheFlyExpansion;
+
+  /** Weighted single voxel cost terms and the parameters they were
+   * computed with. */
+  std::vector<RealType>                      m_LocalCosts;
+  RealType                                   m_LocalCostWeights[2];
+  bool                                       m_LocalCostFindStepEdges;
+  const RealImageType                       *m_LocalCostZeroCrossingImage;
+  unsigned long                              m_LocalCostZeroCrossingMTime;
+
+  /** Active neighbors: index offsets, buffer offsets, length scale
+   * factors and physical displacements. */
+  std::vector<OffsetType>                    m_NeighborOffsets;
+  std::vector<long>                          m_NeighborBufferOffsets;
+  std::vector<RealType>                      m_NeighborScaleFactors;
+  std::vector<typename PointType::VectorType> m_NeighborVectors;
+
+  /** Dijkstra state kept between evaluations from the same anchor. */
+  mutable std::vector<unsigned char>         m_NodeStates;
+  mutable std::vector<unsigned long>         m_VisitedNodes;
+  mutable PriorityQueueType                  m_Frontier;
 };
   
 } // end namespace itk
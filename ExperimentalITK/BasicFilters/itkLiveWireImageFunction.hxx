@@ -21,7 +21,8 @@
 #include "itkLiveWireImageFunction.h"
 
 #include "itkCastImageFilter.h"
-#include "itkConstNeighborhoodIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
 #include "itkNeighborhood.h"
 #include "itkRescaleIntensityImageFilter.h"
 #include "itkZeroCrossingBasedEdgeDetectionImageFilter.h"
@@ -42,6 +43,7 @@ LiveWireImageFunction<TInputImage>
   this->m_UseFaceConnectedness = true;
   this->m_UseImageSpacing = true;
   this->m_FindStepEdges = true;
+  this->m_UseOnTheFlyExpansion = true;
 
   this->m_ZeroCrossingImage = NULL;
   this->m_MaskImage = NULL;
@@ -49,6 +51,12 @@ LiveWireImageFunction<TInputImage>
   this->m_InsidePixelValue = NumericTraits<MaskPixelType>::One;
 
   this->m_AnchorSeed.Fill( 0 );
+
+  this->m_LocalCostWeights[0] = 0.0;
+  this->m_LocalCostWeights[1] = 0.0;
+  this->m_LocalCostFindStepEdges = true;
+  this->m_LocalCostZeroCrossingImage = NULL;
+  this->m_LocalCostZeroCrossingMTime = 0;
 }
  
 // Destructor
@@ -121,9 +129,67 @@ LiveWireImageFunction<TInputImage>
     this->m_ZeroCrossingImage = zeroCrossing->GetOutput();
     }
 
+  this->m_LocalCosts.clear();
+  this->m_NodeStates.clear();
+  this->m_VisitedNodes.clear();
+
   this->GeneratePathDirectionImage();
 }
 
+template <class TInputImage>
+void
+LiveWireImageFunction<TInputImage>
+::UpdateLocalCosts()
+{
+  const unsigned long numberOfPixels = this->m_RescaledGradientMagnitudeImage
+    ->GetBufferedRegion().GetNumberOfPixels();
+
+  unsigned long zeroCrossingMTime = 0;
+  if ( this->m_ZeroCrossingImage )
+    {
+    zeroCrossingMTime = this->m_ZeroCrossingImage->GetMTime();
+    }
+
+  if ( this->m_LocalCosts.size() == numberOfPixels
+    && this->m_LocalCostWeights[0] == this->m_GradientMagnitudeWeight
+    && this->m_LocalCostWeights[1] == this->m_ZeroCrossingWeight
+    && this->m_LocalCostFindStepEdges == this->m_FindStepEdges
+    && this->m_LocalCostZeroCrossingImage == this->m_ZeroCrossingImage.GetPointer()
+    && this->m_LocalCostZeroCrossingMTime == zeroCrossingMTime )
+    {
+    return;
+    }
+
+  this->m_LocalCosts.resize( numberOfPixels );
+
+  ImageRegionConstIteratorWithIndex<RealImageType> It(
+    this->m_RescaledGradientMagnitudeImage,
+    this->m_RescaledGradientMagnitudeImage->GetBufferedRegion() );
+  unsigned long n = 0;
+  for ( It.GoToBegin(); !It.IsAtEnd(); ++It, ++n )
+    {
+    RealType fz = 0.0;
+    RealType fg = 0.0;
+
+    if ( this->m_ZeroCrossingWeight > 0 && this->m_ZeroCrossingImage )
+      {
+      fz = 1.0 - this->m_ZeroCrossingImage->GetPixel( It.GetIndex() );
+      }
+    if ( this->m_GradientMagnitudeWeight > 0.0 )
+      {
+      fg = ( this->m_FindStepEdges ) ? 1.0 - It.Get() : It.Get();
+      }
+    this->m_LocalCosts[n] = fg * this->m_GradientMagnitudeWeight
+      + fz * this->m_ZeroCrossingWeight;
+    }
+
+  this->m_LocalCostWeights[0] = this->m_GradientMagnitudeWeight;
+  this->m_LocalCostWeights[1] = this->m_ZeroCrossingWeight;
+  this->m_LocalCostFindStepEdges = this->m_FindStepEdges;
+  this->m_LocalCostZeroCrossingImage = this->m_ZeroCrossingImage.GetPointer();
+  this->m_LocalCostZeroCrossingMTime = zeroCrossingMTime;
+}
+
 template <class TInputImage>
 void
 LiveWireImageFunction<TInputImage>
@@ -134,35 +200,48 @@ LiveWireImageFunction<TInputImage>
     itkExceptionMacro( "m_AnchorSeed is not inside buffer." );
     }
 
+  this->UpdateLocalCosts();
+
+  /**
+   * Initialize data structures.  The buffers are allocated once per input
+   * image and only the voxels reached from the previous anchor are reset.
+   */
+  const unsigned long numberOfPixels = this->m_LocalCosts.size();
+  if ( this->m_NodeStates.size() != numberOfPixels
+    || !this->m_PathDirectionImage || !this->m_PathDirectionCostImage )
+    {
+    this->m_PathDirectionImage = OffsetImageType::New();
+    this->m_PathDirectionImage->SetOrigin( this->GetInputImage()->GetOrigin() );
+    this->m_PathDirectionImage->SetSpacing( this->GetInputImage()->GetSpacing() );
+    this->m_PathDirectionImage->SetRegions( this->GetInputImage()->GetRequestedRegion() );
+    this->m_PathDirectionImage->Allocate();
+
+    this->m_PathDirectionCostImage = RealImageType::New();
+    this->m_PathDirectionCostImage->SetOrigin( this->GetInputImage()->GetOrigin() );
+    this->m_PathDirectionCostImage->SetSpacing( this->GetInputImage()->GetSpacing() );
+    this->m_PathDirectionCostImage->SetRegions( this->GetInputImage()->GetRequestedRegion() );
+    this->m_PathDirectionCostImage->Allocate();
+    this->m_PathDirectionCostImage->FillBuffer( 0 );
+
+    this->m_NodeStates.assign( numberOfPixels, UnvisitedNode );
+    }
+  else
+    {
+    RealType *costs = this->m_PathDirectionCostImage->GetBufferPointer();
+    for ( unsigned long i = 0; i < this->m_VisitedNodes.size(); i++ )
+      {
+      this->m_NodeStates[this->m_VisitedNodes[i]] = UnvisitedNode;
+      costs[this->m_VisitedNodes[i]] = 0;
+      }
+    }
+  this->m_VisitedNodes.clear();
+  this->m_Frontier = PriorityQueueType();
+
   /**
-   * Initialize data structures
+   * Active neighbors
    */
-  typedef Image<bool, ImageDimension> BooleanImageType;
-  typename BooleanImageType::Pointer expanded = BooleanImageType::New();
-  expanded->SetOrigin( this->GetInputImage()->GetOrigin() );
-  expanded->SetSpacing( this->GetInputImage()->GetSpacing() );
-  expanded->SetRegions( this->GetInputImage()->GetRequestedRegion() );
-  expanded->Allocate();
-  expanded->FillBuffer( false );
-  expanded->SetPixel( this->m_AnchorSeed, true );
-
-  this->m_PathDirectionImage = OffsetImageType::New();
-  this->m_PathDirectionImage->SetOrigin( this->GetInputImage()->GetOrigin() );
-  this->m_PathDirectionImage->SetSpacing( this->GetInputImage()->GetSpacing() );
-  this->m_PathDirectionImage->SetRegions( this->GetInputImage()->GetRequestedRegion() );
-  this->m_PathDirectionImage->Allocate();
-
-  this->m_PathDirectionCostImage = RealImageType::New();
-  this->m_PathDirectionCostImage->SetOrigin( this->GetInputImage()->GetOrigin() );
-  this->m_PathDirectionCostImage->SetSpacing( this->GetInputImage()->GetSpacing() );
-  this->m_PathDirectionCostImage->SetRegions( this->GetInputImage()->GetRequestedRegion() );
-  this->m_PathDirectionCostImage->Allocate();
-  this->m_PathDirectionCostImage->FillBuffer( 0 );
- 
-  typename ConstNeighborhoodIterator<InputImageType>::RadiusType radius;
+  typename Neighborhood<RealType, ImageDimension>::RadiusType radius;
   radius.Fill( 1 );
-  ConstNeighborhoodIterator<BooleanImageType> It( radius, expanded, 
-    expanded->GetRequestedRegion() );
   unsigned int numberOfNeighbors = 1;
   for ( unsigned int d = 0; d < ImageDimension; d++ )
     {
@@ -170,6 +249,17 @@ LiveWireImageFunction<TInputImage>
     }
   Neighborhood<RealType, ImageDimension> scaleFactors;
   scaleFactors.SetRadius( radius );
+
+  this->m_NeighborOffsets.clear();
+  this->m_NeighborBufferOffsets.clear();
+  this->m_NeighborScaleFactors.clear();
+  this->m_NeighborVectors.clear();
+
+  IndexType startIndex = 
+    this->m_PathDirectionCostImage->GetBufferedRegion().GetIndex();
+  PointType startPoint;
+  this->GetInputImage()->TransformIndexToPhysicalPoint( startIndex, startPoint );
+
   for ( unsigned int n = 0; n < numberOfNeighbors; n++ )
     {
     scaleFactors[n] = 0;
@@ -208,17 +298,23 @@ LiveWireImageFunction<TInputImage>
     if ( scaleFactors[n] > 0 )
       {
       scaleFactors[n] = vcl_sqrt( scaleFactors[n] );
+
+      PointType neighborPoint;
+      this->GetInputImage()->TransformIndexToPhysicalPoint( 
+        startIndex + offset, neighborPoint );
+
+      this->m_NeighborOffsets.push_back( offset );
+      this->m_NeighborBufferOffsets.push_back( 
+        this->m_PathDirectionCostImage->ComputeOffset( startIndex + offset )
+        - this->m_PathDirectionCostImage->ComputeOffset( startIndex ) );
+      this->m_NeighborScaleFactors.push_back( scaleFactors[n] );
+      this->m_NeighborVectors.push_back( neighborPoint - startPoint );
       } 
     }   
 
   /**
-   * Generate the PathDirectionImage with Dijkstra's algorithm
+   * Start Dijkstra's algorithm at the anchor seed
    */
-  
-  NodeType anchorNode;
-  anchorNode.cost = 0.0;
-  anchorNode.index = this->m_AnchorSeed;
-
   if ( this->m_MaskImage && 
        this->m_MaskImage->GetPixel( this->m_AnchorSeed ) 
          != this->m_InsidePixelValue )
@@ -227,134 +323,135 @@ LiveWireImageFunction<TInputImage>
     return;
     }    
 
-  PriorityQueueType Q;
-  Q.push( anchorNode );
+  NodeType anchorNode;
+  anchorNode.cost = 0.0;
+  anchorNode.index = this->m_AnchorSeed;
 
-  while ( !Q.empty() )
+  const unsigned long anchorOffset = 
+    this->m_PathDirectionCostImage->ComputeOffset( this->m_AnchorSeed );
+  this->m_NodeStates[anchorOffset] = FrontierNode;
+  this->m_VisitedNodes.push_back( anchorOffset );
+  this->m_Frontier.push( anchorNode );
+
+  if ( !this->m_UseOnTheFlyExpansion )
     {
-    NodeType centerNode = Q.top(); 
-    Q.pop();
+    this->ExpandFrontier( NULL );
+    }
+}
 
-    expanded->SetPixel( centerNode.index, true );
-    It.SetLocation( centerNode.index ); 
-    PointType centerPoint;
-    this->GetInputImage()->TransformIndexToPhysicalPoint( 
-      centerNode.index, centerPoint );
+template <class TInputImage>
+typename LiveWireImageFunction<TInputImage>::RealType
+LiveWireImageFunction<TInputImage>
+::ComputeEdgeCost( const IndexType & centerIndex, unsigned int n,
+  const IndexType & neighborIndex, unsigned long neighborOffset ) const
+{
+  RealType fd = 0.0;
 
-    typename GradientImageType::PixelType centerGradient 
-      = this->m_GradientImage->GetPixel( centerNode.index );
+  if ( this->m_GradientDirectionWeight > 0.0 )
+    {
     RealType centerNorm 
-      = this->m_GradientMagnitudeImage->GetPixel( centerNode.index );
+      = this->m_GradientMagnitudeImage->GetPixel( centerIndex );
+    RealType neighborNorm 
+      = this->m_GradientMagnitudeImage->GetPixel( neighborIndex );
+
+    if ( neighborNorm > 0 && centerNorm > 0 )
+      {
+      typename GradientImageType::PixelType centerGradient 
+        = this->m_GradientImage->GetPixel( centerIndex );
+      typename GradientImageType::PixelType neighborGradient 
+        = this->m_GradientImage->GetPixel( neighborIndex );
+
+      const typename PointType::VectorType & vector 
+        = this->m_NeighborVectors[n];
+      RealType vectorNorm = vector.GetNorm();            
+
+      RealType centerMin = vnl_math_min( centerGradient * vector, 
+        centerGradient * -vector );            
+      RealType neighborMin = vnl_math_min( neighborGradient * vector, 
+        neighborGradient * -vector );            
+
+      fd = 1.0 - ( vcl_acos( centerMin / ( centerNorm * vectorNorm ) ) +  
+        vcl_acos( neighborMin / ( neighborNorm * vectorNorm ) ) )
+        / vnl_math::pi;
+      }
+    }
+
+  return this->m_NeighborScaleFactors[n] * ( this->m_LocalCosts[neighborOffset]
+    + fd * this->m_GradientDirectionWeight );
+}
 
-    for ( unsigned int n = 0; n < numberOfNeighbors; n++ )
+template <class TInputImage>
+bool
+LiveWireImageFunction<TInputImage>
+::ExpandFrontier( const unsigned long *target ) const
+{
+  const InputImageRegionType region = 
+    this->m_PathDirectionCostImage->GetBufferedRegion();
+  RealType *costs = this->m_PathDirectionCostImage->GetBufferPointer();
+
+  while ( !this->m_Frontier.empty() )
+    {
+    if ( target && this->m_NodeStates[*target] == SettledNode )
       {
-      if ( scaleFactors[n] == 0 )
+      return true;
+      }
+
+    NodeType centerNode = this->m_Frontier.top(); 
+    this->m_Frontier.pop();
+
+    const unsigned long centerOffset = 
+      this->m_PathDirectionCostImage->ComputeOffset( centerNode.index );
+
+    // Stale entries of nodes whose cost was lowered after they were queued
+    if ( this->m_NodeStates[centerOffset] == SettledNode 
+      || centerNode.cost > costs[centerOffset] )
+      {
+      continue;
+      }
+    this->m_NodeStates[centerOffset] = SettledNode;
+
+    for ( unsigned int n = 0; n < this->m_NeighborOffsets.size(); n++ )
+      {
+      IndexType index = centerNode.index + this->m_NeighborOffsets[n];
+      if ( !region.IsInside( index ) )
         {
         continue;
-        } 
-      bool inBounds;
-      bool isExpanded = It.GetPixel( n, inBounds );
-      if ( isExpanded || !inBounds )
+        }
+      const unsigned long offset = centerOffset + this->m_NeighborBufferOffsets[n];
+      const unsigned char state = this->m_NodeStates[offset];
+      if ( state == SettledNode )
         {
         continue;
         }  
-
-      IndexType index = It.GetIndex( n );
-      NodeType neighborNode;
-      neighborNode.index = index;
-
       if ( this->m_MaskImage && 
            this->m_MaskImage->GetPixel( index ) != this->m_InsidePixelValue )
         {
         continue;
         }    
 
-      typename GradientImageType::PixelType neighborGradient 
-        = this->m_GradientImage->GetPixel( index );
-      RealType neighborNorm = this->m_GradientMagnitudeImage->GetPixel( index );
-      
-      RealType fz = 0.0;
-      RealType fg = 0.0;
-      RealType fd = 0.0;
-
-      if ( this->m_ZeroCrossingWeight > 0 && this->m_ZeroCrossingImage )
-        {
-        fz = 1.0 - this->m_ZeroCrossingImage->GetPixel( index );
-        } 
-      if ( this->m_FindStepEdges )
+      RealType cost = centerNode.cost 
+        + this->ComputeEdgeCost( centerNode.index, n, index, offset );
+
+      if ( state == UnvisitedNode || cost < costs[offset] )
         {
-        if ( this->m_GradientMagnitudeWeight > 0.0 )
+        if ( state == UnvisitedNode )
           {
-          fg = 1.0 - this->m_RescaledGradientMagnitudeImage->GetPixel( index );
-          }
-        if ( this->m_GradientDirectionWeight > 0.0 
-             && neighborNorm > 0 && centerNorm > 0 )
-          {
-          PointType neighborPoint;
-          this->GetInputImage()->TransformIndexToPhysicalPoint( 
-            neighborNode.index, neighborPoint );
-          typename PointType::VectorType vector 
-            = neighborPoint - centerPoint;
-          RealType vectorNorm = vector.GetNorm();            
-
-          RealType centerMin = vnl_math_min( centerGradient * vector, 
-            centerGradient * -vector );            
-          RealType neighborMin = vnl_math_min( neighborGradient * vector, 
-            neighborGradient * -vector );            
-
-          fd = 1.0 - ( vcl_acos( centerMin / ( centerNorm * vectorNorm ) ) +  
-            vcl_acos( neighborMin / ( neighborNorm * vectorNorm ) ) )
-            / vnl_math::pi;
+          this->m_NodeStates[offset] = FrontierNode;
+          this->m_VisitedNodes.push_back( offset );
           }
+        costs[offset] = cost;
+        this->m_PathDirectionImage->SetPixel( index, 
+          centerNode.index - index ); 
+
+        NodeType neighborNode;
+        neighborNode.index = index;
+        neighborNode.cost = cost;
+        this->m_Frontier.push( neighborNode ); 
         }
-      else
-        {
-        if ( this->m_GradientMagnitudeWeight > 0.0 )
-          {
-          fg = this->m_RescaledGradientMagnitudeImage->GetPixel( index );
-          } 
-        if ( this->m_GradientDirectionWeight > 0.0 
-             && neighborNorm > 0 && centerNorm > 0 )
-          {
-          PointType neighborPoint;
-          this->GetInputImage()->TransformIndexToPhysicalPoint( 
-            neighborNode.index, neighborPoint );
-          typename PointType::VectorType vector 
-            = neighborPoint - centerPoint;
-          RealType vectorNorm = vector.GetNorm();            
-
-          RealType centerMin = vnl_math_min( centerGradient * vector, 
-            centerGradient * -vector );            
-          RealType neighborMin = vnl_math_min( neighborGradient * vector, 
-            neighborGradient * -vector );            
-
-          fd = 1.0 - ( vcl_acos( centerMin / ( centerNorm * vectorNorm ) ) + 
-            vcl_acos( neighborMin / ( neighborNorm * vectorNorm ) ) )
-            / vnl_math::pi;
-          } 
-        }
-
-      neighborNode.cost = centerNode.cost + scaleFactors[n] *
-        ( fg * this->m_GradientMagnitudeWeight
-        + fz * this->m_ZeroCrossingWeight
-        + fd * this->m_GradientDirectionWeight );
-
-      Q.push( neighborNode ); 
-
-      this->m_PathDirectionImage->SetPixel( neighborNode.index, 
-        centerNode.index - neighborNode.index ); 
-
-      this->m_PathDirectionCostImage->SetPixel( neighborNode.index, 
-        neighborNode.cost ); 
-
-      NodeType node = Q.top();
-      while ( expanded->GetPixel( node.index ) )
-        {
-        Q.pop();
-        node = Q.top();
-        } 
       }  
     }  
+
+  return ( !target || this->m_NodeStates[*target] == SettledNode );
 }
 
 template <class TInputImage>
@@ -375,6 +472,14 @@ LiveWireImageFunction<TInputImage>
     return NULL;
     }    
 
+  const unsigned long offset = 
+    this->m_PathDirectionCostImage->ComputeOffset( index );
+  if ( !this->ExpandFrontier( &offset ) )
+    {
+    itkWarningMacro( "The index cannot be reached from the anchor seed." ); 
+    return NULL;
+    }
+
   typename OutputType::Pointer output = OutputType::New();
   output->Initialize();
 
@@ -411,6 +516,8 @@ LiveWireImageFunction<TInputImage>
      << this->m_UseImageSpacing << std::endl;
   os << indent << "UseFaceConnectedness: " 
      << this->m_UseFaceConnectedness << std::endl;
+  os << indent << "UseOnTheFlyExpansion: " 
+     << this->m_UseOnTheFlyExpansion << std::endl;
 
   os << indent << "MaskImage"
      << this->m_MaskImage << std::endl;
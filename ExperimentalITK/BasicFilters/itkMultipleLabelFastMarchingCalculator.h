@@ -0,0 +1,157 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkMultipleLabelFastMarchingCalculator_h
+#define __itkMultipleLabelFastMarchingCalculator_h
+
+#include "itkImage.h"
+#include "itkObject.h"
+
+#include <vector>
+
+namespace itk
+{
+/** \class MultipleLabelFastMarchingCalculator
+ * \brief Propagates all labels of a label image at once by fast marching.
+ *
+ * Every nonzero voxel of the label image is a seed with arrival time zero.
+ * A single fast marching front grows from all seeds together, and every
+ * trial node carries the label of the front that reached it first.  When
+ * a node is updated from a newly accepted neighbor, the upwind quadratic
+ * of FastMarchingImageFilter is solved with the accepted neighbors of that
+ * neighbor's label only, so every label grows as its own front.  The
+ * result is the label of the earliest arrival, i.e. the geodesic Voronoi
+ * partition of the seeds, and its arrival time.  It matches running one
+ * FastMarchingImageFilter per label and keeping the smallest time, but
+ * costs one pass over the image instead of one pass per label.
+ *
+ * The speed image is optional.  Voxels where it is not positive are never
+ * reached.  Without it the speed is one everywhere.  Arrival times are in
+ * physical units.  Voxels that are not reached have label zero and the
+ * largest RealType arrival time.  The speed image must have the buffered
+ * region of the label image.
+ */
+template<class TLabelImage, class TSpeedImage =
+  Image<float, TLabelImage::ImageDimension> >
+class ITK_EXPORT MultipleLabelFastMarchingCalculator : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef MultipleLabelFastMarchingCalculator            Self;
+  typedef Object                                         Superclass;
+  typedef SmartPointer<Self>                             Pointer;
+  typedef SmartPointer<const Self>                       ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( MultipleLabelFastMarchingCalculator, Object );
+
+  itkStaticConstMacro( ImageDimension, unsigned int,
+                       TLabelImage::ImageDimension );
+
+  typedef TLabelImage                                    LabelImageType;
+  typedef typename LabelImageType::PixelType             LabelType;
+  typedef typename LabelImageType::RegionType            RegionType;
+  typedef TSpeedImage                                    SpeedImageType;
+
+  typedef float                                          RealType;
+  typedef Image<RealType, ImageDimension>                RealImageType;
+
+  itkSetConstObjectMacro( LabelImage, LabelImageType );
+  itkGetConstObjectMacro( LabelImage, LabelImageType );
+
+  itkSetConstObjectMacro( SpeedImage, SpeedImageType );
+  itkGetConstObjectMacro( SpeedImage, SpeedImageType );
+
+  /** Nodes are not accepted beyond this arrival time.  Default is the
+   * largest RealType value. */
+  itkSetMacro( StoppingValue, RealType );
+  itkGetConstMacro( StoppingValue, RealType );
+
+  /** Triggers the computation. */
+  void Compute();
+
+  /** The propagated labels. */
+  LabelImageType * GetOutputLabelImage()
+    {
+    return this->m_OutputLabelImage.GetPointer();
+    }
+
+  /** The arrival time of the front that set each label. */
+  RealImageType * GetArrivalTimeImage()
+    {
+    return this->m_ArrivalTimeImage.GetPointer();
+    }
+
+protected:
+  MultipleLabelFastMarchingCalculator();
+  ~MultipleLabelFastMarchingCalculator() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  MultipleLabelFastMarchingCalculator( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  enum NodeStateType { FarState, TrialState, AliveState };
+
+  /** A trial node of the heap.  Nodes whose value or label no longer
+   * matches the images are stale and skipped when popped. */
+  struct NodeType
+    {
+    RealType          Value;
+    OffsetValueType   Offset;
+    LabelType         Label;
+
+    bool operator>( const NodeType & other ) const
+      {
+      return this->Value > other.Value;
+      }
+    };
+
+  typedef std::vector<NodeType>                          HeapType;
+
+  /** Solves for the arrival time of the node at the given offset and
+   * index from its accepted neighbors with the given label, and pushes
+   * the node if the time improves. */
+  void UpdateNode( OffsetValueType offset, const OffsetValueType index[],
+    LabelType label, HeapType & heap );
+
+  void ComputeIndex( OffsetValueType offset, OffsetValueType index[] ) const;
+
+  typename LabelImageType::ConstPointer            m_LabelImage;
+  typename SpeedImageType::ConstPointer            m_SpeedImage;
+  RealType                                         m_StoppingValue;
+
+  typename LabelImageType::Pointer                 m_OutputLabelImage;
+  typename RealImageType::Pointer                  m_ArrivalTimeImage;
+
+  /** Set up by Compute(). */
+  std::vector<unsigned char>                       m_States;
+  OffsetValueType                                  m_Strides[ImageDimension];
+  OffsetValueType                                  m_Size[ImageDimension];
+  double                                           m_InverseSquaredSpacing[ImageDimension];
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkMultipleLabelFastMarchingCalculator.hxx"
+#endif
+
+#endif
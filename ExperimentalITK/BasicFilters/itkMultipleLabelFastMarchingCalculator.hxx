@@ -0,0 +1,298 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkMultipleLabelFastMarchingCalculator_hxx
+#define __itkMultipleLabelFastMarchingCalculator_hxx
+
+#include "itkMultipleLabelFastMarchingCalculator.h"
+
+#include "itkNumericTraits.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace itk
+{
+
+template<class TLabelImage, class TSpeedImage>
+MultipleLabelFastMarchingCalculator<TLabelImage, TSpeedImage>
+::MultipleLabelFastMarchingCalculator()
+{
+  this->m_StoppingValue = NumericTraits<RealType>::max();
+}
+
+template<class TLabelImage, class TSpeedImage>
+void
+MultipleLabelFastMarchingCalculator<TLabelImage, TSpeedImage>
+::Compute()
+{
+  if( !this->m_LabelImage )
+    {
+    itkExceptionMacro( "The label image is not set." );
+    }
+  const RegionType region = this->m_LabelImage->GetBufferedRegion();
+  if( this->m_SpeedImage &&
+    this->m_SpeedImage->GetBufferedRegion() != region )
+    {
+    itkExceptionMacro( "The speed image and the label image must have the "
+      << "same buffered region." );
+    }
+
+  this->m_OutputLabelImage = LabelImageType::New();
+  this->m_OutputLabelImage->CopyInformation( this->m_LabelImage );
+  this->m_OutputLabelImage->SetRegions( region );
+  this->m_OutputLabelImage->Allocate();
+  this->m_OutputLabelImage->FillBuffer( NumericTraits<LabelType>::Zero );
+
+  this->m_ArrivalTimeImage = RealImageType::New();
+  this->m_ArrivalTimeImage->CopyInformation( this->m_LabelImage );
+  this->m_ArrivalTimeImage->SetRegions( region );
+  this->m_ArrivalTimeImage->Allocate();
+  this->m_ArrivalTimeImage->FillBuffer( NumericTraits<RealType>::max() );
+
+  OffsetValueType stride = 1;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    this->m_Strides[d] = stride;
+    this->m_Size[d] = region.GetSize()[d];
+    stride *= this->m_Size[d];
+    this->m_InverseSquaredSpacing[d] = 1.0 /
+      vnl_math_sqr( this->m_LabelImage->GetSpacing()[d] );
+    }
+  const OffsetValueType numberOfVoxels = stride;
+
+  this->m_States.assign( numberOfVoxels, FarState );
+
+  const LabelType *inputLabels = this->m_LabelImage->GetBufferPointer();
+  LabelType *labels = this->m_OutputLabelImage->GetBufferPointer();
+  RealType *times = this->m_ArrivalTimeImage->GetBufferPointer();
+
+  // Every labeled voxel is an accepted seed.
+  for( OffsetValueType n = 0; n < numberOfVoxels; n++ )
+    {
+    if( inputLabels[n] != NumericTraits<LabelType>::Zero )
+      {
+      labels[n] = inputLabels[n];
+      times[n] = 0.0;
+      this->m_States[n] = AliveState;
+      }
+    }
+
+  HeapType heap;
+  OffsetValueType index[ImageDimension];
+  OffsetValueType neighborIndex[ImageDimension];
+
+  // The first trial nodes are the unlabeled neighbors of the seeds.
+  for( OffsetValueType n = 0; n < numberOfVoxels; n++ )
+    {
+    if( this->m_States[n] != AliveState )
+      {
+      continue;
+      }
+    this->ComputeIndex( n, index );
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      std::copy( index, index + ImageDimension, neighborIndex );
+      for( int step = -1; step <= 1; step += 2 )
+        {
+        neighborIndex[d] = index[d] + step;
+        if( neighborIndex[d] < 0 || neighborIndex[d] >= this->m_Size[d] )
+          {
+          continue;
+          }
+        const OffsetValueType neighbor = n + step * this->m_Strides[d];
+        if( this->m_States[neighbor] != AliveState )
+          {
+          this->UpdateNode( neighbor, neighborIndex, labels[n], heap );
+          }
+        }
+      }
+    }
+
+  while( !heap.empty() )
+    {
+    std::pop_heap( heap.begin(), heap.end(), std::greater<NodeType>() );
+    const NodeType node = heap.back();
+    heap.pop_back();
+
+    if( this->m_States[node.Offset] == AliveState ||
+      node.Value != times[node.Offset] || node.Label != labels[node.Offset] )
+      {
+      continue;
+      }
+    if( node.Value > this->m_StoppingValue )
+      {
+      break;
+      }
+    this->m_States[node.Offset] = AliveState;
+
+    this->ComputeIndex( node.Offset, index );
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      std::copy( index, index + ImageDimension, neighborIndex );
+      for( int step = -1; step <= 1; step += 2 )
+        {
+        neighborIndex[d] = index[d] + step;
+        if( neighborIndex[d] < 0 || neighborIndex[d] >= this->m_Size[d] )
+          {
+          continue;
+          }
+        const OffsetValueType neighbor = node.Offset + step * this->m_Strides[d];
+        if( this->m_States[neighbor] != AliveState )
+          {
+          this->UpdateNode( neighbor, neighborIndex, node.Label, heap );
+          }
+        }
+      }
+    }
+
+  // Trial nodes beyond the stopping value are not part of the result.
+  for( OffsetValueType n = 0; n < numberOfVoxels; n++ )
+    {
+    if( this->m_States[n] != AliveState )
+      {
+      labels[n] = NumericTraits<LabelType>::Zero;
+      times[n] = NumericTraits<RealType>::max();
+      }
+    }
+  std::vector<unsigned char>().swap( this->m_States );
+}
+
+template<class TLabelImage, class TSpeedImage>
+void
+MultipleLabelFastMarchingCalculator<TLabelImage, TSpeedImage>
+::ComputeIndex( OffsetValueType offset, OffsetValueType index[] ) const
+{
+  for( int d = ImageDimension - 1; d >= 0; d-- )
+    {
+    index[d] = offset / this->m_Strides[d];
+    offset -= index[d] * this->m_Strides[d];
+    }
+}
+
+template<class TLabelImage, class TSpeedImage>
+void
+MultipleLabelFastMarchingCalculator<TLabelImage, TSpeedImage>
+::UpdateNode( OffsetValueType offset, const OffsetValueType index[],
+  LabelType label, HeapType & heap )
+{
+  double speed = 1.0;
+  if( this->m_SpeedImage )
+    {
+    speed = static_cast<double>( this->m_SpeedImage->GetBufferPointer()[offset] );
+    if( speed <= 0.0 )
+      {
+      return;
+      }
+    }
+
+  const LabelType *labels = this->m_OutputLabelImage->GetBufferPointer();
+  RealType *times = this->m_ArrivalTimeImage->GetBufferPointer();
+
+  // The smallest accepted neighbor value of the label along every axis.
+  double values[ImageDimension];
+  unsigned int axes[ImageDimension];
+  unsigned int numberOfAxes = 0;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    double value = NumericTraits<double>::max();
+    for( int step = -1; step <= 1; step += 2 )
+      {
+      const OffsetValueType neighborIndex = index[d] + step;
+      if( neighborIndex < 0 || neighborIndex >= this->m_Size[d] )
+        {
+        continue;
+        }
+      const OffsetValueType neighbor = offset + step * this->m_Strides[d];
+      if( this->m_States[neighbor] == AliveState && labels[neighbor] == label )
+        {
+        value = vnl_math_min( value, static_cast<double>( times[neighbor] ) );
+        }
+      }
+    if( value < NumericTraits<double>::max() )
+      {
+      // Insertion into the ascending list of axis values.
+      unsigned int k = numberOfAxes++;
+      while( k > 0 && values[k - 1] > value )
+        {
+        values[k] = values[k - 1];
+        axes[k] = axes[k - 1];
+        k--;
+        }
+      values[k] = value;
+      axes[k] = d;
+      }
+    }
+  if( numberOfAxes == 0 )
+    {
+    return;
+    }
+
+  // Upwind quadratic of FastMarchingImageFilter::UpdateValue().
+  double aa = 0.0;
+  double bb = 0.0;
+  double cc = -1.0 / vnl_math_sqr( speed );
+  double solution = NumericTraits<double>::max();
+  for( unsigned int k = 0; k < numberOfAxes; k++ )
+    {
+    if( solution < values[k] )
+      {
+      break;
+      }
+    const double spaceFactor = this->m_InverseSquaredSpacing[axes[k]];
+    aa += spaceFactor;
+    bb += values[k] * spaceFactor;
+    cc += vnl_math_sqr( values[k] ) * spaceFactor;
+
+    const double discriminant = vnl_math_sqr( bb ) - aa * cc;
+    if( discriminant < 0.0 )
+      {
+      break;
+      }
+    solution = ( std::sqrt( discriminant ) + bb ) / aa;
+    }
+
+  if( solution < static_cast<double>( times[offset] ) )
+    {
+    NodeType node;
+    node.Value = static_cast<RealType>( solution );
+    node.Offset = offset;
+    node.Label = label;
+
+    times[offset] = node.Value;
+    this->m_OutputLabelImage->GetBufferPointer()[offset] = label;
+    this->m_States[offset] = TrialState;
+
+    heap.push_back( node );
+    std::push_heap( heap.begin(), heap.end(), std::greater<NodeType>() );
+    }
+}
+
+template<class TLabelImage, class TSpeedImage>
+void
+MultipleLabelFastMarchingCalculator<TLabelImage, TSpeedImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Stopping value: " << this->m_StoppingValue << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,186 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkPackedBinaryMorphologyImageFilter_h
+#define __itkPackedBinaryMorphologyImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkIntTypes.h"
+#include "itkMultiThreader.h"
+
+#include <vector>
+
+namespace itk
+{
+/** \class PackedBinaryMorphologyImageFilter
+ * \brief Binary dilation, erosion, closing and opening with large box,
+ * ball or diamond structuring elements.
+ *
+ * The foreground is packed into 64-bit words along the first image axis.
+ * Dilation by a box is applied separably along each axis as a segment
+ * dilation computed with O(log radius) shift-OR passes.  Dilation by a
+ * diamond is the radius-fold dilation by the unit cross.  Dilation by a
+ * ball thresholds the squared Euclidean distance transform (in index
+ * space) of the foreground at radius*(radius+1), which selects the same
+ * offsets as BinaryBallStructuringElement.  Erosion is the complement of
+ * the dilation of the complement.  All passes are multithreaded over rows
+ * or lines.
+ *
+ * The output follows BinaryDilateImageFilter and BinaryErodeImageFilter:
+ * pixels in the result are set to the foreground value, foreground pixels
+ * that are not in the result are set to the background value, and other
+ * pixels keep their input value.  Pixels outside the image are background
+ * for dilation and foreground for erosion, and closing pads the image by
+ * the radius (as BinaryMorphologicalClosingImageFilter with SafeBorder).
+ */
+template<class TInputImage, class TOutputImage = TInputImage>
+class ITK_EXPORT PackedBinaryMorphologyImageFilter :
+  public ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef PackedBinaryMorphologyImageFilter               Self;
+  typedef ImageToImageFilter<TInputImage, TOutputImage>   Superclass;
+  typedef SmartPointer<Self>                              Pointer;
+  typedef SmartPointer<const Self>                        ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( PackedBinaryMorphologyImageFilter, ImageToImageFilter );
+
+  /** Extract dimension from input image. */
+  itkStaticConstMacro( ImageDimension, unsigned int,
+                       TInputImage::ImageDimension );
+
+  /** Convenient typedefs for simplifying declarations. */
+  typedef TInputImage                              InputImageType;
+  typedef TOutputImage                             OutputImageType;
+  typedef typename InputImageType::PixelType       InputPixelType;
+  typedef typename OutputImageType::PixelType      OutputPixelType;
+  typedef typename InputImageType::RegionType      RegionType;
+
+  /** Operations, numbered as in the BinaryMorphology tool. */
+  enum OperationType { Dilate = 0, Erode = 1, Close = 2, Open = 3 };
+
+  /** Structuring elements, numbered as in the BinaryMorphology tool. */
+  enum StructuringElementType { Box = 0, Ball = 1, Diamond = 2 };
+
+  itkSetMacro( Operation, unsigned int );
+  itkGetConstMacro( Operation, unsigned int );
+
+  itkSetMacro( StructuringElement, unsigned int );
+  itkGetConstMacro( StructuringElement, unsigned int );
+
+  itkSetMacro( Radius, unsigned int );
+  itkGetConstMacro( Radius, unsigned int );
+
+  itkSetMacro( ForegroundValue, InputPixelType );
+  itkGetConstMacro( ForegroundValue, InputPixelType );
+
+  itkSetMacro( BackgroundValue, OutputPixelType );
+  itkGetConstMacro( BackgroundValue, OutputPixelType );
+
+protected:
+  PackedBinaryMorphologyImageFilter();
+  ~PackedBinaryMorphologyImageFilter() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  void GenerateInputRequestedRegion();
+
+  void EnlargeOutputRequestedRegion( DataObject * );
+
+  void GenerateData();
+
+private:
+  PackedBinaryMorphologyImageFilter( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  typedef uint64_t                                 WordType;
+
+  enum PassType { RowSegment, LineSegment, Cross, RowDistance,
+    LineDistance, Threshold };
+
+  struct PassThreadStruct
+    {
+    PackedBinaryMorphologyImageFilter *Filter;
+    PassType                           Pass;
+    unsigned int                       Axis;
+    };
+
+  static ITK_THREAD_RETURN_TYPE PassThreaderCallback( void *arg );
+
+  /** Runs one pass over all rows or lines with the multithreader. */
+  void ExecutePass( PassType, unsigned int axis = 0 );
+
+  void ThreadedPass( PassType, unsigned int, unsigned int, unsigned int );
+
+  void DilateBits();
+  void ErodeBits();
+  void ComplementBits();
+
+  /** Segment dilation of one row of bits, or of one line of rows along
+   * axis > 0. */
+  void DilateRowSegment( unsigned long row, std::vector<WordType> & );
+  void DilateLineSegment( unsigned long line, unsigned int axis,
+    std::vector<WordType> & );
+
+  /** Dilation of one row by the unit cross, into m_Buffer. */
+  void DilateRowCross( unsigned long row );
+
+  /** Squared distance transforms of one row and one line. */
+  void ComputeRowDistance( unsigned long row );
+  void ComputeLineDistance( unsigned long line, unsigned int axis,
+    std::vector<unsigned long> &, std::vector<double> &,
+    std::vector<double> & );
+
+  /** dst |= src shifted by shift bits toward higher (ShiftUpOr) or lower
+   * (ShiftDownOr) indices.  ShiftUpOr may be applied in place. */
+  static void ShiftUpOr( const WordType *src, unsigned long srcWords,
+    unsigned long shift, WordType *dst, unsigned long dstWords );
+  static void ShiftDownOr( const WordType *src, unsigned long srcWords,
+    unsigned long shift, WordType *dst, unsigned long dstWords );
+
+  /** First row of a line along axis > 0. */
+  unsigned long GetLineStartRow( unsigned long line, unsigned int axis ) const;
+
+  unsigned int                        m_Operation;
+  unsigned int                        m_StructuringElement;
+  unsigned int                        m_Radius;
+  InputPixelType                      m_ForegroundValue;
+  OutputPixelType                     m_BackgroundValue;
+
+  /** Packed (padded) foreground.  Row r of the volume starts at word
+   * r * m_WordsPerRow and the rows are ordered by axes 1, ..., N-1. */
+  unsigned long                       m_PaddedSize[ImageDimension];
+  unsigned long                       m_RowStrides[ImageDimension];
+  unsigned long                       m_WordsPerRow;
+  unsigned long                       m_NumberOfRows;
+  std::vector<WordType>               m_Bits;
+  std::vector<WordType>               m_Buffer;
+  WordType                            m_LastWordMask;
+  std::vector<unsigned int>           m_SquaredDistances;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkPackedBinaryMorphologyImageFilter.hxx"
+#endif
+
+#endif
@@ -0,0 +1,717 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkPackedBinaryMorphologyImageFilter_hxx
+#define __itkPackedBinaryMorphologyImageFilter_hxx
+
+#include "itkPackedBinaryMorphologyImageFilter.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
+#include "itkNumericTraits.h"
+
+namespace itk
+{
+
+template<class TInputImage, class TOutputImage>
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::PackedBinaryMorphologyImageFilter()
+{
+  this->m_Operation = Dilate;
+  this->m_StructuringElement = Ball;
+  this->m_Radius = 1;
+  this->m_ForegroundValue = NumericTraits<InputPixelType>::max();
+  this->m_BackgroundValue = NumericTraits<OutputPixelType>::Zero;
+
+  this->m_WordsPerRow = 0;
+  this->m_NumberOfRows = 0;
+  this->m_LastWordMask = 0;
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+
+  InputImageType *input = const_cast<InputImageType *>( this->GetInput() );
+  if( input )
+    {
+    input->SetRequestedRegionToLargestPossibleRegion();
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::EnlargeOutputRequestedRegion( DataObject *output )
+{
+  Superclass::EnlargeOutputRequestedRegion( output );
+  output->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::GenerateData()
+{
+  this->AllocateOutputs();
+
+  const InputImageType *input = this->GetInput();
+  OutputImageType *output = this->GetOutput();
+
+  const RegionType region = input->GetLargestPossibleRegion();
+  const typename RegionType::IndexType start = region.GetIndex();
+
+  /**
+   * Pack the foreground.  Closing pads the image by the radius so that the
+   * dilated foreground can extend beyond the image before it is eroded.
+   */
+  const unsigned long padding =
+    ( this->m_Operation == Close ) ? this->m_Radius : 0;
+
+  this->m_NumberOfRows = 1;
+  this->m_RowStrides[0] = 0;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    this->m_PaddedSize[d] = region.GetSize()[d] + 2 * padding;
+    if( d > 0 )
+      {
+      this->m_RowStrides[d] = this->m_NumberOfRows;
+      this->m_NumberOfRows *= this->m_PaddedSize[d];
+      }
+    }
+  this->m_WordsPerRow = ( this->m_PaddedSize[0] + 63 ) / 64;
+  this->m_LastWordMask = ~static_cast<WordType>( 0 );
+  if( this->m_PaddedSize[0] % 64 != 0 )
+    {
+    this->m_LastWordMask = ( static_cast<WordType>( 1 )
+      << ( this->m_PaddedSize[0] % 64 ) ) - 1;
+    }
+
+  this->m_Bits.assign( this->m_NumberOfRows * this->m_WordsPerRow, 0 );
+
+  ImageRegionConstIteratorWithIndex<InputImageType> ItI( input, region );
+  for( ItI.GoToBegin(); !ItI.IsAtEnd(); ++ItI )
+    {
+    if( ItI.Get() != this->m_ForegroundValue )
+      {
+      continue;
+      }
+    const typename RegionType::IndexType index = ItI.GetIndex();
+    unsigned long x = index[0] - start[0] + padding;
+    unsigned long row = 0;
+    for( unsigned int d = 1; d < ImageDimension; d++ )
+      {
+      row += ( index[d] - start[d] + padding ) * this->m_RowStrides[d];
+      }
+    this->m_Bits[row * this->m_WordsPerRow + x / 64] |=
+      static_cast<WordType>( 1 ) << ( x % 64 );
+    }
+
+  switch( this->m_Operation )
+    {
+    case Dilate:
+      {
+      this->DilateBits();
+      break;
+      }
+    case Erode:
+      {
+      this->ErodeBits();
+      break;
+      }
+    case Close:
+      {
+      this->DilateBits();
+      this->ErodeBits();
+      break;
+      }
+    case Open:
+      {
+      this->ErodeBits();
+      this->DilateBits();
+      break;
+      }
+    default:
+      {
+      itkExceptionMacro( "Unknown operation " << this->m_Operation );
+      }
+    }
+  this->m_Buffer.clear();
+
+  /**
+   * Unpack the result.
+   */
+  const OutputPixelType foregroundValue =
+    static_cast<OutputPixelType>( this->m_ForegroundValue );
+
+  ImageRegionIterator<OutputImageType> ItO( output, region );
+  for( ItI.GoToBegin(), ItO.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++ItO )
+    {
+    const typename RegionType::IndexType index = ItI.GetIndex();
+    unsigned long x = index[0] - start[0] + padding;
+    unsigned long row = 0;
+    for( unsigned int d = 1; d < ImageDimension; d++ )
+      {
+      row += ( index[d] - start[d] + padding ) * this->m_RowStrides[d];
+      }
+    bool isOn = ( this->m_Bits[row * this->m_WordsPerRow + x / 64]
+      >> ( x % 64 ) ) & 1;
+
+    if( isOn )
+      {
+      ItO.Set( foregroundValue );
+      }
+    else if( ItI.Get() == this->m_ForegroundValue )
+      {
+      ItO.Set( this->m_BackgroundValue );
+      }
+    else
+      {
+      ItO.Set( static_cast<OutputPixelType>( ItI.Get() ) );
+      }
+    }
+  this->m_Bits.clear();
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::DilateBits()
+{
+  if( this->m_Radius == 0 )
+    {
+    return;
+    }
+
+  switch( this->m_StructuringElement )
+    {
+    case Box:
+      {
+      this->ExecutePass( RowSegment );
+      for( unsigned int d = 1; d < ImageDimension; d++ )
+        {
+        this->ExecutePass( LineSegment, d );
+        }
+      break;
+      }
+    case Diamond:
+      {
+      // The diamond of radius r is the r-fold dilation by the unit cross.
+      this->m_Buffer.resize( this->m_Bits.size() );
+      for( unsigned int i = 0; i < this->m_Radius; i++ )
+        {
+        this->ExecutePass( Cross );
+        this->m_Bits.swap( this->m_Buffer );
+        }
+      break;
+      }
+    case Ball:
+      {
+      this->m_SquaredDistances.resize(
+        this->m_NumberOfRows * this->m_PaddedSize[0] );
+      this->ExecutePass( RowDistance );
+      for( unsigned int d = 1; d < ImageDimension; d++ )
+        {
+        this->ExecutePass( LineDistance, d );
+        }
+      this->ExecutePass( Threshold );
+      std::vector<unsigned int>().swap( this->m_SquaredDistances );
+      break;
+      }
+    default:
+      {
+      itkExceptionMacro( "Unknown structuring element "
+        << this->m_StructuringElement );
+      }
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::ErodeBits()
+{
+  this->ComplementBits();
+  this->DilateBits();
+  this->ComplementBits();
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::ComplementBits()
+{
+  for( unsigned long row = 0; row < this->m_NumberOfRows; row++ )
+    {
+    WordType *words = &this->m_Bits[row * this->m_WordsPerRow];
+    for( unsigned long w = 0; w < this->m_WordsPerRow; w++ )
+      {
+      words[w] = ~words[w];
+      }
+    words[this->m_WordsPerRow - 1] &= this->m_LastWordMask;
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::ExecutePass( PassType pass, unsigned int axis )
+{
+  PassThreadStruct str;
+  str.Filter = this;
+  str.Pass = pass;
+  str.Axis = axis;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( this->GetNumberOfThreads() );
+  threader->SetSingleMethod( this->PassThreaderCallback, &str );
+  threader->SingleMethodExecute();
+}
+
+template<class TInputImage, class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::PassThreaderCallback( void *arg )
+{
+  unsigned int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  unsigned int threadCount =
+    ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  PassThreadStruct *str = (PassThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  str->Filter->ThreadedPass( str->Pass, str->Axis, threadId, threadCount );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::ThreadedPass( PassType pass, unsigned int axis, unsigned int threadId,
+  unsigned int numberOfThreads )
+{
+  // Rows are independent for the row passes, lines of rows along the axis
+  // for the line passes.
+  unsigned long numberOfItems = this->m_NumberOfRows;
+  if( pass == LineSegment || pass == LineDistance )
+    {
+    numberOfItems /= this->m_PaddedSize[axis];
+    }
+  const unsigned long begin = numberOfItems * threadId / numberOfThreads;
+  const unsigned long end = numberOfItems * ( threadId + 1 ) / numberOfThreads;
+
+  std::vector<WordType> words;
+  std::vector<unsigned long> v;
+  std::vector<double> z;
+  std::vector<double> f;
+
+  const unsigned long threshold = static_cast<unsigned long>( this->m_Radius )
+    * static_cast<unsigned long>( this->m_Radius + 1 );
+
+  for( unsigned long item = begin; item < end; item++ )
+    {
+    switch( pass )
+      {
+      case RowSegment:
+        {
+        this->DilateRowSegment( item, words );
+        break;
+        }
+      case LineSegment:
+        {
+        this->DilateLineSegment( item, axis, words );
+        break;
+        }
+      case Cross:
+        {
+        this->DilateRowCross( item );
+        break;
+        }
+      case RowDistance:
+        {
+        this->ComputeRowDistance( item );
+        break;
+        }
+      case LineDistance:
+        {
+        this->ComputeLineDistance( item, axis, v, z, f );
+        break;
+        }
+      case Threshold:
+        {
+        WordType *row = &this->m_Bits[item * this->m_WordsPerRow];
+        const unsigned int *distances =
+          &this->m_SquaredDistances[item * this->m_PaddedSize[0]];
+        for( unsigned long w = 0; w < this->m_WordsPerRow; w++ )
+          {
+          row[w] = 0;
+          }
+        for( unsigned long x = 0; x < this->m_PaddedSize[0]; x++ )
+          {
+          if( distances[x] <= threshold )
+            {
+            row[x / 64] |= static_cast<WordType>( 1 ) << ( x % 64 );
+            }
+          }
+        break;
+        }
+      }
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::ShiftUpOr( const WordType *src, unsigned long srcWords, unsigned long shift,
+  WordType *dst, unsigned long dstWords )
+{
+  const long q = static_cast<long>( shift / 64 );
+  const unsigned int b = shift % 64;
+
+  // Descending so that the shift can be done in place.
+  for( long w = static_cast<long>( dstWords ) - 1; w >= 0; w-- )
+    {
+    const long i = w - q;
+    WordType value = 0;
+    if( i >= 0 && i < static_cast<long>( srcWords ) )
+      {
+      value |= ( b > 0 ) ? ( src[i] << b ) : src[i];
+      }
+    if( b > 0 && i - 1 >= 0 && i - 1 < static_cast<long>( srcWords ) )
+      {
+      value |= src[i - 1] >> ( 64 - b );
+      }
+    dst[w] |= value;
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::ShiftDownOr( const WordType *src, unsigned long srcWords, unsigned long shift,
+  WordType *dst, unsigned long dstWords )
+{
+  const unsigned long q = shift / 64;
+  const unsigned int b = shift % 64;
+
+  for( unsigned long w = 0; w < dstWords; w++ )
+    {
+    const unsigned long i = w + q;
+    WordType value = 0;
+    if( i < srcWords )
+      {
+      value |= ( b > 0 ) ? ( src[i] >> b ) : src[i];
+      }
+    if( b > 0 && i + 1 < srcWords )
+      {
+      value |= src[i + 1] << ( 64 - b );
+      }
+    dst[w] |= value;
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::DilateRowSegment( unsigned long row, std::vector<WordType> & temp )
+{
+  /**
+   * With the row shifted into a buffer padded by r zero bits on both sides,
+   * doubling gives cur[i] = OR of bits i-len+1, ..., i for the largest power
+   * of two len <= 2r+1 (so len > r) and the dilated bit j is
+   * cur[j+2r] | cur[j+len-1].
+   */
+  const unsigned long r = this->m_Radius;
+  const unsigned long tempWords = ( this->m_PaddedSize[0] + 2 * r + 63 ) / 64;
+
+  WordType *words = &this->m_Bits[row * this->m_WordsPerRow];
+
+  temp.assign( tempWords, 0 );
+  ShiftUpOr( words, this->m_WordsPerRow, r, &temp[0], tempWords );
+
+  unsigned long len = 1;
+  while( 2 * len <= 2 * r + 1 )
+    {
+    ShiftUpOr( &temp[0], tempWords, len, &temp[0], tempWords );
+    len *= 2;
+    }
+
+  for( unsigned long w = 0; w < this->m_WordsPerRow; w++ )
+    {
+    words[w] = 0;
+    }
+  ShiftDownOr( &temp[0], tempWords, 2 * r, words, this->m_WordsPerRow );
+  ShiftDownOr( &temp[0], tempWords, len - 1, words, this->m_WordsPerRow );
+  words[this->m_WordsPerRow - 1] &= this->m_LastWordMask;
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::DilateLineSegment( unsigned long line, unsigned int axis,
+  std::vector<WordType> & temp )
+{
+  /**
+   * Same doubling as DilateRowSegment() with whole rows as elements.
+   */
+  const unsigned long r = this->m_Radius;
+  const unsigned long W = this->m_WordsPerRow;
+  const unsigned long size = this->m_PaddedSize[axis];
+  const unsigned long stride = this->m_RowStrides[axis];
+  const unsigned long startRow = this->GetLineStartRow( line, axis );
+  const unsigned long length = size + 2 * r;
+
+  temp.assign( length * W, 0 );
+  for( unsigned long j = 0; j < size; j++ )
+    {
+    const WordType *words = &this->m_Bits[( startRow + j * stride ) * W];
+    WordType *t = &temp[( j + r ) * W];
+    for( unsigned long w = 0; w < W; w++ )
+      {
+      t[w] = words[w];
+      }
+    }
+
+  unsigned long len = 1;
+  while( 2 * len <= 2 * r + 1 )
+    {
+    for( unsigned long t = length - 1; t >= len; t-- )
+      {
+      WordType *dst = &temp[t * W];
+      const WordType *src = &temp[( t - len ) * W];
+      for( unsigned long w = 0; w < W; w++ )
+        {
+        dst[w] |= src[w];
+        }
+      }
+    len *= 2;
+    }
+
+  for( unsigned long j = 0; j < size; j++ )
+    {
+    WordType *words = &this->m_Bits[( startRow + j * stride ) * W];
+    const WordType *a = &temp[( j + 2 * r ) * W];
+    const WordType *b = &temp[( j + len - 1 ) * W];
+    for( unsigned long w = 0; w < W; w++ )
+      {
+      words[w] = a[w] | b[w];
+      }
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::DilateRowCross( unsigned long row )
+{
+  const unsigned long W = this->m_WordsPerRow;
+  const WordType *src = &this->m_Bits[row * W];
+  WordType *dst = &this->m_Buffer[row * W];
+
+  for( unsigned long w = 0; w < W; w++ )
+    {
+    WordType value = src[w] | ( src[w] << 1 ) | ( src[w] >> 1 );
+    if( w > 0 )
+      {
+      value |= src[w - 1] >> 63;
+      }
+    if( w + 1 < W )
+      {
+      value |= src[w + 1] << 63;
+      }
+    dst[w] = value;
+    }
+
+  for( unsigned int d = 1; d < ImageDimension; d++ )
+    {
+    const unsigned long stride = this->m_RowStrides[d];
+    const unsigned long c = ( row / stride ) % this->m_PaddedSize[d];
+    if( c > 0 )
+      {
+      const WordType *neighbor = &this->m_Bits[( row - stride ) * W];
+      for( unsigned long w = 0; w < W; w++ )
+        {
+        dst[w] |= neighbor[w];
+        }
+      }
+    if( c + 1 < this->m_PaddedSize[d] )
+      {
+      const WordType *neighbor = &this->m_Bits[( row + stride ) * W];
+      for( unsigned long w = 0; w < W; w++ )
+        {
+        dst[w] |= neighbor[w];
+        }
+      }
+    }
+  dst[W - 1] &= this->m_LastWordMask;
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::ComputeRowDistance( unsigned long row )
+{
+  const unsigned long size = this->m_PaddedSize[0];
+  const WordType *words = &this->m_Bits[row * this->m_WordsPerRow];
+  unsigned int *distances = &this->m_SquaredDistances[row * size];
+
+  const unsigned int infinity = NumericTraits<unsigned int>::max();
+
+  long last = -1;
+  for( unsigned long x = 0; x < size; x++ )
+    {
+    if( ( words[x / 64] >> ( x % 64 ) ) & 1 )
+      {
+      last = static_cast<long>( x );
+      }
+    distances[x] = ( last < 0 ) ? infinity
+      : static_cast<unsigned int>( x - last );
+    }
+  last = -1;
+  for( long x = static_cast<long>( size ) - 1; x >= 0; x-- )
+    {
+    if( ( words[x / 64] >> ( x % 64 ) ) & 1 )
+      {
+      last = x;
+      }
+    if( last >= 0 && static_cast<unsigned int>( last - x ) < distances[x] )
+      {
+      distances[x] = static_cast<unsigned int>( last - x );
+      }
+    if( distances[x] != infinity )
+      {
+      distances[x] *= distances[x];
+      }
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::ComputeLineDistance( unsigned long line, unsigned int axis,
+  std::vector<unsigned long> & v, std::vector<double> & z,
+  std::vector<double> & f )
+{
+  /**
+   * Lower envelope of parabolas (Felzenszwalb and Huttenlocher) along the
+   * axis, for every x of the line of rows.
+   */
+  const unsigned long size = this->m_PaddedSize[axis];
+  const unsigned long rowSize = this->m_PaddedSize[0];
+  const unsigned long stride = this->m_RowStrides[axis];
+  const unsigned long startRow = this->GetLineStartRow( line, axis );
+
+  const unsigned int infinity = NumericTraits<unsigned int>::max();
+
+  v.resize( size );
+  z.resize( size + 1 );
+  f.resize( size );
+
+  for( unsigned long x = 0; x < rowSize; x++ )
+    {
+    long k = -1;
+    for( unsigned long q = 0; q < size; q++ )
+      {
+      unsigned int value = this->m_SquaredDistances[
+        ( startRow + q * stride ) * rowSize + x];
+      if( value == infinity )
+        {
+        continue;
+        }
+      f[q] = static_cast<double>( value );
+
+      const double fq = f[q] + static_cast<double>( q ) * q;
+      while( k >= 0 )
+        {
+        const double s = ( fq - ( f[v[k]] + static_cast<double>( v[k] ) * v[k] ) )
+          / ( 2.0 * ( static_cast<double>( q ) - static_cast<double>( v[k] ) ) );
+        if( s <= z[k] )
+          {
+          k--;
+          }
+        else
+          {
+          k++;
+          v[k] = q;
+          z[k] = s;
+          z[k + 1] = NumericTraits<double>::max();
+          break;
+          }
+        }
+      if( k < 0 )
+        {
+        k = 0;
+        v[0] = q;
+        z[0] = NumericTraits<double>::NonpositiveMin();
+        z[1] = NumericTraits<double>::max();
+        }
+      }
+    if( k < 0 )
+      {
+      continue;
+      }
+
+    k = 0;
+    for( unsigned long q = 0; q < size; q++ )
+      {
+      while( z[k + 1] < static_cast<double>( q ) )
+        {
+        k++;
+        }
+      const double dq = static_cast<double>( q ) - static_cast<double>( v[k] );
+      this->m_SquaredDistances[( startRow + q * stride ) * rowSize + x] =
+        static_cast<unsigned int>( dq * dq + f[v[k]] );
+      }
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+unsigned long
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::GetLineStartRow( unsigned long line, unsigned int axis ) const
+{
+  const unsigned long stride = this->m_RowStrides[axis];
+  return ( line % stride ) + ( line / stride ) * stride
+    * this->m_PaddedSize[axis];
+}
+
+template<class TInputImage, class TOutputImage>
+void
+PackedBinaryMorphologyImageFilter<TInputImage, TOutputImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Operation: " << this->m_Operation << std::endl;
+  os << indent << "Structuring element: "
+     << this->m_StructuringElement << std::endl;
+  os << indent << "Radius: " << this->m_Radius << std::endl;
+  os << indent << "Foreground value: "
+     << static_cast<typename NumericTraits<InputPixelType>::PrintType>(
+       this->m_ForegroundValue ) << std::endl;
+  os << indent << "Background value: "
+     << static_cast<typename NumericTraits<OutputPixelType>::PrintType>(
+       this->m_BackgroundValue ) << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,223 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkPatchMatchDenoisingImageFilter_h
+#define __itkPatchMatchDenoisingImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkMultiThreader.h"
+
+#include <vector>
+
+namespace itk
+{
+
+/**
+ * \class PatchMatchDenoisingImageFilter
+ *
+ * \brief Non-local means denoising with PatchMatch candidate search.
+ *
+ * \par
+ * Instead of comparing each voxel's patch with a random sample of
+ * candidates drawn from the search window, a field of the K most similar
+ * patches per voxel is maintained and improved with PatchMatch iterations:
+ * good matches are propagated from the already visited neighbors (the scan
+ * direction alternates between iterations) and refined with a random search
+ * of exponentially decreasing radius around the current best match.  The
+ * output is the weighted average of the centers of the K matches
+ * (w = exp( -d / ( 2 * beta * sigma^2 * |patch| ) ), with the center voxel
+ * given the maximum neighbor weight).
+ *
+ * \par
+ * Patch sums and sums of squares are precomputed once with separable
+ * integral (cumulative sum) passes so that the exact lower bound
+ *   ||p - q||^2 >= |patch| * ( mean_p - mean_q )^2 + ( ||p~|| - ||q~|| )^2,
+ * where p~ and q~ are the mean-removed patches, rejects dissimilar
+ * candidates without touching their patches.  Remaining candidates are
+ * compared row by row on a padded, contiguous copy of the image and the
+ * comparison stops as soon as the current K-th best distance is exceeded.
+ *
+ * \par
+ * The noise standard deviation is estimated from pseudo-residuals (median
+ * absolute value) unless it is specified.  For the Rician noise model the
+ * squared magnitudes are averaged and bias corrected.  Results are
+ * reproducible for a given random seed and number of threads.
+ */
+
+template <class TInputImage, class TOutputImage = TInputImage>
+class PatchMatchDenoisingImageFilter
+  : public ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  typedef PatchMatchDenoisingImageFilter                Self;
+  typedef ImageToImageFilter<TInputImage, TOutputImage> Superclass;
+  typedef SmartPointer<Self>                            Pointer;
+  typedef SmartPointer<const Self>                      ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( PatchMatchDenoisingImageFilter, ImageToImageFilter );
+
+  /** Extract dimension from input image. */
+  itkStaticConstMacro( ImageDimension, unsigned int,
+    TInputImage::ImageDimension );
+
+  /** Image typedef support. */
+  typedef TInputImage                             InputImageType;
+  typedef TOutputImage                            OutputImageType;
+  typedef typename OutputImageType::PixelType     OutputPixelType;
+  typedef typename OutputImageType::RegionType    RegionType;
+  typedef typename OutputImageType::IndexType     IndexType;
+  typedef typename OutputImageType::SizeType      SizeType;
+  typedef typename OutputImageType::OffsetType    OffsetType;
+
+  /** Other typedef */
+  typedef float                                   RealType;
+
+  typedef enum { GAUSSIAN, RICIAN }               NoiseModelType;
+
+  /** Set/Get the (isotropic) patch radius.  Default = 1. */
+  itkSetMacro( PatchRadius, unsigned int );
+  itkGetConstMacro( PatchRadius, unsigned int );
+
+  /** Set/Get the (isotropic) radius of the search window in voxels.  The
+   * offsets are packed in 8 bits per dimension so the radius is limited to
+   * 126.  Default = 5. */
+  itkSetClampMacro( SearchRadius, unsigned int, 1, 126 );
+  itkGetConstMacro( SearchRadius, unsigned int );
+
+  /** Set/Get the number of matches kept per voxel.  Default = 8. */
+  itkSetClampMacro( NumberOfNearestNeighbors, unsigned int, 1, 64 );
+  itkGetConstMacro( NumberOfNearestNeighbors, unsigned int );
+
+  /** Set/Get the number of propagation/random search sweeps.  Default = 4. */
+  itkSetMacro( NumberOfPatchMatchIterations, unsigned int );
+  itkGetConstMacro( NumberOfPatchMatchIterations, unsigned int );
+
+  /** Set/Get the smoothing factor (beta) which multiplies the estimated
+   * noise variance in the weights.  Default = 1.0. */
+  itkSetMacro( SmoothingFactor, RealType );
+  itkGetConstMacro( SmoothingFactor, RealType );
+
+  /** Set/Get the noise standard deviation.  A non-positive value means
+   * that it is estimated from the input.  Default = 0. */
+  itkSetMacro( NoiseSigma, RealType );
+  itkGetConstMacro( NoiseSigma, RealType );
+
+  /** Get the noise standard deviation used in the last update. */
+  itkGetConstMacro( EstimatedNoiseSigma, RealType );
+
+  /** Set/Get the noise model.  Default = GAUSSIAN. */
+  itkSetMacro( NoiseModel, NoiseModelType );
+  itkGetConstMacro( NoiseModel, NoiseModelType );
+
+  /** Set/Get the seed of the random search.  Default = 19650218. */
+  itkSetMacro( RandomSeed, unsigned int );
+  itkGetConstMacro( RandomSeed, unsigned int );
+
+protected:
+  PatchMatchDenoisingImageFilter();
+  virtual ~PatchMatchDenoisingImageFilter();
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  /** The whole image is needed to search for matching patches. */
+  void GenerateInputRequestedRegion();
+  void EnlargeOutputRequestedRegion( DataObject * );
+
+  void GenerateData();
+
+private:
+  PatchMatchDenoisingImageFilter( const Self& ); //purposely not implemented
+  void operator=( const Self& );                 //purposely not implemented
+
+  typedef enum { INITIALIZE, PROPAGATE, AVERAGE } PassType;
+
+  struct PatchMatchThreadStruct
+    {
+    PatchMatchDenoisingImageFilter *Filter;
+    PassType                        Pass;
+    unsigned int                    Iteration;
+    };
+
+  void PadInputImage();
+  void ComputePatchStatistics();
+  void EstimateNoiseSigma();
+
+  void ExecutePass( PassType, unsigned int );
+  static ITK_THREAD_RETURN_TYPE PassThreaderCallback( void *arg );
+
+  void ThreadedInitialize( unsigned long, unsigned long, ThreadIdType );
+  void ThreadedPropagate( unsigned long, unsigned long, ThreadIdType,
+    unsigned int );
+  void ThreadedAverage( unsigned long, unsigned long );
+
+  /** Evaluate the offset as a match for voxel n and insert it in the
+   * sorted list of matches if it improves on the current K-th best. */
+  void TryCandidate( unsigned long, const IndexType &, const OffsetType & );
+
+  /** Squared patch distance with early termination above the threshold. */
+  RealType ComputePatchDistance( unsigned long, unsigned long,
+    RealType ) const;
+
+  IndexType ComputeIndex( unsigned long ) const;
+  unsigned long ComputePaddedOffset( const IndexType & ) const;
+
+  unsigned int EncodeOffset( const OffsetType & ) const;
+  OffsetType DecodeOffset( unsigned int ) const;
+
+  static unsigned int GenerateRandomNumber( unsigned int & );
+
+  unsigned int                                  m_PatchRadius;
+  unsigned int                                  m_SearchRadius;
+  unsigned int                                  m_NumberOfNearestNeighbors;
+  unsigned int                                  m_NumberOfPatchMatchIterations;
+  RealType                                      m_SmoothingFactor;
+  RealType                                      m_NoiseSigma;
+  RealType                                      m_EstimatedNoiseSigma;
+  NoiseModelType                                m_NoiseModel;
+  unsigned int                                  m_RandomSeed;
+
+  /** Mirror-padded copy of the input and its layout. */
+  std::vector<RealType>                         m_PaddedImage;
+  unsigned long                                 m_PaddedStride[ImageDimension];
+  unsigned long                                 m_ImageStride[ImageDimension];
+  SizeType                                      m_ImageSize;
+  unsigned long                                 m_NumberOfPixels;
+
+  /** Offsets (in the padded image) of the first voxel of each patch row. */
+  std::vector<long>                             m_PatchRowOffsets;
+  unsigned int                                  m_PatchRowLength;
+  unsigned long                                 m_NumberOfPatchVoxels;
+
+  /** Per-voxel patch means and norms of the mean-removed patches. */
+  std::vector<RealType>                         m_PatchMeans;
+  std::vector<RealType>                         m_PatchNorms;
+
+  /** K sorted matches per voxel (packed offsets and squared distances). */
+  std::vector<unsigned int>                     m_MatchOffsets;
+  std::vector<RealType>                         m_MatchDistances;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkPatchMatchDenoisingImageFilter.hxx"
+#endif
+
+#endif
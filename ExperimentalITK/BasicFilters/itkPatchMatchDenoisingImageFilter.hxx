@@ -0,0 +1,772 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkPatchMatchDenoisingImageFilter_hxx
+#define __itkPatchMatchDenoisingImageFilter_hxx
+
+#include "itkPatchMatchDenoisingImageFilter.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+template <class TInputImage, class TOutputImage>
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::PatchMatchDenoisingImageFilter()
+{
+  this->m_PatchRadius = 1;
+  this->m_SearchRadius = 5;
+  this->m_NumberOfNearestNeighbors = 8;
+  this->m_NumberOfPatchMatchIterations = 4;
+  this->m_SmoothingFactor = 1.0;
+  this->m_NoiseSigma = 0.0;
+  this->m_EstimatedNoiseSigma = 0.0;
+  this->m_NoiseModel = GAUSSIAN;
+  this->m_RandomSeed = 19650218;
+
+  this->m_NumberOfPixels = 0;
+  this->m_PatchRowLength = 0;
+  this->m_NumberOfPatchVoxels = 0;
+}
+
+template <class TInputImage, class TOutputImage>
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::~PatchMatchDenoisingImageFilter()
+{
+}
+
+template <class TInputImage, class TOutputImage>
+void
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+
+  InputImageType *input = const_cast<InputImageType *>( this->GetInput() );
+  if( input )
+    {
+    input->SetRequestedRegionToLargestPossibleRegion();
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::EnlargeOutputRequestedRegion( DataObject *output )
+{
+  Superclass::EnlargeOutputRequestedRegion( output );
+  output->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template <class TInputImage, class TOutputImage>
+void
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::GenerateData()
+{
+  if( ImageDimension > 4 )
+    {
+    itkExceptionMacro( "Offsets are packed for at most 4 dimensions." );
+    }
+
+  this->AllocateOutputs();
+
+  this->PadInputImage();
+  this->ComputePatchStatistics();
+
+  if( this->m_NoiseSigma > 0.0 )
+    {
+    this->m_EstimatedNoiseSigma = this->m_NoiseSigma;
+    }
+  else
+    {
+    this->EstimateNoiseSigma();
+    }
+  itkDebugMacro( "Noise sigma = " << this->m_EstimatedNoiseSigma );
+
+  unsigned long numberOfMatches = this->m_NumberOfPixels *
+    this->m_NumberOfNearestNeighbors;
+  this->m_MatchOffsets.assign( numberOfMatches,
+    NumericTraits<unsigned int>::max() );
+  this->m_MatchDistances.assign( numberOfMatches,
+    NumericTraits<RealType>::max() );
+
+  this->ExecutePass( INITIALIZE, 0 );
+  for( unsigned int n = 0; n < this->m_NumberOfPatchMatchIterations; n++ )
+    {
+    this->ExecutePass( PROPAGATE, n );
+    this->UpdateProgress( static_cast<float>( n + 1 ) /
+      static_cast<float>( this->m_NumberOfPatchMatchIterations + 1 ) );
+    }
+  this->ExecutePass( AVERAGE, 0 );
+
+  this->m_PaddedImage.clear();
+  this->m_PatchMeans.clear();
+  this->m_PatchNorms.clear();
+  this->m_MatchOffsets.clear();
+  this->m_MatchDistances.clear();
+}
+
+template <class TInputImage, class TOutputImage>
+void
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::PadInputImage()
+{
+  const InputImageType *input = this->GetInput();
+  RegionType region = this->GetOutput()->GetBufferedRegion();
+  this->m_ImageSize = region.GetSize();
+
+  long radius = static_cast<long>( this->m_PatchRadius );
+
+  SizeType paddedSize;
+  unsigned long numberOfPaddedPixels = 1;
+  this->m_NumberOfPixels = 1;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    paddedSize[d] = this->m_ImageSize[d] + 2 * radius;
+    this->m_PaddedStride[d] = numberOfPaddedPixels;
+    this->m_ImageStride[d] = this->m_NumberOfPixels;
+    numberOfPaddedPixels *= paddedSize[d];
+    this->m_NumberOfPixels *= this->m_ImageSize[d];
+    }
+
+  /**
+   * Mirror the image across its boundaries so that every patch lies
+   * entirely inside the padded buffer.
+   */
+  this->m_PaddedImage.resize( numberOfPaddedPixels );
+  for( unsigned long n = 0; n < numberOfPaddedPixels; n++ )
+    {
+    IndexType index = region.GetIndex();
+    unsigned long residual = n;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      long size = static_cast<long>( this->m_ImageSize[d] );
+      long c = static_cast<long>( residual % paddedSize[d] ) - radius;
+      residual /= paddedSize[d];
+      if( c < 0 )
+        {
+        c = -c;
+        }
+      if( c >= size )
+        {
+        c = 2 * size - 2 - c;
+        }
+      c = vnl_math_max( 0L, vnl_math_min( c, size - 1 ) );
+      index[d] += c;
+      }
+    this->m_PaddedImage[n] = static_cast<RealType>( input->GetPixel( index ) );
+    }
+
+  /**
+   * Patch rows are contiguous along the first dimension.
+   */
+  this->m_PatchRowLength = 2 * this->m_PatchRadius + 1;
+  this->m_NumberOfPatchVoxels = 1;
+  unsigned long numberOfRows = 1;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    this->m_NumberOfPatchVoxels *= this->m_PatchRowLength;
+    if( d > 0 )
+      {
+      numberOfRows *= this->m_PatchRowLength;
+      }
+    }
+  this->m_PatchRowOffsets.resize( numberOfRows );
+  for( unsigned long r = 0; r < numberOfRows; r++ )
+    {
+    long offset = -radius;
+    unsigned long residual = r;
+    for( unsigned int d = 1; d < ImageDimension; d++ )
+      {
+      long o = static_cast<long>( residual % this->m_PatchRowLength ) - radius;
+      residual /= this->m_PatchRowLength;
+      offset += o * static_cast<long>( this->m_PaddedStride[d] );
+      }
+    this->m_PatchRowOffsets[r] = offset;
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::ComputePatchStatistics()
+{
+  /**
+   * Box sums of the intensities and squared intensities over every patch
+   * are obtained from one cumulative sum per line and per dimension
+   * (i.e. a separable integral image).  Double precision is used for the
+   * running sums.
+   */
+  unsigned long numberOfPaddedPixels = this->m_PaddedImage.size();
+  std::vector<RealType> sums( this->m_PaddedImage );
+  std::vector<RealType> squares( numberOfPaddedPixels );
+  for( unsigned long n = 0; n < numberOfPaddedPixels; n++ )
+    {
+    squares[n] = this->m_PaddedImage[n] * this->m_PaddedImage[n];
+    }
+
+  long radius = static_cast<long>( this->m_PatchRadius );
+
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    unsigned long stride = this->m_PaddedStride[d];
+    long length = static_cast<long>( this->m_ImageSize[d] ) + 2 * radius;
+
+    std::vector<double> cumulativeSums( length + 1 );
+    std::vector<double> cumulativeSquares( length + 1 );
+
+    for( unsigned long start = 0; start < numberOfPaddedPixels; start++ )
+      {
+      if( ( start / stride ) % length != 0 )
+        {
+        continue;
+        }
+      cumulativeSums[0] = cumulativeSquares[0] = 0.0;
+      for( long k = 0; k < length; k++ )
+        {
+        cumulativeSums[k+1] = cumulativeSums[k] + sums[start + k * stride];
+        cumulativeSquares[k+1] = cumulativeSquares[k] +
+          squares[start + k * stride];
+        }
+      for( long k = 0; k < length; k++ )
+        {
+        long lower = vnl_math_max( 0L, k - radius );
+        long upper = vnl_math_min( length, k + radius + 1 );
+        sums[start + k * stride] = static_cast<RealType>(
+          cumulativeSums[upper] - cumulativeSums[lower] );
+        squares[start + k * stride] = static_cast<RealType>(
+          cumulativeSquares[upper] - cumulativeSquares[lower] );
+        }
+      }
+    }
+
+  RealType numberOfPatchVoxels =
+    static_cast<RealType>( this->m_NumberOfPatchVoxels );
+
+  this->m_PatchMeans.resize( this->m_NumberOfPixels );
+  this->m_PatchNorms.resize( this->m_NumberOfPixels );
+  for( unsigned long n = 0; n < this->m_NumberOfPixels; n++ )
+    {
+    unsigned long p = this->ComputePaddedOffset( this->ComputeIndex( n ) );
+    RealType mean = sums[p] / numberOfPatchVoxels;
+    this->m_PatchMeans[n] = mean;
+    this->m_PatchNorms[n] = vcl_sqrt( vnl_math_max(
+      static_cast<RealType>( 0.0 ), squares[p] - sums[p] * mean ) );
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::EstimateNoiseSigma()
+{
+  /**
+   * Pseudo-residuals
+   *   e = sqrt( 2D / ( 2D + 1 ) ) * ( u - mean of the 2D face neighbors )
+   * have the variance of the noise in homogeneous regions.  The median
+   * absolute residual makes the estimate robust to edges.
+   */
+  RealType factor = vcl_sqrt( static_cast<RealType>( 2 * ImageDimension ) /
+    static_cast<RealType>( 2 * ImageDimension + 1 ) );
+
+  std::vector<RealType> residuals( this->m_NumberOfPixels );
+  for( unsigned long n = 0; n < this->m_NumberOfPixels; n++ )
+    {
+    unsigned long p = this->ComputePaddedOffset( this->ComputeIndex( n ) );
+    RealType neighborMean = 0.0;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      neighborMean += this->m_PaddedImage[p - this->m_PaddedStride[d]] +
+        this->m_PaddedImage[p + this->m_PaddedStride[d]];
+      }
+    neighborMean /= static_cast<RealType>( 2 * ImageDimension );
+    residuals[n] = vnl_math_abs( factor *
+      ( this->m_PaddedImage[p] - neighborMean ) );
+    }
+
+  std::vector<RealType>::iterator median =
+    residuals.begin() + residuals.size() / 2;
+  std::nth_element( residuals.begin(), median, residuals.end() );
+
+  this->m_EstimatedNoiseSigma = 1.4826 * ( *median );
+}
+
+template <class TInputImage, class TOutputImage>
+void
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::ExecutePass( PassType pass, unsigned int iteration )
+{
+  PatchMatchThreadStruct str;
+  str.Filter = this;
+  str.Pass = pass;
+  str.Iteration = iteration;
+
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->GetMultiThreader()->SetSingleMethod( this->PassThreaderCallback, &str );
+  this->GetMultiThreader()->SingleMethodExecute();
+}
+
+template <class TInputImage, class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::PassThreaderCallback( void *arg )
+{
+  ThreadIdType threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  ThreadIdType threadCount =
+    ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  PatchMatchThreadStruct *str = (PatchMatchThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  // The requested region is split along the last dimension so each thread
+  // owns a contiguous range of voxels.
+  RegionType splitRegion;
+  ThreadIdType total = str->Filter->SplitRequestedRegion( threadId,
+    threadCount, splitRegion );
+  if( threadId >= total )
+    {
+    return ITK_THREAD_RETURN_VALUE;
+    }
+
+  unsigned long begin = str->Filter->GetOutput()->ComputeOffset(
+    splitRegion.GetIndex() );
+  unsigned long end = begin + splitRegion.GetNumberOfPixels();
+
+  switch( str->Pass )
+    {
+    case INITIALIZE:
+      str->Filter->ThreadedInitialize( begin, end, threadId );
+      break;
+    case PROPAGATE:
+      str->Filter->ThreadedPropagate( begin, end, threadId, str->Iteration );
+      break;
+    case AVERAGE:
+      str->Filter->ThreadedAverage( begin, end );
+      break;
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::ThreadedInitialize( unsigned long begin, unsigned long end,
+  ThreadIdType threadId )
+{
+  unsigned int state = this->m_RandomSeed ^ ( 2654435761u * ( threadId + 1 ) );
+  if( state == 0 )
+    {
+    state = 1;
+    }
+
+  unsigned int windowSize = 2 * this->m_SearchRadius + 1;
+  long radius = static_cast<long>( this->m_SearchRadius );
+
+  for( unsigned long n = begin; n < end; n++ )
+    {
+    IndexType index = this->ComputeIndex( n );
+    for( unsigned int k = 0; k < this->m_NumberOfNearestNeighbors; k++ )
+      {
+      OffsetType offset;
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        offset[d] = static_cast<long>(
+          this->GenerateRandomNumber( state ) % windowSize ) - radius;
+        }
+      this->TryCandidate( n, index, offset );
+      }
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::ThreadedPropagate( unsigned long begin, unsigned long end,
+  ThreadIdType threadId, unsigned int iteration )
+{
+  unsigned int state = this->m_RandomSeed ^
+    ( 2654435761u * ( threadId + 1 ) ) ^ ( 40503u * ( iteration + 1 ) );
+  if( state == 0 )
+    {
+    state = 1;
+    }
+
+  const unsigned int K = this->m_NumberOfNearestNeighbors;
+  long searchRadius = static_cast<long>( this->m_SearchRadius );
+
+  // Alternate the scan order so that good matches travel both ways.
+  bool forward = ( iteration % 2 == 0 );
+  long direction = forward ? -1 : 1;
+
+  std::vector<unsigned int> neighborMatches( K );
+
+  for( unsigned long m = 0; m < end - begin; m++ )
+    {
+    unsigned long n = forward ? begin + m : end - 1 - m;
+    IndexType index = this->ComputeIndex( n );
+
+    /**
+     * Propagation:  the matches of the previously visited neighbor along
+     * each dimension, shifted by one voxel, are candidates for this voxel.
+     * Neighbors owned by another thread are not read.
+     */
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      long c = index[d] - this->GetOutput()->GetBufferedRegion().GetIndex()[d]
+        + direction;
+      if( c < 0 || c >= static_cast<long>( this->m_ImageSize[d] ) )
+        {
+        continue;
+        }
+      unsigned long neighbor = forward ? n - this->m_ImageStride[d]
+        : n + this->m_ImageStride[d];
+      if( neighbor < begin || neighbor >= end )
+        {
+        continue;
+        }
+      std::copy( this->m_MatchOffsets.begin() + neighbor * K,
+        this->m_MatchOffsets.begin() + ( neighbor + 1 ) * K,
+        neighborMatches.begin() );
+      for( unsigned int k = 0; k < K; k++ )
+        {
+        if( neighborMatches[k] == NumericTraits<unsigned int>::max() )
+          {
+          break;
+          }
+        this->TryCandidate( n, index, this->DecodeOffset( neighborMatches[k] ) );
+        }
+      }
+
+    /**
+     * Random search around the best match with exponentially decreasing
+     * radius.
+     */
+    unsigned int best = this->m_MatchOffsets[n * K];
+    if( best == NumericTraits<unsigned int>::max() )
+      {
+      continue;
+      }
+    OffsetType bestOffset = this->DecodeOffset( best );
+    for( long r = searchRadius; r >= 1; r /= 2 )
+      {
+      OffsetType offset;
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        long o = bestOffset[d] + static_cast<long>(
+          this->GenerateRandomNumber( state ) % ( 2 * r + 1 ) ) - r;
+        offset[d] = vnl_math_max( -searchRadius, vnl_math_min( o, searchRadius ) );
+        }
+      this->TryCandidate( n, index, offset );
+      }
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::ThreadedAverage( unsigned long begin, unsigned long end )
+{
+  const unsigned int K = this->m_NumberOfNearestNeighbors;
+
+  RealType sigma = this->m_EstimatedNoiseSigma;
+  RealType bandwidth = 2.0 * this->m_SmoothingFactor * sigma * sigma *
+    static_cast<RealType>( this->m_NumberOfPatchVoxels );
+
+  OutputPixelType *output = this->GetOutput()->GetBufferPointer();
+
+  for( unsigned long n = begin; n < end; n++ )
+    {
+    unsigned long p = this->ComputePaddedOffset( this->ComputeIndex( n ) );
+    RealType center = this->m_PaddedImage[p];
+
+    if( bandwidth <= 0.0 )
+      {
+      output[n] = static_cast<OutputPixelType>( center );
+      continue;
+      }
+
+    RealType sumWeights = 0.0;
+    RealType sumValues = 0.0;
+    RealType maxWeight = 0.0;
+    for( unsigned int k = 0; k < K; k++ )
+      {
+      unsigned int code = this->m_MatchOffsets[n * K + k];
+      if( code == NumericTraits<unsigned int>::max() )
+        {
+        break;
+        }
+      OffsetType offset = this->DecodeOffset( code );
+      long q = static_cast<long>( p );
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        q += offset[d] * static_cast<long>( this->m_PaddedStride[d] );
+        }
+      RealType weight = vcl_exp( -this->m_MatchDistances[n * K + k] / bandwidth );
+      RealType value = this->m_PaddedImage[q];
+      if( this->m_NoiseModel == RICIAN )
+        {
+        value *= value;
+        }
+      sumWeights += weight;
+      sumValues += weight * value;
+      maxWeight = vnl_math_max( maxWeight, weight );
+      }
+
+    // The center voxel is given the maximum weight of its matches.
+    if( maxWeight <= 0.0 )
+      {
+      maxWeight = 1.0;
+      }
+    sumWeights += maxWeight;
+    if( this->m_NoiseModel == RICIAN )
+      {
+      sumValues += maxWeight * center * center;
+      RealType value = sumValues / sumWeights - 2.0 * sigma * sigma;
+      output[n] = static_cast<OutputPixelType>(
+        vcl_sqrt( vnl_math_max( static_cast<RealType>( 0.0 ), value ) ) );
+      }
+    else
+      {
+      sumValues += maxWeight * center;
+      output[n] = static_cast<OutputPixelType>( sumValues / sumWeights );
+      }
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::TryCandidate( unsigned long n, const IndexType &index,
+  const OffsetType &offset )
+{
+  const unsigned int K = this->m_NumberOfNearestNeighbors;
+
+  bool isZero = true;
+  long q = 0;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    long c = index[d] + offset[d] -
+      this->GetOutput()->GetBufferedRegion().GetIndex()[d];
+    if( c < 0 || c >= static_cast<long>( this->m_ImageSize[d] ) )
+      {
+      return;
+      }
+    if( offset[d] != 0 )
+      {
+      isZero = false;
+      }
+    q += c * static_cast<long>( this->m_ImageStride[d] );
+    }
+  if( isZero )
+    {
+    return;
+    }
+
+  unsigned int code = this->EncodeOffset( offset );
+  unsigned int *offsets = &this->m_MatchOffsets[n * K];
+  RealType *distances = &this->m_MatchDistances[n * K];
+  for( unsigned int k = 0; k < K; k++ )
+    {
+    if( offsets[k] == code )
+      {
+      return;
+      }
+    }
+
+  /**
+   * Reject the candidate if the lower bound from the precomputed patch
+   * statistics already exceeds the current K-th best distance.
+   */
+  RealType worst = distances[K - 1];
+  RealType meanDifference = this->m_PatchMeans[n] - this->m_PatchMeans[q];
+  RealType normDifference = this->m_PatchNorms[n] - this->m_PatchNorms[q];
+  RealType bound = static_cast<RealType>( this->m_NumberOfPatchVoxels ) *
+    meanDifference * meanDifference + normDifference * normDifference;
+  if( bound >= worst )
+    {
+    return;
+    }
+
+  unsigned long p = this->ComputePaddedOffset( index );
+  long qPadded = static_cast<long>( p );
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    qPadded += offset[d] * static_cast<long>( this->m_PaddedStride[d] );
+    }
+
+  RealType distance = this->ComputePatchDistance( p,
+    static_cast<unsigned long>( qPadded ), worst );
+  if( distance >= worst )
+    {
+    return;
+    }
+
+  // Insertion into the sorted list of matches.
+  unsigned int k = K - 1;
+  while( k > 0 && distances[k-1] > distance )
+    {
+    distances[k] = distances[k-1];
+    offsets[k] = offsets[k-1];
+    k--;
+    }
+  distances[k] = distance;
+  offsets[k] = code;
+}
+
+template <class TInputImage, class TOutputImage>
+typename PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>::RealType
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::ComputePatchDistance( unsigned long p, unsigned long q,
+  RealType threshold ) const
+{
+  const RealType *buffer = &this->m_PaddedImage[0];
+  const unsigned int length = this->m_PatchRowLength;
+  const unsigned int packedLength = length - length % 4;
+
+  RealType distance = 0.0;
+  for( unsigned int r = 0; r < this->m_PatchRowOffsets.size(); r++ )
+    {
+    const RealType *a = buffer + p + this->m_PatchRowOffsets[r];
+    const RealType *b = buffer + q + this->m_PatchRowOffsets[r];
+
+    // Four independent accumulators over the contiguous row let the
+    // compiler keep the row in vector registers.
+    RealType s0 = 0.0;
+    RealType s1 = 0.0;
+    RealType s2 = 0.0;
+    RealType s3 = 0.0;
+    unsigned int i = 0;
+    for( ; i < packedLength; i += 4 )
+      {
+      RealType d0 = a[i] - b[i];
+      RealType d1 = a[i+1] - b[i+1];
+      RealType d2 = a[i+2] - b[i+2];
+      RealType d3 = a[i+3] - b[i+3];
+      s0 += d0 * d0;
+      s1 += d1 * d1;
+      s2 += d2 * d2;
+      s3 += d3 * d3;
+      }
+    for( ; i < length; i++ )
+      {
+      RealType d0 = a[i] - b[i];
+      s0 += d0 * d0;
+      }
+    distance += ( s0 + s1 ) + ( s2 + s3 );
+
+    if( distance >= threshold )
+      {
+      break;
+      }
+    }
+  return distance;
+}
+
+template <class TInputImage, class TOutputImage>
+typename PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>::IndexType
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::ComputeIndex( unsigned long n ) const
+{
+  IndexType index = this->GetOutput()->GetBufferedRegion().GetIndex();
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    index[d] += static_cast<long>( n % this->m_ImageSize[d] );
+    n /= this->m_ImageSize[d];
+    }
+  return index;
+}
+
+template <class TInputImage, class TOutputImage>
+unsigned long
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::ComputePaddedOffset( const IndexType &index ) const
+{
+  unsigned long offset = 0;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    offset += ( index[d] - this->GetOutput()->GetBufferedRegion().GetIndex()[d]
+      + this->m_PatchRadius ) * this->m_PaddedStride[d];
+    }
+  return offset;
+}
+
+template <class TInputImage, class TOutputImage>
+unsigned int
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::EncodeOffset( const OffsetType &offset ) const
+{
+  unsigned int code = 0;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    code |= static_cast<unsigned int>( offset[d] + 128 ) << ( 8 * d );
+    }
+  return code;
+}
+
+template <class TInputImage, class TOutputImage>
+typename PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>::OffsetType
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::DecodeOffset( unsigned int code ) const
+{
+  OffsetType offset;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    offset[d] = static_cast<long>( ( code >> ( 8 * d ) ) & 0xFF ) - 128;
+    }
+  return offset;
+}
+
+template <class TInputImage, class TOutputImage>
+unsigned int
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::GenerateRandomNumber( unsigned int &state )
+{
+  // xorshift32:  cheap and private to each thread.
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+PatchMatchDenoisingImageFilter<TInputImage, TOutputImage>
+::PrintSelf( std::ostream &os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Patch radius: " << this->m_PatchRadius << std::endl;
+  os << indent << "Search radius: " << this->m_SearchRadius << std::endl;
+  os << indent << "Number of nearest neighbors: "
+     << this->m_NumberOfNearestNeighbors << std::endl;
+  os << indent << "Number of PatchMatch iterations: "
+     << this->m_NumberOfPatchMatchIterations << std::endl;
+  os << indent << "Smoothing factor: " << this->m_SmoothingFactor << std::endl;
+  os << indent << "Noise sigma: " << this->m_NoiseSigma << std::endl;
+  os << indent << "Noise model: " << this->m_NoiseModel << std::endl;
+  os << indent << "Random seed: " << this->m_RandomSeed << std::endl;
+}
+
+}  //end namespace itk
+
+#endif
@@ -21,10 +21,20 @@
 
 #include "itkConstNeighborhoodIterator.h"
 
+#include <vector>
+
 namespace itk {
 
 /** \class ScalarToFractalImageFilter
-
+ * \brief Estimates the local fractal dimension from the slope of the mean
+ * absolute intensity difference of voxel pairs against their distance, on
+ * a log-log scale, in the neighborhood of every voxel.
+ *
+ * The pairs of neighborhood offsets are grouped into distance classes once,
+ * before the threads start, since the pair geometry is the same at every
+ * voxel.  Each voxel then only accumulates the absolute differences of each
+ * class.  Where the whole neighborhood is inside the image and the mask,
+ * the terms of the fit that depend on the distances alone are precomputed.
  */
 template<class TInputImage, class TOutputImage>
 class ITK_EXPORT ScalarToFractalImageFilter :
@@ -49,6 +59,7 @@ public:
   typedef TInputImage                             InputImageType;
   typedef TOutputImage                            OutputImageType;
   typedef Image<char, ImageDimension>             MaskImageType;
+  typedef typename OutputImageType::RegionType    OutputImageRegionType;
 
 
   /** Runtime information support. */
@@ -70,7 +81,12 @@ protected:
   ~ScalarToFractalImageFilter() {};
   void PrintSelf( std::ostream& os, Indent indent ) const;
 
-  void GenerateData();
+  void GenerateInputRequestedRegion();
+
+  void BeforeThreadedGenerateData();
+
+  void ThreadedGenerateData( const OutputImageRegionType &,
+    ThreadIdType threadId );
 
 private:
   ScalarToFractalImageFilter( const Self& ); //purposely not implemented
@@ -79,6 +95,20 @@ private:
   RadiusType                       m_NeighborhoodRadius;
   typename MaskImageType::Pointer  m_MaskImage;
 
+  /** The offset pairs ( i < j ), as neighborhood indices, sorted by
+   * distance class.  The pairs of class k are [m_ClassBegin[k],
+   * m_ClassBegin[k+1]). */
+  std::vector<unsigned int>        m_PairFirst;
+  std::vector<unsigned int>        m_PairSecond;
+  std::vector<unsigned long>       m_ClassBegin;
+
+  /** log( distance ) of every class. */
+  std::vector<RealType>            m_ClassLogDistance;
+
+  /** Sums of the log distances over all classes, for full neighborhoods. */
+  RealType                         m_SumLogDistance;
+  RealType                         m_SumSquaredLogDistance;
+
 }; // end of class
 
 } // end namespace itk
@@ -19,6 +19,7 @@
 
 #include "itkScalarToFractalImageFilter.h"
 
+#include "itkImageRegionIterator.h"
 #include "itkNeighborhoodAlgorithm.h"
 #include "itkProgressReporter.h"
 
@@ -38,144 +39,239 @@ ScalarToFractalImageFilter<TInputImage, TOutputImage>
 template<class TInputImage, class TOutputImage>
 void
 ScalarToFractalImageFilter<TInputImage, TOutputImage>
-::GenerateData()
+::GenerateInputRequestedRegion()
 {
-  this->AllocateOutputs();
+  Superclass::GenerateInputRequestedRegion();
 
-  ProgressReporter progress( this, 0, 
-    this->GetInput()->GetRequestedRegion().GetNumberOfPixels(), 100 );
+  InputImageType *input = const_cast<InputImageType *>( this->GetInput() );
+  if( !input )
+    {
+    return;
+    }
 
-  typedef typename NeighborhoodAlgorithm
-    ::ImageBoundaryFacesCalculator<InputImageType> FaceCalculatorType;
-  FaceCalculatorType faceCalculator;
+  typename InputImageType::RegionType region = input->GetRequestedRegion();
+  region.PadByRadius( this->m_NeighborhoodRadius );
+  region.Crop( input->GetLargestPossibleRegion() );
+  input->SetRequestedRegion( region );
+}
 
-  typename FaceCalculatorType::FaceListType faceList
-    = faceCalculator( this->GetInput(),
-    this->GetInput()->GetRequestedRegion(), this->m_NeighborhoodRadius );
-  typename FaceCalculatorType::FaceListType::iterator fit;
+template<class TInputImage, class TOutputImage>
+void
+ScalarToFractalImageFilter<TInputImage, TOutputImage>
+::BeforeThreadedGenerateData()
+{
+  const InputImageType *input = this->GetInput();
 
-  RealType minSpacing = this->GetInput()->GetSpacing()[0];
+  RealType minSpacing = input->GetSpacing()[0];
   for( unsigned int d = 0; d < ImageDimension; d++ )
     {
-    if( this->GetInput()->GetSpacing()[d] < minSpacing )
+    if( input->GetSpacing()[d] < minSpacing )
       {
-      minSpacing = this->GetInput()->GetSpacing()[d];
+      minSpacing = input->GetSpacing()[d];
       }
     }
 
+  Neighborhood<typename InputImageType::PixelType, ImageDimension> neighborhood;
+  neighborhood.SetRadius( this->m_NeighborhoodRadius );
+  const unsigned int neighborhoodSize = neighborhood.Size();
+
+  std::vector<typename InputImageType::PointType> points( neighborhoodSize );
+  for( unsigned int i = 0; i < neighborhoodSize; i++ )
+    {
+    input->TransformIndexToPhysicalPoint(
+      input->GetRequestedRegion().GetIndex() + neighborhood.GetOffset( i ),
+      points[i] );
+    }
+
+  // Classes are formed in the order in which the pairs are visited, with
+  // the squared distance of the first pair of a class as its distance.
+  // Visiting only the pairs i < j creates the same classes as visiting all
+  // ordered pairs, and halves the differences of each class without
+  // changing their mean.
   std::vector<RealType> distances;
-  std::vector<RealType> distancesFrequency;
-  std::vector<RealType> averageAbsoluteIntensityDifference;
+  std::vector<unsigned int> pairClasses;
+  std::vector<unsigned long> classSizes;
+  for( unsigned int i = 0; i < neighborhoodSize; i++ )
+    {
+    for( unsigned int j = i + 1; j < neighborhoodSize; j++ )
+      {
+      const RealType distance = points[i].SquaredEuclideanDistanceTo( points[j] );
+
+      unsigned int k = 0;
+      while( k < distances.size() &&
+        vnl_math_abs( distances[k] - distance ) >= 0.5 * minSpacing )
+        {
+        k++;
+        }
+      if( k == distances.size() )
+        {
+        distances.push_back( distance );
+        classSizes.push_back( 0 );
+        }
+      pairClasses.push_back( k );
+      classSizes[k]++;
+      }
+    }
+
+  const unsigned int numberOfClasses = distances.size();
+  this->m_ClassBegin.assign( numberOfClasses + 1, 0 );
+  for( unsigned int k = 0; k < numberOfClasses; k++ )
+    {
+    this->m_ClassBegin[k + 1] = this->m_ClassBegin[k] + classSizes[k];
+    }
+
+  this->m_PairFirst.resize( pairClasses.size() );
+  this->m_PairSecond.resize( pairClasses.size() );
+  std::vector<unsigned long> position( this->m_ClassBegin.begin(),
+    this->m_ClassBegin.end() - 1 );
+  unsigned long pair = 0;
+  for( unsigned int i = 0; i < neighborhoodSize; i++ )
+    {
+    for( unsigned int j = i + 1; j < neighborhoodSize; j++ )
+      {
+      const unsigned long p = position[pairClasses[pair++]]++;
+      this->m_PairFirst[p] = i;
+      this->m_PairSecond[p] = j;
+      }
+    }
+
+  this->m_ClassLogDistance.resize( numberOfClasses );
+  this->m_SumLogDistance = 0.0;
+  this->m_SumSquaredLogDistance = 0.0;
+  for( unsigned int k = 0; k < numberOfClasses; k++ )
+    {
+    this->m_ClassLogDistance[k] = vcl_log( vcl_sqrt( distances[k] ) );
+    this->m_SumLogDistance += this->m_ClassLogDistance[k];
+    this->m_SumSquaredLogDistance +=
+      this->m_ClassLogDistance[k] * this->m_ClassLogDistance[k];
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+ScalarToFractalImageFilter<TInputImage, TOutputImage>
+::ThreadedGenerateData( const OutputImageRegionType & outputRegionForThread,
+  ThreadIdType threadId )
+{
+  ProgressReporter progress( this, threadId,
+    outputRegionForThread.GetNumberOfPixels(), 100 );
+
+  typedef typename NeighborhoodAlgorithm
+    ::ImageBoundaryFacesCalculator<InputImageType> FaceCalculatorType;
+  FaceCalculatorType faceCalculator;
+
+  typename FaceCalculatorType::FaceListType faceList
+    = faceCalculator( this->GetInput(), outputRegionForThread,
+    this->m_NeighborhoodRadius );
+  typename FaceCalculatorType::FaceListType::iterator fit;
+
+  const unsigned int numberOfClasses = this->m_ClassLogDistance.size();
+
+  std::vector<RealType> values;
+  std::vector<char> valid;
 
   for( fit = faceList.begin(); fit != faceList.end(); ++fit )
     {
     ConstNeighborhoodIteratorType It(
       this->m_NeighborhoodRadius, this->GetInput(), *fit );
-    NeighborhoodIterator<OutputImageType> ItO(
-      this->m_NeighborhoodRadius, this->GetOutput(), *fit );
+    ImageRegionIterator<OutputImageType> ItO( this->GetOutput(), *fit );
+
+    typedef ConstNeighborhoodIterator<MaskImageType> MaskIteratorType;
+    MaskIteratorType ItM;
+    if( this->m_MaskImage )
+      {
+      ItM = MaskIteratorType( this->m_NeighborhoodRadius,
+        this->m_MaskImage, *fit );
+      ItM.GoToBegin();
+      }
+
+    values.resize( It.Size() );
+    valid.resize( It.Size() );
 
     for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
       {
-      if( this->m_MaskImage &&
-        !this->m_MaskImage->GetPixel( It.GetIndex() ) )
+      if( this->m_MaskImage && !ItM.GetCenterPixel() )
         {
-        ItO.SetCenterPixel(
-          NumericTraits<typename OutputImageType::PixelType>::Zero );
+        ItO.Set( NumericTraits<typename OutputImageType::PixelType>::Zero );
+        ++ItM;
         progress.CompletedPixel();
         continue;
         }
-      
-      distances.clear();
-      distancesFrequency.clear();
-      averageAbsoluteIntensityDifference.clear();
 
-      for( unsigned int i = 0; i < It.GetNeighborhood().Size(); i++ )
+      bool isFull = true;
+      for( unsigned int i = 0; i < It.Size(); i++ )
         {
-        bool IsInBounds1;
-        typename InputImageType::PixelType pixel1
-          = It.GetPixel( i, IsInBounds1 );
-
-        if( IsInBounds1 && ( !this->m_MaskImage || ( this->m_MaskImage &&
-          this->m_MaskImage->GetPixel( It.GetIndex( i ) ) ) ) )
+        bool isInBounds;
+        values[i] = static_cast<RealType>( It.GetPixel( i, isInBounds ) );
+        if( isInBounds && this->m_MaskImage )
           {
-          typename InputImageType::PointType point1;
-          this->GetInput()->TransformIndexToPhysicalPoint(
-            It.GetIndex( i ), point1 );
-
-          for( unsigned int j = 0; j < It.GetNeighborhood().Size(); j++ )
-            {
-            if( i != j )
-              {
-              bool IsInBounds2;
-              typename InputImageType::PixelType pixel2
-                = It.GetPixel( j, IsInBounds2 );
-
-              if( IsInBounds2 && ( !this->m_MaskImage || ( this->m_MaskImage &&
-                this->m_MaskImage->GetPixel( It.GetIndex( j ) ) ) ) )
-                {
-                typename InputImageType::PointType point2;
-                this->GetInput()->TransformIndexToPhysicalPoint(
-                  It.GetIndex( j ), point2 );
-
-                RealType distance
-                  = point1.SquaredEuclideanDistanceTo( point2 );
-
-                bool distanceFound = false;
-                for( unsigned int k = 0; k < distances.size(); k++ )
-                  {
-                  if( vnl_math_abs( distances[k] - distance )
-                    < 0.5 * minSpacing )
-                    {
-                    distancesFrequency[k]++;
-                    averageAbsoluteIntensityDifference[k]
-                      += vnl_math_abs( pixel1 - pixel2 );
-                    distanceFound = true;
-                    break;
-                    }
-                  }
-                if( !distanceFound )
-                  {
-                  distances.push_back( distance );
-                  distancesFrequency.push_back( 1 );
-                  averageAbsoluteIntensityDifference.push_back(
-                    vnl_math_abs( pixel1 - pixel2 ) );
-                  }
-                }
-              }
-            }
+          isInBounds = ( ItM.GetPixel( i, isInBounds ) != 0 && isInBounds );
           }
+        valid[i] = isInBounds;
+        isFull = ( isFull && isInBounds );
         }
+      if( this->m_MaskImage )
+        {
+        ++ItM;
+        }
+
       RealType sumY = 0.0;
       RealType sumX = 0.0;
       RealType sumXY = 0.0;
       RealType sumXX = 0.0;
+      RealType N = 0.0;
 
-      for( unsigned int k = 0; k < distances.size(); k++ )
+      for( unsigned int k = 0; k < numberOfClasses; k++ )
         {
-        if( distancesFrequency[k] == 0 )
+        RealType sum = 0.0;
+        unsigned long count = 0;
+        if( isFull )
           {
-          continue;
+          for( unsigned long p = this->m_ClassBegin[k];
+            p < this->m_ClassBegin[k + 1]; p++ )
+            {
+            sum += vnl_math_abs( values[this->m_PairFirst[p]]
+              - values[this->m_PairSecond[p]] );
+            }
+          count = this->m_ClassBegin[k + 1] - this->m_ClassBegin[k];
+          }
+        else
+          {
+          for( unsigned long p = this->m_ClassBegin[k];
+            p < this->m_ClassBegin[k + 1]; p++ )
+            {
+            if( valid[this->m_PairFirst[p]] && valid[this->m_PairSecond[p]] )
+              {
+              sum += vnl_math_abs( values[this->m_PairFirst[p]]
+                - values[this->m_PairSecond[p]] );
+              count++;
+              }
+            }
+          if( count == 0 )
+            {
+            continue;
+            }
+          sumX += this->m_ClassLogDistance[k];
+          sumXX += this->m_ClassLogDistance[k] * this->m_ClassLogDistance[k];
+          N++;
           }
 
-        averageAbsoluteIntensityDifference[k]
-          /= static_cast<RealType>( distancesFrequency[k] );
-        averageAbsoluteIntensityDifference[k]
-          = vcl_log( averageAbsoluteIntensityDifference[k] );
-
-        RealType distance = vcl_log( vcl_sqrt( distances[k] ) );
-
-        sumY += averageAbsoluteIntensityDifference[k];
-        sumX += distance;
-        sumXX += ( distance * distance );
-        sumXY += ( averageAbsoluteIntensityDifference[k] * distance );
+        const RealType logDifference =
+          vcl_log( sum / static_cast<RealType>( count ) );
+        sumY += logDifference;
+        sumXY += logDifference * this->m_ClassLogDistance[k];
+        }
+      if( isFull )
+        {
+        sumX = this->m_SumLogDistance;
+        sumXX = this->m_SumSquaredLogDistance;
+        N = static_cast<RealType>( numberOfClasses );
         }
-      RealType N = static_cast<RealType>( distances.size() );
 
       RealType slope = ( N * sumXY - sumX * sumY )
         / ( N * sumXX - sumX * sumX );
 
-      ItO.SetCenterPixel(
-        static_cast<typename OutputImageType::PixelType>( 3.0 - slope ) );
+      ItO.Set( static_cast<typename OutputImageType::PixelType>( 3.0 - slope ) );
       progress.CompletedPixel();
       }
     }
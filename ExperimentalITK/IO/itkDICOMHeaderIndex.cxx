@@ -0,0 +1,602 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkDICOMHeaderIndex.h"
+
+#include "itkDICOMSliceGeometry.h"
+#include "itkGDCMImageIO.h"
+#include "itkIntTypes.h"
+#include "itkMetaDataObject.h"
+
+#include <itksys/Directory.hxx>
+#include <itksys/SystemTools.hxx>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#if defined( _WIN32 )
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace itk
+{
+
+namespace
+{
+const char         IndexMagic[8] = { 'D', 'C', 'M', 'I', 'N', 'D', 'E', 'X' };
+const uint32_t     IndexByteOrder = 0x01020304;
+const uint32_t     IndexVersion = 2;
+
+template<class T>
+void WriteValue( std::ostream & os, const T & value )
+{
+  os.write( reinterpret_cast<const char *>( &value ), sizeof( T ) );
+}
+
+template<class T>
+bool ReadValue( std::istream & is, T & value )
+{
+  is.read( reinterpret_cast<char *>( &value ), sizeof( T ) );
+  return is.good();
+}
+
+void WriteString( std::ostream & os, const std::string & value )
+{
+  WriteValue( os, static_cast<uint32_t>( value.size() ) );
+  os.write( value.data(), value.size() );
+}
+
+bool ReadString( std::istream & is, std::string & value )
+{
+  uint32_t length;
+  if( !ReadValue( is, length ) )
+    {
+    return false;
+    }
+  value.resize( length );
+  if( length > 0 )
+    {
+    is.read( &value[0], length );
+    }
+  return is.good();
+}
+
+const char         TemporarySuffix[] = ".tmp";
+
+long GetProcessId()
+{
+#if defined( _WIN32 )
+  return static_cast<long>( _getpid() );
+#else
+  return static_cast<long>( getpid() );
+#endif
+}
+} // end anonymous namespace
+
+DICOMHeaderIndex
+::DICOMHeaderIndex()
+{
+  this->m_MaximumValueLength = 512;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->m_NumberOfScannedFiles = 0;
+  this->m_Changed = false;
+}
+
+bool
+DICOMHeaderIndex
+::EncodeTag( const std::string & tag, unsigned int & key )
+{
+  if( tag.size() != 9 || tag[4] != '|' )
+    {
+    return false;
+    }
+  for( unsigned int i = 0; i < 9; i++ )
+    {
+    if( i != 4 && !std::isxdigit( static_cast<unsigned char>( tag[i] ) ) )
+      {
+      return false;
+      }
+    }
+  const unsigned long group = std::strtoul( tag.substr( 0, 4 ).c_str(), 0, 16 );
+  const unsigned long element = std::strtoul( tag.substr( 5, 4 ).c_str(), 0, 16 );
+  key = static_cast<unsigned int>( ( group << 16 ) | element );
+  return true;
+}
+
+std::string
+DICOMHeaderIndex
+::DecodeTag( unsigned int key )
+{
+  char tag[10];
+  sprintf( tag, "%04x|%04x", ( key >> 16 ) & 0xffff, key & 0xffff );
+  return std::string( tag );
+}
+
+bool
+DICOMHeaderIndex
+::IsTemporaryFileName( const std::string & indexFileName,
+  const std::string & fileName )
+{
+  const std::string suffix( TemporarySuffix );
+  if( fileName.size() <= indexFileName.size() + 1 + suffix.size() ||
+    fileName.compare( 0, indexFileName.size(), indexFileName ) != 0 ||
+    fileName[indexFileName.size()] != '.' ||
+    fileName.compare( fileName.size() - suffix.size(), suffix.size(),
+      suffix ) != 0 )
+    {
+    return false;
+    }
+  const std::string pid = fileName.substr( indexFileName.size() + 1,
+    fileName.size() - indexFileName.size() - 1 - suffix.size() );
+  for( unsigned int i = 0; i < pid.size(); i++ )
+    {
+    if( !std::isdigit( static_cast<unsigned char>( pid[i] ) ) )
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+bool
+DICOMHeaderIndex
+::CompareTags( const TagType & a, const TagType & b )
+{
+  return a.Key < b.Key;
+}
+
+DICOMHeaderIndex::FileNamesContainer
+DICOMHeaderIndex
+::GetDirectoryFileNames( const std::string & directory )
+{
+  FileNamesContainer fileNames;
+
+  itksys::Directory dir;
+  if( !dir.Load( directory.c_str() ) )
+    {
+    return fileNames;
+    }
+  const std::string path =
+    itksys::SystemTools::CollapseFullPath( directory.c_str() );
+  for( unsigned long n = 0; n < dir.GetNumberOfFiles(); n++ )
+    {
+    const std::string name = dir.GetFile( n );
+    if( name == "." || name == ".." )
+      {
+      continue;
+      }
+    const std::string fileName = path + "/" + name;
+    if( !itksys::SystemTools::FileIsDirectory( fileName.c_str() ) )
+      {
+      fileNames.push_back( fileName );
+      }
+    }
+  std::sort( fileNames.begin(), fileNames.end() );
+
+  return fileNames;
+}
+
+bool
+DICOMHeaderIndex
+::Load()
+{
+  this->m_Entries.clear();
+  this->m_Changed = false;
+
+  std::ifstream is( this->m_FileName.c_str(), std::ios::in | std::ios::binary );
+  if( !is )
+    {
+    return false;
+    }
+
+  char magic[8];
+  uint32_t byteOrder;
+  uint32_t version;
+  uint64_t numberOfEntries;
+  is.read( magic, 8 );
+  if( !is.good() || !std::equal( magic, magic + 8, IndexMagic ) ||
+    !ReadValue( is, byteOrder ) || byteOrder != IndexByteOrder ||
+    !ReadValue( is, version ) || version != IndexVersion ||
+    !ReadValue( is, numberOfEntries ) )
+    {
+    return false;
+    }
+
+  for( uint64_t n = 0; n < numberOfEntries; n++ )
+    {
+    EntryType entry;
+    int64_t modifiedTime;
+    uint64_t fileSize;
+    uint8_t isDICOM;
+    bool ok = ReadString( is, entry.FileName ) &&
+      ReadValue( is, modifiedTime ) && ReadValue( is, fileSize ) &&
+      ReadValue( is, isDICOM );
+    entry.ModifiedTime = static_cast<long>( modifiedTime );
+    entry.FileSize = static_cast<unsigned long>( fileSize );
+    entry.IsDICOM = ( isDICOM != 0 );
+
+    if( ok && entry.IsDICOM )
+      {
+      uint32_t size[2];
+      uint32_t numberOfTags = 0;
+      is.read( reinterpret_cast<char *>( entry.Position ), 3 * sizeof( double ) );
+      is.read( reinterpret_cast<char *>( entry.Orientation ), 6 * sizeof( double ) );
+      is.read( reinterpret_cast<char *>( entry.Spacing ), 2 * sizeof( double ) );
+      ok = ReadValue( is, size[0] ) && ReadValue( is, size[1] ) &&
+        ReadValue( is, numberOfTags );
+      entry.Size[0] = size[0];
+      entry.Size[1] = size[1];
+
+      entry.Tags.resize( ok ? numberOfTags : 0 );
+      for( uint32_t t = 0; ok && t < numberOfTags; t++ )
+        {
+        uint32_t key;
+        uint8_t stored;
+        ok = ReadValue( is, key ) && ReadValue( is, stored ) &&
+          ReadString( is, entry.Tags[t].Value );
+        entry.Tags[t].Key = key;
+        entry.Tags[t].Stored = ( stored != 0 );
+        }
+      }
+    if( !ok )
+      {
+      this->m_Entries.clear();
+      return false;
+      }
+    this->m_Entries[entry.FileName] = entry;
+    }
+
+  return true;
+}
+
+void
+DICOMHeaderIndex
+::Save()
+{
+  std::ostringstream temporaryName;
+  temporaryName << this->m_FileName << "." << GetProcessId()
+    << TemporarySuffix;
+  const std::string temporaryFileName = temporaryName.str();
+  {
+  std::ofstream os( temporaryFileName.c_str(),
+    std::ios::out | std::ios::binary | std::ios::trunc );
+  if( !os )
+    {
+    itkExceptionMacro( "Unable to write " << temporaryFileName );
+    }
+
+  os.write( IndexMagic, 8 );
+  WriteValue( os, IndexByteOrder );
+  WriteValue( os, IndexVersion );
+  WriteValue( os, static_cast<uint64_t>( this->m_Entries.size() ) );
+
+  for( EntryMapType::const_iterator it = this->m_Entries.begin();
+    it != this->m_Entries.end(); ++it )
+    {
+    const EntryType & entry = it->second;
+    WriteString( os, entry.FileName );
+    WriteValue( os, static_cast<int64_t>( entry.ModifiedTime ) );
+    WriteValue( os, static_cast<uint64_t>( entry.FileSize ) );
+    WriteValue( os, static_cast<uint8_t>( entry.IsDICOM ? 1 : 0 ) );
+    if( !entry.IsDICOM )
+      {
+      continue;
+      }
+    os.write( reinterpret_cast<const char *>( entry.Position ), 3 * sizeof( double ) );
+    os.write( reinterpret_cast<const char *>( entry.Orientation ), 6 * sizeof( double ) );
+    os.write( reinterpret_cast<const char *>( entry.Spacing ), 2 * sizeof( double ) );
+    WriteValue( os, static_cast<uint32_t>( entry.Size[0] ) );
+    WriteValue( os, static_cast<uint32_t>( entry.Size[1] ) );
+    WriteValue( os, static_cast<uint32_t>( entry.Tags.size() ) );
+    for( unsigned int t = 0; t < entry.Tags.size(); t++ )
+      {
+      WriteValue( os, static_cast<uint32_t>( entry.Tags[t].Key ) );
+      WriteValue( os, static_cast<uint8_t>( entry.Tags[t].Stored ? 1 : 0 ) );
+      WriteString( os, entry.Tags[t].Value );
+      }
+    }
+  if( !os.good() )
+    {
+    itkExceptionMacro( "Unable to write " << temporaryFileName );
+    }
+  }
+
+  // rename() does not replace an existing file on every platform.
+  if( std::rename( temporaryFileName.c_str(), this->m_FileName.c_str() ) != 0 )
+    {
+    itksys::SystemTools::RemoveFile( this->m_FileName.c_str() );
+    if( std::rename( temporaryFileName.c_str(), this->m_FileName.c_str() ) != 0 )
+      {
+      itksys::SystemTools::RemoveFile( temporaryFileName.c_str() );
+      itkExceptionMacro( "Unable to replace " << this->m_FileName );
+      }
+    }
+  this->m_Changed = false;
+}
+
+bool
+DICOMHeaderIndex
+::ScanFile( const std::string & fileName, EntryType & entry ) const
+{
+  entry.Tags.clear();
+  entry.IsDICOM = false;
+
+  GDCMImageIO::Pointer io = GDCMImageIO::New();
+  io->SetFileName( fileName.c_str() );
+  try
+    {
+    io->ReadImageInformation();
+    }
+  catch( ExceptionObject & )
+    {
+    return false;
+    }
+
+  DICOMSliceGeometry::Read( io, entry.Position, entry.Orientation,
+    entry.Spacing, entry.Size );
+
+  const MetaDataDictionary & dictionary = io->GetMetaDataDictionary();
+  for( MetaDataDictionary::ConstIterator it = dictionary.Begin();
+    it != dictionary.End(); ++it )
+    {
+    const MetaDataObject<std::string> *object =
+      dynamic_cast<const MetaDataObject<std::string> *>(
+      it->second.GetPointer() );
+    TagType tag;
+    if( object && EncodeTag( it->first, tag.Key ) )
+      {
+      // Long values, typically private or binary data, only keep their
+      // key so that GetTagValue() knows to read them from the file.
+      tag.Stored = ( object->GetMetaDataObjectValue().size() <=
+        this->m_MaximumValueLength );
+      if( tag.Stored )
+        {
+        tag.Value = object->GetMetaDataObjectValue();
+        }
+      entry.Tags.push_back( tag );
+      }
+    }
+  std::sort( entry.Tags.begin(), entry.Tags.end(), CompareTags );
+
+  entry.IsDICOM = true;
+  return true;
+}
+
+void
+DICOMHeaderIndex
+::Update( const FileNamesContainer & fileNames )
+{
+  this->m_NumberOfScannedFiles = 0;
+  this->m_ScanEntries.clear();
+
+  std::set<std::string> pending;
+  for( unsigned int n = 0; n < fileNames.size(); n++ )
+    {
+    const std::string fileName =
+      itksys::SystemTools::CollapseFullPath( fileNames[n].c_str() );
+    EntryMapType::iterator it = this->m_Entries.find( fileName );
+
+    if( !itksys::SystemTools::FileExists( fileName.c_str() ) ||
+      itksys::SystemTools::FileIsDirectory( fileName.c_str() ) )
+      {
+      if( it != this->m_Entries.end() )
+        {
+        this->m_Entries.erase( it );
+        this->m_Changed = true;
+        }
+      continue;
+      }
+
+    const long modifiedTime =
+      itksys::SystemTools::ModifiedTime( fileName.c_str() );
+    const unsigned long fileSize =
+      itksys::SystemTools::FileLength( fileName.c_str() );
+    if( ( it != this->m_Entries.end() &&
+      it->second.ModifiedTime == modifiedTime &&
+      it->second.FileSize == fileSize ) || !pending.insert( fileName ).second )
+      {
+      continue;
+      }
+
+    EntryType entry;
+    entry.FileName = fileName;
+    entry.ModifiedTime = modifiedTime;
+    entry.FileSize = fileSize;
+    entry.IsDICOM = false;
+    this->m_ScanEntries.push_back( entry );
+    }
+
+  if( this->m_ScanEntries.empty() )
+    {
+    return;
+    }
+
+  // The first file is scanned on its own, which also initializes the
+  // GDCM dictionaries before the threads use them.
+  this->ScanFile( this->m_ScanEntries[0].FileName, this->m_ScanEntries[0] );
+
+  if( this->m_ScanEntries.size() > 1 )
+    {
+    ScanThreadStruct str;
+    str.Index = this;
+
+    MultiThreader::Pointer threader = MultiThreader::New();
+    threader->SetNumberOfThreads( std::min( this->m_NumberOfThreads,
+      static_cast<unsigned int>( this->m_ScanEntries.size() - 1 ) ) );
+    threader->SetSingleMethod( this->ScanThreaderCallback, &str );
+    threader->SingleMethodExecute();
+    }
+
+  for( unsigned int n = 0; n < this->m_ScanEntries.size(); n++ )
+    {
+    this->m_Entries[this->m_ScanEntries[n].FileName] = this->m_ScanEntries[n];
+    }
+  this->m_NumberOfScannedFiles = this->m_ScanEntries.size();
+  this->m_ScanEntries.clear();
+  this->m_Changed = true;
+}
+
+ITK_THREAD_RETURN_TYPE
+DICOMHeaderIndex
+::ScanThreaderCallback( void *arg )
+{
+  MultiThreader::ThreadInfoStruct *info =
+    static_cast<MultiThreader::ThreadInfoStruct *>( arg );
+  ScanThreadStruct *str = static_cast<ScanThreadStruct *>( info->UserData );
+
+  str->Index->ThreadedScan( info->ThreadID, info->NumberOfThreads );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void
+DICOMHeaderIndex
+::ThreadedScan( unsigned int threadId, unsigned int numberOfThreads )
+{
+  // The first entry has already been scanned.
+  const unsigned long numberOfEntries = this->m_ScanEntries.size() - 1;
+  const unsigned long begin = 1 + numberOfEntries * threadId / numberOfThreads;
+  const unsigned long end =
+    1 + numberOfEntries * ( threadId + 1 ) / numberOfThreads;
+
+  for( unsigned long n = begin; n < end; n++ )
+    {
+    this->ScanFile( this->m_ScanEntries[n].FileName, this->m_ScanEntries[n] );
+    }
+}
+
+const DICOMHeaderIndex::EntryType *
+DICOMHeaderIndex
+::GetEntry( const std::string & fileName ) const
+{
+  EntryMapType::const_iterator it = this->m_Entries.find(
+    itksys::SystemTools::CollapseFullPath( fileName.c_str() ) );
+  return ( it != this->m_Entries.end() ) ? &it->second : 0;
+}
+
+bool
+DICOMHeaderIndex
+::GetTagValue( const std::string & fileName, const std::string & tag,
+  std::string & value ) const
+{
+  const EntryType *entry = this->GetEntry( fileName );
+  TagType target;
+  if( !entry || !EncodeTag( tag, target.Key ) )
+    {
+    return false;
+    }
+  TagContainer::const_iterator it = std::lower_bound( entry->Tags.begin(),
+    entry->Tags.end(), target, CompareTags );
+  if( it == entry->Tags.end() || it->Key != target.Key )
+    {
+    return false;
+    }
+  if( it->Stored )
+    {
+    value = it->Value;
+    return true;
+    }
+
+  GDCMImageIO::Pointer io = GDCMImageIO::New();
+  io->SetFileName( entry->FileName.c_str() );
+  try
+    {
+    io->ReadImageInformation();
+    }
+  catch( ExceptionObject & )
+    {
+    return false;
+    }
+  return ExposeMetaData<std::string>( io->GetMetaDataDictionary(),
+    DecodeTag( target.Key ), value );
+}
+
+DICOMHeaderIndex::FileNamesContainer
+DICOMHeaderIndex
+::GetOrderedFileNames( const FileNamesContainer & fileNames ) const
+{
+  const char *seriesTags[6] = { "0020|000e", "0020|0011", "0018|0024",
+    "0018|0050", "0028|0010", "0028|0011" };
+
+  typedef std::vector<const EntryType *>                 SeriesType;
+  std::map<std::string, SeriesType> series;
+  for( unsigned int n = 0; n < fileNames.size(); n++ )
+    {
+    const EntryType *entry = this->GetEntry( fileNames[n] );
+    if( !entry || !entry->IsDICOM )
+      {
+      continue;
+      }
+    std::string identifier;
+    for( unsigned int t = 0; t < 6; t++ )
+      {
+      std::string value;
+      this->GetTagValue( entry->FileName, seriesTags[t], value );
+      identifier += value + ".";
+      }
+    series[identifier].push_back( entry );
+    }
+
+  FileNamesContainer ordered;
+  if( series.empty() )
+    {
+    return ordered;
+    }
+  const SeriesType & first = series.begin()->second;
+
+  double normal[3];
+  DICOMSliceGeometry::ComputeNormal( first[0]->Orientation, normal );
+
+  // The index of each file breaks ties, which keeps the given order of
+  // slices at the same location.
+  std::vector<std::pair<double, unsigned int> > locations( first.size() );
+  for( unsigned int n = 0; n < first.size(); n++ )
+    {
+    locations[n].first = DICOMSliceGeometry::ComputeLocation(
+      first[n]->Position, normal );
+    locations[n].second = n;
+    }
+  std::sort( locations.begin(), locations.end() );
+
+  for( unsigned int n = 0; n < locations.size(); n++ )
+    {
+    ordered.push_back( first[locations[n].second]->FileName );
+    }
+  return ordered;
+}
+
+void
+DICOMHeaderIndex
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "File name: " << this->m_FileName << std::endl;
+  os << indent << "Number of entries: " << this->m_Entries.size() << std::endl;
+  os << indent << "Maximum value length: " << this->m_MaximumValueLength
+     << std::endl;
+  os << indent << "Number of threads: " << this->m_NumberOfThreads << std::endl;
+}
+
+} // end namespace itk
@@ -0,0 +1,196 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkDICOMHeaderIndex_h
+#define __itkDICOMHeaderIndex_h
+
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace itk
+{
+/** \class DICOMHeaderIndex
+ * \brief A persistent index of DICOM headers, keyed by path, modification
+ * time and file size.
+ *
+ * Update() brings the entries of a list of files up to date: files whose
+ * modification time and size match their entry are not opened again, all
+ * other files are scanned in parallel with
+ * GDCMImageIO::ReadImageInformation, which reads the header but not the
+ * pixel data.  Each entry keeps the slice geometry and the string tags of
+ * the header, so ordering and tag queries are answered from the index.
+ *
+ * The index is stored in a compact binary file (see Load() and Save()).
+ * The file is written in the byte order of the machine and is rebuilt when
+ * it was written with a different byte order or version.  Paths are stored
+ * as full paths.
+ */
+class ITK_EXPORT DICOMHeaderIndex : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef DICOMHeaderIndex                               Self;
+  typedef Object                                         Superclass;
+  typedef SmartPointer<Self>                             Pointer;
+  typedef SmartPointer<const Self>                       ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( DICOMHeaderIndex, Object );
+
+  typedef std::vector<std::string>                       FileNamesContainer;
+
+  /** A tag, with the group in the upper and the element in the lower 16
+   * bits of the key, and its value.  Values longer than the maximum value
+   * length are not stored: Stored is false and GetTagValue() reads them
+   * from the file. */
+  struct TagType
+    {
+    unsigned int   Key;
+    bool           Stored;
+    std::string    Value;
+    };
+  typedef std::vector<TagType>                           TagContainer;
+
+  /** The header of one file.  The tags are sorted by key. */
+  struct EntryType
+    {
+    std::string    FileName;
+    long           ModifiedTime;
+    unsigned long  FileSize;
+    bool           IsDICOM;
+    double         Position[3];
+    double         Orientation[6];
+    double         Spacing[2];
+    unsigned long  Size[2];
+    TagContainer   Tags;
+    };
+
+  /** The index file. */
+  itkSetStringMacro( FileName );
+  itkGetStringMacro( FileName );
+
+  /** Longer values are not stored in the index and are read from the file
+   * when queried.  Default is 512. */
+  itkSetMacro( MaximumValueLength, unsigned int );
+  itkGetConstMacro( MaximumValueLength, unsigned int );
+
+  itkSetClampMacro( NumberOfThreads, unsigned int, 1,
+    NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( NumberOfThreads, unsigned int );
+
+  /** Reads the index file.  Returns false, and leaves the index empty, if
+   * the file does not exist or was not written by this version. */
+  bool Load();
+
+  /** Writes the index file, through a temporary file that is renamed so
+   * that readers never see a partial index.  The temporary file is named
+   * after the index file and the process, "<index>.<pid>.tmp", so that
+   * concurrent writers do not share it. */
+  void Save();
+
+  /** Whether entries were added, rescanned or removed since the index was
+   * loaded or saved. */
+  bool GetChanged() const
+    {
+    return this->m_Changed;
+    }
+
+  /** Brings the entries of the files up to date.  Entries of files that no
+   * longer exist are removed. */
+  void Update( const FileNamesContainer & fileNames );
+
+  /** Number of files scanned by the last Update(). */
+  itkGetConstMacro( NumberOfScannedFiles, unsigned long );
+
+  /** The entry of a file, or 0 if the file is not indexed. */
+  const EntryType * GetEntry( const std::string & fileName ) const;
+
+  /** The value of a tag given as "gggg|eeee".  Returns false if the file
+   * is not indexed or does not have the tag.  Values that are not stored
+   * in the index are read from the file. */
+  bool GetTagValue( const std::string & fileName, const std::string & tag,
+    std::string & value ) const;
+
+  /** The DICOM files of the first series of the given files, sorted along
+   * the slice normal.  As with GDCMSeriesFileNames::SetUseSeriesDetails,
+   * a series is identified by the Series Instance UID, series number,
+   * sequence name, slice thickness, rows and columns, and the first series
+   * is the one with the smallest identifier.  The files must be indexed. */
+  FileNamesContainer GetOrderedFileNames(
+    const FileNamesContainer & fileNames ) const;
+
+  /** Reads the header of one file into an entry.  Returns false if the
+   * file cannot be read as a DICOM image. */
+  bool ScanFile( const std::string & fileName, EntryType & entry ) const;
+
+  /** Whether a file name is a temporary file written by Save() for the
+   * given index file. */
+  static bool IsTemporaryFileName( const std::string & indexFileName,
+    const std::string & fileName );
+
+  /** Converts between "gggg|eeee" and a tag key. */
+  static bool EncodeTag( const std::string & tag, unsigned int & key );
+  static std::string DecodeTag( unsigned int key );
+
+  /** The regular files of a directory, sorted by name, as full paths. */
+  static FileNamesContainer GetDirectoryFileNames(
+    const std::string & directory );
+
+protected:
+  DICOMHeaderIndex();
+  ~DICOMHeaderIndex() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  DICOMHeaderIndex( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  struct ScanThreadStruct
+    {
+    DICOMHeaderIndex          *Index;
+    };
+
+  static ITK_THREAD_RETURN_TYPE ScanThreaderCallback( void *arg );
+
+  void ThreadedScan( unsigned int threadId, unsigned int numberOfThreads );
+
+  static bool CompareTags( const TagType &, const TagType & );
+
+  typedef std::map<std::string, EntryType>               EntryMapType;
+
+  EntryMapType                       m_Entries;
+
+  /** Entries being scanned by Update(). */
+  std::vector<EntryType>             m_ScanEntries;
+
+  std::string                        m_FileName;
+  unsigned int                       m_MaximumValueLength;
+  unsigned int                       m_NumberOfThreads;
+  unsigned long                      m_NumberOfScannedFiles;
+  bool                               m_Changed;
+};
+
+} // end namespace itk
+
+#endif
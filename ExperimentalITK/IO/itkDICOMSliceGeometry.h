@@ -0,0 +1,111 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkDICOMSliceGeometry_h
+#define __itkDICOMSliceGeometry_h
+
+#include "itkImageIOBase.h"
+#include "itkMetaDataObject.h"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+namespace itk
+{
+/** \class DICOMSliceGeometry
+ * \brief The slice geometry of a DICOM header, shared by
+ * ParallelDICOMSeriesReader and DICOMHeaderIndex.
+ *
+ * Read() takes the geometry from an image IO whose image information has
+ * been read.  The position and orientation come from Image Position
+ * (Patient) and Image Orientation (Patient); without them the origin of the
+ * IO and the identity orientation are used.
+ */
+class DICOMSliceGeometry
+{
+public:
+  /** Parses a backslash separated DICOM multi-value.  Returns the number of
+   * values parsed. */
+  static unsigned int ParseValues( std::string value, double *values,
+    unsigned int numberOfValues )
+    {
+    std::replace( value.begin(), value.end(), '\\', ' ' );
+    std::istringstream str( value );
+    unsigned int n = 0;
+    while( n < numberOfValues && str >> values[n] )
+      {
+      n++;
+      }
+    return n;
+    }
+
+  static void Read( const ImageIOBase *io, double position[3],
+    double orientation[6], double spacing[2], unsigned long size[2] )
+    {
+    const unsigned int dimension = io->GetNumberOfDimensions();
+    for( unsigned int d = 0; d < 2; d++ )
+      {
+      size[d] = ( d < dimension ) ? io->GetDimensions( d ) : 1;
+      spacing[d] = ( d < dimension ) ? io->GetSpacing( d ) : 1.0;
+      }
+
+    const MetaDataDictionary & dictionary = io->GetMetaDataDictionary();
+
+    std::string value;
+    if( !ExposeMetaData<std::string>( dictionary, "0020|0032", value ) ||
+      ParseValues( value, position, 3 ) != 3 )
+      {
+      for( unsigned int d = 0; d < 3; d++ )
+        {
+        position[d] = ( d < dimension ) ? io->GetOrigin( d ) : 0.0;
+        }
+      }
+    if( !ExposeMetaData<std::string>( dictionary, "0020|0037", value ) ||
+      ParseValues( value, orientation, 6 ) != 6 )
+      {
+      const double identity[6] = { 1.0, 0.0, 0.0, 0.0, 1.0, 0.0 };
+      std::copy( identity, identity + 6, orientation );
+      }
+    }
+
+  /** The slice normal, the cross product of the row and column directions
+   * of the orientation. */
+  static void ComputeNormal( const double orientation[6], double normal[3] )
+    {
+    const double *o = orientation;
+    normal[0] = o[1] * o[5] - o[2] * o[4];
+    normal[1] = o[2] * o[3] - o[0] * o[5];
+    normal[2] = o[0] * o[4] - o[1] * o[3];
+    }
+
+  /** The projection of a slice position onto the normal. */
+  static double ComputeLocation( const double position[3],
+    const double normal[3] )
+    {
+    double location = 0.0;
+    for( unsigned int d = 0; d < 3; d++ )
+      {
+      location += position[d] * normal[d];
+      }
+    return location;
+    }
+};
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,181 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkParallelDICOMSeriesReader_h
+#define __itkParallelDICOMSeriesReader_h
+
+#include "itkImageSource.h"
+#include "itkMultiThreader.h"
+
+#include <string>
+#include <vector>
+
+namespace itk
+{
+/** \class ParallelDICOMSeriesReader
+ * \brief Reads a series of single-slice DICOM files into a volume, decoding
+ * the slices in parallel.
+ *
+ * The headers of all files are read first (in parallel, with
+ * GDCMImageIO::ReadImageInformation) and the slices are sorted by the
+ * projection of their Image Position (Patient) onto the slice normal given
+ * by Image Orientation (Patient).  The origin, spacing and direction of the
+ * volume follow from the sorted slices; the slice spacing is the mean
+ * distance between consecutive slices.
+ *
+ * Only the slices of the requested region are decoded.  Each thread reads
+ * whole slices with its own GDCMImageIO and copies them into the
+ * preallocated output buffer, so the reader can be streamed: with
+ * ImageFileWriter::SetNumberOfStreamDivisions and an output format that
+ * supports streamed writing, only one slab of the volume is held in memory
+ * at a time.
+ *
+ * The output image must be three dimensional and all slices must have the
+ * same size.  Multi-frame (enhanced) DICOM files are not supported and make
+ * the reader throw rather than silently keep their first frame.
+ */
+template<class TOutputImage>
+class ITK_EXPORT ParallelDICOMSeriesReader : public ImageSource<TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef ParallelDICOMSeriesReader                      Self;
+  typedef ImageSource<TOutputImage>                      Superclass;
+  typedef SmartPointer<Self>                             Pointer;
+  typedef SmartPointer<const Self>                       ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( ParallelDICOMSeriesReader, ImageSource );
+
+  itkStaticConstMacro( ImageDimension, unsigned int,
+                       TOutputImage::ImageDimension );
+
+  typedef TOutputImage                                   OutputImageType;
+  typedef typename OutputImageType::PixelType            PixelType;
+  typedef typename OutputImageType::RegionType           RegionType;
+  typedef typename OutputImageType::SizeType             SizeType;
+  typedef typename OutputImageType::IndexType            IndexType;
+  typedef typename OutputImageType::PointType            PointType;
+  typedef typename OutputImageType::SpacingType          SpacingType;
+  typedef typename OutputImageType::DirectionType        DirectionType;
+
+  typedef std::vector<std::string>                       FileNamesContainer;
+
+  /** Geometry of one slice, from its header. */
+  struct SliceHeaderType
+    {
+    std::string    FileName;
+    double         Position[3];
+    double         Orientation[6];
+    double         Spacing[2];
+    unsigned long  Size[2];
+    unsigned long  NumberOfFrames;
+    double         Location;
+    };
+  typedef std::vector<SliceHeaderType>                   SliceHeaderContainer;
+
+  void SetFileNames( const FileNamesContainer & fileNames )
+    {
+    this->m_FileNames = fileNames;
+    this->m_SliceHeaders.clear();
+    this->Modified();
+    }
+  const FileNamesContainer & GetFileNames() const
+    {
+    return this->m_FileNames;
+    }
+
+  /** Set the slice headers directly, e.g. from an index of previously
+   * read headers, instead of reading them from the files.  The headers
+   * are sorted when the output information is generated, and all their
+   * fields, NumberOfFrames included, must be set. */
+  void SetSliceHeaders( const SliceHeaderContainer & headers )
+    {
+    this->m_SliceHeaders = headers;
+    this->m_FileNames.clear();
+    for( unsigned int n = 0; n < headers.size(); n++ )
+      {
+      this->m_FileNames.push_back( headers[n].FileName );
+      }
+    this->Modified();
+    }
+
+  /** The slice headers, sorted along the slice normal once the output
+   * information has been generated. */
+  const SliceHeaderContainer & GetSliceHeaders() const
+    {
+    return this->m_SliceHeaders;
+    }
+
+  /** Reads the geometry of one file.  Returns false if the file cannot be
+   * read as a DICOM image.  Multi-frame files are read successfully but
+   * have a NumberOfFrames greater than one. */
+  static bool ReadSliceHeader( const std::string & fileName,
+    SliceHeaderType & header );
+
+protected:
+  ParallelDICOMSeriesReader() {}
+  ~ParallelDICOMSeriesReader() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  void GenerateOutputInformation();
+
+  void EnlargeOutputRequestedRegion( DataObject * );
+
+  void GenerateData();
+
+private:
+  ParallelDICOMSeriesReader( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  enum TaskType { ReadHeaders, ReadSlices };
+
+  struct SeriesThreadStruct
+    {
+    ParallelDICOMSeriesReader *Reader;
+    TaskType                   Task;
+    };
+
+  static ITK_THREAD_RETURN_TYPE SeriesThreaderCallback( void *arg );
+
+  void ThreadedReadHeaders( unsigned int threadId,
+    unsigned int numberOfThreads );
+  void ThreadedReadSlices( unsigned int threadId,
+    unsigned int numberOfThreads );
+
+  void Execute( TaskType );
+
+  static bool CompareLocations( const SliceHeaderType &,
+    const SliceHeaderType & );
+
+  FileNamesContainer                 m_FileNames;
+  SliceHeaderContainer               m_SliceHeaders;
+
+  /** Errors of the threads of the last task. */
+  std::vector<std::string>           m_Errors;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkParallelDICOMSeriesReader.hxx"
+#endif
+
+#endif
@@ -0,0 +1,342 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkParallelDICOMSeriesReader_hxx
+#define __itkParallelDICOMSeriesReader_hxx
+
+#include "itkParallelDICOMSeriesReader.h"
+
+#include "itkDICOMSliceGeometry.h"
+#include "itkGDCMImageIO.h"
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+template<class TOutputImage>
+bool
+ParallelDICOMSeriesReader<TOutputImage>
+::CompareLocations( const SliceHeaderType & a, const SliceHeaderType & b )
+{
+  return a.Location < b.Location;
+}
+
+template<class TOutputImage>
+bool
+ParallelDICOMSeriesReader<TOutputImage>
+::ReadSliceHeader( const std::string & fileName, SliceHeaderType & header )
+{
+  GDCMImageIO::Pointer io = GDCMImageIO::New();
+  io->SetFileName( fileName.c_str() );
+  try
+    {
+    io->ReadImageInformation();
+    }
+  catch( ExceptionObject & )
+    {
+    return false;
+    }
+
+  header.FileName = fileName;
+  DICOMSliceGeometry::Read( io, header.Position, header.Orientation,
+    header.Spacing, header.Size );
+  header.NumberOfFrames = ( io->GetNumberOfDimensions() > 2 )
+    ? io->GetDimensions( 2 ) : 1;
+  header.Location = 0.0;
+
+  return true;
+}
+
+template<class TOutputImage>
+void
+ParallelDICOMSeriesReader<TOutputImage>
+::GenerateOutputInformation()
+{
+  if( ImageDimension != 3 )
+    {
+    itkExceptionMacro( "The output image must be three dimensional." );
+    }
+  if( this->m_FileNames.empty() )
+    {
+    itkExceptionMacro( "No file names are set." );
+    }
+
+  if( this->m_SliceHeaders.size() != this->m_FileNames.size() )
+    {
+    this->m_SliceHeaders.resize( this->m_FileNames.size() );
+    for( unsigned int n = 0; n < this->m_FileNames.size(); n++ )
+      {
+      this->m_SliceHeaders[n].FileName = this->m_FileNames[n];
+      }
+
+    // The first header is read on its own, which also initializes the
+    // GDCM dictionaries before the threads use them.
+    if( !ReadSliceHeader( this->m_FileNames[0], this->m_SliceHeaders[0] ) )
+      {
+      this->m_SliceHeaders.clear();
+      itkExceptionMacro( "Unable to read the header of "
+        << this->m_FileNames[0] );
+      }
+    this->Execute( ReadHeaders );
+    }
+
+  // Sort along the slice normal.
+  double normal[3];
+  DICOMSliceGeometry::ComputeNormal( this->m_SliceHeaders[0].Orientation,
+    normal );
+
+  for( unsigned int n = 0; n < this->m_SliceHeaders.size(); n++ )
+    {
+    SliceHeaderType & header = this->m_SliceHeaders[n];
+    header.Location = DICOMSliceGeometry::ComputeLocation( header.Position,
+      normal );
+    if( header.NumberOfFrames > 1 )
+      {
+      itkExceptionMacro( << header.FileName << " is a multi-frame file with "
+        << header.NumberOfFrames << " frames, only single-slice files can be "
+        << "read." );
+      }
+    if( header.Size[0] != this->m_SliceHeaders[0].Size[0] ||
+      header.Size[1] != this->m_SliceHeaders[0].Size[1] )
+      {
+      itkExceptionMacro( << header.FileName << " does not have the slice "
+        << "size of " << this->m_SliceHeaders[0].FileName );
+      }
+    }
+
+  // The stable sort keeps the file order of slices at the same location.
+  std::stable_sort( this->m_SliceHeaders.begin(), this->m_SliceHeaders.end(),
+    CompareLocations );
+  for( unsigned int n = 0; n < this->m_SliceHeaders.size(); n++ )
+    {
+    this->m_FileNames[n] = this->m_SliceHeaders[n].FileName;
+    }
+
+  const SliceHeaderType & first = this->m_SliceHeaders.front();
+  const SliceHeaderType & last = this->m_SliceHeaders.back();
+  const unsigned long numberOfSlices = this->m_SliceHeaders.size();
+
+  PointType origin;
+  SpacingType spacing;
+  DirectionType direction;
+  SizeType size;
+  IndexType index;
+  for( unsigned int d = 0; d < 3; d++ )
+    {
+    origin[d] = first.Position[d];
+    direction[d][0] = first.Orientation[d];
+    direction[d][1] = first.Orientation[d + 3];
+    direction[d][2] = normal[d];
+    index[d] = 0;
+    }
+  spacing[0] = first.Spacing[0];
+  spacing[1] = first.Spacing[1];
+  spacing[2] = 1.0;
+  if( numberOfSlices > 1 && last.Location > first.Location )
+    {
+    spacing[2] = ( last.Location - first.Location ) / ( numberOfSlices - 1 );
+    }
+  size[0] = first.Size[0];
+  size[1] = first.Size[1];
+  size[2] = numberOfSlices;
+
+  RegionType region;
+  region.SetIndex( index );
+  region.SetSize( size );
+
+  OutputImageType *output = this->GetOutput();
+  output->SetOrigin( origin );
+  output->SetSpacing( spacing );
+  output->SetDirection( direction );
+  output->SetLargestPossibleRegion( region );
+}
+
+template<class TOutputImage>
+void
+ParallelDICOMSeriesReader<TOutputImage>
+::EnlargeOutputRequestedRegion( DataObject *data )
+{
+  // Slices are decoded whole.
+  OutputImageType *output = dynamic_cast<OutputImageType *>( data );
+  if( !output )
+    {
+    return;
+    }
+
+  RegionType requested = output->GetRequestedRegion();
+  const RegionType largest = output->GetLargestPossibleRegion();
+  for( unsigned int d = 0; d < ImageDimension - 1; d++ )
+    {
+    requested.SetIndex( d, largest.GetIndex()[d] );
+    requested.SetSize( d, largest.GetSize()[d] );
+    }
+  output->SetRequestedRegion( requested );
+}
+
+template<class TOutputImage>
+void
+ParallelDICOMSeriesReader<TOutputImage>
+::GenerateData()
+{
+  OutputImageType *output = this->GetOutput();
+  output->SetBufferedRegion( output->GetRequestedRegion() );
+  output->Allocate();
+
+  this->Execute( ReadSlices );
+}
+
+template<class TOutputImage>
+void
+ParallelDICOMSeriesReader<TOutputImage>
+::Execute( TaskType task )
+{
+  const unsigned int numberOfThreads = this->GetNumberOfThreads();
+  this->m_Errors.assign( numberOfThreads, std::string() );
+
+  SeriesThreadStruct str;
+  str.Reader = this;
+  str.Task = task;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( this->SeriesThreaderCallback, &str );
+  threader->SingleMethodExecute();
+
+  for( unsigned int n = 0; n < this->m_Errors.size(); n++ )
+    {
+    if( !this->m_Errors[n].empty() )
+      {
+      if( task == ReadHeaders )
+        {
+        this->m_SliceHeaders.clear();
+        }
+      itkExceptionMacro( << this->m_Errors[n] );
+      }
+    }
+}
+
+template<class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+ParallelDICOMSeriesReader<TOutputImage>
+::SeriesThreaderCallback( void *arg )
+{
+  unsigned int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  unsigned int threadCount =
+    ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  SeriesThreadStruct *str = (SeriesThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  if( str->Task == ReadHeaders )
+    {
+    str->Reader->ThreadedReadHeaders( threadId, threadCount );
+    }
+  else
+    {
+    str->Reader->ThreadedReadSlices( threadId, threadCount );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TOutputImage>
+void
+ParallelDICOMSeriesReader<TOutputImage>
+::ThreadedReadHeaders( unsigned int threadId, unsigned int numberOfThreads )
+{
+  // The first header has already been read.
+  const unsigned long numberOfFiles = this->m_FileNames.size() - 1;
+  const unsigned long begin = 1 + numberOfFiles * threadId / numberOfThreads;
+  const unsigned long end = 1 + numberOfFiles * ( threadId + 1 ) / numberOfThreads;
+
+  for( unsigned long n = begin; n < end; n++ )
+    {
+    if( !ReadSliceHeader( this->m_FileNames[n], this->m_SliceHeaders[n] ) )
+      {
+      this->m_Errors[threadId] = std::string( "Unable to read the header of " )
+        + this->m_FileNames[n];
+      return;
+      }
+    }
+}
+
+template<class TOutputImage>
+void
+ParallelDICOMSeriesReader<TOutputImage>
+::ThreadedReadSlices( unsigned int threadId, unsigned int numberOfThreads )
+{
+  typedef Image<PixelType, 2>                  SliceImageType;
+  typedef ImageFileReader<SliceImageType>      SliceReaderType;
+
+  OutputImageType *output = this->GetOutput();
+  const RegionType region = output->GetBufferedRegion();
+  const unsigned long sliceSize = region.GetSize()[0] * region.GetSize()[1];
+  const unsigned long firstSlice = region.GetIndex()[2];
+  const unsigned long numberOfSlices = region.GetSize()[2];
+
+  const unsigned long begin = numberOfSlices * threadId / numberOfThreads;
+  const unsigned long end = numberOfSlices * ( threadId + 1 ) / numberOfThreads;
+
+  for( unsigned long n = begin; n < end; n++ )
+    {
+    const std::string & fileName = this->m_FileNames[firstSlice + n];
+    try
+      {
+      typename SliceReaderType::Pointer reader = SliceReaderType::New();
+      reader->SetImageIO( GDCMImageIO::New() );
+      reader->SetFileName( fileName.c_str() );
+      reader->Update();
+
+      const SliceImageType *slice = reader->GetOutput();
+      if( slice->GetBufferedRegion().GetNumberOfPixels() != sliceSize )
+        {
+        this->m_Errors[threadId] = fileName +
+          std::string( " does not have the slice size of the series." );
+        return;
+        }
+      std::copy( slice->GetBufferPointer(),
+        slice->GetBufferPointer() + sliceSize,
+        output->GetBufferPointer() + n * sliceSize );
+      }
+    catch( ExceptionObject & e )
+      {
+      this->m_Errors[threadId] = fileName + std::string( ": " ) +
+        e.GetDescription();
+      return;
+      }
+    }
+}
+
+template<class TOutputImage>
+void
+ParallelDICOMSeriesReader<TOutputImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Number of files: " << this->m_FileNames.size()
+    << std::endl;
+  os << indent << "Number of slice headers: " << this->m_SliceHeaders.size()
+    << std::endl;
+}
+
+} // end namespace itk
+
+#endif
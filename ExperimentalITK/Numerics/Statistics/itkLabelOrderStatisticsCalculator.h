@@ -0,0 +1,227 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkLabelOrderStatisticsCalculator_h
+#define __itkLabelOrderStatisticsCalculator_h
+
+#include "itkIntTypes.h"
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+#include "itkStreamingQuantileSketch.h"
+
+#include <map>
+#include <vector>
+
+namespace itk {
+namespace Statistics {
+
+/** \class LabelOrderStatisticsCalculator
+ * \brief Percentiles and other order statistics of an image per label.
+ *
+ * Compute() gathers the finite values of every label and sorts them, so
+ * any number of percentiles per label can then be queried without another
+ * pass over the image.  The values are stored as float keys whose unsigned
+ * order is the float order and sorted with a least significant digit radix
+ * sort of three 11 bit passes, which is linear in the number of voxels.
+ * The image is scanned by threads, labels with few values are sorted on
+ * one thread each, and the passes of large labels are split among the
+ * threads.  Memory is two floats per voxel.
+ *
+ * With UseApproximateQuantiles on, the values are instead fed to a
+ * StreamingQuantileSketch per label and thread and the sketches are merged,
+ * so memory does not depend on the image size.  Only the count, the
+ * extrema and GetQuantile() are then available.
+ *
+ * Without a label image, all voxels have label 1.  The label image must
+ * have the buffered region of the image.
+ */
+
+template<class TImage, class TLabelImage>
+class ITK_EXPORT LabelOrderStatisticsCalculator : public Object
+{
+public:
+  /**
+   * Standard class typedefs.
+   */
+  typedef LabelOrderStatisticsCalculator                      Self;
+  typedef Object                                              Superclass;
+  typedef SmartPointer<Self>                                  Pointer;
+  typedef SmartPointer<const Self>                            ConstPointer;
+
+  /**
+   * Standard macros
+   */
+  itkTypeMacro( LabelOrderStatisticsCalculator, Object );
+
+  /**
+   * Method for creation through the object factory.
+   */
+  itkNewMacro( Self );
+
+  typedef TImage                                              ImageType;
+  typedef TLabelImage                                         LabelImageType;
+  typedef typename LabelImageType::PixelType                  LabelType;
+  typedef std::vector<LabelType>                              LabelContainerType;
+
+  typedef float                                               RealType;
+  typedef StreamingQuantileSketch<RealType>                   SketchType;
+
+  itkSetConstObjectMacro( Image, ImageType );
+  itkGetConstObjectMacro( Image, ImageType );
+
+  itkSetConstObjectMacro( LabelImage, LabelImageType );
+  itkGetConstObjectMacro( LabelImage, LabelImageType );
+
+  itkSetMacro( UseApproximateQuantiles, bool );
+  itkGetConstMacro( UseApproximateQuantiles, bool );
+  itkBooleanMacro( UseApproximateQuantiles );
+
+  /** K of the sketches used for approximate quantiles.  Default is 200. */
+  itkSetClampMacro( SketchSize, unsigned int, 8,
+    NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( SketchSize, unsigned int );
+
+  itkSetClampMacro( NumberOfThreads, unsigned int, 1,
+    NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( NumberOfThreads, unsigned int );
+
+  /** Triggers the computation. */
+  void Compute();
+
+  /** The labels found, in ascending order. */
+  const LabelContainerType & GetLabels() const
+    {
+    return this->m_Labels;
+    }
+
+  bool HasLabel( LabelType label ) const
+    {
+    return this->m_LabelIndices.find( label ) != this->m_LabelIndices.end();
+    }
+
+  /** Number of finite values with the label. */
+  SizeValueType GetCount( LabelType label ) const;
+
+  RealType GetMinimum( LabelType label ) const;
+  RealType GetMaximum( LabelType label ) const;
+
+  /** The quantile p in [0,1], linearly interpolated between the values of
+   * zero-based rank floor( h ) and ceil( h ) with h = p * ( count - 1 ), as
+   * numpy.percentile does.  Approximate quantiles are retained values of
+   * the sketch. */
+  RealType GetQuantile( LabelType label, double p ) const;
+
+  /** Exact only: the value of zero-based rank n. */
+  RealType GetValueAtRank( LabelType label, SizeValueType n ) const;
+
+  /** Exact only: the number of values less than the threshold, e.g. the
+   * number of voxels below -950 HU. */
+  SizeValueType GetNumberOfValuesLessThan( LabelType label,
+    RealType threshold ) const;
+
+  /** Float values and the unsigned keys that sort in the same order. */
+  static uint32_t EncodeKey( RealType value );
+  static RealType DecodeKey( uint32_t key );
+
+protected:
+  LabelOrderStatisticsCalculator();
+  ~LabelOrderStatisticsCalculator() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  LabelOrderStatisticsCalculator( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  enum ThreadedStageType { CountStage, ScatterStage, SketchStage,
+    SortSmallLabelsStage, RadixCountStage, RadixScatterStage };
+
+  struct OrderStatisticsThreadStruct
+    {
+    LabelOrderStatisticsCalculator *Calculator;
+    ThreadedStageType               Stage;
+    };
+
+  typedef std::map<LabelType, SizeValueType>                 LabelCountMapType;
+  typedef std::map<LabelType, unsigned int>                  LabelIndexMapType;
+  typedef std::map<LabelType, typename SketchType::Pointer>  LabelSketchMapType;
+
+  static const unsigned int RadixBits = 11;
+  static const unsigned int RadixSize = 1u << RadixBits;
+  static const unsigned int NumberOfRadixPasses = 3;
+
+  /** Labels with fewer values are sorted by a single thread. */
+  static const SizeValueType SmallLabelSize = 65536;
+
+  static ITK_THREAD_RETURN_TYPE OrderStatisticsThreaderCallback( void *arg );
+
+  void ExecuteThreadedStage( ThreadedStageType stage,
+    unsigned int numberOfThreads );
+
+  void ThreadedCount( unsigned int threadId, unsigned int numberOfThreads );
+  void ThreadedScatter( unsigned int threadId, unsigned int numberOfThreads );
+  void ThreadedSketch( unsigned int threadId, unsigned int numberOfThreads );
+  void ThreadedSortSmallLabels( unsigned int threadId,
+    unsigned int numberOfThreads );
+  void ThreadedRadixCount( unsigned int threadId, unsigned int numberOfThreads );
+  void ThreadedRadixScatter( unsigned int threadId,
+    unsigned int numberOfThreads );
+
+  /** Sorts keys [begin, end) of m_Keys on the calling thread.  The sorted
+   * keys end up in m_Scratch, like those of the threaded sort. */
+  void SortRange( SizeValueType begin, SizeValueType end );
+
+  unsigned int GetLabelIndex( LabelType label ) const;
+
+  typename ImageType::ConstPointer                    m_Image;
+  typename LabelImageType::ConstPointer               m_LabelImage;
+  bool                                                m_UseApproximateQuantiles;
+  unsigned int                                        m_SketchSize;
+  unsigned int                                        m_NumberOfThreads;
+
+  LabelContainerType                                  m_Labels;
+  LabelIndexMapType                                   m_LabelIndices;
+
+  /** Exact mode: the sorted keys of all labels, one segment per label. */
+  std::vector<uint32_t>                               m_Keys;
+  std::vector<uint32_t>                               m_Scratch;
+  std::vector<SizeValueType>                          m_SegmentBegins;
+
+  /** Approximate mode: one merged sketch per label. */
+  std::vector<typename SketchType::Pointer>           m_Sketches;
+
+  /** Per thread state of the threaded stages. */
+  std::vector<LabelCountMapType>                      m_ThreadCounts;
+  std::vector<std::vector<SizeValueType> >            m_ThreadOffsets;
+  std::vector<LabelSketchMapType>                     m_ThreadSketches;
+  std::vector<SizeValueType>                          m_RadixCounts;
+  const uint32_t                                     *m_RadixSource;
+  uint32_t                                           *m_RadixDestination;
+  SizeValueType                                       m_RadixBegin;
+  SizeValueType                                       m_RadixEnd;
+  unsigned int                                        m_RadixShift;
+
+}; // end of class
+
+} // end of namespace Statistics
+} // end of namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkLabelOrderStatisticsCalculator.hxx"
+#endif
+
+#endif
@@ -0,0 +1,622 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkLabelOrderStatisticsCalculator_hxx
+#define __itkLabelOrderStatisticsCalculator_hxx
+
+#include "itkLabelOrderStatisticsCalculator.h"
+
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace itk {
+namespace Statistics {
+
+template<class TImage, class TLabelImage>
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::LabelOrderStatisticsCalculator()
+{
+  this->m_UseApproximateQuantiles = false;
+  this->m_SketchSize = 200;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->m_RadixSource = NULL;
+  this->m_RadixDestination = NULL;
+  this->m_RadixBegin = 0;
+  this->m_RadixEnd = 0;
+  this->m_RadixShift = 0;
+}
+
+template<class TImage, class TLabelImage>
+uint32_t
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::EncodeKey( RealType value )
+{
+  uint32_t bits;
+  std::memcpy( &bits, &value, sizeof( bits ) );
+  // Negative values have their order reversed by flipping all bits;
+  // setting the sign bit of the others puts them above.
+  return ( bits & 0x80000000u ) ? ~bits : ( bits | 0x80000000u );
+}
+
+template<class TImage, class TLabelImage>
+typename LabelOrderStatisticsCalculator<TImage, TLabelImage>::RealType
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::DecodeKey( uint32_t key )
+{
+  const uint32_t bits = ( key & 0x80000000u ) ? ( key & 0x7fffffffu ) : ~key;
+  RealType value;
+  std::memcpy( &value, &bits, sizeof( value ) );
+  return value;
+}
+
+template<class TImage, class TLabelImage>
+void
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::Compute()
+{
+  if( !this->m_Image )
+    {
+    itkExceptionMacro( "The image is not set." );
+    }
+  if( this->m_LabelImage && this->m_LabelImage->GetBufferedRegion() !=
+    this->m_Image->GetBufferedRegion() )
+    {
+    itkExceptionMacro( "The label image and the image must have the same "
+      << "buffered region." );
+    }
+
+  this->m_Labels.clear();
+  this->m_LabelIndices.clear();
+  this->m_Keys.clear();
+  this->m_SegmentBegins.clear();
+  this->m_Sketches.clear();
+
+  const SizeValueType numberOfVoxels =
+    this->m_Image->GetBufferedRegion().GetNumberOfPixels();
+  const unsigned int numberOfThreads = std::max( 1u, static_cast<unsigned int>(
+    std::min( static_cast<SizeValueType>( std::min( this->m_NumberOfThreads,
+    MultiThreader::GetGlobalMaximumNumberOfThreads() ) ), numberOfVoxels ) ) );
+
+  if( this->m_UseApproximateQuantiles )
+    {
+    this->m_ThreadSketches.assign( numberOfThreads, LabelSketchMapType() );
+    this->ExecuteThreadedStage( SketchStage, numberOfThreads );
+
+    LabelSketchMapType sketches;
+    for( unsigned int t = 0; t < numberOfThreads; t++ )
+      {
+      typename LabelSketchMapType::const_iterator it;
+      for( it = this->m_ThreadSketches[t].begin();
+        it != this->m_ThreadSketches[t].end(); ++it )
+        {
+        typename LabelSketchMapType::iterator found = sketches.find( it->first );
+        if( found == sketches.end() )
+          {
+          sketches[it->first] = it->second;
+          }
+        else
+          {
+          found->second->Merge( it->second );
+          }
+        }
+      }
+    this->m_ThreadSketches.clear();
+
+    typename LabelSketchMapType::const_iterator it;
+    for( it = sketches.begin(); it != sketches.end(); ++it )
+      {
+      this->m_LabelIndices[it->first] = this->m_Labels.size();
+      this->m_Labels.push_back( it->first );
+      this->m_Sketches.push_back( it->second );
+      }
+    return;
+    }
+
+  /**
+   * Count the values of every label per thread, then give every thread
+   * its own range of every label segment to scatter its keys into.
+   */
+  this->m_ThreadCounts.assign( numberOfThreads, LabelCountMapType() );
+  this->ExecuteThreadedStage( CountStage, numberOfThreads );
+
+  LabelCountMapType counts;
+  for( unsigned int t = 0; t < numberOfThreads; t++ )
+    {
+    typename LabelCountMapType::const_iterator it;
+    for( it = this->m_ThreadCounts[t].begin();
+      it != this->m_ThreadCounts[t].end(); ++it )
+      {
+      counts[it->first] += it->second;
+      }
+    }
+
+  this->m_SegmentBegins.push_back( 0 );
+  typename LabelCountMapType::const_iterator it;
+  for( it = counts.begin(); it != counts.end(); ++it )
+    {
+    this->m_LabelIndices[it->first] = this->m_Labels.size();
+    this->m_Labels.push_back( it->first );
+    this->m_SegmentBegins.push_back( this->m_SegmentBegins.back() + it->second );
+    }
+  const unsigned int numberOfLabels = this->m_Labels.size();
+  if( numberOfLabels == 0 )
+    {
+    this->m_ThreadCounts.clear();
+    return;
+    }
+
+  this->m_ThreadOffsets.assign( numberOfThreads,
+    std::vector<SizeValueType>( numberOfLabels ) );
+  for( unsigned int l = 0; l < numberOfLabels; l++ )
+    {
+    SizeValueType offset = this->m_SegmentBegins[l];
+    for( unsigned int t = 0; t < numberOfThreads; t++ )
+      {
+      this->m_ThreadOffsets[t][l] = offset;
+      typename LabelCountMapType::const_iterator found =
+        this->m_ThreadCounts[t].find( this->m_Labels[l] );
+      if( found != this->m_ThreadCounts[t].end() )
+        {
+        offset += found->second;
+        }
+      }
+    }
+  this->m_ThreadCounts.clear();
+
+  this->m_Keys.resize( this->m_SegmentBegins.back() );
+  this->ExecuteThreadedStage( ScatterStage, numberOfThreads );
+  this->m_ThreadOffsets.clear();
+
+  /**
+   * Sort every segment.  Each pass moves the keys between m_Keys and
+   * m_Scratch, so after the three passes all sorted keys are in m_Scratch.
+   */
+  this->m_Scratch.resize( this->m_Keys.size() );
+  this->ExecuteThreadedStage( SortSmallLabelsStage, numberOfThreads );
+
+  for( unsigned int l = 0; l < numberOfLabels; l++ )
+    {
+    this->m_RadixBegin = this->m_SegmentBegins[l];
+    this->m_RadixEnd = this->m_SegmentBegins[l + 1];
+    if( this->m_RadixEnd - this->m_RadixBegin < SmallLabelSize )
+      {
+      continue;
+      }
+    for( unsigned int pass = 0; pass < NumberOfRadixPasses; pass++ )
+      {
+      this->m_RadixShift = pass * RadixBits;
+      if( pass % 2 == 0 )
+        {
+        this->m_RadixSource = &this->m_Keys[0];
+        this->m_RadixDestination = &this->m_Scratch[0];
+        }
+      else
+        {
+        this->m_RadixSource = &this->m_Scratch[0];
+        this->m_RadixDestination = &this->m_Keys[0];
+        }
+
+      this->m_RadixCounts.assign( numberOfThreads * RadixSize, 0 );
+      this->ExecuteThreadedStage( RadixCountStage, numberOfThreads );
+
+      // Digit-major, thread-minor offsets keep the sort stable.
+      SizeValueType offset = this->m_RadixBegin;
+      for( unsigned int digit = 0; digit < RadixSize; digit++ )
+        {
+        for( unsigned int t = 0; t < numberOfThreads; t++ )
+          {
+          const SizeValueType count = this->m_RadixCounts[t * RadixSize + digit];
+          this->m_RadixCounts[t * RadixSize + digit] = offset;
+          offset += count;
+          }
+        }
+      this->ExecuteThreadedStage( RadixScatterStage, numberOfThreads );
+      }
+    }
+  this->m_RadixCounts.clear();
+
+  this->m_Keys.swap( this->m_Scratch );
+  std::vector<uint32_t>().swap( this->m_Scratch );
+}
+
+template<class TImage, class TLabelImage>
+void
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::ExecuteThreadedStage( ThreadedStageType stage, unsigned int numberOfThreads )
+{
+  OrderStatisticsThreadStruct str;
+  str.Calculator = this;
+  str.Stage = stage;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( this->OrderStatisticsThreaderCallback, &str );
+  threader->SingleMethodExecute();
+}
+
+template<class TImage, class TLabelImage>
+ITK_THREAD_RETURN_TYPE
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::OrderStatisticsThreaderCallback( void *arg )
+{
+  MultiThreader::ThreadInfoStruct *info =
+    static_cast<MultiThreader::ThreadInfoStruct *>( arg );
+  OrderStatisticsThreadStruct *str =
+    static_cast<OrderStatisticsThreadStruct *>( info->UserData );
+
+  const unsigned int threadId = info->ThreadID;
+  const unsigned int numberOfThreads = info->NumberOfThreads;
+
+  switch( str->Stage )
+    {
+    case CountStage:
+      str->Calculator->ThreadedCount( threadId, numberOfThreads );
+      break;
+    case ScatterStage:
+      str->Calculator->ThreadedScatter( threadId, numberOfThreads );
+      break;
+    case SketchStage:
+      str->Calculator->ThreadedSketch( threadId, numberOfThreads );
+      break;
+    case SortSmallLabelsStage:
+      str->Calculator->ThreadedSortSmallLabels( threadId, numberOfThreads );
+      break;
+    case RadixCountStage:
+      str->Calculator->ThreadedRadixCount( threadId, numberOfThreads );
+      break;
+    case RadixScatterStage:
+      str->Calculator->ThreadedRadixScatter( threadId, numberOfThreads );
+      break;
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TImage, class TLabelImage>
+void
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::ThreadedCount( unsigned int threadId, unsigned int numberOfThreads )
+{
+  const typename ImageType::PixelType *image =
+    this->m_Image->GetBufferPointer();
+  const LabelType *labels = this->m_LabelImage ?
+    this->m_LabelImage->GetBufferPointer() : NULL;
+
+  const SizeValueType numberOfVoxels =
+    this->m_Image->GetBufferedRegion().GetNumberOfPixels();
+  const SizeValueType begin = numberOfVoxels * threadId / numberOfThreads;
+  const SizeValueType end = numberOfVoxels * ( threadId + 1 ) / numberOfThreads;
+
+  LabelCountMapType & counts = this->m_ThreadCounts[threadId];
+
+  // Neighboring voxels mostly share their label, so the map is only
+  // searched when the label changes.
+  SizeValueType *count = NULL;
+  LabelType currentLabel = NumericTraits<LabelType>::Zero;
+  for( SizeValueType n = begin; n < end; n++ )
+    {
+    if( !vnl_math_isfinite( static_cast<RealType>( image[n] ) ) )
+      {
+      continue;
+      }
+    const LabelType label = labels ? labels[n] : NumericTraits<LabelType>::One;
+    if( !count || label != currentLabel )
+      {
+      currentLabel = label;
+      count = &counts[label];
+      }
+    ( *count )++;
+    }
+}
+
+template<class TImage, class TLabelImage>
+void
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::ThreadedScatter( unsigned int threadId, unsigned int numberOfThreads )
+{
+  const typename ImageType::PixelType *image =
+    this->m_Image->GetBufferPointer();
+  const LabelType *labels = this->m_LabelImage ?
+    this->m_LabelImage->GetBufferPointer() : NULL;
+
+  const SizeValueType numberOfVoxels =
+    this->m_Image->GetBufferedRegion().GetNumberOfPixels();
+  const SizeValueType begin = numberOfVoxels * threadId / numberOfThreads;
+  const SizeValueType end = numberOfVoxels * ( threadId + 1 ) / numberOfThreads;
+
+  std::vector<SizeValueType> & offsets = this->m_ThreadOffsets[threadId];
+  uint32_t *keys = &this->m_Keys[0];
+
+  SizeValueType *offset = NULL;
+  LabelType currentLabel = NumericTraits<LabelType>::Zero;
+  for( SizeValueType n = begin; n < end; n++ )
+    {
+    const RealType value = static_cast<RealType>( image[n] );
+    if( !vnl_math_isfinite( value ) )
+      {
+      continue;
+      }
+    const LabelType label = labels ? labels[n] : NumericTraits<LabelType>::One;
+    if( !offset || label != currentLabel )
+      {
+      currentLabel = label;
+      offset = &offsets[this->GetLabelIndex( label )];
+      }
+    keys[( *offset )++] = EncodeKey( value );
+    }
+}
+
+template<class TImage, class TLabelImage>
+void
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::ThreadedSketch( unsigned int threadId, unsigned int numberOfThreads )
+{
+  const typename ImageType::PixelType *image =
+    this->m_Image->GetBufferPointer();
+  const LabelType *labels = this->m_LabelImage ?
+    this->m_LabelImage->GetBufferPointer() : NULL;
+
+  const SizeValueType numberOfVoxels =
+    this->m_Image->GetBufferedRegion().GetNumberOfPixels();
+  const SizeValueType begin = numberOfVoxels * threadId / numberOfThreads;
+  const SizeValueType end = numberOfVoxels * ( threadId + 1 ) / numberOfThreads;
+
+  LabelSketchMapType & sketches = this->m_ThreadSketches[threadId];
+
+  SketchType *sketch = NULL;
+  LabelType currentLabel = NumericTraits<LabelType>::Zero;
+  for( SizeValueType n = begin; n < end; n++ )
+    {
+    const RealType value = static_cast<RealType>( image[n] );
+    if( !vnl_math_isfinite( value ) )
+      {
+      continue;
+      }
+    const LabelType label = labels ? labels[n] : NumericTraits<LabelType>::One;
+    if( !sketch || label != currentLabel )
+      {
+      currentLabel = label;
+      typename SketchType::Pointer & labelSketch = sketches[label];
+      if( !labelSketch )
+        {
+        labelSketch = SketchType::New();
+        labelSketch->SetK( this->m_SketchSize );
+        }
+      sketch = labelSketch.GetPointer();
+      }
+    sketch->AddValue( value );
+    }
+}
+
+template<class TImage, class TLabelImage>
+void
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::ThreadedSortSmallLabels( unsigned int threadId, unsigned int numberOfThreads )
+{
+  for( unsigned int l = threadId; l < this->m_Labels.size();
+    l += numberOfThreads )
+    {
+    const SizeValueType begin = this->m_SegmentBegins[l];
+    const SizeValueType end = this->m_SegmentBegins[l + 1];
+    if( end - begin < SmallLabelSize )
+      {
+      this->SortRange( begin, end );
+      }
+    }
+}
+
+template<class TImage, class TLabelImage>
+void
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::SortRange( SizeValueType begin, SizeValueType end )
+{
+  std::vector<SizeValueType> offsets( RadixSize );
+  for( unsigned int pass = 0; pass < NumberOfRadixPasses; pass++ )
+    {
+    const unsigned int shift = pass * RadixBits;
+    const uint32_t *source = ( pass % 2 == 0 ) ?
+      &this->m_Keys[0] : &this->m_Scratch[0];
+    uint32_t *destination = ( pass % 2 == 0 ) ?
+      &this->m_Scratch[0] : &this->m_Keys[0];
+
+    std::fill( offsets.begin(), offsets.end(), 0 );
+    for( SizeValueType n = begin; n < end; n++ )
+      {
+      offsets[( source[n] >> shift ) & ( RadixSize - 1 )]++;
+      }
+    SizeValueType offset = begin;
+    for( unsigned int digit = 0; digit < RadixSize; digit++ )
+      {
+      const SizeValueType count = offsets[digit];
+      offsets[digit] = offset;
+      offset += count;
+      }
+    for( SizeValueType n = begin; n < end; n++ )
+      {
+      destination[offsets[( source[n] >> shift ) & ( RadixSize - 1 )]++] =
+        source[n];
+      }
+    }
+}
+
+template<class TImage, class TLabelImage>
+void
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::ThreadedRadixCount( unsigned int threadId, unsigned int numberOfThreads )
+{
+  const SizeValueType size = this->m_RadixEnd - this->m_RadixBegin;
+  const SizeValueType begin = this->m_RadixBegin + size * threadId / numberOfThreads;
+  const SizeValueType end = this->m_RadixBegin + size * ( threadId + 1 ) / numberOfThreads;
+
+  SizeValueType *counts = &this->m_RadixCounts[threadId * RadixSize];
+  const uint32_t *source = this->m_RadixSource;
+  const unsigned int shift = this->m_RadixShift;
+  for( SizeValueType n = begin; n < end; n++ )
+    {
+    counts[( source[n] >> shift ) & ( RadixSize - 1 )]++;
+    }
+}
+
+template<class TImage, class TLabelImage>
+void
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::ThreadedRadixScatter( unsigned int threadId, unsigned int numberOfThreads )
+{
+  const SizeValueType size = this->m_RadixEnd - this->m_RadixBegin;
+  const SizeValueType begin = this->m_RadixBegin + size * threadId / numberOfThreads;
+  const SizeValueType end = this->m_RadixBegin + size * ( threadId + 1 ) / numberOfThreads;
+
+  SizeValueType *offsets = &this->m_RadixCounts[threadId * RadixSize];
+  const uint32_t *source = this->m_RadixSource;
+  uint32_t *destination = this->m_RadixDestination;
+  const unsigned int shift = this->m_RadixShift;
+  for( SizeValueType n = begin; n < end; n++ )
+    {
+    destination[offsets[( source[n] >> shift ) & ( RadixSize - 1 )]++] =
+      source[n];
+    }
+}
+
+template<class TImage, class TLabelImage>
+unsigned int
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::GetLabelIndex( LabelType label ) const
+{
+  typename LabelIndexMapType::const_iterator it =
+    this->m_LabelIndices.find( label );
+  if( it == this->m_LabelIndices.end() )
+    {
+    itkExceptionMacro( "Label " << static_cast<typename
+      NumericTraits<LabelType>::PrintType>( label ) << " was not found." );
+    }
+  return it->second;
+}
+
+template<class TImage, class TLabelImage>
+SizeValueType
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::GetCount( LabelType label ) const
+{
+  const unsigned int l = this->GetLabelIndex( label );
+  if( this->m_UseApproximateQuantiles )
+    {
+    return this->m_Sketches[l]->GetCount();
+    }
+  return this->m_SegmentBegins[l + 1] - this->m_SegmentBegins[l];
+}
+
+template<class TImage, class TLabelImage>
+typename LabelOrderStatisticsCalculator<TImage, TLabelImage>::RealType
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::GetMinimum( LabelType label ) const
+{
+  if( this->m_UseApproximateQuantiles )
+    {
+    return this->m_Sketches[this->GetLabelIndex( label )]->GetMinimum();
+    }
+  return this->GetValueAtRank( label, 0 );
+}
+
+template<class TImage, class TLabelImage>
+typename LabelOrderStatisticsCalculator<TImage, TLabelImage>::RealType
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::GetMaximum( LabelType label ) const
+{
+  if( this->m_UseApproximateQuantiles )
+    {
+    return this->m_Sketches[this->GetLabelIndex( label )]->GetMaximum();
+    }
+  return this->GetValueAtRank( label, this->GetCount( label ) - 1 );
+}
+
+template<class TImage, class TLabelImage>
+typename LabelOrderStatisticsCalculator<TImage, TLabelImage>::RealType
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::GetQuantile( LabelType label, double p ) const
+{
+  p = std::min( std::max( p, 0.0 ), 1.0 );
+  if( this->m_UseApproximateQuantiles )
+    {
+    return this->m_Sketches[this->GetLabelIndex( label )]->GetQuantile( p );
+    }
+
+  const double h = p * static_cast<double>( this->GetCount( label ) - 1 );
+  const SizeValueType lower = static_cast<SizeValueType>( std::floor( h ) );
+  const RealType lowerValue = this->GetValueAtRank( label, lower );
+  if( static_cast<double>( lower ) == h )
+    {
+    return lowerValue;
+    }
+  const RealType upperValue = this->GetValueAtRank( label, lower + 1 );
+  return static_cast<RealType>( lowerValue + ( h - lower ) *
+    ( upperValue - lowerValue ) );
+}
+
+template<class TImage, class TLabelImage>
+typename LabelOrderStatisticsCalculator<TImage, TLabelImage>::RealType
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::GetValueAtRank( LabelType label, SizeValueType n ) const
+{
+  if( this->m_UseApproximateQuantiles )
+    {
+    itkExceptionMacro( "Ranks are only available for exact quantiles." );
+    }
+  const unsigned int l = this->GetLabelIndex( label );
+  if( n >= this->m_SegmentBegins[l + 1] - this->m_SegmentBegins[l] )
+    {
+    itkExceptionMacro( "Rank " << n << " is out of range." );
+    }
+  return DecodeKey( this->m_Keys[this->m_SegmentBegins[l] + n] );
+}
+
+template<class TImage, class TLabelImage>
+SizeValueType
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::GetNumberOfValuesLessThan( LabelType label, RealType threshold ) const
+{
+  if( this->m_UseApproximateQuantiles )
+    {
+    itkExceptionMacro( "Counts below a threshold are only available for "
+      << "exact quantiles." );
+    }
+  const unsigned int l = this->GetLabelIndex( label );
+  const uint32_t *begin = &this->m_Keys[0] + this->m_SegmentBegins[l];
+  const uint32_t *end = &this->m_Keys[0] + this->m_SegmentBegins[l + 1];
+  return std::lower_bound( begin, end, EncodeKey( threshold ) ) - begin;
+}
+
+template<class TImage, class TLabelImage>
+void
+LabelOrderStatisticsCalculator<TImage, TLabelImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Use approximate quantiles: "
+    << this->m_UseApproximateQuantiles << std::endl;
+  os << indent << "Sketch size: " << this->m_SketchSize << std::endl;
+  os << indent << "Number of threads: " << this->m_NumberOfThreads << std::endl;
+  os << indent << "Number of labels: " << this->m_Labels.size() << std::endl;
+}
+
+} // end of namespace Statistics
+} // end of namespace itk
+
+#endif
@@ -0,0 +1,132 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkLabelScalarImageToCooccurrenceMatricesGenerator_h
+#define __itkLabelScalarImageToCooccurrenceMatricesGenerator_h
+
+#include "itkLabelScalarImageToMatricesGeneratorBase.h"
+
+#include "itkFixedArray.h"
+
+namespace itk {
+  namespace Statistics {
+
+/** \class LabelScalarImageToCooccurrenceMatricesGenerator
+ * \brief Computes the grey level co-occurrence matrices of every label of a
+ * label image and every offset direction in a single pass.
+ *
+ * The input is quantized and split over the threads as described in
+ * LabelScalarImageToMatricesGeneratorBase.  Each voxel is paired with its
+ * neighbor at every offset if both voxels belong to the same label.  As in
+ * ScalarImageToCooccurrenceMatrixFilter, pairs are counted symmetrically,
+ * so only the lower triangle of each matrix is stored.
+ *
+ * The features are those of HistogramToTextureFeaturesFilter computed on
+ * the normalized matrix, in the order Energy, Entropy, Correlation,
+ * InverseDifferenceMoment, Inertia, ClusterShade, ClusterProminence and
+ * HaralickCorrelation.
+ */
+
+template< class TImageType, class TLabelImageType =
+  Image<unsigned int, TImageType::ImageDimension> >
+class LabelScalarImageToCooccurrenceMatricesGenerator
+  : public LabelScalarImageToMatricesGeneratorBase<TImageType, TLabelImageType>
+  {
+  public:
+    /** Standard typedefs */
+    typedef LabelScalarImageToCooccurrenceMatricesGenerator Self;
+    typedef LabelScalarImageToMatricesGeneratorBase<TImageType,
+      TLabelImageType> Superclass;
+    typedef SmartPointer<Self> Pointer;
+    typedef SmartPointer<const Self> ConstPointer;
+
+    /** Run-time type information (and related methods). */
+    itkTypeMacro( LabelScalarImageToCooccurrenceMatricesGenerator,
+      LabelScalarImageToMatricesGeneratorBase );
+
+    /** standard New() method support */
+    itkNewMacro( Self );
+
+    /** ImageDimension constants */
+    itkStaticConstMacro( ImageDimension, unsigned int,
+                         TImageType::ImageDimension );
+
+    typedef typename Superclass::RegionType                 RegionType;
+    typedef typename Superclass::OffsetType                 OffsetType;
+
+    /** Lower triangle of a co-occurrence matrix, row major, i.e. the
+     * frequency of the pair (i, j), i >= j, is at i * ( i + 1 ) / 2 + j. */
+    typedef typename Superclass::FrequencyType              FrequencyType;
+    typedef typename Superclass::MatrixType                 CooccurrenceMatrixType;
+
+    typedef FixedArray<double, 8>                           FeatureArrayType;
+
+    /** The number of grey level bins along each axis of the matrices. */
+    void SetNumberOfBinsPerAxis( unsigned int numberOfBins )
+      {
+      this->SetNumberOfGreyLevelBins( numberOfBins );
+      }
+    unsigned int GetNumberOfBinsPerAxis() const
+      {
+      return this->GetNumberOfGreyLevelBins();
+      }
+
+    /** The co-occurrence matrix of the specified label (index into
+     * GetLabels()) and offset.  Valid after Compute(). */
+    const CooccurrenceMatrixType & GetCooccurrenceMatrix(
+      unsigned int whichLabel, unsigned int whichOffset ) const
+      {
+      return this->GetMatrix( whichLabel, whichOffset );
+      }
+
+    /** The features of the specified label and offset. */
+    FeatureArrayType GetFeatures( unsigned int whichLabel,
+      unsigned int whichOffset ) const;
+
+    /** The features of the specified label averaged over the offsets. */
+    FeatureArrayType GetFeatureMeans( unsigned int whichLabel ) const;
+
+    static const char * GetFeatureName( unsigned int n )
+      {
+      static const char * names[] = { "Energy", "Entropy", "Correlation",
+        "InverseDifferenceMoment", "Inertia", "ClusterShade",
+        "ClusterProminence", "HaralickCorrelation" };
+      return names[n];
+      }
+
+  protected:
+    LabelScalarImageToCooccurrenceMatricesGenerator() {};
+    virtual ~LabelScalarImageToCooccurrenceMatricesGenerator() {};
+
+    unsigned long GetMatrixSize() const;
+
+    void ThreadedComputeMatrices( unsigned int *, unsigned long,
+      unsigned long );
+
+  private:
+    LabelScalarImageToCooccurrenceMatricesGenerator( const Self& ); //purposely not implemented
+    void operator=( const Self& );                                  //purposely not implemented
+  };
+
+  } // end of namespace Statistics
+} // end of namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkLabelScalarImageToCooccurrenceMatricesGenerator.hxx"
+#endif
+
+#endif
@@ -0,0 +1,237 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkLabelScalarImageToCooccurrenceMatricesGenerator_hxx
+#define __itkLabelScalarImageToCooccurrenceMatricesGenerator_hxx
+
+#include "itkLabelScalarImageToCooccurrenceMatricesGenerator.h"
+
+#include "vnl/vnl_math.h"
+
+namespace itk {
+  namespace Statistics {
+
+    template< class TImageType, class TLabelImageType >
+    unsigned long
+    LabelScalarImageToCooccurrenceMatricesGenerator< TImageType, TLabelImageType >::
+    GetMatrixSize() const
+      {
+      return static_cast<unsigned long>( this->m_NumberOfGreyLevelBins ) *
+        ( this->m_NumberOfGreyLevelBins + 1 ) / 2;
+      }
+
+    template< class TImageType, class TLabelImageType >
+    void
+    LabelScalarImageToCooccurrenceMatricesGenerator< TImageType, TLabelImageType >::
+    ThreadedComputeMatrices( unsigned int *matrices, unsigned long firstSlice,
+      unsigned long lastSlice )
+      {
+      const RegionType region = this->m_Input->GetRequestedRegion();
+      const typename RegionType::SizeType size = region.GetSize();
+      const unsigned short outside = this->GetOutsideValue();
+
+      const unsigned long sliceSize = this->m_Strides[ImageDimension - 1];
+      const unsigned int numberOfOffsets = this->m_Offsets.size();
+      const unsigned long matrixSize = this->GetMatrixSize();
+      const std::vector<long> & steps = this->m_OffsetSteps;
+
+      long index[ImageDimension];
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        index[d] = 0;
+        }
+      index[ImageDimension - 1] = firstSlice;
+
+      const unsigned long begin = firstSlice * sliceSize;
+      const unsigned long end = lastSlice * sliceSize;
+      for( unsigned long n = begin; n < end; n++ )
+        {
+        const unsigned short grey = this->m_GreyLevels[n];
+        const unsigned short roi = this->m_RegionsOfInterest[n];
+
+        if( grey != outside )
+          {
+          unsigned int *roiMatrices = matrices + roi * numberOfOffsets * matrixSize;
+          for( unsigned int k = 0; k < numberOfOffsets; k++ )
+            {
+            const OffsetType & offset = this->m_Offsets[k];
+
+            bool isInside = true;
+            for( unsigned int d = 0; d < ImageDimension; d++ )
+              {
+              long c = index[d] + offset[d];
+              if( c < 0 || c >= static_cast<long>( size[d] ) )
+                {
+                isInside = false;
+                break;
+                }
+              }
+            if( !isInside )
+              {
+              continue;
+              }
+            const unsigned long m = n + steps[k];
+            if( this->m_RegionsOfInterest[m] != roi )
+              {
+              continue;
+              }
+            const unsigned int i = vnl_math_max( grey, this->m_GreyLevels[m] );
+            const unsigned int j = vnl_math_min( grey, this->m_GreyLevels[m] );
+            roiMatrices[k * matrixSize + i * ( i + 1 ) / 2 + j]++;
+            }
+          }
+
+        // Advance the index along the scanline.
+        for( unsigned int d = 0; d < ImageDimension; d++ )
+          {
+          if( ++index[d] < static_cast<long>( size[d] ) )
+            {
+            break;
+            }
+          index[d] = 0;
+          }
+        }
+      }
+
+    template< class TImageType, class TLabelImageType >
+    typename LabelScalarImageToCooccurrenceMatricesGenerator< TImageType,
+      TLabelImageType >::FeatureArrayType
+    LabelScalarImageToCooccurrenceMatricesGenerator< TImageType, TLabelImageType >::
+    GetFeatures( unsigned int whichLabel, unsigned int whichOffset ) const
+      {
+      const CooccurrenceMatrixType & matrix =
+        this->GetCooccurrenceMatrix( whichLabel, whichOffset );
+      const unsigned int numberOfBins = this->m_NumberOfGreyLevelBins;
+
+      FeatureArrayType features;
+      features.Fill( 0.0 );
+
+      double total = 0.0;
+      for( unsigned long k = 0; k < matrix.size(); k++ )
+        {
+        total += static_cast<double>( matrix[k] );
+        }
+      if( total <= 0.0 )
+        {
+        return features;
+        }
+
+      // Each stored pair (i, j), i > j, stands for the entries (i, j) and
+      // (j, i) of the symmetric matrix, each with probability c / ( 2 total );
+      // a diagonal pair has probability c / total.  Any symmetric function
+      // f( i, j ) therefore sums as ( c / total ) f( i, j ) over the stored
+      // triangle.
+      std::vector<double> marginal( numberOfBins, 0.0 );
+      double mean = 0.0;
+      unsigned long k = 0;
+      for( unsigned int i = 0; i < numberOfBins; i++ )
+        {
+        for( unsigned int j = 0; j <= i; j++, k++ )
+          {
+          if( matrix[k] == 0 )
+            {
+            continue;
+            }
+          const double p = static_cast<double>( matrix[k] ) / total;
+          if( i == j )
+            {
+            marginal[i] += p;
+            }
+          else
+            {
+            marginal[i] += 0.5 * p;
+            marginal[j] += 0.5 * p;
+            }
+          mean += 0.5 * p * ( i + j );
+          }
+        }
+
+      double variance = 0.0;
+      double marginalMean = 0.0;
+      for( unsigned int i = 0; i < numberOfBins; i++ )
+        {
+        variance += marginal[i] * vnl_math_sqr( i - mean );
+        marginalMean += marginal[i];
+        }
+      marginalMean /= static_cast<double>( numberOfBins );
+      double marginalVariance = 0.0;
+      for( unsigned int i = 0; i < numberOfBins; i++ )
+        {
+        marginalVariance += vnl_math_sqr( marginal[i] - marginalMean );
+        }
+      marginalVariance /= static_cast<double>( numberOfBins );
+
+      const double log2 = vcl_log( 2.0 );
+      double sumProducts = 0.0;
+      k = 0;
+      for( unsigned int i = 0; i < numberOfBins; i++ )
+        {
+        for( unsigned int j = 0; j <= i; j++, k++ )
+          {
+          if( matrix[k] == 0 )
+            {
+            continue;
+            }
+          const double p = static_cast<double>( matrix[k] ) / total;
+          const double q = ( i == j ) ? p : 0.5 * p;
+          const double weight = ( i == j ) ? 1.0 : 2.0;
+          const double di = static_cast<double>( i ) - mean;
+          const double dj = static_cast<double>( j ) - mean;
+          const double d2 = vnl_math_sqr( static_cast<double>( i ) -
+            static_cast<double>( j ) );
+
+          features[0] += weight * q * q;
+          features[1] -= weight * q * vcl_log( q ) / log2;
+          features[2] += p * di * dj;
+          features[3] += p / ( 1.0 + d2 );
+          features[4] += p * d2;
+          features[5] += p * vcl_pow( di + dj, 3.0 );
+          features[6] += p * vcl_pow( di + dj, 4.0 );
+          sumProducts += p * static_cast<double>( i ) * static_cast<double>( j );
+          }
+        }
+      features[2] = ( variance > 0.0 ) ? features[2] / variance : 0.0;
+      features[7] = ( marginalVariance > 0.0 ) ? ( sumProducts -
+        marginalMean * marginalMean ) / marginalVariance : 0.0;
+
+      return features;
+      }
+
+    template< class TImageType, class TLabelImageType >
+    typename LabelScalarImageToCooccurrenceMatricesGenerator< TImageType,
+      TLabelImageType >::FeatureArrayType
+    LabelScalarImageToCooccurrenceMatricesGenerator< TImageType, TLabelImageType >::
+    GetFeatureMeans( unsigned int whichLabel ) const
+      {
+      FeatureArrayType means;
+      means.Fill( 0.0 );
+      for( unsigned int k = 0; k < this->m_Offsets.size(); k++ )
+        {
+        FeatureArrayType features = this->GetFeatures( whichLabel, k );
+        for( unsigned int n = 0; n < means.Size(); n++ )
+          {
+          means[n] += features[n] / static_cast<double>( this->m_Offsets.size() );
+          }
+        }
+      return means;
+      }
+
+  } // end of namespace Statistics
+} // end of namespace itk
+
+
+#endif
@@ -0,0 +1,240 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkLabelScalarImageToMatricesGeneratorBase_h
+#define __itkLabelScalarImageToMatricesGeneratorBase_h
+
+#include "itkImage.h"
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+
+#include <vector>
+
+namespace itk {
+  namespace Statistics {
+
+/** \class LabelScalarImageToMatricesGeneratorBase
+ * \brief Base class of the generators that compute a texture matrix of
+ * every label of a label image and every offset direction in one pass.
+ *
+ * Compute() quantizes the input once into NumberOfGreyLevelBins grey level
+ * bins and maps the labels once to region of interest indices.  The image
+ * is then split into slabs of consecutive scanlines along the last
+ * dimension, one per thread, and ThreadedComputeMatrices() of the subclass
+ * counts the slab into dense integer matrices owned by the thread.  The
+ * per-thread matrices are summed at the end.
+ *
+ * Without a label image the whole requested region forms a single region
+ * of interest.  Without specified labels all nonzero labels are used.
+ * Every label is binned over [Min, Max] (inclusive), over its own range
+ * given with SetLabelPixelValueMinMax or, with UseLabelPixelValueRanges
+ * on, over the range of its own voxels, so that it is binned exactly as if
+ * its matrices were computed on their own.
+ */
+
+template< class TImageType, class TLabelImageType >
+class LabelScalarImageToMatricesGeneratorBase : public Object
+  {
+  public:
+    /** Standard typedefs */
+    typedef LabelScalarImageToMatricesGeneratorBase Self;
+    typedef Object Superclass;
+    typedef SmartPointer<Self> Pointer;
+    typedef SmartPointer<const Self> ConstPointer;
+
+    /** Run-time type information (and related methods). */
+    itkTypeMacro( LabelScalarImageToMatricesGeneratorBase, Object );
+
+    /** ImageDimension constants */
+    itkStaticConstMacro( ImageDimension, unsigned int,
+                         TImageType::ImageDimension );
+
+    typedef TImageType                                      ImageType;
+    typedef typename ImageType::ConstPointer                ImageConstPointer;
+    typedef typename ImageType::PixelType                   PixelType;
+    typedef typename ImageType::IndexType                   IndexType;
+    typedef typename ImageType::RegionType                  RegionType;
+    typedef typename ImageType::OffsetType                  OffsetType;
+    typedef std::vector<OffsetType>                         OffsetContainerType;
+
+    typedef TLabelImageType                                 LabelImageType;
+    typedef typename LabelImageType::ConstPointer           LabelImageConstPointer;
+    typedef typename LabelImageType::PixelType              LabelType;
+    typedef std::vector<LabelType>                          LabelContainerType;
+
+    typedef typename NumericTraits<PixelType>::RealType     RealType;
+    typedef std::vector<PixelType>                          PixelContainerType;
+    typedef std::vector<RealType>                           RealContainerType;
+
+    typedef unsigned long                                   FrequencyType;
+    typedef std::vector<FrequencyType>                      MatrixType;
+
+    /** Triggers the computation of the matrices. */
+    void Compute( void );
+
+    /** Connects the input image. */
+    itkSetConstObjectMacro( Input, ImageType );
+    itkGetConstObjectMacro( Input, ImageType );
+
+    /** Connects the (optional) label image. */
+    itkSetConstObjectMacro( LabelImage, LabelImageType );
+    itkGetConstObjectMacro( LabelImage, LabelImageType );
+
+    /** Set/Get the labels for which matrices are computed.  If empty, all
+     * nonzero labels of the label image are used. */
+    void SetLabels( const LabelContainerType & labels )
+      {
+      this->m_Labels = labels;
+      this->Modified();
+      }
+    const LabelContainerType & GetLabels() const
+      {
+      return this->m_Labels;
+      }
+
+    /** Set/Get the offset directions.  The default offsets are the 13
+     * (3-D) or 4 (2-D) "previous" neighbors. */
+    void SetOffsets( const OffsetContainerType & offsets )
+      {
+      this->m_Offsets = offsets;
+      this->Modified();
+      }
+    const OffsetContainerType & GetOffsets() const
+      {
+      return this->m_Offsets;
+      }
+
+    itkSetClampMacro( NumberOfGreyLevelBins, unsigned int, 1, 65535 );
+    itkGetConstMacro( NumberOfGreyLevelBins, unsigned int );
+
+    /** Set the min and max (inclusive) pixel value that will be binned. */
+    void SetPixelValueMinMax( PixelType min, PixelType max );
+    itkGetConstMacro( Min, PixelType );
+    itkGetConstMacro( Max, PixelType );
+
+    /** Set the min and max (inclusive) pixel values of each label, in the
+     * order of GetLabels().  They replace the range set with
+     * SetPixelValueMinMax; empty containers restore it. */
+    void SetLabelPixelValueMinMax( const PixelContainerType & mins,
+      const PixelContainerType & maxs );
+
+    /** Bin every label over the range of its own voxels.  This replaces the
+     * ranges set with SetPixelValueMinMax and SetLabelPixelValueMinMax.
+     * Default is off. */
+    itkSetMacro( UseLabelPixelValueRanges, bool );
+    itkGetConstMacro( UseLabelPixelValueRanges, bool );
+    itkBooleanMacro( UseLabelPixelValueRanges );
+
+    /** The min and max pixel values each label was binned over, in the order
+     * of GetLabels().  Valid after Compute(). */
+    const PixelContainerType & GetLabelPixelValueMins() const
+      {
+      return this->m_RegionMins;
+      }
+    const PixelContainerType & GetLabelPixelValueMaxs() const
+      {
+      return this->m_RegionMaxs;
+      }
+
+    itkSetClampMacro( NumberOfThreads, unsigned int, 1,
+      NumericTraits<unsigned int>::max() );
+    itkGetConstMacro( NumberOfThreads, unsigned int );
+
+  protected:
+    LabelScalarImageToMatricesGeneratorBase();
+    virtual ~LabelScalarImageToMatricesGeneratorBase() {};
+    void PrintSelf( std::ostream& os, Indent indent ) const;
+
+    /** Number of counters of one matrix. */
+    virtual unsigned long GetMatrixSize() const = 0;
+
+    /** Called after the input is quantized and before the threads start. */
+    virtual void BeforeThreadedComputeMatrices() {};
+
+    /** Counts the voxels of slices [firstSlice, lastSlice) along the last
+     * dimension into the matrices of a thread, laid out label major, i.e.
+     * the matrix of region of interest r and offset k starts at
+     * ( r * NumberOfOffsets + k ) * GetMatrixSize(). */
+    virtual void ThreadedComputeMatrices( unsigned int *matrices,
+      unsigned long firstSlice, unsigned long lastSlice ) = 0;
+
+    /** The matrix of the specified label (index into GetLabels()) and
+     * offset.  Valid after Compute(). */
+    const MatrixType & GetMatrix( unsigned int whichLabel,
+      unsigned int whichOffset ) const
+      {
+      return this->m_Matrices[whichLabel * this->m_Offsets.size() + whichOffset];
+      }
+
+    /** Marks voxels outside the regions of interest or the binned ranges in
+     * m_GreyLevels and m_RegionsOfInterest. */
+    static unsigned short GetOutsideValue()
+      {
+      return NumericTraits<unsigned short>::max();
+      }
+
+    ImageConstPointer                        m_Input;
+    LabelImageConstPointer                   m_LabelImage;
+    LabelContainerType                       m_Labels;
+    OffsetContainerType                      m_Offsets;
+
+    PixelType                                m_Min;
+    PixelType                                m_Max;
+    unsigned int                             m_NumberOfGreyLevelBins;
+    unsigned int                             m_NumberOfThreads;
+
+    PixelContainerType                       m_LabelMins;
+    PixelContainerType                       m_LabelMaxs;
+    bool                                     m_UseLabelPixelValueRanges;
+
+    /** Intensity range of every region of interest. */
+    PixelContainerType                       m_RegionMins;
+    PixelContainerType                       m_RegionMaxs;
+
+    /** Grey level bin and region of interest index of every voxel of the
+     * requested region, the strides of the region and the buffer step of
+     * every offset. */
+    std::vector<unsigned short>              m_GreyLevels;
+    std::vector<unsigned short>              m_RegionsOfInterest;
+    unsigned long                            m_Strides[ImageDimension];
+    std::vector<long>                        m_OffsetSteps;
+
+  private:
+    LabelScalarImageToMatricesGeneratorBase( const Self& ); //purposely not implemented
+    void operator=( const Self& );                          //purposely not implemented
+
+    struct MatricesThreadStruct
+      {
+      LabelScalarImageToMatricesGeneratorBase *Generator;
+      };
+
+    void QuantizeInput();
+
+    static ITK_THREAD_RETURN_TYPE ComputeMatricesThreaderCallback( void *arg );
+
+    std::vector<std::vector<unsigned int> >  m_ThreadMatrices;
+    std::vector<MatrixType>                  m_Matrices;
+  };
+
+  } // end of namespace Statistics
+} // end of namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkLabelScalarImageToMatricesGeneratorBase.hxx"
+#endif
+
+#endif
@@ -0,0 +1,336 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkLabelScalarImageToMatricesGeneratorBase_hxx
+#define __itkLabelScalarImageToMatricesGeneratorBase_hxx
+
+#include "itkLabelScalarImageToMatricesGeneratorBase.h"
+
+#include "itkImageRegionConstIterator.h"
+#include "itkNeighborhood.h"
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+#include <map>
+
+namespace itk {
+  namespace Statistics {
+
+    template< class TImageType, class TLabelImageType >
+    LabelScalarImageToMatricesGeneratorBase< TImageType, TLabelImageType >::
+    LabelScalarImageToMatricesGeneratorBase()
+      {
+      this->m_Input = NULL;
+      this->m_LabelImage = NULL;
+
+      this->m_Min = NumericTraits<PixelType>::NonpositiveMin();
+      this->m_Max = NumericTraits<PixelType>::max();
+      this->m_NumberOfGreyLevelBins = 256;
+      this->m_NumberOfThreads =
+        MultiThreader::GetGlobalDefaultNumberOfThreads();
+      this->m_UseLabelPixelValueRanges = false;
+
+      // Get a set of default offset values:  the "previous" half of the
+      // neighborhood (the other half gives the same matrices).
+      typedef Neighborhood<PixelType, ImageDimension> NeighborhoodType;
+      NeighborhoodType neighborhood;
+      neighborhood.SetRadius( 1 );
+      for( unsigned int n = 0; n < neighborhood.GetCenterNeighborhoodIndex(); n++ )
+        {
+        this->m_Offsets.push_back( neighborhood.GetOffset( n ) );
+        }
+      }
+
+    template< class TImageType, class TLabelImageType >
+    void
+    LabelScalarImageToMatricesGeneratorBase< TImageType, TLabelImageType >::
+    Compute( void )
+      {
+      if( !this->m_Input )
+        {
+        itkExceptionMacro( "Input image is not set." );
+        }
+
+      this->QuantizeInput();
+      this->BeforeThreadedComputeMatrices();
+
+      const unsigned long matrixSize = this->GetMatrixSize();
+      const unsigned long numberOfMatrices = this->m_Labels.size() *
+        this->m_Offsets.size();
+
+      this->m_ThreadMatrices.resize( this->m_NumberOfThreads );
+      for( unsigned int n = 0; n < this->m_NumberOfThreads; n++ )
+        {
+        this->m_ThreadMatrices[n].assign( numberOfMatrices * matrixSize, 0 );
+        }
+
+      MatricesThreadStruct str;
+      str.Generator = this;
+
+      MultiThreader::Pointer threader = MultiThreader::New();
+      threader->SetNumberOfThreads( this->m_NumberOfThreads );
+      threader->SetSingleMethod( this->ComputeMatricesThreaderCallback, &str );
+      threader->SingleMethodExecute();
+
+      // Merge the per-thread matrices.
+      this->m_Matrices.resize( numberOfMatrices );
+      for( unsigned long m = 0; m < numberOfMatrices; m++ )
+        {
+        this->m_Matrices[m].assign( matrixSize, 0 );
+        for( unsigned int n = 0; n < this->m_NumberOfThreads; n++ )
+          {
+          const unsigned int *counts = &this->m_ThreadMatrices[n][m * matrixSize];
+          for( unsigned long k = 0; k < matrixSize; k++ )
+            {
+            this->m_Matrices[m][k] += counts[k];
+            }
+          }
+        }
+
+      this->m_ThreadMatrices.clear();
+      this->m_GreyLevels.clear();
+      this->m_RegionsOfInterest.clear();
+      }
+
+    template< class TImageType, class TLabelImageType >
+    void
+    LabelScalarImageToMatricesGeneratorBase< TImageType, TLabelImageType >::
+    QuantizeInput()
+      {
+      const RegionType region = this->m_Input->GetRequestedRegion();
+      const unsigned long numberOfPixels = region.GetNumberOfPixels();
+      const unsigned short outside = GetOutsideValue();
+
+      unsigned long stride = 1;
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        this->m_Strides[d] = stride;
+        stride *= region.GetSize()[d];
+        }
+
+      this->m_OffsetSteps.resize( this->m_Offsets.size() );
+      for( unsigned int k = 0; k < this->m_Offsets.size(); k++ )
+        {
+        this->m_OffsetSteps[k] = 0;
+        for( unsigned int d = 0; d < ImageDimension; d++ )
+          {
+          this->m_OffsetSteps[k] += this->m_Offsets[k][d] *
+            static_cast<long>( this->m_Strides[d] );
+          }
+        }
+
+      // Labels to regions of interest.
+      if( this->m_LabelImage && this->m_Labels.empty() )
+        {
+        ImageRegionConstIterator<LabelImageType> ItL( this->m_LabelImage, region );
+        std::map<LabelType, bool> present;
+        for( ItL.GoToBegin(); !ItL.IsAtEnd(); ++ItL )
+          {
+          if( ItL.Get() != NumericTraits<LabelType>::Zero )
+            {
+            present[ItL.Get()] = true;
+            }
+          }
+        typename std::map<LabelType, bool>::const_iterator it;
+        for( it = present.begin(); it != present.end(); ++it )
+          {
+          this->m_Labels.push_back( it->first );
+          }
+        }
+      if( !this->m_LabelImage )
+        {
+        this->m_Labels.assign( 1, NumericTraits<LabelType>::One );
+        }
+      if( this->m_Labels.size() >= outside )
+        {
+        itkExceptionMacro( "Too many labels." );
+        }
+
+      const unsigned int numberOfLabels = this->m_Labels.size();
+      if( !this->m_UseLabelPixelValueRanges && !this->m_LabelMins.empty() &&
+        ( this->m_LabelMins.size() != numberOfLabels ||
+        this->m_LabelMaxs.size() != numberOfLabels ) )
+        {
+        itkExceptionMacro( "The label ranges do not match the labels." );
+        }
+
+      this->m_GreyLevels.resize( numberOfPixels );
+      this->m_RegionsOfInterest.resize( numberOfPixels );
+
+      unsigned long n = 0;
+      if( this->m_LabelImage )
+        {
+        std::map<LabelType, unsigned short> roiIndices;
+        for( unsigned int l = 0; l < numberOfLabels; l++ )
+          {
+          roiIndices[this->m_Labels[l]] = l;
+          }
+
+        ImageRegionConstIterator<LabelImageType> ItL( this->m_LabelImage, region );
+        LabelType lastLabel = NumericTraits<LabelType>::Zero;
+        unsigned short lastIndex = outside;
+        for( ItL.GoToBegin(); !ItL.IsAtEnd(); ++ItL, ++n )
+          {
+          if( ItL.Get() != lastLabel || n == 0 )
+            {
+            lastLabel = ItL.Get();
+            typename std::map<LabelType, unsigned short>::const_iterator it
+              = roiIndices.find( lastLabel );
+            lastIndex = ( it != roiIndices.end() ) ? it->second : outside;
+            }
+          this->m_RegionsOfInterest[n] = lastIndex;
+          }
+        }
+      else
+        {
+        std::fill( this->m_RegionsOfInterest.begin(),
+          this->m_RegionsOfInterest.end(), 0 );
+        }
+
+      // Intensity range of every region of interest.  A label without
+      // voxels keeps an empty range.
+      ImageRegionConstIterator<ImageType> ItI( this->m_Input, region );
+      if( this->m_UseLabelPixelValueRanges )
+        {
+        this->m_RegionMins.assign( numberOfLabels,
+          NumericTraits<PixelType>::max() );
+        this->m_RegionMaxs.assign( numberOfLabels,
+          NumericTraits<PixelType>::NonpositiveMin() );
+        n = 0;
+        for( ItI.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++n )
+          {
+          const unsigned short roi = this->m_RegionsOfInterest[n];
+          if( roi != outside )
+            {
+            this->m_RegionMins[roi] = vnl_math_min( this->m_RegionMins[roi], ItI.Get() );
+            this->m_RegionMaxs[roi] = vnl_math_max( this->m_RegionMaxs[roi], ItI.Get() );
+            }
+          }
+        }
+      else if( !this->m_LabelMins.empty() )
+        {
+        this->m_RegionMins = this->m_LabelMins;
+        this->m_RegionMaxs = this->m_LabelMaxs;
+        }
+      else
+        {
+        this->m_RegionMins.assign( numberOfLabels, this->m_Min );
+        this->m_RegionMaxs.assign( numberOfLabels, this->m_Max );
+        }
+
+      RealContainerType binWidths( numberOfLabels );
+      for( unsigned int l = 0; l < numberOfLabels; l++ )
+        {
+        binWidths[l] = ( static_cast<RealType>( this->m_RegionMaxs[l] ) -
+          static_cast<RealType>( this->m_RegionMins[l] ) ) /
+          static_cast<RealType>( this->m_NumberOfGreyLevelBins );
+        }
+
+      n = 0;
+      for( ItI.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++n )
+        {
+        const PixelType value = ItI.Get();
+        const unsigned short roi = this->m_RegionsOfInterest[n];
+        if( roi == outside || value < this->m_RegionMins[roi] ||
+          value > this->m_RegionMaxs[roi] )
+          {
+          this->m_GreyLevels[n] = outside;
+          this->m_RegionsOfInterest[n] = outside;
+          continue;
+          }
+        unsigned int bin = 0;
+        if( binWidths[roi] > 0.0 )
+          {
+          bin = static_cast<unsigned int>( ( static_cast<RealType>( value ) -
+            static_cast<RealType>( this->m_RegionMins[roi] ) ) / binWidths[roi] );
+          }
+        this->m_GreyLevels[n] = static_cast<unsigned short>(
+          vnl_math_min( bin, this->m_NumberOfGreyLevelBins - 1 ) );
+        }
+      }
+
+    template< class TImageType, class TLabelImageType >
+    ITK_THREAD_RETURN_TYPE
+    LabelScalarImageToMatricesGeneratorBase< TImageType, TLabelImageType >::
+    ComputeMatricesThreaderCallback( void *arg )
+      {
+      unsigned int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+      unsigned int threadCount =
+        ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+      MatricesThreadStruct *str = (MatricesThreadStruct *)
+        (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+      Self *generator = str->Generator;
+
+      // Slabs of consecutive scanlines along the last dimension.
+      const unsigned long numberOfSlices = generator->m_Input->
+        GetRequestedRegion().GetSize()[ImageDimension - 1];
+      const unsigned long firstSlice = threadId * numberOfSlices / threadCount;
+      const unsigned long lastSlice = ( threadId + 1 ) * numberOfSlices / threadCount;
+      if( firstSlice < lastSlice )
+        {
+        generator->ThreadedComputeMatrices(
+          &generator->m_ThreadMatrices[threadId][0], firstSlice, lastSlice );
+        }
+
+      return ITK_THREAD_RETURN_VALUE;
+      }
+
+    template< class TImageType, class TLabelImageType >
+    void
+    LabelScalarImageToMatricesGeneratorBase< TImageType, TLabelImageType >::
+    SetPixelValueMinMax( PixelType min, PixelType max )
+      {
+      itkDebugMacro( "setting Min to " << min << "and Max to " << max );
+      this->m_Min = min;
+      this->m_Max = max;
+      this->Modified();
+      }
+
+    template< class TImageType, class TLabelImageType >
+    void
+    LabelScalarImageToMatricesGeneratorBase< TImageType, TLabelImageType >::
+    SetLabelPixelValueMinMax( const PixelContainerType & mins,
+      const PixelContainerType & maxs )
+      {
+      this->m_LabelMins = mins;
+      this->m_LabelMaxs = maxs;
+      this->Modified();
+      }
+
+    template< class TImageType, class TLabelImageType >
+    void
+    LabelScalarImageToMatricesGeneratorBase< TImageType, TLabelImageType >::
+    PrintSelf( std::ostream& os, Indent indent ) const
+      {
+      Superclass::PrintSelf( os, indent );
+
+      os << indent << "Number of labels: " << this->m_Labels.size() << std::endl;
+      os << indent << "Number of offsets: " << this->m_Offsets.size() << std::endl;
+      os << indent << "Number of grey level bins: "
+         << this->m_NumberOfGreyLevelBins << std::endl;
+      os << indent << "Min/Max: " << this->m_Min << ", " << this->m_Max << std::endl;
+      os << indent << "Use label pixel value ranges: "
+         << this->m_UseLabelPixelValueRanges << std::endl;
+      os << indent << "Number of threads: " << this->m_NumberOfThreads << std::endl;
+      }
+
+  } // end of namespace Statistics
+} // end of namespace itk
+
+
+#endif
@@ -0,0 +1,287 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkLabelScalarImageToRunLengthMatricesGenerator_h
+#define __itkLabelScalarImageToRunLengthMatricesGenerator_h
+
+#include "itkLabelScalarImageToMatricesGeneratorBase.h"
+
+#include "itkFixedArray.h"
+
+#include <vector>
+
+namespace itk {
+  namespace Statistics {
+
+/** \class GreyLevelRunLengthFeatureAccumulator
+ * \brief Accumulates the run-length texture features of
+ * GreyLevelRunLengthMatrixTextureCoefficientsCalculator run by run.
+ *
+ * All the features are linear in the run counts except for the grey level
+ * and run length nonuniformities which only need the marginals of the
+ * matrix.  Runs can therefore be added one at a time, without a matrix,
+ * and the accumulator reset in time proportional to the number of distinct
+ * bins touched.
+ */
+class GreyLevelRunLengthFeatureAccumulator
+  {
+  public:
+    typedef FixedArray<double, 10>  FeatureArrayType;
+
+    GreyLevelRunLengthFeatureAccumulator() {};
+
+    void Initialize( unsigned int numberOfGreyLevelBins,
+      unsigned int numberOfRunLengthBins )
+      {
+      this->m_GreyLevelMarginal.assign( numberOfGreyLevelBins, 0.0 );
+      this->m_RunLengthMarginal.assign( numberOfRunLengthBins, 0.0 );
+      this->m_TouchedGreyLevels.clear();
+      this->m_TouchedRunLengths.clear();
+      this->Reset();
+      }
+
+    void Reset()
+      {
+      for ( unsigned int n = 0; n < this->m_TouchedGreyLevels.size(); n++ )
+        {
+        this->m_GreyLevelMarginal[this->m_TouchedGreyLevels[n]] = 0.0;
+        }
+      for ( unsigned int n = 0; n < this->m_TouchedRunLengths.size(); n++ )
+        {
+        this->m_RunLengthMarginal[this->m_TouchedRunLengths[n]] = 0.0;
+        }
+      this->m_TouchedGreyLevels.clear();
+      this->m_TouchedRunLengths.clear();
+      this->m_Sums.Fill( 0.0 );
+      this->m_TotalNumberOfRuns = 0.0;
+      }
+
+    /** Add frequency runs in grey level bin i and run length bin j. */
+    void AddRuns( unsigned int i, unsigned int j, double frequency = 1.0 )
+      {
+      if ( this->m_GreyLevelMarginal[i] == 0.0 )
+        {
+        this->m_TouchedGreyLevels.push_back( i );
+        }
+      if ( this->m_RunLengthMarginal[j] == 0.0 )
+        {
+        this->m_TouchedRunLengths.push_back( j );
+        }
+      this->m_GreyLevelMarginal[i] += frequency;
+      this->m_RunLengthMarginal[j] += frequency;
+      this->m_TotalNumberOfRuns += frequency;
+
+      double i2 = static_cast<double>( ( i + 1 ) * ( i + 1 ) );
+      double j2 = static_cast<double>( ( j + 1 ) * ( j + 1 ) );
+
+      this->m_Sums[0] += ( frequency / j2 );
+      this->m_Sums[1] += ( frequency * j2 );
+      this->m_Sums[4] += ( frequency / i2 );
+      this->m_Sums[5] += ( frequency * i2 );
+      this->m_Sums[6] += ( frequency / ( i2 * j2 ) );
+      this->m_Sums[7] += ( frequency * i2 / j2 );
+      this->m_Sums[8] += ( frequency * j2 / i2 );
+      this->m_Sums[9] += ( frequency * i2 * j2 );
+      }
+
+    double GetTotalNumberOfRuns() const
+      {
+      return this->m_TotalNumberOfRuns;
+      }
+
+    /** The features, normalized by the total number of runs, in the order
+     * ShortRunEmphasis, LongRunEmphasis, GreyLevelNonuniformity,
+     * RunLengthNonuniformity, LowGreyLevelRunEmphasis,
+     * HighGreyLevelRunEmphasis, ShortRunLowGreyLevelEmphasis,
+     * ShortRunHighGreyLevelEmphasis, LongRunLowGreyLevelEmphasis,
+     * LongRunHighGreyLevelEmphasis. */
+    FeatureArrayType GetFeatures() const
+      {
+      FeatureArrayType features = this->m_Sums;
+      features[2] = features[3] = 0.0;
+      for ( unsigned int n = 0; n < this->m_TouchedGreyLevels.size(); n++ )
+        {
+        double f = this->m_GreyLevelMarginal[this->m_TouchedGreyLevels[n]];
+        features[2] += f * f;
+        }
+      for ( unsigned int n = 0; n < this->m_TouchedRunLengths.size(); n++ )
+        {
+        double f = this->m_RunLengthMarginal[this->m_TouchedRunLengths[n]];
+        features[3] += f * f;
+        }
+      for ( unsigned int n = 0; n < features.Size(); n++ )
+        {
+        features[n] = ( this->m_TotalNumberOfRuns > 0.0 )
+          ? features[n] / this->m_TotalNumberOfRuns : 0.0;
+        }
+      return features;
+      }
+
+    static const char * GetFeatureName( unsigned int n )
+      {
+      static const char * names[] = { "ShortRunEmphasis", "LongRunEmphasis",
+        "GreyLevelNonuniformity", "RunLengthNonuniformity",
+        "LowGreyLevelRunEmphasis", "HighGreyLevelRunEmphasis",
+        "ShortRunLowGreyLevelEmphasis", "ShortRunHighGreyLevelEmphasis",
+        "LongRunLowGreyLevelEmphasis", "LongRunHighGreyLevelEmphasis" };
+      return names[n];
+      }
+
+  private:
+    std::vector<double>        m_GreyLevelMarginal;
+    std::vector<double>        m_RunLengthMarginal;
+    std::vector<unsigned int>  m_TouchedGreyLevels;
+    std::vector<unsigned int>  m_TouchedRunLengths;
+    FeatureArrayType           m_Sums;
+    double                     m_TotalNumberOfRuns;
+  };
+
+/** \class LabelScalarImageToRunLengthMatricesGenerator
+ * \brief Computes the grey level run-length matrices of every label of a
+ * label image and every offset direction in a single pass.
+ *
+ * The input is quantized and split over the threads as described in
+ * LabelScalarImageToMatricesGeneratorBase.  A voxel starts a run in a
+ * direction if the voxel preceding it in that direction has a different
+ * grey level bin or label.  The run is followed to its end and counted
+ * once in the matrix of the thread for the label of the run and the
+ * direction.  As in ScalarImageToGreyLevelRunLengthMatrixGenerator, the
+ * run length is the physical distance spanned by the run and is binned
+ * over [MinDistance, MaxDistance].
+ *
+ * Each label can be given its own distance range, or, with
+ * UseLabelDistanceRanges on, binned over [0, extent] where the extent is
+ * the diagonal of the physical bounding box of its binned voxels.
+ * Each thread holds NumberOfLabels x NumberOfOffsets x NumberOfGreyLevelBins
+ * x NumberOfRunLengthBins counters (4 bytes each).
+ */
+
+template< class TImageType, class TLabelImageType =
+  Image<unsigned int, TImageType::ImageDimension> >
+class LabelScalarImageToRunLengthMatricesGenerator
+  : public LabelScalarImageToMatricesGeneratorBase<TImageType, TLabelImageType>
+  {
+  public:
+    /** Standard typedefs */
+    typedef LabelScalarImageToRunLengthMatricesGenerator Self;
+    typedef LabelScalarImageToMatricesGeneratorBase<TImageType,
+      TLabelImageType> Superclass;
+    typedef SmartPointer<Self> Pointer;
+    typedef SmartPointer<const Self> ConstPointer;
+
+    /** Run-time type information (and related methods). */
+    itkTypeMacro( LabelScalarImageToRunLengthMatricesGenerator,
+      LabelScalarImageToMatricesGeneratorBase );
+
+    /** standard New() method support */
+    itkNewMacro( Self );
+
+    /** ImageDimension constants */
+    itkStaticConstMacro( ImageDimension, unsigned int,
+                         TImageType::ImageDimension );
+
+    typedef typename Superclass::ImageType                  ImageType;
+    typedef typename Superclass::PixelType                  PixelType;
+    typedef typename Superclass::RegionType                 RegionType;
+    typedef typename Superclass::OffsetType                 OffsetType;
+    typedef typename Superclass::RealType                   RealType;
+    typedef typename Superclass::RealContainerType          RealContainerType;
+
+    /** Dense run-length matrix stored grey level major, i.e. the frequency
+     * of grey level bin i and run length bin j is at i * R + j. */
+    typedef typename Superclass::FrequencyType              FrequencyType;
+    typedef typename Superclass::MatrixType                 RunLengthMatrixType;
+
+    typedef GreyLevelRunLengthFeatureAccumulator            FeatureAccumulatorType;
+    typedef FeatureAccumulatorType::FeatureArrayType        FeatureArrayType;
+
+    itkSetClampMacro( NumberOfRunLengthBins, unsigned int, 1,
+      NumericTraits<unsigned int>::max() );
+    itkGetConstMacro( NumberOfRunLengthBins, unsigned int );
+
+    /** Set the min and max (inclusive) run distance that will be binned. */
+    void SetDistanceValueMinMax( RealType min, RealType max );
+    itkGetConstMacro( MinDistance, RealType );
+    itkGetConstMacro( MaxDistance, RealType );
+
+    /** Set the min and max (inclusive) run distances of each label, in the
+     * order of GetLabels().  They replace the range set with
+     * SetDistanceValueMinMax; empty containers restore it. */
+    void SetLabelDistanceValueMinMax( const RealContainerType & mins,
+      const RealContainerType & maxs );
+
+    /** Bin the runs of every label over [0, extent of the label].  This
+     * replaces the ranges set with SetDistanceValueMinMax and
+     * SetLabelDistanceValueMinMax.  Default is off. */
+    itkSetMacro( UseLabelDistanceRanges, bool );
+    itkGetConstMacro( UseLabelDistanceRanges, bool );
+    itkBooleanMacro( UseLabelDistanceRanges );
+
+    /** The run-length matrix of the specified label (index into GetLabels())
+     * and offset.  Valid after Compute(). */
+    const RunLengthMatrixType & GetRunLengthMatrix( unsigned int whichLabel,
+      unsigned int whichOffset ) const
+      {
+      return this->GetMatrix( whichLabel, whichOffset );
+      }
+
+    /** The features of the specified label and offset. */
+    FeatureArrayType GetFeatures( unsigned int whichLabel,
+      unsigned int whichOffset ) const;
+
+    /** The features of the specified label averaged over the offsets. */
+    FeatureArrayType GetFeatureMeans( unsigned int whichLabel ) const;
+
+  protected:
+    LabelScalarImageToRunLengthMatricesGenerator();
+    virtual ~LabelScalarImageToRunLengthMatricesGenerator() {};
+    void PrintSelf( std::ostream& os, Indent indent ) const;
+
+    unsigned long GetMatrixSize() const;
+
+    void BeforeThreadedComputeMatrices();
+
+    void ThreadedComputeMatrices( unsigned int *, unsigned long,
+      unsigned long );
+
+  private:
+    LabelScalarImageToRunLengthMatricesGenerator( const Self& ); //purposely not implemented
+    void operator=( const Self& );                               //purposely not implemented
+
+    RealType                                 m_MinDistance;
+    RealType                                 m_MaxDistance;
+    unsigned int                             m_NumberOfRunLengthBins;
+
+    RealContainerType                        m_LabelMinDistances;
+    RealContainerType                        m_LabelMaxDistances;
+    bool                                     m_UseLabelDistanceRanges;
+
+    /** Physical length of one step along each offset and distance range of
+     * every region of interest. */
+    std::vector<RealType>                    m_StepLengths;
+    RealContainerType                        m_RegionMinDistances;
+    RealContainerType                        m_RegionMaxDistances;
+  };
+
+  } // end of namespace Statistics
+} // end of namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkLabelScalarImageToRunLengthMatricesGenerator.hxx"
+#endif
+
+#endif
@@ -0,0 +1,345 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkLabelScalarImageToRunLengthMatricesGenerator_hxx
+#define __itkLabelScalarImageToRunLengthMatricesGenerator_hxx
+
+#include "itkLabelScalarImageToRunLengthMatricesGenerator.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "vnl/vnl_math.h"
+
+namespace itk {
+  namespace Statistics {
+
+    template< class TImageType, class TLabelImageType >
+    LabelScalarImageToRunLengthMatricesGenerator< TImageType, TLabelImageType >::
+    LabelScalarImageToRunLengthMatricesGenerator()
+      {
+      this->m_MinDistance = NumericTraits<RealType>::Zero;
+      this->m_MaxDistance = NumericTraits<RealType>::max();
+      this->m_NumberOfRunLengthBins = 256;
+      this->m_UseLabelDistanceRanges = false;
+      }
+
+    template< class TImageType, class TLabelImageType >
+    unsigned long
+    LabelScalarImageToRunLengthMatricesGenerator< TImageType, TLabelImageType >::
+    GetMatrixSize() const
+      {
+      return static_cast<unsigned long>( this->m_NumberOfGreyLevelBins ) *
+        this->m_NumberOfRunLengthBins;
+      }
+
+    template< class TImageType, class TLabelImageType >
+    void
+    LabelScalarImageToRunLengthMatricesGenerator< TImageType, TLabelImageType >::
+    BeforeThreadedComputeMatrices()
+      {
+      const RegionType region = this->m_Input->GetRequestedRegion();
+      const unsigned short outside = this->GetOutsideValue();
+      const unsigned int numberOfLabels = this->m_Labels.size();
+
+      // Physical length of one step along each offset direction.
+      this->m_StepLengths.resize( this->m_Offsets.size() );
+      for( unsigned int k = 0; k < this->m_Offsets.size(); k++ )
+        {
+        RealType length = 0.0;
+        for( unsigned int d = 0; d < ImageDimension; d++ )
+          {
+          RealType step = this->m_Offsets[k][d] * this->m_Input->GetSpacing()[d];
+          length += step * step;
+          }
+        this->m_StepLengths[k] = vcl_sqrt( length );
+        }
+
+      if( !this->m_UseLabelDistanceRanges &&
+        !this->m_LabelMinDistances.empty() &&
+        ( this->m_LabelMinDistances.size() != numberOfLabels ||
+        this->m_LabelMaxDistances.size() != numberOfLabels ) )
+        {
+        itkExceptionMacro( "The label distance ranges do not match the labels." );
+        }
+
+      // Distance range of every region of interest.
+      if( this->m_UseLabelDistanceRanges )
+        {
+        typedef typename ImageType::PointType PointType;
+        std::vector<PointType> pointMins( numberOfLabels );
+        std::vector<PointType> pointMaxs( numberOfLabels );
+        for( unsigned int l = 0; l < numberOfLabels; l++ )
+          {
+          pointMins[l].Fill( NumericTraits<typename PointType::ValueType>::max() );
+          pointMaxs[l].Fill(
+            NumericTraits<typename PointType::ValueType>::NonpositiveMin() );
+          }
+        std::vector<bool> isEmpty( numberOfLabels, true );
+
+        PointType point;
+        ImageRegionConstIteratorWithIndex<ImageType> ItI( this->m_Input, region );
+        unsigned long n = 0;
+        for( ItI.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++n )
+          {
+          const unsigned short roi = this->m_RegionsOfInterest[n];
+          if( roi == outside )
+            {
+            continue;
+            }
+          this->m_Input->TransformIndexToPhysicalPoint( ItI.GetIndex(), point );
+          for( unsigned int d = 0; d < ImageDimension; d++ )
+            {
+            pointMins[roi][d] = vnl_math_min( pointMins[roi][d], point[d] );
+            pointMaxs[roi][d] = vnl_math_max( pointMaxs[roi][d], point[d] );
+            }
+          isEmpty[roi] = false;
+          }
+
+        this->m_RegionMinDistances.assign( numberOfLabels,
+          NumericTraits<RealType>::Zero );
+        this->m_RegionMaxDistances.assign( numberOfLabels,
+          NumericTraits<RealType>::Zero );
+        for( unsigned int l = 0; l < numberOfLabels; l++ )
+          {
+          if( !isEmpty[l] )
+            {
+            this->m_RegionMaxDistances[l] =
+              pointMins[l].EuclideanDistanceTo( pointMaxs[l] );
+            }
+          }
+        }
+      else if( !this->m_LabelMinDistances.empty() )
+        {
+        this->m_RegionMinDistances = this->m_LabelMinDistances;
+        this->m_RegionMaxDistances = this->m_LabelMaxDistances;
+        }
+      else
+        {
+        this->m_RegionMinDistances.assign( numberOfLabels, this->m_MinDistance );
+        this->m_RegionMaxDistances.assign( numberOfLabels, this->m_MaxDistance );
+        }
+      }
+
+    template< class TImageType, class TLabelImageType >
+    void
+    LabelScalarImageToRunLengthMatricesGenerator< TImageType, TLabelImageType >::
+    ThreadedComputeMatrices( unsigned int *matrices, unsigned long firstSlice,
+      unsigned long lastSlice )
+      {
+      const RegionType region = this->m_Input->GetRequestedRegion();
+      const typename RegionType::SizeType size = region.GetSize();
+      const unsigned short outside = this->GetOutsideValue();
+
+      const unsigned long sliceSize = this->m_Strides[ImageDimension - 1];
+      const unsigned int numberOfOffsets = this->m_Offsets.size();
+      const unsigned long matrixSize = this->GetMatrixSize();
+      const std::vector<long> & steps = this->m_OffsetSteps;
+
+      long index[ImageDimension];
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        index[d] = 0;
+        }
+      index[ImageDimension - 1] = firstSlice;
+
+      const unsigned long begin = firstSlice * sliceSize;
+      const unsigned long end = lastSlice * sliceSize;
+      for( unsigned long n = begin; n < end; n++ )
+        {
+        const unsigned short grey = this->m_GreyLevels[n];
+        const unsigned short roi = this->m_RegionsOfInterest[n];
+
+        if( grey != outside )
+          {
+          for( unsigned int k = 0; k < numberOfOffsets; k++ )
+            {
+            const OffsetType & offset = this->m_Offsets[k];
+
+            // Is the voxel the start of a run in this direction?
+            bool isInside = true;
+            for( unsigned int d = 0; d < ImageDimension; d++ )
+              {
+              long c = index[d] - offset[d];
+              if( c < 0 || c >= static_cast<long>( size[d] ) )
+                {
+                isInside = false;
+                break;
+                }
+              }
+            if( isInside )
+              {
+              const unsigned long previous = n - steps[k];
+              if( this->m_GreyLevels[previous] == grey &&
+                this->m_RegionsOfInterest[previous] == roi )
+                {
+                continue;
+                }
+              }
+
+            // Follow the run to its end.
+            unsigned long runLength = 1;
+            long c[ImageDimension];
+            for( unsigned int d = 0; d < ImageDimension; d++ )
+              {
+              c[d] = index[d];
+              }
+            unsigned long m = n;
+            while( true )
+              {
+              bool nextIsInside = true;
+              for( unsigned int d = 0; d < ImageDimension; d++ )
+                {
+                c[d] += offset[d];
+                if( c[d] < 0 || c[d] >= static_cast<long>( size[d] ) )
+                  {
+                  nextIsInside = false;
+                  }
+                }
+              if( !nextIsInside )
+                {
+                break;
+                }
+              m += steps[k];
+              if( this->m_GreyLevels[m] != grey ||
+                this->m_RegionsOfInterest[m] != roi )
+                {
+                break;
+                }
+              runLength++;
+              }
+
+            const RealType distance = runLength * this->m_StepLengths[k];
+            const RealType minDistance = this->m_RegionMinDistances[roi];
+            const RealType distanceRange =
+              this->m_RegionMaxDistances[roi] - minDistance;
+            if( distance < minDistance || distance > this->m_RegionMaxDistances[roi] )
+              {
+              continue;
+              }
+            unsigned int bin = 0;
+            if( distanceRange > 0.0 )
+              {
+              bin = static_cast<unsigned int>( ( distance - minDistance ) /
+                distanceRange * this->m_NumberOfRunLengthBins );
+              }
+            bin = vnl_math_min( bin, this->m_NumberOfRunLengthBins - 1 );
+
+            matrices[( roi * numberOfOffsets + k ) * matrixSize +
+              grey * this->m_NumberOfRunLengthBins + bin]++;
+            }
+          }
+
+        // Advance the index along the scanline.
+        for( unsigned int d = 0; d < ImageDimension; d++ )
+          {
+          if( ++index[d] < static_cast<long>( size[d] ) )
+            {
+            break;
+            }
+          index[d] = 0;
+          }
+        }
+      }
+
+    template< class TImageType, class TLabelImageType >
+    typename LabelScalarImageToRunLengthMatricesGenerator< TImageType,
+      TLabelImageType >::FeatureArrayType
+    LabelScalarImageToRunLengthMatricesGenerator< TImageType, TLabelImageType >::
+    GetFeatures( unsigned int whichLabel, unsigned int whichOffset ) const
+      {
+      const RunLengthMatrixType & matrix =
+        this->GetRunLengthMatrix( whichLabel, whichOffset );
+
+      FeatureAccumulatorType accumulator;
+      accumulator.Initialize( this->m_NumberOfGreyLevelBins,
+        this->m_NumberOfRunLengthBins );
+      for( unsigned int i = 0; i < this->m_NumberOfGreyLevelBins; i++ )
+        {
+        for( unsigned int j = 0; j < this->m_NumberOfRunLengthBins; j++ )
+          {
+          const FrequencyType frequency =
+            matrix[i * this->m_NumberOfRunLengthBins + j];
+          if( frequency > 0 )
+            {
+            accumulator.AddRuns( i, j, static_cast<double>( frequency ) );
+            }
+          }
+        }
+      return accumulator.GetFeatures();
+      }
+
+    template< class TImageType, class TLabelImageType >
+    typename LabelScalarImageToRunLengthMatricesGenerator< TImageType,
+      TLabelImageType >::FeatureArrayType
+    LabelScalarImageToRunLengthMatricesGenerator< TImageType, TLabelImageType >::
+    GetFeatureMeans( unsigned int whichLabel ) const
+      {
+      FeatureArrayType means;
+      means.Fill( 0.0 );
+      for( unsigned int k = 0; k < this->m_Offsets.size(); k++ )
+        {
+        FeatureArrayType features = this->GetFeatures( whichLabel, k );
+        for( unsigned int n = 0; n < means.Size(); n++ )
+          {
+          means[n] += features[n] / static_cast<double>( this->m_Offsets.size() );
+          }
+        }
+      return means;
+      }
+
+    template< class TImageType, class TLabelImageType >
+    void
+    LabelScalarImageToRunLengthMatricesGenerator< TImageType, TLabelImageType >::
+    SetDistanceValueMinMax( RealType min, RealType max )
+      {
+      itkDebugMacro( "setting MinDistance to " << min <<
+                     "and MaxDistance to " << max );
+      this->m_MinDistance = min;
+      this->m_MaxDistance = max;
+      this->Modified();
+      }
+
+    template< class TImageType, class TLabelImageType >
+    void
+    LabelScalarImageToRunLengthMatricesGenerator< TImageType, TLabelImageType >::
+    SetLabelDistanceValueMinMax( const RealContainerType & mins,
+      const RealContainerType & maxs )
+      {
+      this->m_LabelMinDistances = mins;
+      this->m_LabelMaxDistances = maxs;
+      this->Modified();
+      }
+
+    template< class TImageType, class TLabelImageType >
+    void
+    LabelScalarImageToRunLengthMatricesGenerator< TImageType, TLabelImageType >::
+    PrintSelf( std::ostream& os, Indent indent ) const
+      {
+      Superclass::PrintSelf( os, indent );
+
+      os << indent << "Number of run length bins: "
+         << this->m_NumberOfRunLengthBins << std::endl;
+      os << indent << "Min/Max distance: " << this->m_MinDistance << ", "
+         << this->m_MaxDistance << std::endl;
+      os << indent << "Use label distance ranges: "
+         << this->m_UseLabelDistanceRanges << std::endl;
+      }
+
+  } // end of namespace Statistics
+} // end of namespace itk
+
+
+#endif
@@ -0,0 +1,163 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkRunLengthTextureFeaturesImageFilter_h
+#define __itkRunLengthTextureFeaturesImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkLabelScalarImageToRunLengthMatricesGenerator.h"
+#include "itkVectorImage.h"
+
+#include <vector>
+
+namespace itk
+{
+namespace Statistics
+{
+/** \class RunLengthTextureFeaturesImageFilter
+ *  \brief This filter computes, at every voxel, the run-length texture
+ * features of the runs contained in a sliding window around the voxel.
+ *
+ * The input is quantized once.  Within each window the runs along every
+ * offset direction are enumerated directly (a voxel starts a run if its
+ * predecessor lies outside the window, outside the mask or in another grey
+ * level bin) and accumulated in a per-thread
+ * GreyLevelRunLengthFeatureAccumulator so that no histogram is allocated
+ * or cleared per voxel.  The output has the 10 features, averaged over the
+ * offsets, as components.
+ */
+template<class TInputImage, class TOutputImage
+  = VectorImage<float, TInputImage::ImageDimension> >
+class ITK_EXPORT RunLengthTextureFeaturesImageFilter:
+  public ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef RunLengthTextureFeaturesImageFilter             Self;
+  typedef ImageToImageFilter<TInputImage, TOutputImage>   Superclass;
+  typedef SmartPointer<Self>                              Pointer;
+  typedef SmartPointer<const Self>                        ConstPointer;
+
+  /** Standard New method. */
+  itkNewMacro( Self );
+
+  /** Runtime information support. */
+  itkTypeMacro( RunLengthTextureFeaturesImageFilter, ImageToImageFilter );
+
+  /** ImageDimension constants */
+  itkStaticConstMacro( ImageDimension, unsigned int, TInputImage::ImageDimension );
+
+  /** Some convenient typedefs. */
+  typedef float                                      RealType;
+  typedef TInputImage                                InputImageType;
+  typedef typename InputImageType::RegionType        RegionType;
+  typedef typename InputImageType::SizeType          RadiusType;
+  typedef typename InputImageType::OffsetType        OffsetType;
+  typedef std::vector<OffsetType>                    OffsetVectorType;
+  typedef Image<unsigned int, ImageDimension>        MaskImageType;
+  typedef TOutputImage                               OutputImageType;
+  typedef typename InputImageType::PixelType         InputPixelType;
+  typedef typename OutputImageType::PixelType        OutputPixelType;
+
+  typedef GreyLevelRunLengthFeatureAccumulator       FeatureAccumulatorType;
+
+  /** Set/Get the mask image.  Features are only computed at, and runs only
+   * pass through, voxels with the inside value. */
+  void SetMaskImage( const MaskImageType *mask );
+  const MaskImageType * GetMaskImage() const;
+
+  itkSetMacro( InsidePixelValue, typename MaskImageType::PixelType );
+  itkGetConstMacro( InsidePixelValue, typename MaskImageType::PixelType );
+
+  /** Radius defining the local window for evaluating the texture features. */
+  itkSetMacro( NeighborhoodRadius, RadiusType );
+  itkGetConstMacro( NeighborhoodRadius, RadiusType );
+
+  /** Set the offset directions along which runs are measured. */
+  itkGetConstReferenceMacro( Offsets, OffsetVectorType );
+  void SetOffsets( const OffsetVectorType &offsets )
+  {
+    if ( this->m_Offsets != offsets )
+      {
+      this->m_Offsets.assign( offsets.begin(), offsets.end() );
+      this->Modified();
+      }
+  }
+
+  /** Set number of histogram bins along each axis */
+  itkSetMacro( NumberOfBinsPerAxis, unsigned int );
+  itkGetConstMacro( NumberOfBinsPerAxis, unsigned int );
+
+  /** Set the min and max (inclusive) pixel value that will be binned. */
+  void SetPixelValueMinMax( InputPixelType, InputPixelType );
+  itkGetConstMacro( Min, InputPixelType );
+  itkGetConstMacro( Max, InputPixelType );
+
+  /** Set the min and max (inclusive) run distance that will be binned. */
+  void SetDistanceValueMinMax( RealType, RealType );
+  itkGetConstMacro( MinDistance, RealType );
+  itkGetConstMacro( MaxDistance, RealType );
+
+  unsigned int GetNumberOfOutputComponents() { return 10; }
+
+protected:
+  RunLengthTextureFeaturesImageFilter();
+  ~RunLengthTextureFeaturesImageFilter() {};
+
+  virtual void GenerateInputRequestedRegion()
+  {
+    // currently we require the entire input image to process
+    TInputImage *input = const_cast<TInputImage *>( this->GetInput() );
+    input->SetRequestedRegionToLargestPossibleRegion();
+  }
+
+  virtual void ThreadedGenerateData( const RegionType &, ThreadIdType );
+
+  virtual void BeforeThreadedGenerateData();
+
+  virtual void AfterThreadedGenerateData();
+
+  void PrintSelf( std::ostream & os, Indent indent ) const;
+
+  void GenerateOutputInformation();
+
+private:
+  RunLengthTextureFeaturesImageFilter( const Self & );  //purposely not implemented
+  void operator=( const Self & );                       //purposely not implemented
+
+  OffsetVectorType                                  m_Offsets;
+  RadiusType                                        m_NeighborhoodRadius;
+  InputPixelType                                    m_Min;
+  InputPixelType                                    m_Max;
+  RealType                                          m_MinDistance;
+  RealType                                          m_MaxDistance;
+  unsigned int                                      m_NumberOfBinsPerAxis;
+  typename MaskImageType::PixelType                 m_InsidePixelValue;
+
+  /** Grey level bin of every voxel (65535 if it is to be skipped). */
+  std::vector<unsigned short>                       m_GreyLevels;
+  std::vector<RealType>                             m_StepLengths;
+
+}; // end of class
+} // end namespace statistics
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkRunLengthTextureFeaturesImageFilter.hxx"
+#endif
+
+#endif
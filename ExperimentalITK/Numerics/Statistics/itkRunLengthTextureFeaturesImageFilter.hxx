@@ -0,0 +1,381 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkRunLengthTextureFeaturesImageFilter_hxx
+#define __itkRunLengthTextureFeaturesImageFilter_hxx
+
+#include "itkRunLengthTextureFeaturesImageFilter.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkNeighborhood.h"
+#include "itkProgressReporter.h"
+
+#include "vnl/vnl_math.h"
+
+namespace itk
+{
+namespace Statistics
+{
+template<class TInputImage, class TOutputImage>
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::RunLengthTextureFeaturesImageFilter()
+{
+  // Set the offset directions to their defaults: half of all the possible
+  // directions 1 pixel away. (The other half describes the same lines.)
+  typedef Neighborhood<typename InputImageType::PixelType, ImageDimension> NeighborhoodType;
+  NeighborhoodType neighborhood;
+  neighborhood.SetRadius( 1 );
+
+  unsigned int centerIndex = neighborhood.GetCenterNeighborhoodIndex();
+  this->m_Offsets.clear();
+  for ( unsigned int d = 0; d < centerIndex; d++ )
+    {
+    this->m_Offsets.push_back( neighborhood.GetOffset( d ) );
+    }
+
+  this->m_NumberOfBinsPerAxis = 64;
+  this->m_Min = NumericTraits<InputPixelType>::NonpositiveMin();
+  this->m_Max = NumericTraits<InputPixelType>::max();
+  this->m_MinDistance = NumericTraits<RealType>::Zero;
+  this->m_MaxDistance = NumericTraits<RealType>::max();
+
+  this->m_InsidePixelValue = 1;
+
+  this->m_NeighborhoodRadius.Fill( 2 );
+}
+
+template<class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::SetMaskImage( const MaskImageType *mask )
+{
+  this->SetNthInput( 1, const_cast<MaskImageType *>( mask ) );
+}
+
+template<class TInputImage, class TOutputImage>
+const typename RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>::MaskImageType *
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::GetMaskImage() const
+{
+  const MaskImageType *maskImage = dynamic_cast<const MaskImageType *>( this->ProcessObject::GetInput( 1 ) );
+
+  return maskImage;
+}
+
+template< class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::SetPixelValueMinMax( InputPixelType min, InputPixelType max )
+{
+  if( this->m_Min != min || this->m_Max != max )
+    {
+    itkDebugMacro( "setting Min to " << min << "and Max to " << max );
+    this->m_Min = min;
+    this->m_Max = max;
+    this->Modified();
+    }
+}
+
+template< class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::SetDistanceValueMinMax( RealType min, RealType max )
+{
+  if( this->m_MinDistance != min || this->m_MaxDistance != max )
+    {
+    itkDebugMacro( "setting MinDistance to " << min << "and MaxDistance to " << max );
+    this->m_MinDistance = min;
+    this->m_MaxDistance = max;
+    this->Modified();
+    }
+}
+
+template< class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter< TInputImage, TOutputImage>
+::GenerateOutputInformation()
+{
+  // this methods is overloaded so that if the output image is a
+  // VectorImage then the correct number of components are set.
+  Superclass::GenerateOutputInformation();
+  OutputImageType* output = this->GetOutput();
+
+  if ( !output )
+    {
+    return;
+    }
+  if ( output->GetNumberOfComponentsPerPixel() != this->GetNumberOfOutputComponents() )
+    {
+    output->SetNumberOfComponentsPerPixel( this->GetNumberOfOutputComponents() );
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::BeforeThreadedGenerateData()
+{
+  const InputImageType *inputImage = this->GetInput();
+  const MaskImageType  *maskImage = this->GetMaskImage();
+  const RegionType region = inputImage->GetLargestPossibleRegion();
+  const unsigned short outside = NumericTraits<unsigned short>::max();
+
+  if( this->m_NumberOfBinsPerAxis >= outside )
+    {
+    itkExceptionMacro( "Too many bins." );
+    }
+
+  OutputPixelType zero;
+  NumericTraits<OutputPixelType>::SetLength( zero, this->GetNumberOfOutputComponents() );
+  zero.Fill( 0 );
+  this->GetOutput()->FillBuffer( zero );
+
+  const RealType binWidth = ( static_cast<RealType>( this->m_Max ) -
+    static_cast<RealType>( this->m_Min ) ) /
+    static_cast<RealType>( this->m_NumberOfBinsPerAxis );
+
+  this->m_GreyLevels.resize( region.GetNumberOfPixels() );
+
+  ImageRegionConstIteratorWithIndex<InputImageType> It( inputImage, region );
+  unsigned long n = 0;
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It, ++n )
+    {
+    const InputPixelType value = It.Get();
+    if( value < this->m_Min || value > this->m_Max ||
+      ( maskImage && maskImage->GetPixel( It.GetIndex() ) != this->m_InsidePixelValue ) )
+      {
+      this->m_GreyLevels[n] = outside;
+      continue;
+      }
+    unsigned int bin = 0;
+    if( binWidth > 0.0 )
+      {
+      bin = static_cast<unsigned int>( ( static_cast<RealType>( value ) -
+        static_cast<RealType>( this->m_Min ) ) / binWidth );
+      }
+    this->m_GreyLevels[n] = static_cast<unsigned short>(
+      vnl_math_min( bin, this->m_NumberOfBinsPerAxis - 1 ) );
+    }
+
+  this->m_StepLengths.resize( this->m_Offsets.size() );
+  for( unsigned int k = 0; k < this->m_Offsets.size(); k++ )
+    {
+    RealType length = 0.0;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      RealType step = this->m_Offsets[k][d] * inputImage->GetSpacing()[d];
+      length += step * step;
+      }
+    this->m_StepLengths[k] = vcl_sqrt( length );
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::ThreadedGenerateData( const RegionType & region, ThreadIdType threadId )
+{
+  const InputImageType *inputImage = this->GetInput();
+  OutputImageType      *outputImage = this->GetOutput();
+
+  const RegionType largestRegion = inputImage->GetLargestPossibleRegion();
+  const typename RegionType::SizeType size = largestRegion.GetSize();
+  const typename RegionType::IndexType start = largestRegion.GetIndex();
+  const unsigned short outside = NumericTraits<unsigned short>::max();
+
+  long strides[ImageDimension];
+  long stride = 1;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    strides[d] = stride;
+    stride *= size[d];
+    }
+
+  const unsigned int numberOfOffsets = this->m_Offsets.size();
+  std::vector<long> steps( numberOfOffsets, 0 );
+  for( unsigned int k = 0; k < numberOfOffsets; k++ )
+    {
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      steps[k] += this->m_Offsets[k][d] * strides[d];
+      }
+    }
+
+  const RealType distanceRange = this->m_MaxDistance - this->m_MinDistance;
+
+  FeatureAccumulatorType accumulator;
+  accumulator.Initialize( this->m_NumberOfBinsPerAxis, this->m_NumberOfBinsPerAxis );
+
+  OutputPixelType out;
+  NumericTraits<OutputPixelType>::SetLength( out, this->GetNumberOfOutputComponents() );
+
+  ProgressReporter progress( this, threadId, region.GetNumberOfPixels() );
+
+  ImageRegionIteratorWithIndex<OutputImageType> ItO( outputImage, region );
+  for( ItO.GoToBegin(); !ItO.IsAtEnd(); ++ItO )
+    {
+    typename RegionType::IndexType centerIndex = ItO.GetIndex();
+
+    long center = 0;
+    long lower[ImageDimension];
+    long upper[ImageDimension];
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      long c = centerIndex[d] - start[d];
+      center += c * strides[d];
+      lower[d] = vnl_math_max( 0L, c - static_cast<long>( this->m_NeighborhoodRadius[d] ) );
+      upper[d] = vnl_math_min( static_cast<long>( size[d] ) - 1,
+        c + static_cast<long>( this->m_NeighborhoodRadius[d] ) );
+      }
+
+    if( this->m_GreyLevels[center] == outside )
+      {
+      progress.CompletedPixel();
+      continue;
+      }
+
+    out.Fill( 0 );
+    for( unsigned int k = 0; k < numberOfOffsets; k++ )
+      {
+      const OffsetType & offset = this->m_Offsets[k];
+      accumulator.Reset();
+
+      long index[ImageDimension];
+      long n = 0;
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        index[d] = lower[d];
+        n += index[d] * strides[d];
+        }
+
+      bool done = false;
+      while( !done )
+        {
+        const unsigned short grey = this->m_GreyLevels[n];
+        if( grey != outside )
+          {
+          // A run starts here if the previous voxel is outside the window
+          // or differs.
+          bool previousIsInside = true;
+          for( unsigned int d = 0; d < ImageDimension; d++ )
+            {
+            long c = index[d] - offset[d];
+            if( c < lower[d] || c > upper[d] )
+              {
+              previousIsInside = false;
+              break;
+              }
+            }
+          if( !previousIsInside || this->m_GreyLevels[n - steps[k]] != grey )
+            {
+            unsigned long runLength = 1;
+            long c[ImageDimension];
+            for( unsigned int d = 0; d < ImageDimension; d++ )
+              {
+              c[d] = index[d];
+              }
+            long m = n;
+            while( true )
+              {
+              bool nextIsInside = true;
+              for( unsigned int d = 0; d < ImageDimension; d++ )
+                {
+                c[d] += offset[d];
+                if( c[d] < lower[d] || c[d] > upper[d] )
+                  {
+                  nextIsInside = false;
+                  }
+                }
+              m += steps[k];
+              if( !nextIsInside || this->m_GreyLevels[m] != grey )
+                {
+                break;
+                }
+              runLength++;
+              }
+
+            const RealType distance = runLength * this->m_StepLengths[k];
+            if( distance >= this->m_MinDistance && distance <= this->m_MaxDistance )
+              {
+              unsigned int bin = 0;
+              if( distanceRange > 0.0 )
+                {
+                bin = static_cast<unsigned int>( ( distance - this->m_MinDistance ) /
+                  distanceRange * this->m_NumberOfBinsPerAxis );
+                }
+              accumulator.AddRuns( grey,
+                vnl_math_min( bin, this->m_NumberOfBinsPerAxis - 1 ) );
+              }
+            }
+          }
+
+        // Next voxel of the window.
+        done = true;
+        for( unsigned int d = 0; d < ImageDimension; d++ )
+          {
+          if( index[d] < upper[d] )
+            {
+            index[d]++;
+            n += strides[d];
+            done = false;
+            break;
+            }
+          n -= ( index[d] - lower[d] ) * strides[d];
+          index[d] = lower[d];
+          }
+        }
+
+      FeatureAccumulatorType::FeatureArrayType features = accumulator.GetFeatures();
+      for( unsigned int i = 0; i < features.Size(); i++ )
+        {
+        out[i] += features[i] / static_cast<RealType>( numberOfOffsets );
+        }
+      }
+
+    ItO.Set( out );
+    progress.CompletedPixel();
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::AfterThreadedGenerateData()
+{
+  this->m_GreyLevels.clear();
+}
+
+template<class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "NeighborhoodRadius: " << this->m_NeighborhoodRadius << std::endl;
+  os << indent << "Min: " << this->GetMin() << std::endl;
+  os << indent << "Max: " << this->GetMax() << std::endl;
+  os << indent << "MinDistance: " << this->GetMinDistance() << std::endl;
+  os << indent << "MaxDistance: " << this->GetMaxDistance() << std::endl;
+  os << indent << "NumberOfBinsPerAxis: " << this->GetNumberOfBinsPerAxis() << std::endl;
+}
+
+} // end namespace Statistics
+} // end namespace itk
+
+#endif
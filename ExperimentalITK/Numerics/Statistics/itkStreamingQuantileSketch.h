@@ -0,0 +1,162 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkStreamingQuantileSketch_h
+#define __itkStreamingQuantileSketch_h
+
+#include "itkNumericTraits.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include <vector>
+
+namespace itk {
+namespace Statistics {
+
+/** \class StreamingQuantileSketch
+ * \brief Approximate quantiles of a stream of values in fixed memory.
+ *
+ * The values are kept in a stack of compactors, as in the KLL sketch of
+ * Karnin, Lang and Liberty.  A value in compactor h stands for 2^h input
+ * values.  When the sketch is full, the lowest compactor that exceeds its
+ * capacity is sorted and every other value of it is promoted to the next
+ * compactor.  The top compactor holds K values and the capacities shrink
+ * by a factor 2/3 per level below it, so the sketch stores about 3 K
+ * values whatever the length of the stream.  The rank error of a quantile
+ * is of the order of 1.7 / K of the number of values.
+ *
+ * Sketches of parts of a stream can be merged, so the parts can be
+ * processed in parallel or out of core.  The minimum and the maximum are
+ * exact.
+ */
+
+template<class TValue = float>
+class ITK_EXPORT StreamingQuantileSketch : public Object
+{
+public:
+  /**
+   * Standard class typedefs.
+   */
+  typedef StreamingQuantileSketch                             Self;
+  typedef Object                                              Superclass;
+  typedef SmartPointer<Self>                                  Pointer;
+  typedef SmartPointer<const Self>                            ConstPointer;
+
+  /**
+   * Standard macros
+   */
+  itkTypeMacro( StreamingQuantileSketch, Object );
+
+  /**
+   * Method for creation through the object factory.
+   */
+  itkNewMacro( Self );
+
+  typedef TValue                                              ValueType;
+  typedef SizeValueType                                       CountType;
+
+  /** Accuracy parameter, i.e. the capacity of the top compactor.  Setting
+   * it clears the sketch.  Default is 200. */
+  void SetK( unsigned int );
+  itkGetConstMacro( K, unsigned int );
+
+  void Clear();
+
+  void AddValue( ValueType value )
+    {
+    this->m_Compactors[0].push_back( value );
+    this->m_Count++;
+    if( value < this->m_Minimum )
+      {
+      this->m_Minimum = value;
+      }
+    if( value > this->m_Maximum )
+      {
+      this->m_Maximum = value;
+      }
+    if( ++this->m_Size > this->m_Capacity )
+      {
+      this->Compress();
+      }
+    }
+
+  /** Adds the values of another sketch with the same K. */
+  void Merge( const Self *other );
+
+  /** Number of values added. */
+  itkGetConstMacro( Count, CountType );
+
+  ValueType GetMinimum() const
+    {
+    return this->m_Minimum;
+    }
+  ValueType GetMaximum() const
+    {
+    return this->m_Maximum;
+    }
+
+  /** The value of rank p * count, for p in [0,1].  Zero if the sketch is
+   * empty. */
+  ValueType GetQuantile( double p ) const;
+
+  /** Several quantiles from a single sort of the retained values. */
+  void GetQuantiles( const std::vector<double> & p,
+    std::vector<ValueType> & quantiles ) const;
+
+  /** Number of values retained. */
+  SizeValueType GetNumberOfRetainedValues() const
+    {
+    return this->m_Size;
+    }
+
+protected:
+  StreamingQuantileSketch();
+  ~StreamingQuantileSketch() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  StreamingQuantileSketch( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  SizeValueType GetCompactorCapacity( unsigned int level ) const;
+  void UpdateCapacity();
+  void Compress();
+
+  unsigned int                                        m_K;
+  std::vector<std::vector<ValueType> >                m_Compactors;
+
+  /** Per compactor, which half of the next compaction is promoted.  It
+   * alternates so that the rank errors cancel out on average. */
+  std::vector<char>                                   m_Parities;
+
+  SizeValueType                                       m_Size;
+  SizeValueType                                       m_Capacity;
+  CountType                                           m_Count;
+  ValueType                                           m_Minimum;
+  ValueType                                           m_Maximum;
+
+}; // end of class
+
+} // end of namespace Statistics
+} // end of namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkStreamingQuantileSketch.hxx"
+#endif
+
+#endif
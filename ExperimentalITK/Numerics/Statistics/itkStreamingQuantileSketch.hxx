@@ -0,0 +1,248 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkStreamingQuantileSketch_hxx
+#define __itkStreamingQuantileSketch_hxx
+
+#include "itkStreamingQuantileSketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace itk {
+namespace Statistics {
+
+template<class TValue>
+StreamingQuantileSketch<TValue>
+::StreamingQuantileSketch()
+{
+  this->m_K = 200;
+  this->Clear();
+}
+
+template<class TValue>
+void
+StreamingQuantileSketch<TValue>
+::SetK( unsigned int k )
+{
+  k = std::max( k, 8u );
+  if( k != this->m_K )
+    {
+    this->m_K = k;
+    this->Clear();
+    this->Modified();
+    }
+}
+
+template<class TValue>
+void
+StreamingQuantileSketch<TValue>
+::Clear()
+{
+  this->m_Compactors.assign( 1, std::vector<ValueType>() );
+  this->m_Parities.assign( 1, 0 );
+  this->m_Size = 0;
+  this->m_Count = 0;
+  this->m_Minimum = NumericTraits<ValueType>::max();
+  this->m_Maximum = NumericTraits<ValueType>::NonpositiveMin();
+  this->UpdateCapacity();
+}
+
+template<class TValue>
+SizeValueType
+StreamingQuantileSketch<TValue>
+::GetCompactorCapacity( unsigned int level ) const
+{
+  const unsigned int depth = this->m_Compactors.size() - 1 - level;
+  const double capacity = std::ceil( this->m_K *
+    std::pow( 2.0 / 3.0, static_cast<double>( depth ) ) );
+  return std::max( static_cast<SizeValueType>( capacity ),
+    static_cast<SizeValueType>( 2 ) );
+}
+
+template<class TValue>
+void
+StreamingQuantileSketch<TValue>
+::UpdateCapacity()
+{
+  this->m_Capacity = 0;
+  for( unsigned int h = 0; h < this->m_Compactors.size(); h++ )
+    {
+    this->m_Capacity += this->GetCompactorCapacity( h );
+    }
+}
+
+template<class TValue>
+void
+StreamingQuantileSketch<TValue>
+::Compress()
+{
+  while( this->m_Size > this->m_Capacity )
+    {
+    // Compact the lowest compactor at or over its capacity.
+    unsigned int h = 0;
+    while( this->m_Compactors[h].size() < this->GetCompactorCapacity( h ) )
+      {
+      h++;
+      }
+    if( h + 1 == this->m_Compactors.size() )
+      {
+      this->m_Compactors.push_back( std::vector<ValueType>() );
+      this->m_Parities.push_back( 0 );
+      }
+
+    std::vector<ValueType> & compactor = this->m_Compactors[h];
+    std::vector<ValueType> & next = this->m_Compactors[h + 1];
+    std::sort( compactor.begin(), compactor.end() );
+
+    // With an odd number of values, the largest one stays behind.
+    const SizeValueType numberOfPairs = compactor.size() / 2;
+    const unsigned int parity = this->m_Parities[h];
+    for( SizeValueType n = 0; n < numberOfPairs; n++ )
+      {
+      next.push_back( compactor[2 * n + parity] );
+      }
+    this->m_Parities[h] = 1 - parity;
+    if( compactor.size() % 2 )
+      {
+      compactor[0] = compactor.back();
+      compactor.resize( 1 );
+      }
+    else
+      {
+      compactor.clear();
+      }
+    this->m_Size -= numberOfPairs;
+    this->UpdateCapacity();
+    }
+}
+
+template<class TValue>
+void
+StreamingQuantileSketch<TValue>
+::Merge( const Self *other )
+{
+  if( !other || other->m_Count == 0 )
+    {
+    return;
+    }
+  if( other->m_K != this->m_K )
+    {
+    itkExceptionMacro( "Only sketches with the same K can be merged." );
+    }
+  while( this->m_Compactors.size() < other->m_Compactors.size() )
+    {
+    this->m_Compactors.push_back( std::vector<ValueType>() );
+    this->m_Parities.push_back( 0 );
+    }
+  for( unsigned int h = 0; h < other->m_Compactors.size(); h++ )
+    {
+    this->m_Compactors[h].insert( this->m_Compactors[h].end(),
+      other->m_Compactors[h].begin(), other->m_Compactors[h].end() );
+    }
+  this->m_Size += other->m_Size;
+  this->m_Count += other->m_Count;
+  this->m_Minimum = std::min( this->m_Minimum, other->m_Minimum );
+  this->m_Maximum = std::max( this->m_Maximum, other->m_Maximum );
+  this->UpdateCapacity();
+  this->Compress();
+}
+
+template<class TValue>
+typename StreamingQuantileSketch<TValue>::ValueType
+StreamingQuantileSketch<TValue>
+::GetQuantile( double p ) const
+{
+  std::vector<double> ps( 1, p );
+  std::vector<ValueType> quantiles;
+  this->GetQuantiles( ps, quantiles );
+  return quantiles[0];
+}
+
+template<class TValue>
+void
+StreamingQuantileSketch<TValue>
+::GetQuantiles( const std::vector<double> & p,
+  std::vector<ValueType> & quantiles ) const
+{
+  quantiles.assign( p.size(), NumericTraits<ValueType>::Zero );
+  if( this->m_Count == 0 )
+    {
+    return;
+    }
+
+  typedef std::pair<ValueType, CountType> WeightedValueType;
+  std::vector<WeightedValueType> values;
+  values.reserve( this->m_Size );
+  for( unsigned int h = 0; h < this->m_Compactors.size(); h++ )
+    {
+    const CountType weight = static_cast<CountType>( 1 ) << h;
+    for( SizeValueType n = 0; n < this->m_Compactors[h].size(); n++ )
+      {
+      values.push_back( WeightedValueType( this->m_Compactors[h][n], weight ) );
+      }
+    }
+  std::sort( values.begin(), values.end() );
+
+  std::vector<CountType> cumulative( values.size() );
+  CountType total = 0;
+  for( SizeValueType n = 0; n < values.size(); n++ )
+    {
+    total += values[n].second;
+    cumulative[n] = total;
+    }
+
+  for( unsigned int i = 0; i < p.size(); i++ )
+    {
+    if( p[i] <= 0.0 )
+      {
+      quantiles[i] = this->m_Minimum;
+      }
+    else if( p[i] >= 1.0 )
+      {
+      quantiles[i] = this->m_Maximum;
+      }
+    else
+      {
+      // First retained value whose cumulative weight passes the
+      // zero-based rank p * ( count - 1 ).
+      const double rank = p[i] * static_cast<double>( total - 1 );
+      const SizeValueType n = std::upper_bound( cumulative.begin(),
+        cumulative.end(), static_cast<CountType>( rank ) ) - cumulative.begin();
+      quantiles[i] = values[std::min( n, values.size() - 1 )].first;
+      }
+    }
+}
+
+template<class TValue>
+void
+StreamingQuantileSketch<TValue>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "K: " << this->m_K << std::endl;
+  os << indent << "Count: " << this->m_Count << std::endl;
+  os << indent << "Retained values: " << this->m_Size << std::endl;
+  os << indent << "Compactors: " << this->m_Compactors.size() << std::endl;
+}
+
+} // end of namespace Statistics
+} // end of namespace itk
+
+#endif
@@ -0,0 +1,704 @@
+#include "itkImage.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMemoryProbe.h"
+#include "itkMemoryProbesCollectorBase.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+#include "itkPointSet.h"
+#include "itkTimeProbe.h"
+#include "itkTimeProbesCollectorBase.h"
+#include "itkVector.h"
+
+#include "itkBinaryThinning3DImageFilter.h"
+#include "itkComposeDiffeomorphismsImageFilter.h"
+#include "itkJensenHavrdaCharvatTsallisPointSetMetric.h"
+#include "itkLabelScalarImageToCooccurrenceMatricesGenerator.h"
+#include "itkLabelScalarImageToRunLengthMatricesGenerator.h"
+#include "itkMattesMutualInformationImageToImageMetricv4.h"
+#include "itkN4MRIBiasFieldCorrectionImageFilter.h"
+
+#include "MultipleOperateImagesReducers.h"
+
+#include "vnl/vnl_math.h"
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+#include <sys/resource.h>
+#endif
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Times the hot kernels of the tools on deterministic synthetic data of
+ * several sizes and writes the throughput of every kernel as JSON.  If a
+ * baseline file written by an earlier run is given, kernels whose
+ * throughput dropped by more than the tolerance are reported and the
+ * program exits with failure.
+ */
+
+const unsigned int ImageDimension = 3;
+
+typedef float                                          RealType;
+typedef itk::Image<RealType, ImageDimension>           ImageType;
+typedef itk::Image<unsigned int, ImageDimension>       LabelImageType;
+typedef itk::Image<unsigned char, ImageDimension>      MaskImageType;
+typedef itk::Vector<RealType, ImageDimension>          VectorType;
+typedef itk::Image<VectorType, ImageDimension>         DisplacementFieldType;
+typedef itk::PointSet<long, ImageDimension>            PointSetType;
+
+typedef itk::Statistics::MersenneTwisterRandomVariateGenerator GeneratorType;
+
+struct BenchmarkResult
+{
+  std::string Kernel;
+  unsigned int Size;
+  unsigned long Elements;
+  std::string Unit;
+  double Seconds;
+  double Throughput;
+  double MemoryKB;
+};
+
+/**
+ * Collects the time and memory of the repetitions of one kernel.
+ */
+class KernelProbe
+{
+public:
+  KernelProbe( const std::string & kernel, unsigned int size,
+    itk::TimeProbesCollectorBase & timeCollector,
+    itk::MemoryProbesCollectorBase & memoryCollector )
+    : m_TimeCollector( timeCollector ), m_MemoryCollector( memoryCollector )
+    {
+    std::ostringstream id;
+    id << kernel << " " << size;
+    this->m_Id = id.str();
+    this->m_Kernel = kernel;
+    this->m_Size = size;
+    }
+
+  void Start()
+    {
+    this->m_MemoryCollector.Start( this->m_Id.c_str() );
+    this->m_TimeCollector.Start( this->m_Id.c_str() );
+    this->m_MemoryProbe.Start();
+    this->m_TimeProbe.Start();
+    }
+
+  void Stop()
+    {
+    this->m_TimeProbe.Stop();
+    this->m_MemoryProbe.Stop();
+    this->m_TimeCollector.Stop( this->m_Id.c_str() );
+    this->m_MemoryCollector.Stop( this->m_Id.c_str() );
+    }
+
+  BenchmarkResult GetResult( unsigned long elements, const std::string & unit )
+    {
+    BenchmarkResult result;
+    result.Kernel = this->m_Kernel;
+    result.Size = this->m_Size;
+    result.Elements = elements;
+    result.Unit = unit;
+    result.Seconds = this->m_TimeProbe.GetMean();
+    result.Throughput = ( result.Seconds > 0.0 )
+      ? static_cast<double>( elements ) / result.Seconds : 0.0;
+    result.MemoryKB = this->m_MemoryProbe.GetMean();
+    return result;
+    }
+
+private:
+  std::string                       m_Id;
+  std::string                       m_Kernel;
+  unsigned int                      m_Size;
+  itk::TimeProbe                    m_TimeProbe;
+  itk::MemoryProbe                  m_MemoryProbe;
+  itk::TimeProbesCollectorBase &    m_TimeCollector;
+  itk::MemoryProbesCollectorBase &  m_MemoryCollector;
+};
+
+template <class TImage>
+typename TImage::Pointer AllocateImage( unsigned int size )
+{
+  typename TImage::SizeType imageSize;
+  imageSize.Fill( size );
+  typename TImage::SpacingType spacing;
+  spacing.Fill( 1.0 );
+  typename TImage::PointType origin;
+  origin.Fill( 0.0 );
+
+  typename TImage::Pointer image = TImage::New();
+  image->SetRegions( imageSize );
+  image->SetSpacing( spacing );
+  image->SetOrigin( origin );
+  image->Allocate();
+  return image;
+}
+
+/**
+ * Smooth blobs on a smooth bias with seeded noise.  The shift moves the
+ * blobs to give a second image for the similarity metrics.
+ */
+ImageType::Pointer CreateIntensityImage( unsigned int size, RealType shift,
+  GeneratorType *generator )
+{
+  ImageType::Pointer image = AllocateImage<ImageType>( size );
+
+  itk::ImageRegionIteratorWithIndex<ImageType> It( image,
+    image->GetLargestPossibleRegion() );
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    ImageType::IndexType index = It.GetIndex();
+    RealType value = 100.0;
+    RealType bias = 1.0;
+    for( unsigned int b = 0; b < 4; b++ )
+      {
+      RealType distance2 = 0.0;
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        RealType center = size * ( 0.25 + 0.5 * ( ( b >> d ) & 1 ) ) + shift;
+        RealType x = ( index[d] - center ) / ( 0.15 * size );
+        distance2 += x * x;
+        }
+      value += 200.0 * ( b + 1 ) * vcl_exp( -0.5 * distance2 );
+      }
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      bias += 0.1 * static_cast<RealType>( index[d] ) / size;
+      }
+    It.Set( value * bias + 10.0 * generator->GetNormalVariate() );
+    }
+  return image;
+}
+
+LabelImageType::Pointer CreateLabelImage( const ImageType *image,
+  unsigned int numberOfLabels )
+{
+  LabelImageType::Pointer labels = AllocateImage<LabelImageType>(
+    image->GetLargestPossibleRegion().GetSize()[0] );
+
+  itk::ImageRegionConstIterator<ImageType> ItI( image,
+    image->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<LabelImageType> ItL( labels,
+    labels->GetLargestPossibleRegion() );
+  for( ItI.GoToBegin(), ItL.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++ItL )
+    {
+    unsigned int label = static_cast<unsigned int>( ItI.Get() / 150.0 );
+    ItL.Set( vnl_math_min( label, numberOfLabels ) );
+    }
+  return labels;
+}
+
+MaskImageType::Pointer CreateBinaryImage( const ImageType *image,
+  RealType threshold )
+{
+  MaskImageType::Pointer binary = AllocateImage<MaskImageType>(
+    image->GetLargestPossibleRegion().GetSize()[0] );
+
+  itk::ImageRegionConstIterator<ImageType> ItI( image,
+    image->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<MaskImageType> ItB( binary,
+    binary->GetLargestPossibleRegion() );
+  for( ItI.GoToBegin(), ItB.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++ItB )
+    {
+    ItB.Set( ( ItI.Get() > threshold ) ? 1 : 0 );
+    }
+  return binary;
+}
+
+DisplacementFieldType::Pointer CreateDisplacementField( unsigned int size,
+  RealType amplitude, RealType phase )
+{
+  DisplacementFieldType::Pointer field =
+    AllocateImage<DisplacementFieldType>( size );
+
+  itk::ImageRegionIteratorWithIndex<DisplacementFieldType> It( field,
+    field->GetLargestPossibleRegion() );
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    DisplacementFieldType::IndexType index = It.GetIndex();
+    VectorType displacement;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      unsigned int e = ( d + 1 ) % ImageDimension;
+      displacement[d] = amplitude * vcl_sin( 2.0 * vnl_math::pi
+        * static_cast<RealType>( index[e] ) / size + phase );
+      }
+    It.Set( displacement );
+    }
+  return field;
+}
+
+/**
+ * Noisy points on an ellipsoid.
+ */
+PointSetType::Pointer CreatePointSet( unsigned long numberOfPoints,
+  RealType radius, GeneratorType *generator )
+{
+  PointSetType::Pointer points = PointSetType::New();
+  points->Initialize();
+
+  for( unsigned long n = 0; n < numberOfPoints; n++ )
+    {
+    PointSetType::PointType point;
+    RealType norm = 0.0;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      point[d] = generator->GetNormalVariate();
+      norm += point[d] * point[d];
+      }
+    norm = vcl_sqrt( norm );
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      point[d] = radius * ( 1.0 + 0.2 * d ) * point[d] / norm
+        + 0.01 * radius * generator->GetNormalVariate();
+      }
+    points->SetPoint( n, point );
+    points->SetPointData( n, 1 );
+    }
+  return points;
+}
+
+void RunKernels( unsigned int size, unsigned int repetitions,
+  itk::TimeProbesCollectorBase & timeCollector,
+  itk::MemoryProbesCollectorBase & memoryCollector,
+  std::vector<BenchmarkResult> & results )
+{
+  GeneratorType::Pointer generator = GeneratorType::New();
+  generator->Initialize( 1234 + size );
+
+  ImageType::Pointer fixedImage = CreateIntensityImage( size, 0.0, generator );
+  ImageType::Pointer movingImage = CreateIntensityImage( size, 0.05 * size,
+    generator );
+  const unsigned long numberOfVoxels =
+    fixedImage->GetLargestPossibleRegion().GetNumberOfPixels();
+
+  RealType minValue = itk::NumericTraits<RealType>::max();
+  RealType maxValue = itk::NumericTraits<RealType>::NonpositiveMin();
+  itk::ImageRegionConstIterator<ImageType> ItF( fixedImage,
+    fixedImage->GetLargestPossibleRegion() );
+  for( ItF.GoToBegin(); !ItF.IsAtEnd(); ++ItF )
+    {
+    minValue = vnl_math_min( minValue, ItF.Get() );
+    maxValue = vnl_math_max( maxValue, ItF.Get() );
+    }
+
+  /**
+   * Mattes mutual information
+   */
+  {
+  typedef itk::MattesMutualInformationImageToImageMetricv4<ImageType, ImageType,
+    ImageType> MetricType;
+  MetricType::Pointer metric = MetricType::New();
+  metric->SetNumberOfHistogramBins( 32 );
+  metric->SetFixedImage( fixedImage );
+  metric->SetMovingImage( movingImage );
+  metric->SetVirtualDomainFromImage( fixedImage );
+  metric->SetUseMovingImageGradientFilter( false );
+  metric->SetUseFixedImageGradientFilter( false );
+  metric->Initialize();
+
+  KernelProbe probe( "MattesMutualInformation", size, timeCollector,
+    memoryCollector );
+  for( unsigned int r = 0; r < repetitions; r++ )
+    {
+    probe.Start();
+    metric->GetValue();
+    probe.Stop();
+    }
+  results.push_back( probe.GetResult( numberOfVoxels, "voxels/s" ) );
+  }
+
+  /**
+   * Displacement field composition
+   */
+  {
+  DisplacementFieldType::Pointer field = CreateDisplacementField( size,
+    0.02 * size, 0.0 );
+  DisplacementFieldType::Pointer warp = CreateDisplacementField( size,
+    0.03 * size, 0.5 );
+
+  typedef itk::ComposeDiffeomorphismsImageFilter<DisplacementFieldType,
+    DisplacementFieldType> ComposerType;
+
+  KernelProbe probe( "ComposeDiffeomorphisms", size, timeCollector,
+    memoryCollector );
+  for( unsigned int r = 0; r < repetitions; r++ )
+    {
+    ComposerType::Pointer composer = ComposerType::New();
+    composer->SetDeformationField( field );
+    composer->SetWarpingField( warp );
+
+    probe.Start();
+    composer->Update();
+    probe.Stop();
+    }
+  results.push_back( probe.GetResult( numberOfVoxels, "voxels/s" ) );
+  }
+
+  /**
+   * One N4 iteration at one fitting level
+   */
+  {
+  typedef itk::N4MRIBiasFieldCorrectionImageFilter<ImageType, MaskImageType,
+    ImageType> CorrecterType;
+
+  CorrecterType::VariableSizeArrayType maximumNumberOfIterations( 1 );
+  maximumNumberOfIterations[0] = 1;
+
+  KernelProbe probe( "N4Iteration", size, timeCollector, memoryCollector );
+  for( unsigned int r = 0; r < repetitions; r++ )
+    {
+    CorrecterType::Pointer correcter = CorrecterType::New();
+    correcter->SetInput( fixedImage );
+    correcter->SetMaximumNumberOfIterations( maximumNumberOfIterations );
+    correcter->SetNumberOfFittingLevels( 1 );
+    correcter->SetConvergenceThreshold( 0.0 );
+
+    probe.Start();
+    correcter->Update();
+    probe.Stop();
+    }
+  results.push_back( probe.GetResult( numberOfVoxels, "voxels/s" ) );
+  }
+
+  /**
+   * Texture features of all labels
+   */
+  {
+  LabelImageType::Pointer labels = CreateLabelImage( fixedImage, 4 );
+
+  typedef itk::Statistics::LabelScalarImageToCooccurrenceMatricesGenerator
+    <ImageType, LabelImageType> CooccurrenceGeneratorType;
+  CooccurrenceGeneratorType::Pointer cooccurrence =
+    CooccurrenceGeneratorType::New();
+  cooccurrence->SetInput( fixedImage );
+  cooccurrence->SetLabelImage( labels );
+  cooccurrence->SetNumberOfBinsPerAxis( 64 );
+  cooccurrence->SetPixelValueMinMax( minValue, maxValue );
+
+  KernelProbe cooccurrenceProbe( "CooccurrenceFeatures", size,
+    timeCollector, memoryCollector );
+  for( unsigned int r = 0; r < repetitions; r++ )
+    {
+    cooccurrence->Modified();
+    cooccurrenceProbe.Start();
+    cooccurrence->Compute();
+    cooccurrenceProbe.Stop();
+    }
+  results.push_back( cooccurrenceProbe.GetResult( numberOfVoxels, "voxels/s" ) );
+
+  typedef itk::Statistics::LabelScalarImageToRunLengthMatricesGenerator
+    <ImageType, LabelImageType> RunLengthGeneratorType;
+  RunLengthGeneratorType::Pointer runLength = RunLengthGeneratorType::New();
+  runLength->SetInput( fixedImage );
+  runLength->SetLabelImage( labels );
+  runLength->SetNumberOfGreyLevelBins( 64 );
+  runLength->SetNumberOfRunLengthBins( 64 );
+  runLength->SetPixelValueMinMax( minValue, maxValue );
+  runLength->SetDistanceValueMinMax( 0, vcl_sqrt(
+    static_cast<RealType>( ImageDimension ) ) * size );
+
+  KernelProbe runLengthProbe( "RunLengthFeatures", size,
+    timeCollector, memoryCollector );
+  for( unsigned int r = 0; r < repetitions; r++ )
+    {
+    runLength->Modified();
+    runLengthProbe.Start();
+    runLength->Compute();
+    runLengthProbe.Stop();
+    }
+  results.push_back( runLengthProbe.GetResult( numberOfVoxels, "voxels/s" ) );
+  }
+
+  /**
+   * Thinning
+   */
+  {
+  MaskImageType::Pointer binary = CreateBinaryImage( fixedImage,
+    0.5 * ( minValue + maxValue ) );
+
+  typedef itk::BinaryThinning3DImageFilter<MaskImageType, MaskImageType>
+    ThinnerType;
+
+  KernelProbe probe( "BinaryThinning3D", size, timeCollector,
+    memoryCollector );
+  for( unsigned int r = 0; r < repetitions; r++ )
+    {
+    ThinnerType::Pointer thinner = ThinnerType::New();
+    thinner->SetInput( binary );
+
+    probe.Start();
+    thinner->Update();
+    probe.Stop();
+    }
+  results.push_back( probe.GetResult( numberOfVoxels, "voxels/s" ) );
+  }
+
+  /**
+   * Jensen-Havrda-Charvat-Tsallis point-set metric
+   */
+  {
+  const unsigned long numberOfPoints = 8 * size;
+  PointSetType::Pointer fixedPoints = CreatePointSet( numberOfPoints,
+    0.3 * size, generator );
+  PointSetType::Pointer movingPoints = CreatePointSet( numberOfPoints,
+    0.32 * size, generator );
+
+  typedef itk::JensenHavrdaCharvatTsallisPointSetMetric<PointSetType>
+    MetricType;
+  MetricType::Pointer metric = MetricType::New();
+  metric->SetFixedPointSet( fixedPoints );
+  metric->SetMovingPointSet( movingPoints );
+  metric->SetFixedPointSetSigma( 1.0 );
+  metric->SetMovingPointSetSigma( 1.0 );
+  metric->SetFixedEvaluationKNeighborhood( 50 );
+  metric->SetMovingEvaluationKNeighborhood( 50 );
+  metric->SetUseRegularizationTerm( true );
+  metric->SetUseInputAsSamples( true );
+  metric->SetAlpha( 2.0 );
+  metric->SetUseAnisotropicCovariances( false );
+  metric->Initialize();
+
+  MetricType::DefaultTransformType::ParametersType parameters;
+  parameters.Fill( 0 );
+
+  KernelProbe probe( "JensenHavrdaCharvatTsallis", size, timeCollector,
+    memoryCollector );
+  for( unsigned int r = 0; r < repetitions; r++ )
+    {
+    MetricType::MeasureType value;
+    MetricType::DerivativeType derivative;
+
+    probe.Start();
+    metric->GetValueAndDerivative( parameters, value, derivative );
+    probe.Stop();
+    }
+  results.push_back( probe.GetResult( 2 * numberOfPoints, "points/s" ) );
+  }
+
+  /**
+   * The mean and max reducers of MultipleOperateImages over 8 images
+   */
+  {
+  const unsigned int numberOfImages = 8;
+  std::vector<ImageType::Pointer> images;
+  for( unsigned int n = 0; n < numberOfImages; n++ )
+    {
+    images.push_back( CreateIntensityImage( size, 0.01 * n * size,
+      generator ) );
+    }
+  ImageType::Pointer output = AllocateImage<ImageType>( size );
+
+  KernelProbe meanProbe( "MultipleOperateImagesMean", size, timeCollector,
+    memoryCollector );
+  for( unsigned int r = 0; r < repetitions; r++ )
+    {
+    meanProbe.Start();
+    output->FillBuffer( 0.0 );
+    RealType N = 0.0;
+    for( unsigned int n = 0; n < numberOfImages; n++ )
+      {
+      N += 1.0;
+      AccumulateMeanImage<ImageType, LabelImageType>( output, images[n],
+        NULL, N );
+      }
+    meanProbe.Stop();
+    }
+  results.push_back( meanProbe.GetResult( numberOfImages * numberOfVoxels,
+    "voxels/s" ) );
+
+  KernelProbe maxProbe( "MultipleOperateImagesMax", size, timeCollector,
+    memoryCollector );
+  for( unsigned int r = 0; r < repetitions; r++ )
+    {
+    maxProbe.Start();
+    output->FillBuffer( itk::NumericTraits<RealType>::NonpositiveMin() );
+    for( unsigned int n = 0; n < numberOfImages; n++ )
+      {
+      AccumulateMaxImage<ImageType, LabelImageType>( output, images[n],
+        NULL );
+      }
+    maxProbe.Stop();
+    }
+  results.push_back( maxProbe.GetResult( numberOfImages * numberOfVoxels,
+    "voxels/s" ) );
+  }
+}
+
+/**
+ * Peak resident set size of the process in KB (0 if not available).
+ */
+double GetPeakResidentSetSize()
+{
+#if defined( __unix__ ) || defined( __APPLE__ )
+  struct rusage usage;
+  if( getrusage( RUSAGE_SELF, &usage ) == 0 )
+    {
+#if defined( __APPLE__ )
+    return static_cast<double>( usage.ru_maxrss ) / 1024.0;
+#else
+    return static_cast<double>( usage.ru_maxrss );
+#endif
+    }
+#endif
+  return 0.0;
+}
+
+void WriteResults( const char *filename,
+  const std::vector<BenchmarkResult> & results, unsigned int repetitions )
+{
+  std::ofstream str( filename );
+  str.precision( 10 );
+
+  str << "{" << std::endl;
+  str << "  \"repetitions\": " << repetitions << "," << std::endl;
+  str << "  \"peakRSSKB\": " << GetPeakResidentSetSize() << "," << std::endl;
+  str << "  \"kernels\": [" << std::endl;
+  for( unsigned int n = 0; n < results.size(); n++ )
+    {
+    // One kernel per line so that baselines can be read back line by line.
+    str << "    { \"kernel\": \"" << results[n].Kernel << "\", "
+        << "\"size\": " << results[n].Size << ", "
+        << "\"elements\": " << results[n].Elements << ", "
+        << "\"seconds\": " << results[n].Seconds << ", "
+        << "\"throughput\": " << results[n].Throughput << ", "
+        << "\"unit\": \"" << results[n].Unit << "\", "
+        << "\"memoryKB\": " << results[n].MemoryKB << " }";
+    if( n + 1 < results.size() )
+      {
+      str << ",";
+      }
+    str << std::endl;
+    }
+  str << "  ]" << std::endl;
+  str << "}" << std::endl;
+}
+
+/**
+ * Reads the throughput of every kernel and size from a file written by
+ * WriteResults().
+ */
+std::map<std::string, double> ReadBaseline( const char *filename )
+{
+  std::map<std::string, double> baseline;
+
+  std::ifstream str( filename );
+  std::string line;
+  while( std::getline( str, line ) )
+    {
+    std::string::size_type kernelPos = line.find( "\"kernel\": \"" );
+    std::string::size_type sizePos = line.find( "\"size\": " );
+    std::string::size_type throughputPos = line.find( "\"throughput\": " );
+    if( kernelPos == std::string::npos || sizePos == std::string::npos
+      || throughputPos == std::string::npos )
+      {
+      continue;
+      }
+    kernelPos += 11;
+    std::string kernel = line.substr( kernelPos,
+      line.find( '"', kernelPos ) - kernelPos );
+    unsigned int size = static_cast<unsigned int>(
+      atoi( line.c_str() + sizePos + 8 ) );
+
+    std::ostringstream id;
+    id << kernel << " " << size;
+    baseline[id.str()] = atof( line.c_str() + throughputPos + 14 );
+    }
+  return baseline;
+}
+
+int main( int argc, char *argv[] )
+{
+  if( argc < 2 )
+    {
+    std::cout << "Usage: " << argv[0] << " outputJson [sizes=32x64x96] "
+      << "[repetitions=3] [baselineJson] [tolerance=0.25]" << std::endl;
+    exit( 1 );
+    }
+
+  std::vector<unsigned int> sizes;
+  std::string sizeString( "32x64x96" );
+  if( argc > 2 )
+    {
+    sizeString = std::string( argv[2] );
+    }
+  std::istringstream sizeStream( sizeString );
+  std::string token;
+  while( std::getline( sizeStream, token, 'x' ) )
+    {
+    if( atoi( token.c_str() ) > 0 )
+      {
+      sizes.push_back( static_cast<unsigned int>( atoi( token.c_str() ) ) );
+      }
+    }
+
+  unsigned int repetitions = 3;
+  if( argc > 3 )
+    {
+    repetitions = vnl_math_max( 1, atoi( argv[3] ) );
+    }
+
+  itk::TimeProbesCollectorBase timeCollector;
+  itk::MemoryProbesCollectorBase memoryCollector;
+  std::vector<BenchmarkResult> results;
+
+  for( unsigned int s = 0; s < sizes.size(); s++ )
+    {
+    std::cout << "Size " << sizes[s] << "^" << ImageDimension << std::endl;
+    RunKernels( sizes[s], repetitions, timeCollector, memoryCollector,
+      results );
+    }
+
+  timeCollector.Report( std::cout );
+  memoryCollector.Report( std::cout );
+
+  WriteResults( argv[1], results, repetitions );
+
+  if( argc > 4 )
+    {
+    RealType tolerance = 0.25;
+    if( argc > 5 )
+      {
+      tolerance = atof( argv[5] );
+      }
+
+    std::map<std::string, double> baseline = ReadBaseline( argv[4] );
+
+    unsigned int numberOfRegressions = 0;
+    for( unsigned int n = 0; n < results.size(); n++ )
+      {
+      std::ostringstream id;
+      id << results[n].Kernel << " " << results[n].Size;
+
+      std::map<std::string, double>::const_iterator it =
+        baseline.find( id.str() );
+      if( it == baseline.end() )
+        {
+        std::cout << "  " << id.str() << ": not in baseline" << std::endl;
+        continue;
+        }
+      double ratio = ( it->second > 0.0 )
+        ? results[n].Throughput / it->second : 1.0;
+      std::cout << "  " << id.str() << ": " << ratio << " x baseline";
+      if( ratio < 1.0 - tolerance )
+        {
+        std::cout << "  REGRESSION";
+        numberOfRegressions++;
+        }
+      std::cout << std::endl;
+      }
+    if( numberOfRegressions > 0 )
+      {
+      std::cerr << numberOfRegressions << " kernel(s) regressed by more than "
+        << 100.0 * tolerance << "%." << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  return EXIT_SUCCESS;
+}
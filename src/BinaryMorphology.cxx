@@ -22,6 +22,8 @@
 
 #include "vnl/vnl_math.h"
 
+#include "BinaryMorphologyOperations.h"
+
 template <unsigned int ImageDimension>
 int BinaryMorphology( int argc, char * argv[] )
 {
@@ -52,46 +54,7 @@ int BinaryMorphology( int argc, char * argv[] )
 
   unsigned int operation = static_cast<unsigned int>( atoi( argv[4] ) );
 
-  if( operation == 5 )
-    {
-    typedef itk::BinaryFillholeImageFilter<ImageType>  FilterType;
-    typename FilterType::Pointer  filter = FilterType::New();
-    filter->SetInput( reader->GetOutput() );
-    filter->SetForegroundValue( foreground );
-    filter->SetFullyConnected( true );
-    filter->Update();
-
-    typedef itk::ImageFileWriter<ImageType>  WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( filter->GetOutput() );
-    writer->SetFileName( argv[3] );
-    writer->Update();
-
-    return EXIT_SUCCESS;
-    }
-  else if( operation == 6 )
-    {
-    typedef itk::VotingBinaryIterativeHoleFillingImageFilter<ImageType>  FilterType;
-    typename FilterType::InputSizeType radii;
-    radii.Fill( radius );
-
-    typename FilterType::Pointer  filter = FilterType::New();
-    filter->SetInput( reader->GetOutput() );
-    filter->SetForegroundValue( foreground );
-    filter->SetMajorityThreshold( 1 );  // 1 == default
-    filter->SetRadius( radii );
-    filter->SetMaximumNumberOfIterations( 100000000 );
-    filter->Update();
-
-    typedef itk::ImageFileWriter<ImageType>  WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( filter->GetOutput() );
-    writer->SetFileName( argv[3] );
-    writer->Update();
-
-    return EXIT_SUCCESS;
-    }
-  else if( operation == 7 )
+  if( operation == 7 )
     {
     typedef itk::Image<unsigned short, ImageDimension> ShortImageType;
     typedef itk::CastImageFilter<ImageType, ShortImageType> CasterType;
@@ -136,262 +99,29 @@ int BinaryMorphology( int argc, char * argv[] )
     return EXIT_SUCCESS;
     }
 
+  // Bit-packed engine for large radii.
+  bool usePackedEngine = ( argc > 9 && atoi( argv[9] ) == 1 );
+  unsigned int type = ( argc > 6 )
+    ? static_cast<unsigned int>( atoi( argv[6] ) ) : 1;
 
-  if ( argc < 6 || atoi( argv[6] ) == 1 )
+  typename ImageType::Pointer output = NULL;
+  try
     {
-    typedef itk::BinaryBallStructuringElement<
-                        PixelType,
-                        ImageDimension> StructuringElementType;
-    StructuringElementType  element;
-    element.SetRadius( radius );
-    element.CreateStructuringElement();
-
-    switch ( operation )
-      {
-      case 0:
-        {
-        typedef itk::BinaryDilateImageFilter<ImageType, ImageType,
-          StructuringElementType >  FilterType;
-        typename FilterType::Pointer  filter = FilterType::New();
-        filter->SetKernel( element );
-        filter->SetInput( reader->GetOutput() );
-        filter->SetBackgroundValue( background );
-        filter->SetForegroundValue( foreground );
-        filter->Update();
-        typedef itk::ImageFileWriter<ImageType>  WriterType;
-        typename WriterType::Pointer writer = WriterType::New();
-        writer->SetInput( filter->GetOutput() );
-        writer->SetFileName( argv[3] );
-        writer->Update();
-        break;
-        }
-      case 1:
-        {
-        typedef itk::BinaryErodeImageFilter<ImageType, ImageType,
-          StructuringElementType >  FilterType;
-        typename FilterType::Pointer  filter = FilterType::New();
-        filter->SetKernel( element );
-        filter->SetInput( reader->GetOutput() );
-        filter->SetBackgroundValue( background );
-        filter->SetForegroundValue( foreground );
-        filter->Update();
-        typedef itk::ImageFileWriter<ImageType>  WriterType;
-        typename WriterType::Pointer writer = WriterType::New();
-        writer->SetInput( filter->GetOutput() );
-        writer->SetFileName( argv[3] );
-        writer->Update();
-        break;
-        }
-      case 2:
-        {
-        typedef itk::BinaryMorphologicalClosingImageFilter<ImageType, ImageType,
-          StructuringElementType >  FilterType;
-        typename FilterType::Pointer  filter = FilterType::New();
-        filter->SetKernel( element );
-        filter->SetInput( reader->GetOutput() );
-        filter->SetForegroundValue( foreground );
-        filter->Update();
-        typedef itk::ImageFileWriter<ImageType>  WriterType;
-        typename WriterType::Pointer writer = WriterType::New();
-        writer->SetInput( filter->GetOutput() );
-        writer->SetFileName( argv[3] );
-        writer->Update();
-        break;
-        }
-      case 3:
-        {
-        typedef itk::BinaryMorphologicalOpeningImageFilter<ImageType, ImageType,
-          StructuringElementType >  FilterType;
-        typename FilterType::Pointer  filter = FilterType::New();
-        filter->SetKernel( element );
-        filter->SetInput( reader->GetOutput() );
-        filter->SetBackgroundValue( background );
-        filter->SetForegroundValue( foreground );
-        filter->Update();
-        typedef itk::ImageFileWriter<ImageType>  WriterType;
-        typename WriterType::Pointer writer = WriterType::New();
-        writer->SetInput( filter->GetOutput() );
-        writer->SetFileName( argv[3] );
-        writer->Update();
-        break;
-        }
-      default:
-        {
-        std::cerr << "Invalid operation choice." << std::endl;
-        return EXIT_FAILURE;
-        }
-      }
+    output = BinaryMorphologyImage<ImageType>( reader->GetOutput(),
+      operation, radius, type, foreground, background, usePackedEngine );
     }
-  else if ( atoi( argv[6] ) == 0 )
+  catch( itk::ExceptionObject & excp )
     {
-    typedef itk::BinaryBoxStructuringElement<
-                        PixelType,
-                        ImageDimension>  StructuringElementType;
-    StructuringElementType element;
-    element.SetRadius( radius );
-    element.CreateStructuringElement();
-
-    switch ( operation )
-      {
-      case 0:
-        {
-        typedef itk::BinaryDilateImageFilter<ImageType, ImageType,
-          StructuringElementType >  FilterType;
-        typename FilterType::Pointer  filter = FilterType::New();
-        filter->SetKernel( element );
-        filter->SetInput( reader->GetOutput() );
-        filter->SetBackgroundValue( background );
-        filter->SetForegroundValue( foreground );
-        filter->Update();
-        typedef itk::ImageFileWriter<ImageType>  WriterType;
-        typename WriterType::Pointer writer = WriterType::New();
-        writer->SetInput( filter->GetOutput() );
-        writer->SetFileName( argv[3] );
-        writer->Update();
-        break;
-        }
-      case 1:
-        {
-        typedef itk::BinaryErodeImageFilter<ImageType, ImageType,
-          StructuringElementType >  FilterType;
-        typename FilterType::Pointer  filter = FilterType::New();
-        filter->SetKernel( element );
-        filter->SetInput( reader->GetOutput() );
-        filter->SetBackgroundValue( background );
-        filter->SetForegroundValue( foreground );
-        filter->Update();
-        typedef itk::ImageFileWriter<ImageType>  WriterType;
-        typename WriterType::Pointer writer = WriterType::New();
-        writer->SetInput( filter->GetOutput() );
-        writer->SetFileName( argv[3] );
-        writer->Update();
-        break;
-        }
-      case 2:
-        {
-        typedef itk::BinaryMorphologicalClosingImageFilter<ImageType, ImageType,
-          StructuringElementType >  FilterType;
-        typename FilterType::Pointer  filter = FilterType::New();
-        filter->SetKernel( element );
-        filter->SetInput( reader->GetOutput() );
-        filter->SetForegroundValue( foreground );
-        filter->Update();
-        typedef itk::ImageFileWriter<ImageType>  WriterType;
-        typename WriterType::Pointer writer = WriterType::New();
-        writer->SetInput( filter->GetOutput() );
-        writer->SetFileName( argv[3] );
-        writer->Update();
-        break;
-        }
-      case 3:
-        {
-        typedef itk::BinaryMorphologicalOpeningImageFilter<ImageType, ImageType,
-          StructuringElementType >  FilterType;
-        typename FilterType::Pointer  filter = FilterType::New();
-        filter->SetKernel( element );
-        filter->SetInput( reader->GetOutput() );
-        filter->SetBackgroundValue( background );
-        filter->SetForegroundValue( foreground );
-        filter->Update();
-        typedef itk::ImageFileWriter<ImageType>  WriterType;
-        typename WriterType::Pointer writer = WriterType::New();
-        writer->SetInput( filter->GetOutput() );
-        writer->SetFileName( argv[3] );
-        writer->Update();
-        break;
-        }
-      default:
-        {
-        std::cerr << "Invalid operation choice." << std::endl;
-        return EXIT_FAILURE;
-        }
-      }
+    std::cerr << excp.GetDescription() << std::endl;
+    return EXIT_FAILURE;
     }
-  else
-    {
-    typedef itk::BinaryDiamondStructuringElement<
-                        PixelType,
-                        ImageDimension> StructuringElementType;
-    StructuringElementType  element;
-    element.SetRadius( radius );
-    element.CreateStructuringElement();
 
-    switch ( operation )
-      {
-      case 0:
-        {
-        typedef itk::BinaryDilateImageFilter<ImageType, ImageType,
-          StructuringElementType >  FilterType;
-        typename FilterType::Pointer  filter = FilterType::New();
-        filter->SetKernel( element );
-        filter->SetInput( reader->GetOutput() );
-        filter->SetBackgroundValue( background );
-        filter->SetForegroundValue( foreground );
-        filter->Update();
-        typedef itk::ImageFileWriter<ImageType>  WriterType;
-        typename WriterType::Pointer writer = WriterType::New();
-        writer->SetInput( filter->GetOutput() );
-        writer->SetFileName( argv[3] );
-        writer->Update();
-        break;
-        }
-      case 1:
-        {
-        typedef itk::BinaryErodeImageFilter<ImageType, ImageType,
-          StructuringElementType >  FilterType;
-        typename FilterType::Pointer  filter = FilterType::New();
-        filter->SetKernel( element );
-        filter->SetInput( reader->GetOutput() );
-        filter->SetBackgroundValue( background );
-        filter->SetForegroundValue( foreground );
-        filter->Update();
-        typedef itk::ImageFileWriter<ImageType>  WriterType;
-        typename WriterType::Pointer writer = WriterType::New();
-        writer->SetInput( filter->GetOutput() );
-        writer->SetFileName( argv[3] );
-        writer->Update();
-        break;
-        }
-      case 2:
-        {
-        typedef itk::BinaryMorphologicalClosingImageFilter<ImageType, ImageType,
-          StructuringElementType >  FilterType;
-        typename FilterType::Pointer  filter = FilterType::New();
-        filter->SetKernel( element );
-        filter->SetInput( reader->GetOutput() );
-        filter->SetForegroundValue( foreground );
-        filter->Update();
-        typedef itk::ImageFileWriter<ImageType>  WriterType;
-        typename WriterType::Pointer writer = WriterType::New();
-        writer->SetInput( filter->GetOutput() );
-        writer->SetFileName( argv[3] );
-        writer->Update();
-        break;
-        }
-      case 3:
-        {
-        typedef itk::BinaryMorphologicalOpeningImageFilter<ImageType, ImageType,
-          StructuringElementType >  FilterType;
-        typename FilterType::Pointer  filter = FilterType::New();
-        filter->SetKernel( element );
-        filter->SetInput( reader->GetOutput() );
-        filter->SetBackgroundValue( background );
-        filter->SetForegroundValue( foreground );
-        filter->Update();
-        typedef itk::ImageFileWriter<ImageType>  WriterType;
-        typename WriterType::Pointer writer = WriterType::New();
-        writer->SetInput( filter->GetOutput() );
-        writer->SetFileName( argv[3] );
-        writer->Update();
-        break;
-        }
-      default:
-        {
-        std::cerr << "Invalid operation choice." << std::endl;
-        return EXIT_FAILURE;
-        }
-      }
-    }
+  typedef itk::ImageFileWriter<ImageType>  WriterType;
+  typename WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( output );
+  writer->SetFileName( argv[3] );
+  writer->Update();
+
   return EXIT_SUCCESS;
 }
 
@@ -799,7 +529,8 @@ int main( int argc, char *argv[] )
     {
     std::cerr << "Usage: " << std::endl;
     std::cerr << argv[0] << " imageDimension inputImage outputImage operation "
-      << "[radius] [type: box == 0, ball = 1, diamond = 2] [label]" << std::endl;
+      << "[radius] [type: box == 0, ball = 1, diamond = 2] [label] [background] "
+      << "[engine: itk = 0, packed = 1]" << std::endl;
     std::cerr << "  operation: " << std::endl;
     std::cerr << "    0. dilate" << std::endl;
     std::cerr << "    1. erode " << std::endl;
@@ -0,0 +1,175 @@
+#ifndef __BinaryMorphologyOperations_h
+#define __BinaryMorphologyOperations_h
+
+#include "itkBinaryBallStructuringElement.h"
+#include "itkBinaryBoxStructuringElement.h"
+#include "itkBinaryDiamondStructuringElement.h"
+#include "itkBinaryDilateImageFilter.h"
+#include "itkBinaryErodeImageFilter.h"
+#include "itkBinaryFillholeImageFilter.h"
+#include "itkBinaryMorphologicalClosingImageFilter.h"
+#include "itkBinaryMorphologicalOpeningImageFilter.h"
+#include "itkPackedBinaryMorphologyImageFilter.h"
+#include "itkVotingBinaryIterativeHoleFillingImageFilter.h"
+
+/**
+ * Dilates (0), erodes (1), closes (2) or opens (3) the input with the given
+ * structuring element.
+ */
+template<class TImage, class TStructuringElement>
+typename TImage::Pointer BinaryMorphologyImageWithElement(
+  const TImage *input, unsigned int operation,
+  const TStructuringElement & element,
+  typename TImage::PixelType foreground,
+  typename TImage::PixelType background )
+{
+  switch( operation )
+    {
+    case 0:
+      {
+      typedef itk::BinaryDilateImageFilter<TImage, TImage,
+        TStructuringElement> FilterType;
+      typename FilterType::Pointer filter = FilterType::New();
+      filter->SetKernel( element );
+      filter->SetInput( input );
+      filter->SetBackgroundValue( background );
+      filter->SetForegroundValue( foreground );
+      filter->Update();
+      return filter->GetOutput();
+      }
+    case 1:
+      {
+      typedef itk::BinaryErodeImageFilter<TImage, TImage,
+        TStructuringElement> FilterType;
+      typename FilterType::Pointer filter = FilterType::New();
+      filter->SetKernel( element );
+      filter->SetInput( input );
+      filter->SetBackgroundValue( background );
+      filter->SetForegroundValue( foreground );
+      filter->Update();
+      return filter->GetOutput();
+      }
+    case 2:
+      {
+      typedef itk::BinaryMorphologicalClosingImageFilter<TImage, TImage,
+        TStructuringElement> FilterType;
+      typename FilterType::Pointer filter = FilterType::New();
+      filter->SetKernel( element );
+      filter->SetInput( input );
+      filter->SetForegroundValue( foreground );
+      filter->Update();
+      return filter->GetOutput();
+      }
+    case 3:
+      {
+      typedef itk::BinaryMorphologicalOpeningImageFilter<TImage, TImage,
+        TStructuringElement> FilterType;
+      typename FilterType::Pointer filter = FilterType::New();
+      filter->SetKernel( element );
+      filter->SetInput( input );
+      filter->SetBackgroundValue( background );
+      filter->SetForegroundValue( foreground );
+      filter->Update();
+      return filter->GetOutput();
+      }
+    default:
+      {
+      itkGenericExceptionMacro( << "Invalid operation choice " << operation );
+      }
+    }
+  return NULL;
+}
+
+/**
+ * The operations of BinaryMorphology that map a binary image to a new
+ * image: dilate (0), erode (1), close (2), open (3), fill holes (5) and
+ * iterative hole filling (6).  The structuring element is a box (0), a ball
+ * (1) or a diamond (2) of the given radius.  Operations 0-3 run on the
+ * bit-packed engine if usePackedEngine is set.  Other operations throw.
+ */
+template<class TImage>
+typename TImage::Pointer BinaryMorphologyImage( const TImage *input,
+  unsigned int operation, unsigned int radius, unsigned int type,
+  typename TImage::PixelType foreground,
+  typename TImage::PixelType background, bool usePackedEngine )
+{
+  typedef typename TImage::PixelType PixelType;
+  const unsigned int ImageDimension = TImage::ImageDimension;
+
+  if( operation == 5 )
+    {
+    typedef itk::BinaryFillholeImageFilter<TImage> FilterType;
+    typename FilterType::Pointer filter = FilterType::New();
+    filter->SetInput( input );
+    filter->SetForegroundValue( foreground );
+    filter->SetFullyConnected( true );
+    filter->Update();
+    return filter->GetOutput();
+    }
+  else if( operation == 6 )
+    {
+    typedef itk::VotingBinaryIterativeHoleFillingImageFilter<TImage> FilterType;
+    typename FilterType::InputSizeType radii;
+    radii.Fill( radius );
+
+    typename FilterType::Pointer filter = FilterType::New();
+    filter->SetInput( input );
+    filter->SetForegroundValue( foreground );
+    filter->SetMajorityThreshold( 1 );  // 1 == default
+    filter->SetRadius( radii );
+    filter->SetMaximumNumberOfIterations( 100000000 );
+    filter->Update();
+    return filter->GetOutput();
+    }
+  else if( operation > 3 )
+    {
+    itkGenericExceptionMacro( << "Invalid operation choice " << operation );
+    }
+
+  if( usePackedEngine )
+    {
+    typedef itk::PackedBinaryMorphologyImageFilter<TImage, TImage> FilterType;
+    typename FilterType::Pointer filter = FilterType::New();
+    filter->SetInput( input );
+    filter->SetOperation( operation );
+    filter->SetStructuringElement( type );
+    filter->SetRadius( radius );
+    filter->SetForegroundValue( foreground );
+    filter->SetBackgroundValue( background );
+    filter->Update();
+    return filter->GetOutput();
+    }
+
+  if( type == 1 )
+    {
+    typedef itk::BinaryBallStructuringElement<PixelType, ImageDimension>
+      StructuringElementType;
+    StructuringElementType element;
+    element.SetRadius( radius );
+    element.CreateStructuringElement();
+    return BinaryMorphologyImageWithElement<TImage, StructuringElementType>(
+      input, operation, element, foreground, background );
+    }
+  else if( type == 0 )
+    {
+    typedef itk::BinaryBoxStructuringElement<PixelType, ImageDimension>
+      StructuringElementType;
+    StructuringElementType element;
+    element.SetRadius( radius );
+    element.CreateStructuringElement();
+    return BinaryMorphologyImageWithElement<TImage, StructuringElementType>(
+      input, operation, element, foreground, background );
+    }
+  else
+    {
+    typedef itk::BinaryDiamondStructuringElement<PixelType, ImageDimension>
+      StructuringElementType;
+    StructuringElementType element;
+    element.SetRadius( radius );
+    element.CreateStructuringElement();
+    return BinaryMorphologyImageWithElement<TImage, StructuringElementType>(
+      input, operation, element, foreground, background );
+    }
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include "itkImageRegionIterator.h"
 #include "itkImageRegionIteratorWithIndex.h"
 
+#include "itkLabelOrderStatisticsCalculator.h"
 #include "itkLabelStatisticsImageFilter.h"
 
 #include <fstream>
@@ -12,6 +13,10 @@ template <unsigned int ImageDimension>
 int CalculateFirstOrderStatistics( int argc, char *argv[] )
 {
 
+  // The order statistics do not depend on the number of threads, so they
+  // keep the default while the other filters run on a single thread.
+  const unsigned int numberOfThreads =
+    itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
   itk::MultiThreader::SetGlobalDefaultNumberOfThreads( 1 );
 
   typedef int PixelType;
@@ -125,7 +130,27 @@ int CalculateFirstOrderStatistics( int argc, char *argv[] )
   sum = stats->GetSum( 1 );
   sigma = stats->GetSigma( 1 );
   variance = sigma * sigma;
-  median = stats->GetMedian( 1 );
+
+  /**
+   * Exact order statistics of the masked voxels, all read from a single
+   * sort.
+   */
+  typedef itk::Statistics::LabelOrderStatisticsCalculator<RealImageType, ImageType>
+    OrderStatisticsCalculatorType;
+  typename OrderStatisticsCalculatorType::Pointer orderStatistics =
+    OrderStatisticsCalculatorType::New();
+  orderStatistics->SetImage( imageReader->GetOutput() );
+  orderStatistics->SetLabelImage( mask );
+  orderStatistics->SetNumberOfThreads( numberOfThreads );
+  orderStatistics->Compute();
+
+  if( !orderStatistics->HasLabel( 1 ) )
+    {
+    std::cerr << "ERROR:  No voxels with the label." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  median = orderStatistics->GetQuantile( 1, 0.5 );
 
   kurtosis = 0.0;
   skewness = 0.0;
@@ -147,8 +172,8 @@ int CalculateFirstOrderStatistics( int argc, char *argv[] )
   skewness /= ( ( N - 1 ) * variance * sigma );
   kurtosis /= ( ( N - 1 ) * variance * variance );
 
-		double fifthPercentileValue = 0.0;
-		double ninetyFifthPercentileValue = 0.0;
+		double fifthPercentileValue = orderStatistics->GetQuantile( 1, 0.05 );
+		double ninetyFifthPercentileValue = orderStatistics->GetQuantile( 1, 0.95 );
 
 		double fifthPercentileMean = 0.0;
 		double fifthN = 0.0;
@@ -185,12 +210,10 @@ int CalculateFirstOrderStatistics( int argc, char *argv[] )
 						}
 				str.close();
 
-				fifthPercentileValue = histogram->Quantile( 0, 0.05 );
-				ninetyFifthPercentileValue = histogram->Quantile( 0, 0.95 );
     if( argc > 7 )
       {
       float quantile = atof( argv[7] );
-      quantileValue = histogram->Quantile( 0, quantile );
+      quantileValue = orderStatistics->GetQuantile( 1, quantile );
       }
 
 				entropy = 0.0;
@@ -206,6 +229,10 @@ int CalculateFirstOrderStatistics( int argc, char *argv[] )
 
 				for ( ItM.GoToBegin(), ItI.GoToBegin(); !ItM.IsAtEnd(); ++ItM, ++ItI )
 						{
+						if ( ItM.Get() != 1 )
+								{
+								continue;
+								}
 						RealType value = ItI.Get();
 						if ( value <= fifthPercentileValue )
 								{
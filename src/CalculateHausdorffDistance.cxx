@@ -1,9 +1,9 @@
 #include <stdio.h>
 
-#include "itkHausdorffDistanceImageFilter.h"
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageRegionIterator.h"
+#include "itkLabelSurfaceDistanceCalculator.h"
 
 
 template <unsigned int ImageDimension>
@@ -24,75 +24,82 @@ int CalculateHausdorffDistance( int argc, char *argv[] )
 
   long unsigned int differences = 0;
 
-  typedef itk::HausdorffDistanceImageFilter<ImageType, ImageType> HausdorfferType;
-  typename HausdorfferType::Pointer hausdorffer = HausdorfferType::New();
+  // The objects are the nonzero voxels of each image or, if a label is
+  // given, the voxels with that label.
 
-  if ( argc <= 4 )
+  bool useLabel = ( argc > 4 );
+  PixelType label = 0;
+  if( useLabel )
     {
-    hausdorffer->SetInput1( reader1->GetOutput() );
-    hausdorffer->SetInput2( reader2->GetOutput() );
+    label = static_cast<PixelType>( atoi( argv[4] ) );
+    }
+
+  typename ImageType::Pointer image1 = reader1->GetOutput();
+  typename ImageType::Pointer image2 = reader2->GetOutput();
 
-    itk::ImageRegionIterator<ImageType> It1( reader1->GetOutput(), reader1->GetOutput()->GetLargestPossibleRegion() );  
-    itk::ImageRegionIterator<ImageType> It2( reader2->GetOutput(), reader2->GetOutput()->GetLargestPossibleRegion() );  
-    for ( It2.GoToBegin(), It1.GoToBegin(); !It2.IsAtEnd(); ++It2, ++It1 )
+  itk::ImageRegionIterator<ImageType> It1( image1, image1->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<ImageType> It2( image2, image2->GetLargestPossibleRegion() );
+  for ( It1.GoToBegin(), It2.GoToBegin(); !It1.IsAtEnd(); ++It1, ++It2 )
+    {
+    if ( useLabel ? ( ( It1.Get() == label ) != ( It2.Get() == label ) )
+      : ( It1.Get() != It2.Get() ) )
       {
-      if ( It1.Get() != It2.Get() )
-        {
-        differences++;
-        }
+      differences++;
       }
     }
-  else
-    {
-
-    typename ImageType::Pointer image1 = ImageType::New();
-    image1->SetRegions( reader1->GetOutput()->GetLargestPossibleRegion() );
-    image1->SetOrigin( reader1->GetOutput()->GetOrigin() );
-    image1->SetSpacing( reader1->GetOutput()->GetSpacing() );
-    image1->Allocate();
-    image1->FillBuffer( 0 );
 
-    itk::ImageRegionIterator<ImageType> ItR1( reader1->GetOutput(), reader1->GetOutput()->GetLargestPossibleRegion() );  
-    itk::ImageRegionIterator<ImageType> It1( image1, image1->GetLargestPossibleRegion() );  
-    for ( It1.GoToBegin(), ItR1.GoToBegin(); !It1.IsAtEnd(); ++It1, ++ItR1 )
+  // The calculator compares against a single label, so without one the
+  // images are binarized in place once the differences are counted.
+  if ( !useLabel )
+    {
+    label = 1;
+    for ( It1.GoToBegin(), It2.GoToBegin(); !It1.IsAtEnd(); ++It1, ++It2 )
       {
-      if ( ItR1.Get() == static_cast<PixelType>( atoi( argv[4] ) ) )
-        {
-        It1.Set( 1 );
-        }
+      It1.Set( It1.Get() != 0 ? 1 : 0 );
+      It2.Set( It2.Get() != 0 ? 1 : 0 );
       }
+    }
 
-    typename ImageType::Pointer image2 = ImageType::New();
-    image2->SetRegions( reader2->GetOutput()->GetLargestPossibleRegion() );
-    image2->SetOrigin( reader2->GetOutput()->GetOrigin() );
-    image2->SetSpacing( reader2->GetOutput()->GetSpacing() );
-    image2->Allocate();
-    image2->FillBuffer( 0 );
+  typedef itk::LabelSurfaceDistanceCalculator<ImageType> CalculatorType;
+  typename CalculatorType::Pointer calculator = CalculatorType::New();
+  calculator->SetInput1( image1 );
+  calculator->SetInput2( image2 );
+  calculator->SetLabel1( label );
+  calculator->SetLabel2( label );
+
+  std::cout << "Pixel-wise difference = " << differences << std::endl;
 
-    itk::ImageRegionIterator<ImageType> ItR2( reader2->GetOutput(), reader2->GetOutput()->GetLargestPossibleRegion() );  
-    itk::ImageRegionIterator<ImageType> It2( image2, image2->GetLargestPossibleRegion() );  
-    for ( It2.GoToBegin(), ItR2.GoToBegin(); !It2.IsAtEnd(); ++It2, ++ItR2 )
+  if ( argc > 5 )
+    {
+    // Only decide whether the Hausdorff distance exceeds the threshold,
+    // which stops at the first surface voxel found farther away.
+    typename CalculatorType::RealType threshold = atof( argv[5] );
+    try
       {
-      if ( ItR2.Get() == static_cast<PixelType>( atoi( argv[3] ) ) )
-        {
-        It2.Set( 1 );
-        }
+      bool exceeds = calculator->HausdorffDistanceExceeds( threshold );
+      std::cout << "Hausdorff distance > " << threshold << " = "
+        << exceeds << std::endl;
       }
-    for ( It2.GoToBegin(), It1.GoToBegin(); !It2.IsAtEnd(); ++It2, ++It1 )
+    catch( itk::ExceptionObject & excp )
       {
-      if ( It1.Get() != It2.Get() )
-        {
-        differences++;
-        }
+      std::cerr << excp << std::endl;
+      return EXIT_FAILURE;
       }
+    return 0;
+    }
 
-    hausdorffer->SetInput1( image1 );
-    hausdorffer->SetInput2( image2 );
-    }        
-
-  hausdorffer->Update();
-  std::cout << "Pixel-wise difference = " << differences << std::endl;
-  std::cout << "Hausdorff distance = " << hausdorffer->GetHausdorffDistance() << std::endl;  
+  try
+    {
+    calculator->Compute();
+    }
+  catch( itk::ExceptionObject & excp )
+    {
+    std::cerr << excp << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "Hausdorff distance = " << calculator->GetHausdorffDistance() << std::endl;
+  std::cout << "95% Hausdorff distance = " << calculator->GetPercentileHausdorffDistance( 0.95 ) << std::endl;
+  std::cout << "Mean surface distance = " << calculator->GetMeanSurfaceDistance() << std::endl;
 
   return 0;
 }
@@ -101,17 +108,17 @@ int main( int argc, char *argv[] )
 {
   if ( argc < 4 )
     {
-    std::cerr << "Usage: " << argv[0] << " imageDimension inputImage1 inputImage2 [label]"<< std::endl;
+    std::cerr << "Usage: " << argv[0] << " imageDimension inputImage1 inputImage2 [label] [hausdorffThreshold]"<< std::endl;
     exit( 1 );
     }
 
-  switch( atoi( argv[1] ) ) 
+  switch( atoi( argv[1] ) )
    {
    case 2:
-     CalculateHausdorffDistance<2>( argc, argv );
+     return CalculateHausdorffDistance<2>( argc, argv );
      break;
    case 3:
-     CalculateHausdorffDistance<3>( argc, argv );
+     return CalculateHausdorffDistance<3>( argc, argv );
      break;
    default:
       std::cerr << "Unsupported dimension" << std::endl;
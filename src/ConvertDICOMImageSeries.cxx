@@ -3,6 +3,7 @@
 #include "itkImageSeriesReader.h"
 #include "itkGDCMSeriesFileNames.h"
 #include "itkImageFileWriter.h"
+#include "itkParallelDICOMSeriesReader.h"
 
 template<unsigned int ImageDimension>
 int dicom( int argc, char* argv[] )
@@ -42,11 +43,69 @@ int dicom( int argc, char* argv[] )
 }
 
 
+/**
+ * Volumes are read with ParallelDICOMSeriesReader, which decodes the slices
+ * in parallel and only the slices of each requested slab, so the writer
+ * can stream the volume in pieces.  Multi-frame (enhanced) files are read
+ * with ImageSeriesReader instead, which keeps all their frames.
+ */
+int dicomVolume( int argc, char* argv[] )
+{
+  typedef itk::Image<int, 3> ImageType;
+  typedef itk::ParallelDICOMSeriesReader<ImageType> ReaderType;
+
+  itk::GDCMSeriesFileNames::Pointer names = itk::GDCMSeriesFileNames::New();
+  names->SetDirectory( argv[2] );
+
+  const ReaderType::FileNamesContainer fileNames = names->GetInputFileNames();
+
+  ReaderType::SliceHeaderType header;
+  if( !fileNames.empty() &&
+    ReaderType::ReadSliceHeader( fileNames[0], header ) &&
+    header.NumberOfFrames > 1 )
+    {
+    return dicom<3>( argc, argv );
+    }
+
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileNames( fileNames );
+  if( argc > 5 )
+    {
+    reader->SetNumberOfThreads( atoi( argv[5] ) );
+    }
+  std::cout << names;
+
+  typedef itk::ImageFileWriter<ImageType> WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetFileName( argv[3] );
+  writer->SetInput( reader->GetOutput() );
+  if( argc > 4 )
+    {
+    writer->SetNumberOfStreamDivisions( atoi( argv[4] ) );
+    }
+
+  try
+    {
+    reader->UpdateOutputInformation();
+    reader->GetOutput()->Print( std::cout );
+    writer->Update();
+    }
+  catch ( itk::ExceptionObject &ex )
+    {
+    std::cout << ex;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
+
 int main( int argc, char *argv[] )
 {
   if ( argc < 4 )
     {
-    std::cerr << "Usage: " << argv[0] << " ImageDimension DicomDirectory OutputImage\n";
+    std::cerr << "Usage: " << argv[0] << " ImageDimension DicomDirectory OutputImage "
+      << "[numberOfStreamDivisions=1] [numberOfThreads]\n";
+    std::cerr << "  (the optional arguments apply to 3-D volumes)\n";
     exit( 1 );
     }
 
@@ -56,7 +115,7 @@ int main( int argc, char *argv[] )
      dicom<2>( argc, argv );
      break;
    case 3:
-     dicom<3>( argc, argv );
+     dicomVolume( argc, argv );
      break;
    case 4:
      dicom<4>( argc, argv );
@@ -1,5 +1,5 @@
-#include "itkImageRegionIteratorWithIndex.h"
-#include "itkVectorFieldGradientImageFunction.h"
+#include "itkDeformationGradientCalculator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkVector.h"
@@ -55,33 +55,29 @@ int CreateDirectionalStrainImages( int argc, char *argv[] )
     mask = maskreader->GetOutput();
     }
 
-  typename RealImageType::Pointer lagrangian = RealImageType::New();
-  lagrangian->SetOrigin( reader->GetOutput()->GetOrigin() );
-  lagrangian->SetSpacing( reader->GetOutput()->GetSpacing() );
-  lagrangian->SetRegions( reader->GetOutput()->GetLargestPossibleRegion() );
-  lagrangian->Allocate();
-  lagrangian->FillBuffer( 0 );
-
-  typename RealImageType::Pointer eulerian = RealImageType::New();
-  eulerian->SetOrigin( reader->GetOutput()->GetOrigin() );
-  eulerian->SetSpacing( reader->GetOutput()->GetSpacing() );
-  eulerian->SetRegions( reader->GetOutput()->GetLargestPossibleRegion() );
-  eulerian->Allocate();
-  eulerian->FillBuffer( 0 );
-
-
-
-  /**
-   * Evaluate various measures at the specified point
-   */
-  typedef itk::VectorFieldGradientImageFunction<VectorImageType> FunctionType;
-  typename FunctionType::Pointer function = FunctionType::New();
-  function->SetInputImage( reader->GetOutput() );
+  typedef itk::DeformationGradientCalculator<VectorImageType, MaskImageType>
+    CalculatorType;
+  typename CalculatorType::Pointer calculator = CalculatorType::New();
+  calculator->SetDisplacementField( reader->GetOutput() );
+  // The derivatives stay in index space, as the tool always computed them.
+  calculator->UseImageDirectionOff();
+  calculator->SetMaskImage( mask );
+  calculator->SetComputeJacobianDeterminant( false );
+  calculator->SetComputeDirectionalStrains( true );
+  if( directions )
+    {
+    calculator->SetDirectionField( directions );
+    }
+  else
+    {
+    calculator->SetStrainComponents( whichComponent[0], whichComponent[1] );
+    }
+  calculator->Compute();
 
-  itk::ImageRegionIteratorWithIndex<RealImageType> ItL
-    ( lagrangian, lagrangian->GetLargestPossibleRegion() );
-  itk::ImageRegionIteratorWithIndex<RealImageType> ItE
-    ( eulerian, eulerian->GetLargestPossibleRegion() );
+  typename RealImageType::Pointer lagrangian
+    = calculator->GetLagrangianDirectionalStrainImage();
+  typename RealImageType::Pointer eulerian
+    = calculator->GetEulerianDirectionalStrainImage();
 
   RealType N = 0.0;
   RealType mean1 = 0.0;
@@ -89,39 +85,20 @@ int CreateDirectionalStrainImages( int argc, char *argv[] )
   RealType mean2 = 0.0;
   RealType var2 = 0.0;
 
-  ItL.GoToBegin();
-  ItE.GoToBegin();
+  itk::ImageRegionConstIteratorWithIndex<RealImageType> ItL
+    ( lagrangian, lagrangian->GetLargestPossibleRegion() );
+  itk::ImageRegionConstIteratorWithIndex<RealImageType> ItE
+    ( eulerian, eulerian->GetLargestPossibleRegion() );
 
-  while ( !ItL.IsAtEnd() )
+  for( ItL.GoToBegin(), ItE.GoToBegin(); !ItL.IsAtEnd(); ++ItL, ++ItE )
     {
     if ( mask && mask->GetPixel( ItL.GetIndex() ) == 0 )
       {
-      ++ItL;
-      ++ItE;
       continue;
       }
 
-    RealType l, e;
-
-    if( directions )
-      {
-      l = function->EvaluateLagrangianDirectionalStrainAtIndex( ItL.GetIndex(),
-        directions->GetPixel( ItL.GetIndex() ) );
-      e = function->EvaluateEulerianDirectionalStrainAtIndex( ItL.GetIndex(),
-        directions->GetPixel( ItL.GetIndex() ) );
-      }
-    else
-      {
-      typename FunctionType::MatrixType L
-        = function->EvaluateLagrangianStrainTensorAtIndex( ItL.GetIndex() );
-      typename FunctionType::MatrixType E
-        = function->EvaluateEulerianStrainTensorAtIndex( ItL.GetIndex() );
-      l = L( whichComponent[0], whichComponent[1] );
-      e = E( whichComponent[0], whichComponent[1] );
-      }
-
-    ItL.Set( l );
-    ItE.Set( e );
+    RealType l = ItL.Get();
+    RealType e = ItE.Get();
 
     N += 1.0;
     mean1 = mean1*( N - 1.0 )/N + l/N;
@@ -131,8 +108,6 @@ int CreateDirectionalStrainImages( int argc, char *argv[] )
       var1 = var1*( N - 1.0 )/N + ( l - mean1 )*( l - mean1 )/( N - 1.0 );
       var2 = var2*( N - 1.0 )/N + ( e - mean2 )*( e - mean2 )/( N - 1.0 );
       }
-    ++ItL;
-    ++ItE;
     }
 
   std::cout << argv[2] << ": lagrangian mean = " << mean1 << ", std1 = " << sqrt( var1 ) << std::endl;
@@ -1,5 +1,4 @@
-#include "itkImageRegionIteratorWithIndex.h"
-#include "itkVectorFieldGradientImageFunction.h"
+#include "itkDeformationGradientCalculator.h"
 #include "itkVectorMagnitudeImageFilter.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
@@ -24,129 +23,42 @@ int CreatePrincipalStrainImages( int argc, char *argv[] )
   reader->SetFileName( argv[2] );
   reader->Update();
 
-  typename MaskImageType::Pointer mask = MaskImageType::New();
-  if ( argc < 6 )
-    {
-    mask->SetOrigin( reader->GetOutput()->GetOrigin() );
-    mask->SetSpacing( reader->GetOutput()->GetSpacing() );
-    mask->SetRegions( reader->GetOutput()->GetLargestPossibleRegion() );
-    mask->Allocate();
-    mask->FillBuffer( 1 );
-    }
-  else
+  typedef itk::DeformationGradientCalculator<VectorImageType, MaskImageType>
+    CalculatorType;
+  typename CalculatorType::Pointer calculator = CalculatorType::New();
+  calculator->SetDisplacementField( reader->GetOutput() );
+  // The derivatives stay in index space, as the tool always computed them.
+  calculator->UseImageDirectionOff();
+  calculator->SetComputeJacobianDeterminant( false );
+  calculator->SetComputePrincipalStrains( true );
+
+  if ( argc > 5 )
     {
     typedef itk::ImageFileReader<MaskImageType> MaskReaderType;
     typename MaskReaderType::Pointer maskreader = MaskReaderType::New();
     maskreader->SetFileName( argv[5] );
     maskreader->Update();
-    mask = maskreader->GetOutput();
+    calculator->SetMaskImage( maskreader->GetOutput() );
     }
-
-  typename VectorImageType::Pointer strain1 = VectorImageType::New();
-  strain1->SetOrigin( reader->GetOutput()->GetOrigin() );
-  strain1->SetSpacing( reader->GetOutput()->GetSpacing() );
-  strain1->SetRegions( reader->GetOutput()->GetLargestPossibleRegion() );
-  strain1->Allocate();
-  typename VectorImageType::Pointer strain2 = VectorImageType::New();
-  strain2->SetOrigin( reader->GetOutput()->GetOrigin() );
-  strain2->SetSpacing( reader->GetOutput()->GetSpacing() );
-  strain2->SetRegions( reader->GetOutput()->GetLargestPossibleRegion() );
-  strain2->Allocate();
-  typename VectorImageType::Pointer strain3 = VectorImageType::New();
-  strain3->SetOrigin( reader->GetOutput()->GetOrigin() );
-  strain3->SetSpacing( reader->GetOutput()->GetSpacing() );
-  strain3->SetRegions( reader->GetOutput()->GetLargestPossibleRegion() );
-  strain3->Allocate();
-
-  VectorType V;
-  V.Fill( 0 );
-  strain1->FillBuffer( V );
-  strain2->FillBuffer( V );
-  strain3->FillBuffer( V );
+  calculator->Compute();
 
   /**
-   * Evaluate various measures at the specified point
+   * The principal strains are written largest first, as 1, 2, 3 in 3-D
+   * and as 2, 3 in 2-D.
    */
-  typedef itk::VectorFieldGradientImageFunction<VectorImageType> FunctionType;
-  typename FunctionType::Pointer function = FunctionType::New();
-  function->SetInputImage( reader->GetOutput() );
-
-  typedef itk::DecomposeTensorFunction<typename FunctionType::MatrixType> DecomposerType;
-  typename DecomposerType::Pointer decomposer = DecomposerType::New();
-
-  itk::ImageRegionIteratorWithIndex<MaskImageType> ItM
-    ( mask, mask->GetLargestPossibleRegion() );
-  itk::ImageRegionIteratorWithIndex<VectorImageType> ItS1
-    ( strain1, strain1->GetLargestPossibleRegion() );
-  itk::ImageRegionIteratorWithIndex<VectorImageType> ItS2
-    ( strain2, strain2->GetLargestPossibleRegion() );
-  itk::ImageRegionIteratorWithIndex<VectorImageType> ItS3
-    ( strain3, strain3->GetLargestPossibleRegion() );
-
-  RealType N = 0.0;
-  RealType mean1 = 0.0;
-  RealType var1 = 0.0;
-  RealType mean2 = 0.0;
-  RealType var2 = 0.0;
-  RealType mean3 = 0.0;
-  RealType var3 = 0.0;
-
-  ItM.GoToBegin();
-  ItS1.GoToBegin();
-  ItS2.GoToBegin();
-  ItS3.GoToBegin();
-
-  while ( !ItM.IsAtEnd() )
+  typename VectorImageType::Pointer strain1 = NULL;
+  typename VectorImageType::Pointer strain2 = NULL;
+  typename VectorImageType::Pointer strain3 = NULL;
+  if ( ImageDimension == 3 )
     {
-    if ( ItM.Get() == 0 )
-      {
-      ++ItM;
-      ++ItS1;
-      ++ItS2;
-      ++ItS3;
-      continue;
-      }
-    typename FunctionType::MatrixType E
-      = function->EvaluateLagrangianStrainTensorAtIndex( ItM.GetIndex() );
-    typename FunctionType::MatrixType D;
-    typename FunctionType::MatrixType V;
-    decomposer->EvaluateSymmetricEigenDecomposition( E, D, V );
-    VectorType P1;  P1.Fill( 0 );
-    VectorType P2;
-    VectorType P3;
-    for ( unsigned int i = 0; i < ImageDimension; i++ )
-      {
-      if ( ImageDimension == 3 )
-        {
-        P1[i] = D[2][2]*V[i][2];
-        }
-      P2[i] = D[1][1]*V[i][1];
-      P3[i] = D[0][0]*V[i][0];
-      }
-    ItS1.Set( P1 );
-    ItS2.Set( P2 );
-    ItS3.Set( P3 );
-
-    N += 1.0;
-    if ( ImageDimension == 3 )
-      {
-      mean1 = mean1*( N - 1.0 )/N + D[2][2]/N;
-      }
-    mean2 = mean2*( N - 1.0 )/N + D[1][1]/N;
-    mean3 = mean3*( N - 1.0 )/N + D[0][0]/N;
-    if ( N > 1.0 )
-      {
-      if ( ImageDimension == 3 )
-        {
-        var1 = var1*( N - 1.0 )/N + ( D[2][2] - mean1 )*( D[2][2] - mean1 )/( N - 1.0 );
-        }
-      var2 = var2*( N - 1.0 )/N + ( D[1][1] - mean2 )*( D[1][1] - mean2 )/( N - 1.0 );
-      var3 = var3*( N - 1.0 )/N + ( D[0][0] - mean3 )*( D[0][0] - mean3 )/( N - 1.0 );
-      }
-    ++ItM;
-    ++ItS1;
-    ++ItS2;
-    ++ItS3;
+    strain1 = calculator->GetPrincipalStrainImage( 0 );
+    strain2 = calculator->GetPrincipalStrainImage( 1 );
+    strain3 = calculator->GetPrincipalStrainImage( 2 );
+    }
+  else
+    {
+    strain2 = calculator->GetPrincipalStrainImage( 0 );
+    strain3 = calculator->GetPrincipalStrainImage( 1 );
     }
 
   bool magnitudeOnly = true;
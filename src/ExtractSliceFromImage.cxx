@@ -4,6 +4,13 @@
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkExtractImageFilter.h"
+#include "itkNumericSeriesFileNames.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Common.h"
 
 template <unsigned int ImageDimension>
 int ExtractSliceFromImage( int argc, char *argv[] )
@@ -16,29 +23,86 @@ int ExtractSliceFromImage( int argc, char *argv[] )
   typedef itk::ImageFileReader<ImageType> ReaderType;
   typename ReaderType::Pointer reader = ReaderType::New();
   reader->SetFileName( argv[2] );
+  reader->UpdateOutputInformation();
+
+  const unsigned int direction = atoi( argv[4] );
+  std::vector<int> slices = ConvertVector<int>( std::string( argv[5] ) );
+
+  const typename ImageType::RegionType largestRegion
+    = reader->GetOutput()->GetLargestPossibleRegion();
+  if( direction >= ImageDimension )
+    {
+    std::cerr << "The direction must be less than " << ImageDimension
+      << "." << std::endl;
+    return EXIT_FAILURE;
+    }
+  for( unsigned int n = 0; n < slices.size(); n++ )
+    {
+    if( slices[n] < largestRegion.GetIndex()[direction] ||
+      slices[n] >= largestRegion.GetIndex()[direction] + static_cast<int>(
+      largestRegion.GetSize()[direction] ) )
+      {
+      std::cerr << "Slice " << slices[n] << " is outside the image."
+        << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  if( slices.size() > 1 &&
+    std::string( argv[3] ).find( '%' ) == std::string::npos )
+    {
+    std::cerr << "Several slices need an output file name format, "
+      << "e.g. slice%03d.nii.gz." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  /**
+   * Only the slab spanned by the slices is read, in a single pass, through
+   * the streaming path of the reader.  ImageIOs that cannot stream read the
+   * whole image instead.
+   */
+  const int firstSlice = *std::min_element( slices.begin(), slices.end() );
+  const int lastSlice = *std::max_element( slices.begin(), slices.end() );
+
+  typename ImageType::RegionType slabRegion = largestRegion;
+  slabRegion.SetIndex( direction, firstSlice );
+  slabRegion.SetSize( direction, lastSlice - firstSlice + 1 );
+
+  reader->GetOutput()->SetRequestedRegion( slabRegion );
   reader->Update();
 
-  typename ImageType::RegionType region;
-  typename ImageType::RegionType::SizeType size = reader->GetOutput()->GetRequestedRegion().GetSize();
-  size[atoi( argv[4] )] = 0;
-  typename ImageType::IndexType index;
-  index.Fill( 0 );
-  index[atoi( argv[4] )] = atoi( argv[5] );
-  region.SetIndex( index );
-  region.SetSize( size );
-
-  typedef itk::ExtractImageFilter<ImageType, SliceType> ExtracterType;
-  typename ExtracterType::Pointer extracter = ExtracterType::New();
-  extracter->SetInput( reader->GetOutput() );
-  extracter->SetExtractionRegion( region );
-  extracter->SetDirectionCollapseToIdentity();
-  extracter->Update();
-
-  typedef itk::ImageFileWriter<SliceType> WriterType;
-  typename WriterType::Pointer writer = WriterType::New();
-  writer->SetFileName( argv[3] );
-  writer->SetInput( extracter->GetOutput() );
-  writer->Update();
+  typename ImageType::Pointer slab = reader->GetOutput();
+  slab->DisconnectPipeline();
+
+  for( unsigned int n = 0; n < slices.size(); n++ )
+    {
+    typename ImageType::RegionType region = largestRegion;
+    region.SetIndex( direction, slices[n] );
+    region.SetSize( direction, 0 );
+
+    typedef itk::ExtractImageFilter<ImageType, SliceType> ExtracterType;
+    typename ExtracterType::Pointer extracter = ExtracterType::New();
+    extracter->SetInput( slab );
+    extracter->SetExtractionRegion( region );
+    extracter->SetDirectionCollapseToIdentity();
+    extracter->Update();
+
+    std::string fileName = std::string( argv[3] );
+    if( slices.size() > 1 )
+      {
+      itk::NumericSeriesFileNames::Pointer fileNamesCreator =
+        itk::NumericSeriesFileNames::New();
+      fileNamesCreator->SetStartIndex( slices[n] );
+      fileNamesCreator->SetEndIndex( slices[n] );
+      fileNamesCreator->SetSeriesFormat( argv[3] );
+      fileName = fileNamesCreator->GetFileNames()[0];
+      }
+
+    typedef itk::ImageFileWriter<SliceType> WriterType;
+    typename WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName( fileName.c_str() );
+    writer->SetInput( extracter->GetOutput() );
+    writer->Update();
+    }
 
   return 0;
 }
@@ -48,6 +112,8 @@ int main( int argc, char *argv[] )
   if ( argc != 6 )
     {
     std::cout << "Usage: " << argv[0] << " imageDimension inputImage outputSlice direction(e.g. 0, 1, 2) slice_number" << std::endl;
+    std::cout << "  Several slices, e.g. 10x20x30, are read in one pass and written "
+      << "with outputSlice as a format, e.g. slice%03d.nii.gz." << std::endl;
     exit( 1 );
     }
 
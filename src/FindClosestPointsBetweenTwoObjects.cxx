@@ -1,17 +1,13 @@
 #include <stdio.h>
 
-#include "itkBinaryThresholdImageFilter.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkImageRegionIteratorWithIndex.h"
-#include "itkSignedMaurerDistanceMapImageFilter.h"
+#include "itkLabelSurfaceDistanceCalculator.h"
 
 template <unsigned int ImageDimension>
 int FindClosestPointsBetweenTwoObjects( int argc, char *argv[] )
 {
-  typedef float PixelType;
-  typedef itk::Image<PixelType, ImageDimension> ImageType;
-
   typedef int LabelType;
   typedef itk::Image<LabelType, ImageDimension> MaskImageType;
 
@@ -37,68 +33,75 @@ int FindClosestPointsBetweenTwoObjects( int argc, char *argv[] )
   reader2->SetFileName( argv[3] );
   reader2->Update();
 
-  typedef itk::BinaryThresholdImageFilter<MaskImageType, MaskImageType> ThresholderType;
-
-  typename ThresholderType::Pointer thresholder1 = ThresholderType::New();
-  thresholder1->SetInput( reader1->GetOutput() );
-  thresholder1->SetLowerThreshold( label1 );
-  thresholder1->SetUpperThreshold( label1 );
-  thresholder1->SetInsideValue( 1 );
-  thresholder1->SetOutsideValue( 0 );
-
-  typename ThresholderType::Pointer thresholder2 = ThresholderType::New();
-  thresholder2->SetInput( reader2->GetOutput() );
-  thresholder2->SetLowerThreshold( label2 );
-  thresholder2->SetUpperThreshold( label2 );
-  thresholder2->SetInsideValue( 1 );
-  thresholder2->SetOutsideValue( 0 );
-
-  typedef itk::SignedMaurerDistanceMapImageFilter<MaskImageType, ImageType> FilterType;
-
-  typename FilterType::Pointer filter1 = FilterType::New();
-  filter1->SetInput( thresholder1->GetOutput() );
-  filter1->SetSquaredDistance( false );
-  filter1->SetUseImageSpacing( true );
-  filter1->SetInsideIsPositive( false );
-  filter1->Update();
-
-  typename FilterType::Pointer filter2 = FilterType::New();
-  filter2->SetInput( thresholder2->GetOutput() );
-  filter2->SetSquaredDistance( false );
-  filter2->SetUseImageSpacing( true );
-  filter2->SetInsideIsPositive( false );
-  filter2->Update();
-
-  typename ImageType::PixelType minDistance = itk::NumericTraits<typename ImageType::PixelType>::max();
-
-  itk::ImageRegionIteratorWithIndex<ImageType> ItF(
-    filter1->GetOutput(), filter1->GetOutput()->GetLargestPossibleRegion() );
-  itk::ImageRegionIteratorWithIndex<MaskImageType> ItM(
-    thresholder2->GetOutput(), thresholder2->GetOutput()->GetLargestPossibleRegion() );
-  for( ItF.GoToBegin(), ItM.GoToBegin(); !ItF.IsAtEnd(); ++ItF, ++ItM )
-    {
-    if( ItF.Get() < minDistance && ItM.Get() == 1 )
-      {
-      minDistance = ItF.Get();
-      }
-    }
-
   typename MaskImageType::Pointer output = MaskImageType::New();
   output->CopyInformation( reader2->GetOutput() );
   output->SetRegions( reader2->GetOutput()->GetLargestPossibleRegion() );
   output->Allocate();
   output->FillBuffer( 0 );
 
-  itk::ImageRegionIteratorWithIndex<MaskImageType> ItO(
-    output, output->GetLargestPossibleRegion() );
-  for( ItF.GoToBegin(), ItM.GoToBegin(), ItO.GoToBegin(); !ItF.IsAtEnd(); ++ItF, ++ItM, ++ItO )
+  // Overlapping objects touch everywhere they overlap.
+  bool objectsOverlap = false;
+  if( reader1->GetOutput()->GetLargestPossibleRegion() ==
+    reader2->GetOutput()->GetLargestPossibleRegion() )
     {
-    if( ItF.Get() <= minDistance && ItM.Get() == 1 )
+    itk::ImageRegionIteratorWithIndex<MaskImageType> It1(
+      reader1->GetOutput(), reader1->GetOutput()->GetLargestPossibleRegion() );
+    itk::ImageRegionIteratorWithIndex<MaskImageType> It2(
+      reader2->GetOutput(), reader2->GetOutput()->GetLargestPossibleRegion() );
+    itk::ImageRegionIteratorWithIndex<MaskImageType> ItO(
+      output, output->GetLargestPossibleRegion() );
+    for( It1.GoToBegin(), It2.GoToBegin(), ItO.GoToBegin(); !It1.IsAtEnd();
+      ++It1, ++It2, ++ItO )
+      {
+      if( It1.Get() == label1 && It2.Get() == label2 )
+        {
+        ItO.Set( 1 );
+        objectsOverlap = true;
+        }
+      }
+    }
+
+  if( objectsOverlap )
+    {
+    std::cout << "Min distance = 0" << std::endl;
+    }
+  else
+    {
+    // The closest voxels of two disjoint objects lie on their surfaces, so
+    // only the surface voxels of the second object are queried against a
+    // tree of the surface voxels of the first one.
+    typedef itk::LabelSurfaceDistanceCalculator<MaskImageType> CalculatorType;
+    typename CalculatorType::Pointer calculator = CalculatorType::New();
+    calculator->SetInput1( reader1->GetOutput() );
+    calculator->SetInput2( reader2->GetOutput() );
+    calculator->SetLabel1( label1 );
+    calculator->SetLabel2( label2 );
+    try
+      {
+      calculator->Compute();
+      }
+    catch( itk::ExceptionObject & excp )
+      {
+      std::cerr << excp << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    typename CalculatorType::RealType minDistance =
+      calculator->GetMinimumDistance();
+
+    const typename CalculatorType::SurfacePointContainerType & points =
+      calculator->GetSurfacePoints( 1 );
+    const std::vector<typename CalculatorType::RealType> & distances =
+      calculator->GetDistances( 1 );
+    for( unsigned long n = 0; n < points.size(); n++ )
       {
-      ItO.Set( 1 );
+      if( distances[n] <= minDistance )
+        {
+        output->SetPixel( points[n].Index, 1 );
+        }
       }
+    std::cout << "Min distance = " << minDistance << std::endl;
     }
-  std::cout << "Min distance = " << minDistance << std::endl;
 
   typedef itk::ImageFileWriter<MaskImageType> WriterType;
   typename WriterType::Pointer writer = WriterType::New();
@@ -121,10 +124,10 @@ int main( int argc, char *argv[] )
   switch( atoi( argv[1] ) )
    {
    case 2:
-     FindClosestPointsBetweenTwoObjects<2>( argc, argv );
+     return FindClosestPointsBetweenTwoObjects<2>( argc, argv );
      break;
    case 3:
-     FindClosestPointsBetweenTwoObjects<3>( argc, argv );
+     return FindClosestPointsBetweenTwoObjects<3>( argc, argv );
      break;
    default:
       std::cerr << "Unsupported dimension" << std::endl;
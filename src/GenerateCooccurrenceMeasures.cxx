@@ -2,97 +2,79 @@
 
 #include "itkImage.h"
 #include "itkImageFileReader.h"
-#include "itkImageFileWriter.h"
-#include "itkImageRegionIteratorWithIndex.h"
 
-#include "itkRescaleIntensityImageFilter.h"
-#include "itkScalarImageToTextureFeaturesFilter.h"
-#include "itkDenseFrequencyContainer2.h"
+#include "itkLabelScalarImageToCooccurrenceMatricesGenerator.h"
+
+#include <string>
+#include <vector>
 
 template <unsigned int ImageDimension>
 int GenerateCooccurrenceMeasures( int argc, char *argv[] )
 {
 
   typedef float PixelType;
-  typedef float RealType;
-
+  typedef unsigned int LabelType;
 
   typedef itk::Image<PixelType, ImageDimension> ImageType;
-  typedef itk::Image<RealType, ImageDimension> RealImageType;
+  typedef itk::Image<LabelType, ImageDimension> LabelImageType;
 
   typedef itk::ImageFileReader<ImageType> ReaderType;
   typename ReaderType::Pointer imageReader = ReaderType::New();
   imageReader->SetFileName( argv[2] );
   imageReader->Update();
 
-  // we have to rescale the input image since the cooccurrence filter
-  // adds 1 to the upper bound of the joint histogram and small ranges
-  // will be greatly affected by this.
-
-  typedef itk::RescaleIntensityImageFilter<ImageType, ImageType> RescalerType;
-  typename RescalerType::Pointer rescaler = RescalerType::New();
-  rescaler->SetInput( imageReader->GetOutput() );
-  rescaler->SetOutputMinimum( 0 );
-  rescaler->SetOutputMaximum( 10000 );
-  rescaler->Update();
-
-  typedef itk::Statistics::DenseFrequencyContainer2 HistogramFrequencyContainerType;
-
-  typedef itk::Statistics::ScalarImageToTextureFeaturesFilter
-    <RealImageType, HistogramFrequencyContainerType> TextureFilterType;
-  typename TextureFilterType::Pointer textureFilter = TextureFilterType::New();
-  textureFilter->SetInput( rescaler->GetOutput() );
-
-  typename ImageType::Pointer mask = NULL;
-  PixelType label = itk::NumericTraits<PixelType>::One;
+  // The generator bins [min, max] inclusively so, unlike the histogram of
+  // ScalarImageToTextureFeaturesFilter, it does not need the input to be
+  // rescaled to a large intensity range first.
+
+  typedef itk::Statistics::LabelScalarImageToCooccurrenceMatricesGenerator
+    <ImageType, LabelImageType> CooccurrenceGeneratorType;
+  typename CooccurrenceGeneratorType::Pointer generator =
+    CooccurrenceGeneratorType::New();
+  generator->SetInput( imageReader->GetOutput() );
+
+  // A mask label of "all" computes the measures of every nonzero label in
+  // the same pass.
+  typename LabelImageType::Pointer mask = NULL;
+  bool allLabels = false;
+  std::vector<LabelType> labels;
   if ( argc > 4 )
     {
-    typename ReaderType::Pointer labelImageReader = ReaderType::New();
+    typedef itk::ImageFileReader<LabelImageType> LabelReaderType;
+    typename LabelReaderType::Pointer labelImageReader = LabelReaderType::New();
     labelImageReader->SetFileName( argv[4] );
     labelImageReader->Update();
     mask = labelImageReader->GetOutput();
-    textureFilter->SetMaskImage( mask );
+    generator->SetLabelImage( mask );
 
+    LabelType label = itk::NumericTraits<LabelType>::One;
     if ( argc > 5 )
       {
-      label = static_cast<PixelType>( atoi( argv[5] ) );
+      if( std::string( argv[5] ) == std::string( "all" ) )
+        {
+        allLabels = true;
+        }
+      else
+        {
+        label = static_cast<LabelType>( atoi( argv[5] ) );
+        }
+      }
+    if( !allLabels )
+      {
+      labels.push_back( label );
       }
-    textureFilter->SetInsidePixelValue( label );
     }
 
-
   unsigned int numberOfBins = 256;
   if ( argc > 3 )
     {
-    numberOfBins = static_cast<PixelType>( atoi( argv[3] ) );
+    numberOfBins = static_cast<unsigned int>( atoi( argv[3] ) );
     }
-  textureFilter->SetNumberOfBinsPerAxis( numberOfBins );
-
+  generator->SetNumberOfBinsPerAxis( numberOfBins );
 
-  itk::ImageRegionIteratorWithIndex<ImageType> ItI( rescaler->GetOutput(),
-    rescaler->GetOutput()->GetLargestPossibleRegion() );
-
-  PixelType maxValue = itk::NumericTraits<PixelType>::NonpositiveMin();
-  PixelType minValue = itk::NumericTraits<PixelType>::max();
-
-  for( ItI.GoToBegin(); !ItI.IsAtEnd(); ++ItI )
-    {
-    if ( !mask || ( mask->GetPixel( ItI.GetIndex() ) == label ) )
-      {
-      if ( ItI.Get() < minValue )
-        {
-        minValue = ItI.Get();
-        }
-      else if ( ItI.Get() > maxValue )
-        {
-        maxValue = ItI.Get();
-        }
-      }
-    }
-
-  textureFilter->SetPixelValueMinMax( minValue, maxValue );
-  textureFilter->SetNumberOfBinsPerAxis( numberOfBins );
-  textureFilter->FastCalculationsOff();
+  // Each label is quantized over the intensities of its own voxels.
+  generator->SetLabels( labels );
+  generator->UseLabelPixelValueRangesOn();
 
   /**
    * Second order measurements
@@ -105,52 +87,38 @@ int GenerateCooccurrenceMeasures( int argc, char *argv[] )
    *   6. cluster shade (f6) *cth
    *   7. cluster prominence (f7) *cth
    *   8. haralick's correlation (f8)
+   *
+   * Only the features requested by default from
+   * ScalarImageToTextureFeaturesFilter are printed.
    */
 
-  textureFilter->Update();
-
-  typename TextureFilterType::FeatureValueVectorPointer means =
-    textureFilter->GetFeatureMeans();
-  const typename TextureFilterType::FeatureNameVector* names =
-    textureFilter->GetRequestedFeatures();
-
-  typename TextureFilterType::FeatureValueVector::ConstIterator mIt =
-    means->Begin();
-  typename TextureFilterType::FeatureNameVector::ConstIterator nIt =
-    names->Begin();
+  generator->Compute();
 
+  const unsigned int requestedFeatures[] = { 0, 1, 3, 4, 5, 6 };
 
+  if( allLabels )
+    {
+    std::cout << "Label,";
+    }
   std::cout << "Energy,Entropy,InverseDifferenceMoment,Inertia,ClusterShade,ClusterProminence" << std::endl;
-  while( mIt != means->End() )
+  for( unsigned int n = 0; n < generator->GetLabels().size(); n++ )
     {
-//    std::cout << nIt.Value() << ": " << mIt.Value() << std::endl;
-    std::cout << mIt.Value() << " ";
-    ++mIt;
-    ++nIt;
+    typename CooccurrenceGeneratorType::FeatureArrayType means =
+      generator->GetFeatureMeans( n );
+    if( allLabels )
+      {
+      std::cout << generator->GetLabels()[n] << ",";
+      }
+    for( unsigned int i = 0; i < 6; i++ )
+      {
+      if( i > 0 )
+        {
+        std::cout << ",";
+        }
+      std::cout << means[requestedFeatures[i]];
+      }
+    std::cout << std::endl;
     }
-  std::cout << std::endl;
-
-//  RealType entropy = textureFilter->GetFeatureMeansOutput()[1];
-//  RealType inverseDifferenceMoment = textureFilter->GetFeatureMeansOutput()[2];
-//  RealType inertia = textureFilter->GetFeatureMeansOutput()[3];
-//  RealType clusterShade = textureFilter->GetFeatureMeansOutput()[4];
-//  RealType clusterProminence = textureFilter->GetFeatureMeansOutput()[5];
-//
-//  std::cout << energy << " "
-//            << entropy << " "
-//            << inverseDifferenceMoment << " "
-//            << inertia << " "
-//            << clusterShade << " "
-//            << clusterProminence << std::endl;
-
-/*
-  std::cout << "energy             : " << energy << std::endl;
-  std::cout << "entropy            : " << entropy << std::endl;
-  std::cout << "inverse diff moment: " << inverseDifferenceMoment << std::endl;
-  std::cout << "inertia            : " << inertia << std::endl;
-  std::cout << "cluster Shade      : " << clusterShade << std::endl;
-  std::cout << "cluster prominence : " << clusterProminence << std::endl;
-*/
 
   return 0;
 }
@@ -161,7 +129,7 @@ int main( int argc, char *argv[] )
   if ( argc < 4 )
     {
     std::cout << "Usage: " << argv[0] << " imageDimension inputImage "
-     << "[numberOfBinsPerAxis=256] [maskImage] [maskLabel=1]" << std::endl;
+     << "[numberOfBinsPerAxis=256] [maskImage] [maskLabel=1|all]" << std::endl;
     exit( 1 );
     }
 
@@ -5,7 +5,7 @@
 #include "itkImageFileWriter.h"
 #include "itkImageRegionIterator.h"
 
-#include "itkLabelStatisticsImageFilter.h"
+#include "itkLabelOrderStatisticsCalculator.h"
 
 template <unsigned int ImageDimension>
 int GeneratePercentileAttenuationMask( int argc, char *argv[] )
@@ -13,8 +13,6 @@ int GeneratePercentileAttenuationMask( int argc, char *argv[] )
   typedef int PixelType;
   typedef float RealType;
 
-  unsigned int numberOfBins = 200;
-
   typedef itk::Image<PixelType, ImageDimension> ImageType;
   typedef itk::Image<RealType, ImageDimension> RealImageType;
 
@@ -50,46 +48,35 @@ int GeneratePercentileAttenuationMask( int argc, char *argv[] )
     {
     label = static_cast<PixelType>( atoi( argv[8] ) );
     }
-  itk::ImageRegionIterator<ImageType> ItI( imageReader->GetOutput(),
-    imageReader->GetOutput()->GetLargestPossibleRegion() );
-  itk::ImageRegionIterator<ImageType> ItM( maskImage,
-    maskImage->GetLargestPossibleRegion() );
-
-  PixelType maxValue = itk::NumericTraits<PixelType>::min();
-  PixelType minValue = itk::NumericTraits<PixelType>::max();
-
-  for ( ItM.GoToBegin(), ItI.GoToBegin(); !ItM.IsAtEnd(); ++ItM, ++ItI )
+  /**
+   * The percentiles are exact order statistics of the labeled voxels,
+   * linearly interpolated between ranks, rather than histogram estimates.
+   */
+  typedef itk::Statistics::LabelOrderStatisticsCalculator<ImageType, ImageType>
+    OrderStatisticsCalculatorType;
+  typename OrderStatisticsCalculatorType::Pointer orderStatistics =
+    OrderStatisticsCalculatorType::New();
+  orderStatistics->SetImage( imageReader->GetOutput() );
+  orderStatistics->SetLabelImage( maskImage );
+  orderStatistics->Compute();
+
+  if ( !orderStatistics->HasLabel( label ) )
     {
-    if ( ItM.Get() == label )
-      {
-      if ( ItI.Get() < minValue )
-        {
-        minValue = ItI.Get();
-        }
-      else if ( ItI.Get() > maxValue )
-        {
-        maxValue = ItI.Get();
-        }
-      }
+    std::cerr << "The label image has no voxels with label " << label
+      << "." << std::endl;
+    return EXIT_FAILURE;
     }
 
-  typedef itk::LabelStatisticsImageFilter<ImageType, ImageType> HistogramGeneratorType;
-  typename HistogramGeneratorType::Pointer stats = HistogramGeneratorType::New();
-  stats->SetInput( imageReader->GetOutput() );
-  stats->SetLabelInput( maskImage );
-  stats->UseHistogramsOn();
-  stats->SetHistogramParameters( numberOfBins, minValue, maxValue );
-  stats->Update();
-
-  typedef typename HistogramGeneratorType::HistogramType  HistogramType;
-  const HistogramType *histogram = stats->GetHistogram( label );
-
-  double minPercentileValue = histogram->Quantile( 0, atof( argv[4] ) );
-  double maxPercentileValue = histogram->Quantile( 0, atof( argv[5] ) );
+  double minPercentileValue = orderStatistics->GetQuantile( label, atof( argv[4] ) );
+  double maxPercentileValue = orderStatistics->GetQuantile( label, atof( argv[5] ) );
 
   std::cout << "Min percentile: " << minPercentileValue << std::endl;
   std::cout << "Max percentile: " << maxPercentileValue << std::endl;
 
+  itk::ImageRegionIterator<ImageType> ItI( imageReader->GetOutput(),
+    imageReader->GetOutput()->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<ImageType> ItM( maskImage,
+    maskImage->GetLargestPossibleRegion() );
   for ( ItM.GoToBegin(), ItI.GoToBegin(); !ItM.IsAtEnd(); ++ItM, ++ItI )
     {
     RealType value = ItI.Get();
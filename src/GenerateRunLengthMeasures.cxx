@@ -1,14 +1,16 @@
 #include <stdio.h>
 
-#include "itkBoundingBox.h"
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
-#include "itkImageRegionIteratorWithIndex.h"
-#include "itkPointSet.h"
+#include "itkVectorImage.h"
+#include "itkVectorIndexSelectionCastImageFilter.h"
 
-#include "itkScalarImageToRunLengthFeaturesFilter.h"
-#include "itkDenseFrequencyContainer2.h"
+#include "itkLabelScalarImageToRunLengthMatricesGenerator.h"
+#include "itkRunLengthTextureFeaturesImageFilter.h"
+
+#include <string>
+#include <vector>
 
 template <unsigned int ImageDimension>
 int GenerateRunLengthMeasures( int argc, char *argv[] )
@@ -16,113 +18,173 @@ int GenerateRunLengthMeasures( int argc, char *argv[] )
 
   typedef float PixelType;
   typedef float RealType;
-
+  typedef unsigned int LabelType;
 
   typedef itk::Image<PixelType, ImageDimension> ImageType;
-  typedef itk::Image<RealType, ImageDimension> RealImageType;
+  typedef itk::Image<LabelType, ImageDimension> LabelImageType;
 
   typedef itk::ImageFileReader<ImageType> ReaderType;
   typename ReaderType::Pointer imageReader = ReaderType::New();
   imageReader->SetFileName( argv[2] );
   imageReader->Update();
 
-  typedef itk::Statistics::DenseFrequencyContainer2 HistogramFrequencyContainerType;
-
-  typedef itk::Statistics::ScalarImageToRunLengthFeaturesFilter
-    <RealImageType, HistogramFrequencyContainerType> RunLengthFilterType;
-  typename RunLengthFilterType::Pointer runLengthFilter = RunLengthFilterType::New();
-  runLengthFilter->SetInput( imageReader->GetOutput() );
+  typedef itk::Statistics::LabelScalarImageToRunLengthMatricesGenerator
+    <ImageType, LabelImageType> RunLengthGeneratorType;
+  typename RunLengthGeneratorType::Pointer generator = RunLengthGeneratorType::New();
+  generator->SetInput( imageReader->GetOutput() );
 
-  typename ImageType::Pointer mask = NULL;
-  PixelType label = itk::NumericTraits<PixelType>::One;
+  unsigned int numberOfBins = 256;
+  if ( argc > 3 )
+    {
+    numberOfBins = static_cast<unsigned int>( atoi( argv[3] ) );
+    }
+  generator->SetNumberOfGreyLevelBins( numberOfBins );
+  generator->SetNumberOfRunLengthBins( numberOfBins );
+
+  // A mask label of "all" computes the measures of every nonzero label in
+  // the same sweep.
+  typename LabelImageType::Pointer mask = NULL;
+  bool allLabels = false;
+  std::vector<LabelType> labels;
   if ( argc > 4 )
     {
-    typename ReaderType::Pointer labelImageReader = ReaderType::New();
+    typedef itk::ImageFileReader<LabelImageType> LabelReaderType;
+    typename LabelReaderType::Pointer labelImageReader = LabelReaderType::New();
     labelImageReader->SetFileName( argv[4] );
     labelImageReader->Update();
     mask = labelImageReader->GetOutput();
-    runLengthFilter->SetMaskImage( mask );
+    generator->SetLabelImage( mask );
 
+    LabelType label = itk::NumericTraits<LabelType>::One;
     if ( argc > 5 )
       {
-      label = static_cast<PixelType>( atoi( argv[5] ) );
+      if( std::string( argv[5] ) == std::string( "all" ) )
+        {
+        allLabels = true;
+        }
+      else
+        {
+        label = static_cast<LabelType>( atoi( argv[5] ) );
+        }
+      }
+    if( !allLabels )
+      {
+      labels.push_back( label );
       }
-    runLengthFilter->SetInsidePixelValue( label );
-    }
-
-
-  unsigned int numberOfBins = 256;
-  if ( argc > 3 )
-    {
-    numberOfBins = static_cast<PixelType>( atoi( argv[3] ) );
     }
-  runLengthFilter->SetNumberOfBinsPerAxis( numberOfBins );
-
 
-  itk::ImageRegionIteratorWithIndex<ImageType> ItI( imageReader->GetOutput(),
-    imageReader->GetOutput()->GetLargestPossibleRegion() );
+  // Every label is binned over its own intensity range and extent, exactly
+  // as when it is processed on its own.  Without labels the generator uses
+  // every nonzero label.
+  generator->SetLabels( labels );
+  generator->UseLabelPixelValueRangesOn();
+  generator->UseLabelDistanceRangesOn();
+  generator->Compute();
 
+  // The range over all the labels is used for the voxelwise features.
   PixelType maxValue = itk::NumericTraits<PixelType>::NonpositiveMin();
   PixelType minValue = itk::NumericTraits<PixelType>::max();
+  for( unsigned int n = 0; n < generator->GetLabels().size(); n++ )
+    {
+    minValue = vnl_math_min( minValue, generator->GetLabelPixelValueMins()[n] );
+    maxValue = vnl_math_max( maxValue, generator->GetLabelPixelValueMaxs()[n] );
+    }
 
-  typedef itk::BoundingBox<unsigned long,
-       ImageDimension, RealType> BoundingBoxType;
-  typename BoundingBoxType::Pointer bbox = BoundingBoxType::New();
-  typename BoundingBoxType::PointsContainerPointer points
-       = BoundingBoxType::PointsContainer::New();
-  itk::Point<RealType, ImageDimension> point;
-
-  unsigned int idx = 0;
-
-  for( ItI.GoToBegin(); !ItI.IsAtEnd(); ++ItI )
+  if( allLabels )
     {
-    if ( !mask || ( mask->GetPixel( ItI.GetIndex() ) == label ) )
+    std::cout << "Label,";
+    }
+  std::cout << "ShortRunEmphasis,LongRunEmphasis,GreyLevelNonuniformity,RunLengthNonuniformity,LowGreyLevelRunEmphasis,HighGreyLevelRunEmphasis,ShortRunLowGreyLevelEmphasis,ShortRunHighGreyLevelEmphasis,LongRunLowGreyLevelEmphasis,LongRunHighGreyLevelEmphasis" << std::endl;
+  for( unsigned int n = 0; n < generator->GetLabels().size(); n++ )
+    {
+    typename RunLengthGeneratorType::FeatureArrayType means =
+      generator->GetFeatureMeans( n );
+    if( allLabels )
       {
-      if ( ItI.Get() < minValue )
-        {
-        minValue = ItI.Get();
-        }
-      else if ( ItI.Get() > maxValue )
+      std::cout << generator->GetLabels()[n] << ",";
+      }
+    for( unsigned int i = 0; i < means.Size(); i++ )
+      {
+      if( i > 0 )
         {
-        maxValue = ItI.Get();
+        std::cout << ",";
         }
-      imageReader->GetOutput()->TransformIndexToPhysicalPoint( ItI.GetIndex(), point );
-      points->InsertElement( idx++, point );
+      std::cout << means[i];
       }
+    std::cout << std::endl;
     }
-  bbox->SetPoints( points );
-  bbox->ComputeBoundingBox();
-  typename BoundingBoxType::PointType pointMin = bbox->GetMinimum();
-  typename BoundingBoxType::PointType pointMax = bbox->GetMaximum();
 
-  runLengthFilter->SetPixelValueMinMax( minValue, maxValue );
-  runLengthFilter->SetDistanceValueMinMax( 0, pointMin.EuclideanDistanceTo( pointMax ) );
-  runLengthFilter->SetNumberOfBinsPerAxis( numberOfBins );
-  runLengthFilter->FastCalculationsOff();
+  // Voxelwise features over a sliding window.
+  if( argc > 6 )
+    {
+    typedef itk::VectorImage<RealType, ImageDimension> FeatureImageType;
+    typedef itk::Statistics::RunLengthTextureFeaturesImageFilter
+      <ImageType, FeatureImageType> FeatureFilterType;
+    typename FeatureFilterType::Pointer featureFilter = FeatureFilterType::New();
+    featureFilter->SetInput( imageReader->GetOutput() );
+    if( mask && !allLabels )
+      {
+      featureFilter->SetMaskImage( mask );
+      featureFilter->SetInsidePixelValue( labels[0] );
+      }
 
-  runLengthFilter->Update();
+    typename FeatureFilterType::RadiusType radius;
+    radius.Fill( 2 );
+    if( argc > 7 )
+      {
+      radius.Fill( static_cast<unsigned int>( atoi( argv[7] ) ) );
+      }
+    featureFilter->SetNeighborhoodRadius( radius );
+    featureFilter->SetNumberOfBinsPerAxis( numberOfBins );
+    featureFilter->SetPixelValueMinMax( minValue, maxValue );
 
-  typename RunLengthFilterType::FeatureValueVectorPointer means =
-    runLengthFilter->GetFeatureMeans();
-  const typename RunLengthFilterType::FeatureNameVector* names =
-    runLengthFilter->GetRequestedFeatures();
+    RealType windowDistance = 0.0;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      RealType extent = ( 2 * radius[d] + 1 ) *
+        imageReader->GetOutput()->GetSpacing()[d];
+      windowDistance += extent * extent;
+      }
+    featureFilter->SetDistanceValueMinMax( 0, vcl_sqrt( windowDistance ) );
+    featureFilter->Update();
 
-  typename RunLengthFilterType::FeatureValueVector::ConstIterator mIt =
-    means->Begin();
-  typename RunLengthFilterType::FeatureNameVector::ConstIterator nIt =
-    names->Begin();
+    std::string prefix( argv[6] );
+    std::string extension( ".nii.gz" );
+    std::string::size_type pos = prefix.rfind( '.' );
+    if( pos != std::string::npos && pos > 0 )
+      {
+      extension = prefix.substr( pos );
+      prefix = prefix.substr( 0, pos );
+      if( extension == std::string( ".gz" ) )
+        {
+        std::string::size_type pos2 = prefix.rfind( '.' );
+        if( pos2 != std::string::npos )
+          {
+          extension = prefix.substr( pos2 ) + extension;
+          prefix = prefix.substr( 0, pos2 );
+          }
+        }
+      }
 
-  std::cout << "ShortRunEmphasis,LongRunEmphasis,GreyLevelNonuniformity,RunLengthNonuniformity,LowGreyLevelRunEmphasis,HighGreyLevelRunEmphasis,ShortRunLowGreyLevelEmphasis,ShortRunHighGreyLevelEmphasis,LongRunLowGreyLevelEmphasis,LongRunHighGreyLevelEmphasis" << std::endl;
-  while( mIt != means->End() )
-    {
-//    std::cout << nIt.Value() << ": " << mIt.Value() << std::endl;
-    std::cout << mIt.Value() << " ";
-    ++mIt;
-    ++nIt;
+    for( unsigned int i = 0; i < featureFilter->GetNumberOfOutputComponents(); i++ )
+      {
+      typedef itk::VectorIndexSelectionCastImageFilter
+        <FeatureImageType, ImageType> SelectorType;
+      typename SelectorType::Pointer selector = SelectorType::New();
+      selector->SetInput( featureFilter->GetOutput() );
+      selector->SetIndex( i );
+      selector->Update();
+
+      std::string name = RunLengthGeneratorType::FeatureAccumulatorType::GetFeatureName( i );
+      std::string filename = prefix + name + extension;
+
+      typedef itk::ImageFileWriter<ImageType> WriterType;
+      typename WriterType::Pointer writer = WriterType::New();
+      writer->SetInput( selector->GetOutput() );
+      writer->SetFileName( filename.c_str() );
+      writer->Update();
+      }
     }
-  std::cout << std::endl;
-
-
 
   return 0;
 }
@@ -133,7 +195,8 @@ int main( int argc, char *argv[] )
   if ( argc < 4 )
     {
     std::cout << "Usage: " << argv[0] << " imageDimension inputImage "
-     << "[numberOfBinsPerAxis=256] [maskImage] [maskLabel=1]" << std::endl;
+     << "[numberOfBinsPerAxis=256] [maskImage] [maskLabel=1|all] "
+     << "[voxelwiseOutputPrefix] [windowRadius=2]" << std::endl;
     exit( 1 );
     }
 
@@ -20,14 +20,8 @@
 
 #include "itkImageFileWriter.h"
 #include "itkImageFileReader.h"
-#include "itkImageRegionIterator.h"
 
-#include "itkBinaryThresholdImageFilter.h"
-#include "itkConnectedComponentImageFilter.h"
-#include "itkRelabelComponentImageFilter.h"
-
-#include <vector>
-#include <algorithm>
+#include "GetConnectedComponentsOperations.h"
 
 template <unsigned int ImageDimension>
 int GetConnectedComponents(int argc, char* argv[] )
@@ -40,141 +34,34 @@ int GetConnectedComponents(int argc, char* argv[] )
   reader->SetFileName( argv[2] );
   reader->Update();
 
-  typedef itk::RelabelComponentImageFilter<ImageType, ImageType> RelabelerType;
-  typename RelabelerType::Pointer relabeler = RelabelerType::New();
-
+  typename ImageType::Pointer output = NULL;
   if( argc > 5 )
     {
-    typedef itk::ConnectedComponentImageFilter<ImageType, ImageType> ConnectedComponentType;
-    typename ConnectedComponentType::Pointer filter = ConnectedComponentType::New();
-    filter->SetInput( reader->GetOutput() );
-    filter->Update();
-
-    typedef itk::RelabelComponentImageFilter<ImageType, ImageType> RelabelerType;
-    typename RelabelerType::Pointer relabeler = RelabelerType::New();
-    relabeler->SetInput( filter->GetOutput() );
-    relabeler->Update();
-
     float thresholdSize = atof( argv[5] );
-    if( thresholdSize <= 1.0 )
-      {
-      thresholdSize *= relabeler->GetSizeOfObjectsInPixels()[0];
-
-      std::cout << "  Thresholding at size " << static_cast<typename RelabelerType::ObjectSizeType>( thresholdSize ) << std::endl;
-      }
-
-    for ( unsigned int i = 0; i < relabeler->GetNumberOfObjects(); i++ )
+    const bool isFraction = ( thresholdSize <= 1.0 );
+    output = RemoveSmallConnectedComponents<ImageType>( reader->GetOutput(),
+      thresholdSize );
+    if( isFraction )
       {
-      if( relabeler->GetSizeOfObjectsInPixels()[i] < static_cast<typename RelabelerType::ObjectSizeType>( thresholdSize ) )
-        {
-        itk::ImageRegionIterator<ImageType> It( relabeler->GetOutput(), relabeler->GetOutput()->GetRequestedRegion() );
-        for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-          {
-          if( It.Get() >= static_cast<PixelType>( i+1 ) )
-            {
-            It.Set( 0 );
-            }
-          }
-        break;
-        }
+      std::cout << "  Thresholding at size " << static_cast<unsigned long>( thresholdSize ) << std::endl;
       }
-
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetFileName( argv[3] );
-    writer->SetInput( relabeler->GetOutput() );
-    writer->Update();
     }
   else if( argc > 4 && atoi( argv[4] ) != 0 )
     {
-    std::vector<PixelType> labels;
-
-    itk::ImageRegionIterator<ImageType> It( reader->GetOutput(),
-      reader->GetOutput()->GetLargestPossibleRegion() );
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-      {
-      if( It.Get() != 0 &&
-        std::find( labels.begin(), labels.end(), It.Get() ) == labels.end() )
-        {
-        labels.push_back( It.Get() );
-        }
-      }
-    std::sort( labels.begin(), labels.end() );
-
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-      {
-      if( It.Get() != 0 )
-        {
-        typename std::vector<PixelType>::iterator it =
-          std::find( labels.begin(), labels.end(), It.Get() );
-        It.Set( static_cast<PixelType>( it - labels.begin() ) + 1 );
-        }
-      }
-
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetFileName( argv[3] );
-    writer->SetInput( reader->GetOutput() );
-    writer->Update();
+    output = reader->GetOutput();
+    RelabelSequentially<ImageType>( output );
     }
   else
     {
-    typename ImageType::Pointer output = ImageType::New();
-    output->CopyInformation( reader->GetOutput() );
-    output->SetRegions( reader->GetOutput()->GetRequestedRegion() );
-    output->Allocate();
-    output->FillBuffer( 0 );
-
-    typedef itk::RelabelComponentImageFilter<ImageType, ImageType> RelabelerType;
-    typename RelabelerType::Pointer relabeler = RelabelerType::New();
-    relabeler->SetInput( reader->GetOutput() );
-    relabeler->Update();
-
-    unsigned int count = 0;
-
-    for ( unsigned int i = 1; i <= relabeler->GetNumberOfObjects(); i++ )
-      {
-      typedef itk::BinaryThresholdImageFilter<ImageType, ImageType> ThresholderType;
-      typename ThresholderType::Pointer thresholder = ThresholderType::New();
-      thresholder->SetInput( relabeler->GetOutput() );
-      thresholder->SetLowerThreshold( i );
-      thresholder->SetUpperThreshold( i );
-      thresholder->SetOutsideValue( 0 );
-      thresholder->SetInsideValue( 1 );
-      thresholder->Update();
-
-      typedef itk::ConnectedComponentImageFilter<ImageType, ImageType> ConnectedComponentType;
-      typename ConnectedComponentType::Pointer filter = ConnectedComponentType::New();
-      filter->SetInput( thresholder->GetOutput() );
-      filter->Update();
-
-      typename RelabelerType::Pointer relabeler2 = RelabelerType::New();
-      relabeler2->SetInput( filter->GetOutput() );
-      relabeler2->Update();
-
-      itk::ImageRegionIterator<ImageType> It2( relabeler2->GetOutput(),
-        relabeler2->GetOutput()->GetRequestedRegion() );
-
-      itk::ImageRegionIterator<ImageType> ItO( output, output->GetRequestedRegion() );
-
-      for( It2.GoToBegin(), ItO.GoToBegin(); !It2.IsAtEnd(); ++It2, ++ItO )
-        {
-        unsigned int label = It2.Get();
-        if( label != 0 )
-          {
-          ItO.Set( label + count );
-          }
-        }
-      count += relabeler2->GetNumberOfObjects();
-      }
-
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetFileName( argv[3] );
-    writer->SetInput( output );
-    writer->Update();
+    output = SplitLabelsIntoConnectedComponents<ImageType>( reader->GetOutput() );
     }
 
+  typedef itk::ImageFileWriter<ImageType> WriterType;
+  typename WriterType::Pointer writer = WriterType::New();
+  writer->SetFileName( argv[3] );
+  writer->SetInput( output );
+  writer->Update();
+
   return 0;
 }
 
@@ -4,12 +4,11 @@
 #include "itkImageRegionIteratorWithIndex.h"
 
 #include "itkBinaryThresholdImageFilter.h"
-#include "itkConnectedComponentImageFilter.h"
-#include "itkRelabelComponentImageFilter.h"
-#include "itkLabelGeometryImageFilter.h"
-#include "itkLabelPerimeterEstimationCalculator.h"
 #include "itkLabelStatisticsImageFilter.h"
+#include "itkLabelSweepStatisticsCalculator.h"
 #include "itkMultiplyImageFilter.h"
+#include "itkRelabelComponentImageFilter.h"
+#include "itkScalarConnectedComponentImageFilter.h"
 #include "itkSignedMaurerDistanceMapImageFilter.h"
 
 #include <string>
@@ -54,70 +53,57 @@ int GetConnectedComponents(int argc, char* argv[] )
     prefactor *= spacing[d];
     }
 
-  typedef itk::RelabelComponentImageFilter<ImageType, ImageType> RelabelerType;
-  typename RelabelerType::Pointer relabeler = RelabelerType::New();
-  relabeler->SetInput( reader->GetOutput() );
-  relabeler->Update();
-
-//   std::vector<unsigned int> tumorLabels = ConvertVector<unsigned int>( std::string( argv[4] ) );
+  // The connected components of all labels are found at once (components
+  // do not cross label boundaries) and their features are accumulated in
+  // a single sweep.
+  typedef itk::ScalarConnectedComponentImageFilter<ImageType, ImageType>
+    ConnectedComponentType;
+  typename ConnectedComponentType::Pointer filter = ConnectedComponentType::New();
+  filter->SetInput( reader->GetOutput() );
+  filter->SetMaskImage( reader->GetOutput() );
+  filter->SetDistanceThreshold( 0 );
+  filter->Update();
+
+  typedef itk::LabelSweepStatisticsCalculator<ImageType, RealImageType>
+    CalculatorType;
+  typename CalculatorType::Pointer stats = CalculatorType::New();
+  stats->SetLabelImage( filter->GetOutput() );
+  stats->Compute();
+
+  const typename CalculatorType::LabelContainerType & labels = stats->GetLabels();
+  // Output images:
+  // [0] = volume (in physical coordinates)
+  // [1] = volume / surface area
+  // [2] = eccentricity
+  // [3] = elongation
 
-  for( unsigned int i = 1; i <= relabeler->GetNumberOfObjects(); i++ )
+  std::vector<std::vector<float> > features( 4 );
+  for( unsigned int n = 0; n < 4; n++ )
     {
-    typedef itk::BinaryThresholdImageFilter<ImageType, ImageType> ThresholderType;
-    typename ThresholderType::Pointer thresholder = ThresholderType::New();
-    thresholder->SetInput( relabeler->GetOutput() );
-    thresholder->SetLowerThreshold( i );
-    thresholder->SetUpperThreshold( i );
-    thresholder->SetInsideValue( 1 );
-    thresholder->SetOutsideValue( 0 );
-    thresholder->Update();
-
-    typedef itk::ConnectedComponentImageFilter<ImageType, ImageType> ConnectedComponentType;
-    typename ConnectedComponentType::Pointer filter = ConnectedComponentType::New();
-    filter->SetInput( thresholder->GetOutput() );
-    filter->Update();
-
-    typename RelabelerType::Pointer relabeler2 = RelabelerType::New();
-    relabeler2->SetInput( filter->GetOutput() );
-    relabeler2->Update();
-
-    typedef itk::LabelGeometryImageFilter<ImageType, RealImageType> GeometryFilterType;
-    typename GeometryFilterType::Pointer geometry = GeometryFilterType::New();
-    geometry->SetInput( relabeler2->GetOutput() );
-    geometry->CalculatePixelIndicesOff();
-    geometry->CalculateOrientedBoundingBoxOff();
-    geometry->CalculateOrientedLabelRegionsOff();
-    geometry->Update();
-
-    typedef itk::LabelPerimeterEstimationCalculator<ImageType> AreaFilterType;
-    typename AreaFilterType::Pointer area = AreaFilterType::New();
-    area->SetImage( relabeler2->GetOutput() );
-    area->Compute();
+    features[n].assign( labels.empty() ? 0 : labels.back() + 1, 0.0 );
+    }
+  for( unsigned int i = 0; i < labels.size(); i++ )
+    {
+    float volume = prefactor * static_cast<float>( stats->GetCount( labels[i] ) );
 
-    itk::ImageRegionIteratorWithIndex<ImageType> It( relabeler->GetOutput(),
-      relabeler->GetOutput()->GetRequestedRegion() );
-    itk::ImageRegionIterator<ImageType> It2( relabeler2->GetOutput(),
-      relabeler2->GetOutput()->GetRequestedRegion() );
+    features[0][labels[i]] = volume;
+    features[1][labels[i]] = stats->GetPerimeter( labels[i] ) / volume;
+    features[2][labels[i]] = stats->GetEccentricity( labels[i] );
+    features[3][labels[i]] = stats->GetElongation( labels[i] );
+    }
 
-    for( It.GoToBegin(), It2.GoToBegin(); !It.IsAtEnd(); ++It, ++It2 )
+  itk::ImageRegionConstIterator<ImageType> It( filter->GetOutput(),
+    filter->GetOutput()->GetRequestedRegion() );
+  for( unsigned int n = 0; n < 4; n++ )
+    {
+    itk::ImageRegionIterator<RealImageType> ItO( outputImages[n],
+      outputImages[n]->GetRequestedRegion() );
+    for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
       {
-      int label = It2.Get();
-      if( label != 0 )
+      int label = It.Get();
+      if( label > 0 )
         {
-        typename ImageType::IndexType index = It.GetIndex();
-
-        // Output images:
-        // [0] = volume (in physical coordinates)
-        // [1] = volume / surface area
-        // [2] = eccentricity
-        // [3] = elongation
-
-        float volume = prefactor * static_cast<float>( geometry->GetVolume( label ) );
-
-        outputImages[0]->SetPixel( index, volume );
-        outputImages[1]->SetPixel( index, area->GetPerimeter( label ) / volume );
-        outputImages[2]->SetPixel( index, geometry->GetEccentricity( label ) );
-        outputImages[3]->SetPixel( index, geometry->GetElongation( label ) );
+        ItO.Set( features[n][label] );
         }
       }
     }
@@ -0,0 +1,161 @@
+#ifndef __GetConnectedComponentsOperations_h
+#define __GetConnectedComponentsOperations_h
+
+#include "itkBinaryThresholdImageFilter.h"
+#include "itkConnectedComponentImageFilter.h"
+#include "itkImageRegionIterator.h"
+#include "itkRelabelComponentImageFilter.h"
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * The operations of GetConnectedComponents on an unsigned integer label
+ * image.
+ */
+
+/**
+ * Labels the connected components of the nonzero voxels by decreasing size
+ * and removes the components smaller than thresholdSize voxels or, if
+ * thresholdSize <= 1, smaller than that fraction of the largest component.
+ * The threshold in voxels is returned in thresholdSize.
+ */
+template<class TLabelImage>
+typename TLabelImage::Pointer RemoveSmallConnectedComponents(
+  const TLabelImage *input, float & thresholdSize )
+{
+  typedef typename TLabelImage::PixelType LabelType;
+
+  typedef itk::ConnectedComponentImageFilter<TLabelImage, TLabelImage>
+    ConnectedComponentType;
+  typename ConnectedComponentType::Pointer filter = ConnectedComponentType::New();
+  filter->SetInput( input );
+  filter->Update();
+
+  typedef itk::RelabelComponentImageFilter<TLabelImage, TLabelImage>
+    RelabelerType;
+  typename RelabelerType::Pointer relabeler = RelabelerType::New();
+  relabeler->SetInput( filter->GetOutput() );
+  relabeler->Update();
+
+  if( thresholdSize <= 1.0 && relabeler->GetNumberOfObjects() > 0 )
+    {
+    thresholdSize *= relabeler->GetSizeOfObjectsInPixels()[0];
+    }
+
+  // The components are sorted by size, so the first one below the
+  // threshold and all later ones are removed.
+  typename TLabelImage::Pointer output = relabeler->GetOutput();
+  for( unsigned int i = 0; i < relabeler->GetNumberOfObjects(); i++ )
+    {
+    if( relabeler->GetSizeOfObjectsInPixels()[i] <
+      static_cast<typename RelabelerType::ObjectSizeType>( thresholdSize ) )
+      {
+      itk::ImageRegionIterator<TLabelImage> It( output,
+        output->GetRequestedRegion() );
+      for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+        {
+        if( It.Get() >= static_cast<LabelType>( i + 1 ) )
+          {
+          It.Set( 0 );
+          }
+        }
+      break;
+      }
+    }
+  return output;
+}
+
+/**
+ * Maps the nonzero labels of the image, in place, to 1, 2, ... in
+ * increasing order.
+ */
+template<class TLabelImage>
+void RelabelSequentially( TLabelImage *image )
+{
+  typedef typename TLabelImage::PixelType LabelType;
+
+  std::vector<LabelType> labels;
+  itk::ImageRegionIterator<TLabelImage> It( image,
+    image->GetLargestPossibleRegion() );
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    if( It.Get() != 0 &&
+      std::find( labels.begin(), labels.end(), It.Get() ) == labels.end() )
+      {
+      labels.push_back( It.Get() );
+      }
+    }
+  std::sort( labels.begin(), labels.end() );
+
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    if( It.Get() != 0 )
+      {
+      typename std::vector<LabelType>::iterator it =
+        std::find( labels.begin(), labels.end(), It.Get() );
+      It.Set( static_cast<LabelType>( it - labels.begin() ) + 1 );
+      }
+    }
+}
+
+/**
+ * Splits every label into its connected components.  The components of the
+ * labels, ordered by size, are numbered consecutively label after label.
+ */
+template<class TLabelImage>
+typename TLabelImage::Pointer SplitLabelsIntoConnectedComponents(
+  const TLabelImage *input )
+{
+  typename TLabelImage::Pointer output = TLabelImage::New();
+  output->CopyInformation( input );
+  output->SetRegions( input->GetRequestedRegion() );
+  output->Allocate();
+  output->FillBuffer( 0 );
+
+  typedef itk::RelabelComponentImageFilter<TLabelImage, TLabelImage>
+    RelabelerType;
+  typename RelabelerType::Pointer relabeler = RelabelerType::New();
+  relabeler->SetInput( input );
+  relabeler->Update();
+
+  unsigned int count = 0;
+  for( unsigned int i = 1; i <= relabeler->GetNumberOfObjects(); i++ )
+    {
+    typedef itk::BinaryThresholdImageFilter<TLabelImage, TLabelImage>
+      ThresholderType;
+    typename ThresholderType::Pointer thresholder = ThresholderType::New();
+    thresholder->SetInput( relabeler->GetOutput() );
+    thresholder->SetLowerThreshold( i );
+    thresholder->SetUpperThreshold( i );
+    thresholder->SetOutsideValue( 0 );
+    thresholder->SetInsideValue( 1 );
+    thresholder->Update();
+
+    typedef itk::ConnectedComponentImageFilter<TLabelImage, TLabelImage>
+      ConnectedComponentType;
+    typename ConnectedComponentType::Pointer filter = ConnectedComponentType::New();
+    filter->SetInput( thresholder->GetOutput() );
+    filter->Update();
+
+    typename RelabelerType::Pointer relabeler2 = RelabelerType::New();
+    relabeler2->SetInput( filter->GetOutput() );
+    relabeler2->Update();
+
+    itk::ImageRegionIterator<TLabelImage> It2( relabeler2->GetOutput(),
+      relabeler2->GetOutput()->GetRequestedRegion() );
+    itk::ImageRegionIterator<TLabelImage> ItO( output,
+      output->GetRequestedRegion() );
+    for( It2.GoToBegin(), ItO.GoToBegin(); !It2.IsAtEnd(); ++It2, ++ItO )
+      {
+      if( It2.Get() != 0 )
+        {
+        ItO.Set( It2.Get() + count );
+        }
+      }
+    count += relabeler2->GetNumberOfObjects();
+    }
+  return output;
+}
+
+#endif
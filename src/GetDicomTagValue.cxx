@@ -27,6 +27,7 @@
 #include "itkImageFileReader.h"
 #include "itkImageSeriesWriter.h"
 #include "itkMetaDataObject.h"
+#include "itkDICOMHeaderIndex.h"
 
 #include <vector>
 #include <itksys/SystemTools.hxx>
@@ -36,15 +37,58 @@
 int main( int argc, char* argv[] )
 {
 
-  if( argc < 2 )
+  if( argc < 3 )
     {
     std::cerr << "Usage: " << argv[0];
-    std::cerr << " inputImage tagID" << std::endl;
-
+    std::cerr << " inputImage tagID [headerIndexFile]" << std::endl;
+    std::cerr << "  With a header index, the tag is read from the index and the "
+      << "image is only read if it changed since the index was written."
+      << std::endl;
 
     return EXIT_FAILURE;
     }
 
+  if( argc > 3 )
+    {
+    itk::DICOMHeaderIndex::Pointer index = itk::DICOMHeaderIndex::New();
+    index->SetFileName( argv[3] );
+    index->Load();
+
+    std::vector<std::string> fileNames( 1, std::string( argv[1] ) );
+    index->Update( fileNames );
+
+    const itk::DICOMHeaderIndex::EntryType *entry = index->GetEntry( argv[1] );
+    if( !entry || !entry->IsDICOM )
+      {
+      std::cerr << "Unable to read the header of " << argv[1] << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    std::string value;
+    if( index->GetTagValue( argv[1], argv[2], value ) )
+      {
+      std::cout << argv[2] << "," << value << std::endl;
+      }
+    else
+      {
+      std::cout << argv[2] << std::endl;
+      }
+
+    if( index->GetChanged() )
+      {
+      try
+        {
+        index->Save();
+        }
+      catch( itk::ExceptionObject & excp )
+        {
+        std::cerr << "Warning: the header index was not saved." << std::endl;
+        std::cerr << excp << std::endl;
+        }
+      }
+    return EXIT_SUCCESS;
+    }
+
   typedef signed short    PixelType;
   const unsigned int      Dimension = 2;
 
@@ -10,10 +10,11 @@ int GetImageInformation( int argc, char *argv[] )
 
   typedef itk::Image<PixelType, ImageDimension> ImageType;
 
+  // Only the header is read; the voxel query below requests a single voxel.
   typedef itk::ImageFileReader<ImageType> ReaderType;
   typename ReaderType::Pointer reader = ReaderType::New();
   reader->SetFileName( argv[2] );
-  reader->Update();
+  reader->UpdateOutputInformation();
 
   if( argc > 3 )
     {
@@ -83,7 +84,19 @@ int GetImageInformation( int argc, char *argv[] )
           {
           index[d] = idx[d];
           }
+        typename ImageType::SizeType size;
+        size.Fill( 1 );
+        typename ImageType::RegionType region( index, size );
+        if( !reader->GetOutput()->GetLargestPossibleRegion().IsInside( region ) )
+          {
+          std::cerr << "The index " << index << " is outside the image."
+            << std::endl;
+          return EXIT_FAILURE;
+          }
+        reader->GetOutput()->SetRequestedRegion( region );
+        reader->Update();
         std::cout << reader->GetOutput()->GetPixel( index ) << std::endl;
+        break;
         }
       }
     }
@@ -5,6 +5,31 @@
 #include "itkHistogramMatchingImageFilter.h"
 #include "itkDynamicHistogramWarpingImageFilter.h"
 
+#include <itksys/SystemTools.hxx>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+std::vector<std::string> ReadFileNames( const std::string & name )
+{
+  std::vector<std::string> fileNames;
+  if( itksys::SystemTools::GetFilenameLastExtension( name ) == ".txt" )
+    {
+    std::ifstream str( name.c_str() );
+    std::string fileName;
+    while( str >> fileName )
+      {
+      fileNames.push_back( fileName );
+      }
+    }
+  else
+    {
+    fileNames.push_back( name );
+    }
+  return fileNames;
+}
+
 template <unsigned int ImageDimension>
 int HistogramMatchImages( int argc, char * argv[] )
 {
@@ -12,40 +37,70 @@ int HistogramMatchImages( int argc, char * argv[] )
 
   typedef itk::Image<PixelType, ImageDimension> ImageType;
 
-  typedef itk::ImageFileReader<ImageType>  ReaderType;
-  typename ReaderType::Pointer reader1 = ReaderType::New();
-  reader1->SetFileName( argv[2] );
-  reader1->Update();
+  /**
+   * A list of source images is matched to the reference image, which is
+   * read once.  The dynamic histogram warping filter also keeps the
+   * reference histogram between the source images.
+   */
+  std::vector<std::string> sourceFileNames = ReadFileNames( argv[2] );
+  std::vector<std::string> outputFileNames = ReadFileNames( argv[4] );
+  if( sourceFileNames.size() != outputFileNames.size() )
+    {
+    std::cerr << "The numbers of source and output images differ." << std::endl;
+    return EXIT_FAILURE;
+    }
 
+  typedef itk::ImageFileReader<ImageType>  ReaderType;
   typename ReaderType::Pointer reader2 = ReaderType::New();
   reader2->SetFileName( argv[3] );
   reader2->Update();
 
+  const unsigned int method = ( argc > 7 ) ? atoi( argv[7] ) : 0;
+
   typedef itk::HistogramMatchingImageFilter<ImageType, ImageType> FilterType;
   typename FilterType::Pointer filter = FilterType::New();
-  filter->SetSourceImage( reader1->GetOutput() );
   filter->SetReferenceImage( reader2->GetOutput() );
   filter->ThresholdAtMeanIntensityOn();
   filter->SetNumberOfHistogramLevels( ( argc > 5 ) ? atoi( argv[5] ) : 255 );
   filter->SetNumberOfMatchPoints( ( argc > 6 ) ? atoi( argv[6] ) : 12 );
-  filter->Update();
-
-//   typedef itk::DynamicHistogramWarpingImageFilter<ImageType, ImageType> FilterType;
-//   typename FilterType::Pointer filter = FilterType::New();
-//   filter->SetSourceImage( reader1->GetOutput() );
-//   filter->SetReferenceImage( reader2->GetOutput() );
-//   filter->SetNumberOfHistogramLevels( ( argc > 5 ) ? atoi( argv[5] ) : 255 );
-//   filter->SetMaximumSourceBinCompressionSize(
-//     ( argc > 6 ) ? atoi( argv[6] ) : 10 );
-//   filter->SetMaximumReferenceBinCompressionSize(
-//     ( argc > 7 ) ? atoi( argv[7] ) : 10 );
-//   filter->Update();
-
-  typedef itk::ImageFileWriter<ImageType>  WriterType;
-  typename WriterType::Pointer writer = WriterType::New();
-  writer->SetInput( filter->GetOutput() );
-  writer->SetFileName( argv[4] );
-  writer->Update();
+
+  typedef itk::DynamicHistogramWarpingImageFilter<ImageType, ImageType> DHWFilterType;
+  typename DHWFilterType::Pointer dhwFilter = DHWFilterType::New();
+  dhwFilter->SetReferenceImage( reader2->GetOutput() );
+  dhwFilter->SetNumberOfHistogramLevels( ( argc > 5 ) ? atoi( argv[5] ) : 255 );
+  dhwFilter->SetBandRadius( ( argc > 8 ) ? atoi( argv[8] ) : 0 );
+  dhwFilter->SetMaximumSourceBinCompressionSize(
+    ( argc > 9 ) ? atoi( argv[9] ) : 10 );
+  dhwFilter->SetMaximumReferenceBinCompressionSize(
+    ( argc > 9 ) ? atoi( argv[9] ) : 10 );
+
+  for( unsigned int n = 0; n < sourceFileNames.size(); n++ )
+    {
+    typename ReaderType::Pointer reader1 = ReaderType::New();
+    reader1->SetFileName( sourceFileNames[n].c_str() );
+    reader1->Update();
+
+    typename ImageType::Pointer output = NULL;
+    if( method == 1 )
+      {
+      dhwFilter->SetSourceImage( reader1->GetOutput() );
+      dhwFilter->Update();
+      output = dhwFilter->GetOutput();
+      }
+    else
+      {
+      filter->SetSourceImage( reader1->GetOutput() );
+      filter->Update();
+      output = filter->GetOutput();
+      }
+    output->DisconnectPipeline();
+
+    typedef itk::ImageFileWriter<ImageType>  WriterType;
+    typename WriterType::Pointer writer = WriterType::New();
+    writer->SetInput( output );
+    writer->SetFileName( outputFileNames[n].c_str() );
+    writer->Update();
+    }
 
   return EXIT_SUCCESS;
 }
@@ -54,12 +109,16 @@ int main( int argc, char *argv[] )
 {
   if ( argc < 5 )
     {
-//     std::cout << "Usage: " << argv[0] << " imageDimension "
-//       << "sourceImage referenceImage outputImage [histLevels] "
-//       << "[sourceCompressionSize] [referenceCompressionSize]" << std::endl;
     std::cout << "Usage: " << argv[0] << " imageDimension "
-      << "sourceImage referenceImage outputImage [histLevels] [numberOfMatchPoints] "
+      << "sourceImage referenceImage outputImage [histLevels] "
+      << "[numberOfMatchPoints] [method] [bandRadius] [compressionSize]"
+      << std::endl;
+    std::cout << "  method: 0 = histogram matching (default, uses "
+      << "numberOfMatchPoints=12), 1 = dynamic histogram warping (uses "
+      << "bandRadius=0 for the full cost table and compressionSize=10)."
       << std::endl;
+    std::cout << "  sourceImage and outputImage can be .txt files listing "
+      << "one image per line, all matched to referenceImage." << std::endl;
     exit( 1 );
 
     }
@@ -3,12 +3,10 @@
 #include "itkImageFileWriter.h"
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkThresholdImageFilter.h"
-#include "itkMinimumMaximumImageCalculator.h"
 #include <itkGradientMagnitudeImageFilter.h>
 #include <itkDiscreteGaussianImageFilter.h>
-#include "itkBinaryBallStructuringElement.h"
-#include "itkGrayscaleDilateImageFilter.h"
 #include "itkLabelOverlayImageFilter.h"
+#include <algorithm>
 #include <list>
 #include "itkCastImageFilter.h"
 #include "vnl/vnl_math.h"
@@ -90,6 +88,7 @@ int HoughTransform( unsigned int argc, char *argv[] )
   if( argc > 15 )
     {
   houghFilter->SetNbOfThreads( atoi(argv[1+14]) );
+  houghFilter->SetNumberOfThreads( atoi(argv[1+14]) );
     }
   if( argc > 16 )
     {
@@ -135,39 +134,49 @@ int HoughTransform( unsigned int argc, char *argv[] )
               << std::endl;
     std::cout << "Radius: " << (*itSpheres)->GetRadius()[0] << std::endl;
 
-    itk::ImageRegionIteratorWithIndex<OutputImageType> It( localImage,
-      localImage->GetLargestPossibleRegion() );
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    // Only the bounding box of the sphere can be inside it.
+    typename OutputImageType::IndexType sphereStart, sphereEnd;
+    typename OutputImageType::SizeType sphereSize;
+    bool isInside = true;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
       {
-      typename OutputImageType::IndexType index = It.GetIndex();
-      float sum = 0.0;
-      for( unsigned int d = 0; d < ImageDimension; d++ )
+      const double center = (*itSpheres)->GetObjectToParentTransform()->GetOffset()[d];
+      const double radius = (*itSpheres)->GetRadius()[0];
+      sphereStart[d] = std::max( static_cast<long>( vcl_ceil( center - radius ) ),
+        static_cast<long>( region.GetIndex()[d] ) );
+      sphereEnd[d] = std::min( static_cast<long>( vcl_floor( center + radius ) ),
+        static_cast<long>( region.GetIndex()[d] + region.GetSize()[d] ) - 1 );
+      if( sphereEnd[d] < sphereStart[d] )
         {
-        sum += vnl_math_sqr( index[d] - (*itSpheres)->GetObjectToParentTransform()->GetOffset()[d] );
+        isInside = false;
+        break;
         }
-      if( sum <= vnl_math_sqr( (*itSpheres)->GetRadius()[0] ) )
+      sphereSize[d] = sphereEnd[d] - sphereStart[d] + 1;
+      }
+    if( isInside )
+      {
+      typename OutputImageType::RegionType sphereRegion( sphereStart, sphereSize );
+
+      itk::ImageRegionIteratorWithIndex<OutputImageType> It( localOutputImage,
+        sphereRegion );
+      for( It.GoToBegin(); !It.IsAtEnd(); ++It )
         {
-        localOutputImage->SetPixel( index, count );
+        typename OutputImageType::IndexType index = It.GetIndex();
+        float sum = 0.0;
+        for( unsigned int d = 0; d < ImageDimension; d++ )
+          {
+          sum += vnl_math_sqr( index[d] - (*itSpheres)->GetObjectToParentTransform()->GetOffset()[d] );
+          }
+        if( sum <= vnl_math_sqr( (*itSpheres)->GetRadius()[0] ) )
+          {
+          It.Set( count );
+          }
         }
       }
     itSpheres++;
     count++;
     }
 
-//  int radius = 2;
-//  typedef itk::BinaryBallStructuringElement< OutputPixelType, Dimension >
-//    SEType;
-//  SEType sE;
-//  sE.SetRadius ( radius );
-//  sE.CreateStructuringElement();
-//
-//  typedef itk::GrayscaleDilateImageFilter< OutputImageType, OutputImageType, SEType >
-//    DilateFilterType;
-//  typename DilateFilterType::Pointer grayscaleDilate = DilateFilterType::New();
-//  grayscaleDilate->SetKernel ( sE );
-//  grayscaleDilate->SetInput ( localOutputImage );
-//  grayscaleDilate->Update();
-
   typedef itk::ImageFileWriter< OutputImageType > CirclesWriterType;
   typename CirclesWriterType::Pointer cwriter = CirclesWriterType::New();
   cwriter->SetInput( localOutputImage );
@@ -24,6 +24,7 @@
 #include <sstream>
 
 #include "Common.h"
+#include "MultipleOperateImagesReducers.h"
 
 typedef float RealType;
 
@@ -190,17 +191,8 @@ int MultipleOperateImages( int argc, char * argv[] )
       reader->Update();
 
       N += 1.0;
-      itk::ImageRegionIteratorWithIndex<ImageType> It( reader->GetOutput(),
-        reader->GetOutput()->GetLargestPossibleRegion() );
-      itk::ImageRegionIterator<ImageType> ItO( output,
-        output->GetLargestPossibleRegion() );
-      for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
-        {
-        if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-          {
-          ItO.Set( ItO.Get() * ( N - 1.0 ) / N + It.Get() / N );
-          }
-        }
+      AccumulateMeanImage<ImageType, LabelImageType>( output,
+        reader->GetOutput(), mask, N );
       }
 
     typedef itk::ImageFileWriter<ImageType> WriterType;
@@ -223,17 +215,8 @@ int MultipleOperateImages( int argc, char * argv[] )
       reader->SetFileName( filenames[n].c_str() );
       reader->Update();
 
-      itk::ImageRegionIteratorWithIndex<ImageType> It( reader->GetOutput(),
-        reader->GetOutput()->GetLargestPossibleRegion() );
-      itk::ImageRegionIterator<ImageType> ItO( output,
-        output->GetLargestPossibleRegion() );
-      for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
-        {
-        if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-          {
-          ItO.Set( ItO.Get() + It.Get() );
-          }
-        }
+      AccumulateSumImage<ImageType, LabelImageType>( output,
+        reader->GetOutput(), mask );
       }
 
     typedef itk::ImageFileWriter<ImageType> WriterType;
@@ -312,17 +295,8 @@ int MultipleOperateImages( int argc, char * argv[] )
       reader->SetFileName( filenames[n].c_str() );
       reader->Update();
 
-      itk::ImageRegionIteratorWithIndex<ImageType> It( reader->GetOutput(),
-        reader->GetOutput()->GetLargestPossibleRegion() );
-      itk::ImageRegionIterator<ImageType> ItO( output,
-        output->GetLargestPossibleRegion() );
-      for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
-        {
-        if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-          {
-          ItO.Set( vnl_math_max( ItO.Get(), It.Get() ) );
-          }
-        }
+      AccumulateMaxImage<ImageType, LabelImageType>( output,
+        reader->GetOutput(), mask );
       }
 
     typedef itk::ImageFileWriter<ImageType> WriterType;
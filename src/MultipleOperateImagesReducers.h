@@ -0,0 +1,70 @@
+#ifndef __MultipleOperateImagesReducers_h
+#define __MultipleOperateImagesReducers_h
+
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+#include "vnl/vnl_math.h"
+
+/**
+ * The voxelwise reducers of MultipleOperateImages.  Each call folds one
+ * image into the output.  Voxels outside a non-null mask are left as they
+ * are.  The images must have the same region as the output.
+ */
+
+/**
+ * Running mean: N is the number of images, including this one, that the
+ * output averages after the call.
+ */
+template<class TImage, class TMaskImage>
+void AccumulateMeanImage( TImage *output, const TImage *image,
+  const TMaskImage *mask, float N )
+{
+  itk::ImageRegionConstIteratorWithIndex<TImage> It( image,
+    image->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<TImage> ItO( output,
+    output->GetLargestPossibleRegion() );
+  for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
+    {
+    if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
+      {
+      ItO.Set( ItO.Get() * ( N - 1.0 ) / N + It.Get() / N );
+      }
+    }
+}
+
+template<class TImage, class TMaskImage>
+void AccumulateSumImage( TImage *output, const TImage *image,
+  const TMaskImage *mask )
+{
+  itk::ImageRegionConstIteratorWithIndex<TImage> It( image,
+    image->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<TImage> ItO( output,
+    output->GetLargestPossibleRegion() );
+  for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
+    {
+    if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
+      {
+      ItO.Set( ItO.Get() + It.Get() );
+      }
+    }
+}
+
+template<class TImage, class TMaskImage>
+void AccumulateMaxImage( TImage *output, const TImage *image,
+  const TMaskImage *mask )
+{
+  itk::ImageRegionConstIteratorWithIndex<TImage> It( image,
+    image->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<TImage> ItO( output,
+    output->GetLargestPossibleRegion() );
+  for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
+    {
+    if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
+      {
+      ItO.Set( vnl_math_max( ItO.Get(), It.Get() ) );
+      }
+    }
+}
+
+#endif
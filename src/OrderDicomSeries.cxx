@@ -1,23 +1,73 @@
 #include "itkGDCMSeriesFileNames.h"
+#include "itkDICOMHeaderIndex.h"
+
+#include <itksys/SystemTools.hxx>
 
 int main( int ac, char* av[] )
 {
 
-  if ( ac != 2 )
+  if ( ac < 2 )
     {
-    std::cerr << "Usage: " << av[0] << " dicomDirectory ";
+    std::cerr << "Usage: " << av[0] << " dicomDirectory [headerIndexFile]"
+      << std::endl;
+    std::cerr << "  The header index is created if it does not exist and only "
+      << "files that changed since it was written are read again." << std::endl;
     return EXIT_FAILURE;
     }
 
-  // Get the GDCM filenames from the directory
-  itk::GDCMSeriesFileNames::Pointer names = itk::GDCMSeriesFileNames::New();
-  names->RecursiveOff();
-  names->SetUseSeriesDetails( true );
-  names->SetLoadSequences( true );
-  names->SetDirectory( av[1] );
-  names->Update();
+  std::vector<std::string> fileNames;
+
+  if( ac > 2 )
+    {
+    itk::DICOMHeaderIndex::Pointer index = itk::DICOMHeaderIndex::New();
+    index->SetFileName( av[2] );
+    index->Load();
+
+    // The index and the temporary files of concurrent writers may be in
+    // the directory.
+    const std::vector<std::string> allFileNames =
+      itk::DICOMHeaderIndex::GetDirectoryFileNames( av[1] );
+    const std::string indexFileName =
+      itksys::SystemTools::CollapseFullPath( av[2] );
+    std::vector<std::string> directoryFileNames;
+    for( unsigned int n = 0; n < allFileNames.size(); n++ )
+      {
+      if( allFileNames[n] != indexFileName &&
+        !itk::DICOMHeaderIndex::IsTemporaryFileName( indexFileName,
+          allFileNames[n] ) )
+        {
+        directoryFileNames.push_back( allFileNames[n] );
+        }
+      }
+
+    index->Update( directoryFileNames );
+    fileNames = index->GetOrderedFileNames( directoryFileNames );
 
-  std::vector<std::string> fileNames = names->GetInputFileNames();
+    if( index->GetChanged() )
+      {
+      try
+        {
+        index->Save();
+        }
+      catch( itk::ExceptionObject & excp )
+        {
+        std::cerr << "Warning: the header index was not saved." << std::endl;
+        std::cerr << excp << std::endl;
+        }
+      }
+    }
+  else
+    {
+    // Get the GDCM filenames from the directory
+    itk::GDCMSeriesFileNames::Pointer names = itk::GDCMSeriesFileNames::New();
+    names->RecursiveOff();
+    names->SetUseSeriesDetails( true );
+    names->SetLoadSequences( true );
+    names->SetDirectory( av[1] );
+    names->Update();
+
+    fileNames = names->GetInputFileNames();
+    }
 
   for( unsigned int d = 0; d < fileNames.size(); d++ )
     {
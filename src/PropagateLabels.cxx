@@ -1,10 +1,9 @@
-#include "itkLabelContourImageFilter.h"
 #include "itkBinaryThresholdImageFilter.h"
-#include "itkFastMarchingImageFilter.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkImageRegionIterator.h"
 #include "itkImageRegionIteratorWithIndex.h"
+#include "itkMultipleLabelFastMarchingCalculator.h"
 #include "itkSignedMaurerDistanceMapImageFilter.h"
 
 template <unsigned int ImageDimension>
@@ -39,6 +38,58 @@ int PropagateLabels( unsigned int argc, char *argv[] )
     mask = imageReader->GetOutput();
     }
 
+  /**
+   * Fast marching propagates all labels in a single pass, each voxel taking
+   * the label of the earliest arrival.
+   */
+  if( !useEuclidean )
+    {
+    typedef itk::MultipleLabelFastMarchingCalculator<LabelImageType, RealImageType>
+      FastMarchingCalculatorType;
+    typename FastMarchingCalculatorType::Pointer fastMarching
+      = FastMarchingCalculatorType::New();
+    fastMarching->SetLabelImage( labelImageReader->GetOutput() );
+    if( mask )
+      {
+      fastMarching->SetSpeedImage( mask );
+      }
+    fastMarching->Compute();
+
+    typename LabelImageType::Pointer minimumLabels =
+      fastMarching->GetOutputLabelImage();
+    if( mask )
+      {
+      itk::ImageRegionIterator<RealImageType> ItM( mask,
+        mask->GetBufferedRegion() );
+      itk::ImageRegionIterator<LabelImageType> ItL( minimumLabels,
+        minimumLabels->GetBufferedRegion() );
+      for( ItM.GoToBegin(), ItL.GoToBegin(); !ItM.IsAtEnd(); ++ItM, ++ItL )
+        {
+        if( ItM.Get() == 0 )
+          {
+          ItL.Set( 0 );
+          }
+        }
+      }
+
+    typedef itk::ImageFileWriter<LabelImageType> WriterType;
+    typename WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName( argv[3] );
+    writer->SetInput( minimumLabels );
+    writer->Update();
+
+    if( argc > 6 )
+      {
+      typedef itk::ImageFileWriter<RealImageType> TimeWriterType;
+      typename TimeWriterType::Pointer timeWriter = TimeWriterType::New();
+      timeWriter->SetFileName( argv[6] );
+      timeWriter->SetInput( fastMarching->GetArrivalTimeImage() );
+      timeWriter->Update();
+      }
+
+    return 0;
+    }
+
   typename RealImageType::Pointer minimumDistance = RealImageType::New();
   minimumDistance->SetOrigin( labelImageReader->GetOutput()->GetOrigin() );
   minimumDistance->SetSpacing( labelImageReader->GetOutput()->GetSpacing() );
@@ -83,89 +134,16 @@ int PropagateLabels( unsigned int argc, char *argv[] )
     thresholder->SetOutsideValue( 0 );
     thresholder->Update();
 
-    typename RealImageType::Pointer distanceImage = RealImageType::New();
-
-    if( useEuclidean )
-      {
-      typedef itk::SignedMaurerDistanceMapImageFilter
-        <LabelImageType, RealImageType> DistancerType;
-      typename DistancerType::Pointer distancer = DistancerType::New();
-      distancer->SetInput( thresholder->GetOutput() );
-      distancer->SetSquaredDistance( true );
-      distancer->SetUseImageSpacing( true );
-      distancer->SetInsideIsPositive( false );
-      distancer->Update();
-
-      distanceImage = distancer->GetOutput();
-      }
-    else
-      {
-      typedef itk::LabelContourImageFilter<LabelImageType, RealImageType>
-        ContourFilterType;
-      typename ContourFilterType::Pointer contour = ContourFilterType::New();
-      contour->SetInput( thresholder->GetOutput() );
-      contour->FullyConnectedOff();
-      contour->Update();
-
-      typedef itk::FastMarchingImageFilter<RealImageType, RealImageType>
-        FastMarchingFilterType;
-      typename FastMarchingFilterType::Pointer fastMarching
-        = FastMarchingFilterType::New();
-
-      if( mask )
-        {
-        fastMarching->SetInput( mask );
-        }
-      else
-        {
-        fastMarching->SetSpeedConstant( 1.0 );
-        fastMarching->SetOverrideOutputInformation( true );
-        fastMarching->SetOutputOrigin( labelImageReader->GetOutput()->GetOrigin() );
-        fastMarching->SetOutputSpacing( labelImageReader->GetOutput()->GetSpacing() );
-        fastMarching->SetOutputRegion( labelImageReader->GetOutput()->GetRequestedRegion() );
-        fastMarching->SetOutputDirection( labelImageReader->GetOutput()->GetDirection() );
-        }
-
-      typedef typename FastMarchingFilterType::NodeContainer NodeContainer;
-      typedef typename FastMarchingFilterType::NodeType NodeType;
-      typename NodeContainer::Pointer trialPoints = NodeContainer::New();
-      trialPoints->Initialize();
-      typename NodeContainer::Pointer alivePoints = NodeContainer::New();
-      alivePoints->Initialize();
-
-      unsigned long trialCount = 0;
-      unsigned long aliveCount = 0;
-
-      itk::ImageRegionIteratorWithIndex<RealImageType> ItC(
-        contour->GetOutput(), contour->GetOutput()->GetRequestedRegion() );
-      itk::ImageRegionIteratorWithIndex<LabelImageType> ItL(
-        labelImageReader->GetOutput(), labelImageReader->GetOutput()->GetRequestedRegion() );
-      for( ItC.GoToBegin(), ItL.GoToBegin(); !ItC.IsAtEnd(); ++ItC, ++ItL )
-        {
-        if( ItC.Get() == 1 )
-          {
-          NodeType node;
-          node.SetValue( 0.0 );
-          node.SetIndex( ItC.GetIndex() );
-          trialPoints->InsertElement( trialCount++, node );
-          }
-        else if( ItL.Get() == *it )
-          {
-          NodeType node;
-          node.SetValue( 0.0 );
-          node.SetIndex( ItC.GetIndex() );
-          alivePoints->InsertElement( aliveCount++, node );
-          }
-        }
-      fastMarching->SetTrialPoints( trialPoints );
-      fastMarching->SetAlivePoints( alivePoints );
-      fastMarching->SetStoppingValue( itk::NumericTraits<RealType>::max() );
-//           fastMarching->SetTopologyCheck( FastMarchingFilterType::None );
-      fastMarching->Update();
-
-      distanceImage = fastMarching->GetOutput();
-      }
+    typedef itk::SignedMaurerDistanceMapImageFilter
+      <LabelImageType, RealImageType> DistancerType;
+    typename DistancerType::Pointer distancer = DistancerType::New();
+    distancer->SetInput( thresholder->GetOutput() );
+    distancer->SetSquaredDistance( true );
+    distancer->SetUseImageSpacing( true );
+    distancer->SetInsideIsPositive( false );
+    distancer->Update();
 
+    typename RealImageType::Pointer distanceImage = distancer->GetOutput();
 
     itk::ImageRegionIteratorWithIndex<RealImageType> ItD(
       distanceImage, distanceImage->GetRequestedRegion() );
@@ -180,7 +158,7 @@ int PropagateLabels( unsigned int argc, char *argv[] )
 
     while( !ItD.IsAtEnd() )
       {
-      if( mask && mask->GetPixel( ItD.GetIndex() ) != 0 )
+      if( !mask || mask->GetPixel( ItD.GetIndex() ) != 0 )
         {
         if( ItD.Get() < ItM.Get() )
           {
@@ -208,7 +186,10 @@ int main( int argc, char *argv[] )
   if ( argc < 4 )
     {
     std::cout << argv[0] << " imageDimension labelImage outputImage [useEuclidean] "
-      << "[speedImage]" << std::endl;
+      << "[speedImage] [arrivalTimeImage]" << std::endl;
+    std::cout << "  Without useEuclidean, all labels are propagated together by "
+      << "fast marching and arrivalTimeImage receives the arrival times."
+      << std::endl;
     exit( 1 );
     }
 
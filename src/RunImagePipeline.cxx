@@ -0,0 +1,701 @@
+#include "itkCastImageFilter.h"
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkImageRegionIterator.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+
+#include "vnl/vnl_math.h"
+
+#include "BinaryMorphologyOperations.h"
+#include "GetConnectedComponentsOperations.h"
+#include "MultipleOperateImagesReducers.h"
+#include "ThresholdImageOperations.h"
+#include "UnaryOperateImageOperations.h"
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Runs a pipeline of the ThresholdImage, BinaryMorphology,
+ * GetConnectedComponents, UnaryOperateImage and MultipleOperateImages
+ * operations in one process.  The images are passed between the steps in
+ * memory, every intermediate image is released after its last use and the
+ * steps that do not depend on each other are run concurrently.
+ *
+ * The pipeline file has one step per line ('#' starts a comment):
+ *
+ *   name = Read file
+ *   name = ThresholdImage input lower upper [inside=1] [outside=0]
+ *   name = BinaryMorphology input operation [radius=1] [type=1]
+ *            [foreground=1] [background=0] [engine=1]
+ *   name = GetConnectedComponents input [relabelOnly=0] [sizeThreshold]
+ *   name = UnaryOperateImage input operation constant [arguments]
+ *   name = MultipleOperateImages operation input1 input2 ...
+ *   Write input file
+ *
+ * The arguments follow the command lines of the tools with the image
+ * dimension and file names left out, and the steps call the same code as
+ * the tools.  BinaryMorphology supports dilate (0), erode (1), close (2),
+ * open (3), fill holes (5) and iterative hole filling (6) and defaults to
+ * the bit-packed engine, UnaryOperateImage the element-wise operations
+ * (+, -, x, /, ^, f, e, l, b, s, r, t) with the extra arguments in the
+ * positions after the output image, and MultipleOperateImages the mean,
+ * sum and max reducers.
+ * Steps may be given in any order.
+ */
+
+struct PipelineStep
+{
+  unsigned int Line;
+  std::string Output;
+  std::string Operation;
+  std::vector<std::string> Inputs;
+  std::vector<std::string> Arguments;
+  unsigned int Wave;
+};
+
+template <unsigned int ImageDimension>
+class ImagePipeline
+{
+public:
+  typedef float                                      PixelType;
+  typedef itk::Image<PixelType, ImageDimension>      ImageType;
+  typedef typename ImageType::Pointer                ImagePointer;
+  typedef itk::Image<unsigned int, ImageDimension>   LabelImageType;
+
+  ImagePipeline( const std::vector<PipelineStep> & steps,
+    unsigned int numberOfConcurrentSteps )
+    : m_Steps( steps ), m_NumberOfConcurrentSteps( numberOfConcurrentSteps )
+    {
+    }
+
+  int Run();
+
+private:
+  struct WaveThreadStruct
+    {
+    ImagePipeline *Pipeline;
+    std::vector<unsigned int> Steps;
+    };
+
+  static ITK_THREAD_RETURN_TYPE WaveThreaderCallback( void *arg );
+
+  bool Schedule();
+
+  ImagePointer Execute( const PipelineStep & step );
+
+  const ImageType * GetImage( const std::string & name ) const;
+
+  ImagePointer ThresholdImage( const PipelineStep & );
+  ImagePointer BinaryMorphology( const PipelineStep & );
+  ImagePointer GetConnectedComponents( const PipelineStep & );
+  ImagePointer UnaryOperateImage( const PipelineStep & );
+  ImagePointer MultipleOperateImages( const PipelineStep & );
+
+  static ImagePointer DuplicateImage( const ImageType * );
+
+  static double GetArgument( const PipelineStep &, unsigned int, double );
+
+  std::vector<PipelineStep>                 m_Steps;
+  unsigned int                              m_NumberOfConcurrentSteps;
+  unsigned int                              m_NumberOfWaves;
+
+  /** Images produced by earlier waves and the wave after which each is no
+   * longer needed. */
+  std::map<std::string, ImagePointer>       m_Images;
+  std::map<std::string, unsigned int>       m_LastWave;
+
+  /** Outputs and errors of the steps of the current wave. */
+  std::vector<ImagePointer>                 m_Outputs;
+  std::vector<std::string>                  m_Errors;
+  itk::SimpleFastMutexLock                  m_OutputMutex;
+};
+
+template <unsigned int ImageDimension>
+bool
+ImagePipeline<ImageDimension>
+::Schedule()
+{
+  std::map<std::string, unsigned int> producers;
+  for( unsigned int n = 0; n < this->m_Steps.size(); n++ )
+    {
+    if( this->m_Steps[n].Output.empty() )
+      {
+      continue;
+      }
+    if( producers.find( this->m_Steps[n].Output ) != producers.end() )
+      {
+      std::cerr << "Line " << this->m_Steps[n].Line << ": "
+        << this->m_Steps[n].Output << " is defined twice." << std::endl;
+      return false;
+      }
+    producers[this->m_Steps[n].Output] = n;
+    }
+
+  // A step runs in the wave after the last wave of its inputs.  Iterate
+  // until the waves are stable, which takes at most one pass per step
+  // unless there is a cycle.
+  for( unsigned int n = 0; n < this->m_Steps.size(); n++ )
+    {
+    this->m_Steps[n].Wave = 0;
+    for( unsigned int i = 0; i < this->m_Steps[n].Inputs.size(); i++ )
+      {
+      if( producers.find( this->m_Steps[n].Inputs[i] ) == producers.end() )
+        {
+        std::cerr << "Line " << this->m_Steps[n].Line << ": "
+          << this->m_Steps[n].Inputs[i] << " is not defined." << std::endl;
+        return false;
+        }
+      }
+    }
+
+  bool changed = true;
+  unsigned int pass = 0;
+  while( changed )
+    {
+    if( pass++ > this->m_Steps.size() )
+      {
+      std::cerr << "The pipeline has a cycle." << std::endl;
+      return false;
+      }
+    changed = false;
+    for( unsigned int n = 0; n < this->m_Steps.size(); n++ )
+      {
+      for( unsigned int i = 0; i < this->m_Steps[n].Inputs.size(); i++ )
+        {
+        const PipelineStep & producer =
+          this->m_Steps[producers[this->m_Steps[n].Inputs[i]]];
+        if( this->m_Steps[n].Wave < producer.Wave + 1 )
+          {
+          this->m_Steps[n].Wave = producer.Wave + 1;
+          changed = true;
+          }
+        }
+      }
+    }
+
+  this->m_NumberOfWaves = 0;
+  for( unsigned int n = 0; n < this->m_Steps.size(); n++ )
+    {
+    this->m_NumberOfWaves = vnl_math_max( this->m_NumberOfWaves,
+      this->m_Steps[n].Wave + 1 );
+    if( !this->m_Steps[n].Output.empty() )
+      {
+      this->m_LastWave[this->m_Steps[n].Output] = this->m_Steps[n].Wave;
+      }
+    }
+  for( unsigned int n = 0; n < this->m_Steps.size(); n++ )
+    {
+    for( unsigned int i = 0; i < this->m_Steps[n].Inputs.size(); i++ )
+      {
+      unsigned int & lastWave = this->m_LastWave[this->m_Steps[n].Inputs[i]];
+      lastWave = vnl_math_max( lastWave, this->m_Steps[n].Wave );
+      }
+    }
+
+  return true;
+}
+
+template <unsigned int ImageDimension>
+int
+ImagePipeline<ImageDimension>
+::Run()
+{
+  if( !this->Schedule() )
+    {
+    return EXIT_FAILURE;
+    }
+
+  for( unsigned int w = 0; w < this->m_NumberOfWaves; w++ )
+    {
+    std::vector<unsigned int> waveSteps;
+    for( unsigned int n = 0; n < this->m_Steps.size(); n++ )
+      {
+      if( this->m_Steps[n].Wave == w )
+        {
+        waveSteps.push_back( n );
+        }
+      }
+
+    this->m_Outputs.assign( this->m_Steps.size(), NULL );
+    this->m_Errors.assign( this->m_Steps.size(), std::string() );
+
+    WaveThreadStruct str;
+    str.Pipeline = this;
+    str.Steps = waveSteps;
+
+    itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+    threader->SetNumberOfThreads( vnl_math_max( 1u, vnl_math_min(
+      this->m_NumberOfConcurrentSteps,
+      static_cast<unsigned int>( waveSteps.size() ) ) ) );
+    threader->SetSingleMethod( this->WaveThreaderCallback, &str );
+    threader->SingleMethodExecute();
+
+    bool failed = false;
+    for( unsigned int i = 0; i < waveSteps.size(); i++ )
+      {
+      const PipelineStep & step = this->m_Steps[waveSteps[i]];
+      if( !this->m_Errors[waveSteps[i]].empty() )
+        {
+        std::cerr << "Line " << step.Line << " (" << step.Operation << "): "
+          << this->m_Errors[waveSteps[i]] << std::endl;
+        failed = true;
+        }
+      else if( !step.Output.empty() )
+        {
+        this->m_Images[step.Output] = this->m_Outputs[waveSteps[i]];
+        }
+      }
+    this->m_Outputs.clear();
+    if( failed )
+      {
+      return EXIT_FAILURE;
+      }
+
+    // Release the images that no later step reads.
+    typename std::map<std::string, ImagePointer>::iterator it =
+      this->m_Images.begin();
+    while( it != this->m_Images.end() )
+      {
+      if( this->m_LastWave[it->first] <= w )
+        {
+        this->m_Images.erase( it++ );
+        }
+      else
+        {
+        ++it;
+        }
+      }
+    }
+
+  return EXIT_SUCCESS;
+}
+
+template <unsigned int ImageDimension>
+ITK_THREAD_RETURN_TYPE
+ImagePipeline<ImageDimension>
+::WaveThreaderCallback( void *arg )
+{
+  unsigned int threadId = ((itk::MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  unsigned int threadCount =
+    ((itk::MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  WaveThreadStruct *str = (WaveThreadStruct *)
+    (((itk::MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  for( unsigned int i = threadId; i < str->Steps.size(); i += threadCount )
+    {
+    const unsigned int n = str->Steps[i];
+    ImagePointer output = NULL;
+    std::string error;
+    try
+      {
+      output = str->Pipeline->Execute( str->Pipeline->m_Steps[n] );
+      }
+    catch( itk::ExceptionObject & e )
+      {
+      error = e.GetDescription();
+      }
+    catch( std::exception & e )
+      {
+      error = e.what();
+      }
+
+    str->Pipeline->m_OutputMutex.Lock();
+    str->Pipeline->m_Outputs[n] = output;
+    str->Pipeline->m_Errors[n] = error;
+    str->Pipeline->m_OutputMutex.Unlock();
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <unsigned int ImageDimension>
+const typename ImagePipeline<ImageDimension>::ImageType *
+ImagePipeline<ImageDimension>
+::GetImage( const std::string & name ) const
+{
+  typename std::map<std::string, ImagePointer>::const_iterator it =
+    this->m_Images.find( name );
+  if( it == this->m_Images.end() )
+    {
+    itkGenericExceptionMacro( << name << " is not available." );
+    }
+  return it->second.GetPointer();
+}
+
+template <unsigned int ImageDimension>
+typename ImagePipeline<ImageDimension>::ImagePointer
+ImagePipeline<ImageDimension>
+::DuplicateImage( const ImageType *image )
+{
+  ImagePointer output = ImageType::New();
+  output->CopyInformation( image );
+  output->SetRegions( image->GetLargestPossibleRegion() );
+  output->Allocate();
+
+  itk::ImageRegionConstIterator<ImageType> It( image,
+    image->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<ImageType> ItO( output,
+    output->GetLargestPossibleRegion() );
+  for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
+    {
+    ItO.Set( It.Get() );
+    }
+  return output;
+}
+
+template <unsigned int ImageDimension>
+double
+ImagePipeline<ImageDimension>
+::GetArgument( const PipelineStep & step, unsigned int which,
+  double defaultValue )
+{
+  if( which < step.Arguments.size() )
+    {
+    return atof( step.Arguments[which].c_str() );
+    }
+  return defaultValue;
+}
+
+template <unsigned int ImageDimension>
+typename ImagePipeline<ImageDimension>::ImagePointer
+ImagePipeline<ImageDimension>
+::Execute( const PipelineStep & step )
+{
+  if( step.Operation == "Read" )
+    {
+    typedef itk::ImageFileReader<ImageType> ReaderType;
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName( step.Arguments[0].c_str() );
+    reader->Update();
+    return reader->GetOutput();
+    }
+  else if( step.Operation == "Write" )
+    {
+    typedef itk::ImageFileWriter<ImageType> WriterType;
+    typename WriterType::Pointer writer = WriterType::New();
+    writer->SetInput( this->GetImage( step.Inputs[0] ) );
+    writer->SetFileName( step.Arguments[0].c_str() );
+    writer->Update();
+    return NULL;
+    }
+  else if( step.Operation == "ThresholdImage" )
+    {
+    return this->ThresholdImage( step );
+    }
+  else if( step.Operation == "BinaryMorphology" )
+    {
+    return this->BinaryMorphology( step );
+    }
+  else if( step.Operation == "GetConnectedComponents" )
+    {
+    return this->GetConnectedComponents( step );
+    }
+  else if( step.Operation == "UnaryOperateImage" )
+    {
+    return this->UnaryOperateImage( step );
+    }
+  else if( step.Operation == "MultipleOperateImages" )
+    {
+    return this->MultipleOperateImages( step );
+    }
+  itkGenericExceptionMacro( << "Unknown operation " << step.Operation );
+  return NULL;
+}
+
+template <unsigned int ImageDimension>
+typename ImagePipeline<ImageDimension>::ImagePointer
+ImagePipeline<ImageDimension>
+::ThresholdImage( const PipelineStep & step )
+{
+  if( step.Arguments.size() < 2 )
+    {
+    itkGenericExceptionMacro( << "Lower and upper thresholds are required." );
+    }
+
+  return BinaryThresholdImage<ImageType>( this->GetImage( step.Inputs[0] ),
+    static_cast<PixelType>( GetArgument( step, 0, 0 ) ),
+    static_cast<PixelType>( GetArgument( step, 1, 0 ) ),
+    static_cast<PixelType>( GetArgument( step, 2, 1 ) ),
+    static_cast<PixelType>( GetArgument( step, 3, 0 ) ) );
+}
+
+template <unsigned int ImageDimension>
+typename ImagePipeline<ImageDimension>::ImagePointer
+ImagePipeline<ImageDimension>
+::BinaryMorphology( const PipelineStep & step )
+{
+  unsigned int operation = static_cast<unsigned int>( GetArgument( step, 0, 0 ) );
+  unsigned int radius = static_cast<unsigned int>( GetArgument( step, 1, 1 ) );
+  unsigned int type = static_cast<unsigned int>( GetArgument( step, 2, 1 ) );
+  PixelType foreground = static_cast<PixelType>( GetArgument( step, 3, 1 ) );
+  PixelType background = static_cast<PixelType>( GetArgument( step, 4, 0 ) );
+  bool usePackedEngine = ( GetArgument( step, 5, 1 ) == 1 );
+
+  return BinaryMorphologyImage<ImageType>( this->GetImage( step.Inputs[0] ),
+    operation, radius, type, foreground, background, usePackedEngine );
+}
+
+template <unsigned int ImageDimension>
+typename ImagePipeline<ImageDimension>::ImagePointer
+ImagePipeline<ImageDimension>
+::GetConnectedComponents( const PipelineStep & step )
+{
+  typedef itk::CastImageFilter<ImageType, LabelImageType> CasterType;
+  typename CasterType::Pointer caster = CasterType::New();
+  caster->SetInput( this->GetImage( step.Inputs[0] ) );
+  caster->Update();
+
+  typename LabelImageType::Pointer output = NULL;
+  if( step.Arguments.size() > 1 )
+    {
+    float thresholdSize = GetArgument( step, 1, 0 );
+    output = RemoveSmallConnectedComponents<LabelImageType>(
+      caster->GetOutput(), thresholdSize );
+    }
+  else if( step.Arguments.size() > 0 && GetArgument( step, 0, 0 ) != 0 )
+    {
+    output = caster->GetOutput();
+    RelabelSequentially<LabelImageType>( output );
+    }
+  else
+    {
+    output = SplitLabelsIntoConnectedComponents<LabelImageType>(
+      caster->GetOutput() );
+    }
+
+  typedef itk::CastImageFilter<LabelImageType, ImageType> OutputCasterType;
+  typename OutputCasterType::Pointer outputCaster = OutputCasterType::New();
+  outputCaster->SetInput( output );
+  outputCaster->Update();
+
+  return outputCaster->GetOutput();
+}
+
+template <unsigned int ImageDimension>
+typename ImagePipeline<ImageDimension>::ImagePointer
+ImagePipeline<ImageDimension>
+::UnaryOperateImage( const PipelineStep & step )
+{
+  if( step.Arguments.empty() || step.Arguments[0].empty() )
+    {
+    itkGenericExceptionMacro( << "The operation is required." );
+    }
+
+  // The input may be read by other steps of the same wave.
+  ImagePointer output = DuplicateImage( this->GetImage( step.Inputs[0] ) );
+
+  // The arguments after the constant are argv[6], argv[7], ... of the
+  // tool.
+  std::vector<std::string> arguments;
+  if( step.Arguments.size() > 2 )
+    {
+    arguments.assign( step.Arguments.begin() + 2, step.Arguments.end() );
+    }
+  if( !UnaryOperateImageInPlace<ImageType>( output, step.Arguments[0][0],
+    GetArgument( step, 1, 0 ), arguments ) )
+    {
+    itkGenericExceptionMacro( << "Unknown operation " << step.Arguments[0] );
+    }
+
+  return output;
+}
+
+template <unsigned int ImageDimension>
+typename ImagePipeline<ImageDimension>::ImagePointer
+ImagePipeline<ImageDimension>
+::MultipleOperateImages( const PipelineStep & step )
+{
+  enum { Mean, Sum, Max } reducer;
+  const std::string op = step.Arguments.empty()
+    ? std::string() : step.Arguments[0];
+  if( op == "mean" )
+    {
+    reducer = Mean;
+    }
+  else if( op == "sum" )
+    {
+    reducer = Sum;
+    }
+  else if( op == "max" )
+    {
+    reducer = Max;
+    }
+  else
+    {
+    itkGenericExceptionMacro( << "Unsupported operation " << op );
+    }
+
+  ImagePointer output = DuplicateImage( this->GetImage( step.Inputs[0] ) );
+  const LabelImageType *mask = NULL;
+
+  float N = 1.0;
+  for( unsigned int n = 1; n < step.Inputs.size(); n++ )
+    {
+    const ImageType *image = this->GetImage( step.Inputs[n] );
+
+    N += 1.0;
+    switch( reducer )
+      {
+      case Mean:
+        AccumulateMeanImage<ImageType, LabelImageType>( output, image, mask, N );
+        break;
+      case Sum:
+        AccumulateSumImage<ImageType, LabelImageType>( output, image, mask );
+        break;
+      case Max:
+        AccumulateMaxImage<ImageType, LabelImageType>( output, image, mask );
+        break;
+      }
+    }
+
+  return output;
+}
+
+/**
+ * Reads the pipeline file.  The image arguments of every operation are
+ * moved from the arguments to the inputs.
+ */
+bool ReadPipeline( const char *filename, std::vector<PipelineStep> & steps )
+{
+  std::ifstream str( filename );
+  if( !str )
+    {
+    std::cerr << "Unable to read " << filename << std::endl;
+    return false;
+    }
+
+  std::string line;
+  unsigned int lineNumber = 0;
+  while( std::getline( str, line ) )
+    {
+    lineNumber++;
+    std::string::size_type comment = line.find( '#' );
+    if( comment != std::string::npos )
+      {
+      line = line.substr( 0, comment );
+      }
+
+    std::istringstream tokens( line );
+    std::vector<std::string> words;
+    std::string word;
+    while( tokens >> word )
+      {
+      words.push_back( word );
+      }
+    if( words.empty() )
+      {
+      continue;
+      }
+
+    PipelineStep step;
+    step.Line = lineNumber;
+    step.Wave = 0;
+
+    unsigned int first = 0;
+    if( words.size() > 2 && words[1] == "=" )
+      {
+      step.Output = words[0];
+      first = 2;
+      }
+    step.Operation = words[first];
+    for( unsigned int i = first + 1; i < words.size(); i++ )
+      {
+      step.Arguments.push_back( words[i] );
+      }
+
+    unsigned int numberOfInputs = 1;
+    unsigned int firstInput = 0;
+    if( step.Operation == "Read" )
+      {
+      numberOfInputs = 0;
+      }
+    else if( step.Operation == "MultipleOperateImages" )
+      {
+      firstInput = 1;
+      numberOfInputs = ( step.Arguments.size() > 1 )
+        ? step.Arguments.size() - 1 : 0;
+      }
+
+    if( step.Arguments.size() < firstInput + numberOfInputs
+      || ( step.Operation == "Write" ) != step.Output.empty() )
+      {
+      std::cerr << "Line " << lineNumber << ": malformed step." << std::endl;
+      return false;
+      }
+    if( step.Operation == "MultipleOperateImages" && numberOfInputs == 0 )
+      {
+      std::cerr << "Line " << lineNumber << ": no input images." << std::endl;
+      return false;
+      }
+
+    step.Inputs.assign( step.Arguments.begin() + firstInput,
+      step.Arguments.begin() + firstInput + numberOfInputs );
+    step.Arguments.erase( step.Arguments.begin() + firstInput,
+      step.Arguments.begin() + firstInput + numberOfInputs );
+
+    if( ( step.Operation == "Read" || step.Operation == "Write" )
+      && step.Arguments.empty() )
+      {
+      std::cerr << "Line " << lineNumber << ": no file name." << std::endl;
+      return false;
+      }
+
+    steps.push_back( step );
+    }
+  return true;
+}
+
+int main( int argc, char *argv[] )
+{
+  if( argc < 3 )
+    {
+    std::cerr << "Usage: " << argv[0] << " imageDimension pipelineFile "
+      << "[numberOfConcurrentSteps=2]" << std::endl;
+    std::cerr << "  pipeline file (one step per line):" << std::endl;
+    std::cerr << "    name = Read file" << std::endl;
+    std::cerr << "    name = ThresholdImage input lower upper [inside] [outside]" << std::endl;
+    std::cerr << "    name = BinaryMorphology input operation [radius] [type] "
+      << "[foreground] [background] [engine]" << std::endl;
+    std::cerr << "    name = GetConnectedComponents input [relabelOnly] [sizeThreshold]" << std::endl;
+    std::cerr << "    name = UnaryOperateImage input operation constant [arguments]" << std::endl;
+    std::cerr << "    name = MultipleOperateImages mean|sum|max input1 input2 ..." << std::endl;
+    std::cerr << "    Write input file" << std::endl;
+    exit( 1 );
+    }
+
+  std::vector<PipelineStep> steps;
+  if( !ReadPipeline( argv[2], steps ) )
+    {
+    exit( 1 );
+    }
+
+  unsigned int numberOfConcurrentSteps = 2;
+  if( argc > 3 )
+    {
+    numberOfConcurrentSteps = vnl_math_max( 1, atoi( argv[3] ) );
+    }
+
+  switch( atoi( argv[1] ) )
+   {
+   case 2:
+     {
+     ImagePipeline<2> pipeline( steps, numberOfConcurrentSteps );
+     return pipeline.Run();
+     }
+   case 3:
+     {
+     ImagePipeline<3> pipeline( steps, numberOfConcurrentSteps );
+     return pipeline.Run();
+     }
+   default:
+      std::cerr << "Unsupported dimension" << std::endl;
+      exit( EXIT_FAILURE );
+   }
+}
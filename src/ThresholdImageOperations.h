@@ -0,0 +1,28 @@
+#ifndef __ThresholdImageOperations_h
+#define __ThresholdImageOperations_h
+
+#include "itkBinaryThresholdImageFilter.h"
+
+/**
+ * The operation of ThresholdImage: voxels in [lower, upper] are set to
+ * inside, all others to outside.  The input is left untouched.
+ */
+template<class TImage>
+typename TImage::Pointer BinaryThresholdImage( const TImage *input,
+  typename TImage::PixelType lower, typename TImage::PixelType upper,
+  typename TImage::PixelType inside, typename TImage::PixelType outside )
+{
+  typedef itk::BinaryThresholdImageFilter<TImage, TImage> FilterType;
+  typename FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( input );
+  filter->SetLowerThreshold( lower );
+  filter->SetUpperThreshold( upper );
+  filter->SetInsideValue( inside );
+  filter->SetOutsideValue( outside );
+  filter->InPlaceOff();
+  filter->Update();
+
+  return filter->GetOutput();
+}
+
+#endif
@@ -1,10 +1,10 @@
 #include "itkImage.h"
 #include "itkImageFileReader.h"
-#include "itkImageRegionIteratorWithIndex.h"
 #include "itkImageFileWriter.h"
 #include "itkGaussianInterpolateImageFunction.h"
 
 #include "Common.h"
+#include "UnaryOperateImageOperations.h"
 
 template <unsigned int ImageDimension>
 int UnaryOperateImage( int argc, char * argv[] )
@@ -88,100 +88,16 @@ int UnaryOperateImage( int argc, char * argv[] )
     }
   else
     {
-    itk::ImageRegionIteratorWithIndex<ImageType> It( reader->GetOutput(),
-      reader->GetOutput()->GetLargestPossibleRegion() );
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    std::vector<std::string> arguments;
+    for( int n = 6; n < argc; n++ )
       {
-      switch( argv[3][0] )
-        {
-        case '+':
-          {
-          It.Set( It.Get() + atof( argv[4] ) );
-          break;
-          }
-        case '-':
-          {
-          It.Set( It.Get() - atof( argv[4] ) );
-          break;
-          }
-        case 'x':
-          {
-          It.Set( It.Get() * atof( argv[4] ) );
-          break;
-          }
-        case '/':
-          {
-          It.Set( It.Get() / atof( argv[4] ) );
-          break;
-          }
-        case '^':
-          {
-          It.Set( static_cast<PixelType>( vcl_pow( static_cast<double>( It.Get() ),
-            static_cast<double>( atof( argv[4] ) ) ) ) );
-          break;
-          }
-        case 'f':
-          {
-          It.Set( vnl_math_max( static_cast<float>( It.Get() ), static_cast<float>( atof( argv[4] ) ) ) );
-          break;
-          }
-        case 'e':
-          {
-          It.Set( static_cast<PixelType>( vcl_exp( static_cast<double>( It.Get() ) ) ) );
-          break;
-          }
-        case 'l':
-          {
-          It.Set( static_cast<PixelType>( vcl_log( static_cast<double>( It.Get() ) ) ) );
-          break;
-          }
-        case 'b':
-          {
-          It.Set( 1.0 / ( 1.0 + It.Get() ) );
-          break;
-          }
-        case 's':
-          {
-          It.Set( 1.0 / ( 1.0 + vcl_exp( -( It.Get() - atof( argv[7] ) ) / ( atof( argv[6] ) ) ) ) );
-          break;
-          }
-        case 'r':
-          {
-          if( strcmp( "nan", argv[6] ) == 0 )
-            {
-            if( vnl_math_isnan( It.Get() ) )
-              {
-              It.Set( atof( argv[7] ) );
-              }
-            }
-          else if( strcmp( "inf", argv[6] ) == 0 )
-            {
-            if( vnl_math_isinf( It.Get() ) )
-              {
-              It.Set( atof( argv[7] ) );
-              }
-            }
-          else if( It.Get() == atof( argv[6] ) )
-            {
-            It.Set( atof( argv[7] ) );
-            }
-          break;
-          }
-        case 't':
-          {
-          if( It.Get() >= atof( argv[6] ) && It.Get() <= atof( argv[7] ) )
-            {
-            It.Set( atof( argv[8] ) );
-            }
-          break;
-          }
-        default:
-          {
-          std::cerr << "Error: Unknown operation." << std::endl;
-          exit( 1 );
-          break;
-          }
-        }
+      arguments.push_back( std::string( argv[n] ) );
+      }
+    if( !UnaryOperateImageInPlace<ImageType>( reader->GetOutput(), argv[3][0],
+      atof( argv[4] ), arguments ) )
+      {
+      std::cerr << "Error: Unknown operation." << std::endl;
+      exit( 1 );
       }
     }
 
@@ -0,0 +1,240 @@
+#ifndef __UnaryOperateImageOperations_h
+#define __UnaryOperateImageOperations_h
+
+#include "itkImageRegionIterator.h"
+
+#include "vnl/vnl_math.h"
+#include "vcl_cmath.h"
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+/**
+ * The element-wise operations of UnaryOperateImage.  Each functor maps a
+ * voxel value to its new value.
+ */
+namespace UnaryOperateImageFunctors
+{
+struct Add
+  {
+  double Constant;
+  double operator()( double value ) const { return value + this->Constant; }
+  };
+struct Subtract
+  {
+  double Constant;
+  double operator()( double value ) const { return value - this->Constant; }
+  };
+struct Multiply
+  {
+  double Constant;
+  double operator()( double value ) const { return value * this->Constant; }
+  };
+struct Divide
+  {
+  double Constant;
+  double operator()( double value ) const { return value / this->Constant; }
+  };
+struct Power
+  {
+  double Constant;
+  double operator()( double value ) const
+    {
+    return vcl_pow( value, this->Constant );
+    }
+  };
+struct Floor
+  {
+  float Constant;
+  double operator()( double value ) const
+    {
+    return vnl_math_max( static_cast<float>( value ), this->Constant );
+    }
+  };
+struct Exp
+  {
+  double operator()( double value ) const { return vcl_exp( value ); }
+  };
+struct Log
+  {
+  double operator()( double value ) const { return vcl_log( value ); }
+  };
+struct BoundedReciprocal
+  {
+  double operator()( double value ) const { return 1.0 / ( 1.0 + value ); }
+  };
+struct Sigmoid
+  {
+  double Alpha;
+  double Beta;
+  double operator()( double value ) const
+    {
+    return 1.0 / ( 1.0 + vcl_exp( -( value - this->Beta ) / this->Alpha ) );
+    }
+  };
+struct ReplaceNaN
+  {
+  double NewValue;
+  double operator()( double value ) const
+    {
+    return vnl_math_isnan( value ) ? this->NewValue : value;
+    }
+  };
+struct ReplaceInf
+  {
+  double NewValue;
+  double operator()( double value ) const
+    {
+    return vnl_math_isinf( value ) ? this->NewValue : value;
+    }
+  };
+struct Replace
+  {
+  double OldValue;
+  double NewValue;
+  double operator()( double value ) const
+    {
+    return ( value == this->OldValue ) ? this->NewValue : value;
+    }
+  };
+struct ReplaceRange
+  {
+  double Low;
+  double High;
+  double NewValue;
+  double operator()( double value ) const
+    {
+    return ( value >= this->Low && value <= this->High )
+      ? this->NewValue : value;
+    }
+  };
+} // end namespace UnaryOperateImageFunctors
+
+template<class TImage, class TFunction>
+void UnaryOperateImageVoxels( TImage *image, const TFunction & function )
+{
+  typedef typename TImage::PixelType PixelType;
+
+  itk::ImageRegionIterator<TImage> It( image,
+    image->GetLargestPossibleRegion() );
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    It.Set( static_cast<PixelType>( function( It.Get() ) ) );
+    }
+}
+
+/**
+ * Applies the element-wise operation of UnaryOperateImage to the image in
+ * place.  The operation is chosen once, before the voxel loop.  arguments
+ * holds the arguments after the output image of the tool (argv[6],
+ * argv[7], ...); missing ones are 0.  Returns false if the operation is
+ * not element-wise.
+ */
+template<class TImage>
+bool UnaryOperateImageInPlace( TImage *image, char operation,
+  double constant, const std::vector<std::string> & arguments )
+{
+  using namespace UnaryOperateImageFunctors;
+
+  double argument[3] = { 0.0, 0.0, 0.0 };
+  for( unsigned int i = 0; i < 3 && i < arguments.size(); i++ )
+    {
+    argument[i] = atof( arguments[i].c_str() );
+    }
+
+  switch( operation )
+    {
+    case '+':
+      {
+      Add function = { constant };
+      UnaryOperateImageVoxels( image, function );
+      break;
+      }
+    case '-':
+      {
+      Subtract function = { constant };
+      UnaryOperateImageVoxels( image, function );
+      break;
+      }
+    case 'x':
+      {
+      Multiply function = { constant };
+      UnaryOperateImageVoxels( image, function );
+      break;
+      }
+    case '/':
+      {
+      Divide function = { constant };
+      UnaryOperateImageVoxels( image, function );
+      break;
+      }
+    case '^':
+      {
+      Power function = { constant };
+      UnaryOperateImageVoxels( image, function );
+      break;
+      }
+    case 'f':
+      {
+      Floor function = { static_cast<float>( constant ) };
+      UnaryOperateImageVoxels( image, function );
+      break;
+      }
+    case 'e':
+      {
+      UnaryOperateImageVoxels( image, Exp() );
+      break;
+      }
+    case 'l':
+      {
+      UnaryOperateImageVoxels( image, Log() );
+      break;
+      }
+    case 'b':
+      {
+      UnaryOperateImageVoxels( image, BoundedReciprocal() );
+      break;
+      }
+    case 's':
+      {
+      Sigmoid function = { argument[0], argument[1] };
+      UnaryOperateImageVoxels( image, function );
+      break;
+      }
+    case 'r':
+      {
+      const std::string oldValue = arguments.empty()
+        ? std::string() : arguments[0];
+      if( oldValue == "nan" )
+        {
+        ReplaceNaN function = { argument[1] };
+        UnaryOperateImageVoxels( image, function );
+        }
+      else if( oldValue == "inf" )
+        {
+        ReplaceInf function = { argument[1] };
+        UnaryOperateImageVoxels( image, function );
+        }
+      else
+        {
+        Replace function = { argument[0], argument[1] };
+        UnaryOperateImageVoxels( image, function );
+        }
+      break;
+      }
+    case 't':
+      {
+      ReplaceRange function = { argument[0], argument[1], argument[2] };
+      UnaryOperateImageVoxels( image, function );
+      break;
+      }
+    default:
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+#endif
@@ -1,15 +1,19 @@
-#include "itkContinuousIndex.h"
+#include "itkDisplacementFieldPointWarper.h"
 #include "itkLabeledPointSetFileReader.h"
 #include "itkLabeledPointSetFileWriter.h"
 #include "itkPointSet.h"
 #include "itkImageFileReader.h"
-#include "itkVectorLinearInterpolateImageFunction.h"
+#include "itkTransformFactory.h"
+#include "itkTransformFileReader.h"
+
+#include <itksys/SystemTools.hxx>
+
+#include <string>
 
 template <unsigned int ImageDimension>
 int WarpPoints( int argc, char *argv[] )
 {
   typedef float RealType;
-  typedef itk::Image<RealType, ImageDimension> RealImageType;
   typedef itk::Vector<RealType, ImageDimension> VectorType;
   typedef itk::Image<VectorType, ImageDimension> DeformationFieldType;
 
@@ -20,94 +24,128 @@ int WarpPoints( int argc, char *argv[] )
   reader->SetFileName( argv[2] );
   reader->Update();
 
-//  try
-//    {
-    typedef itk::ImageFileReader<DeformationFieldType> FieldReaderType;
-    typename FieldReaderType::Pointer fieldreader = FieldReaderType::New();
-    fieldreader->SetFileName( argv[3] );
-    fieldreader->Update();
-
-    typedef itk::VectorLinearInterpolateImageFunction
-      <DeformationFieldType, RealType> DeformationFieldInterpolatorType;
-    typename DeformationFieldInterpolatorType::Pointer interpolator
-      = DeformationFieldInterpolatorType::New();
-    interpolator->SetInputImage( fieldreader->GetOutput() );
-
-    typename PointSetType::PointsContainerIterator It
-      = reader->GetOutput()->GetPoints()->Begin();
-    typename PointSetType::PointDataContainerIterator ItL
-      = reader->GetOutput()->GetPointData()->Begin();
-
-    typename PointSetType::Pointer output = PointSetType::New();
-    output->Initialize();
-
-    unsigned long idx = 0;
-    while( It != reader->GetOutput()->GetPoints()->End() )
+  /**
+   * The chain is the deformation field followed by the optional
+   * transforms, applied in the order given.  Affine transforms are read
+   * from transform files and can be inverted with a preceding "-i".
+   */
+  typedef itk::DisplacementFieldPointWarper<DeformationFieldType> WarperType;
+  typename WarperType::Pointer warper = WarperType::New();
+
+  typedef typename WarperType::AffineTransformType AffineTransformType;
+  itk::TransformFactory<AffineTransformType>::RegisterTransform();
+
+  std::vector<std::string> stages( 1, std::string( argv[3] ) );
+  for( int n = 5; n < argc; n++ )
+    {
+    stages.push_back( std::string( argv[n] ) );
+    }
+
+  bool invertNext = false;
+  for( unsigned int n = 0; n < stages.size(); n++ )
+    {
+    if( stages[n] == "-i" )
+      {
+      invertNext = true;
+      continue;
+      }
+
+    const std::string extension
+      = itksys::SystemTools::GetFilenameLastExtension( stages[n] );
+    if( extension == ".txt" || extension == ".tfm" || extension == ".mat" )
       {
-      typename DeformationFieldInterpolatorType::PointType point;
-      point.CastFrom( It.Value() );
+      typedef itk::TransformFileReader TransformReaderType;
+      TransformReaderType::Pointer transformReader
+        = TransformReaderType::New();
+      transformReader->SetFileName( stages[n].c_str() );
+      transformReader->Update();
 
-      if( interpolator->IsInsideBuffer( point ) )
+      const AffineTransformType *transform
+        = dynamic_cast<const AffineTransformType *>(
+        transformReader->GetTransformList()->front().GetPointer() );
+      if( !transform )
         {
-        typename DeformationFieldInterpolatorType::OutputType vec
-          = interpolator->Evaluate( point );
-        PointType newPoint = It.Value() + vec;
-        output->SetPoint( idx, newPoint );
-        output->SetPointData( idx, ItL.Value() );
-        idx++;
+        std::cerr << stages[n] << " is not an affine transform." << std::endl;
+        return EXIT_FAILURE;
+        }
+      if( invertNext )
+        {
+        typename AffineTransformType::Pointer inverse
+          = AffineTransformType::New();
+        if( !transform->GetInverse( inverse ) )
+          {
+          std::cerr << stages[n] << " is not invertible." << std::endl;
+          return EXIT_FAILURE;
+          }
+        warper->AddAffineTransform( inverse );
+        }
+      else
+        {
+        warper->AddAffineTransform( transform );
         }
-      ++It;
-      ++ItL;
       }
-    typedef itk::LabeledPointSetFileWriter<PointSetType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetFileName( argv[4] );
-    writer->SetInput( output );
-    writer->Update();
-//    }
-//  catch(...)
-//    {
-//    typedef itk::ImageFileReader<RealImageType> ImageReaderType;
-//    typename ImageReaderType::Pointer imagereader = ImageReaderType::New();
-//    imagereader->SetFileName( argv[3] );
-//    imagereader->Update();
-//
-//    typename PointSetType::PointsContainerIterator It
-//      = reader->GetOutput()->GetPoints()->Begin();
-//    typename PointSetType::PointDataContainerIterator ItL
-//      = reader->GetOutput()->GetPointData()->Begin();
-//
-//    typename PointSetType::Pointer output = PointSetType::New();
-//    output->Initialize();
-//
-//    unsigned long idx = 0;
-//    while( It != reader->GetOutput()->GetPoints()->End() )
-//      {
-//      typename RealImageType::PointType point;
-//      point.CastFrom( It.Value() );
-//
-//      itk::ContinuousIndex<double, ImageDimension> cidx;
-//      for( unsigned int d = 0; d < ImageDimension; d++ )
-//        {
-//        cidx[d] = point[d];
-//        }
-//
-//      if( imagereader->GetOutput()->GetLargestPossibleRegion().IsInside( cidx ) )
-//        {
-//        imagereader->GetOutput()->TransformContinuousIndexToPhysicalPoint( cidx, point );
-//        output->SetPoint( idx, point );
-//        output->SetPointData( idx, ItL.Value() );
-//        idx++;
-//        }
-//      ++It;
-//      ++ItL;
-//      }
-//    typedef itk::LabeledPointSetFileWriter<PointSetType> WriterType;
-//    typename WriterType::Pointer writer = WriterType::New();
-//    writer->SetFileName( argv[4] );
-//    writer->SetInput( output );
-//    writer->Update();
-//    }
+    else
+      {
+      if( invertNext )
+        {
+        std::cerr << "Only affine transforms can be inverted." << std::endl;
+        return EXIT_FAILURE;
+        }
+      typedef itk::ImageFileReader<DeformationFieldType> FieldReaderType;
+      typename FieldReaderType::Pointer fieldreader = FieldReaderType::New();
+      fieldreader->SetFileName( stages[n].c_str() );
+      fieldreader->Update();
+      warper->AddDisplacementField( fieldreader->GetOutput() );
+      }
+    invertNext = false;
+    }
+  if( invertNext )
+    {
+    std::cerr << "\"-i\" must be followed by an affine transform file." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  typename WarperType::PointContainerType points;
+  points.reserve( reader->GetOutput()->GetNumberOfPoints() );
+  typename PointSetType::PointsContainerIterator It
+    = reader->GetOutput()->GetPoints()->Begin();
+  while( It != reader->GetOutput()->GetPoints()->End() )
+    {
+    typename WarperType::PointType point;
+    point.CastFrom( It.Value() );
+    points.push_back( point );
+    ++It;
+    }
+
+  typename WarperType::PointContainerType warpedPoints;
+  typename WarperType::InsideContainerType isInside;
+  warper->Warp( points, warpedPoints, isInside );
+
+  typename PointSetType::Pointer output = PointSetType::New();
+  output->Initialize();
+
+  typename PointSetType::PointDataContainerIterator ItL
+    = reader->GetOutput()->GetPointData()->Begin();
+
+  unsigned long idx = 0;
+  for( unsigned long n = 0; n < warpedPoints.size(); n++, ++ItL )
+    {
+    if( isInside[n] )
+      {
+      PointType newPoint;
+      newPoint.CastFrom( warpedPoints[n] );
+      output->SetPoint( idx, newPoint );
+      output->SetPointData( idx, ItL.Value() );
+      idx++;
+      }
+    }
+
+  typedef itk::LabeledPointSetFileWriter<PointSetType> WriterType;
+  typename WriterType::Pointer writer = WriterType::New();
+  writer->SetFileName( argv[4] );
+  writer->SetInput( output );
+  writer->Update();
+
   return EXIT_SUCCESS;
 }
 
@@ -115,17 +153,22 @@ int main( int argc, char *argv[] )
 {
   if ( argc < 5 )
     {
-    std::cout << argv[0] << " ImageDimension inputPointSet deformationField outputPointSet" << std::endl;
+    std::cout << argv[0] << " ImageDimension inputPointSet deformationField outputPointSet "
+      << "[transform1] [transform2] ..." << std::endl;
+    std::cout << "  The deformation field and then the transforms (deformation fields "
+      << "or affine .txt/.tfm/.mat files, \"-i\" before an affine file to invert "
+      << "it) are applied in order.  Points that leave a field are dropped."
+      << std::endl;
     exit( 1 );
     }
 
   switch( atoi( argv[1] ) )
    {
    case 2:
-     WarpPoints<2>( argc, argv );
+     return WarpPoints<2>( argc, argv );
      break;
    case 3:
-     WarpPoints<3>( argc, argv );
+     return WarpPoints<3>( argc, argv );
      break;
    default:
       std::cerr << "Unsupported dimension" << std::endl;